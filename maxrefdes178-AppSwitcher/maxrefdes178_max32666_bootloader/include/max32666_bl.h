@@ -56,6 +56,12 @@ typedef struct {
 	Becase Linker exposes boot_mode varible in the flash memory.
 	*/
 } app_header_t;
+
+typedef struct {
+	uint32_t last_cycles;
+	uint64_t cycles;
+} bl_timer_t;
+
 extern void *_app_isr[];
 extern int _app_start;
 extern int _app_end;
@@ -65,4 +71,9 @@ extern int _boot_mem_start;
 //int selfprogrammer_flash_image(const char *image);
 int bl_load_from_sdcard(const char* filename);
 int bl_master_erase();
+// Keeps the app from starting until bl_load_from_sdcard programmed a new one
+int bl_invalidate_app();
+// Cycle counter based stopwatch, must be sampled at least every ~40 seconds
+void bl_timer_start(bl_timer_t *timer);
+uint32_t bl_timer_elapsed_ms(bl_timer_t *timer);
 #endif /* INCLUDE_MAX32666_BL_H_ */
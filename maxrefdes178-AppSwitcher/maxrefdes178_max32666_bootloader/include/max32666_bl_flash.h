@@ -0,0 +1,87 @@
+/*******************************************************************************
+* Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+*
+* This software is protected by copyright laws of the United States and
+* of foreign countries. This material may also be protected by patent laws
+* and technology transfer regulations of the United States and of foreign
+* countries. This software is furnished under a license agreement and/or a
+* nondisclosure agreement and may only be used or reproduced in accordance
+* with the terms of those agreements. Dissemination of this information to
+* any party or parties not specified in the license agreement and/or
+* nondisclosure agreement is expressly prohibited.
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+* OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+* OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+* OTHER DEALINGS IN THE SOFTWARE.
+*
+* Except as contained in this notice, the name of Maxim Integrated
+* Products, Inc. shall not be used except as stated in the Maxim Integrated
+* Products, Inc. Branding Policy.
+*
+* The mere transfer of this software does not imply any licenses
+* of trade secrets, proprietary technology, copyrights, patents,
+* trademarks, maskwork rights, or any other form of intellectual
+* property whatsoever. Maxim Integrated Products, Inc. retains all
+* ownership rights.
+*******************************************************************************
+*/
+
+#ifndef INCLUDE_MAX32666_BL_FLASH_H_
+#define INCLUDE_MAX32666_BL_FLASH_H_
+
+#include <stdint.h>
+#include "max32666_bl.h"
+
+/*
+ * MAX32666 self programming, hardware independent so it also builds on a host.
+ * Flash and the image are reached through bl_flash_t, max32666_bl.c fills it with
+ * the FLC driver and the FatFs file.
+ *
+ * The app is only started by the bootloader when its first page holds a vector
+ * table, so that page is erased first and programmed last. Any interruption in
+ * between leaves the bootloader in charge with the valid mark cleared.
+ */
+
+typedef enum {
+	BL_FLASH_MODE_FULL = 0,	// Erase the app region and program every page
+	BL_FLASH_MODE_DIFF,		// Erase and program only the pages that differ
+} bl_flash_mode_e;
+
+typedef struct {
+	uint32_t app_start;			// Page aligned, first page holds the vector table
+	uint32_t app_end;
+	uint32_t boot_mem_start;	// app_header_t, at the end of the last app page
+	uint32_t boot_mem_len;
+
+	const uint8_t *(*mem)(uint32_t address);	// Flash contents at an address
+	int (*erase_page)(uint32_t address);
+	int (*prog)(uint32_t address, uint32_t size, const uint8_t *buffer);	// Verifies by read back
+	int (*read_page)(uint8_t *page);	// Next decrypted PAGE_PAYLOAD_SIZE bytes of the image
+	int (*authenticate)(void);			// After the last page, 0 if valid, optional
+	void (*progress)(int page, int pages);	// Optional
+} bl_flash_t;
+
+typedef struct {
+	int pages;			// Image pages, app header page included
+	int skipped;		// Already in flash
+	int erased;			// Page erases
+	int programmed;		// Page programs
+} bl_flash_stats_t;
+
+int bl_flash_master_erase(const bl_flash_t *flash);
+// Erases the vector table page and clears the valid mark, app is not started until programmed again
+int bl_flash_invalidate(const bl_flash_t *flash);
+// Programs an image of pages pages that is read through read_page, master erases on a bad image
+int bl_flash_program(const bl_flash_t *flash, int pages, bl_flash_mode_e mode, bl_flash_stats_t *stats);
+//Return 0 if valid
+int bl_flash_app_valid(const bl_flash_t *flash, unsigned char valid_check_flag);
+int bl_flash_app_crc(const bl_flash_t *flash);
+
+#endif /* INCLUDE_MAX32666_BL_FLASH_H_ */
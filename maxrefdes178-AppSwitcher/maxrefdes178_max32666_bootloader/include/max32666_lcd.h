@@ -62,6 +62,7 @@ extern char line_str[80];
 //-----------------------------------------------------------------------------
 int lcd_init(void);
 int lcd_drawImage(uint8_t *data);
+int lcd_drawRows(uint8_t *data, uint16_t y, uint16_t h);
 int lcd_backlight(int on, uint8_t level);
 int lcd_set_rotation(lcd_rotation_e lcd_rotation);
 int lcd_notification(uint16_t color, const char *notification);
@@ -42,21 +42,43 @@
 #include <sdhc_lib.h>
 #include <mxc_delay.h>
 #include "max32666_bl.h"
+#include "max32666_bl_flash.h"
 #include "max32666_debug.h"
 #include "max32666_loader.h"
 #include "max32666_fonts.h"
 #include "max32666_lcd.h"
-#include "crc32.h"
 
 #define S_MODULE_NAME   "bl"
 extern FIL file;
 extern TCHAR *FF_ERRORS[ERROR_MAX_LEN];
 
-static uint8_t page_plain[PAGE_PAYLOAD_SIZE] __attribute__ ((aligned (4)));
+static bl_flash_t bl_flash;
+static bl_timer_t load_timer;
+static FIL *load_file;
 #if defined(SECURE_BOOTLOADER)
 static uint8_t page_cipher[FLC_PAGE_SIZE + CHECKBYTE_16] __attribute__ ((aligned (4)));
 #endif
 
+void bl_timer_start(bl_timer_t *timer)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	timer->last_cycles = DWT->CYCCNT;
+	timer->cycles = 0;
+}
+
+uint32_t bl_timer_elapsed_ms(bl_timer_t *timer)
+{
+	uint32_t now = DWT->CYCCNT;
+
+	// Unsigned difference handles a single counter wrap between samples
+	timer->cycles += (uint32_t)(now - timer->last_cycles);
+	timer->last_cycles = now;
+
+	return (uint32_t)(timer->cycles / (SystemCoreClock / 1000));
+}
+
 int flc_init(void)
 {
     return MXC_FLC_Init();
@@ -110,134 +132,106 @@ int flc_prog_page(uint32_t address, uint32_t size, uint8_t *buffer)
     return 0;
 }
 
-static int erase_boot_mem_page(unsigned char delete_mark)
+static const uint8_t *bl_flash_mem(uint32_t address)
 {
-	int ret;
-	uint8_t bootmem_buf[(unsigned long)&_boot_mem_len];
+	return (const uint8_t *)address;
+}
 
-	memcpy(bootmem_buf, (void *)&_boot_mem_start, (unsigned long)&_boot_mem_len);
+static int bl_flash_prog(uint32_t address, uint32_t size, const uint8_t *buffer)
+{
+	return flc_prog_page(address, size, (uint8_t *)buffer);
+}
 
-    app_header_t *header = (app_header_t *)bootmem_buf;
-	if (delete_mark) {
-	   header->valid_mark = 0;
-	}
+static int bl_read_page(uint8_t *page)
+{
+	unsigned int bytes_read;
 
-	ret = flc_erase_page((unsigned long)&_boot_mem_start);
-	if (ret)
-	{
+#if defined(SECURE_BOOTLOADER)
+	if (f_read(load_file, page_cipher, FLC_PAGE_SIZE + CHECKBYTE_16, &bytes_read) != FR_OK) {
 		return -1;
 	}
-
-	ret = flc_prog_page((unsigned long)&_boot_mem_start, (unsigned long)&_boot_mem_len, bootmem_buf);
-	if (ret) {
+	bl_security_decrypt(page, page_cipher, FLC_PAGE_SIZE + CHECKBYTE_16);
+#else
+	if (f_read(load_file, page, FLC_PAGE_SIZE + CHECKBYTE_16, &bytes_read) != FR_OK) {
 		return -1;
 	}
+#endif
 
-	return 0;
+	return (bytes_read == (FLC_PAGE_SIZE + CHECKBYTE_16)) ? 0 : -1;
 }
 
+#if defined(SECURE_BOOTLOADER)
+static int bl_authenticate(void)
+{
+	return bl_security_decrypt_auth_valid() ? 0 : -1;
+}
+#endif
+
+static void bl_progress(int page, int pages)
+{
+	// Only the progress line changes, redraw its rows instead of the whole screen
+	sprintf(line_str, "MAX32666 FW %d/%d", page, pages);
+	fonts_putStringOver(1, 100, line_str, &Font_7x10, BLACK, 0, 0, lcd_buff);
+	lcd_drawRows(lcd_buff, 100, Font_7x10.height);
+	bl_timer_elapsed_ms(&load_timer);
+}
+
+static const bl_flash_t *bl_flash_setup(void)
+{
+	bl_flash.app_start      = (uint32_t)&_app_start;
+	bl_flash.app_end        = (uint32_t)&_app_end;
+	bl_flash.boot_mem_start = (uint32_t)&_boot_mem_start;
+	bl_flash.boot_mem_len   = (uint32_t)&_boot_mem_len;
+	bl_flash.mem            = bl_flash_mem;
+	bl_flash.erase_page     = flc_erase_page;
+	bl_flash.prog           = bl_flash_prog;
+	bl_flash.read_page      = bl_read_page;
+#if defined(SECURE_BOOTLOADER)
+	bl_flash.authenticate   = bl_authenticate;
+#else
+	bl_flash.authenticate   = NULL;
+#endif
+	bl_flash.progress       = bl_progress;
+
+	return &bl_flash;
+}
 
 int bl_master_erase()
 {
 	int ret;
-	int startPage;
-	int currentPage;
-	int lastPage;
-	int memLoc;
-	unsigned long flash_size, app_start_loc;
 
 	flc_uninit();
 	flc_init();
-	app_start_loc = (unsigned long)&_app_start;
-
-	flash_size = (unsigned long)&_app_end - (unsigned long)&_app_start;
-
-	startPage = ((app_start_loc - MXC_FLASH_MEM_BASE) >> FLC_PAGE_BIT_SIZE);
-	lastPage = (flash_size >> FLC_PAGE_BIT_SIZE) + startPage;
-
-
-	for (currentPage = startPage; currentPage < lastPage; currentPage++) {
-		memLoc = MXC_FLASH_MEM_BASE + (currentPage * FLC_PAGE_SIZE);
-
-		ret = flc_erase_page(memLoc);
-		if (ret)
-		{
-			flc_uninit();
-			return ret;
-		}
-	}
-
-	erase_boot_mem_page(1);
+	ret = bl_flash_master_erase(bl_flash_setup());
 	flc_uninit();
-	return 0;
+
+	return ret;
 }
 
-//Return 0 if valid
-//Return others if not valid
-char check_if_app_is_valid(unsigned char valid_check_flag)
+int bl_invalidate_app()
 {
-	unsigned long flash_size = (unsigned long)&_app_end - (unsigned long)&_app_start;
-	//Does app have a valid isr vector table?
-	if ((uint32_t)_app_isr[1] == UNINITIALIZED_MEM) {
-		return -1;
-	}
-
-	if(valid_check_flag) {
-		//Get application crc from app header/footer
-		app_header_t *header = (app_header_t *)&_boot_mem_start;
-
-		if ((header->length == UNINITIALIZED_MEM) || (header->length > flash_size)) {
-			return -2;
-		} else if (header->valid_mark != MARK_VALID_MAGIC_VAL) {
-			return -3;
-		} else if (_boot_mode == UNINITIALIZED_MEM) {
-			return -4;
-		}
-	}
+	int ret;
 
-	return 0;
-}
+	flc_uninit();
+	flc_init();
+	ret = bl_flash_invalidate(bl_flash_setup());
+	flc_uninit();
 
-//Return 0 if valid
-//Return others if not valid
-char check_app_crc(unsigned char crc_check_flag)
-{
-	unsigned long app_start_loc = (unsigned long)&_app_start;
-	if(crc_check_flag) {
-		//Get application crc from app header/footer
-		app_header_t *header = (app_header_t *)&_boot_mem_start;
-	    MXC_Delay(MXC_DELAY_MSEC(10)); // magic delay
-		uint32_t app_crc = calcCrc32((uint8_t*)app_start_loc, header->length);
-		if (app_crc == header->CRC32) {
-			return 0;
-		} else {
-			return -1;
-		}
-	}
-	return 0;
+	return ret;
 }
 
 int bl_load_image(FIL *file)
 {
 	int ret;
-	int startPage;
-	int currentPage;
-	int bootMemPage;
-	int endPage;
 	MsblHeader_t header;
-	unsigned long app_start_loc = (unsigned long)&_app_start;
 	unsigned int bytes_read;
-	unsigned long memLoc;
-	unsigned long flc_write_size;
-	unsigned char is_app_valid = -1;
-	unsigned char is_crc_ok = -1;
+	bl_flash_stats_t stats;
 
+	bl_timer_start(&load_timer);
 	f_read(file, &header, sizeof(MsblHeader_t), &bytes_read);
 
     MXC_Delay(MXC_DELAY_MSEC(10)); // magic delay
 
-	//memcpy(&header, image, sizeof(MsblHeader_t));
-
 #if defined(SECURE_BOOTLOADER)
 	bl_security_set_aes_auth(header.auth,sizeof(header.auth));
 	bl_security_set_aes_nonce(header.nonce,sizeof(header.nonce));
@@ -248,94 +242,20 @@ int bl_load_image(FIL *file)
     }
 #endif
 
-	ret = bl_master_erase();
-    if (ret) {
-        return ret;
-    }
-
-	startPage = ((app_start_loc - MXC_FLASH_MEM_BASE) >> FLC_PAGE_BIT_SIZE);
-	bootMemPage = (uint32_t)&_boot_mem_start - MXC_FLASH_MEM_BASE;
-	bootMemPage >>= FLC_PAGE_BIT_SIZE;
-	currentPage = startPage;
-	endPage = startPage + header.numPages - 1;
-    while (currentPage < (startPage + header.numPages)) {
-
-
-#if defined(SECURE_BOOTLOADER)
-    	f_read(file, page_cipher, FLC_PAGE_SIZE + CHECKBYTE_16, &bytes_read);
-    	bl_security_decrypt(page_plain, page_cipher, FLC_PAGE_SIZE + CHECKBYTE_16);
-
-#else
-    	f_read(file, page_plain, FLC_PAGE_SIZE + CHECKBYTE_16, &bytes_read);
-#endif
-
-		//memcpy(page_plain, (const uint8_t*)&image[sizeof(MsblHeader_t) + (currentPage - startPage)*page_len], FLC_PAGE_SIZE + CHECKBYTE_16);
-		//Checksum
-		if (crcVerifyMsg((const uint8_t*)page_plain, FLC_PAGE_SIZE + CHECK_BYTESIZE)) {
-			return -1;
-		}
-
-		if (currentPage < endPage) { //currentPage < bootMemPage
-			memLoc = (currentPage * FLC_PAGE_SIZE) + MXC_FLASH_MEM_BASE;
-			flc_write_size = FLC_PAGE_SIZE;
-			if(currentPage == bootMemPage) {
-				flc_write_size = FLC_PAGE_SIZE - (unsigned long)&_boot_mem_len;
-			}
-		} else {
-			app_header_t header;
-#if defined(SECURE_BOOTLOADER)
-			char authenticated = bl_security_decrypt_auth_valid();
-			if (!authenticated) {
-				bl_master_erase();
-				return -1;
-			}
-#endif
-
-			memcpy(&header, page_plain, sizeof(app_header_t));
-			if (header.valid_mark) {
-				bl_master_erase();
-				return -1;
-			}
-			if (header.length == 0 || header.length > (_boot_mem_start - _app_start)) {
-				bl_master_erase();
-				return -2;
-			}
-
-			/* Back up page, and update boot memory arguments */
-			memLoc = (bootMemPage * FLC_PAGE_SIZE) + MXC_FLASH_MEM_BASE;
-			memcpy(page_plain, (void *)memLoc, FLC_PAGE_SIZE);
-			header.valid_mark = MARK_VALID_MAGIC_VAL;
-			uint32_t offset = (uint32_t)&_boot_mem_start & (FLC_PAGE_SIZE - 1);
-			memcpy(&page_plain[offset], &header, sizeof(app_header_t));
-			flc_write_size = FLC_PAGE_SIZE;
-			flc_erase_page((uint32_t)memLoc);
-		}
-
-
-		ret = flc_prog_page(memLoc, flc_write_size, page_plain);
-		if (ret) {
-			return -3;
-		}
-		currentPage++;
-
-        sprintf(line_str, "MAX32666 FW %d/%d", currentPage - startPage, header.numPages);
-        fonts_putStringOver(1, 100, line_str, &Font_7x10, BLACK, 0, 0, lcd_buff);
-        lcd_drawImage(lcd_buff);
-	}
-
+	// Pages already in flash are kept, the app is only startable again once all others are done
+	load_file = file;
 	flc_uninit();
-	is_app_valid = check_if_app_is_valid(1);
-	is_crc_ok = check_app_crc(1);
-
-    MXC_Delay(MXC_DELAY_MSEC(10)); // magic delay
-
-	if (is_crc_ok || is_app_valid) {
-		bl_master_erase();
-		return -1;
+	flc_init();
+	ret = bl_flash_program(bl_flash_setup(), header.numPages, BL_FLASH_MODE_DIFF, &stats);
+	flc_uninit();
+	if (ret) {
+		return ret;
 	}
 
-	return 0;
+	PR_INFO("MAX32666 FW %d pages, %d unchanged, %d erased, %d programmed in %u ms", stats.pages,
+			stats.skipped, stats.erased, stats.programmed, bl_timer_elapsed_ms(&load_timer));
 
+	return 0;
 }
 
 int bl_load_from_sdcard(const char* filename)
@@ -0,0 +1,325 @@
+/*******************************************************************************
+* Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+*
+* This software is protected by copyright laws of the United States and
+* of foreign countries. This material may also be protected by patent laws
+* and technology transfer regulations of the United States and of foreign
+* countries. This software is furnished under a license agreement and/or a
+* nondisclosure agreement and may only be used or reproduced in accordance
+* with the terms of those agreements. Dissemination of this information to
+* any party or parties not specified in the license agreement and/or
+* nondisclosure agreement is expressly prohibited.
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+* OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+* OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+* OTHER DEALINGS IN THE SOFTWARE.
+*
+* Except as contained in this notice, the name of Maxim Integrated
+* Products, Inc. shall not be used except as stated in the Maxim Integrated
+* Products, Inc. Branding Policy.
+*
+* The mere transfer of this software does not imply any licenses
+* of trade secrets, proprietary technology, copyrights, patents,
+* trademarks, maskwork rights, or any other form of intellectual
+* property whatsoever. Maxim Integrated Products, Inc. retains all
+* ownership rights.
+*******************************************************************************
+*/
+#include <stdint.h>
+#include <string.h>
+#include "max32666_bl_flash.h"
+#include "crc32.h"
+
+#define VECTOR_TABLE_HEAD	8	// Initial SP and reset vector
+
+static uint8_t page_plain[PAGE_PAYLOAD_SIZE] __attribute__ ((aligned (4)));
+// Vector table page, programmed after everything else
+static uint8_t page_first[FLC_PAGE_SIZE] __attribute__ ((aligned (4)));
+// App bytes of the page that ends with the boot memory, programmed with the app header
+static uint8_t page_last[FLC_PAGE_SIZE] __attribute__ ((aligned (4)));
+
+static uint32_t boot_mem_page(const bl_flash_t *flash)
+{
+	return flash->boot_mem_start & ~(FLC_PAGE_SIZE - 1);
+}
+
+static int is_blank(const uint8_t *mem, uint32_t size)
+{
+	const uint32_t *mem32 = (const uint32_t *)mem;
+	uint32_t i;
+
+	for (i = 0; i < (size >> 2); i++) {
+		if (mem32[i] != UNINITIALIZED_MEM) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static int erase_if_used(const bl_flash_t *flash, uint32_t address, bl_flash_stats_t *stats)
+{
+	if (is_blank(flash->mem(address), FLC_PAGE_SIZE)) {
+		return 0;
+	}
+
+	stats->erased++;
+	return flash->erase_page(address);
+}
+
+// Rewrites the boot memory page with header, app bytes of the page from app or erased if NULL
+static int write_boot_mem(const bl_flash_t *flash, const uint8_t *app, const app_header_t *header,
+		bl_flash_stats_t *stats)
+{
+	uint8_t *page = page_last;
+	uint32_t page_address = boot_mem_page(flash);
+	uint32_t offset = flash->boot_mem_start - page_address;
+	int ret;
+
+	if (!app) {
+		memset(page, 0xff, offset);
+	}
+	memcpy(&page[offset], flash->mem(flash->boot_mem_start), flash->boot_mem_len);
+	memcpy(&page[offset], header, sizeof(app_header_t));
+
+	stats->erased++;
+	ret = flash->erase_page(page_address);
+	if (ret) {
+		return ret;
+	}
+
+	stats->programmed++;
+	if (app) {
+		return flash->prog(page_address, offset + flash->boot_mem_len, page);
+	}
+	return flash->prog(flash->boot_mem_start, flash->boot_mem_len, &page[offset]);
+}
+
+static int write_page(const bl_flash_t *flash, uint32_t address, const uint8_t *data,
+		bl_flash_mode_e mode, bl_flash_stats_t *stats)
+{
+	int ret;
+
+	if ((mode == BL_FLASH_MODE_DIFF) && !memcmp(flash->mem(address), data, FLC_PAGE_SIZE)) {
+		stats->skipped++;
+		return 0;
+	}
+
+	ret = erase_if_used(flash, address, stats);
+	if (ret) {
+		return ret;
+	}
+
+	stats->programmed++;
+	return flash->prog(address, FLC_PAGE_SIZE, data);
+}
+
+static int master_erase(const bl_flash_t *flash, bl_flash_stats_t *stats)
+{
+	app_header_t header;
+	uint32_t address;
+	int ret;
+
+	for (address = flash->app_start; address < boot_mem_page(flash); address += FLC_PAGE_SIZE) {
+		stats->erased++;
+		ret = flash->erase_page(address);
+		if (ret) {
+			return ret;
+		}
+	}
+
+	memcpy(&header, flash->mem(flash->boot_mem_start), sizeof(app_header_t));
+	header.valid_mark = 0;
+	return write_boot_mem(flash, NULL, &header, stats);
+}
+
+static int invalidate(const bl_flash_t *flash, bl_flash_stats_t *stats)
+{
+	app_header_t header;
+	int ret;
+
+	// Vector table first, the old app stays startable and intact until it is gone
+	ret = erase_if_used(flash, flash->app_start, stats);
+	if (ret) {
+		return ret;
+	}
+
+	memcpy(&header, flash->mem(flash->boot_mem_start), sizeof(app_header_t));
+	if (header.valid_mark != MARK_VALID_MAGIC_VAL) {
+		return 0;
+	}
+	header.valid_mark = 0;
+	return write_boot_mem(flash, NULL, &header, stats);
+}
+
+int bl_flash_master_erase(const bl_flash_t *flash)
+{
+	bl_flash_stats_t stats;
+
+	return master_erase(flash, &stats);
+}
+
+int bl_flash_invalidate(const bl_flash_t *flash)
+{
+	bl_flash_stats_t stats;
+
+	return invalidate(flash, &stats);
+}
+
+int bl_flash_program(const bl_flash_t *flash, int pages, bl_flash_mode_e mode, bl_flash_stats_t *stats)
+{
+	bl_flash_stats_t local_stats;
+	app_header_t header;
+	uint32_t last_page = boot_mem_page(flash);
+	uint32_t address;
+	int page;
+	int ret;
+
+	if (!stats) {
+		stats = &local_stats;
+	}
+	memset(stats, 0, sizeof(bl_flash_stats_t));
+	stats->pages = pages;
+
+	// App pages and the app header page, the last app page is shared with the boot memory
+	if ((pages < 2) || ((flash->app_start + (pages - 2) * FLC_PAGE_SIZE) > last_page)) {
+		return -2;
+	}
+
+	if (mode == BL_FLASH_MODE_FULL) {
+		ret = master_erase(flash, stats);
+	} else {
+		ret = invalidate(flash, stats);
+	}
+	if (ret) {
+		return ret;
+	}
+
+	memset(page_last, 0xff, FLC_PAGE_SIZE);
+	for (page = 0; page < pages; page++) {
+		ret = flash->read_page(page_plain);
+		if (ret) {
+			return -1;
+		}
+
+		//Checksum
+		if (crcVerifyMsg((const uint8_t*)page_plain, FLC_PAGE_SIZE + CHECK_BYTESIZE)) {
+			return -1;
+		}
+
+		address = flash->app_start + (page * FLC_PAGE_SIZE);
+		if (page == (pages - 1)) {
+			// App header, stays in page_plain
+		} else if (address == flash->app_start) {
+			memcpy(page_first, page_plain, FLC_PAGE_SIZE);
+		} else if (address == last_page) {
+			memcpy(page_last, page_plain, flash->boot_mem_start - last_page);
+		} else {
+			ret = write_page(flash, address, page_plain, mode, stats);
+			if (ret) {
+				return -3;
+			}
+		}
+
+		if (flash->progress) {
+			flash->progress(page + 1, pages);
+		}
+	}
+
+	if (flash->authenticate && flash->authenticate()) {
+		bl_flash_master_erase(flash);
+		return -1;
+	}
+
+	memcpy(&header, page_plain, sizeof(app_header_t));
+	if (header.valid_mark) {
+		bl_flash_master_erase(flash);
+		return -1;
+	}
+	if ((header.length == 0) || (header.length > (flash->boot_mem_start - flash->app_start))) {
+		bl_flash_master_erase(flash);
+		return -2;
+	}
+
+	// Rest of a longer previous app
+	for (address = flash->app_start + ((pages - 1) * FLC_PAGE_SIZE); address < last_page; address += FLC_PAGE_SIZE) {
+		ret = erase_if_used(flash, address, stats);
+		if (ret) {
+			return -3;
+		}
+	}
+
+	header.valid_mark = MARK_VALID_MAGIC_VAL;
+	ret = write_boot_mem(flash, page_last, &header, stats);
+	if (ret) {
+		return -3;
+	}
+
+	// Reset vector last, a partly programmed vector table page is still blank there
+	ret = erase_if_used(flash, flash->app_start, stats);
+	if (ret) {
+		return -3;
+	}
+	stats->programmed++;
+	ret = flash->prog(flash->app_start + VECTOR_TABLE_HEAD, FLC_PAGE_SIZE - VECTOR_TABLE_HEAD,
+			&page_first[VECTOR_TABLE_HEAD]);
+	if (ret) {
+		return -3;
+	}
+	ret = flash->prog(flash->app_start, VECTOR_TABLE_HEAD, page_first);
+	if (ret) {
+		return -3;
+	}
+
+	if (bl_flash_app_valid(flash, 1) || bl_flash_app_crc(flash)) {
+		bl_flash_master_erase(flash);
+		return -1;
+	}
+
+	return 0;
+}
+
+//Return 0 if valid
+//Return others if not valid
+int bl_flash_app_valid(const bl_flash_t *flash, unsigned char valid_check_flag)
+{
+	const app_header_t *header = (const app_header_t *)flash->mem(flash->boot_mem_start);
+	const uint32_t *isr = (const uint32_t *)flash->mem(flash->app_start);
+
+	//Does app have a valid isr vector table?
+	if (isr[1] == UNINITIALIZED_MEM) {
+		return -1;
+	}
+
+	if (valid_check_flag) {
+		if ((header->length == UNINITIALIZED_MEM) || (header->length > (flash->app_end - flash->app_start))) {
+			return -2;
+		} else if (header->valid_mark != MARK_VALID_MAGIC_VAL) {
+			return -3;
+		} else if (header->boot_mode == UNINITIALIZED_MEM) {
+			return -4;
+		}
+	}
+
+	return 0;
+}
+
+//Return 0 if valid
+//Return others if not valid
+int bl_flash_app_crc(const bl_flash_t *flash)
+{
+	const app_header_t *header = (const app_header_t *)flash->mem(flash->boot_mem_start);
+
+	if (calcCrc32(flash->mem(flash->app_start), header->length) == header->CRC32) {
+		return 0;
+	}
+
+	return -1;
+}
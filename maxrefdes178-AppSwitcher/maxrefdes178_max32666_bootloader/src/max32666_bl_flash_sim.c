@@ -0,0 +1,461 @@
+/*******************************************************************************
+* Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+*
+* This software is protected by copyright laws of the United States and
+* of foreign countries. This material may also be protected by patent laws
+* and technology transfer regulations of the United States and of foreign
+* countries. This software is furnished under a license agreement and/or a
+* nondisclosure agreement and may only be used or reproduced in accordance
+* with the terms of those agreements. Dissemination of this information to
+* any party or parties not specified in the license agreement and/or
+* nondisclosure agreement is expressly prohibited.
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+* OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+* OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+* OTHER DEALINGS IN THE SOFTWARE.
+*
+* Except as contained in this notice, the name of Maxim Integrated
+* Products, Inc. shall not be used except as stated in the Maxim Integrated
+* Products, Inc. Branding Policy.
+*
+* The mere transfer of this software does not imply any licenses
+* of trade secrets, proprietary technology, copyrights, patents,
+* trademarks, maskwork rights, or any other form of intellectual
+* property whatsoever. Maxim Integrated Products, Inc. retains all
+* ownership rights.
+*******************************************************************************
+*/
+
+/*
+ * Host simulation of the MAX32666 self programming (max32666_bl_flash.c) on a simulated flash
+ * and a simulated msbl file on the SD card:
+ *
+ *   gcc -O2 -Iinclude src/crc32.c src/max32666_bl_flash.c src/max32666_bl_flash_sim.c -o bl_flash_sim
+ *   ./bl_flash_sim [app_a.bin app_b.bin]
+ *
+ * The flash keeps the FLC rules: erase sets a page to 0xFF, programming only clears bits and is
+ * verified by read back. Images are built from app binaries like the msbl files, unencrypted,
+ * a CRC-32 after every page and the app header as the last page. Without arguments a synthetic
+ * pair of apps with a common start is used.
+ *
+ * Power is cut once before every flash operation of a switch from A to B, invalidation before
+ * the MAX78000 updates included, and in the middle of every page program. After each cut the
+ * bootloader start check of max32666_main.c must either refuse the app or find A or B intact,
+ * and a second update must end with B. The switch time is estimated from the flash operations
+ * and page reads for the full and the differential mode.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "max32666_bl_flash.h"
+#include "crc32.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Memory map of maxrefdes178_bootloader_max32666.ld
+#define SIM_FLASH_BASE          0x10000000
+#define SIM_FLASH_SIZE          0x100000
+#define SIM_BOOTLOADER_SIZE     0x10000
+#define SIM_BOOTMEM_SIZE        0x40
+#define SIM_APP_START           (SIM_FLASH_BASE + SIM_BOOTLOADER_SIZE)
+#define SIM_BOOTMEM_START       (SIM_FLASH_BASE + SIM_FLASH_SIZE - SIM_BOOTMEM_SIZE)
+#define SIM_APP_MAX             (SIM_BOOTMEM_START - SIM_APP_START)
+
+// us, assumed costs on the MAX32666 at 96 MHz
+#define SIM_PAGE_ERASE          30000
+#define SIM_WORD_PROG           42
+#define SIM_PAGE_READ           4000   // 8 KB from the SD card and decryption
+#define SIM_PAGE_COMPARE        100
+#define SIM_CRC_BYTE_NS         100    // Table CRC-32 of the app
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    uint8_t *data;
+    uint32_t len;
+} sim_app_t;
+
+typedef struct {
+    uint8_t *data;
+    int pages;
+} sim_image_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static uint8_t flash_mem[SIM_FLASH_SIZE];
+static const sim_image_t *image;
+static int image_page;
+
+static uint64_t time_us;
+static int erases;
+static uint32_t prog_words;
+static int ops;
+static int cut_op = -1;       // Flash operation the power is cut at, -1 for none
+static uint32_t cut_words;    // Words of a page program done before the cut
+static jmp_buf power_cut;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static const uint8_t *sim_mem(uint32_t address);
+static int sim_erase_page(uint32_t address);
+static int sim_prog(uint32_t address, uint32_t size, const uint8_t *buffer);
+static int sim_read_page(uint8_t *page);
+
+static const bl_flash_t sim_flash = {
+    SIM_APP_START, SIM_BOOTMEM_START, SIM_BOOTMEM_START, SIM_BOOTMEM_SIZE,
+    sim_mem, sim_erase_page, sim_prog, sim_read_page, NULL, NULL,
+};
+
+
+//-----------------------------------------------------------------------------
+// Local functions
+//-----------------------------------------------------------------------------
+static const uint8_t *sim_mem(uint32_t address)
+{
+    return &flash_mem[address - SIM_FLASH_BASE];
+}
+
+static int sim_erase_page(uint32_t address)
+{
+    if (ops++ == cut_op) {
+        longjmp(power_cut, 1);
+    }
+
+    memset(&flash_mem[address - SIM_FLASH_BASE], 0xff, FLC_PAGE_SIZE);
+    erases++;
+    time_us += SIM_PAGE_ERASE;
+    return 0;
+}
+
+static int sim_prog(uint32_t address, uint32_t size, const uint8_t *buffer)
+{
+    uint8_t *mem = &flash_mem[address - SIM_FLASH_BASE];
+    uint32_t words = size >> 2;
+    uint32_t i;
+
+    if (ops++ == cut_op) {
+        words = (cut_words < words) ? cut_words : words;
+        for (i = 0; i < (words << 2); i++) {
+            mem[i] &= buffer[i];
+        }
+        longjmp(power_cut, 1);
+    }
+
+    for (i = 0; i < size; i++) {
+        mem[i] &= buffer[i];
+    }
+    prog_words += words;
+    time_us += (uint64_t) words * SIM_WORD_PROG;
+
+    return memcmp(mem, buffer, size) ? -1 : 0;
+}
+
+static int sim_read_page(uint8_t *page)
+{
+    if (image_page >= image->pages) {
+        return -1;
+    }
+
+    memcpy(page, &image->data[image_page * PAGE_PAYLOAD_SIZE], PAGE_PAYLOAD_SIZE);
+    image_page++;
+    time_us += SIM_PAGE_READ;
+    return 0;
+}
+
+static void make_page(uint8_t *page, const uint8_t *data, uint32_t len)
+{
+    uint32_t crc;
+
+    memset(page, 0xff, PAGE_PAYLOAD_SIZE);
+    memcpy(page, data, len);
+    crc = calcCrc32(page, FLC_PAGE_SIZE);
+    memcpy(&page[FLC_PAGE_SIZE], &crc, sizeof(crc));
+}
+
+static void make_image(sim_image_t *img, const sim_app_t *app)
+{
+    app_header_t header;
+    int i;
+
+    img->pages = ((app->len + FLC_PAGE_SIZE - 1) / FLC_PAGE_SIZE) + 1;
+    img->data = malloc(img->pages * PAGE_PAYLOAD_SIZE);
+
+    for (i = 0; i < img->pages - 1; i++) {
+        uint32_t len = app->len - (i * FLC_PAGE_SIZE);
+        make_page(&img->data[i * PAGE_PAYLOAD_SIZE], &app->data[i * FLC_PAGE_SIZE],
+                (len > FLC_PAGE_SIZE) ? FLC_PAGE_SIZE : len);
+    }
+
+    header.CRC32 = calcCrc32(app->data, app->len);
+    header.length = app->len;
+    header.valid_mark = 0;
+    header.boot_mode = 0;
+    make_page(&img->data[i * PAGE_PAYLOAD_SIZE], (const uint8_t *) &header, sizeof(header));
+}
+
+static int program(const sim_image_t *img, bl_flash_mode_e mode, bl_flash_stats_t *stats)
+{
+    image = img;
+    image_page = 0;
+
+    // Before the MAX78000 updates in max32666_main.c, then the MAX32666 update
+    if (mode == BL_FLASH_MODE_DIFF) {
+        if (bl_flash_invalidate(&sim_flash)) {
+            return -1;
+        }
+    }
+
+    return bl_flash_program(&sim_flash, img->pages, mode, stats);
+}
+
+// max32666_main.c check_if_app_is_valid
+static int app_starts(void)
+{
+    return ((const uint32_t *) sim_mem(SIM_APP_START))[1] != UNINITIALIZED_MEM;
+}
+
+static int app_is(const sim_app_t *app)
+{
+    return !bl_flash_app_valid(&sim_flash, 1) && !bl_flash_app_crc(&sim_flash) &&
+            (((const app_header_t *) sim_mem(SIM_BOOTMEM_START))->length == app->len) &&
+            !memcmp(sim_mem(SIM_APP_START), app->data, app->len);
+}
+
+static void install(const sim_image_t *img, const sim_app_t *app)
+{
+    memset(flash_mem, 0xff, sizeof(flash_mem));
+    cut_op = -1;
+    if (program(img, BL_FLASH_MODE_FULL, NULL) || !app_is(app)) {
+        printf("FAIL: install\n");
+        exit(1);
+    }
+}
+
+static int test_power_cuts(const sim_image_t *img_a, const sim_app_t *a, const sim_image_t *img_b,
+        const sim_app_t *b)
+{
+    static const uint32_t fractions[] = {0, 1, 2, 3};  // Quarters of the program done
+    int total_ops;
+    volatile int refused = 0;
+    volatile int old = 0;
+    volatile int new = 0;
+    volatile int op;
+    volatile int f;
+
+    install(img_a, a);
+    ops = 0;
+    program(img_b, BL_FLASH_MODE_DIFF, NULL);
+    total_ops = ops;
+
+    for (op = 0; op < total_ops; op++) {
+        for (f = 0; f < 4; f++) {
+            install(img_a, a);
+            ops = 0;
+            cut_op = op;
+            cut_words = (FLC_PAGE_SIZE >> 2) * fractions[f] / 4;
+
+            if (!setjmp(power_cut)) {
+                program(img_b, BL_FLASH_MODE_DIFF, NULL);
+                printf("FAIL: operation %d not reached\n", op);
+                return -1;
+            }
+            cut_op = -1;
+
+            if (!app_starts()) {
+                refused++;
+            } else if (app_is(a)) {
+                old++;
+            } else if (app_is(b)) {
+                new++;
+            } else {
+                printf("FAIL: cut at operation %d/%d, %u words, a broken app would start\n",
+                        op, total_ops, cut_words);
+                return -1;
+            }
+
+            if (program(img_b, BL_FLASH_MODE_DIFF, NULL) || !app_is(b)) {
+                printf("FAIL: update after a cut at operation %d/%d did not recover\n", op, total_ops);
+                return -1;
+            }
+        }
+    }
+
+    printf("power cuts: %d flash operations x 4, bootloader %d, old app %d, new app %d\n",
+            total_ops, refused, old, new);
+    return 0;
+}
+
+static int test_bad_images(const sim_image_t *img_a, const sim_app_t *a, const sim_image_t *img_b)
+{
+    sim_image_t bad;
+    app_header_t *header;
+    int ret;
+
+    bad.pages = img_b->pages;
+    bad.data = malloc(bad.pages * PAGE_PAYLOAD_SIZE);
+
+    // Corrupted page
+    install(img_a, a);
+    memcpy(bad.data, img_b->data, bad.pages * PAGE_PAYLOAD_SIZE);
+    bad.data[PAGE_PAYLOAD_SIZE + 100] ^= 1;
+    ret = program(&bad, BL_FLASH_MODE_DIFF, NULL);
+    if (!ret || app_starts()) {
+        printf("FAIL: corrupted page accepted\n");
+        return -1;
+    }
+
+    // App header with the valid mark already set
+    install(img_a, a);
+    memcpy(bad.data, img_b->data, bad.pages * PAGE_PAYLOAD_SIZE);
+    header = (app_header_t *) &bad.data[(bad.pages - 1) * PAGE_PAYLOAD_SIZE];
+    header->valid_mark = MARK_VALID_MAGIC_VAL;
+    make_page((uint8_t *) header, (const uint8_t *) header, sizeof(app_header_t));
+    ret = program(&bad, BL_FLASH_MODE_DIFF, NULL);
+    if (!ret || app_starts()) {
+        printf("FAIL: marked app header accepted\n");
+        return -1;
+    }
+
+    // Truncated file
+    install(img_a, a);
+    bad.pages = img_b->pages;
+    memcpy(bad.data, img_b->data, bad.pages * PAGE_PAYLOAD_SIZE);
+    bad.pages--;
+    image = &bad;
+    image_page = 0;
+    bl_flash_invalidate(&sim_flash);
+    ret = bl_flash_program(&sim_flash, img_b->pages, BL_FLASH_MODE_DIFF, NULL);
+    if (!ret || app_starts()) {
+        printf("FAIL: truncated image accepted\n");
+        return -1;
+    }
+
+    free(bad.data);
+    printf("bad images: corrupted page, marked header and truncated file refused\n");
+    return 0;
+}
+
+static void benchmark(const char *name, const sim_image_t *img_from, const sim_app_t *from,
+        const sim_image_t *img_to, const sim_app_t *to)
+{
+    bl_flash_stats_t stats;
+    int mode;
+
+    for (mode = BL_FLASH_MODE_FULL; mode <= BL_FLASH_MODE_DIFF; mode++) {
+        install(img_from, from);
+        time_us = 0;
+        erases = 0;
+        prog_words = 0;
+        if (program(img_to, mode, &stats) || !app_is(to)) {
+            printf("FAIL: %s\n", name);
+            exit(1);
+        }
+        time_us += (uint64_t) stats.pages * SIM_PAGE_COMPARE;
+        time_us += (uint64_t) to->len * SIM_CRC_BYTE_NS / 1000;
+
+        // Invalidation before the MAX78000 updates included
+        printf("%-16s %s %3d pages, %3d skipped, %3d erased, %3u programmed, %5u ms\n",
+                name, (mode == BL_FLASH_MODE_FULL) ? "full" : "diff", stats.pages, stats.skipped,
+                erases, prog_words / (FLC_PAGE_SIZE >> 2), (uint32_t) (time_us / 1000));
+    }
+}
+
+static void load_app(sim_app_t *app, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        printf("Cannot open %s\n", path);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    app->len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if ((app->len == 0) || (app->len > SIM_APP_MAX - FLC_PAGE_SIZE)) {
+        printf("Bad app size %s\n", path);
+        exit(1);
+    }
+    app->data = malloc(app->len);
+    if (fread(app->data, 1, app->len, f) != app->len) {
+        printf("Cannot read %s\n", path);
+        exit(1);
+    }
+    fclose(f);
+}
+
+static void random_app(sim_app_t *app, uint32_t len, const sim_app_t *base, uint32_t common)
+{
+    uint32_t i;
+
+    app->len = len;
+    app->data = malloc(len);
+    for (i = 0; i < len; i++) {
+        app->data[i] = (i < common) ? base->data[i] : (uint8_t) rand();
+    }
+    // Reset vector
+    app->data[4] = 0x01;
+    app->data[5] = 0x02;
+    app->data[6] = 0x01;
+    app->data[7] = 0x10;
+}
+
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    sim_app_t a, b, a_patch, none = {NULL, 0};
+    sim_image_t img_a, img_b, img_a_patch;
+
+    srand(1);
+    if (argc >= 3) {
+        load_app(&a, argv[1]);
+        load_app(&b, argv[2]);
+    } else {
+        // Different demos built from the same SDK, startup and drivers match
+        random_app(&a, 430 * 1024 + 123, &none, 0);
+        random_app(&b, 350 * 1024 + 77, &a, 40 * 1024);
+    }
+    // Rebuild of A with a change, code after it moved by a few bytes
+    random_app(&a_patch, a.len + 8, &a, a.len * 3 / 4);
+    memcpy(&a_patch.data[a.len * 3 / 4 + 8], &a.data[a.len * 3 / 4], a.len - a.len * 3 / 4);
+
+    make_image(&img_a, &a);
+    make_image(&img_b, &b);
+    make_image(&img_a_patch, &a_patch);
+    printf("app A %u bytes, app B %u bytes\n", a.len, b.len);
+
+    if (test_power_cuts(&img_a, &a, &img_b, &b) || test_power_cuts(&img_b, &b, &img_a, &a) ||
+            test_bad_images(&img_a, &a, &img_b)) {
+        return 1;
+    }
+
+    benchmark("A to B", &img_a, &a, &img_b, &b);
+    benchmark("B to A", &img_b, &b, &img_a, &a);
+    benchmark("A to A", &img_a, &a, &img_a, &a);
+    benchmark("A to rebuilt A", &img_a, &a, &img_a_patch, &a_patch);
+
+    return 0;
+}
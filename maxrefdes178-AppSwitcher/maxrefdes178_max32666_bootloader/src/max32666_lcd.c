@@ -359,6 +359,36 @@ int lcd_drawImage(uint8_t *data)
     return E_NO_ERROR;
 }
 
+int lcd_drawRows(uint8_t *data, uint16_t y, uint16_t h)
+{
+    static const uint16_t x = 0;
+    static const uint16_t w = LCD_WIDTH;
+
+    if ((y >= LCD_HEIGHT) || (h == 0)) {
+        return E_BAD_PARAM;
+    }
+    if (h > (LCD_HEIGHT - y)) {
+        h = LCD_HEIGHT - y;
+    }
+
+    if (spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
+        PR_WARN("lcd spi busy");
+        return E_BUSY;
+    }
+
+    // Full width rows are contiguous in the frame buffer
+    lcd_setAddrWindow(x, y, x + w - 1, y + h - 1);
+
+    GPIO_SET(lcd_dc_pin);
+    spi_assert_cs();
+
+    spi_dma(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI, &data[y * w * LCD_BYTE_PER_PIXEL], NULL, (w * h * LCD_BYTE_PER_PIXEL), MAX32666_LCD_DMA_REQSEL_SPITX, NULL);
+    spi_dma_wait(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI);
+    spi_deassert_cs();
+
+    return E_NO_ERROR;
+}
+
 int lcd_init(void)
 {
     int ret;
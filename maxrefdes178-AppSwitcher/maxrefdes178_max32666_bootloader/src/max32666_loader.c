@@ -56,12 +56,19 @@
 	#define MAX(x,y)	( (x>y) ? x: y )
 #endif
 
+// Response polling period and worst case wait for slow target operations
+#define LOADER_POLL_INTERVAL_MS			2
+#define LOADER_ERASE_TIMEOUT_MS			5000
+#define LOADER_WRITE_PAGE_TIMEOUT_MS	1500
+#define LOADER_FLASH_CFG_TIMEOUT_MS		1100
+
 /******************************* Type Definitions ****************************/
 
 
 /******************************* 	Variables 	  ****************************/
 static bl_conf_struct_t g_plt_funcs;
-static char page_plain[PAGE_PAYLOAD_SIZE] __attribute__ ((aligned (4)));
+// Write page request, the page is read from SD card right after the command bytes
+static unsigned char page_req[PAGE_PAYLOAD_SIZE+2] __attribute__ ((aligned (4)));
 extern FIL file;
 extern TCHAR *FF_ERRORS[ERROR_MAX_LEN];
 
@@ -85,15 +92,11 @@ extern TCHAR *FF_ERRORS[ERROR_MAX_LEN];
 //    PR_INFO("");
 //}
 
-static int send_rcv(unsigned char *tx, int txLen, unsigned char *rx, int rxLen, int delay_ms, int delay_step_ms)
+static int send_cmd(unsigned char *tx, int txLen)
 {
 	int ret = 0;
 	int i;
 
-	if (delay_step_ms == 0) {
-		delay_step_ms = 100; // 100ms default
-	}
-
 	for (i=0; i<2; i++) {
 		ret = g_plt_funcs.write(tx, 2);
 		if (ret == 0) {
@@ -114,35 +117,62 @@ static int send_rcv(unsigned char *tx, int txLen, unsigned char *rx, int rxLen,
 		g_plt_funcs.delay_ms(100);
 	}
 
-	if (ret == 0) {
-        int nb_of_retry = (delay_ms / delay_step_ms) + 1;
-        for (i = 0; i < nb_of_retry; i++) {
-        	if (delay_ms > 0) {
-        		g_plt_funcs.delay_ms(delay_step_ms);
-        	}
+	return ret;
+}
 
-        	// read
-        	MXC_Delay(15);
-        	ret = g_plt_funcs.read(rx, rxLen);
+static int rcv_rsp(unsigned char *rx, int rxLen, int timeout_ms)
+{
+	int ret = 0;
+	int elapsed_ms = 0;
 
-			if ( (ret == 0) && (rx[0] != BL_RET_ERR_TRY_AGAIN) ) {
-				break;
-			}
-        }
+	// Poll until the target stops answering TRY_AGAIN instead of sleeping for the worst case
+	while (1) {
+		MXC_Delay(15);
+		ret = g_plt_funcs.read(rx, rxLen);
 
-        // Convert BL return value
-    	if (rx[0] == BL_RET_SUCCESS) {
-    		ret = 0; // zero means success
-    	} else if (rx[0] == 0) {
-    		ret = -1;
-    	} else {
-    		ret = rx[0]; // first byte is BL response
-    	}
+		if ( (ret == 0) && (rx[0] != BL_RET_ERR_TRY_AGAIN) ) {
+			break;
+		}
+		if (elapsed_ms >= timeout_ms) {
+			break;
+		}
+
+		g_plt_funcs.delay_ms(LOADER_POLL_INTERVAL_MS);
+		elapsed_ms += LOADER_POLL_INTERVAL_MS;
+	}
+
+	// Convert BL return value
+	if (rx[0] == BL_RET_SUCCESS) {
+		ret = 0; // zero means success
+	} else if (rx[0] == 0) {
+		ret = -1;
+	} else {
+		ret = rx[0]; // first byte is BL response
 	}
 
 	return ret;
 }
 
+static int send_rcv(unsigned char *tx, int txLen, unsigned char *rx, int rxLen, int timeout_ms)
+{
+	int ret;
+
+	ret = send_cmd(tx, txLen);
+	if (ret == 0) {
+		ret = rcv_rsp(rx, rxLen, timeout_ms);
+	}
+
+	return ret;
+}
+
+static int send_page(unsigned int page_len)
+{
+    page_req[0] = BLCmdFlash_MAIN_CMD;
+    page_req[1] = BLCmdFlash_WRITE_PAGE;
+
+    return send_cmd(page_req, page_len+2);
+}
+
 static int update_bl_cfg (unsigned char item, unsigned char cmd)
 {
 	int ret = 0;
@@ -154,7 +184,7 @@ static int update_bl_cfg (unsigned char item, unsigned char cmd)
 	req[2] = item;
 	req[3] = cmd;
 
-    ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -199,7 +229,7 @@ int loader_enter_bl_mode(void)
 	unsigned char req[ ] = {BLCmdDevSetMode_MAIN_CMD, BLCmdDevSetMode_SET_MODE, 0x08};
 	unsigned char rsp[1] = {0xFF, };
 
-    ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -210,7 +240,7 @@ int loader_exit_bl_mode(void)
 	unsigned char req[ ] = {BLCmdDevSetMode_MAIN_CMD, BLCmdDevSetMode_SET_MODE, 0x00};
 	unsigned char rsp[1] = {0xFF, };
 
-    ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -221,7 +251,7 @@ int loader_get_partnumber(char *buf, unsigned int maxLen)
 	unsigned char req[ ] = {BLCmdDeviceInfo_MAIN_CMD, BLCmdDeviceInfo_GET_PLATFORM_TYPE};
 	unsigned char rsp[2] = {0xFF, };
 
-    ret = send_rcv(req, sizeof(req), rsp, 2, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 2, 0);
 
     if (ret == 0) {
     	switch(rsp[1]) {
@@ -244,7 +274,7 @@ int loader_get_version(char *buf, unsigned int maxLen)
 	unsigned char req[ ] = {BLCmdInfo_MAIN_CMD, BLCmdInfo_GET_VERSION};
 	unsigned char rsp[4] = {0xFF, };
 
-    ret = send_rcv(req, sizeof(req), rsp, 4, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 4, 0);
 
     if (ret == 0) {
     	snprintf(buf, maxLen, "v%d.%d.%d", rsp[1], rsp[2], rsp[3]);
@@ -259,7 +289,7 @@ int loader_get_usn(char *buf, unsigned int maxLen)
 	unsigned char req[ ]  = {BLCmdInfo_MAIN_CMD, BLCmdInfo_GET_USN};
 	unsigned char rsp[25] = {0xFF, };
 
-    ret = send_rcv(req, sizeof(req), rsp, 24, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 24, 0);
 
     if (ret == 0) {
     	memcpy(buf, &rsp[1], MIN(24, maxLen));
@@ -274,7 +304,7 @@ int loader_get_page_size(unsigned int *page_size)
 	unsigned char req[ ] = {BLCmdInfo_MAIN_CMD, BLCmdInfo_GET_PAGE_SIZE};
 	unsigned char rsp[3] = {0xFF, };
 
-    ret = send_rcv(req, sizeof(req), rsp, 3, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 3, 0);
 
     if (ret == 0) {
     	*page_size =  (rsp[1]<<8) | rsp[2];
@@ -289,7 +319,7 @@ int loader_erase_app(void)
 	unsigned char req[ ] = {BLCmdFlash_MAIN_CMD,  BLCmdFlash_ERASE_APP_MEMORY};
 	unsigned char rsp[1] = {0xFF, };
 
-    ret = send_rcv(req, sizeof(req), rsp, 1, 4000, 1000);
+    ret = send_rcv(req, sizeof(req), rsp, 1, LOADER_ERASE_TIMEOUT_MS);
 
 	return ret;
 }
@@ -305,7 +335,7 @@ int loader_set_num_pages(int page_num)
     req[2] = (page_num>>8) & 0xff;
     req[3] = (page_num>>0) & 0xff;
 
-    ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -320,7 +350,7 @@ int loader_set_iv(unsigned char *iv)
     req[1] = BLCmdFlash_SET_IV;
     memcpy(&req[2], iv, AES_IV_SIZE);
 
-    ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -335,7 +365,7 @@ int loader_set_auth(unsigned char *auth)
     req[1] = BLCmdFlash_SET_AUTH;
     memcpy(&req[2], auth, AES_AUTH_SIZE);
 
-    ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -350,7 +380,7 @@ int loader_set_key(unsigned char *key)
     req[1] = BLCmdFlash_SET_KEY;
     memcpy(&req[2], key, AES_KEY_LOAD_SIZE);//valid key len, 32 byte key padded with 0, valid aad len 32 byte aad padded with 0
 
-    ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+    ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -358,18 +388,18 @@ int loader_set_key(unsigned char *key)
 int loader_write_page(const char *page, unsigned int page_len)
 {
 	int ret = 0;
-	static unsigned char req[8*1024+32];// use static buffer
 	unsigned char rsp[1] = {0xFF, };
 
-	if (page_len > (sizeof(req)-2) ) {
+	if (page_len > (sizeof(page_req)-2) ) {
 		return -1;
 	}
 
-    req[0] = BLCmdFlash_MAIN_CMD;
-    req[1] = BLCmdFlash_WRITE_PAGE;
-    memcpy(&req[2], page, page_len);
+    memcpy(&page_req[2], page, page_len);
 
-    ret = send_rcv(req, page_len+2, rsp, 1, 1200, 300);
+    ret = send_page(page_len);
+    if (ret == 0) {
+    	ret = rcv_rsp(rsp, 1, LOADER_WRITE_PAGE_TIMEOUT_MS);
+    }
 
 	return ret;
 }
@@ -381,6 +411,10 @@ int loader_flash_image(const char* filename, int video_audio)
 	unsigned int bytes_read;
 	MsblHeader_t header;
 	int checksum_size = 16; // checksum value at the end of page
+	unsigned char rsp[1] = {0xFF, };
+	bl_timer_t timer;
+
+	bl_timer_start(&timer);
     PR_INFO("Attempting to read back file...");
     if((ret = f_open(&file, filename, FA_READ)) != FR_OK){
         PR_ERROR("Error opening file: %s", FF_ERRORS[ret]);
@@ -399,7 +433,7 @@ int loader_flash_image(const char* filename, int video_audio)
 	PR_INFO("%-15s: %d", 		"numPages", header.numPages);
 	PR_INFO("%-15s: %d", 		"pageSize", header.pageSize);
 	PR_INFO("%-15s: %d", 		"crcSize", header.crcSize);
-	PR_INFO("%-15s: %d", 		"Header Size", sizeof(header));
+	PR_INFO("%-15s: %d", 		"Header Size", (int)sizeof(header));
 	PR_INFO("%-15s: %d", 		"resv0", header.resv0);
 	//
 //	hexdump("nonce", header.nonce, 	AES_IV_SIZE);
@@ -436,28 +470,50 @@ int loader_flash_image(const char* filename, int video_audio)
     }
 
     int page_len = header.pageSize + checksum_size;
+    if (page_len > (int)(sizeof(page_req)-2) ) {
+    	PR_ERROR("Error! page size %d", header.pageSize);
+    	return -1;
+    }
+
+    f_read(&file, &page_req[2], page_len, &bytes_read);
     for (i=0; i < header.numPages; i++) {
-    	f_read(&file, page_plain, page_len, &bytes_read);
-		ret = loader_write_page( page_plain, page_len);
+		if (bytes_read != (unsigned int)page_len) {
+			PR_ERROR("Error! page %d read %d/%d", i+1, bytes_read, page_len);
+			return -1;
+		}
+
+		// SPI transfer is synchronous, the request buffer is free once the page is sent.
+		// Read the next page from SD card while the target programs this one.
+		ret = send_page(page_len);
+		if (ret == 0) {
+			if ((i + 1) < header.numPages) {
+				f_read(&file, &page_req[2], page_len, &bytes_read);
+			}
+			ret = rcv_rsp(rsp, 1, LOADER_WRITE_PAGE_TIMEOUT_MS);
+		}
 		if (ret) {
 			PR_INFO("Flashing page %d/%d  [FAILED] err:%d", i+1, header.numPages, ret);
 			return ret;
 		}
 		PR_INFO("Flashing page %d/%d  [SUCCESS]", i+1, header.numPages);
 
+		// Only the progress line changes, redraw its rows instead of the whole screen
 		if (video_audio) { // MAX78000 Video
 		    sprintf(line_str, "MAX78000 Video FW %d/%d", i+1, header.numPages);
 		    fonts_putStringOver(1, 80, line_str, &Font_7x10, BLACK, 0, 0, lcd_buff);
-		    lcd_drawImage(lcd_buff);
+		    lcd_drawRows(lcd_buff, 80, Font_7x10.height);
 		} else { // MAX78000 Audio
 		    sprintf(line_str, "MAX78000 Audio FW %d/%d", i+1, header.numPages);
 		    fonts_putStringOver(1, 60, line_str, &Font_7x10, BLACK, 0, 0, lcd_buff);
-		    lcd_drawImage(lcd_buff);
+		    lcd_drawRows(lcd_buff, 60, Font_7x10.height);
 		}
+		bl_timer_elapsed_ms(&timer);
     }
 
     loader_exit_bl_mode();
 
+    PR_INFO("MAX78000 %s FW %d pages flashed in %u ms", video_audio ? "Video" : "Audio", header.numPages, bl_timer_elapsed_ms(&timer));
+
 	return ret;
 }
 
@@ -472,7 +528,7 @@ int loader_get_target_configure(const char *target_bl_version, void *bl_cfg_stru
     req[2] = 0x00; // dummy byte
 
     if (strcmp(target_bl_version, "v3.4.1") <= 0) {
-		ret = send_rcv(req, sizeof(req), rsp, 5, 0, 0);
+		ret = send_rcv(req, sizeof(req), rsp, 5, 0);
 
 		if (ret == 0) {
 			//
@@ -482,7 +538,7 @@ int loader_get_target_configure(const char *target_bl_version, void *bl_cfg_stru
 			((boot_config_t_before_v342 *)bl_cfg_struct)->v[3] = rsp[1];
 		}
     } else {
-    	ret = send_rcv(req, sizeof(req), rsp, 9, 0, 0);
+    	ret = send_rcv(req, sizeof(req), rsp, 9, 0);
 
 		if (ret == 0) {
 			//
@@ -575,7 +631,7 @@ int loader_update_cfg_set_bl_exit_mode(BLExitMode_t mode)
     req[2] = 0x00; // means exit mode
     req[3] = mode; //
 
-	ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+	ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -605,7 +661,7 @@ int loader_update_cfg_set_bl_exit_timeout(unsigned short timeout)
     	}
     }
 
-	ret = send_rcv(req, sizeof(req), rsp, 1, 0, 0);
+	ret = send_rcv(req, sizeof(req), rsp, 1, 0);
 
 	return ret;
 }
@@ -616,7 +672,7 @@ int loader_flash_bl_cfg(void)
 	unsigned char req[ ] = {BLCmdConfigWrite_MAIN_CMD, BLCmdConfigWrite_SAVE_SETTINGS};
 	unsigned char rsp[1] = {0xFF, };
 
-	ret = send_rcv(req, sizeof(req), rsp, 1, 1000, 0);
+	ret = send_rcv(req, sizeof(req), rsp, 1, LOADER_FLASH_CFG_TIMEOUT_MS);
 
 	return ret;
 }
@@ -0,0 +1,747 @@
+/*******************************************************************************
+* Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+*
+* This software is protected by copyright laws of the United States and
+* of foreign countries. This material may also be protected by patent laws
+* and technology transfer regulations of the United States and of foreign
+* countries. This software is furnished under a license agreement and/or a
+* nondisclosure agreement and may only be used or reproduced in accordance
+* with the terms of those agreements. Dissemination of this information to
+* any party or parties not specified in the license agreement and/or
+* nondisclosure agreement is expressly prohibited.
+*
+* The above copyright notice and this permission notice shall be included
+* in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+* OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+* OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+* ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+* OTHER DEALINGS IN THE SOFTWARE.
+*
+* Except as contained in this notice, the name of Maxim Integrated
+* Products, Inc. shall not be used except as stated in the Maxim Integrated
+* Products, Inc. Branding Policy.
+*
+* The mere transfer of this software does not imply any licenses
+* of trade secrets, proprietary technology, copyrights, patents,
+* trademarks, maskwork rights, or any other form of intellectual
+* property whatsoever. Maxim Integrated Products, Inc. retains all
+* ownership rights.
+*******************************************************************************
+*/
+
+/*
+ * Host simulation of the AppSwitcher firmware flashing, MAX78000 targets (max32666_loader.c) and
+ * MAX32666 self programming (max32666_bl_flash.c), with msbl files on a FatFs backed by host files:
+ *
+ *   gcc -O2 -Iinclude -I../../maxrefdes178_common -I../../maxrefdes178_common/host src/crc32.c \
+ *       src/max32666_bl_flash.c src/max32666_loader.c src/max32666_loader_sim.c -o loader_sim
+ *   ./loader_sim [max78000.msbl]
+ *
+ * The MAX78000 bootloader is simulated behind the loader SPI read and write functions. It answers
+ * TRY_AGAIN until an erase or a page program is done, refuses commands while busy and checks that
+ * every page arrives intact and in order. loader_flash_image, which reads page N+1 from the SD card
+ * while the target programs page N, is timed against the sequential loop it replaced, an SD read
+ * then loader_write_page per page. Without arguments synthetic video and audio images are used.
+ *
+ * The MAX32666 image is programmed into a simulated flash through bl_flash_program, with the
+ * page reads and progress of max32666_bl.c, which itself needs the FLC driver and is not built
+ * here. Flash programming stalls the core, so this path stays sequential and only its time and
+ * the share of the SD reads are reported.
+ *
+ * Time is virtual, from the assumed costs below.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ff.h>
+#include <mxc_delay.h>
+
+#include "max32666_bl.h"
+#include "max32666_bl_flash.h"
+#include "max32666_fonts.h"
+#include "max32666_loader.h"
+#include "crc32.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Memory map of maxrefdes178_bootloader_max32666.ld
+#define SIM_FLASH_BASE          0x10000000
+#define SIM_FLASH_SIZE          0x100000
+#define SIM_BOOTLOADER_SIZE     0x10000
+#define SIM_BOOTMEM_SIZE        0x40
+#define SIM_APP_START           (SIM_FLASH_BASE + SIM_BOOTLOADER_SIZE)
+#define SIM_BOOTMEM_START       (SIM_FLASH_BASE + SIM_FLASH_SIZE - SIM_BOOTMEM_SIZE)
+
+// ns, assumed costs
+#define SIM_SD_READ_CALL        200000  // FatFs and SD command overhead of an f_read
+#define SIM_SD_READ_BYTE        400     // ~2.5 MB/s from the SD card
+#define SIM_SPI_BYTE            1000    // max32666_loader_int.c SPI at 8 MHz
+#define SIM_LCD_BYTE            330     // 240 pixel rows to the LCD
+#define SIM_TARGET_CMD          10000   // MAX78000 bootloader command, answered within the 15 us
+#define SIM_TARGET_PAGE_ERASE   30000000
+#define SIM_TARGET_PAGE_PROG    20000000    // 8 KB in 128-bit writes and the page check
+#define SIM_PAGE_ERASE          30000000    // MAX32666
+#define SIM_WORD_PROG           42000
+
+#define SIM_VIDEO_PAGES         46
+#define SIM_AUDIO_PAGES         34
+#define SIM_MAX32666_APP_LEN    (350 * 1024 + 77)
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    const char *name;
+    char path[64];
+    int video_audio;
+    uint8_t *data;          // File contents
+    uint32_t len;
+} sim_file_t;
+
+// MAX78000 bootloader
+typedef struct {
+    const sim_file_t *image;
+    int in_bl;
+    int pages;              // From SET_NUM_PAGES
+    int erased;
+    int written;            // Pages received intact
+    int fail_page;          // Page answered with a checksum error, -1 for none
+    int failed;
+    uint8_t cmd[2 + PAGE_PAYLOAD_SIZE];
+    uint32_t cmd_len;
+    uint64_t busy_until;
+    uint8_t rsp;
+    int errors;
+} sim_target_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+// max32666_sdcard.c and max32666_lcd.c
+FIL file;
+TCHAR *FF_ERRORS[ERROR_MAX_LEN];
+uint8_t lcd_buff[115200];
+char line_str[80];
+const FontDef Font_7x10 = {7, 10, NULL};
+
+static uint64_t time_ns;
+static uint64_t sd_ns;
+static sim_target_t target;
+
+static uint8_t flash_mem[SIM_FLASH_SIZE];
+static FIL *load_file;
+static bl_timer_t load_timer;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static const uint8_t *sim_mem(uint32_t address);
+static int sim_erase_page(uint32_t address);
+static int sim_prog(uint32_t address, uint32_t size, const uint8_t *buffer);
+static int sim_read_page(uint8_t *page);
+static void sim_progress(int page, int pages);
+
+static const bl_flash_t sim_flash = {
+    SIM_APP_START, SIM_BOOTMEM_START, SIM_BOOTMEM_START, SIM_BOOTMEM_SIZE,
+    sim_mem, sim_erase_page, sim_prog, sim_read_page, NULL, sim_progress,
+};
+
+
+//-----------------------------------------------------------------------------
+// FatFs on host files
+//-----------------------------------------------------------------------------
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode)
+{
+    (void) mode;
+
+    fp->fp = fopen(path, "rb");
+    return fp->fp ? FR_OK : FR_NO_FILE;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    uint64_t ns = SIM_SD_READ_CALL + (uint64_t) btr * SIM_SD_READ_BYTE;
+
+    time_ns += ns;
+    sd_ns += ns;
+    *br = fread(buff, 1, btr, fp->fp);
+    return FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+    if (fp->fp) {
+        fclose(fp->fp);
+        fp->fp = NULL;
+    }
+    return FR_OK;
+}
+
+FRESULT f_mount(FATFS *fs, const TCHAR *path, BYTE opt)
+{
+    (void) fs;
+    (void) path;
+    (void) opt;
+
+    return FR_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+// SDK, LCD and max32666_bl.c stand-ins
+//-----------------------------------------------------------------------------
+void MXC_Delay(uint32_t us)
+{
+    time_ns += (uint64_t) us * 1000;
+}
+
+void fonts_putStringOver(uint16_t x, uint16_t y, char *str, const FontDef *font, uint16_t color,
+        uint8_t bg, uint16_t bgcolor, uint8_t *buff)
+{
+    (void) x;
+    (void) y;
+    (void) str;
+    (void) font;
+    (void) color;
+    (void) bg;
+    (void) bgcolor;
+    (void) buff;
+}
+
+int lcd_drawRows(uint8_t *data, uint16_t y, uint16_t h)
+{
+    (void) data;
+    (void) y;
+
+    time_ns += (uint64_t) h * 240 * 2 * SIM_LCD_BYTE;
+    return 0;
+}
+
+// Counts us instead of core cycles
+void bl_timer_start(bl_timer_t *timer)
+{
+    timer->last_cycles = (uint32_t) (time_ns / 1000);
+    timer->cycles = 0;
+}
+
+uint32_t bl_timer_elapsed_ms(bl_timer_t *timer)
+{
+    uint32_t now = (uint32_t) (time_ns / 1000);
+
+    timer->cycles += (uint32_t) (now - timer->last_cycles);
+    timer->last_cycles = now;
+
+    return (uint32_t) (timer->cycles / 1000);
+}
+
+
+//-----------------------------------------------------------------------------
+// MAX78000 bootloader behind max32666_loader_int.c
+//-----------------------------------------------------------------------------
+static uint32_t target_cmd_len(const uint8_t *cmd)
+{
+    if (cmd[0] == BLCmdDevSetMode_MAIN_CMD) {
+        return 3;
+    }
+    if ((cmd[0] == BLCmdFlash_MAIN_CMD) && (cmd[1] == BLCmdFlash_SET_NUM_PAGES)) {
+        return 4;
+    }
+    if ((cmd[0] == BLCmdFlash_MAIN_CMD) && (cmd[1] == BLCmdFlash_WRITE_PAGE)) {
+        return 2 + PAGE_PAYLOAD_SIZE;
+    }
+    return 2;
+}
+
+static void target_run(void)
+{
+    const uint8_t *page;
+
+    target.rsp = BL_RET_SUCCESS;
+    target.busy_until = time_ns + SIM_TARGET_CMD;
+
+    if (target.cmd[0] == BLCmdDevSetMode_MAIN_CMD) {
+        if (target.cmd[2] == 0x08) {
+            target.in_bl = 1;
+        } else {
+            if (target.written != target.pages) {
+                printf("FAIL: bootloader exited after %d/%d pages\n", target.written, target.pages);
+                target.errors++;
+            }
+            target.in_bl = 0;
+        }
+    } else if (!target.in_bl) {
+        printf("FAIL: command 0x%02X 0x%02X outside bootloader mode\n", target.cmd[0], target.cmd[1]);
+        target.errors++;
+        target.rsp = BL_RET_ERR_UNAVAIL_CMD;
+    } else if ((target.cmd[0] == BLCmdFlash_MAIN_CMD) && (target.cmd[1] == BLCmdFlash_SET_NUM_PAGES)) {
+        target.pages = (target.cmd[2] << 8) | target.cmd[3];
+        target.erased = 0;
+        target.written = 0;
+    } else if ((target.cmd[0] == BLCmdFlash_MAIN_CMD) && (target.cmd[1] == BLCmdFlash_ERASE_APP_MEMORY)) {
+        target.erased = 1;
+        target.busy_until = time_ns + (uint64_t) target.pages * SIM_TARGET_PAGE_ERASE;
+    } else if ((target.cmd[0] == BLCmdFlash_MAIN_CMD) && (target.cmd[1] == BLCmdFlash_WRITE_PAGE)) {
+        page = &target.image->data[sizeof(MsblHeader_t) + target.written * PAGE_PAYLOAD_SIZE];
+        if (!target.erased || target.failed || (target.written >= target.pages)) {
+            printf("FAIL: page %d written out of sequence\n", target.written + 1);
+            target.errors++;
+            target.rsp = BL_RET_ERR_BTLDR_GENERAL;
+        } else if (memcmp(&target.cmd[2], page, PAGE_PAYLOAD_SIZE)) {
+            printf("FAIL: page %d arrived corrupted\n", target.written + 1);
+            target.errors++;
+            target.rsp = BL_RET_ERR_BTLDR_CHECKSUM;
+        } else if (target.written == target.fail_page) {
+            target.failed = 1;
+            target.rsp = BL_RET_ERR_BTLDR_CHECKSUM;
+        } else {
+            target.written++;
+            target.busy_until = time_ns + SIM_TARGET_PAGE_PROG;
+        }
+    } else {
+        target.rsp = BL_RET_ERR_UNAVAIL_CMD;
+    }
+}
+
+static int target_write(unsigned char *src, unsigned int len)
+{
+    time_ns += (uint64_t) len * SIM_SPI_BYTE;
+
+    if (time_ns < target.busy_until) {
+        printf("FAIL: command sent while the target is busy\n");
+        target.errors++;
+    }
+    if ((target.cmd_len + len) > sizeof(target.cmd)) {
+        printf("FAIL: %u byte command\n", target.cmd_len + len);
+        target.errors++;
+        target.cmd_len = 0;
+        return 0;
+    }
+
+    memcpy(&target.cmd[target.cmd_len], src, len);
+    target.cmd_len += len;
+    if ((target.cmd_len >= 2) && (target.cmd_len >= target_cmd_len(target.cmd))) {
+        target_run();
+        target.cmd_len = 0;
+    }
+
+    return 0;
+}
+
+static int target_read(unsigned char *dst, unsigned int len)
+{
+    time_ns += (uint64_t) len * SIM_SPI_BYTE;
+
+    memset(dst, 0, len);
+    dst[0] = (time_ns < target.busy_until) ? BL_RET_ERR_TRY_AGAIN : target.rsp;
+    return 0;
+}
+
+static void target_gpio_set(unsigned int idx, int state)
+{
+    // Reset
+    if ((idx == GPIO_IDX_BL0) && !state) {
+        target.in_bl = 0;
+        target.erased = 0;
+        target.written = 0;
+        target.failed = 0;
+        target.cmd_len = 0;
+        target.busy_until = 0;
+    }
+}
+
+static void target_delay_ms(unsigned int ms)
+{
+    time_ns += (uint64_t) ms * 1000000;
+}
+
+
+//-----------------------------------------------------------------------------
+// MAX32666 flash and max32666_bl.c page reads
+//-----------------------------------------------------------------------------
+static const uint8_t *sim_mem(uint32_t address)
+{
+    return &flash_mem[address - SIM_FLASH_BASE];
+}
+
+static int sim_erase_page(uint32_t address)
+{
+    memset(&flash_mem[address - SIM_FLASH_BASE], 0xff, FLC_PAGE_SIZE);
+    time_ns += SIM_PAGE_ERASE;
+    return 0;
+}
+
+static int sim_prog(uint32_t address, uint32_t size, const uint8_t *buffer)
+{
+    uint8_t *mem = &flash_mem[address - SIM_FLASH_BASE];
+    uint32_t i;
+
+    for (i = 0; i < size; i++) {
+        mem[i] &= buffer[i];
+    }
+    time_ns += (uint64_t) (size >> 2) * SIM_WORD_PROG;
+
+    return memcmp(mem, buffer, size) ? -1 : 0;
+}
+
+static int sim_read_page(uint8_t *page)
+{
+    unsigned int bytes_read;
+
+    if (f_read(load_file, page, FLC_PAGE_SIZE + CHECKBYTE_16, &bytes_read) != FR_OK) {
+        return -1;
+    }
+
+    return (bytes_read == (FLC_PAGE_SIZE + CHECKBYTE_16)) ? 0 : -1;
+}
+
+static void sim_progress(int page, int pages)
+{
+    sprintf(line_str, "MAX32666 FW %d/%d", page, pages);
+    fonts_putStringOver(1, 100, line_str, &Font_7x10, BLACK, 0, 0, lcd_buff);
+    lcd_drawRows(lcd_buff, 100, Font_7x10.height);
+    bl_timer_elapsed_ms(&load_timer);
+}
+
+
+//-----------------------------------------------------------------------------
+// Images
+//-----------------------------------------------------------------------------
+static void write_file(sim_file_t *f)
+{
+    int fd;
+    FILE *fp;
+
+    strcpy(f->path, "/tmp/loader_sim_XXXXXX");
+    fd = mkstemp(f->path);
+    fp = (fd < 0) ? NULL : fdopen(fd, "wb");
+    if (!fp || (fwrite(f->data, 1, f->len, fp) != f->len)) {
+        printf("Cannot write %s\n", f->path);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+static void msbl_header(MsblHeader_t *header, int pages)
+{
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, "MSBL", 4);
+    header->formatVersion = 1;
+    strcpy((char *) header->target, "MAX78000");
+    strcpy((char *) header->enc_type, "None");
+    header->numPages = pages;
+    header->pageSize = FLC_PAGE_SIZE;
+    header->crcSize = CHECKBYTE_16;
+}
+
+static void max78000_image(sim_file_t *f, const char *name, int video_audio, int pages)
+{
+    uint32_t i;
+
+    f->name = name;
+    f->video_audio = video_audio;
+    f->len = sizeof(MsblHeader_t) + pages * PAGE_PAYLOAD_SIZE;
+    f->data = malloc(f->len);
+    msbl_header((MsblHeader_t *) f->data, pages);
+    for (i = sizeof(MsblHeader_t); i < f->len; i++) {
+        f->data[i] = (uint8_t) rand();
+    }
+    write_file(f);
+}
+
+static void make_page(uint8_t *page, const uint8_t *data, uint32_t len)
+{
+    uint32_t crc;
+
+    memset(page, 0xff, PAGE_PAYLOAD_SIZE);
+    memcpy(page, data, len);
+    crc = calcCrc32(page, FLC_PAGE_SIZE);
+    memcpy(&page[FLC_PAGE_SIZE], &crc, sizeof(crc));
+}
+
+// Unencrypted, a CRC-32 after every page and the app header as the last page
+static void max32666_image(sim_file_t *f, const uint8_t *app, uint32_t app_len)
+{
+    app_header_t header;
+    uint8_t *pages;
+    int count = ((app_len + FLC_PAGE_SIZE - 1) / FLC_PAGE_SIZE) + 1;
+    int i;
+
+    f->name = "MAX32666";
+    f->video_audio = 0;
+    f->len = sizeof(MsblHeader_t) + count * PAGE_PAYLOAD_SIZE;
+    f->data = malloc(f->len);
+    msbl_header((MsblHeader_t *) f->data, count);
+    pages = &f->data[sizeof(MsblHeader_t)];
+
+    for (i = 0; i < count - 1; i++) {
+        uint32_t len = app_len - (i * FLC_PAGE_SIZE);
+        make_page(&pages[i * PAGE_PAYLOAD_SIZE], &app[i * FLC_PAGE_SIZE],
+                (len > FLC_PAGE_SIZE) ? FLC_PAGE_SIZE : len);
+    }
+
+    header.CRC32 = calcCrc32(app, app_len);
+    header.length = app_len;
+    header.valid_mark = 0;
+    header.boot_mode = 0;
+    make_page(&pages[i * PAGE_PAYLOAD_SIZE], (const uint8_t *) &header, sizeof(header));
+    write_file(f);
+}
+
+static void load_file_data(sim_file_t *f, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        printf("Cannot open %s\n", path);
+        exit(1);
+    }
+    fseek(fp, 0, SEEK_END);
+    f->len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    f->data = malloc(f->len);
+    if ((f->len < sizeof(MsblHeader_t)) || (fread(f->data, 1, f->len, fp) != f->len)) {
+        printf("Cannot read %s\n", path);
+        exit(1);
+    }
+    fclose(fp);
+    f->name = path;
+    f->video_audio = 1;
+    snprintf(f->path, sizeof(f->path), "%s", path);
+}
+
+
+//-----------------------------------------------------------------------------
+// Flashing
+//-----------------------------------------------------------------------------
+// The loop loader_flash_image used before the pipelining, read a page then send it and wait
+static int flash_sequential(const char *filename, int video_audio)
+{
+    static char page[PAGE_PAYLOAD_SIZE];
+    MsblHeader_t header;
+    unsigned int bytes_read;
+    int page_len;
+    int ret;
+    int i;
+
+    if (f_open(&file, filename, FA_READ) != FR_OK) {
+        return -1;
+    }
+    f_read(&file, &header, sizeof(MsblHeader_t), &bytes_read);
+
+    ret = loader_hard_reset_then_enter_bl_mode();
+    if (!ret) {
+        ret = loader_set_num_pages(header.numPages);
+    }
+    if (!ret) {
+        ret = loader_erase_app();
+    }
+
+    page_len = header.pageSize + CHECKBYTE_16;
+    for (i = 0; !ret && (i < header.numPages); i++) {
+        f_read(&file, page, page_len, &bytes_read);
+        if (bytes_read != (unsigned int) page_len) {
+            ret = -1;
+            break;
+        }
+        ret = loader_write_page(page, page_len);
+
+        sprintf(line_str, "MAX78000 %s FW %d/%d", video_audio ? "Video" : "Audio", i + 1, header.numPages);
+        fonts_putStringOver(1, video_audio ? 80 : 60, line_str, &Font_7x10, BLACK, 0, 0, lcd_buff);
+        lcd_drawRows(lcd_buff, video_audio ? 80 : 60, Font_7x10.height);
+    }
+
+    if (!ret) {
+        loader_exit_bl_mode();
+    }
+    f_close(&file);
+
+    return ret;
+}
+
+static void target_setup(const sim_file_t *image, int fail_page)
+{
+    memset(&target, 0, sizeof(target));
+    target.image = image;
+    target.fail_page = fail_page;
+    time_ns = 0;
+    sd_ns = 0;
+}
+
+// Returns the flashing time in us, 0 on failure
+static uint64_t flash_max78000(const sim_file_t *image, int pipelined)
+{
+    const MsblHeader_t *header = (const MsblHeader_t *) image->data;
+    int ret;
+
+    target_setup(image, -1);
+    if (pipelined) {
+        ret = loader_flash_image(image->path, image->video_audio);
+        f_close(&file);
+    } else {
+        ret = flash_sequential(image->path, image->video_audio);
+    }
+
+    if (ret || target.errors || target.in_bl || (target.written != header->numPages)) {
+        printf("FAIL: %s %s flashing returned %d, %d/%d pages\n", image->name,
+                pipelined ? "pipelined" : "sequential", ret, target.written, header->numPages);
+        return 0;
+    }
+
+    return time_ns / 1000;
+}
+
+static int test_max78000(const sim_file_t *image)
+{
+    const MsblHeader_t *header = (const MsblHeader_t *) image->data;
+    uint64_t sequential_us, pipelined_us, sd_us;
+
+    sequential_us = flash_max78000(image, 0);
+    pipelined_us = flash_max78000(image, 1);
+    sd_us = sd_ns / 1000;
+    if (!sequential_us || !pipelined_us) {
+        return -1;
+    }
+
+    printf("%-16s %3d pages, sequential %5u ms, pipelined %5u ms, %4.1f%% faster, SD reads %4u ms\n",
+            image->name, header->numPages, (uint32_t) (sequential_us / 1000),
+            (uint32_t) (pipelined_us / 1000), 100.0 * (sequential_us - pipelined_us) / sequential_us,
+            (uint32_t) (sd_us / 1000));
+
+    if (pipelined_us >= sequential_us) {
+        printf("FAIL: %s pipelined flashing is not faster\n", image->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_max78000_errors(const sim_file_t *image)
+{
+    const MsblHeader_t *header = (const MsblHeader_t *) image->data;
+    sim_file_t truncated = *image;
+    int fail_page = header->numPages / 2;
+    int ret;
+
+    // Checksum error reported by the target, nothing sent after it
+    target_setup(image, fail_page);
+    ret = loader_flash_image(image->path, image->video_audio);
+    f_close(&file);
+    if (!ret || target.errors || (target.written != fail_page)) {
+        printf("FAIL: target error at page %d returned %d, %d pages written\n", fail_page + 1, ret,
+                target.written);
+        return -1;
+    }
+
+    // File ends within the last page, the pages before it are sent intact
+    truncated.len -= PAGE_PAYLOAD_SIZE / 2;
+    write_file(&truncated);
+    target_setup(&truncated, -1);
+    ret = loader_flash_image(truncated.path, truncated.video_audio);
+    f_close(&file);
+    unlink(truncated.path);
+    if (!ret || target.errors || (target.written != header->numPages - 1)) {
+        printf("FAIL: truncated image returned %d, %d pages written\n", ret, target.written);
+        return -1;
+    }
+
+    printf("errors: target checksum error and truncated image stop the flashing\n");
+    return 0;
+}
+
+static int test_max32666(const sim_file_t *image, const uint8_t *app, uint32_t app_len)
+{
+    const app_header_t *header = (const app_header_t *) sim_mem(SIM_BOOTMEM_START);
+    MsblHeader_t msbl;
+    unsigned int bytes_read;
+    bl_flash_stats_t stats;
+    int ret;
+
+    memset(flash_mem, 0xff, sizeof(flash_mem));
+    time_ns = 0;
+    sd_ns = 0;
+
+    // max32666_bl.c bl_load_from_sdcard
+    if (f_open(&file, image->path, FA_READ) != FR_OK) {
+        printf("FAIL: cannot open %s\n", image->path);
+        return -1;
+    }
+    bl_timer_start(&load_timer);
+    f_read(&file, &msbl, sizeof(MsblHeader_t), &bytes_read);
+    MXC_Delay(MXC_DELAY_MSEC(10));
+    load_file = &file;
+    ret = bl_flash_program(&sim_flash, msbl.numPages, BL_FLASH_MODE_DIFF, &stats);
+    f_close(&file);
+
+    if (ret || bl_flash_app_valid(&sim_flash, 1) || bl_flash_app_crc(&sim_flash) ||
+            (header->length != app_len) || memcmp(sim_mem(SIM_APP_START), app, app_len)) {
+        printf("FAIL: MAX32666 self programming returned %d\n", ret);
+        return -1;
+    }
+
+    printf("%-16s %3d pages, sequential %5u ms, SD reads %4u ms\n", image->name, stats.pages,
+            bl_timer_elapsed_ms(&load_timer), (uint32_t) (sd_ns / 1000000));
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    bl_conf_struct_t plt = {target_read, target_write, target_gpio_set, target_delay_ms};
+    sim_file_t images[2];
+    sim_file_t max32666;
+    uint8_t *app;
+    int count;
+    int errors = 0;
+    int i;
+
+    srand(1);
+    loader_init(&plt);
+
+    if (argc >= 2) {
+        load_file_data(&images[0], argv[1]);
+        count = 1;
+    } else {
+        max78000_image(&images[0], "MAX78000 Video", 1, SIM_VIDEO_PAGES);
+        max78000_image(&images[1], "MAX78000 Audio", 0, SIM_AUDIO_PAGES);
+        count = 2;
+    }
+
+    app = malloc(SIM_MAX32666_APP_LEN);
+    for (i = 0; i < SIM_MAX32666_APP_LEN; i++) {
+        app[i] = (uint8_t) rand();
+    }
+    max32666_image(&max32666, app, SIM_MAX32666_APP_LEN);
+
+    for (i = 0; i < count; i++) {
+        errors += test_max78000(&images[i]) ? 1 : 0;
+    }
+    errors += test_max78000_errors(&images[0]) ? 1 : 0;
+    errors += test_max32666(&max32666, app, SIM_MAX32666_APP_LEN) ? 1 : 0;
+
+    for (i = 0; i < count; i++) {
+        if (argc < 2) {
+            unlink(images[i].path);
+        }
+    }
+    unlink(max32666.path);
+
+    printf("loader check: %s\n", errors ? "FAILED" : "passed");
+    return errors ? 1 : 0;
+}
@@ -277,8 +277,8 @@ int main(void)
     PR_INFO("%s", max78000_video_msbl_path);
     PR_INFO("%s", max78000_audio_msbl_path);
 
-    // Erase MAX32666 FW
-    bl_master_erase();
+    // Invalidate MAX32666 FW, pages that do not change are kept
+    bl_invalidate_app();
 
     loader_int_spi_init();
     loader_int_gpio_init();
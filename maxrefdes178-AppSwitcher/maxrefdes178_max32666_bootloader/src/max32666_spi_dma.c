@@ -306,3 +306,27 @@ uint8_t spi_dma_busy_flag(uint8_t ch)
 {
     return dma_busy_flag[ch];
 }
+
+void spi_dma_abort(uint8_t ch, mxc_spi_regs_t *spi)
+{
+    __disable_irq();
+
+    // Stop DMA, a pending reload must not restart it
+    MXC_DMA0->ch[ch].cfg &= ~(MXC_F_DMA_CFG_CHEN | MXC_F_DMA_CFG_RLDEN);
+    MXC_DMA0->ch[ch].cnt_rld = 0;
+
+    // Stop SPI
+    spi->ctrl0 &= ~(MXC_F_SPI_CTRL0_EN | MXC_F_SPI_CTRL0_START);
+
+    // Disable SPI DMA, flush FIFO
+    spi->dma = (MXC_F_SPI_DMA_TX_FIFO_CLEAR | MXC_F_SPI_DMA_RX_FIFO_CLEAR);
+
+    // Late completion must not call the callback of the aborted transfer
+    dma_callback[ch] = NULL;
+    dma_busy_flag[ch] = 0;
+
+    // Clear DMA int flags
+    MXC_DMA0->ch[ch].st =  MXC_DMA0->ch[ch].st;
+
+    __enable_irq();
+}
@@ -426,6 +426,8 @@ int pmic_worker(void)
 //        break;
 //    }
 
+    device_status.pmic_thermal = lMax20303RegStatus1.bits.ChgThmReg || lMax20303RegStatus1.bits.ChgThmSd;
+
     if (lMax20303RegStatus1.bits.UsbOk) {
         if (!device_status.usb_chgin) {
             pmic_enable_charger();
@@ -43,6 +43,7 @@
 #include "max32666_debug.h"
 #include "max32666_i2c.h"
 #include "max32666_timer_led_button.h"
+#include "maxrefdes178_scheduler.h"
 
 
 //-----------------------------------------------------------------------------
@@ -109,6 +110,7 @@ static int touch_point(uint16_t *x1, uint16_t *y1);
 void touch_int(void *cbdata)
 {
     touch_int_flag = 1;
+    scheduler_post(MAX32666_EVENT_INPUT);
 }
 
 int touch_init(void)
@@ -441,9 +441,8 @@ def load_data_arrs(db_path, load_img_prevs=True):
             subj_list.append(int.from_bytes(file.read(1), byteorder='little', signed=False))
             embedding_list.append(list(file.read(L)))
 
-        embedding_list = np.array(embedding_list).astype(np.int8)
-        neg_idx = embedding_list > 127
-        embedding_list[neg_idx] -= 256
+        # Stored as two's complement bytes
+        embedding_list = np.array(embedding_list, dtype=np.uint8).view(np.int8)
 
         img_arr = None
         if load_img_prevs:
@@ -56,19 +56,47 @@
 //-----------------------------------------------------------------------------
 // Function declarations
 //-----------------------------------------------------------------------------
+/*  Two single producer single consumer rings, each end is owned by one core:
+ *    rx: core1 (BLE stack) produces, core0 (ble_command) consumes
+ *    tx: core0 (ble_command) produces, core1 (ble_tx) consumes
+ *  Calling an end from the other core, or from two contexts on the same core, breaks the ring.
+ *
+ *  The rings use no C11 atomics, only volatile head and tail indices and __DMB. This is safe on the
+ *  Cortex-M4 cores of the MAX32666: aligned 32-bit loads and stores are single-copy atomic, each
+ *  index is written by one end only so no read-modify-write is shared, and volatile keeps the
+ *  compiler from caching or merging index accesses. __DMB, also a compiler barrier, orders the slot
+ *  accesses against the index update as the other core sees them.
+ */
 int ble_queue_init(void);
+
+// Should be called from core0, drops rx directly and asks core1 to drop the queued tx
 int ble_queue_flush(void);
 
-// Should be called from core0
+// rx consumer, should be called from core0
 int ble_queue_deq_rx(ble_packet_container_t *ble_packet_container);
 
-// Should be called from core1
+// rx producer, should be called from core1
 int ble_queue_enq_rx(ble_packet_container_t *ble_packet_container);
 
-// Should be called from core0
+// tx consumer, should be called from core1
 int ble_queue_deq_tx(ble_packet_container_t *ble_packet_container);
 
-// Should be called from core1
+// tx producer, should be called from core0
 int ble_queue_enq_tx(ble_packet_container_t *ble_packet_container);
 
+// Zero-copy access, should be called from core1
+// rx producer: fill the reserved slot then commit it, NULL if the queue is full
+ble_packet_container_t *ble_queue_reserve_rx(void);
+void ble_queue_commit_rx(void);
+// tx consumer: use the oldest slot then release it, NULL if the queue is empty
+ble_packet_container_t *ble_queue_peek_tx(void);
+void ble_queue_release_tx(void);
+
+// Zero-copy access, should be called from core0
+// tx producer
+ble_packet_container_t *ble_queue_reserve_tx(void);
+void ble_queue_commit_tx(void);
+// Number of tx packets not yet released by core1
+int ble_queue_count_tx(void);
+
 #endif /* _MAX32666_BLE_QUEUE_H_ */
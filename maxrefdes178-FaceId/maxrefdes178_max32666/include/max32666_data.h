@@ -44,11 +44,14 @@
 #include <mxc_sys.h>
 
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_governor.h"
 
 
 //-----------------------------------------------------------------------------
 // Defines
 //-----------------------------------------------------------------------------
+// Receive the next video frame while the LCD shows the previous one
+#define MAX32666_LCD_DOUBLE_BUFFER         1
 
 
 //-----------------------------------------------------------------------------
@@ -71,6 +74,7 @@ typedef struct {
     uint8_t enable_max78000_video_cnn;
     uint8_t enable_max78000_video_flash_led;
     uint8_t enable_max78000_video_vflip;
+    uint8_t enable_max78000_video_compression;
     uint8_t enable_max78000_video_and_audio_power;  // TODO
     uint8_t enable_lcd_statistics;
     uint8_t enable_lcd_probabilty;
@@ -78,6 +82,8 @@ typedef struct {
     uint8_t enable_ble_send_classification;  // TODO
     uint8_t enable_inactivity;
     lcd_rotation_e lcd_rotation;
+    governor_policy_e governor_policy;
+    uint16_t governor_target_minutes;  // GOVERNOR_POLICY_BATTERY_HOURS only
 	uint8_t enable_voicecommand;
 } device_settings_t;
 
@@ -102,6 +108,9 @@ typedef struct {
     uint8_t fuel_gauge_working;
     float vcell;
     uint8_t usb_chgin;
+    uint8_t pmic_thermal;  // Charger thermal regulation or shutdown
+
+    governor_t governor;
 
     inactivity_state_e inactivity_state;
 
@@ -112,13 +121,22 @@ typedef struct {
     volatile uint16_t ble_max_packet_size; // written by core1
     volatile uint8_t ble_expected_rx_seq;  // written by core1
     volatile uint8_t ble_next_tx_seq;  // written by core1
+    volatile uint8_t ble_tx_aborted;  // set by core1, cleared by core0 after the tx queue is flushed
+
+#ifdef ENABLE_TRACE
+    trace_dump_t trace[TRACE_SOURCE_LAST];
+    uint8_t trace_pending;  // bit per trace_source_e, dump not sent over BLE yet
+#endif
 } device_status_t;
 
 typedef struct {
-    uint8_t buffer[LCD_DATA_SIZE];
+    uint8_t *buffer;  // Front buffer, overlays are drawn here and it is sent to the LCD
+    uint8_t *back_buffer;  // Video frames are received here
+    uint8_t frame_buffer[MAX32666_LCD_DOUBLE_BUFFER + 1][LCD_DATA_SIZE];
     char notification[LCD_NOTIFICATION_MAX_SIZE];
     uint16_t notification_color;
     volatile uint8_t refresh_screen;
+    volatile uint8_t frame_pending;  // Complete frame in back buffer, not shown yet
 } lcd_data_t;
 
 typedef struct {
@@ -128,10 +146,11 @@ typedef struct {
     uint32_t faceid_subject_names_received;
     uint32_t screen_drew;
     uint32_t statistics_sent;
-    uint32_t pmic_check;
-    uint32_t led;
-    uint32_t powmon;
+#ifdef ENABLE_TRACE
+    uint32_t trace_sent;
+#endif
     uint32_t activity_detected;
+    uint32_t scene_activity;  // Video classification or touch
 } timestamps_t;
 
 
@@ -36,11 +36,14 @@
 //-----------------------------------------------------------------------------
 // Includes
 //-----------------------------------------------------------------------------
+#include <mxc_device.h>
 #include <string.h>
 
 #include "max32666_ble_queue.h"
 #include "max32666_debug.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_trace.h"
+#include "maxrefdes178_utility.h"
 
 
 //-----------------------------------------------------------------------------
@@ -48,82 +51,133 @@
 //-----------------------------------------------------------------------------
 #define S_MODULE_NAME   "queue"
 
+#if (MAX32666_BLE_QUEUE_SIZE & (MAX32666_BLE_QUEUE_SIZE - 1)) != 0
+#error "MAX32666_BLE_QUEUE_SIZE must be a power of two"
+#endif
+
+#define BLE_QUEUE_MASK  (MAX32666_BLE_QUEUE_SIZE - 1)
+
 
 //-----------------------------------------------------------------------------
 // Typedefs
 //-----------------------------------------------------------------------------
-// Circular buffer queue implementation, overwrite is not permitted
+// Single producer single consumer ring between core0 and core1, overwrite is not permitted
+// head and tail run freely and are masked on access, each one is written by a single side only.
+// The data memory barrier orders slot accesses against index updates as seen by the other core.
 typedef struct {
     ble_packet_container_t container_array[MAX32666_BLE_QUEUE_SIZE];
-    uint32_t head;
-    uint32_t tail;
+    volatile uint32_t head;         // Written by producer
+    volatile uint32_t tail;         // Written by consumer
+    volatile uint32_t flush_head;   // Written by producer, consumer drops entries before it
+    volatile uint32_t flush_req;    // Written by producer
+    volatile uint32_t flush_ack;    // Written by consumer
 } ble_queue_t;
 
 
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
-//static const mxc_gpio_cfg_t core0_int_pin = MAX32666_CORE0_INT_PIN;
-//static const mxc_gpio_cfg_t core1_int_pin = MAX32666_CORE1_INT_PIN;
-
-static volatile ble_queue_t ble_queue_rx;
-static volatile ble_queue_t ble_queue_tx;
+static ble_queue_t ble_queue_rx;
+static ble_queue_t ble_queue_tx;
 
 
 //-----------------------------------------------------------------------------
 // Local function declarations
 //-----------------------------------------------------------------------------
-static int ble_queue_enq(volatile ble_queue_t *ble_queue, ble_packet_container_t *ble_packet_container);
-static int ble_queue_deq(volatile ble_queue_t *ble_queue, ble_packet_container_t *ble_packet_container);
-//static int ble_queue_trigger_interrupt(void)
+static ble_packet_container_t *ble_queue_reserve(ble_queue_t *ble_queue);
+static void ble_queue_commit(ble_queue_t *ble_queue);
+static ble_packet_container_t *ble_queue_peek(ble_queue_t *ble_queue);
+static void ble_queue_release(ble_queue_t *ble_queue);
+static int ble_queue_enq(ble_queue_t *ble_queue, ble_packet_container_t *ble_packet_container);
+static int ble_queue_deq(ble_queue_t *ble_queue, ble_packet_container_t *ble_packet_container);
 
 
 //-----------------------------------------------------------------------------
 // Function definitions
 //-----------------------------------------------------------------------------
-//void core1_to_core0_int_handler(void *cbdata)
-//{
-//
-//}
-
-static int ble_queue_enq(volatile ble_queue_t *ble_queue, ble_packet_container_t *ble_packet_container)
+// Producer side, returns free slot or NULL if the queue is full
+static ble_packet_container_t *ble_queue_reserve(ble_queue_t *ble_queue)
 {
-    uint32_t next;
+    uint32_t head = ble_queue->head;
 
-    while(MXC_SEMA_GetSema(MAX32666_SEMAPHORE_BLE_QUEUE) == E_BUSY) {};
+    if ((head - ble_queue->tail) >= MAX32666_BLE_QUEUE_SIZE) {
+        return NULL;
+    }
 
-    next = (ble_queue->head + 1) % MAX32666_BLE_QUEUE_SIZE;
+    // Slot must not be written before the consumer released it
+    __DMB();
 
-    if (next == ble_queue->tail) {
-        MXC_SEMA_FreeSema(MAX32666_SEMAPHORE_BLE_QUEUE);
-        return E_OVERFLOW;
+    return &ble_queue->container_array[head & BLE_QUEUE_MASK];
+}
+
+// Producer side, publishes the slot returned by ble_queue_reserve
+static void ble_queue_commit(ble_queue_t *ble_queue)
+{
+    // Slot content must be visible before the new head
+    __DMB();
+    ble_queue->head = ble_queue->head + 1;
+}
+
+// Consumer side, returns oldest slot or NULL if the queue is empty
+static ble_packet_container_t *ble_queue_peek(ble_queue_t *ble_queue)
+{
+    uint32_t tail = ble_queue->tail;
+
+    // Drop entries enqueued before a flush requested by the producer
+    if (ble_queue->flush_ack != ble_queue->flush_req) {
+        uint32_t flush_req = ble_queue->flush_req;
+
+        __DMB();
+        if ((int32_t)(ble_queue->flush_head - tail) > 0) {
+            tail = ble_queue->flush_head;
+            ble_queue->tail = tail;
+        }
+        ble_queue->flush_ack = flush_req;
     }
 
-    memcpy((uint8_t *) &(ble_queue->container_array[ble_queue->head]), ble_packet_container, sizeof(ble_packet_container_t));
-    ble_queue->head = next;
+    if (tail == ble_queue->head) {
+        return NULL;
+    }
 
-    MXC_SEMA_FreeSema(MAX32666_SEMAPHORE_BLE_QUEUE);
+    // Slot must not be read before the head that published it
+    __DMB();
 
-    return E_SUCCESS;
+    return &ble_queue->container_array[tail & BLE_QUEUE_MASK];
 }
 
-static int ble_queue_deq(volatile ble_queue_t *ble_queue, ble_packet_container_t *ble_packet_container)
+// Consumer side, frees the slot returned by ble_queue_peek
+static void ble_queue_release(ble_queue_t *ble_queue)
 {
-    uint32_t next;
+    // Slot reads must complete before the producer may reuse it
+    __DMB();
+    ble_queue->tail = ble_queue->tail + 1;
+}
 
-    while(MXC_SEMA_GetSema(MAX32666_SEMAPHORE_BLE_QUEUE) == E_BUSY) {};
+static int ble_queue_enq(ble_queue_t *ble_queue, ble_packet_container_t *ble_packet_container)
+{
+    ble_packet_container_t *slot = ble_queue_reserve(ble_queue);
 
-    if (ble_queue->head == ble_queue->tail) {
-        MXC_SEMA_FreeSema(MAX32666_SEMAPHORE_BLE_QUEUE);
-        return E_UNDERFLOW;
+    if (!slot) {
+        return E_OVERFLOW;
     }
 
-    next = (ble_queue->tail + 1) % MAX32666_BLE_QUEUE_SIZE;
+    // Only the used part of the packet is copied
+    memcpy(slot, ble_packet_container, sizeof(slot->size) + MIN(ble_packet_container->size, sizeof(slot->packet)));
+    ble_queue_commit(ble_queue);
 
-    memcpy(ble_packet_container, (uint8_t *) &(ble_queue->container_array[ble_queue->tail]), sizeof(ble_packet_container_t));
-    ble_queue->tail = next;
+    return E_SUCCESS;
+}
 
-    MXC_SEMA_FreeSema(MAX32666_SEMAPHORE_BLE_QUEUE);
+static int ble_queue_deq(ble_queue_t *ble_queue, ble_packet_container_t *ble_packet_container)
+{
+    ble_packet_container_t *slot = ble_queue_peek(ble_queue);
+
+    if (!slot) {
+        return E_UNDERFLOW;
+    }
+
+    memcpy(ble_packet_container, slot, sizeof(slot->size) + MIN(slot->size, sizeof(slot->packet)));
+    ble_queue_release(ble_queue);
 
     return E_SUCCESS;
 }
@@ -145,46 +199,64 @@ int ble_queue_deq_tx(ble_packet_container_t *ble_packet_container)
 
 int ble_queue_enq_tx(ble_packet_container_t *ble_packet_container)
 {
+    TRACE_EVENT(TRACE_EVENT_BLE_ENQUEUE, ble_packet_container->size);
+
     return ble_queue_enq(&ble_queue_tx, ble_packet_container);
 }
 
-int ble_queue_flush(void)
+ble_packet_container_t *ble_queue_reserve_rx(void)
 {
-    while(MXC_SEMA_GetSema(MAX32666_SEMAPHORE_BLE_QUEUE) == E_BUSY) {};
+    return ble_queue_reserve(&ble_queue_rx);
+}
 
-    ble_queue_rx.head = 0;
-    ble_queue_rx.tail = 0;
-    ble_queue_tx.head = 0;
-    ble_queue_tx.tail = 0;
+void ble_queue_commit_rx(void)
+{
+    ble_queue_commit(&ble_queue_rx);
+}
 
-    MXC_SEMA_FreeSema(MAX32666_SEMAPHORE_BLE_QUEUE);
+ble_packet_container_t *ble_queue_reserve_tx(void)
+{
+    return ble_queue_reserve(&ble_queue_tx);
+}
 
-    return E_SUCCESS;
+void ble_queue_commit_tx(void)
+{
+    TRACE_EVENT(TRACE_EVENT_BLE_ENQUEUE, ble_queue_tx.container_array[ble_queue_tx.head & BLE_QUEUE_MASK].size);
+
+    ble_queue_commit(&ble_queue_tx);
 }
 
-//static int ble_queue_trigger_interrupt(void)
-//{
-//    // Only Core1 can call this function
-//    if (SCB->VTOR != (unsigned long)&__isr_vector_core1) {
-//        return E_NOT_SUPPORTED;
-//    }
-//    GPIO_CLR(core1_int_pin);
-//    GPIO_SET(core1_int_pin);
-//
-//    return E_SUCCESS;
-//}
+int ble_queue_count_tx(void)
+{
+    // Producer view, entries dropped by a pending flush are still counted until core1 acknowledges
+    return ble_queue_tx.head - ble_queue_tx.tail;
+}
 
-int ble_queue_init(void)
+ble_packet_container_t *ble_queue_peek_tx(void)
 {
-//    MXC_GPIO_Config(&core0_int_pin);
-//    MXC_GPIO_RegisterCallback(&core0_int_pin, core1_to_core0_int_handler, NULL);
-//    MXC_GPIO_IntConfig(&core0_int_pin, MAX32666_CORE0_INT_MODE);
-//    MXC_GPIO_EnableInt(core0_int_pin.port, core0_int_pin.mask);
-//    NVIC_EnableIRQ(MXC_GPIO_GET_IRQ(MXC_GPIO_GET_IDX(core0_int_pin.port)));
-//
-//    GPIO_SET(core1_int_pin);
-//    MXC_GPIO_Config(&core1_int_pin);
+    return ble_queue_peek(&ble_queue_tx);
+}
 
+void ble_queue_release_tx(void)
+{
+    ble_queue_release(&ble_queue_tx);
+}
+
+int ble_queue_flush(void)
+{
+    // Core0 consumes rx, it can drop everything directly
+    ble_queue_rx.tail = ble_queue_rx.head;
+
+    // Core0 produces tx, ask core1 to drop what is queued so far
+    ble_queue_tx.flush_head = ble_queue_tx.head;
+    __DMB();
+    ble_queue_tx.flush_req = ble_queue_tx.flush_req + 1;
+
+    return E_SUCCESS;
+}
+
+int ble_queue_init(void)
+{
     ble_queue_flush();
 
     return E_SUCCESS;
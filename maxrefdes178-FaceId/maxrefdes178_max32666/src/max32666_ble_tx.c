@@ -0,0 +1,152 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+#include <string.h>
+
+#include "max32666_ble.h"
+#include "max32666_ble_queue.h"
+#include "max32666_ble_tx.h"
+#include "max32666_data.h"
+#include "max32666_debug.h"
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_utility.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define S_MODULE_NAME   "ble_tx"
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static int ble_tx_retry;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static int ble_tx_send_container(ble_packet_container_t *ble_packet_container, int *partial);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+static int ble_tx_send_container(ble_packet_container_t *ble_packet_container, int *partial)
+{
+    ble_payload_packet_t payload_packet;
+    uint8_t *packet = (uint8_t *) &(ble_packet_container->packet);
+    uint16_t max_packet_size = device_status.ble_max_packet_size;
+    uint16_t packet_payload_size;
+    uint16_t offset;
+    int ret;
+
+    *partial = 0;
+
+    // Core0 queues packets ahead, number them in send order
+    ble_packet_container->packet.packet_info.seq = device_status.ble_next_tx_seq;
+
+    if (ble_packet_container->size <= max_packet_size) {
+        return ble_send_indication(ble_packet_container->size, packet);
+    }
+
+    if (max_packet_size <= sizeof(ble_command_packet_header_t)) {
+        PR_ERROR("invalid max packet size %d", max_packet_size);
+        return E_BAD_STATE;
+    }
+
+    // MTU shrank after the packet was queued, send the remainder as payload packets which the peer appends
+    ret = ble_send_indication(max_packet_size, packet);
+    for (offset = max_packet_size; (ret == E_SUCCESS) && (offset < ble_packet_container->size);
+            offset += packet_payload_size) {
+        *partial = 1;
+        packet_payload_size = MIN((uint32_t)(ble_packet_container->size - offset),
+                max_packet_size - sizeof(ble_payload_packet_header_t));
+        payload_packet.header.packet_info.type = BLE_PACKET_TYPE_PAYLOAD;
+        payload_packet.header.packet_info.seq = device_status.ble_next_tx_seq;
+        memcpy(payload_packet.payload, &packet[offset], packet_payload_size);
+        ret = ble_send_indication(sizeof(ble_payload_packet_header_t) + packet_payload_size, (uint8_t *) &payload_packet);
+    }
+
+    return ret;
+}
+
+int ble_tx_worker(void)
+{
+    ble_packet_container_t *ble_packet_container;
+    int partial;
+    int ret;
+
+    // Nothing is sent until core0 flushed the aborted stream
+    if (device_status.ble_tx_aborted) {
+        return E_BUSY;
+    }
+
+    // Send straight from the queue slot
+    ble_packet_container = ble_queue_peek_tx();
+    if (!ble_packet_container) {
+        return E_NO_ERROR;
+    }
+
+    ret = ble_tx_send_container(ble_packet_container, &partial);
+    if (ret == E_SUCCESS) {
+        ble_tx_retry = 0;
+        ble_queue_release_tx();
+        return E_SUCCESS;
+    }
+
+    // Nothing of the packet reached the peer, keep the slot and send it again on the next pass
+    if (!partial && (ret == E_COMM_ERR) && (++ble_tx_retry < MAX32666_BLE_TX_RETRY)) {
+        PR_ERROR("ble tx failed, retry %d", ble_tx_retry);
+        return ret;
+    }
+
+    // Dropping only this packet would leave a gap in the stream, core0 flushes the rest of it
+    PR_ERROR("ble tx failed %d, abort", ret);
+    ble_tx_retry = 0;
+    device_status.ble_tx_aborted = 1;
+
+    return ret;
+}
@@ -72,6 +72,7 @@ volatile device_settings_t device_settings = {
         .enable_max78000_video_cnn = 1,
         .enable_max78000_video_flash_led = 0,
         .enable_max78000_video_vflip = 1,
+        .enable_max78000_video_compression = 1,
         .enable_max78000_video_and_audio_power = 1,
         .enable_lcd_statistics = 0,
         .enable_lcd_probabilty = 0,
@@ -79,6 +80,8 @@ volatile device_settings_t device_settings = {
         .enable_ble_send_classification = 0,
         .enable_inactivity = 1,
         .lcd_rotation = LCD_ROTATION_UP,
+        .governor_policy = GOVERNOR_POLICY_MAX_FPS,
+        .governor_target_minutes = 8 * 60,
 		.enable_voicecommand = 1,
 };
 
@@ -50,6 +50,7 @@
 #include "max32666_i2c.h"
 #include "max32666_timer_led_button.h"
 #include "max32666_pmic.h"
+#include "maxrefdes178_scheduler.h"
 #include "maxrefdes178_utility.h"
 
 
@@ -80,6 +81,7 @@ static volatile int expander_int_flag = 0;
 void expander_int(void *cbdata)
 {
     expander_int_flag = 1;
+    scheduler_post(MAX32666_EVENT_INPUT);
 }
 
 int expander_init(void)
@@ -71,6 +71,9 @@
 #include "max32666_touch.h"
 #include "max32666_usb.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_governor.h"
+#include "maxrefdes178_scheduler.h"
+#include "maxrefdes178_trace.h"
 #include "maxrefdes178_version.h"
 
 
@@ -106,7 +109,19 @@ static void core1_irq_init(void);
 static void core0_icc(int enable);
 static void core1_icc(int enable);
 static void run_application(void);
+static void qspi_task(void);
+static void display_task(void);
+static void input_task(void);
+static void ble_task(void);
+static void status_task(void);
+static void led_task(void);
+static void powmon_task(void);
+static void pmic_task(void);
 static int refresh_screen(void);
+static void governor_worker(void);
+#ifdef ENABLE_TRACE
+static void send_trace_dump(void);
+#endif
 
 
 //-----------------------------------------------------------------------------
@@ -329,7 +344,7 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD);
             qspi_master_wait_video_int();
-            qspi_master_video_rx_worker(&qspi_packet_type_rx);
+            qspi_master_video_rx_wait(&qspi_packet_type_rx);
             if (device_status.faceid_embed_subject_names_size) {
                 break;
             }
@@ -338,7 +353,7 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_VERSION_CMD);
             qspi_master_wait_video_int();
-            qspi_master_video_rx_worker(&qspi_packet_type_rx);
+            qspi_master_video_rx_wait(&qspi_packet_type_rx);
             if (device_info.device_version.max78000_video.major || device_info.device_version.max78000_video.minor) {
                 break;
             }
@@ -346,7 +361,7 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_audio(NULL, 0, QSPI_PACKET_TYPE_AUDIO_VERSION_CMD);
             qspi_master_wait_audio_int();
-            qspi_master_audio_rx_worker(&qspi_packet_type_rx);
+            qspi_master_audio_rx_wait(&qspi_packet_type_rx);
             if (device_info.device_version.max78000_audio.major || device_info.device_version.max78000_audio.minor) {
                 break;
             }
@@ -355,7 +370,7 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DEMO_NAME_CMD);
             qspi_master_wait_video_int();
-            qspi_master_video_rx_worker(&qspi_packet_type_rx);
+            qspi_master_video_rx_wait(&qspi_packet_type_rx);
             if (device_info.max78000_video_demo_name[0]) {
                 break;
             }
@@ -363,12 +378,17 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_audio(NULL, 0, QSPI_PACKET_TYPE_AUDIO_DEMO_NAME_CMD);
             qspi_master_wait_audio_int();
-            qspi_master_audio_rx_worker(&qspi_packet_type_rx);
+            qspi_master_audio_rx_wait(&qspi_packet_type_rx);
             if (device_info.max78000_audio_demo_name[0]) {
                 break;
             }
         }
 
+        // Video firmware without compression support keeps sending raw frames
+        if (device_settings.enable_max78000_video_compression) {
+            qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_COMPRESSION_CMD);
+        }
+
         ret = E_NO_ERROR;
         // Check video and audio fw version
         if (!(device_info.device_version.max78000_video.major || device_info.device_version.max78000_video.minor)) {
@@ -421,7 +441,8 @@ int main(void)
                 expander_worker();
 
                 if (lcd_data.refresh_screen && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
-                    memcpy(lcd_data.buffer, adi_logo, sizeof(lcd_data.buffer));
+                    memcpy(lcd_data.buffer, adi_logo, LCD_DATA_SIZE);
+                    lcd_mark_dirty_all();
                     if (strlen(lcd_data.notification) < (LCD_WIDTH / Font_11x18.width)) {
                         fonts_putStringCentered(LCD_HEIGHT - Font_11x18.height - 3, lcd_data.notification, &Font_11x18, lcd_data.notification_color, lcd_data.buffer);
                     } else {
@@ -433,6 +454,8 @@ int main(void)
         }
     }
 
+    TRACE_INIT(TRACE_SOURCE_MAX32666);
+
     PR_INFO("core 0 init completed");
 
     run_application();
@@ -442,63 +465,91 @@ int main(void)
 
 static void run_application(void)
 {
-    qspi_packet_type_e qspi_packet_type_rx = 0;
+    // Tasks in priority order, the frame path first
+    static scheduler_task_t tasks[] = {
+        {.handler = qspi_task,    .events = MAX32666_EVENT_QSPI,  .period = MAX32666_QSPI_POLL_INTERVAL},
+        {.handler = display_task, .events = MAX32666_EVENT_LCD,   .period = MAX32666_LCD_POLL_INTERVAL},
+        {.handler = input_task,   .events = MAX32666_EVENT_INPUT, .period = 0},
+        {.handler = ble_task,     .events = 0,                    .period = MAX32666_BLE_INTERVAL},
+        {.handler = status_task,  .events = 0,                    .period = MAX32666_STATUS_INTERVAL},
+        {.handler = led_task,     .events = 0,                    .period = MAX32666_LED_INTERVAL},
+        {.handler = powmon_task,  .events = 0,                    .period = MAX32666_POWMON_INTERVAL},
+        {.handler = pmic_task,    .events = 0,                    .period = MAX32666_PMIC_INTERVAL},
+    };
+
     video_frame_color = WHITE;
-    uint16_t touch_x1, touch_y1;
 
     core0_icc(1);
 
+    if (scheduler_init(tasks, sizeof(tasks) / sizeof(tasks[0]), timer_ms_tick)) {
+        PR_ERROR("scheduler_init failed");
+    }
+
     // Main application loop
     while (1) {
+        // Run the highest priority ready task, sleep until an interrupt when none is ready.
+        // The ms timer wakes the core at least every ms.
+        if (!scheduler_dispatch(timer_ms_tick)) {
+            __WFI();
+        }
+    }
+}
 
-        // Handle Video QSPI RX
-        if (qspi_master_video_rx_worker(&qspi_packet_type_rx) == E_NO_ERROR) {
-            switch(qspi_packet_type_rx) {
-            case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
-                timestamps.video_data_received = timer_ms_tick;
-                lcd_data.refresh_screen = 1;
-                break;
-            case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
-                timestamps.activity_detected = timer_ms_tick;
-                if (device_status.classification_video.classification == CLASSIFICATION_UNKNOWN) {
-                    video_string_color = RED;
-                    video_frame_color = RED;
-                } else if (device_status.classification_video.classification == CLASSIFICATION_LOW_CONFIDENCE) {
-                    video_string_color = YELLOW;
-                    video_frame_color = YELLOW;
-                } else if (device_status.classification_video.classification == CLASSIFICATION_DETECTED) {
-                    video_string_color = GREEN;
-                    video_frame_color = GREEN;
-                } else if (device_status.classification_video.classification == CLASSIFICATION_NOTHING) {
-                    video_frame_color = WHITE;
-                }
+// Video and audio QSPI, on slave interrupts and QSPI DMA completion
+static void qspi_task(void)
+{
+    qspi_packet_type_e qspi_packet_type_rx = 0;
 
-                if (device_settings.enable_ble_send_classification && device_status.ble_connected) {
-                    ble_command_send_single_packet(BLE_COMMAND_GET_MAX78000_VIDEO_CLASSIFICATION_RES,
-                        sizeof(device_status.classification_video), (uint8_t *) &device_status.classification_video);
-                }
-                break;
-            case QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_RES:
-                if (device_status.ble_connected) {
-                    ble_command_send_single_packet(BLE_COMMAND_FACEID_EMBED_UPDATE_RES,
-                        sizeof(device_status.faceid_embed_update_status), (uint8_t *) &device_status.faceid_embed_update_status);
-                }
-                qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD);
-                lcd_notification(GREEN, "FaceID signature updated");
-                break;
-            case QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_RES:
-                timestamps.faceid_subject_names_received = timer_ms_tick;
-                break;
-            default:
-                break;
+    // Handle Video QSPI RX
+    if (qspi_master_video_rx_worker(&qspi_packet_type_rx) == E_NO_ERROR) {
+        switch(qspi_packet_type_rx) {
+        case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
+            timestamps.video_data_received = timer_ms_tick;
+            break;
+        case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
+            timestamps.activity_detected = timer_ms_tick;
+            if (device_status.classification_video.classification == CLASSIFICATION_UNKNOWN) {
+                video_string_color = RED;
+                video_frame_color = RED;
+            } else if (device_status.classification_video.classification == CLASSIFICATION_LOW_CONFIDENCE) {
+                video_string_color = YELLOW;
+                video_frame_color = YELLOW;
+            } else if (device_status.classification_video.classification == CLASSIFICATION_DETECTED) {
+                video_string_color = GREEN;
+                video_frame_color = GREEN;
+            } else if (device_status.classification_video.classification == CLASSIFICATION_NOTHING) {
+                video_frame_color = WHITE;
             }
+            if (device_status.classification_video.classification != CLASSIFICATION_NOTHING) {
+                timestamps.scene_activity = timer_ms_tick;
+            }
+
+            if (device_settings.enable_ble_send_classification && device_status.ble_connected) {
+                ble_command_send_single_packet(BLE_COMMAND_GET_MAX78000_VIDEO_CLASSIFICATION_RES,
+                    sizeof(device_status.classification_video), (uint8_t *) &device_status.classification_video);
+            }
+            break;
+        case QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_RES:
+            if (device_status.ble_connected) {
+                ble_command_send_single_packet(BLE_COMMAND_FACEID_EMBED_UPDATE_RES,
+                    sizeof(device_status.faceid_embed_update_status), (uint8_t *) &device_status.faceid_embed_update_status);
+            }
+            qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD);
+            lcd_notification(GREEN, "FaceID signature updated");
+            break;
+        case QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_RES:
+            timestamps.faceid_subject_names_received = timer_ms_tick;
+            break;
+        default:
+            break;
         }
+    }
 
-        // Handle Audio QSPI RX
-        if (qspi_master_audio_rx_worker(&qspi_packet_type_rx) == E_NO_ERROR) {
-            switch(qspi_packet_type_rx) {
-            case QSPI_PACKET_TYPE_AUDIO_CLASSIFICATION_RES:
-                timestamps.audio_result_received = timer_ms_tick;
+    // Handle Audio QSPI RX
+    if (qspi_master_audio_rx_worker(&qspi_packet_type_rx) == E_NO_ERROR) {
+        switch(qspi_packet_type_rx) {
+        case QSPI_PACKET_TYPE_AUDIO_CLASSIFICATION_RES:
+            timestamps.audio_result_received = timer_ms_tick;
 				
 				// only activate on "CUBE"
 				if ((strcmp(device_status.classification_audio.result, "CUBE") == 0) &&
@@ -506,12 +557,12 @@ static void run_application(void)
 					timestamps.activity_detected = timer_ms_tick;
 				}
 #if 0
-                if (device_status.classification_audio.classification == CLASSIFICATION_UNKNOWN) {
-                    audio_string_color = RED;
-                } else if (device_status.classification_audio.classification == CLASSIFICATION_LOW_CONFIDENCE) {
-                    audio_string_color = YELLOW;
-                } else if (device_status.classification_audio.classification == CLASSIFICATION_DETECTED) {
-                    audio_string_color = GREEN;
+            if (device_status.classification_audio.classification == CLASSIFICATION_UNKNOWN) {
+                audio_string_color = RED;
+            } else if (device_status.classification_audio.classification == CLASSIFICATION_LOW_CONFIDENCE) {
+                audio_string_color = YELLOW;
+            } else if (device_status.classification_audio.classification == CLASSIFICATION_DETECTED) {
+                audio_string_color = GREEN;
 				}
 #else
 				if (!device_settings.enable_voicecommand) {
@@ -542,181 +593,309 @@ static void run_application(void)
 							qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CNN_CMD);
 						}
 					}
-                }
+            }
 				// update last result
 				strcpy(device_status.classification_audio_last.result, device_status.classification_audio.result);
 				device_status.classification_audio_last.classification = device_status.classification_audio.classification;
 				
-                if (device_settings.enable_ble_send_classification && device_status.ble_connected) {
-                    ble_command_send_single_packet(BLE_COMMAND_GET_MAX78000_AUDIO_CLASSIFICATION_RES,
-                        sizeof(device_status.classification_audio), (uint8_t *) &device_status.classification_audio);
-                }
-                if (!device_settings.enable_max78000_video) {
-                    lcd_data.refresh_screen = 1;
-                }
-                break;
-            default:
-                break;
+            if (device_settings.enable_ble_send_classification && device_status.ble_connected) {
+                ble_command_send_single_packet(BLE_COMMAND_GET_MAX78000_AUDIO_CLASSIFICATION_RES,
+                    sizeof(device_status.classification_audio), (uint8_t *) &device_status.classification_audio);
+            }
+            if (!device_settings.enable_max78000_video) {
+                lcd_data.refresh_screen = 1;
             }
+            break;
+        default:
+            break;
         }
+    }
+
+    // Handle QSPI TX
+    qspi_master_video_ack_worker();
+    qspi_master_video_tx_worker();
+    qspi_master_audio_tx_worker();
+}
+
+// Frame swap and screen refresh, on received frames and LCD DMA completion
+static void display_task(void)
+{
+    // Show the latest video frame once the LCD and QSPI are done with the buffers,
+    // not faster than the governor operating point allows
+    if (lcd_data.frame_pending && device_settings.enable_max78000_video &&
+        qspi_master_video_rx_idle() && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL) &&
+        ((timer_ms_tick - timestamps.screen_drew) >= governor_get_point(device_status.governor.level)->lcd_interval)) {
+        lcd_swap_buffers();
+        qspi_master_video_ack(QSPI_PACKET_TYPE_VIDEO_DATA_RES);
+    }
+
+#if MAX32666_LCD_DOUBLE_BUFFER
+    // The next frame is received into the back buffer while this one goes to the LCD
+    qspi_master_video_ack_worker();
+#endif
+
+    // Refresh LCD
+    if (lcd_data.refresh_screen && device_settings.enable_lcd && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
+        refresh_screen();
+    }
+
+#if !MAX32666_LCD_DOUBLE_BUFFER
+    // The next frame would be received into the buffer being sent to the LCD, the worker holds
+    // the acknowledge until the LCD DMA is done
+    qspi_master_video_ack_worker();
+#endif
+}
 
-        // Handle QSPI TX
-        qspi_master_video_tx_worker();
-        qspi_master_audio_tx_worker();
+// Touch, buttons and IO expander inputs, on their interrupts
+static void input_task(void)
+{
+    uint16_t touch_x1, touch_y1;
 
-        // Send BLE periodic statistics
-        if (device_settings.enable_ble_send_statistics && device_status.ble_connected) {
-            if ((timer_ms_tick - timestamps.statistics_sent) > BLE_STATISTICS_INTERVAL) {
-                timestamps.statistics_sent = timer_ms_tick;
-                ble_command_send_single_packet(BLE_COMMAND_GET_STATISTICS_RES,
-                    sizeof(device_status.statistics), (uint8_t *) &device_status.statistics);
+    // IO expander worker
+    expander_worker();
+
+    // Touch screen worker
+    if (touch_worker(&touch_x1, &touch_y1) == E_NO_ERROR) {
+
+        // Check if init page start button is clicked
+        if (device_settings.enable_max78000_video == 0) {
+            if ((LCD_START_BUTTON_X1 <= touch_x1) && (touch_x1 <= LCD_START_BUTTON_X2) &&
+                (LCD_START_BUTTON_Y1 <= touch_y1) && (touch_y1 <= LCD_START_BUTTON_Y2)) {
+                device_settings.enable_max78000_video = 1;
+                qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
+                PR_INFO("start button clicked");
             }
         }
 
-        if (device_settings.enable_max78000_video) {
-            // If video is not available for a long time, draw logo and refresh periodically
-            if ((timer_ms_tick - timestamps.video_data_received) > LCD_NO_VIDEO_REFRESH_DURATION) {
-                timestamps.video_data_received = timer_ms_tick;
-                memcpy(lcd_data.buffer, adi_logo, sizeof(lcd_data.buffer));
-                snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1, "No video!");
-                fonts_putStringCentered(16, lcd_string_buff, &Font_11x18, RED, lcd_data.buffer);
-                lcd_data.refresh_screen = 1;
-            }
+        PR_INFO("touch %d %d", touch_x1, touch_y1);
+        timestamps.activity_detected = timer_ms_tick;
+        timestamps.scene_activity = timer_ms_tick;
+    }
+
+    // Button worker
+    button_worker();
+
+    // USB worker
+//    usb_worker();
+}
+
+// BLE commands and connection changes, core1 is polled
+static void ble_task(void)
+{
+    // Handle BLE communication
+    if (device_settings.enable_ble && device_status.ble_connected) {
+        ble_command_worker();
+    }
+
+    // Check if BLE status changed
+    if (device_status.ble_connected_status_changed) {
+        device_status.ble_connected_status_changed = 0;
+
+        ble_queue_flush();
+        ble_command_reset();
+        device_settings.enable_ble_send_classification = 0;
+        device_settings.enable_ble_send_statistics = 0;
+
+        if (device_status.ble_connected) {
+            snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1,
+                    "BLE %02X:%02X:%02X:%02X:%02X:%02X connected!",
+                    device_status.ble_connected_peer_mac[5], device_status.ble_connected_peer_mac[4],
+                    device_status.ble_connected_peer_mac[3], device_status.ble_connected_peer_mac[2],
+                    device_status.ble_connected_peer_mac[1], device_status.ble_connected_peer_mac[0]);
+            lcd_notification(BLUE, lcd_string_buff);
         } else {
-            // If video is disabled, draw logo and refresh periodically
-            if ((timer_ms_tick - timestamps.screen_drew) > LCD_VIDEO_DISABLE_REFRESH_DURATION) {
-                memcpy(lcd_data.buffer, adi_logo, sizeof(lcd_data.buffer));
-                snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1, "Video disabled");
-                fonts_putStringCentered(15, lcd_string_buff, &Font_11x18, RED, lcd_data.buffer);
-                lcd_data.refresh_screen = 1;
-            }
+            lcd_notification(BLUE, "BLE disconnected!");
         }
+    }
 
-        // Handle BLE communication
-        if (device_settings.enable_ble && device_status.ble_connected) {
-            ble_command_worker();
+    if (device_status.ble_running_status_changed) {
+        if (device_settings.enable_ble) {
+            PR_INFO("Enable Core1");
+            Core1_Start();
+        } else {
+            PR_INFO("Disable Core1");
+            Core1_Stop();
         }
+        device_status.ble_running_status_changed = 0;
+    }
+}
 
-        // Check if BLE status changed
-        if (device_status.ble_connected_status_changed) {
-            device_status.ble_connected_status_changed = 0;
-
-            ble_queue_flush();
-            ble_command_reset();
-            device_settings.enable_ble_send_classification = 0;
-            device_settings.enable_ble_send_statistics = 0;
+// Statistics, trace dumps, no video screen and inactivity
+static void status_task(void)
+{
+    // Send BLE periodic statistics
+    if (device_settings.enable_ble_send_statistics && device_status.ble_connected) {
+        if ((timer_ms_tick - timestamps.statistics_sent) > BLE_STATISTICS_INTERVAL) {
+            timestamps.statistics_sent = timer_ms_tick;
+            ble_command_send_single_packet(BLE_COMMAND_GET_STATISTICS_RES,
+                sizeof(device_status.statistics), (uint8_t *) &device_status.statistics);
+        }
+    }
 
-            if (device_status.ble_connected) {
-                snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1,
-                        "BLE %02X:%02X:%02X:%02X:%02X:%02X connected!",
-                        device_status.ble_connected_peer_mac[5], device_status.ble_connected_peer_mac[4],
-                        device_status.ble_connected_peer_mac[3], device_status.ble_connected_peer_mac[2],
-                        device_status.ble_connected_peer_mac[1], device_status.ble_connected_peer_mac[0]);
-                lcd_notification(BLUE, lcd_string_buff);
-            } else {
-                lcd_notification(BLUE, "BLE disconnected!");
-            }
+#ifdef ENABLE_TRACE
+    // Send BLE trace dumps
+    if (device_status.ble_connected) {
+        if ((timer_ms_tick - timestamps.trace_sent) > BLE_STATISTICS_INTERVAL) {
+            timestamps.trace_sent = timer_ms_tick;
+            send_trace_dump();
         }
+    }
+#endif
 
-        if (device_status.ble_running_status_changed) {
-            if (device_settings.enable_ble) {
-                PR_INFO("Enable Core1");
-                Core1_Start();
-            } else {
-                PR_INFO("Disable Core1");
-                Core1_Stop();
-            }
-            device_status.ble_running_status_changed = 0;
+    if (device_settings.enable_max78000_video) {
+        // If video is not available for a long time, draw logo and refresh periodically
+        if ((timer_ms_tick - timestamps.video_data_received) > LCD_NO_VIDEO_REFRESH_DURATION) {
+            timestamps.video_data_received = timer_ms_tick;
+            memcpy(lcd_data.buffer, adi_logo, LCD_DATA_SIZE);
+            lcd_mark_dirty_all();
+            snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1, "No video!");
+            fonts_putStringCentered(16, lcd_string_buff, &Font_11x18, RED, lcd_data.buffer);
+            lcd_data.refresh_screen = 1;
+        }
+    } else {
+        // If video is disabled, draw logo and refresh periodically
+        if ((timer_ms_tick - timestamps.screen_drew) > LCD_VIDEO_DISABLE_REFRESH_DURATION) {
+            memcpy(lcd_data.buffer, adi_logo, LCD_DATA_SIZE);
+            lcd_mark_dirty_all();
+            snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1, "Video disabled");
+            fonts_putStringCentered(15, lcd_string_buff, &Font_11x18, RED, lcd_data.buffer);
+            lcd_data.refresh_screen = 1;
         }
+    }
 
-        // Check inactivity
-        if (device_settings.enable_inactivity) {
-            if ((timer_ms_tick - timestamps.activity_detected) > INACTIVITY_LONG_DURATION) {
-                if (device_status.inactivity_state != INACTIVITY_STATE_INACTIVE_LONG) {
-                    device_status.inactivity_state = INACTIVITY_STATE_INACTIVE_LONG;
-                    // Switch to inactive long state
-                    lcd_backlight(0, 0);
-                    qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CMD);
-                    PR_INFO("Inactive long");
+    // Check inactivity
+    if (device_settings.enable_inactivity) {
+        if ((timer_ms_tick - timestamps.activity_detected) > INACTIVITY_LONG_DURATION) {
+            if (device_status.inactivity_state != INACTIVITY_STATE_INACTIVE_LONG) {
+                device_status.inactivity_state = INACTIVITY_STATE_INACTIVE_LONG;
+                // Switch to inactive long state
+                lcd_backlight(0, 0);
+                qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CMD);
+                PR_INFO("Inactive long");
+            }
+        } else if ((timer_ms_tick - timestamps.activity_detected) > INACTIVITY_SHORT_DURATION) {
+            if (device_status.inactivity_state != INACTIVITY_STATE_INACTIVE_SHORT) {
+                device_status.inactivity_state = INACTIVITY_STATE_INACTIVE_SHORT;
+                // Switch to inactive short state
+                if (device_settings.enable_lcd) {
+                    lcd_backlight(1, MAX32666_LCD_BACKLIGHT_LOW);
                 }
-            } else if ((timer_ms_tick - timestamps.activity_detected) > INACTIVITY_SHORT_DURATION) {
-                if (device_status.inactivity_state != INACTIVITY_STATE_INACTIVE_SHORT) {
-                    device_status.inactivity_state = INACTIVITY_STATE_INACTIVE_SHORT;
-                    // Switch to inactive short state
-                    if (device_settings.enable_lcd) {
-                        lcd_backlight(1, MAX32666_LCD_BACKLIGHT_LOW);
-                    }
-                    PR_INFO("Inactive short");
+                PR_INFO("Inactive short");
+            }
+        } else {
+            if (device_status.inactivity_state != INACTIVITY_STATE_ACTIVE) {
+                device_status.inactivity_state = INACTIVITY_STATE_ACTIVE;
+                // Switch to active state
+                if (device_settings.enable_lcd) {
+                    lcd_backlight(1, MAX32666_LCD_BACKLIGHT_HIGH);
                 }
-            } else {
-                if (device_status.inactivity_state != INACTIVITY_STATE_ACTIVE) {
-                    device_status.inactivity_state = INACTIVITY_STATE_ACTIVE;
-                    // Switch to active state
-                    if (device_settings.enable_lcd) {
-                        lcd_backlight(1, MAX32666_LCD_BACKLIGHT_HIGH);
-                    }
-                    if (device_settings.enable_max78000_video && device_settings.enable_lcd) {
-                        qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
-                    }
-                    PR_INFO("Active");
+                if (device_settings.enable_max78000_video && device_settings.enable_lcd) {
+                    qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
                 }
+                PR_INFO("Active");
             }
         }
+    }
+}
 
-        // Check PMIC and Fuel Gauge
-        if ((timer_ms_tick - timestamps.pmic_check) > MAX32666_PMIC_INTERVAL) {
-            timestamps.pmic_check = timer_ms_tick;
-            pmic_worker();
-            if (device_status.fuel_gauge_working) {
-                fuel_gauge_worker();
-            }
-        }
+// LED worker
+static void led_task(void)
+{
+    led_worker();
+}
 
-        // Power accumulator worker
-        if ((timer_ms_tick - timestamps.powmon) > MAX32666_POWMON_INTERVAL) {
-            timestamps.powmon = timer_ms_tick;
-            powmon_worker();
-        }
+// Power accumulator, the governor works on its readings
+static void powmon_task(void)
+{
+    powmon_worker();
+    governor_worker();
+}
 
-        // LED worker
-        if ((timer_ms_tick - timestamps.led) > MAX32666_LED_INTERVAL) {
-            timestamps.led = timer_ms_tick;
-            led_worker();
-        }
+// PMIC and Fuel Gauge
+static void pmic_task(void)
+{
+    pmic_worker();
+    if (device_status.fuel_gauge_working) {
+        fuel_gauge_worker();
+    }
+}
 
-        // IO expander worker
-        expander_worker();
+#ifdef ENABLE_TRACE
+static void send_trace_dump(void)
+{
+    static int next_source = 0;
+    trace_dump_t *dump;
 
-        // Touch screen worker
-        if (touch_worker(&touch_x1, &touch_y1) == E_NO_ERROR) {
+    // Local events are drained once the previous dump is out
+    if (!(device_status.trace_pending & (1 << TRACE_SOURCE_MAX32666))) {
+        trace_drain(&device_status.trace[TRACE_SOURCE_MAX32666]);
+        device_status.trace_pending |= (1 << TRACE_SOURCE_MAX32666);
+    }
 
-            // Check if init page start button is clicked
-            if (device_settings.enable_max78000_video == 0) {
-                if ((LCD_START_BUTTON_X1 <= touch_x1) && (touch_x1 <= LCD_START_BUTTON_X2) &&
-                    (LCD_START_BUTTON_Y1 <= touch_y1) && (touch_y1 <= LCD_START_BUTTON_Y2)) {
-                    device_settings.enable_max78000_video = 1;
-                    qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
-                    PR_INFO("start button clicked");
-                }
+    // One dump per call, round robin over the sources
+    for (int i = 0; i < TRACE_SOURCE_LAST; i++) {
+        next_source = (next_source + 1) % TRACE_SOURCE_LAST;
+        if (device_status.trace_pending & (1 << next_source)) {
+            dump = &device_status.trace[next_source];
+            if (ble_command_send_multi_packet(BLE_COMMAND_GET_TRACE_RES,
+                    TRACE_DUMP_SIZE(dump->count), (uint8_t *) dump) == E_NO_ERROR) {
+                device_status.trace_pending &= ~(1 << next_source);
             }
-
-            PR_INFO("touch %d %d", touch_x1, touch_y1);
-            timestamps.activity_detected = timer_ms_tick;
+            return;
         }
+    }
+}
+#endif
 
-        // Button worker
-        button_worker();
+static void governor_worker(void)
+{
+    static uint8_t applied_level = 0;
+    const governor_point_t *applied;
+    const governor_point_t *point;
+    governor_policy_t policy;
+    governor_input_t input;
+    uint8_t cnn_interval;
+
+    // Policy changed, restart from full rate
+    if ((device_status.governor.policy.policy != device_settings.governor_policy) ||
+        (device_status.governor.policy.target_minutes != device_settings.governor_target_minutes)) {
+        policy.policy = device_settings.governor_policy;
+        policy.target_minutes = device_settings.governor_target_minutes;
+        governor_init(&device_status.governor, &policy, timer_ms_tick);
+        PR_INFO("governor policy %d target %d min", policy.policy, policy.target_minutes);
+    }
 
-        // USB worker
-//        usb_worker();
+    input.time = timer_ms_tick;
+    input.video_power_mw = device_status.statistics.max78000_video_power_mw;
+    input.audio_power_mw = device_status.statistics.max78000_audio_power_mw;
+    input.idle_duration = timer_ms_tick - timestamps.scene_activity;
+    input.battery_soc = device_status.statistics.battery_soc;
+    input.battery_valid = device_status.fuel_gauge_working;
+    input.usb_chgin = device_status.usb_chgin;
+    input.thermal = device_status.pmic_thermal;
+
+    // Recorded for maxrefdes178_governor_sim.c, power was measured at the current level
+    PR_INFO("governor,%lu,%lu,%lu,%d,%d,%d,%d,%lu,%d", input.time, input.video_power_mw, input.audio_power_mw,
+            input.battery_soc, input.battery_valid, input.usb_chgin, input.thermal, input.idle_duration,
+            device_status.governor.level);
+
+    governor_update(&device_status.governor, &input);
+    if (device_status.governor.level == applied_level) {
+        return;
+    }
 
-        // Refresh LCD
-        if (lcd_data.refresh_screen && device_settings.enable_lcd && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
-            refresh_screen();
-        }
+    applied = governor_get_point(applied_level);
+    point = governor_get_point(device_status.governor.level);
+    applied_level = device_status.governor.level;
+    PR_INFO("governor level %d", applied_level);
 
-        // Sleep until an interrupt
-        __WFI();
+    // Camera clock commands follow camera_clock_e order
+    if (point->camera_clock != applied->camera_clock) {
+        qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_CAMERA_CLOCK_5_MHZ_CMD + point->camera_clock);
+    }
+    if (point->cnn_interval != applied->cnn_interval) {
+        cnn_interval = point->cnn_interval;
+        qspi_master_send_video(&cnn_interval, sizeof(cnn_interval), QSPI_PACKET_TYPE_VIDEO_CNN_INTERVAL_CMD);
     }
 }
 
@@ -924,6 +1103,7 @@ static void core1_irq_init(void)
     NVIC_DisableIRQ(GPIO1_IRQn);
 
     NVIC_DisableIRQ(MXC_TMR_GET_IRQ(MXC_TMR_GET_IDX(MAX32666_TIMER_MS)));
+    NVIC_DisableIRQ(MXC_TMR_GET_IRQ(MXC_TMR_GET_IDX(MAX32666_TIMER_QSPI_CS)));
 }
 
 static void core0_icc(int enable)
@@ -38,7 +38,9 @@
 //-----------------------------------------------------------------------------
 #include <gpio.h>
 #include <mxc_delay.h>
+#include <nvic_table.h>
 #include <string.h>
+#include <tmr.h>
 
 #include "max32666_debug.h"
 #include "max32666_data.h"
@@ -48,7 +50,12 @@
 #include "max32666_spi_dma.h"
 #include "max32666_timer_led_button.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+#include "maxrefdes178_qspi_packet.h"
+#include "maxrefdes178_scheduler.h"
+#include "maxrefdes178_trace.h"
 #include "maxrefdes178_utility.h"
+#include "maxrefdes178_video_codec.h"
 
 
 //-----------------------------------------------------------------------------
@@ -56,10 +63,94 @@
 //-----------------------------------------------------------------------------
 #define S_MODULE_NAME   "qspi"
 
+// Give up a receive if the slave does not complete it in time
+#define QSPI_RX_TIMEOUT_MS    500
+
 
 //-----------------------------------------------------------------------------
 // Typedefs
 //-----------------------------------------------------------------------------
+typedef enum {
+    QSPI_RX_STATE_IDLE = 0,
+    QSPI_RX_STATE_HEADER,         // Header DMA running
+    QSPI_RX_STATE_WAIT_PAYLOAD,   // Waiting slave interrupt to start payload DMA
+    QSPI_RX_STATE_CS_SETTLE,      // CS asserted, payload DMA starts from CS timer interrupt
+    QSPI_RX_STATE_PAYLOAD,        // Payload DMA running
+    QSPI_RX_STATE_COMPLETED,
+    QSPI_RX_STATE_ERROR,
+} qspi_rx_state_e;
+
+// Where the payload of a received packet type goes
+typedef struct {
+    qspi_packet_type_e packet_type;
+    uint8_t *buffer;                // Copied here from qspi_rx_stage once the payload CRC passes
+    uint32_t min_size;
+    uint32_t max_size;
+    void (*post_rx)(uint32_t size); // Called from main loop after the payload is received
+    uint8_t *(*buffer_get)(uint32_t size);  // Called from interrupt, payload DMA goes there directly, optional
+} qspi_rx_descriptor_t;
+
+// Payloads received to a descriptor buffer, largest one sets the size
+typedef union {
+    classification_result_t classification;
+    max78000_statistics_t statistics;
+    version_t version;
+    char demo_name[DEMO_STRING_SIZE];
+    serial_num_t serial;
+    faceid_embed_update_status_e faceid_embed_update_status;
+    char faceid_embed_subject_names[sizeof(device_status.faceid_embed_subject_names)];
+#ifdef ENABLE_TRACE
+    trace_dump_t trace;
+#endif
+} qspi_rx_stage_t;
+
+typedef struct {
+    mxc_gpio_cfg_t cs_pin;
+    mxc_gpio_cfg_t rw_pin;
+    volatile int *int_flag;
+    const qspi_rx_descriptor_t *descriptors;
+    int descriptor_count;
+    void (*header_done)(void);
+    void (*payload_done)(void);
+    volatile qspi_rx_state_e state;
+    volatile int error;
+    const qspi_rx_descriptor_t *descriptor;
+    uint8_t *buffer;
+    qspi_packet_header_t header;
+    uint32_t start_time;
+} qspi_rx_link_t;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void qspi_video_data_rx(uint32_t size);
+static void qspi_video_compressed_data_rx(uint32_t size);
+static void qspi_video_classification_rx(uint32_t size);
+static void qspi_video_statistics_rx(uint32_t size);
+static void qspi_video_version_rx(uint32_t size);
+static void qspi_video_demo_name_rx(uint32_t size);
+static void qspi_video_serial_rx(uint32_t size);
+static void qspi_video_faceid_embed_update_rx(uint32_t size);
+static void qspi_video_faceid_subjects_rx(uint32_t size);
+static void qspi_video_button_press_rx(uint32_t size);
+static void qspi_audio_classification_rx(uint32_t size);
+static void qspi_audio_statistics_rx(uint32_t size);
+static void qspi_audio_version_rx(uint32_t size);
+static void qspi_audio_demo_name_rx(uint32_t size);
+static void qspi_audio_serial_rx(uint32_t size);
+static void qspi_audio_button_press_rx(uint32_t size);
+#ifdef ENABLE_TRACE
+static void qspi_video_trace_rx(uint32_t size);
+static void qspi_audio_trace_rx(uint32_t size);
+#endif
+static uint8_t *qspi_video_data_buffer(uint32_t size);
+static uint8_t *qspi_video_compressed_data_buffer(uint32_t size);
+static void qspi_video_header_done(void);
+static void qspi_video_payload_done(void);
+static void qspi_audio_header_done(void);
+static void qspi_audio_payload_done(void);
+static void qspi_cs_timer(void);
 
 
 //-----------------------------------------------------------------------------
@@ -79,11 +170,109 @@ static qspi_packet_header_info_t qspi_header_buff_video_tx = {0};
 static qspi_packet_header_info_t qspi_header_buff_audio_tx = {0};
 static uint8_t qspi_payload_buff_video_tx[MAX32666_BLE_COMMAND_BUFFER_SIZE];
 static uint8_t qspi_payload_buff_audio_tx[100];
-
-
-//-----------------------------------------------------------------------------
-// Local function declarations
-//-----------------------------------------------------------------------------
+static uint8_t qspi_video_ack_types[QSPI_CREDIT_CLASS_LAST];
+static volatile uint8_t qspi_video_ack_pending = 0;
+static qspi_rx_link_t *volatile qspi_cs_settle_link = NULL;
+// Video and audio share it as they share the bus, only one receive is in progress at a time
+static qspi_rx_stage_t qspi_rx_stage;
+
+static const qspi_rx_descriptor_t qspi_video_rx_descriptors[] = {
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_DATA_RES,
+        .min_size = LCD_DATA_SIZE, .max_size = LCD_DATA_SIZE,
+        .post_rx = qspi_video_data_rx, .buffer_get = qspi_video_data_buffer},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_COMPRESSED_DATA_RES,
+        .min_size = VIDEO_CODEC_HEADER_SIZE, .max_size = LCD_DATA_SIZE,
+        .post_rx = qspi_video_compressed_data_rx, .buffer_get = qspi_video_compressed_data_buffer},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES,
+        .buffer = (uint8_t *) &device_status.classification_video,
+        .min_size = sizeof(classification_result_t), .max_size = sizeof(classification_result_t),
+        .post_rx = qspi_video_classification_rx},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES,
+        .buffer = (uint8_t *) &device_status.statistics.max78000_video,
+        .min_size = sizeof(max78000_statistics_t), .max_size = sizeof(max78000_statistics_t),
+        .post_rx = qspi_video_statistics_rx},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_VERSION_RES,
+        .buffer = (uint8_t *) &device_info.device_version.max78000_video,
+        .min_size = sizeof(version_t), .max_size = sizeof(version_t),
+        .post_rx = qspi_video_version_rx},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_DEMO_NAME_RES,
+        .buffer = (uint8_t *) device_info.max78000_video_demo_name,
+        .min_size = 1, .max_size = DEMO_STRING_SIZE,
+        .post_rx = qspi_video_demo_name_rx},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_SERIAL_RES,
+        .buffer = (uint8_t *) &device_info.device_serial_num.max78000_video,
+        .min_size = sizeof(serial_num_t), .max_size = sizeof(serial_num_t),
+        .post_rx = qspi_video_serial_rx},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_RES,
+        .buffer = (uint8_t *) &device_status.faceid_embed_update_status,
+        .min_size = sizeof(faceid_embed_update_status_e), .max_size = sizeof(faceid_embed_update_status_e),
+        .post_rx = qspi_video_faceid_embed_update_rx},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_RES,
+        .buffer = (uint8_t *) &device_status.faceid_embed_subject_names,
+        .min_size = 0, .max_size = sizeof(device_status.faceid_embed_subject_names),
+        .post_rx = qspi_video_faceid_subjects_rx},
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_BUTTON_PRESS_RES,
+        .min_size = 0, .max_size = 0,
+        .post_rx = qspi_video_button_press_rx},
+#ifdef ENABLE_TRACE
+    {.packet_type = QSPI_PACKET_TYPE_VIDEO_TRACE_RES,
+        .buffer = (uint8_t *) &device_status.trace[TRACE_SOURCE_MAX78000_VIDEO],
+        .min_size = TRACE_DUMP_HEADER_SIZE, .max_size = sizeof(trace_dump_t),
+        .post_rx = qspi_video_trace_rx},
+#endif
+};
+
+static const qspi_rx_descriptor_t qspi_audio_rx_descriptors[] = {
+    {.packet_type = QSPI_PACKET_TYPE_AUDIO_CLASSIFICATION_RES,
+        .buffer = (uint8_t *) &device_status.classification_audio,
+        .min_size = sizeof(classification_result_t), .max_size = sizeof(classification_result_t),
+        .post_rx = qspi_audio_classification_rx},
+    {.packet_type = QSPI_PACKET_TYPE_AUDIO_STATISTICS_RES,
+        .buffer = (uint8_t *) &device_status.statistics.max78000_audio,
+        .min_size = sizeof(max78000_statistics_t), .max_size = sizeof(max78000_statistics_t),
+        .post_rx = qspi_audio_statistics_rx},
+    {.packet_type = QSPI_PACKET_TYPE_AUDIO_VERSION_RES,
+        .buffer = (uint8_t *) &device_info.device_version.max78000_audio,
+        .min_size = sizeof(version_t), .max_size = sizeof(version_t),
+        .post_rx = qspi_audio_version_rx},
+    {.packet_type = QSPI_PACKET_TYPE_AUDIO_DEMO_NAME_RES,
+        .buffer = (uint8_t *) device_info.max78000_audio_demo_name,
+        .min_size = 1, .max_size = DEMO_STRING_SIZE,
+        .post_rx = qspi_audio_demo_name_rx},
+    {.packet_type = QSPI_PACKET_TYPE_AUDIO_SERIAL_RES,
+        .buffer = (uint8_t *) &device_info.device_serial_num.max78000_audio,
+        .min_size = sizeof(serial_num_t), .max_size = sizeof(serial_num_t),
+        .post_rx = qspi_audio_serial_rx},
+    {.packet_type = QSPI_PACKET_TYPE_AUDIO_BUTTON_PRESS_RES,
+        .min_size = 0, .max_size = 0,
+        .post_rx = qspi_audio_button_press_rx},
+#ifdef ENABLE_TRACE
+    {.packet_type = QSPI_PACKET_TYPE_AUDIO_TRACE_RES,
+        .buffer = (uint8_t *) &device_status.trace[TRACE_SOURCE_MAX78000_AUDIO],
+        .min_size = TRACE_DUMP_HEADER_SIZE, .max_size = sizeof(trace_dump_t),
+        .post_rx = qspi_audio_trace_rx},
+#endif
+};
+
+static qspi_rx_link_t qspi_video_rx = {
+    .cs_pin = MAX32666_VIDEO_CS_PIN,
+    .rw_pin = MAX32666_VIDEO_IO_PIN,
+    .int_flag = &qspi_video_int_flag,
+    .descriptors = qspi_video_rx_descriptors,
+    .descriptor_count = sizeof(qspi_video_rx_descriptors) / sizeof(qspi_video_rx_descriptors[0]),
+    .header_done = qspi_video_header_done,
+    .payload_done = qspi_video_payload_done,
+};
+
+static qspi_rx_link_t qspi_audio_rx = {
+    .cs_pin = MAX32666_AUDIO_CS_PIN,
+    .rw_pin = MAX32666_AUDIO_IO_PIN,
+    .int_flag = &qspi_audio_int_flag,
+    .descriptors = qspi_audio_rx_descriptors,
+    .descriptor_count = sizeof(qspi_audio_rx_descriptors) / sizeof(qspi_audio_rx_descriptors[0]),
+    .header_done = qspi_audio_header_done,
+    .payload_done = qspi_audio_payload_done,
+};
 
 
 //-----------------------------------------------------------------------------
@@ -92,16 +281,268 @@ static uint8_t qspi_payload_buff_audio_tx[100];
 void MAX32666_QSPI_DMA_IRQ_HAND(void)
 {
     spi_dma_int_handler(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
+    // Frame swap waits for the video receive to finish
+    scheduler_post(MAX32666_EVENT_QSPI | MAX32666_EVENT_LCD);
+}
+
+static void qspi_rx_start_payload(qspi_rx_link_t *link)
+{
+    if (!link->descriptor) {
+        // Rejected packet, slave is ready to send but payload is dropped
+        link->state = QSPI_RX_STATE_ERROR;
+        return;
+    }
+
+    link->state = QSPI_RX_STATE_CS_SETTLE;
+    qspi_cs_settle_link = link;
+
+    // Runs in GPIO interrupt, CS settle time is left to the one-shot timer instead of busy waiting
+    GPIO_CLR(link->cs_pin);
+    MXC_TMR_Start(MAX32666_TIMER_QSPI_CS);
+}
+
+// Runs in CS timer interrupt QSPI_CS_ASSERT_WAIT after the payload CS is asserted
+static void qspi_cs_timer(void)
+{
+    qspi_rx_link_t *link = qspi_cs_settle_link;
+
+    // Clear interrupt
+    MXC_TMR_ClearFlags(MAX32666_TIMER_QSPI_CS);
+
+    qspi_cs_settle_link = NULL;
+    if (!link || (link->state != QSPI_RX_STATE_CS_SETTLE)) {
+        return;
+    }
+
+    link->state = QSPI_RX_STATE_PAYLOAD;
+    spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, link->buffer,
+            link->header.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, link->payload_done);
+}
+
+// Runs in main loop, gives up a receive the slave did not complete
+static void qspi_rx_abort(qspi_rx_link_t *link)
+{
+    MXC_TMR_Stop(MAX32666_TIMER_QSPI_CS);
+    MXC_TMR_SetCount(MAX32666_TIMER_QSPI_CS, 1);
+    qspi_cs_settle_link = NULL;
+
+    // Payload DMA may still be running, it must not write the buffer or complete a later receive
+    spi_dma_abort(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
+
+    GPIO_SET(link->cs_pin);
+    link->state = QSPI_RX_STATE_IDLE;
+}
+
+static void qspi_rx_int(qspi_rx_link_t *link)
+{
+    *link->int_flag = 1;
+    scheduler_post(MAX32666_EVENT_QSPI);
+
+    // Payload is chained here, slave signals it after the header
+    if (link->state == QSPI_RX_STATE_WAIT_PAYLOAD) {
+        *link->int_flag = 0;
+        qspi_rx_start_payload(link);
+    }
+}
+
+// Runs in DMA interrupt when the header has been received
+static void qspi_rx_header_done(qspi_rx_link_t *link)
+{
+    qspi_packet_header_t *header = &link->header;
+
+    link->descriptor = NULL;
+
+    if (qspi_packet_check_header(header) != QSPI_PACKET_STATUS_OK) {
+        link->error = E_COMM_ERR;
+        link->state = QSPI_RX_STATE_ERROR;
+        GPIO_SET(link->cs_pin);
+        return;
+    }
+
+    // A received video frame starts a new trace frame
+    if (header->info.packet_type == QSPI_PACKET_TYPE_VIDEO_DATA_RES) {
+        TRACE_NEXT_FRAME();
+    }
+    TRACE_EVENT(TRACE_EVENT_QSPI_HEADER, header->info.packet_type);
+
+    link->error = E_INVALID;
+    for (int i = 0; i < link->descriptor_count; i++) {
+        if (link->descriptors[i].packet_type == header->info.packet_type) {
+            if ((header->info.packet_size >= link->descriptors[i].min_size) &&
+                (header->info.packet_size <= link->descriptors[i].max_size)) {
+                link->descriptor = &link->descriptors[i];
+                // Main loop, BLE and LCD read the descriptor buffer, a torn or corrupt payload
+                // must not reach it
+                link->buffer = link->descriptor->buffer_get ?
+                        link->descriptor->buffer_get(header->info.packet_size) : (uint8_t *) &qspi_rx_stage;
+                link->error = E_NO_ERROR;
+            }
+            break;
+        }
+    }
+
+    if (header->info.packet_size) {
+        // Set before releasing CS, slave interrupt for the payload may come right after
+        link->state = QSPI_RX_STATE_WAIT_PAYLOAD;
+    } else {
+        link->state = link->descriptor ? QSPI_RX_STATE_COMPLETED : QSPI_RX_STATE_ERROR;
+    }
+
+    GPIO_SET(link->cs_pin);
+}
+
+// Runs in DMA interrupt when the payload has been received
+static void qspi_rx_payload_done(qspi_rx_link_t *link)
+{
+    GPIO_SET(link->cs_pin);
+    link->state = QSPI_RX_STATE_COMPLETED;
+    TRACE_EVENT(TRACE_EVENT_QSPI_PAYLOAD, link->header.info.packet_type);
+}
+
+static uint8_t *qspi_video_data_buffer(uint32_t size)
+{
+    return lcd_get_back_buffer();
+}
+
+// Compressed frames are received to the end of the back buffer and decompressed in place
+static uint8_t *qspi_video_compressed_data_buffer(uint32_t size)
+{
+    return lcd_get_back_buffer() + LCD_DATA_SIZE - size;
+}
+
+static void qspi_video_header_done(void)
+{
+    qspi_rx_header_done(&qspi_video_rx);
+}
+
+static void qspi_video_payload_done(void)
+{
+    qspi_rx_payload_done(&qspi_video_rx);
+}
+
+static void qspi_audio_header_done(void)
+{
+    qspi_rx_header_done(&qspi_audio_rx);
+}
+
+static void qspi_audio_payload_done(void)
+{
+    qspi_rx_payload_done(&qspi_audio_rx);
+}
+
+static int qspi_rx_busy(void)
+{
+    return (qspi_video_rx.state != QSPI_RX_STATE_IDLE) || (qspi_audio_rx.state != QSPI_RX_STATE_IDLE);
+}
+
+/* Non-blocking receive. Starts the header DMA when the slave signals, the payload DMA is
+ * chained from the interrupts. Returns E_NONE_AVAIL when there is nothing to receive,
+ * E_BUSY while a transfer is in progress and the result once the packet is complete.
+ */
+static int qspi_rx_worker(qspi_rx_link_t *link, qspi_packet_type_e *qspi_packet_type_rx)
+{
+    int ret;
+
+    switch (link->state) {
+    case QSPI_RX_STATE_IDLE:
+        if (!*link->int_flag) {
+            return E_NONE_AVAIL;
+        }
+
+        // Video and audio share the QSPI bus
+        if (qspi_rx_busy() || spi_dma_busy_flag(MAX32666_QSPI_DMA_CHANNEL)) {
+            return E_BUSY;
+        }
+        *link->int_flag = 0;
+
+        link->state = QSPI_RX_STATE_HEADER;
+        link->start_time = timer_ms_tick;
+
+        GPIO_SET(link->rw_pin); // RX request
+
+        GPIO_CLR(link->cs_pin);
+        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
+        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &link->header,
+                sizeof(qspi_packet_header_t), MAX32666_QSPI_DMA_REQSEL_SPIRX, link->header_done);
+
+        return E_BUSY;
+    case QSPI_RX_STATE_COMPLETED:
+        *qspi_packet_type_rx = link->header.info.packet_type;
+        ret = E_NO_ERROR;
+
+        if (qspi_packet_check_payload(&link->header, link->buffer, link->header.info.packet_size) != QSPI_PACKET_STATUS_OK) {
+            PR_ERROR("Invalid payload crc 0x%x", link->header.payload_crc16);
+            ret = E_COMM_ERR;
+        } else {
+            if (link->descriptor->buffer) {
+                memcpy(link->descriptor->buffer, link->buffer, link->header.info.packet_size);
+            }
+            if (link->descriptor->post_rx) {
+                link->descriptor->post_rx(link->header.info.packet_size);
+            }
+        }
+
+        link->state = QSPI_RX_STATE_IDLE;
+        return ret;
+    case QSPI_RX_STATE_ERROR:
+        *qspi_packet_type_rx = link->header.info.packet_type;
+        ret = link->error;
+
+        if (ret == E_COMM_ERR) {
+            PR_ERROR("Invalid QSPI header 0x%08X crc 0x%x", link->header.start_symbol, link->header.header_crc16);
+        } else {
+            PR_ERROR("Invalid QSPI packet %d len %u", link->header.info.packet_type, link->header.info.packet_size);
+        }
+
+        link->state = QSPI_RX_STATE_IDLE;
+        return ret;
+    default:
+        if ((timer_ms_tick - link->start_time) > QSPI_RX_TIMEOUT_MS) {
+            PR_WARN("rx timeout %d", link->state);
+            qspi_rx_abort(link);
+            return E_TIME_OUT;
+        }
+
+        return E_BUSY;
+    }
+}
+
+static int qspi_rx_wait(qspi_rx_link_t *link, qspi_packet_type_e *qspi_packet_type_rx)
+{
+    uint32_t start_time = timer_ms_tick;
+    int ret;
+
+    do {
+        ret = qspi_rx_worker(link, qspi_packet_type_rx);
+    } while ((ret == E_BUSY) && ((timer_ms_tick - start_time) <= QSPI_RX_TIMEOUT_MS));
+
+    return ret;
+}
+
+static void qspi_rx_idle_wait(void)
+{
+    uint32_t start_time = timer_ms_tick;
+
+    // Transmit uses the same bus and DMA channel
+    while (qspi_rx_busy() && ((timer_ms_tick - start_time) <= QSPI_RX_TIMEOUT_MS)) {
+        qspi_packet_type_e qspi_packet_type_rx;
+        if (qspi_video_rx.state != QSPI_RX_STATE_IDLE) {
+            qspi_rx_worker(&qspi_video_rx, &qspi_packet_type_rx);
+        }
+        if (qspi_audio_rx.state != QSPI_RX_STATE_IDLE) {
+            qspi_rx_worker(&qspi_audio_rx, &qspi_packet_type_rx);
+        }
+    }
 }
 
 void qspi_video_int(void *cbdata)
 {
-    qspi_video_int_flag = 1;
+    qspi_rx_int(&qspi_video_rx);
 }
 
 void qspi_audio_int(void *cbdata)
 {
-    qspi_audio_int_flag = 1;
+    qspi_rx_int(&qspi_audio_rx);
 }
 
 int qspi_master_wait_video_int(void)
@@ -139,6 +580,7 @@ int qspi_master_wait_audio_int(void)
 int qspi_master_init(void)
 {
     int ret;
+    mxc_tmr_cfg_t tmr;
 
     GPIO_SET(video_cs_pin);
     MXC_GPIO_Config(&video_cs_pin);
@@ -159,6 +601,16 @@ int qspi_master_init(void)
 
     NVIC_EnableIRQ(MAX32666_QSPI_DMA_IRQ);
 
+    // Init payload CS settle timer
+    MXC_TMR_Shutdown(MAX32666_TIMER_QSPI_CS);
+    tmr.pres = TMR_PRES_1;
+    tmr.mode = TMR_MODE_ONESHOT;
+    tmr.cmp_cnt = QSPI_CS_ASSERT_WAIT * (PeripheralClock / 1000000);
+    tmr.pol = 0;
+    NVIC_SetVector(MXC_TMR_GET_IRQ(MXC_TMR_GET_IDX(MAX32666_TIMER_QSPI_CS)), qspi_cs_timer);
+    NVIC_EnableIRQ(MXC_TMR_GET_IRQ(MXC_TMR_GET_IDX(MAX32666_TIMER_QSPI_CS)));
+    MXC_TMR_Init(MAX32666_TIMER_QSPI_CS, &tmr);
+
     qspi_video_int_flag = 0;
     MXC_GPIO_Config(&video_int_pin);
     MXC_GPIO_RegisterCallback(&video_int_pin, qspi_video_int, NULL);
@@ -176,195 +628,170 @@ int qspi_master_init(void)
     return E_NO_ERROR;
 }
 
-int qspi_master_video_rx_worker(qspi_packet_type_e *qspi_packet_type_rx)
+static void qspi_video_data_rx(uint32_t size)
 {
-    qspi_packet_header_t qspi_packet_header_rx;
-
-    if (!qspi_video_int_flag) {
-        return E_NONE_AVAIL;
-    }
-    qspi_video_int_flag = 0;
-
-    GPIO_SET(video_rw_pin); // RX request
+    lcd_data.frame_pending = 1;
+    scheduler_post(MAX32666_EVENT_LCD);
 
-    GPIO_CLR(video_cs_pin);
-    MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-    spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &qspi_packet_header_rx, sizeof(qspi_packet_header_t), MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-    spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-    GPIO_SET(video_cs_pin);
-    *qspi_packet_type_rx = qspi_packet_header_rx.info.packet_type;
-
-    if (qspi_packet_header_rx.start_symbol != QSPI_START_SYMBOL) {
-        PR_ERROR("Invalid QSPI start byte 0x%08hhX", qspi_packet_header_rx.start_symbol);
-        return E_COMM_ERR;
-    }
+    PR_DEBUG("video %u", size);
+}
 
-    if (qspi_packet_header_rx.header_crc16 != crc16_sw((uint8_t *) &qspi_packet_header_rx.info, sizeof(qspi_packet_header_rx.info))) {
-        PR_ERROR("Invalid header crc 0x%x", qspi_packet_header_rx.header_crc16);
-        return E_COMM_ERR;
-    }
+static void qspi_video_compressed_data_rx(uint32_t size)
+{
+    video_codec_status_e status;
 
-    if (qspi_packet_header_rx.info.packet_size) {
-        qspi_master_wait_video_int();
-        qspi_video_int_flag = 0;
+    // Back buffer is not swapped while the packet is being handled
+    status = video_codec_decode(lcd_data.back_buffer, size);
+    if (status != VIDEO_CODEC_STATUS_OK) {
+        PR_ERROR("Invalid compressed video %d", status);
+        return;
     }
 
-    switch(qspi_packet_header_rx.info.packet_type) {
-    case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
-        if (qspi_packet_header_rx.info.packet_size != LCD_DATA_SIZE) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+    lcd_data.frame_pending = 1;
+    scheduler_post(MAX32666_EVENT_LCD);
 
-        GPIO_CLR(video_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *)lcd_data.buffer, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(video_cs_pin);
-
-        PR_DEBUG("video %u", qspi_packet_header_rx.info.packet_size);
+    PR_DEBUG("video compressed %u", size);
+}
 
-        break;
-    case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(classification_result_t)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+static void qspi_video_classification_rx(uint32_t size)
+{
+    qspi_master_video_ack(QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES);
 
-        GPIO_CLR(video_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_status.classification_video, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(video_cs_pin);
+    PR_INFO("video %s %d %0.1f", device_status.classification_video.result, device_status.classification_video.classification, (double)device_status.classification_video.probabily);
+}
 
-        PR_INFO("video %s %d %0.1f", device_status.classification_video.result, device_status.classification_video.classification, (double)device_status.classification_video.probabily);
+static void qspi_video_statistics_rx(uint32_t size)
+{
+    qspi_master_video_ack(QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES);
 
-        break;
-    case QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(max78000_statistics_t)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+    PR_DEBUG("video capture : %lu", device_status.statistics.max78000_video.capture_duration_us);
+    PR_DEBUG("video cnn     : %lu", device_status.statistics.max78000_video.cnn_duration_us);
+    PR_DEBUG("video qspi    : %lu", device_status.statistics.max78000_video.communication_duration_us);
+    PR_DEBUG("video total   : %lu", device_status.statistics.max78000_video.total_duration_us);
+}
 
-        GPIO_CLR(video_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_status.statistics.max78000_video, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(video_cs_pin);
+static void qspi_video_version_rx(uint32_t size)
+{
+    PR_INFO("MAX78000 Video v%d.%d.%d", device_info.device_version.max78000_video.major, device_info.device_version.max78000_video.minor, device_info.device_version.max78000_video.build);
+}
 
-        PR_DEBUG("video capture : %lu", device_status.statistics.max78000_video.capture_duration_us);
-        PR_DEBUG("video cnn     : %lu", device_status.statistics.max78000_video.cnn_duration_us);
-        PR_DEBUG("video qspi    : %lu", device_status.statistics.max78000_video.communication_duration_us);
-        PR_DEBUG("video total   : %lu", device_status.statistics.max78000_video.total_duration_us);
+static void qspi_video_demo_name_rx(uint32_t size)
+{
+    PR_INFO("MAX78000 Video demo %s", device_info.max78000_video_demo_name);
+}
 
-        break;
-    case QSPI_PACKET_TYPE_VIDEO_VERSION_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(version_t)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+static void qspi_video_serial_rx(uint32_t size)
+{
+    PR_INFO("MAX78000 Video serial: ");
+    for (int i = 0; i < sizeof(device_info.device_serial_num.max78000_video); i++) {
+        PR("%02X", device_info.device_serial_num.max78000_video[i]);
+    }
+    PR("\n");
+}
 
-        GPIO_CLR(video_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_info.device_version.max78000_video, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(video_cs_pin);
+static void qspi_video_faceid_embed_update_rx(uint32_t size)
+{
+    PR_INFO("FaceID stat %d", device_status.faceid_embed_update_status);
+}
 
-        PR_INFO("MAX78000 Video v%d.%d.%d", device_info.device_version.max78000_video.major, device_info.device_version.max78000_video.minor, device_info.device_version.max78000_video.build);
+static void qspi_video_faceid_subjects_rx(uint32_t size)
+{
+    device_status.faceid_embed_subject_names_size = size;
 
-        break;
-    case QSPI_PACKET_TYPE_VIDEO_DEMO_NAME_RES:
-        if (qspi_packet_header_rx.info.packet_size == 0 || qspi_packet_header_rx.info.packet_size > DEMO_STRING_SIZE) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+    PR_INFO("FaceID names %d", device_status.faceid_embed_subject_names_size);
+    for (int i = 0; i < device_status.faceid_embed_subject_names_size;
+            i += printf("%s\n", &device_status.faceid_embed_subject_names[i])) {}
+}
 
-        GPIO_CLR(video_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) device_info.max78000_video_demo_name, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(video_cs_pin);
+static void qspi_video_button_press_rx(uint32_t size)
+{
+    PR_INFO("Video button A pressed");
+    timestamps.activity_detected = timer_ms_tick;
+    device_settings.enable_max78000_video_flash_led = !device_settings.enable_max78000_video_flash_led;
+
+    if (device_settings.enable_max78000_video_flash_led) {
+        lcd_notification(MAGENTA, "Video flash LED enabled");
+    } else {
+        lcd_notification(MAGENTA, "Video flash LED disabled");
+    }
+}
 
-        PR_INFO("MAX78000 Video demo %s", device_info.max78000_video_demo_name);
+static void qspi_audio_classification_rx(uint32_t size)
+{
+    PR_INFO("audio %s %d %0.1f", device_status.classification_audio.result, device_status.classification_audio.classification, (double)device_status.classification_audio.probabily);
+}
 
-        break;
-    case QSPI_PACKET_TYPE_VIDEO_SERIAL_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(serial_num_t)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+static void qspi_audio_statistics_rx(uint32_t size)
+{
+    PR_DEBUG("audio cnn: %lu", device_status.statistics.max78000_audio.cnn_duration_us);
+}
 
-        GPIO_CLR(video_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_info.device_serial_num.max78000_video, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(video_cs_pin);
+static void qspi_audio_version_rx(uint32_t size)
+{
+    PR_INFO("MAX78000 Audio v%d.%d.%d", device_info.device_version.max78000_audio.major, device_info.device_version.max78000_audio.minor, device_info.device_version.max78000_audio.build);
+}
 
-        PR_INFO("MAX78000 Video serial: ");
-        for (int i = 0; i < sizeof(device_info.device_serial_num.max78000_video); i++) {
-            PR("%02X", device_info.device_serial_num.max78000_video[i]);
-        }
-        PR("\n");
+static void qspi_audio_demo_name_rx(uint32_t size)
+{
+    PR_INFO("MAX78000 Audio demo %s", device_info.max78000_audio_demo_name);
+}
 
-        break;
-    case QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(faceid_embed_update_status_e)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+static void qspi_audio_serial_rx(uint32_t size)
+{
+    PR_INFO("MAX78000 Audio serial: ");
+    for (int i = 0; i < sizeof(device_info.device_serial_num.max78000_audio); i++) {
+        PR("%02X", device_info.device_serial_num.max78000_audio[i]);
+    }
+    PR("\n");
+}
 
-        GPIO_CLR(video_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_status.faceid_embed_update_status, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(video_cs_pin);
+static void qspi_audio_button_press_rx(uint32_t size)
+{
+    PR_INFO("Audio button B pressed");
 
-        PR_INFO("FaceID stat %d", device_status.faceid_embed_update_status);
+    device_settings.enable_voicecommand ^= 1;
+    device_settings.enable_voicecommand += 0x2; // second bit shows there is a change in settings
 
-        break;
-    case QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_RES:
-        if (qspi_packet_header_rx.info.packet_size > sizeof(device_status.faceid_embed_subject_names)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+    PR_INFO("Voice Command changed to: %d", device_settings.enable_voicecommand);
 
-        GPIO_CLR(video_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_status.faceid_embed_subject_names, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(video_cs_pin);
+    timestamps.activity_detected = timer_ms_tick;
+}
 
-        device_status.faceid_embed_subject_names_size = qspi_packet_header_rx.info.packet_size;
+#ifdef ENABLE_TRACE
+static void qspi_video_trace_rx(uint32_t size)
+{
+    if (size != TRACE_DUMP_SIZE(device_status.trace[TRACE_SOURCE_MAX78000_VIDEO].count)) {
+        PR_ERROR("Invalid video trace size %u", size);
+        return;
+    }
 
-        PR_INFO("FaceID names %d", device_status.faceid_embed_subject_names_size);
-        for (int i = 0; i < device_status.faceid_embed_subject_names_size;
-                i += printf("%s\n", &device_status.faceid_embed_subject_names[i])) {}
+    device_status.trace_pending |= (1 << TRACE_SOURCE_MAX78000_VIDEO);
+}
 
-        break;
-    case QSPI_PACKET_TYPE_VIDEO_BUTTON_PRESS_RES:
-        if (qspi_packet_header_rx.info.packet_size != 0) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+static void qspi_audio_trace_rx(uint32_t size)
+{
+    if (size != TRACE_DUMP_SIZE(device_status.trace[TRACE_SOURCE_MAX78000_AUDIO].count)) {
+        PR_ERROR("Invalid audio trace size %u", size);
+        return;
+    }
 
-        PR_INFO("Video button A pressed");
-        timestamps.activity_detected = timer_ms_tick;
-        device_settings.enable_max78000_video_flash_led = !device_settings.enable_max78000_video_flash_led;
+    device_status.trace_pending |= (1 << TRACE_SOURCE_MAX78000_AUDIO);
+}
+#endif
 
-        if (device_settings.enable_max78000_video_flash_led) {
-            lcd_notification(MAGENTA, "Video flash LED enabled");
-        } else {
-            lcd_notification(MAGENTA, "Video flash LED disabled");
-        }
+int qspi_master_video_rx_worker(qspi_packet_type_e *qspi_packet_type_rx)
+{
+    return qspi_rx_worker(&qspi_video_rx, qspi_packet_type_rx);
+}
 
-        break;
-    default:
-        PR_ERROR("Unknown qspi video packet");
-        return E_INVALID;
-        break;
-    }
+int qspi_master_video_rx_wait(qspi_packet_type_e *qspi_packet_type_rx)
+{
+    return qspi_rx_wait(&qspi_video_rx, qspi_packet_type_rx);
+}
 
-    return E_NO_ERROR;
+int qspi_master_video_rx_idle(void)
+{
+    return qspi_video_rx.state == QSPI_RX_STATE_IDLE;
 }
 
 int qspi_master_video_tx_worker(void)
@@ -379,142 +806,58 @@ int qspi_master_video_tx_worker(void)
     return E_NO_ERROR;
 }
 
-int qspi_master_audio_rx_worker(qspi_packet_type_e *qspi_packet_type_rx)
+// Gives the video slave a credit back for the class of a consumed packet
+void qspi_master_video_ack(uint8_t packet_type)
 {
-    qspi_packet_header_t qspi_packet_header_rx;
+    qspi_credit_class_e credit_class = qspi_credit_class(packet_type);
 
-    if (!qspi_audio_int_flag) {
-        return E_NONE_AVAIL;
+    if (credit_class == QSPI_CREDIT_CLASS_NONE) {
+        return;
     }
-    qspi_audio_int_flag = 0;
 
-    GPIO_SET(audio_rw_pin); // RX request
-
-    GPIO_CLR(audio_cs_pin);
-    MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-    spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &qspi_packet_header_rx, sizeof(qspi_packet_header_t), MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-    spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-    GPIO_SET(audio_cs_pin);
-    *qspi_packet_type_rx = qspi_packet_header_rx.info.packet_type;
+    qspi_video_ack_types[credit_class] = packet_type;
+    qspi_video_ack_pending |= (1 << credit_class);
+    scheduler_post(MAX32666_EVENT_QSPI);
+}
 
-    if (qspi_packet_header_rx.start_symbol != QSPI_START_SYMBOL) {
-        PR_ERROR("Invalid QSPI start byte 0x%08hhX", qspi_packet_header_rx.start_symbol);
-        return E_COMM_ERR;
-    }
+int qspi_master_video_ack_worker(void)
+{
+    uint8_t ack[QSPI_CREDIT_CLASS_LAST];
+    uint32_t count = 0;
+    int ret;
 
-    if (qspi_packet_header_rx.header_crc16 != crc16_sw((uint8_t *) &qspi_packet_header_rx.info, sizeof(qspi_packet_header_rx.info))) {
-        PR_ERROR("Invalid header crc 0x%x", qspi_packet_header_rx.header_crc16);
-        return E_COMM_ERR;
+    if (!qspi_video_ack_pending) {
+        return E_NO_ERROR;
     }
 
-    if (qspi_packet_header_rx.info.packet_size) {
-        qspi_master_wait_audio_int();
-        qspi_audio_int_flag = 0;
+    // Pending acknowledges go out together once the LCD and the receive are done,
+    // the tasks call this again on their completion
+    if (!qspi_master_video_rx_idle() || spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
+        return E_BUSY;
     }
 
-    switch(qspi_packet_header_rx.info.packet_type) {
-    case QSPI_PACKET_TYPE_AUDIO_CLASSIFICATION_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(classification_result_t)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
-
-        GPIO_CLR(audio_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_status.classification_audio, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(audio_cs_pin);
-
-        PR_INFO("audio %s %d %0.1f", device_status.classification_audio.result, device_status.classification_audio.classification, (double)device_status.classification_audio.probabily);
-
-        break;
-    case QSPI_PACKET_TYPE_AUDIO_STATISTICS_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(max78000_statistics_t)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
-
-        GPIO_CLR(audio_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_status.statistics.max78000_audio, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(audio_cs_pin);
-
-        PR_DEBUG("audio cnn: %lu", device_status.statistics.max78000_audio.cnn_duration_us);
-
-        break;
-    case QSPI_PACKET_TYPE_AUDIO_VERSION_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(version_t)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
-
-        GPIO_CLR(audio_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_info.device_version.max78000_audio, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(audio_cs_pin);
-
-        PR_INFO("MAX78000 Audio v%d.%d.%d", device_info.device_version.max78000_audio.major, device_info.device_version.max78000_audio.minor, device_info.device_version.max78000_audio.build);
-
-        break;
-    case QSPI_PACKET_TYPE_AUDIO_DEMO_NAME_RES:
-        if (qspi_packet_header_rx.info.packet_size == 0 || qspi_packet_header_rx.info.packet_size > DEMO_STRING_SIZE) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
-
-        GPIO_CLR(audio_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) device_info.max78000_audio_demo_name, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(audio_cs_pin);
-
-        PR_INFO("MAX78000 Audio demo %s", device_info.max78000_audio_demo_name);
-
-        break;
-    case QSPI_PACKET_TYPE_AUDIO_SERIAL_RES:
-        if (qspi_packet_header_rx.info.packet_size != sizeof(serial_num_t)) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
-
-        GPIO_CLR(audio_cs_pin);
-        MXC_Delay(MXC_DELAY_USEC(QSPI_CS_ASSERT_WAIT));
-        spi_dma(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI, NULL, (uint8_t *) &device_info.device_serial_num.max78000_audio, qspi_packet_header_rx.info.packet_size, MAX32666_QSPI_DMA_REQSEL_SPIRX, NULL);
-        spi_dma_wait(MAX32666_QSPI_DMA_CHANNEL, MAX32666_QSPI);
-        GPIO_SET(audio_cs_pin);
-
-        PR_INFO("MAX78000 Audio serial: ");
-        for (int i = 0; i < sizeof(device_info.device_serial_num.max78000_audio); i++) {
-            PR("%02X", device_info.device_serial_num.max78000_audio[i]);
+    for (int i = 0; i < QSPI_CREDIT_CLASS_LAST; i++) {
+        if (qspi_video_ack_pending & (1 << i)) {
+            ack[count++] = qspi_video_ack_types[i];
         }
-        PR("\n");
+    }
 
-        break;
-    case QSPI_PACKET_TYPE_AUDIO_BUTTON_PRESS_RES:
-        if (qspi_packet_header_rx.info.packet_size != 0) {
-            PR_ERROR("Invalid QSPI data len %u", qspi_packet_header_rx.info.packet_size);
-            return E_INVALID;
-        }
+    ret = qspi_master_send_video(ack, count, QSPI_PACKET_TYPE_ACKNOWLEDGE);
+    if (ret == E_NO_ERROR) {
+        qspi_video_ack_pending = 0;
+    }
 
-        PR_INFO("Audio button B pressed");
-		
-		device_settings.enable_voicecommand ^= 1;
-		device_settings.enable_voicecommand += 0x2; // second bit shows there is a change in settings
-		
-		PR_INFO("Voice Command changed to: %d", device_settings.enable_voicecommand);
-		
-        timestamps.activity_detected = timer_ms_tick;
+    return ret;
+}
 
-        break;
-    default:
-        PR_ERROR("Unknown qspi audio packet");
-        return E_INVALID;
-        break;
-    }
+int qspi_master_audio_rx_worker(qspi_packet_type_e *qspi_packet_type_rx)
+{
+    return qspi_rx_worker(&qspi_audio_rx, qspi_packet_type_rx);
+}
 
-    return E_NO_ERROR;
+int qspi_master_audio_rx_wait(qspi_packet_type_e *qspi_packet_type_rx)
+{
+    return qspi_rx_wait(&qspi_audio_rx, qspi_packet_type_rx);
 }
 
 int qspi_master_audio_tx_worker(void)
@@ -531,25 +874,17 @@ int qspi_master_audio_tx_worker(void)
 
 int qspi_master_send_video(uint8_t *data, uint32_t data_size, uint8_t data_type)
 {
-    qspi_packet_header_t qspi_packet_header_tx = {
-            .start_dummy = 0,
-            .start_symbol = QSPI_START_SYMBOL,
-            .header_crc16 = 0,
-            .payload_crc16 = 0,
-            .info.packet_size = data_size,
-            .info.packet_type = data_type,
-            .stop_dummy = 0,
-    };
+    qspi_packet_header_t qspi_packet_header_tx;
 
     // Wait LCD dma since it disrupts QSPI write
     spi_dma_wait(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI);
 
+    // Let an ongoing receive finish first
+    qspi_rx_idle_wait();
+
     GPIO_CLR(video_rw_pin); // TX request
 
-    qspi_packet_header_tx.header_crc16 = crc16_sw((uint8_t *) &qspi_packet_header_tx.info, sizeof(qspi_packet_header_tx.info));
-    if (data_size) {
-        qspi_packet_header_tx.payload_crc16 = crc16_sw(data, data_size);
-    }
+    qspi_packet_form_header(&qspi_packet_header_tx, data_type, data, data_size);
 
     if (data_size && qspi_video_int_flag) {
         if (qspi_header_buff_video_tx.packet_type && (qspi_header_buff_video_tx.packet_type != data_type)) {
@@ -590,25 +925,17 @@ int qspi_master_send_video(uint8_t *data, uint32_t data_size, uint8_t data_type)
 
 int qspi_master_send_audio(uint8_t *data, uint32_t data_size, uint8_t data_type)
 {
-    qspi_packet_header_t qspi_packet_header_tx = {
-            .start_dummy = 0,
-            .start_symbol = QSPI_START_SYMBOL,
-            .header_crc16 = 0,
-            .payload_crc16 = 0,
-            .info.packet_size = data_size,
-            .info.packet_type = data_type,
-            .stop_dummy = 0,
-    };
+    qspi_packet_header_t qspi_packet_header_tx;
 
     // Wait LCD dma since it disrupts QSPI write
     spi_dma_wait(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI);
 
+    // Let an ongoing receive finish first
+    qspi_rx_idle_wait();
+
     GPIO_CLR(audio_rw_pin); // TX request
 
-    qspi_packet_header_tx.header_crc16 = crc16_sw((uint8_t *) &qspi_packet_header_tx.info, sizeof(qspi_packet_header_tx.info));
-    if (data_size) {
-        qspi_packet_header_tx.payload_crc16 = crc16_sw(data, data_size);
-    }
+    qspi_packet_form_header(&qspi_packet_header_tx, data_type, data, data_size);
 
     if (data_size && qspi_audio_int_flag) {
         if (qspi_header_buff_audio_tx.packet_type && (qspi_header_buff_audio_tx.packet_type != data_type)) {
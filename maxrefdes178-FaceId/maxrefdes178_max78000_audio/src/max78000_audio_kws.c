@@ -0,0 +1,233 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <mxc.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "max78000_audio_cnn.h"
+#include "max78000_audio_kws.h"
+#include "max78000_audio_transpose.h"
+#include "max78000_debug.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define S_MODULE_NAME   "kws"
+
+#define KWS_MIC_SETTLE_SAMPLES  10000   // discarded after init due to microphone charging cap effect
+#define KWS_ROW_DURATION_US     (TRANSPOSE_WIDTH * 1000 / 16)  // one CHUNK per window row at 16kHz
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static int16_t  x0, x1, Coeff;
+static int32_t  y0, y1;
+static uint32_t micIndex = 0;           // samples since kws_mic_init
+static uint16_t micCount = 0;           // samples in the chunk in progress
+static uint16_t micSum = 0;             // sum of absolute samples in the chunk in progress
+
+static uint16_t kwsWindowRow = 0;       // oldest row of the sliding window in the transpose buffer
+static uint16_t kwsWindowRows = 0;      // number of rows collected so far
+static uint16_t kwsHopCounter = 0;      // CHUNKs since last inference
+static q15_t kwsSoftHistory[KWS_SMOOTHING_WINDOW][CNN_NUM_OUTPUTS];
+static uint8_t kwsSoftHistoryIndex = 0;
+static uint8_t kwsSoftHistoryCount = 0;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static int16_t HPF(int16_t input);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+void kws_mic_init(void)
+{
+    Coeff = 32604; //0.995
+    x0 = 0;
+    y0 = 0;
+    y1 = y0;
+    x1 = x0;
+
+    micIndex = 0;
+    micCount = 0;
+    micSum = 0;
+}
+
+uint8_t kws_mic_sample(int32_t word, uint8_t *pBuff, uint16_t size, uint16_t *avg)
+{
+    int32_t sample;
+
+    /* The actual value is 18 MSB of 32-bit word */
+    /* Remove DC from microphone signal */
+    sample = HPF((int16_t)(word >> 14)); // filter needs about 1K sample to converge
+
+    /* Discard first 10k samples due to microphone charging cap effect */
+    if (micIndex < KWS_MIC_SETTLE_SAMPLES) {
+        micIndex++;
+        return 0;
+    }
+
+    /* absolute for averaging */
+    if (sample >= 0)
+        micSum += sample;
+    else
+        micSum -= sample;
+
+    /* Convert to 8 bit unsigned */
+    pBuff[micCount++] = (uint8_t)((sample)*SAMPLE_SCALE_FACTOR/256);
+
+    if (micCount < size) {
+        return 0;
+    }
+
+    /* enough samples are collected, calculate average */
+    *avg = ((uint16_t)(micSum / size));
+
+    micCount = 0;
+    micSum = 0;
+    return 1;
+}
+
+uint8_t kws_window_add(const uint8_t *pIn, uint32_t cnn_duration_us)
+{
+    /* overwrite the oldest row, window then starts one row later */
+    transpose_row(pIn, kwsWindowRow);
+    kwsWindowRow = (kwsWindowRow + 1) % TRANSPOSE_WIDTH;
+
+    if (kwsWindowRows < TRANSPOSE_WIDTH) {
+        kwsWindowRows++;
+    }
+    if (kwsHopCounter < UINT16_MAX) {
+        kwsHopCounter++;
+    }
+
+    if ((kwsWindowRows < TRANSPOSE_WIDTH) || (kwsHopCounter < KWS_HOP_CHUNKS)) {
+        return 0;
+    }
+
+    /* keep CNN time within KWS_MAX_DUTY_CYCLE of the audio time since last inference */
+    if (((uint32_t) kwsHopCounter * KWS_ROW_DURATION_US * KWS_MAX_DUTY_CYCLE) <
+        (cnn_duration_us * 100)) {
+        return 0;
+    }
+
+    kwsHopCounter = 0;
+
+    return 1;
+}
+
+uint16_t kws_window_start(void)
+{
+    return kwsWindowRow;
+}
+
+uint8_t kws_smooth(const q15_t *ml_soft, q15_t *smooth_soft, int32_t *smooth_data)
+{
+    int32_t sum;
+
+    memcpy(kwsSoftHistory[kwsSoftHistoryIndex], ml_soft, sizeof(kwsSoftHistory[0]));
+    kwsSoftHistoryIndex = (kwsSoftHistoryIndex + 1) % KWS_SMOOTHING_WINDOW;
+    if (kwsSoftHistoryCount < KWS_SMOOTHING_WINDOW) {
+        kwsSoftHistoryCount++;
+    }
+
+    /* decide only on a full history */
+    if (kwsSoftHistoryCount < KWS_SMOOTHING_WINDOW) {
+        return 0;
+    }
+
+    for (int i = 0; i < CNN_NUM_OUTPUTS; i++) {
+        sum = 0;
+        for (int j = 0; j < KWS_SMOOTHING_WINDOW; j++) {
+            sum += kwsSoftHistory[j][i];
+        }
+        smooth_soft[i] = sum / KWS_SMOOTHING_WINDOW;
+        smooth_data[i] = smooth_soft[i];
+    }
+
+    return 1;
+}
+
+void kws_smooth_clear(void)
+{
+    kwsSoftHistoryCount = 0;
+}
+
+void kws_reset(void)
+{
+    kwsWindowRows = 0;
+    kwsHopCounter = 0;
+    kwsSoftHistoryCount = 0;
+}
+
+static int16_t HPF(int16_t input) {
+    int16_t Acc, output;
+    int32_t tmp;
+
+    /* a 1st order IIR high pass filter (100 Hz cutoff frequency)  */
+    /* y(n)=x(n)-x(n-1)+A*y(n-1) and A =.995*2^15 */
+
+    x0 = input;
+
+    tmp = (Coeff * y1);
+    Acc = (int16_t)((tmp + (1 << 14)) >> 15);
+    y0 = x0 - x1 + Acc;
+
+    /* Clipping */
+    if (y0 > 32767) {
+        y0 = 32767;
+    }
+
+    if (y0 < -32768) {
+        y0 = -32768;
+    }
+
+    /* Update filter state */
+    y1 = y0;
+    x1 = x0;
+
+    output = (int16_t)y0;
+
+    return (output);
+}
@@ -45,6 +45,8 @@
 #include "max78000_debug.h"
 #include "max78000_qspi_slave.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_packet.h"
+#include "maxrefdes178_trace.h"
 #include "maxrefdes178_utility.h"
 
 
@@ -156,11 +158,8 @@ void qspi_slave_cs_handler(void *cbdata)
             // RX request
             switch (g_qspi_state_rx) {
             case QSPI_STATE_CS_ASSERTED_HEADER:
-                if (g_qspi_packet_header_rx.start_symbol != QSPI_START_SYMBOL) {
-                    PR_ERROR("Invalid start %x", g_qspi_packet_header_rx.start_symbol);
-                    g_qspi_state_rx = QSPI_STATE_IDLE;
-                } else if (g_qspi_packet_header_rx.header_crc16 != crc16_sw((uint8_t *) &g_qspi_packet_header_rx.info, sizeof(g_qspi_packet_header_rx.info))) {
-                    PR_ERROR("Invalid header crc %x", g_qspi_packet_header_rx.start_symbol);
+                if (qspi_packet_check_header((qspi_packet_header_t *) &g_qspi_packet_header_rx) != QSPI_PACKET_STATUS_OK) {
+                    PR_ERROR("Invalid header %x %x", g_qspi_packet_header_rx.start_symbol, g_qspi_packet_header_rx.header_crc16);
                     g_qspi_state_rx = QSPI_STATE_IDLE;
                 } else if (g_qspi_packet_header_rx.info.packet_size) {
                     g_qspi_state_rx = QSPI_STATE_CS_DEASSERTED_HEADER;
@@ -170,7 +169,7 @@ void qspi_slave_cs_handler(void *cbdata)
                 }
                 break;
             case QSPI_STATE_CS_ASSERTED_DATA:
-                if (g_qspi_packet_header_rx.payload_crc16 != crc16_sw((uint8_t *) g_rx_data, g_rx_data_size)) {
+                if (qspi_packet_check_payload((qspi_packet_header_t *) &g_qspi_packet_header_rx, (uint8_t *) g_rx_data, g_rx_data_size) != QSPI_PACKET_STATUS_OK) {
                     PR_ERROR("Invalid payload crc %x", g_qspi_packet_header_rx.payload_crc16);
                     g_qspi_state_rx = QSPI_STATE_IDLE;
                 } else {
@@ -463,11 +462,7 @@ int qspi_slave_send_packet(uint8_t *data, uint32_t data_size, uint8_t data_type)
 
     PR_DEBUG("spi tx started %d", data_type);
 
-    g_qspi_packet_header_tx.start_symbol = QSPI_START_SYMBOL;
-    g_qspi_packet_header_tx.info.packet_size = data_size;
-    g_qspi_packet_header_tx.info.packet_type = data_type;
-    g_qspi_packet_header_tx.header_crc16 = crc16_sw((uint8_t *) &g_qspi_packet_header_tx.info, sizeof(g_qspi_packet_header_tx.info));
-//    g_qspi_packet_header_tx.payload_crc16 = crc16_sw(data, data_size);
+    qspi_packet_form_header((qspi_packet_header_t *) &g_qspi_packet_header_tx, data_type, data, data_size);
     g_tx_data = data;
     g_tx_data_size = data_size;
 
@@ -482,6 +477,7 @@ int qspi_slave_send_packet(uint8_t *data, uint32_t data_size, uint8_t data_type)
             PR_ERROR("wait fail %d %d", data_size, data_type);
             return E_BAD_STATE;
         }
+        TRACE_EVENT(TRACE_EVENT_QSPI_HEADER, data_type);
 
         // Send data
         qspi_slave_trigger();
@@ -494,6 +490,7 @@ int qspi_slave_send_packet(uint8_t *data, uint32_t data_size, uint8_t data_type)
     }
 
     g_qspi_state_tx = QSPI_STATE_IDLE;
+    TRACE_EVENT(data_size ? TRACE_EVENT_QSPI_PAYLOAD : TRACE_EVENT_QSPI_HEADER, data_type);
 
     PR_DEBUG("spi tx completed %d", data_type);
 
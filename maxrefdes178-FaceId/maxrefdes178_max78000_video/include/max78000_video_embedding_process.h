@@ -49,6 +49,7 @@
 #define thresh_for_unknown_subject 9993
 //#define thresh_for_unknown_subject 313600
 #define closest_sub_buffer_size 3*7  // TODO ????
+#define min_distance_count 3  // Number of closest subjects kept by calculate_minDistance
 
 
 //-----------------------------------------------------------------------------
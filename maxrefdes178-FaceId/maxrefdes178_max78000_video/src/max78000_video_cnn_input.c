@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+
+#include "max78000_video_cnn_input.h"
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define CNN_FIFO_STATUS     (*((volatile uint32_t *) 0x50000004))
+#define CNN_FIFO_0          (*((volatile uint32_t *) 0x50000008))
+#define CNN_FIFO_1          (*((volatile uint32_t *) 0x5000000c))
+#define CNN_FIFO_2          (*((volatile uint32_t *) 0x50000010))
+
+// FIFO full flags in the status register
+#define CNN_FIFO_FULL_0     0x1
+#define CNN_FIFO_FULL_012   0x7
+
+// Camera stores RGB565 big endian, |RRRRRGGG|GGGBBBBB|. With p = byte0 | (byte1 << 8),
+// (byte & 0xF8/0xFC) - 128 for each color is the XOR of the top bit of the 8-bit value.
+#define RGB565_R(p)         (((p) & 0xF8) ^ 0x80)
+#define RGB565_G(p)         (((((p) << 5) & 0xE0) | (((p) >> 11) & 0x1C)) ^ 0x80)
+#define RGB565_B(p)         ((((p) >> 5) & 0xF8) ^ 0x80)
+
+// All three colors of pixel p, 0x00BBGGRR
+#define RGB565_HWC(p)       ((((p) & 0xF8) | (((p) << 13) & 0xE000) | (((p) >> 3) & 0x1C00) | \
+                             (((p) << 11) & 0xF80000)) ^ 0x808080)
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+void cnn_input_rgb565_to_chw(const uint8_t *src, int step, uint32_t *r, uint32_t *g, uint32_t *b, int count)
+{
+    uint32_t p0, p1, p2, p3;
+    int stride = step * LCD_BYTE_PER_PIXEL;
+
+    for (; count >= 4; count -= 4) {
+        p0 = *(const uint16_t *) (src);
+        p1 = *(const uint16_t *) (src + stride);
+        p2 = *(const uint16_t *) (src + 2 * stride);
+        p3 = *(const uint16_t *) (src + 3 * stride);
+        src += 4 * stride;
+
+        *r++ = (RGB565_R(p0) << 24) | (RGB565_R(p1) << 16) | (RGB565_R(p2) << 8) | RGB565_R(p3);
+        *g++ = (RGB565_G(p0) << 24) | (RGB565_G(p1) << 16) | (RGB565_G(p2) << 8) | RGB565_G(p3);
+        *b++ = (RGB565_B(p0) << 24) | (RGB565_B(p1) << 16) | (RGB565_B(p2) << 8) | RGB565_B(p3);
+    }
+}
+
+void cnn_input_fifo_write_rgb565_hwc(const uint8_t *src, int count)
+{
+    uint32_t p;
+
+    // The status register only flags a full FIFO, so each word waits on its own status read.
+    // Converting straight into the FIFO keeps the row out of a line buffer.
+
+    // Align source to word boundary
+    if (((uintptr_t) src & 0x3) && (count > 0)) {
+        p = *(const uint16_t *) src;
+        src += LCD_BYTE_PER_PIXEL;
+        count--;
+        while (CNN_FIFO_STATUS & CNN_FIFO_FULL_0); // Wait for FIFO 0
+        CNN_FIFO_0 = RGB565_HWC(p);
+    }
+
+    // Two pixels per word read
+    for (; count >= 2; count -= 2) {
+        p = *(const uint32_t *) src;
+        src += 2 * LCD_BYTE_PER_PIXEL;
+        while (CNN_FIFO_STATUS & CNN_FIFO_FULL_0);
+        CNN_FIFO_0 = RGB565_HWC(p);
+        p >>= 16;
+        while (CNN_FIFO_STATUS & CNN_FIFO_FULL_0);
+        CNN_FIFO_0 = RGB565_HWC(p);
+    }
+
+    if (count) {
+        p = *(const uint16_t *) src;
+        while (CNN_FIFO_STATUS & CNN_FIFO_FULL_0);
+        CNN_FIFO_0 = RGB565_HWC(p);
+    }
+}
+
+void cnn_input_fifo_write_chw(const uint32_t *r, const uint32_t *g, const uint32_t *b, int count)
+{
+    while (count--) {
+        // One status read for all three FIFOs, each has room for at least one word
+        while (CNN_FIFO_STATUS & CNN_FIFO_FULL_012);
+        CNN_FIFO_0 = *r++;
+        CNN_FIFO_1 = *g++;
+        CNN_FIFO_2 = *b++;
+    }
+}
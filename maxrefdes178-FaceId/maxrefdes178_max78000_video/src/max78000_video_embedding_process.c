@@ -51,6 +51,8 @@
 #include "max78000_debug.h"
 #include "max78000_video_embedding_process.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_faceid_db.h"
+#include "maxrefdes178_utility.h"
 
 
 //-----------------------------------------------------------------------------
@@ -58,65 +60,77 @@
 //-----------------------------------------------------------------------------
 #define S_MODULE_NAME   "embed"
 
+#define MAX_DISTANCE    1000000
+
+// Two database slots, each ends with a commit record. Slot A and its record are emitted by the
+// linker script for the built-in database, slot B starts erased.
+#define DB_SLOT_COUNT           2
+#define DB_COMMIT_MAGIC         0x43424446
+#define DB_COMMIT_CHECK(c, crc) (~((c)->magic + (c)->generation + (c)->size + (crc)))
+#define DB_REGION_SIZE          ((uint32_t) _embeddings_end_ - (uint32_t) _embeddings_start_)
+#define DB_SLOT_SIZE            (DB_REGION_SIZE / DB_SLOT_COUNT)
+#define DB_MAX_SIZE             (DB_SLOT_SIZE - (uint32_t) sizeof(tsDatabaseCommit))
+
+// Partial distance is checked against the bound every chunk
+#define DISTANCE_CHUNK_WORDS    16
+
+// Sum of absolute differences of four unsigned bytes, accumulated
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+#define SAD8(x, y, acc)     __USADA8((x), (y), (acc))
+#else
+#define SAD8(x, y, acc)     sad8((x), (y), (acc))
+#endif
+
 
 //-----------------------------------------------------------------------------
 // Typedefs
 //-----------------------------------------------------------------------------
-typedef struct  __attribute__((packed)) {
-    uint8_t numberOfSubjects;
-    uint16_t lengthOfEmbeddings;
-    uint16_t numberOfEmbeddings;
-    uint16_t imageWidth;
-    uint16_t imageHeight;
-    uint16_t lengthOfSubjectNames;
-
-}tsFaceIDFile;
-
-typedef struct  __attribute__((packed)) sDistance {
-        uint8_t subID;
-        int32_t distance;
-}tsDistance;
+/*  Last 16 bytes of a slot, one 128-bit flash line. update_database writes the slot that is not in
+ *  use and programs its record last, the slot with the highest committed generation is in use.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;    // Counts updates, 0 for the built-in database
+    uint32_t size;          // Database bytes from the start of the slot
+    uint32_t check;         // DB_COMMIT_CHECK with the CRC-16 of the database, 0 for generation 0
+} tsDatabaseCommit;
 
 
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
-extern uint32_t _embeddings_start_, _embeddings_end_;
-static const uint8_t *embeddings = (uint8_t *) &_embeddings_start_;
+// Linker symbols, declared without a bound as the region size is only known at link time
+extern uint8_t _embeddings_start_[], _embeddings_end_[];
+static const uint8_t *embeddings = _embeddings_start_;
 
 static tsMeanDistance gMeanDistance[FACEID_MAX_SUBJECT];
-static tsMinDistance gMinDistance[sizeof(tsMinDistance) * 3];
+static tsMinDistance gMinDistance[min_distance_count];
 static int8_t gClosestSubId[closest_sub_buffer_size];
 static uint8_t gMinDistanceCounter[FACEID_MAX_SUBJECT];
-static tsDistance gDistance[FACEID_MAX_SUBJECT * FACEID_MAX_PHOTO_PER_SUBJECT];
+static uint8_t gRemaining[FACEID_MAX_SUBJECT];
+static uint32_t gQuery[FACEID_EMBEDDING_SIZE / 4];
 
 static tsFaceIDFile *pDatabaseInfo = NULL;
+static const tsFaceIDFile emptyDatabase = {0, FACEID_EMBEDDING_SIZE, 0, FACEID_WIDTH, FACEID_HEIGHT, 0};
 static uint32_t gClosestSubIdBufIdx = 0;
 
 
 //-----------------------------------------------------------------------------
 // Local function declarations
 //-----------------------------------------------------------------------------
+static const tsDatabaseCommit *slot_commit(int slot);
+static int database_slot(void);
+static int page_is_current(uint32_t offset, const uint8_t *data, uint32_t len, uint32_t end);
+static int program_page(uint32_t offset, const uint8_t *data, uint32_t len, int erase);
+static uint32_t embedding_distance(const int8_t *sample, int len, uint32_t limit);
+static void insert_min_distance(uint8_t subID, int32_t distance);
 
 
 //-----------------------------------------------------------------------------
 // Function definitions
 //-----------------------------------------------------------------------------
 
-/*  embeddings db layout:
- *  1 byte : number of subjects (S)
- *  2 bytes: length of embeddings (L)
- *  2 bytes: number of embeddings (N)
- *  2 bytes: length of image width (W)
- *  2 bytes: length of image height (H)
- *  2 bytes: length of subject names (K)
- *  K bytes: subject names
- *  (L+1)*N bytes: embeddings
- *     1 byte : subject id
- *     L bytes: embedding
- *  (W*H*3)*N bytes: image
- *
- *  embeddings maximum sizes:
+/*  embeddings db layout is in maxrefdes178_faceid_db.h, maximum sizes:
  *  1         1 byte : number of subjects (S)        6
  *  2-3       2 bytes: length of embeddings (L)      512
  *  4-5       2 bytes: number of embeddings (N)      6*8=48
@@ -129,7 +143,23 @@ static uint32_t gClosestSubIdBufIdx = 0;
 
 int init_database(void)
 {
-	pDatabaseInfo = (tsFaceIDFile *)embeddings;
+    int slot = database_slot();
+    const tsDatabaseCommit *commit = (slot < 0) ? NULL : slot_commit(slot);
+    const uint8_t *db = commit ? (embeddings + slot * DB_SLOT_SIZE) : NULL;
+    faceid_db_status_e status = commit ? faceid_db_check(db, commit->size) : FACEID_DB_OK;
+
+    if (status != FACEID_DB_OK) {
+        // Committed but not searchable, same as no database
+        PR_WARN("committed database invalid: %s, starting empty", faceid_db_status_string(status));
+        pDatabaseInfo = (tsFaceIDFile *)&emptyDatabase;
+    } else if (commit) {
+        pDatabaseInfo = (tsFaceIDFile *)db;
+        PR_DEBUG("database slot %d generation %d size %d", slot, commit->generation, commit->size);
+    } else {
+        // Neither slot was ever committed
+        PR_WARN("no committed database, starting empty");
+        pDatabaseInfo = (tsFaceIDFile *)&emptyDatabase;
+    }
 
     for(int i=0; i<closest_sub_buffer_size; ++i){
         gClosestSubId[i] = -1;
@@ -164,15 +194,141 @@ void FLC0_IRQHandler(void)
     }
 }
 
-int update_database(uint8_t *db, uint32_t db_size)
+// Commit record of a slot, NULL if the slot holds no complete database
+static const tsDatabaseCommit *slot_commit(int slot)
+{
+    const uint8_t *db = embeddings + slot * DB_SLOT_SIZE;
+    const tsDatabaseCommit *commit = (const tsDatabaseCommit *)(db + DB_MAX_SIZE);
+    uint16_t crc = 0;
+
+    if ((commit->magic != DB_COMMIT_MAGIC) || (commit->size > DB_MAX_SIZE)) {
+        return NULL;
+    }
+
+    // The linker can't compute the CRC of the built-in database
+    if (commit->generation) {
+        crc = crc16_final(crc16_update(crc16_init(), db, commit->size));
+    }
+
+    return (commit->check == DB_COMMIT_CHECK(commit, crc)) ? commit : NULL;
+}
+
+// Slot of the newest committed database, -1 if there is none
+static int database_slot(void)
+{
+    const tsDatabaseCommit *commit;
+    uint32_t generation = 0;
+    int slot = -1;
+
+    for (int i = 0; i < DB_SLOT_COUNT; i++) {
+        commit = slot_commit(i);
+        if (commit && ((slot < 0) || (commit->generation > generation))) {
+            generation = commit->generation;
+            slot = i;
+        }
+    }
+
+    return slot;
+}
+
+/*  Check whether the flash page at region offset already holds len bytes of data followed by
+ *  erased flash till end
+ */
+static int page_is_current(uint32_t offset, const uint8_t *data, uint32_t len, uint32_t end)
 {
+    const uint8_t *page = embeddings + offset;
+
+    if (memcmp(page, data, len)) {
+        return 0;
+    }
+
+    for (uint32_t i = len; i < end; i++) {
+        if (page[i] != 0xFF) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Erase the page at offset if requested, program len bytes of data and verify them
+static int program_page(uint32_t offset, const uint8_t *data, uint32_t len, int erase)
+{
+    uint32_t page_addr = (uint32_t)_embeddings_start_ + offset;
     int ret = E_NO_ERROR;
 
-    if (db_size > ((&_embeddings_end_ - &_embeddings_start_) * 4)) {
-        PR_ERROR("db_size too big %d > %d", db_size, ((&_embeddings_end_ - &_embeddings_start_) * 4));
+    PR_DEBUG("update page 0x%x len %d", page_addr, len);
+
+    // Cache would return stale data for the programmed page
+    MXC_ICC_Disable(MXC_ICC0);
+
+    if (erase) {
+        ret = MXC_FLC_PageErase(page_addr);
+        if (ret != E_NO_ERROR) {
+            PR_ERROR("MXC_FLC_PageErase failed %d %d", page_addr, ret);
+            goto bail;
+        }
+    }
+
+    if (len) {
+        ret = MXC_FLC_Write(page_addr, len, (uint32_t *)data);
+        if (ret != E_NO_ERROR) {
+            PR_ERROR("MXC_FLC_Write failed %d", ret);
+            goto bail;
+        }
+
+        for (uint32_t i = 0; i < len; i++) {
+            if (data[i] != embeddings[offset + i]) {
+                PR_ERROR("verify fail at %d %02hhX != %02hhX", offset + i, data[i], embeddings[offset + i]);
+                ret = E_BAD_STATE;
+                goto bail;
+            }
+        }
+    }
+
+bail:
+    MXC_ICC_Enable(MXC_ICC0);
+
+    return ret;
+}
+
+/*  The new database goes to the slot not in use, the one in use stays valid until the record of the
+ *  new one is programmed and its CRC verifies. From then on the new slot has the higher generation,
+ *  the old one is only erased by the next update. A reset at any point boots with the old or the
+ *  new database.
+ */
+int update_database(uint8_t *db, uint32_t db_size)
+{
+    int current = database_slot();
+    int target = (current == 0) ? 1 : 0;
+    uint32_t base = target * DB_SLOT_SIZE;
+    uint32_t commit_offset = DB_SLOT_SIZE - MXC_FLASH_PAGE_SIZE;
+    tsDatabaseCommit commit;
+    faceid_db_status_e status;
+    int ret;
+
+    if (db_size > DB_MAX_SIZE) {
+        PR_ERROR("db_size too big %d > %d", db_size, DB_MAX_SIZE);
+        return E_BAD_PARAM;
+    }
+
+    // Keep the current database if the new one can't be searched
+    status = faceid_db_check(db, db_size);
+    if (status != FACEID_DB_OK) {
+        PR_ERROR("invalid database: %s", faceid_db_status_string(status));
         return E_BAD_PARAM;
     }
 
+    if ((current >= 0) && (slot_commit(current)->size == db_size) &&
+        !memcmp(embeddings + current * DB_SLOT_SIZE, db, db_size)) {
+        return E_NO_ERROR;
+    }
+
+    commit.magic = DB_COMMIT_MAGIC;
+    commit.generation = ((current >= 0) ? slot_commit(current)->generation : 0) + 1;
+    commit.size = db_size;
+    commit.check = DB_COMMIT_CHECK(&commit, crc16_final(crc16_update(crc16_init(), db, db_size)));
+
     // Set flash clock divider to generate a 1MHz clock from the APB clock
     // APB clock is 54MHz on the real silicon
     MXC_FLC0->clkdiv = 24;
@@ -184,57 +340,53 @@ int update_database(uint8_t *db, uint32_t db_size)
 
     MXC_FLC_EnableInt(MXC_F_FLC_INTR_DONEIE | MXC_F_FLC_INTR_AFIE);
 
-    MXC_ICC_Disable(MXC_ICC0);
+    // Stale record of the target slot goes first, so its pages can change
+    ret = program_page(base + commit_offset, NULL, 0, 1);
+    if (ret != E_NO_ERROR) {
+        return ret;
+    }
 
-    for (uint32_t page_addr = (uint32_t)&_embeddings_start_; page_addr < (uint32_t)&_embeddings_end_; page_addr += MXC_FLASH_PAGE_SIZE) {
-        ret = MXC_FLC_PageErase(page_addr);
+    // Rewrite only the pages whose content differs from the new database.
+    // Beyond db_size the slot is expected to be erased, same as after a full rewrite.
+    for (uint32_t offset = 0; offset < commit_offset; offset += MXC_FLASH_PAGE_SIZE) {
+        uint32_t len = (offset < db_size) ? MIN(db_size - offset, MXC_FLASH_PAGE_SIZE) : 0;
+
+        if (page_is_current(base + offset, db + offset, len, MXC_FLASH_PAGE_SIZE)) {
+            continue;
+        }
+
+        ret = program_page(base + offset, db + offset, len, 1);
         if (ret != E_NO_ERROR) {
-            PR_ERROR("MXC_FLC_PageErase failed %d %d", page_addr, ret);
-            goto bail;
+            return ret;
         }
     }
 
-    ret = MXC_FLC_Write((uint32_t)&_embeddings_start_, db_size, (uint32_t* )db);
+    // Database tail in the commit page, then the commit record last
+    if (db_size > commit_offset) {
+        ret = program_page(base + commit_offset, db + commit_offset, db_size - commit_offset, 0);
+        if (ret != E_NO_ERROR) {
+            return ret;
+        }
+    }
+
+    ret = program_page(base + DB_MAX_SIZE, (uint8_t *)&commit, sizeof(commit), 0);
     if (ret != E_NO_ERROR) {
-        PR_ERROR("MXC_FLC_Write failed %d", ret);
-        goto bail;
+        return ret;
     }
 
-    for (int i = 0; i < db_size; i++) {
-        if (db[i] != embeddings[i]) {
-            PR_ERROR("verify fail at %d %02hhX != %02hhX", i, db[i], embeddings[i]);
-            goto bail;
-        }
+    if (!slot_commit(target)) {
+        PR_ERROR("slot %d commit does not verify", target);
+        return E_BAD_STATE;
     }
 
-bail:
-    MXC_ICC_Enable(MXC_ICC0);
+    PR_DEBUG("database slot %d generation %d committed", target, commit.generation);
 
-    return ret;
+    return E_NO_ERROR;
 }
 
 char *get_subject_name(int ID)
 {
-	char *point = (char *)(pDatabaseInfo+1);
-
-	if (ID == 0) {
-		return point;
-	}
-
-	int counter = 0;
-
-	for(int i = 0; i < pDatabaseInfo->lengthOfSubjectNames; i++){
-		point++;
-		if (*point == '\0') {
-			counter++;
-			if (counter == ID) {
-				point++;
-				return point;
-			}
-		}
-	}
-
-	return 0;
+    return (char *)faceid_db_subject_name(pDatabaseInfo, ID);
 }
 
 uint8_t get_subject_count(void)
@@ -257,79 +409,148 @@ tsMinDistance *get_min_distance(){
     return gMinDistance;
 }
 
-int calculate_minDistance(const uint8_t *embedding)
+#if !(defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1))
+static inline uint32_t sad8(uint32_t x, uint32_t y, uint32_t acc)
 {
-    int8_t *theEmbedding = (int8_t *)embedding;
-    int8_t *theEmbeddingOrigin = theEmbedding;
+    for (int i = 0; i < 4; i++) {
+        acc += abs((int)(x & 0xFF) - (int)(y & 0xFF));
+        x >>= 8;
+        y >>= 8;
+    }
 
-    tsDistance *dist = gDistance;
-    tsMeanDistance *meanDist = gMeanDistance;
+    return acc;
+}
+#endif
+
+/*  L1 distance between gQuery and one stored embedding.
+ *  Embeddings are int8, flipping the sign bit maps them to uint8 with the same differences,
+ *  gQuery is already flipped. Stops early once the distance reaches limit.
+ */
+static uint32_t embedding_distance(const int8_t *sample, int len, uint32_t limit)
+{
+    uint32_t total = 0;
+    uint32_t word;
+    int words = len / 4;
+    int i = 0;
+
+    while (i < words) {
+        int chunk_end = MIN(i + DISTANCE_CHUNK_WORDS, words);
+
+        for (; i < chunk_end; i++) {
+            memcpy(&word, sample, sizeof(word)); // Stored embeddings are not word aligned
+            sample += sizeof(word);
+            total = SAD8(gQuery[i], word ^ 0x80808080, total);
+        }
+
+        if (total >= limit) {
+            return total;
+        }
+    }
 
-    int8_t *pData =  (int8_t *)((uint32_t)(pDatabaseInfo+1) + pDatabaseInfo->lengthOfSubjectNames);
+    for (i = words * 4; i < len; i++) {
+        total += abs((int)((uint8_t *) gQuery)[i] - (int)(uint8_t)(*sample++ ^ 0x80));
+    }
+
+    return total;
+}
 
-    // Calculate min distance for each embedding
-    for (int i = 0; i < pDatabaseInfo->numberOfEmbeddings; i++) {
-        int total = 0;
-        dist->subID = (uint8_t)(*(pData++));
-        theEmbedding = theEmbeddingOrigin;
-        for (int j = 0; j < pDatabaseInfo->lengthOfEmbeddings;j++) {
-            total += abs((*(theEmbedding++))-(*(pData++)));
+/*  Keep gMinDistance sorted by distance, equal distances by subject id. This is the same order
+ *  subjects get when inserted in id order with strict comparison.
+ */
+static void insert_min_distance(uint8_t subID, int32_t distance)
+{
+    int pos;
+
+    for (pos = 0; pos < min_distance_count; pos++) {
+        if ((distance < gMinDistance[pos].distance) ||
+            ((distance == gMinDistance[pos].distance) && (subID < gMinDistance[pos].subID) &&
+             (gMinDistance[pos].subID != 0xFF))) {
+            break;
         }
+    }
 
-        dist->distance = total;
-        dist++;
+    if (pos == min_distance_count) {
+        return;
     }
 
-    dist = gDistance;
+    for (int i = min_distance_count - 1; i > pos; i--) {
+        gMinDistance[i] = gMinDistance[i - 1];
+    }
+
+    gMinDistance[pos].subID = subID;
+    gMinDistance[pos].distance = distance;
+}
+
+int calculate_minDistance(const uint8_t *embedding)
+{
+    tsMeanDistance *meanDist = gMeanDistance;
+    int numberOfSubjects = MIN(pDatabaseInfo->numberOfSubjects, FACEID_MAX_SUBJECT);
+    int length = MIN(pDatabaseInfo->lengthOfEmbeddings, FACEID_EMBEDDING_SIZE);
+    int stride = pDatabaseInfo->lengthOfEmbeddings + 1;
+
+    const int8_t *pDataOrigin = faceid_db_embeddings(pDatabaseInfo);
+    const int8_t *pData;
 
-    for (int i = 0; i < pDatabaseInfo->numberOfSubjects; i++) {
+    // Flip sign bits once so the query can be compared as unsigned bytes
+    memcpy(gQuery, embedding, length);
+    for (int i = 0; i < (length + 3) / 4; i++) {
+        gQuery[i] ^= 0x80808080;
+    }
+
+    for (int i = 0; i < numberOfSubjects; i++) {
         meanDist[i].subID = i;
         meanDist[i].number = 0;
         meanDist[i].distance = 0;
     }
 
-    for (int i = 0; i < pDatabaseInfo->numberOfEmbeddings; i++) {
-        meanDist = gMeanDistance + dist->subID;
-        meanDist->distance += dist->distance;
-        meanDist->number++;
-        dist++;
+    // Count embeddings of each subject first so a subject can be dropped before all are summed
+    pData = pDataOrigin;
+    for (int i = 0; i < pDatabaseInfo->numberOfEmbeddings; i++, pData += stride) {
+        uint8_t subID = (uint8_t) *pData;
+        if (subID < numberOfSubjects) {
+            meanDist[subID].number++;
+        }
     }
 
-    meanDist = gMeanDistance;
+    for (int i = 0; i < min_distance_count; i++) {
+        gMinDistance[i].subID = 0xFF;
+        gMinDistance[i].distance = MAX_DISTANCE;
+    }
 
-    for (int i = 0; i < pDatabaseInfo->numberOfSubjects; i++) {
-        meanDist->distance = meanDist->distance / meanDist->number;
-        meanDist++;
+    for (int i = 0; i < numberOfSubjects; i++) {
+        gRemaining[i] = meanDist[i].number;
+        if (meanDist[i].number == 0) {
+            // No embeddings, mean distance is 0 as integer division by zero gives on Cortex-M4
+            insert_min_distance(i, 0);
+        }
     }
 
-    meanDist = gMeanDistance;
+    pData = pDataOrigin;
+    for (int i = 0; i < pDatabaseInfo->numberOfEmbeddings; i++, pData += stride) {
+        uint8_t subID = (uint8_t) *pData;
+
+        if ((subID >= numberOfSubjects) || (gRemaining[subID] == 0)) {
+            continue;
+        }
 
-#define MAX_DISTANCE 1000000
+        meanDist = gMeanDistance + subID;
 
-    for (int i = 0; i < 3; i++) {
-        gMinDistance[i].subID = 0xFF;
-        gMinDistance[i].distance = MAX_DISTANCE;
-    }
+        // Subject can't get into gMinDistance once its mean is above the last one
+        uint32_t limit = (gMinDistance[min_distance_count - 1].distance + 1) * meanDist->number;
 
-    for (int i = 0; i < pDatabaseInfo->numberOfSubjects; i++)
-    {
-        if (meanDist[i].distance < gMinDistance[0].distance) {         /* Check if current element is less than firstMin, then update first, second and third */
-            gMinDistance[2].distance = gMinDistance[1].distance;
-            gMinDistance[2].subID = gMinDistance[1].subID;
-            gMinDistance[1].distance = gMinDistance[0].distance;
-            gMinDistance[1].subID = gMinDistance[0].subID;
-            gMinDistance[0].distance = meanDist[i].distance;
-            gMinDistance[0].subID  = meanDist[i].subID;
-        } else if (meanDist[i].distance < gMinDistance[1].distance) {    /* Check if current element is less than secmin then update second and third */
-            gMinDistance[2].distance = gMinDistance[1].distance;
-            gMinDistance[2].subID = gMinDistance[1].subID;
-            gMinDistance[1].distance = meanDist[i].distance;
-            gMinDistance[1].subID  = meanDist[i].subID;
-        } else if (meanDist[i].distance < gMinDistance[2].distance) {  /* Check if current element is less than then update third */
-            gMinDistance[2].distance = meanDist[i].distance;
-            gMinDistance[2].subID  = meanDist[i].subID;
+        if ((uint32_t) meanDist->distance < limit) {
+            meanDist->distance += embedding_distance(pData + 1, length, limit - meanDist->distance);
         }
 
+        if ((uint32_t) meanDist->distance >= limit) {
+            gRemaining[subID] = 0;
+            continue;
+        }
+
+        if (--gRemaining[subID] == 0) {
+            meanDist->distance = meanDist->distance / meanDist->number;
+            insert_min_distance(subID, meanDist->distance);
+        }
     }
 
     uint32_t bufferIdx = gClosestSubIdBufIdx % (closest_sub_buffer_size);
@@ -346,9 +567,9 @@ int calculate_minDistance(const uint8_t *embedding)
     ++gClosestSubIdBufIdx;
     
     PR_DEBUG("Results:");
-    PR_DEBUG("1. : %d, distance: %d", gMinDistance[0].subID, gMinDistance[0].distance);
-    PR_DEBUG("2. : %d, distance: %d", gMinDistance[1].subID, gMinDistance[1].distance);
-    PR_DEBUG("3. : %d, distance: %d", gMinDistance[2].subID, gMinDistance[2].distance);
+    for (int i = 0; i < min_distance_count; i++) {
+        PR_DEBUG("%d. : %d, distance: %d", i + 1, gMinDistance[i].subID, gMinDistance[i].distance);
+    }
     
 //    printf("\t");
 //    for(int i=0; i<closest_sub_buffer_size; ++i){
@@ -50,11 +50,15 @@
 #include "max78000_debug.h"
 #include "max78000_qspi_slave.h"
 #include "max78000_video_cnn.h"
+#include "max78000_video_cnn_input.h"
 #include "max78000_video_embedding_process.h"
 #include "max78000_video_weights.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+#include "maxrefdes178_trace.h"
 #include "maxrefdes178_utility.h"
 #include "maxrefdes178_version.h"
+#include "maxrefdes178_video_codec.h"
 
 
 //-----------------------------------------------------------------------------
@@ -62,6 +66,12 @@
 //-----------------------------------------------------------------------------
 #define S_MODULE_NAME          "main"
 
+// Frames estimated to compress to more than this are sent raw
+#define VIDEO_COMPRESSION_MAX_SIZE  (LCD_DATA_SIZE / 2)
+
+// Camera frame period, a frame every 40 ms at the 15 MHz camera clock
+#define CAMERA_FRAME_PERIOD_MS(clock)  ((40UL * 15 * 1000 * 1000) / (clock))
+
 //#define PRINT_TIME_CNN
 
 
@@ -212,20 +222,31 @@ static const uint8_t camera_settings[][2] = {
 // *****************************************************************************
 static int8_t prev_decision = -2;
 static int8_t decision = -2;
+static int8_t decision_pending = 0;  // Last change was not sent, the MAX32666 had no room
 static uint32_t time_counter = 0;
 static int8_t enable_cnn = 1;
+static uint8_t cnn_interval = 1;  // CNN runs on every Nth frame
 static volatile int8_t button_pressed = 0;
 static int8_t flash_led = 0;
 static int8_t camera_vflip = 1;
 static int8_t enable_video = 0;
+static int8_t overlap_capture = 1;
 static int8_t enable_sleep = 0;
+static int8_t enable_compression = 0;
 static uint8_t *qspi_payload_buffer = NULL;
+static uint8_t qspi_command_buffer[16];  // Small payloads, received without stopping the camera
+static qspi_credit_t qspi_credit;
 static version_t version = {S_VERSION_MAJOR, S_VERSION_MINOR, S_VERSION_BUILD};
 static char demo_name[] = FACEID_DEMO_NAME;
+#ifdef ENABLE_TRACE
+static trace_dump_t trace_dump;
+#endif
 static uint32_t camera_clock = 15 * 1000 * 1000;
+static uint32_t ml_data[CNN_NUM_OUTPUTS / sizeof(uint32_t)];
 
 #ifdef PRINT_TIME_CNN
 #define PR_TIMER(fmt, args...) if((time_counter % 10) == 0) printf("T[%-5s:%4d] " fmt "\r\n", S_MODULE_NAME, __LINE__, ##args )
+static uint32_t pass_time = 0;
 #endif
 
 
@@ -234,8 +255,10 @@ static uint32_t camera_clock = 15 * 1000 * 1000;
 //-----------------------------------------------------------------------------
 static void fail(void);
 static void send_img(void);
-static void run_cnn(int x_offset, int y_offset);
+static void run_cnn_load(int x_offset, int y_offset);
+static void run_cnn_result(void);
 static void run_demo(void);
+static int send_credited(uint8_t *data, uint32_t data_size, uint8_t packet_type);
 
 
 //-----------------------------------------------------------------------------
@@ -414,6 +437,8 @@ int main(void)
     // Successfully initialize the program
     PR_INFO("Program initialized successfully");
 
+    TRACE_INIT(TRACE_SOURCE_MAX78000_VIDEO);
+
     run_demo();
 
     return 0;
@@ -434,18 +459,28 @@ static void run_demo(void)
 {
     uint32_t capture_started_time = GET_RTC_MS();
     uint32_t cnn_completed_time = 0;
+    uint32_t qspi_started_time = 0;
     uint32_t qspi_completed_time = 0;
     uint32_t capture_completed_time = 0;
+    uint32_t next_capture_started_time = 0;
+    uint32_t cnn_result_started_time;
+    uint32_t cnn_result_duration = 0;  // Of the last frame the CNN ran on
     max78000_statistics_t max78000_statistics = {0};
     qspi_packet_header_t qspi_rx_header;
     qspi_state_e qspi_rx_state;
+    uint8_t *qspi_rx_buffer;
+    int8_t run_cnn_frame;
+    int8_t capture_overlapped;
 
     PR_INFO("Embeddings subject names:");
     for (int i = 0; i < get_subject_count(); i++) {
           PR_INFO("  %s", get_subject_name(i));
     }
 
+    qspi_credit_init(&qspi_credit);
+
     camera_start_capture_image();
+    TRACE_EVENT(TRACE_EVENT_CAPTURE_START, 0);
 
     while (1) { //Capture image and run CNN
 
@@ -454,18 +489,25 @@ static void run_demo(void)
         if (qspi_rx_state == QSPI_STATE_CS_DEASSERTED_HEADER) {
             qspi_rx_header = qspi_slave_get_rx_header();
 
-            // Use camera interface buffer for QSPI payload
-            MXC_PCIF_Stop();
+            // Use camera interface buffer for large QSPI payloads
+            if (qspi_rx_header.info.packet_size <= sizeof(qspi_command_buffer)) {
+                qspi_rx_buffer = qspi_command_buffer;
+            } else {
+                qspi_rx_buffer = qspi_payload_buffer;
+                MXC_PCIF_Stop();
+            }
 
-            qspi_slave_set_rx_data(qspi_payload_buffer, qspi_rx_header.info.packet_size);
+            qspi_slave_set_rx_data(qspi_rx_buffer, qspi_rx_header.info.packet_size);
             qspi_slave_trigger();
             qspi_slave_wait_rx();
 
             // Check payload crc again
-            if (qspi_rx_header.payload_crc16 != crc16_sw(qspi_payload_buffer, qspi_rx_header.info.packet_size)) {
+            if (qspi_rx_header.payload_crc16 != crc16_sw(qspi_rx_buffer, qspi_rx_header.info.packet_size)) {
                 PR_ERROR("Invalid payload crc %x", qspi_rx_header.payload_crc16);
                 qspi_slave_set_rx_state(QSPI_STATE_IDLE);
-                camera_start_capture_image();
+                if (qspi_rx_buffer == qspi_payload_buffer) {
+                    camera_start_capture_image();
+                }
                 continue;
             }
 
@@ -477,7 +519,7 @@ static void run_demo(void)
                     uninit_database();
 
                     uint8_t faceid_embed_update_status;
-                    if (update_database(qspi_payload_buffer, qspi_rx_header.info.packet_size) != E_NO_ERROR) {
+                    if (update_database(qspi_rx_buffer, qspi_rx_header.info.packet_size) != E_NO_ERROR) {
                         PR_ERROR("Could not update the database");
                         faceid_embed_update_status = FACEID_EMBED_UPDATE_STATUS_ERROR_UNKNOWN;
                     } else if (init_database() != E_NO_ERROR) {
@@ -493,11 +535,22 @@ static void run_demo(void)
                     qspi_slave_set_rx_state(QSPI_STATE_IDLE);
                     qspi_slave_send_packet(&faceid_embed_update_status, 1, QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_RES);
 
+                    break;
+                case QSPI_PACKET_TYPE_VIDEO_CNN_INTERVAL_CMD:
+                    if (qspi_rx_header.info.packet_size != sizeof(cnn_interval)) {
+                        PR_ERROR("Invalid cnn interval size %u", qspi_rx_header.info.packet_size);
+                        break;
+                    }
+                    cnn_interval = MIN(MAX(qspi_rx_buffer[0], 1), GOVERNOR_CNN_INTERVAL_MAX);
+                    PR_INFO("cnn interval %d", cnn_interval);
+                    break;
+                case QSPI_PACKET_TYPE_ACKNOWLEDGE:
+                    qspi_credit_grant(&qspi_credit, qspi_rx_buffer, qspi_rx_header.info.packet_size);
                     break;
                 case QSPI_PACKET_TYPE_TEST:
                     PR_INFO("test data received %d", qspi_rx_header.info.packet_size);
                     for (int i = 0; i < qspi_rx_header.info.packet_size; i++) {
-                        printf("%02hhX ", qspi_payload_buffer[i]);
+                        printf("%02hhX ", qspi_rx_buffer[i]);
                     }
                     printf("\n");
                     break;
@@ -507,7 +560,9 @@ static void run_demo(void)
             }
 
             qspi_slave_set_rx_state(QSPI_STATE_IDLE);
-            camera_start_capture_image();
+            if (qspi_rx_buffer == qspi_payload_buffer) {
+                camera_start_capture_image();
+            }
 
         } else if (qspi_rx_state == QSPI_STATE_COMPLETED) {
             qspi_rx_header = qspi_slave_get_rx_header();
@@ -542,6 +597,7 @@ static void run_demo(void)
                 GPIO_SET(gpio_camera);
                 GPIO_CLR(gpio_red);
                 GPIO_CLR(gpio_green);
+                cnn_release();
                 break;
             case QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD:
                 PR_INFO("enable cnn");
@@ -552,6 +608,7 @@ static void run_demo(void)
                 enable_cnn = 0;
                 GPIO_CLR(gpio_red);
                 GPIO_CLR(gpio_green);
+                cnn_release();
                 break;
             case QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD:
                 // Use camera interface buffer for FaceID embeddings subject names
@@ -604,6 +661,14 @@ static void run_demo(void)
                 camera_vflip = 0;
                 camera_set_vflip(camera_vflip);
                 break;
+            case QSPI_PACKET_TYPE_VIDEO_ENABLE_COMPRESSION_CMD:
+                PR_INFO("enable compression");
+                enable_compression = 1;
+                break;
+            case QSPI_PACKET_TYPE_VIDEO_DISABLE_COMPRESSION_CMD:
+                PR_INFO("disable compression");
+                enable_compression = 0;
+                break;
             case QSPI_PACKET_TYPE_VIDEO_DEBUG_CMD:
                 PR_INFO("dont sleep for %ds to let debugger connection", MAX78000_SLEEP_DEFER_DURATION);
                 enable_sleep = 0;
@@ -641,21 +706,56 @@ static void run_demo(void)
 
         if (camera_is_image_rcv()) { // Check whether image is ready
             capture_completed_time = GET_RTC_MS();
+            TRACE_NEXT_FRAME();
+            TRACE_EVENT(TRACE_EVENT_CAPTURE_END, 0);
+
+            // Governor may run the CNN on every Nth frame only
+            run_cnn_frame = enable_cnn && ((time_counter % cnn_interval) == 0);
+
+            // Compression overwrites the camera buffer, CNN input is loaded before
+            if (run_cnn_frame && enable_compression) {
+                run_cnn_load(0, 0);
+            }
+
+            qspi_started_time = GET_RTC_MS();
 
             send_img();
 
             qspi_completed_time = GET_RTC_MS();
 
-            if (enable_cnn) {
-                run_cnn(0, 0);
+            if (run_cnn_frame && !enable_compression) {
+                run_cnn_load(0, 0);
+            }
+
+            // Frame is sent and streamed into CNN data memory, camera buffer is free. Capture the
+            // next frame while the CNN result is processed only if the result would run past the
+            // next camera frame start. Otherwise the serial loop catches that frame too and an
+            // earlier capture start only waits longer for it.
+            cnn_result_started_time = GET_RTC_MS();
+            capture_overlapped = overlap_capture && run_cnn_frame &&
+                    (((cnn_result_started_time - capture_completed_time) + cnn_result_duration) >
+                    CAMERA_FRAME_PERIOD_MS(camera_clock));
+            if (capture_overlapped) {
+                camera_start_capture_image();
+                next_capture_started_time = GET_RTC_MS();
+                TRACE_EVENT(TRACE_EVENT_CAPTURE_START, 0);
+            }
+
+            if (run_cnn_frame) {
+                run_cnn_result();
             }
 
             cnn_completed_time = GET_RTC_MS();
+            if (run_cnn_frame) {
+                cnn_result_duration = cnn_completed_time - cnn_result_started_time;
+            }
 
             if (time_counter % 10 == 0) {
                 max78000_statistics.capture_duration_us = (capture_completed_time - capture_started_time) * 1000;
-                max78000_statistics.communication_duration_us = (qspi_completed_time - capture_completed_time) * 1000;
-                max78000_statistics.cnn_duration_us = (cnn_completed_time - qspi_completed_time) * 1000;
+                max78000_statistics.communication_duration_us = (qspi_completed_time - qspi_started_time) * 1000;
+                max78000_statistics.cnn_duration_us = ((cnn_completed_time - qspi_completed_time) +
+                        (qspi_started_time - capture_completed_time)) * 1000;
+                // Capture start to result of this frame, the capture overlapped the previous CNN run
                 max78000_statistics.total_duration_us = (cnn_completed_time - capture_started_time) * 1000;
 
                 PR_DEBUG("Capture : %lu", max78000_statistics.capture_duration_us);
@@ -663,15 +763,24 @@ static void run_demo(void)
                 PR_DEBUG("QSPI    : %lu", max78000_statistics.communication_duration_us);
                 PR_DEBUG("Total   : %lu\n\n", max78000_statistics.total_duration_us);
 
-                qspi_slave_send_packet((uint8_t *) &max78000_statistics, sizeof(max78000_statistics),
+                send_credited((uint8_t *) &max78000_statistics, sizeof(max78000_statistics),
                         QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES);
+#ifdef ENABLE_TRACE
+                trace_drain(&trace_dump);
+                qspi_slave_send_packet((uint8_t *) &trace_dump, TRACE_DUMP_SIZE(trace_dump.count),
+                        QSPI_PACKET_TYPE_VIDEO_TRACE_RES);
+#endif
             }
 
             time_counter++;
 
-            camera_start_capture_image();
-            capture_started_time = GET_RTC_MS();
-
+            if (capture_overlapped) {
+                capture_started_time = next_capture_started_time;
+            } else {
+                camera_start_capture_image();
+                capture_started_time = GET_RTC_MS();
+                TRACE_EVENT(TRACE_EVENT_CAPTURE_START, 0);
+            }
         }
     }
 }
@@ -681,37 +790,63 @@ static void send_img(void)
     uint8_t   *raw;
     uint32_t  imgLen;
     uint32_t  w, h;
+    uint32_t  compressed_size = 0;
+
+    // MAX32666 has not shown the previous frame yet, skip this one
+    if (!qspi_credit_available(&qspi_credit, QSPI_PACKET_TYPE_VIDEO_DATA_RES, GET_RTC_MS())) {
+        return;
+    }
 
     // Get the details of the image from the camera driver.
     camera_get_image(&raw, &imgLen, &w, &h);
 
-    qspi_slave_send_packet(raw, imgLen, QSPI_PACKET_TYPE_VIDEO_DATA_RES);
-//    MXC_Delay(MXC_DELAY_MSEC(3)); // Yield SPI DMA RAM read
+    // Compressed in place, frames that would not get small enough are sent raw
+    if (enable_compression && (imgLen == LCD_DATA_SIZE) &&
+        (video_codec_estimate(raw) <= VIDEO_COMPRESSION_MAX_SIZE)) {
+        compressed_size = video_codec_encode(raw);
+    }
+
+    if (compressed_size) {
+        send_credited(raw, compressed_size, QSPI_PACKET_TYPE_VIDEO_COMPRESSED_DATA_RES);
+    } else {
+        send_credited(raw, imgLen, QSPI_PACKET_TYPE_VIDEO_DATA_RES);
+    }
+}
+
+// Sends the packet if the MAX32666 has room for its class, returns E_BUSY otherwise
+static int send_credited(uint8_t *data, uint32_t data_size, uint8_t packet_type)
+{
+    int ret;
+
+    if (!qspi_credit_available(&qspi_credit, packet_type, GET_RTC_MS())) {
+        return E_BUSY;
+    }
+
+    ret = qspi_slave_send_packet(data, data_size, packet_type);
+    if (ret == E_NO_ERROR) {
+        qspi_credit_use(&qspi_credit, packet_type, GET_RTC_MS());
+    }
+
+    return ret;
 }
 
-static void run_cnn(int x_offset, int y_offset)
+static void run_cnn_load(int x_offset, int y_offset)
 {
     uint8_t *data;
     uint8_t *raw;
-    uint8_t ur, ug, ub;
-    int8_t r, g, b;
     uint32_t number;
     uint32_t w, h;
-    static uint32_t noface_count = 0;
 
     // Get the details of the image from the camera driver.
     camera_get_image(&raw, &number, &w, &h);
 
 #ifdef PRINT_TIME_CNN
-    uint32_t pass_time = GET_RTC_MS();
+    pass_time = GET_RTC_MS();
 #endif
 
-    // Enable CNN clock
-    MXC_SYS_ClockEnable(MXC_SYS_PERIPH_CLOCK_CNN);
-
-    cnn_init(); // Bring state machine into consistent state
-    //cnn_load_weights(); // No need to reload kernels
-    cnn_configure(); // Configure state machine
+    // Enable clock and configure CNN, done only once while the CNN stays enabled
+    cnn_prepare();
+    TRACE_EVENT(TRACE_EVENT_CNN_LOAD, 0);
 
     cnn_start();
 
@@ -724,50 +859,43 @@ static void run_cnn(int x_offset, int y_offset)
         data = raw + (((LCD_HEIGHT - FACEID_HEIGHT) / 2) + i) * LCD_WIDTH * LCD_BYTE_PER_PIXEL;  // down
         data += ((LCD_WIDTH - FACEID_WIDTH) / 2) * LCD_BYTE_PER_PIXEL;  // right
 
-        for(int j = x_offset; j < FACEID_WIDTH + x_offset; j++) {
-            // RGB565, |RRRRRGGG|GGGBBBBB|
-            ub = (data[j * LCD_BYTE_PER_PIXEL + 1] << 3);
-            ug = ((data[j * LCD_BYTE_PER_PIXEL] << 5) | ((data[j * LCD_BYTE_PER_PIXEL + 1] & 0xE0) >> 3));
-            ur = (data[j * LCD_BYTE_PER_PIXEL] & 0xF8);
-
-            b = ub - 128;
-            g = ug - 128;
-            r = ur - 128;
-
-            // Loading data into the CNN fifo
-            while (((*((volatile uint32_t *) 0x50000004) & 1)) != 0); // Wait for FIFO 0
-
-            number = 0x00FFFFFF & ((((uint8_t)b) << 16) | (((uint8_t)g) << 8) | ((uint8_t) r));
-
-            *((volatile uint32_t *) 0x50000008) = number; // Write FIFO 0
-        }
+        // Loading data into the CNN fifo
+        cnn_input_fifo_write_rgb565_hwc(data + x_offset * LCD_BYTE_PER_PIXEL, FACEID_WIDTH);
     }
 
+    TRACE_EVENT(TRACE_EVENT_CNN_START, 0);
+
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN load : %d", GET_RTC_MS() - pass_time);
     pass_time = GET_RTC_MS();
 #endif
+}
+
+static void run_cnn_result(void)
+{
+    static uint32_t noface_count = 0;
 
     while (cnn_time == 0)
         __WFI(); // Wait for CNN done
 
+    TRACE_EVENT(TRACE_EVENT_CNN_DONE, 0);
+
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN wait : %d", GET_RTC_MS() - pass_time);
     pass_time = GET_RTC_MS();
 #endif
 
-    cnn_unload((uint32_t*)(raw));
+    cnn_unload(ml_data);
+    TRACE_EVENT(TRACE_EVENT_CNN_UNLOAD, 0);
 
-    cnn_stop();
-    // Disable CNN clock to save power
-    MXC_SYS_ClockDisable(MXC_SYS_PERIPH_CLOCK_CNN);
+    cnn_stop(); // Keep clock and configuration for the next frame
 
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN unload : %d", GET_RTC_MS() - pass_time);
     pass_time = GET_RTC_MS();
 #endif
 
-    int pResult = calculate_minDistance((uint8_t*)(raw));
+    int pResult = calculate_minDistance((uint8_t *) ml_data);
 
 #ifdef PRINT_TIME_CNN
     PR_TIMER("Embedding calc : %d", GET_RTC_MS() - pass_time);
@@ -831,9 +959,10 @@ static void run_cnn(int x_offset, int y_offset)
             }
         }
 
-        if(decision != prev_decision){
-            qspi_slave_send_packet((uint8_t *) &classification_result, sizeof(classification_result),
-                    QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES);
+        // Only changes are sent, one that didn't go out is retried with the next result
+        if((decision != prev_decision) || decision_pending){
+            decision_pending = (send_credited((uint8_t *) &classification_result, sizeof(classification_result),
+                    QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES) != E_NO_ERROR);
             PR_DEBUG("Result : %s\n", classification_result.result);
         }
     }
@@ -44,11 +44,15 @@
 #include <mxc_sys.h>
 
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_governor.h"
+#include "maxrefdes178_unet_mask.h"
 
 
 //-----------------------------------------------------------------------------
 // Defines
 //-----------------------------------------------------------------------------
+// The mask is rendered straight into the front buffer, which leaves room for a second frame
+#define MAX32666_LCD_DOUBLE_BUFFER         1
 
 
 //-----------------------------------------------------------------------------
@@ -71,6 +75,7 @@ typedef struct {
     uint8_t enable_max78000_video_cnn;
     uint8_t enable_max78000_video_flash_led;
     uint8_t enable_max78000_video_vflip;
+    uint8_t enable_max78000_video_compression;
     uint8_t enable_max78000_video_and_audio_power;  // TODO
     uint8_t enable_lcd_statistics;
     uint8_t enable_lcd_probabilty;
@@ -78,6 +83,8 @@ typedef struct {
     uint8_t enable_ble_send_classification;  // TODO
     uint8_t enable_inactivity;
     lcd_rotation_e lcd_rotation;
+    governor_policy_e governor_policy;
+    uint16_t governor_target_minutes;  // GOVERNOR_POLICY_BATTERY_HOURS only
 } device_settings_t;
 
 typedef struct {
@@ -100,6 +107,9 @@ typedef struct {
     uint8_t fuel_gauge_working;
     float vcell;
     uint8_t usb_chgin;
+    uint8_t pmic_thermal;  // Charger thermal regulation or shutdown
+
+    governor_t governor;
 
     inactivity_state_e inactivity_state;
 
@@ -110,27 +120,40 @@ typedef struct {
     volatile uint16_t ble_max_packet_size; // written by core1
     volatile uint8_t ble_expected_rx_seq;  // written by core1
     volatile uint8_t ble_next_tx_seq;  // written by core1
+    volatile uint8_t ble_tx_aborted;  // set by core1, cleared by core0 after the tx queue is flushed
+
+#ifdef ENABLE_TRACE
+    trace_dump_t trace[TRACE_SOURCE_LAST];
+    uint8_t trace_pending;  // bit per trace_source_e, dump not sent over BLE yet
+#endif
 } device_status_t;
 
 typedef struct {
-    uint8_t buffer[LCD_DATA_SIZE];
-	int8_t ml_data8[LCD_DATA_SIZE/4];
+    uint8_t *buffer;  // Front buffer, overlays are drawn here and it is sent to the LCD
+    uint8_t *back_buffer;  // Video frames are received here
+    uint8_t frame_buffer[MAX32666_LCD_DOUBLE_BUFFER + 1][LCD_DATA_SIZE];
+    unet_mask_result_t mask;  // Latest UNet class map, drawn on every frame
+    uint8_t mask_valid;
+    uint8_t mask_pending;  // Not drawn and acknowledged yet
     char notification[LCD_NOTIFICATION_MAX_SIZE];
     uint16_t notification_color;
     volatile uint8_t refresh_screen;
+    volatile uint8_t frame_pending;  // Complete frame in back buffer, not shown yet
 } lcd_data_t;
 
 typedef struct {
     uint32_t audio_result_received;
     uint32_t video_data_received;
+    uint32_t mask_received;
     uint32_t notification_received;
     uint32_t faceid_subject_names_received;
     uint32_t screen_drew;
     uint32_t statistics_sent;
-    uint32_t pmic_check;
-    uint32_t led;
-    uint32_t powmon;
+#ifdef ENABLE_TRACE
+    uint32_t trace_sent;
+#endif
     uint32_t activity_detected;
+    uint32_t scene_activity;  // Video classification or touch
 } timestamps_t;
 
 
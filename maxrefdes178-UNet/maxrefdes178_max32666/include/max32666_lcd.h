@@ -61,6 +61,11 @@
 //-----------------------------------------------------------------------------
 int lcd_init(void);
 int lcd_drawImage(uint8_t *data);
+void lcd_mark_dirty(const uint8_t *buff, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+void lcd_mark_dirty_all(void);
+uint32_t lcd_get_generation(void);
+uint8_t *lcd_get_back_buffer(void);
+int lcd_swap_buffers(void);
 int lcd_backlight(int on, uint8_t level);
 int lcd_set_rotation(lcd_rotation_e lcd_rotation);
 int lcd_notification(uint16_t color, const char *notification);
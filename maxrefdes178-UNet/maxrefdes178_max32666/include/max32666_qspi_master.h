@@ -57,11 +57,16 @@
 int qspi_master_init(void);
 int qspi_master_video_tx_worker(void);
 int qspi_master_video_rx_worker(qspi_packet_type_e *qspi_packet_type_rx);
+int qspi_master_video_rx_wait(qspi_packet_type_e *qspi_packet_type_rx);
+int qspi_master_video_rx_idle(void);
 int qspi_master_audio_tx_worker(void);
 int qspi_master_audio_rx_worker(qspi_packet_type_e *qspi_packet_type_rx);
+int qspi_master_audio_rx_wait(qspi_packet_type_e *qspi_packet_type_rx);
 int qspi_master_send_video(uint8_t *data, uint32_t data_size, uint8_t data_type);
 int qspi_master_send_audio(uint8_t *data, uint32_t data_size, uint8_t data_type);
 int qspi_master_wait_video_int(void);
 int qspi_master_wait_audio_int(void);
+void qspi_master_video_ack(uint8_t packet_type);
+int qspi_master_video_ack_worker(void);
 
 #endif /* _MAX32666_QSPI_MASTER_H_ */
@@ -85,6 +85,7 @@
 
 #include "max32666_ble.h"
 #include "max32666_ble_queue.h"
+#include "max32666_ble_tx.h"
 #include "max32666_data.h"
 #include "max32666_debug.h"
 #include "maxrefdes178_definitions.h"
@@ -627,7 +628,7 @@ static void ble_send_mtu_change_response(void)
 
 static void ble_receive(uint16_t dataLen, uint8_t *data)
 {
-    ble_packet_container_t ble_packet_container;
+    ble_packet_container_t *ble_packet_container;
 
 //    PR_INFO("BLE RX %d", dataLen);
 //    for (int i = 0; i < dataLen; i++) {
@@ -635,15 +636,20 @@ static void ble_receive(uint16_t dataLen, uint8_t *data)
 //    }
 //    PR("\n");
 
-    if ((dataLen > sizeof(ble_packet_container.packet)) ||
-        (dataLen < sizeof(ble_packet_container.packet.packet_info))) {
+    if ((dataLen > sizeof(ble_packet_container->packet)) ||
+        (dataLen < sizeof(ble_packet_container->packet.packet_info))) {
         PR_ERROR("invalid packet size %u", dataLen);
         return;
     }
 
-    ble_packet_container.size = dataLen;
-    memcpy(&(ble_packet_container.packet), data, dataLen);
-    ble_queue_enq_rx(&ble_packet_container);
+    ble_packet_container = ble_queue_reserve_rx();
+    if (ble_packet_container) {
+        ble_packet_container->size = dataLen;
+        memcpy(&(ble_packet_container->packet), data, dataLen);
+        ble_queue_commit_rx();
+    } else {
+        PR_ERROR("ble rx queue full");
+    }
 
     device_status.ble_expected_rx_seq += 1;
     device_status.ble_expected_rx_seq %= BLE_PACKET_SEQ_MASK;
@@ -705,16 +711,10 @@ int ble_init(void)
 
 int ble_worker(void)
 {
-    ble_packet_container_t ble_packet_container;
-
     /* Run the WSF OS */
     wsfOsDispatcher();
 
-    if (ble_queue_deq_tx(&ble_packet_container) == E_SUCCESS) {
-        if (ble_send_indication(ble_packet_container.size, (uint8_t *) &(ble_packet_container.packet)) != E_SUCCESS) {
-            PR_ERROR("ble_send_indication failed");
-        }
-    }
+    ble_tx_worker();
 
     if (!device_settings.enable_ble) {
         PR_INFO("Disconnect BLE");
@@ -50,6 +50,7 @@
 #include "max32666_pmic.h"
 #include "max32666_timer_led_button.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_utility.h"
 
 
 //-----------------------------------------------------------------------------
@@ -57,6 +58,10 @@
 //-----------------------------------------------------------------------------
 #define S_MODULE_NAME   "comm"
 
+#if MAX32666_BLE_TX_WINDOW > MAX32666_BLE_QUEUE_SIZE
+#error "MAX32666_BLE_TX_WINDOW must not exceed MAX32666_BLE_QUEUE_SIZE"
+#endif
+
 
 //-----------------------------------------------------------------------------
 // Typedefs
@@ -78,50 +83,57 @@ typedef struct {
     uint8_t total_payload_buffer[MAX32666_BLE_COMMAND_BUFFER_SIZE];
 } ble_command_buffer_t;
 
+typedef struct {
+    uint32_t count;
+    ble_packet_container_t packets[MAX32666_BLE_COMMAND_PENDING];
+} ble_command_pending_t;
+
 
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 static ble_packet_container_t tmp_container;
-static ble_command_buffer_t ble_command_buffer;
+// Commands from the peer and responses to it are independent, a long response does not block new commands
+static ble_command_buffer_t ble_command_rx;
+static ble_command_buffer_t ble_command_tx;
+// Single packet responses held back until the running multi packet response is fully queued
+static ble_command_pending_t ble_command_pending;
 
 
 //-----------------------------------------------------------------------------
 // Local function declarations
 //-----------------------------------------------------------------------------
 static int ble_command_handle_rx(void);
-//static int ble_command_handle_tx(void);
+static int ble_command_handle_tx(void);
+static void ble_command_fill_single_packet(ble_packet_container_t *ble_packet_container, ble_command_e ble_command,
+        uint32_t payload_size, uint8_t *payload);
+static int ble_command_hold_single_packet(ble_command_e ble_command, uint32_t payload_size, uint8_t *payload);
+static int ble_command_release_pending(void);
 
 
 //-----------------------------------------------------------------------------
 // Function definitions
 //-----------------------------------------------------------------------------
-// TODO: handle small MTU, multiple packet cases
 int ble_command_send_single_packet(ble_command_e ble_command, uint32_t payload_size, uint8_t *payload)
 {
     int ret;
 
-    if (ble_command_buffer.command_state != BLE_COMMAND_STATE_IDLE) {
-        PR_ERROR("command state is not idle");
-        return E_BAD_STATE;
-    }
-
+    // Does not fit into one packet with the current MTU, stream it
     if (payload_size + sizeof(ble_command_packet_header_t) > device_status.ble_max_packet_size) {
-        PR_ERROR("command is bigger than ble max packet size %d %d",
-                payload_size + sizeof(ble_command_packet_header_t), device_status.ble_max_packet_size);
-        return E_BAD_PARAM;
+        return ble_command_send_multi_packet(ble_command, payload_size, payload);
     }
 
     if (payload_size > sizeof(tmp_container.packet.command_packet.payload)) {
         PR_ERROR("invalid command %d payload size %d", ble_command, payload_size);
         return E_BAD_PARAM;
     }
-    tmp_container.packet.command_packet.header.packet_info.type = BLE_PACKET_TYPE_COMMAND;
-    tmp_container.packet.command_packet.header.packet_info.seq = device_status.ble_next_tx_seq;
-    tmp_container.packet.command_packet.header.command = ble_command;
-    tmp_container.packet.command_packet.header.total_payload_size = payload_size;
-    memcpy(tmp_container.packet.command_packet.payload, payload, payload_size);
-    tmp_container.size = payload_size + sizeof(ble_command_packet_header_t);
+
+    // Payload packets of a running response must stay contiguous, queue behind them
+    if ((ble_command_tx.command_state == BLE_COMMAND_STATE_TX_RUNNING) || ble_command_pending.count) {
+        return ble_command_hold_single_packet(ble_command, payload_size, payload);
+    }
+
+    ble_command_fill_single_packet(&tmp_container, ble_command, payload_size, payload);
 
     ret = ble_queue_enq_tx(&tmp_container);
     if (ret != E_SUCCESS) {
@@ -132,52 +144,167 @@ int ble_command_send_single_packet(ble_command_e ble_command, uint32_t payload_s
     return ret;
 }
 
+static void ble_command_fill_single_packet(ble_packet_container_t *ble_packet_container, ble_command_e ble_command,
+        uint32_t payload_size, uint8_t *payload)
+{
+    // seq is stamped by core1 when the packet is sent
+    ble_packet_container->packet.command_packet.header.packet_info.type = BLE_PACKET_TYPE_COMMAND;
+    ble_packet_container->packet.command_packet.header.packet_info.seq = 0;
+    ble_packet_container->packet.command_packet.header.command = ble_command;
+    ble_packet_container->packet.command_packet.header.total_payload_size = payload_size;
+    memcpy(ble_packet_container->packet.command_packet.payload, payload, payload_size);
+    ble_packet_container->size = payload_size + sizeof(ble_command_packet_header_t);
+}
+
+static int ble_command_hold_single_packet(ble_command_e ble_command, uint32_t payload_size, uint8_t *payload)
+{
+    ble_packet_container_t *ble_packet_container = NULL;
+
+    // A newer response replaces a held one of the same command, the peer only needs the latest
+    for (uint32_t i = 0; i < ble_command_pending.count; i++) {
+        if (ble_command_pending.packets[i].packet.command_packet.header.command == ble_command) {
+            ble_packet_container = &ble_command_pending.packets[i];
+            break;
+        }
+    }
+
+    if (!ble_packet_container) {
+        if (ble_command_pending.count >= MAX32666_BLE_COMMAND_PENDING) {
+            PR_ERROR("ble pending queue full, command %d", ble_command);
+            return E_OVERFLOW;
+        }
+        ble_packet_container = &ble_command_pending.packets[ble_command_pending.count++];
+    }
+
+    ble_command_fill_single_packet(ble_packet_container, ble_command, payload_size, payload);
+
+    return E_SUCCESS;
+}
+
+static int ble_command_release_pending(void)
+{
+    uint32_t released;
+
+    for (released = 0; released < ble_command_pending.count; released++) {
+        if (ble_queue_enq_tx(&ble_command_pending.packets[released]) != E_SUCCESS) {
+            break;
+        }
+    }
+
+    if (released) {
+        ble_command_pending.count -= released;
+        memmove(ble_command_pending.packets, &ble_command_pending.packets[released],
+                ble_command_pending.count * sizeof(ble_packet_container_t));
+    }
+
+    return ble_command_pending.count ? E_BUSY : E_SUCCESS;
+}
+
+int ble_command_send_multi_packet(ble_command_e ble_command, uint32_t payload_size, uint8_t *payload)
+{
+    ble_packet_container_t *ble_packet_container;
+    uint32_t packet_payload_size;
+
+    if (ble_command_tx.command_state != BLE_COMMAND_STATE_IDLE) {
+        PR_DEBUG("tx busy, command %d", ble_command_tx.command);
+        return E_BUSY;
+    }
+
+    if (!device_status.ble_connected ||
+        (device_status.ble_max_packet_size <= sizeof(ble_command_packet_header_t))) {
+        PR_ERROR("ble is not ready %d", device_status.ble_max_packet_size);
+        return E_BAD_STATE;
+    }
+
+    if (payload_size > sizeof(ble_command_tx.total_payload_buffer)) {
+        PR_ERROR("invalid command %d payload size %d", ble_command, payload_size);
+        return E_BAD_PARAM;
+    }
+
+    // Held single packets were sent before this response, keep them ahead of it
+    if (ble_command_release_pending() != E_SUCCESS) {
+        return E_BUSY;
+    }
+
+    ble_packet_container = ble_queue_reserve_tx();
+    if (!ble_packet_container) {
+        PR_ERROR("ble tx queue full");
+        return E_OVERFLOW;
+    }
+
+    // Keep a copy so the caller buffer can be reused while the payload packets are streamed
+    memcpy(ble_command_tx.total_payload_buffer, payload, payload_size);
+    ble_command_tx.command = ble_command;
+    ble_command_tx.total_payload_size = payload_size;
+
+    // Command packet carries the total size and the first part of the payload
+    packet_payload_size = MIN(payload_size, device_status.ble_max_packet_size - sizeof(ble_command_packet_header_t));
+    packet_payload_size = MIN(packet_payload_size, sizeof(ble_packet_container->packet.command_packet.payload));
+
+    ble_packet_container->packet.command_packet.header.packet_info.type = BLE_PACKET_TYPE_COMMAND;
+    ble_packet_container->packet.command_packet.header.packet_info.seq = 0;
+    ble_packet_container->packet.command_packet.header.command = ble_command;
+    ble_packet_container->packet.command_packet.header.total_payload_size = payload_size;
+    memcpy(ble_packet_container->packet.command_packet.payload, ble_command_tx.total_payload_buffer,
+            packet_payload_size);
+    ble_packet_container->size = packet_payload_size + sizeof(ble_command_packet_header_t);
+    ble_queue_commit_tx();
+
+    ble_command_tx.transmitted_payload_size = packet_payload_size;
+    ble_command_tx.command_state = BLE_COMMAND_STATE_TX_RUNNING;
+
+    // Queue the first payload packets right away
+    ble_command_handle_tx();
+
+    return E_SUCCESS;
+}
+
 static int ble_command_execute_rx_command(void)
 {
-    PR_INFO("exec %d %d", ble_command_buffer.command,
-            ble_command_buffer.total_payload_size);
-//    for (int i = 0; i < ble_command_buffer.total_payload_size; i++) {
-//        PR("%02hhX ", ble_command_buffer.total_payload_buffer[i]);
+    PR_INFO("exec %d %d", ble_command_rx.command,
+            ble_command_rx.total_payload_size);
+//    for (int i = 0; i < ble_command_rx.total_payload_size; i++) {
+//        PR("%02hhX ", ble_command_rx.total_payload_buffer[i]);
 //    }
 //    PR("\n");
 
-    switch (ble_command_buffer.command) {
+    switch (ble_command_rx.command) {
     case BLE_COMMAND_GET_VERSION_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         ble_command_send_single_packet(BLE_COMMAND_GET_VERSION_RES,
             sizeof(device_info.device_version), (uint8_t *) &device_info.device_version);
         break;
     case BLE_COMMAND_GET_SERIAL_NUM_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         ble_command_send_single_packet(BLE_COMMAND_GET_SERIAL_NUM_RES,
             sizeof(device_info.device_serial_num), (uint8_t *) &device_info.device_serial_num);
         break;
     case BLE_COMMAND_FACEID_EMBED_UPDATE_CMD:
-        if ((ble_command_buffer.total_payload_size < FACEID_EMBEDDING_SIZE) ||
-            (ble_command_buffer.total_payload_size > FACEID_MAX_EMBEDDINGS_SIZE)) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if ((ble_command_rx.total_payload_size < FACEID_EMBEDDING_SIZE) ||
+            (ble_command_rx.total_payload_size > FACEID_MAX_EMBEDDINGS_SIZE)) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
-        qspi_master_send_video(ble_command_buffer.total_payload_buffer, ble_command_buffer.total_payload_size,
+        qspi_master_send_video(ble_command_rx.total_payload_buffer, ble_command_rx.total_payload_size,
                 QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_CMD);
         break;
     case BLE_COMMAND_DISABLE_BLE_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_ble = 0;
         lcd_notification(BLUE, "BLE disabled");
         break;
     case BLE_COMMAND_SHUT_DOWN_DEVICE_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         PR_INFO("shut down device");
@@ -187,8 +314,8 @@ static int ble_command_execute_rx_command(void)
         pmic_power_off();
         break;
     case BLE_COMMAND_RESTART_DEVICE_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         PR_INFO("restart device");
@@ -198,8 +325,8 @@ static int ble_command_execute_rx_command(void)
         pmic_hard_reset();
         break;
     case BLE_COMMAND_ENABLE_MAX78000_AUDIO_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_audio(NULL, 0, QSPI_PACKET_TYPE_AUDIO_ENABLE_CMD);
@@ -207,8 +334,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Audio enabled");
         break;
     case BLE_COMMAND_DISABLE_MAX78000_AUDIO_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_audio(NULL, 0, QSPI_PACKET_TYPE_AUDIO_DISABLE_CMD);
@@ -216,8 +343,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Audio disabled");
         break;
     case BLE_COMMAND_ENABLE_MAX78000_VIDEO_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
@@ -225,8 +352,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Video enabled");
         break;
     case BLE_COMMAND_DISABLE_MAX78000_VIDEO_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CMD);
@@ -234,8 +361,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Video disabled");
         break;
     case BLE_COMMAND_ENABLE_MAX78000_VIDEO_CNN_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD);
@@ -243,8 +370,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "FaceID enabled");
         break;
     case BLE_COMMAND_DISABLE_MAX78000_VIDEO_CNN_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CNN_CMD);
@@ -252,12 +379,12 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "FaceID disabled");
         break;
     case BLE_COMMAND_MAX78000_VIDEO_CAMERA_CLOCK_CMD:
-        if (ble_command_buffer.total_payload_size != 1) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 1) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
 
-        switch(ble_command_buffer.total_payload_buffer[0]) {
+        switch(ble_command_rx.total_payload_buffer[0]) {
         case CAMERA_CLOCK_5_MHZ:
             qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_CAMERA_CLOCK_5_MHZ_CMD);
             lcd_notification(MAGENTA, "Camera clock 5 MHz");
@@ -274,8 +401,8 @@ static int ble_command_execute_rx_command(void)
 
         break;
     case BLE_COMMAND_ENABLE_MAX78000_AUDIO_CNN_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_audio(NULL, 0, QSPI_PACKET_TYPE_AUDIO_ENABLE_CNN_CMD);
@@ -283,8 +410,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Audio CNN enabled");
         break;
     case BLE_COMMAND_DISABLE_MAX78000_AUDIO_CNN_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_audio(NULL, 0, QSPI_PACKET_TYPE_AUDIO_DISABLE_CNN_CMD);
@@ -292,8 +419,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Audio CNN disabled");
         break;
     case BLE_COMMAND_ENABLE_MAX78000_VIDEO_FLASH_LED_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_FLASH_LED_CMD);
@@ -301,8 +428,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Video flash LED enabled");
         break;
     case BLE_COMMAND_DISABLE_MAX78000_VIDEO_FLASH_LED_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_FLASH_LED_CMD);
@@ -310,8 +437,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Video flash LED disabled");
         break;
     case BLE_COMMAND_ENABLE_MAX78000_VIDEO_AUDIO_POWER:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         pmic_ldo1(1);
@@ -320,8 +447,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Video Audio power enabled");
         break;
     case BLE_COMMAND_DISABLE_MAX78000_VIDEO_AUDIO_POWER:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         pmic_buck2(0);
@@ -330,8 +457,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Video Audio power disabled");
         break;
     case BLE_COMMAND_ENABLE_LCD_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         if (device_settings.enable_max78000_video) {
@@ -341,8 +468,8 @@ static int ble_command_execute_rx_command(void)
         device_settings.enable_lcd = 1;
         break;
     case BLE_COMMAND_DISABLE_LCD_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         lcd_backlight(0, 0);
@@ -350,8 +477,8 @@ static int ble_command_execute_rx_command(void)
         device_settings.enable_lcd = 0;
         break;
     case BLE_COMMAND_ENABLE_LCD_STATISCTICS_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_lcd_statistics = 1;
@@ -359,76 +486,76 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "LCD statistics enabled");
         break;
     case BLE_COMMAND_DISABLE_LCD_STATISCTICS_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_lcd_statistics = 0;
         lcd_notification(MAGENTA, "LCD statistics disabled");
         break;
     case BLE_COMMAND_ENABLE_LCD_PROBABILITY_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_lcd_probabilty = 1;
         lcd_notification(MAGENTA, "LCD probability enabled");
         break;
     case BLE_COMMAND_DISABLE_LCD_PROBABILITY_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_lcd_probabilty = 0;
         lcd_notification(MAGENTA, "LCD probability disabled");
         break;
     case BLE_COMMAND_ENABLE_SEND_STATISTICS_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_ble_send_statistics = 1;
         break;
     case BLE_COMMAND_DISABLE_SEND_STATISTICS_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_ble_send_statistics = 0;
         break;
     case BLE_COMMAND_ENABLE_SEND_CLASSIFICATION_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_ble_send_classification = 1;
         break;
     case BLE_COMMAND_DISABLE_SEND_CLASSIFICATION_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_ble_send_classification = 0;
         break;
     case BLE_COMMAND_ENABLE_INACTIVITY_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_inactivity = 1;
         lcd_notification(MAGENTA, "Inactivity timer enabled");
         break;
     case BLE_COMMAND_DISABLE_INACTIVITY_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         device_settings.enable_inactivity = 0;
         lcd_notification(MAGENTA, "Inactivity timer disabled");
         break;
     case BLE_COMMAND_ENABLE_MAX78000_VIDEO_VFLIP_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_VFLIP_CMD);
@@ -436,8 +563,8 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Vertical flip enabled");
         break;
     case BLE_COMMAND_DISABLE_MAX78000_VIDEO_VFLIP_CMD:
-        if (ble_command_buffer.total_payload_size != 0) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 0) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
         qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_VFLIP_CMD);
@@ -445,11 +572,11 @@ static int ble_command_execute_rx_command(void)
         lcd_notification(MAGENTA, "Vertical flip disabled");
         break;
     case BLE_COMMAND_SET_DEBUGGER_CMD:
-        if (ble_command_buffer.total_payload_size != 1) {
-            PR_ERROR("invalid total payload size %d", ble_command_buffer.total_payload_size);
+        if (ble_command_rx.total_payload_size != 1) {
+            PR_ERROR("invalid total payload size %d", ble_command_rx.total_payload_size);
             return E_BAD_PARAM;
         }
-        expander_select_debugger((debugger_select_e)ble_command_buffer.total_payload_buffer[0]);
+        expander_select_debugger((debugger_select_e)ble_command_rx.total_payload_buffer[0]);
         break;
     default:
         PR_ERROR("Unknwon command");
@@ -497,7 +624,7 @@ static int ble_command_handle_rx(void)
         }
 
         // Check state
-        if (ble_command_buffer.command_state != BLE_COMMAND_STATE_IDLE) {
+        if (ble_command_rx.command_state != BLE_COMMAND_STATE_IDLE) {
             PR_ERROR("command packet is not expected");
             return E_BAD_STATE;
         }
@@ -515,48 +642,48 @@ static int ble_command_handle_rx(void)
             return E_BAD_PARAM;
         }
 
-        ble_command_buffer.command = tmp_container.packet.command_packet.header.command;
-        ble_command_buffer.total_payload_size = tmp_container.packet.command_packet.header.total_payload_size;
-        ble_command_buffer.received_payload_size = packet_payload_size;
-        ble_command_buffer.command_state = BLE_COMMAND_STATE_RX_RUNNING;
-        memcpy(ble_command_buffer.total_payload_buffer, tmp_container.packet.command_packet.payload,
+        ble_command_rx.command = tmp_container.packet.command_packet.header.command;
+        ble_command_rx.total_payload_size = tmp_container.packet.command_packet.header.total_payload_size;
+        ble_command_rx.received_payload_size = packet_payload_size;
+        ble_command_rx.command_state = BLE_COMMAND_STATE_RX_RUNNING;
+        memcpy(ble_command_rx.total_payload_buffer, tmp_container.packet.command_packet.payload,
                 packet_payload_size);
 
         // Check if single packet command
-        if (ble_command_buffer.total_payload_size <= ble_command_buffer.received_payload_size) {
-            ble_command_buffer.command_state = BLE_COMMAND_STATE_IDLE;
+        if (ble_command_rx.total_payload_size <= ble_command_rx.received_payload_size) {
+            ble_command_rx.command_state = BLE_COMMAND_STATE_IDLE;
             ble_command_execute_rx_command();
         }
 
         return E_SUCCESS;
     } else if (tmp_container.packet.packet_info.type == BLE_PACKET_TYPE_PAYLOAD) {
         packet_payload_size = tmp_container.size - sizeof(ble_payload_packet_header_t);
-        PR_INFO("P %d (%d/%d): ", packet_payload_size, ble_command_buffer.received_payload_size,
-                ble_command_buffer.total_payload_size);
+        PR_INFO("P %d (%d/%d): ", packet_payload_size, ble_command_rx.received_payload_size,
+                ble_command_rx.total_payload_size);
 //        for (int i = 0; i < packet_payload_size; i++) {
 //            PR("%02hhX ", tmp_container.packet.payload_packet.payload[i]);
 //        }
 //        PR("\n");
 
         // Check state
-        if (ble_command_buffer.command_state != BLE_COMMAND_STATE_RX_RUNNING) {
+        if (ble_command_rx.command_state != BLE_COMMAND_STATE_RX_RUNNING) {
             PR_ERROR("payload packet is not expected");
             return E_BAD_STATE;
         }
 
-        if (ble_command_buffer.received_payload_size + packet_payload_size > MAX32666_BLE_COMMAND_BUFFER_SIZE) {
+        if (ble_command_rx.received_payload_size + packet_payload_size > MAX32666_BLE_COMMAND_BUFFER_SIZE) {
             PR_ERROR("payload overflow");
             return E_OVERFLOW;
         }
 
-        memcpy(&ble_command_buffer.total_payload_buffer[ble_command_buffer.received_payload_size],
+        memcpy(&ble_command_rx.total_payload_buffer[ble_command_rx.received_payload_size],
                 tmp_container.packet.payload_packet.payload, packet_payload_size);
 
-        ble_command_buffer.received_payload_size += packet_payload_size;
+        ble_command_rx.received_payload_size += packet_payload_size;
 
         // Check if payload receive is completed
-        if (ble_command_buffer.total_payload_size <= ble_command_buffer.received_payload_size) {
-            ble_command_buffer.command_state = BLE_COMMAND_STATE_IDLE;
+        if (ble_command_rx.total_payload_size <= ble_command_rx.received_payload_size) {
+            ble_command_rx.command_state = BLE_COMMAND_STATE_IDLE;
             ble_command_execute_rx_command();
         }
 
@@ -566,20 +693,64 @@ static int ble_command_handle_rx(void)
     return E_SUCCESS;
 }
 
-//static int ble_command_handle_tx(void)
-//{
-//    // BLE TX, check new packet to enqueue ble tx queue
-//    if (ble_command_buffer.command_state != BLE_COMMAND_STATE_TX_RUNNING) {
-//        return E_NO_ERROR;
-//    }
-//    // TODO
-//
-//    return E_SUCCESS;
-//}
+static int ble_command_handle_tx(void)
+{
+    ble_packet_container_t *ble_packet_container;
+    uint32_t packet_payload_size;
+
+    // Core1 gave up on a packet, the rest of the queued packets can not be appended by the peer
+    if (device_status.ble_tx_aborted) {
+        PR_ERROR("ble tx aborted, command %d %d/%d", ble_command_tx.command,
+                ble_command_tx.transmitted_payload_size, ble_command_tx.total_payload_size);
+        ble_queue_flush();
+        ble_command_tx.command_state = BLE_COMMAND_STATE_IDLE;
+        device_status.ble_tx_aborted = 0;
+        return E_COMM_ERR;
+    }
+
+    // BLE TX, check new packet to enqueue ble tx queue
+    if (ble_command_tx.command_state != BLE_COMMAND_STATE_TX_RUNNING) {
+        return ble_command_release_pending();
+    }
+
+    while (ble_command_tx.transmitted_payload_size < ble_command_tx.total_payload_size) {
+        // Keep at most MAX32666_BLE_TX_WINDOW packets ahead of core1
+        if (ble_queue_count_tx() >= MAX32666_BLE_TX_WINDOW) {
+            return E_BUSY;
+        }
+
+        ble_packet_container = ble_queue_reserve_tx();
+        if (!ble_packet_container) {
+            return E_BUSY;
+        }
+
+        // Packets are sized with the MTU at enqueue time, core1 splits them if it shrinks later
+        packet_payload_size = MIN(ble_command_tx.total_payload_size - ble_command_tx.transmitted_payload_size,
+                device_status.ble_max_packet_size - sizeof(ble_payload_packet_header_t));
+        packet_payload_size = MIN(packet_payload_size, sizeof(ble_packet_container->packet.payload_packet.payload));
+
+        ble_packet_container->packet.payload_packet.header.packet_info.type = BLE_PACKET_TYPE_PAYLOAD;
+        ble_packet_container->packet.payload_packet.header.packet_info.seq = 0;
+        memcpy(ble_packet_container->packet.payload_packet.payload,
+                &ble_command_tx.total_payload_buffer[ble_command_tx.transmitted_payload_size],
+                packet_payload_size);
+        ble_packet_container->size = packet_payload_size + sizeof(ble_payload_packet_header_t);
+        ble_queue_commit_tx();
+
+        ble_command_tx.transmitted_payload_size += packet_payload_size;
+    }
+
+    PR_DEBUG("tx completed %d %d", ble_command_tx.command, ble_command_tx.total_payload_size);
+    ble_command_tx.command_state = BLE_COMMAND_STATE_IDLE;
+
+    return ble_command_release_pending();
+}
 
 int ble_command_reset(void)
 {
-    ble_command_buffer.command_state = BLE_COMMAND_STATE_IDLE;
+    ble_command_rx.command_state = BLE_COMMAND_STATE_IDLE;
+    ble_command_tx.command_state = BLE_COMMAND_STATE_IDLE;
+    ble_command_pending.count = 0;
 
     // TODO close open files
 
@@ -589,7 +760,7 @@ int ble_command_reset(void)
 int ble_command_worker(void)
 {
     ble_command_handle_rx();
-//    ble_command_handle_tx();
+    ble_command_handle_tx();
 
     return E_SUCCESS;
 }
@@ -40,8 +40,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "max32666_data.h"
 #include "max32666_fonts.h"
+#include "max32666_lcd.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_glyph_cache.h"
+#include "maxrefdes178_utility.h"
 
 
 //-----------------------------------------------------------------------------
@@ -359,18 +363,25 @@ const FontDef Font_16x26 = {16, 26, Font16x26};
 //-----------------------------------------------------------------------------
 // Local function declarations
 //-----------------------------------------------------------------------------
-static void fonts_putChar(uint16_t x, uint16_t y, char ch, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff);
+static void fonts_putChar(uint16_t x, uint16_t y, char ch, const FontDef *font, const glyph_font_t *glyphs, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff);
 
 
 //-----------------------------------------------------------------------------
 // Function definitions
 //-----------------------------------------------------------------------------
-static void fonts_putChar(uint16_t x, uint16_t y, char ch, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff)
+static void fonts_putChar(uint16_t x, uint16_t y, char ch, const FontDef *font, const glyph_font_t *glyphs, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff)
 {
     uint32_t i, b, j, pos;
 
     uint16_t *p = (uint16_t *) buff;
 
+    lcd_mark_dirty(buff, x, y, x + font->width - 1, y + font->height - 1);
+
+    if (glyphs) {
+        glyph_cache_put_char(p, x, y, glyphs, ch, __builtin_bswap16(color), bg, __builtin_bswap16(bgcolor));
+        return;
+    }
+
     for (i = 0; i < font->height; i++) {
         b = font->data[(ch - 32) * font->height + i];
         for (j = 0; j < font->width; j++) {
@@ -391,6 +402,18 @@ static void fonts_putChar(uint16_t x, uint16_t y, char ch, const FontDef *font,
 
 void fonts_putString(uint16_t x, uint16_t y, const char *str, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff)
 {
+    const glyph_font_t *glyphs = glyph_cache_font(font->data, font->width, font->height);
+
+    // Overlays are drawn again on every refresh, text still in the front buffer is skipped.
+    // A single buffer also receives the frames, so it can be overwritten any time.
+    if (glyphs && (buff == lcd_data.buffer) && (lcd_data.buffer != lcd_data.back_buffer)) {
+        if (glyph_cache_text_check(buff, x, y, glyphs, color, bg, bgcolor, str, lcd_get_generation())) {
+            return;
+        }
+    } else {
+        glyph_cache_text_invalidate(buff, 0, y, LCD_WIDTH - 1, LCD_HEIGHT - 1);
+    }
+
     while (*str) {
         if (x + font->width >= LCD_WIDTH) {
             x = 0;
@@ -405,7 +428,7 @@ void fonts_putString(uint16_t x, uint16_t y, const char *str, const FontDef *fon
                 continue;
             }
         }
-        fonts_putChar(x, y, *str, font, color, bg, bgcolor, buff);
+        fonts_putChar(x, y, *str, font, glyphs, color, bg, bgcolor, buff);
         x += font->width;
         str++;
     }
@@ -432,6 +455,9 @@ void fonts_drawLine(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, uint16_t
     uint32_t pos;
     uint16_t *p = (uint16_t *) buff;
 
+    lcd_mark_dirty(buff, MIN(x0, x1), MIN(y0, y1), MAX(x0, x1), MAX(y0, y1));
+    glyph_cache_text_invalidate(buff, MIN(x0, x1), MIN(y0, y1), MAX(x0, x1), MAX(y0, y1));
+
     if (steep) {
         swap = x0;
         x0 = y0;
@@ -39,6 +39,7 @@
 //-----------------------------------------------------------------------------
 #include <gpio.h>
 #include <mxc_delay.h>
+#include <string.h>
 
 #include "max32666_data.h"
 #include "max32666_debug.h"
@@ -48,6 +49,8 @@
 #include "max32666_spi_dma.h"
 #include "max32666_timer_led_button.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_scheduler.h"
+#include "maxrefdes178_trace.h"
 #include "maxrefdes178_utility.h"
 
 
@@ -95,10 +98,22 @@
 #define ST7789_RDID3   0xDC
 #define ST7789_RDID4   0xDD
 
+// Dirty region tracking
+#define LCD_DIRTY_REGION_MAX      8
+#define LCD_DIRTY_MERGE_SLACK     64    // pixels, cost of an extra address window
+#define LCD_DIRTY_FULL_AREA       (LCD_WIDTH * LCD_HEIGHT / 2)
+#define LCD_STAGING_ROWS          32
+
 
 //-----------------------------------------------------------------------------
 // Typedefs
 //-----------------------------------------------------------------------------
+typedef struct {
+    uint16_t x1;
+    uint16_t y1;
+    uint16_t x2;
+    uint16_t y2;
+} lcd_region_t;
 
 
 //-----------------------------------------------------------------------------
@@ -109,6 +124,13 @@ static const mxc_gpio_cfg_t lcd_cs_pin = MAX32666_LCD_CS_PIN;
 static uint8_t lcd_x_shift = 0;
 static uint8_t lcd_y_shift = 0;
 
+// Regions of lcd_data.buffer changed since the last transfer
+static lcd_region_t lcd_dirty_regions[LCD_DIRTY_REGION_MAX];
+static int lcd_dirty_count = 0;
+static int lcd_dirty_all = 1;
+static uint32_t lcd_generation = 0;  // Incremented when lcd_data.buffer is replaced
+static uint8_t lcd_staging_buffer[LCD_WIDTH * LCD_STAGING_ROWS * LCD_BYTE_PER_PIXEL];
+
 
 //-----------------------------------------------------------------------------
 // Local function declarations
@@ -121,6 +143,10 @@ static int lcd_configure(void);
 static int lcd_setAddrWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1);
 static void spi_assert_cs(void);
 static void spi_deassert_cs(void);
+static void lcd_dma_done(void);
+static uint32_t lcd_region_area(const lcd_region_t *region);
+static void lcd_region_union(lcd_region_t *dst, const lcd_region_t *src);
+static void lcd_drawRegion(const lcd_region_t *region, int last);
 
 
 //-----------------------------------------------------------------------------
@@ -143,6 +169,14 @@ static void spi_deassert_cs(void)
     GPIO_SET(lcd_cs_pin);
 }
 
+// Completion of the last frame DMA, runs in DMA interrupt
+static void lcd_dma_done(void)
+{
+    spi_deassert_cs();
+    TRACE_EVENT(TRACE_EVENT_LCD_DMA_END, 0);
+    scheduler_post(MAX32666_EVENT_LCD);
+}
+
 static int lcd_sendCommand(uint8_t command)
 {
     GPIO_CLR(lcd_dc_pin);
@@ -313,6 +347,8 @@ int lcd_set_rotation(lcd_rotation_e lcd_rotation)
 
     spi_deassert_cs();
 
+    lcd_mark_dirty_all();
+
     return E_NO_ERROR;
 }
 
@@ -327,10 +363,144 @@ int lcd_backlight(int on, uint8_t level)
     return E_NO_ERROR;
 }
 
+static uint32_t lcd_region_area(const lcd_region_t *region)
+{
+    return (region->x2 - region->x1 + 1) * (region->y2 - region->y1 + 1);
+}
+
+static void lcd_region_union(lcd_region_t *dst, const lcd_region_t *src)
+{
+    dst->x1 = MIN(dst->x1, src->x1);
+    dst->y1 = MIN(dst->y1, src->y1);
+    dst->x2 = MAX(dst->x2, src->x2);
+    dst->y2 = MAX(dst->y2, src->y2);
+}
+
+/**
+ * @brief Record a changed area of lcd_data.buffer, ignored for other buffers
+ * @param buff -> buffer that was drawn
+ * @param xi&yi -> corners of the changed area, inclusive
+ * @return none
+ */
+void lcd_mark_dirty(const uint8_t *buff, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+    lcd_region_t region;
+    int merged;
+
+    if ((buff != lcd_data.buffer) || lcd_dirty_all) {
+        return;
+    }
+
+    if ((x1 >= LCD_WIDTH) || (y1 >= LCD_HEIGHT) || (x1 > x2) || (y1 > y2)) {
+        return;
+    }
+
+    region.x1 = x1;
+    region.y1 = y1;
+    region.x2 = MIN(x2, LCD_WIDTH - 1);
+    region.y2 = MIN(y2, LCD_HEIGHT - 1);
+
+    // Merge with existing regions as long as the union does not cost more than separate windows
+    do {
+        merged = 0;
+        for (int i = 0; i < lcd_dirty_count; i++) {
+            lcd_region_t candidate = lcd_dirty_regions[i];
+
+            lcd_region_union(&candidate, &region);
+            if (lcd_region_area(&candidate) <= (lcd_region_area(&lcd_dirty_regions[i]) +
+                    lcd_region_area(&region) + LCD_DIRTY_MERGE_SLACK)) {
+                region = candidate;
+                lcd_dirty_regions[i] = lcd_dirty_regions[--lcd_dirty_count];
+                merged = 1;
+                break;
+            }
+        }
+    } while (merged);
+
+    if (lcd_dirty_count == LCD_DIRTY_REGION_MAX) {
+        // No free slot, fold into the region that grows the least
+        int best = 0;
+        uint32_t best_growth = UINT32_MAX;
+
+        for (int i = 0; i < lcd_dirty_count; i++) {
+            lcd_region_t candidate = lcd_dirty_regions[i];
+
+            lcd_region_union(&candidate, &region);
+            if ((lcd_region_area(&candidate) - lcd_region_area(&lcd_dirty_regions[i])) < best_growth) {
+                best_growth = lcd_region_area(&candidate) - lcd_region_area(&lcd_dirty_regions[i]);
+                best = i;
+            }
+        }
+        lcd_region_union(&lcd_dirty_regions[best], &region);
+        return;
+    }
+
+    lcd_dirty_regions[lcd_dirty_count++] = region;
+}
+
+void lcd_mark_dirty_all(void)
+{
+    lcd_dirty_all = 1;
+    lcd_dirty_count = 0;
+    lcd_generation++;
+}
+
+/**
+ * @brief Content generation of lcd_data.buffer, drawings of an older generation are gone
+ * @return generation
+ */
+uint32_t lcd_get_generation(void)
+{
+    return lcd_generation;
+}
+
+/**
+ * @brief Send a region of lcd_data.buffer, rows are packed to the staging buffer if the
+ *        region is narrower than the screen
+ * @param region -> area to send
+ * @param last -> last region, leave the DMA running and release CS from its callback
+ * @return none
+ */
+static void lcd_drawRegion(const lcd_region_t *region, int last)
+{
+    uint16_t w = region->x2 - region->x1 + 1;
+    uint16_t rows_per_chunk = (w == LCD_WIDTH) ? LCD_HEIGHT : (LCD_STAGING_ROWS * LCD_WIDTH / w);
+    uint16_t rows;
+    uint8_t *data;
+
+    for (uint16_t y = region->y1; y <= region->y2; y += rows) {
+        rows = MIN(rows_per_chunk, region->y2 - y + 1);
+
+        if (w == LCD_WIDTH) {
+            // Full rows are contiguous in the frame buffer
+            data = &lcd_data.buffer[y * LCD_WIDTH * LCD_BYTE_PER_PIXEL];
+        } else {
+            data = lcd_staging_buffer;
+            for (uint16_t i = 0; i < rows; i++) {
+                memcpy(&lcd_staging_buffer[i * w * LCD_BYTE_PER_PIXEL],
+                       &lcd_data.buffer[((y + i) * LCD_WIDTH + region->x1) * LCD_BYTE_PER_PIXEL],
+                       w * LCD_BYTE_PER_PIXEL);
+            }
+        }
+
+        lcd_setAddrWindow(region->x1, y, region->x2, y + rows - 1);
+
+        GPIO_SET(lcd_dc_pin);
+        spi_assert_cs();
+
+        if (last && ((y + rows) > region->y2)) {
+            spi_dma(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI, data, NULL, (w * rows * LCD_BYTE_PER_PIXEL), MAX32666_LCD_DMA_REQSEL_SPITX, lcd_dma_done);
+        } else {
+            spi_dma(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI, data, NULL, (w * rows * LCD_BYTE_PER_PIXEL), MAX32666_LCD_DMA_REQSEL_SPITX, NULL);
+            spi_dma_wait(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI);
+            spi_deassert_cs();
+        }
+    }
+}
+
 /**
  * @brief Draw an Image on the screen
- * @param x&y -> start point of the Image
- * @param w&h -> width & height of the Image to Draw
+ *        For lcd_data.buffer only the regions marked dirty since the last call are sent
  * @param data -> pointer of the Image array
  * @return none
  */
@@ -340,18 +510,45 @@ int lcd_drawImage(uint8_t *data)
     static const uint16_t y = 0;
     static const uint16_t w = LCD_WIDTH;
     static const uint16_t h = LCD_HEIGHT;
+    uint32_t dirty_area = 0;
 
     if (spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
         PR_WARN("lcd spi busy");
         return E_BUSY;
     }
 
+    if ((data == lcd_data.buffer) && !lcd_dirty_all) {
+        for (int i = 0; i < lcd_dirty_count; i++) {
+            dirty_area += lcd_region_area(&lcd_dirty_regions[i]);
+        }
+
+        if (dirty_area < LCD_DIRTY_FULL_AREA) {
+            TRACE_EVENT(TRACE_EVENT_LCD_DMA_START, lcd_dirty_count);
+            for (int i = 0; i < lcd_dirty_count; i++) {
+                lcd_drawRegion(&lcd_dirty_regions[i], i == (lcd_dirty_count - 1));
+            }
+            lcd_dirty_count = 0;
+            lcd_data.refresh_screen = 0;
+
+            return E_NO_ERROR;
+        }
+    }
+
+    // Screen shows another image, lcd_data.buffer has to be sent completely next time
+    if (data == lcd_data.buffer) {
+        lcd_dirty_all = 0;
+        lcd_dirty_count = 0;
+    } else {
+        lcd_mark_dirty_all();
+    }
+
     lcd_setAddrWindow(x, y, x + w - 1, y + h - 1);
 
     GPIO_SET(lcd_dc_pin);
     spi_assert_cs();
 
-    spi_dma(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI, data, NULL, (w * h * LCD_BYTE_PER_PIXEL), MAX32666_LCD_DMA_REQSEL_SPITX, spi_deassert_cs);
+    TRACE_EVENT(TRACE_EVENT_LCD_DMA_START, 0);
+    spi_dma(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI, data, NULL, (w * h * LCD_BYTE_PER_PIXEL), MAX32666_LCD_DMA_REQSEL_SPITX, lcd_dma_done);
 
     lcd_data.refresh_screen = 0;
 
@@ -362,6 +559,38 @@ int lcd_drawImage(uint8_t *data)
     return E_NO_ERROR;
 }
 
+/**
+ * @brief Back buffer for the next video frame, called from QSPI interrupt when a frame starts
+ *        A pending frame that was not shown yet is dropped in favor of the newer one
+ * @return buffer to receive into
+ */
+uint8_t *lcd_get_back_buffer(void)
+{
+    lcd_data.frame_pending = 0;
+
+    return lcd_data.back_buffer;
+}
+
+/**
+ * @brief Make the received frame the front buffer, LCD DMA and video QSPI must be idle
+ * @return none
+ */
+int lcd_swap_buffers(void)
+{
+#if MAX32666_LCD_DOUBLE_BUFFER
+    uint8_t *front = lcd_data.buffer;
+
+    lcd_data.buffer = lcd_data.back_buffer;
+    lcd_data.back_buffer = front;
+#endif
+
+    lcd_data.frame_pending = 0;
+    lcd_mark_dirty_all();
+    lcd_data.refresh_screen = 1;
+
+    return E_NO_ERROR;
+}
+
 int lcd_notification(uint16_t color, const char *notification)
 {
     snprintf(lcd_data.notification, sizeof(lcd_data.notification) - 1, notification);
@@ -379,6 +608,11 @@ int lcd_init(void)
 {
     int ret;
 
+    // With single buffering frames are received into the displayed buffer
+    lcd_data.buffer = lcd_data.frame_buffer[0];
+    lcd_data.back_buffer = lcd_data.frame_buffer[MAX32666_LCD_DOUBLE_BUFFER];
+    lcd_data.frame_pending = 0;
+
     lcd_backlight(1, MAX32666_LCD_BACKLIGHT_HIGH);
 
     spi_deassert_cs();
@@ -72,6 +72,10 @@
 #include "max32666_touch.h"
 #include "max32666_usb.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_governor.h"
+#include "maxrefdes178_scheduler.h"
+#include "maxrefdes178_trace.h"
+#include "maxrefdes178_unet_mask.h"
 #include "maxrefdes178_version.h"
 
 
@@ -84,9 +88,11 @@
 //-----------------------------------------------------------------------------
 // Typedefs
 //-----------------------------------------------------------------------------
-#define ALPHA  0.35  // alpha value for overlaid mask
+#define MASK_INTENSITY  0x7f  // mask colour channel value
 
-#define BRG(r,g,b)  (((r&0xF8)<<8)|((g&0xFC)<<3)|((b&0xF8)>>3)) //5 red | 6 green | 5 blue
+// alpha value for overlaid mask, UNET_MASK_ALPHA_OPAQUE replaces the camera frame
+#define MASK_ALPHA      (UNET_MASK_ALPHA_OPAQUE * 35 / 100)
+//#define MASK_ALPHA      UNET_MASK_ALPHA_OPAQUE
 
 //-----------------------------------------------------------------------------
 // Global variables
@@ -99,8 +105,8 @@ static char mac_string[(sizeof(device_info.ble_mac) + 1) * 3] = {0};
 static uint16_t video_string_color;
 static uint16_t video_frame_color;
 static uint16_t audio_string_color;
+static uint16_t mask_palette[UNET_MASK_CLASS_COUNT];
 
-uint16_t mask_data[LCD_WIDTH * LCD_HEIGHT];
 //-----------------------------------------------------------------------------
 // Local function declarations
 //-----------------------------------------------------------------------------
@@ -109,9 +115,17 @@ static void core1_irq_init(void);
 static void core0_icc(int enable);
 static void core1_icc(int enable);
 static void run_application(void);
+static void qspi_task(void);
+static void display_task(void);
+static void input_task(void);
+static void status_task(void);
+static void led_task(void);
+static void pmic_task(void);
 static int refresh_screen(void);
-
-static void update_mask(uint32_t mask);
+static void draw_mask(void);
+#ifdef ENABLE_TRACE
+static void send_trace_dump(void);
+#endif
 
 //-----------------------------------------------------------------------------
 // Function definitions
@@ -329,7 +343,7 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD);
             qspi_master_wait_video_int();
-            qspi_master_video_rx_worker(&qspi_packet_type_rx);
+            qspi_master_video_rx_wait(&qspi_packet_type_rx);
             if (device_status.faceid_embed_subject_names_size) {
                 break;
             }
@@ -338,7 +352,7 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_VERSION_CMD);
             qspi_master_wait_video_int();
-            qspi_master_video_rx_worker(&qspi_packet_type_rx);
+            qspi_master_video_rx_wait(&qspi_packet_type_rx);
             if (device_info.device_version.max78000_video.major || device_info.device_version.max78000_video.minor) {
                 break;
             }
@@ -346,7 +360,7 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_audio(NULL, 0, QSPI_PACKET_TYPE_AUDIO_VERSION_CMD);
             qspi_master_wait_audio_int();
-            qspi_master_audio_rx_worker(&qspi_packet_type_rx);
+            qspi_master_audio_rx_wait(&qspi_packet_type_rx);
             if (device_info.device_version.max78000_audio.major || device_info.device_version.max78000_audio.minor) {
                 break;
             }
@@ -355,7 +369,7 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DEMO_NAME_CMD);
             qspi_master_wait_video_int();
-            qspi_master_video_rx_worker(&qspi_packet_type_rx);
+            qspi_master_video_rx_wait(&qspi_packet_type_rx);
             if (device_info.max78000_video_demo_name[0]) {
                 break;
             }
@@ -363,12 +377,17 @@ int main(void)
         for (int try = 0; try < 3; try++) {
             qspi_master_send_audio(NULL, 0, QSPI_PACKET_TYPE_AUDIO_DEMO_NAME_CMD);
             qspi_master_wait_audio_int();
-            qspi_master_audio_rx_worker(&qspi_packet_type_rx);
+            qspi_master_audio_rx_wait(&qspi_packet_type_rx);
             if (device_info.max78000_audio_demo_name[0]) {
                 break;
             }
         }
 
+        // Video firmware without compression support keeps sending raw frames
+        if (device_settings.enable_max78000_video_compression) {
+            qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_COMPRESSION_CMD);
+        }
+
         ret = E_NO_ERROR;
         // Check video and audio fw version
         if (!(device_info.device_version.max78000_video.major || device_info.device_version.max78000_video.minor)) {
@@ -421,7 +440,8 @@ int main(void)
                 expander_worker();
 
                 if (lcd_data.refresh_screen && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
-                    memcpy(lcd_data.buffer, adi_logo, sizeof(lcd_data.buffer));
+                    memcpy(lcd_data.buffer, adi_logo, LCD_DATA_SIZE);
+                    lcd_mark_dirty_all();
                     if (strlen(lcd_data.notification) < (LCD_WIDTH / Font_11x18.width)) {
                         fonts_putStringCentered(LCD_HEIGHT - Font_11x18.height - 3, lcd_data.notification, &Font_11x18, lcd_data.notification_color, lcd_data.buffer);
                     } else {
@@ -433,6 +453,8 @@ int main(void)
         }
     }
 
+    TRACE_INIT(TRACE_SOURCE_MAX32666);
+
     PR_INFO("core 0 init completed");
 
     // print application name
@@ -446,290 +468,404 @@ int main(void)
 
 static void run_application(void)
 {
-    qspi_packet_type_e qspi_packet_type_rx = 0;
+    // Tasks in priority order, the frame path first
+    static scheduler_task_t tasks[] = {
+        {.handler = qspi_task,    .events = MAX32666_EVENT_QSPI,  .period = MAX32666_QSPI_POLL_INTERVAL},
+        {.handler = display_task, .events = MAX32666_EVENT_LCD,   .period = MAX32666_LCD_POLL_INTERVAL},
+        {.handler = input_task,   .events = MAX32666_EVENT_INPUT, .period = 0},
+        {.handler = status_task,  .events = 0,                    .period = MAX32666_STATUS_INTERVAL},
+        {.handler = led_task,     .events = 0,                    .period = MAX32666_LED_INTERVAL},
+        {.handler = pmic_task,    .events = 0,                    .period = MAX32666_PMIC_INTERVAL},
+    };
+
     video_frame_color = WHITE;
-    uint16_t touch_x1, touch_y1;
+    unet_mask_palette(mask_palette, MASK_INTENSITY);
 
     core0_icc(1);
 
+    if (scheduler_init(tasks, sizeof(tasks) / sizeof(tasks[0]), timer_ms_tick)) {
+        PR_ERROR("scheduler_init failed");
+    }
 
     // Main application loop
     while (1) {
+        // Run the highest priority ready task, sleep until an interrupt when none is ready.
+        // The ms timer wakes the core at least every ms.
+        if (!scheduler_dispatch(timer_ms_tick)) {
+            __WFI();
+        }
+    }
+}
 
-        // Handle Video QSPI RX
-        if (qspi_master_video_rx_worker(&qspi_packet_type_rx) == E_NO_ERROR) {
-            switch(qspi_packet_type_rx) {
-            case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
-                timestamps.video_data_received = timer_ms_tick;
-                lcd_data.refresh_screen = 1;
-                break;
+// Video and audio QSPI, on slave interrupts and QSPI DMA completion
+static void qspi_task(void)
+{
+    qspi_packet_type_e qspi_packet_type_rx = 0;
+
+    // Handle Video QSPI RX
+    if (qspi_master_video_rx_worker(&qspi_packet_type_rx) == E_NO_ERROR) {
+        switch(qspi_packet_type_rx) {
+        case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
+            timestamps.video_data_received = timer_ms_tick;
+            break;
 				
-			case QSPI_PACKET_TYPE_VIDEO_ML_RES: // show ML Mask
-				update_mask(0x7f);
-                timestamps.video_data_received = timer_ms_tick;
-                lcd_data.refresh_screen = 1;
-                break;
+        case QSPI_PACKET_TYPE_VIDEO_UNET_MASK_RES: // drawn on the next frame
+            timestamps.mask_received = timer_ms_tick;
+            lcd_data.mask_valid = 1;
+            lcd_data.mask_pending = 1;
+            break;
 				
-            case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
-                timestamps.activity_detected = timer_ms_tick;
-                if (device_status.classification_video.classification == CLASSIFICATION_UNKNOWN) {
-                    video_string_color = RED;
-                    video_frame_color = RED;
-                } else if (device_status.classification_video.classification == CLASSIFICATION_LOW_CONFIDENCE) {
-                    video_string_color = YELLOW;
-                    video_frame_color = YELLOW;
-                } else if (device_status.classification_video.classification == CLASSIFICATION_DETECTED) {
-                    video_string_color = GREEN;
-                    video_frame_color = GREEN;
-                } else if (device_status.classification_video.classification == CLASSIFICATION_NOTHING) {
-                    video_frame_color = WHITE;
-                }
-
-//                if (device_settings.enable_ble_send_classification && device_status.ble_connected) {
-//                    ble_command_send_single_packet(BLE_COMMAND_GET_MAX78000_VIDEO_CLASSIFICATION_RES,
-//                        sizeof(device_status.classification_video), (uint8_t *) &device_status.classification_video);
-//                }
-                break;
-            case QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_RES:
-//                if (device_status.ble_connected) {
-//                    ble_command_send_single_packet(BLE_COMMAND_FACEID_EMBED_UPDATE_RES,
-//                        sizeof(device_status.faceid_embed_update_status), (uint8_t *) &device_status.faceid_embed_update_status);
-//                }
-                qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD);
-                lcd_notification(GREEN, "FaceID signature updated");
-                break;
-            case QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_RES:
-                timestamps.faceid_subject_names_received = timer_ms_tick;
-                break;
-            default:
-                break;
+        case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
+            timestamps.activity_detected = timer_ms_tick;
+            if (device_status.classification_video.classification == CLASSIFICATION_UNKNOWN) {
+                video_string_color = RED;
+                video_frame_color = RED;
+            } else if (device_status.classification_video.classification == CLASSIFICATION_LOW_CONFIDENCE) {
+                video_string_color = YELLOW;
+                video_frame_color = YELLOW;
+            } else if (device_status.classification_video.classification == CLASSIFICATION_DETECTED) {
+                video_string_color = GREEN;
+                video_frame_color = GREEN;
+            } else if (device_status.classification_video.classification == CLASSIFICATION_NOTHING) {
+                video_frame_color = WHITE;
+            }
+            if (device_status.classification_video.classification != CLASSIFICATION_NOTHING) {
+                timestamps.scene_activity = timer_ms_tick;
             }
+
+//            if (device_settings.enable_ble_send_classification && device_status.ble_connected) {
+//                ble_command_send_single_packet(BLE_COMMAND_GET_MAX78000_VIDEO_CLASSIFICATION_RES,
+//                    sizeof(device_status.classification_video), (uint8_t *) &device_status.classification_video);
+//            }
+            break;
+        case QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_RES:
+//            if (device_status.ble_connected) {
+//                ble_command_send_single_packet(BLE_COMMAND_FACEID_EMBED_UPDATE_RES,
+//                    sizeof(device_status.faceid_embed_update_status), (uint8_t *) &device_status.faceid_embed_update_status);
+//            }
+            qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD);
+            lcd_notification(GREEN, "FaceID signature updated");
+            break;
+        case QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_RES:
+            timestamps.faceid_subject_names_received = timer_ms_tick;
+            break;
+        default:
+            break;
         }
+    }
 
 
        // PR_INFO("LCD:%d VIDEO:%d CNN:%d AUDIO:%d",device_settings.enable_lcd, device_settings.enable_max78000_video
        // 		,device_settings.enable_max78000_video_cnn, device_settings.enable_max78000_audio);
-        // Handle Audio QSPI RX
-        if (qspi_master_audio_rx_worker(&qspi_packet_type_rx) == E_NO_ERROR) {
-            switch(qspi_packet_type_rx) {
-            case QSPI_PACKET_TYPE_AUDIO_CLASSIFICATION_RES:
-                timestamps.audio_result_received = timer_ms_tick;
-                timestamps.activity_detected = timer_ms_tick;
-
-                if (device_status.classification_audio.classification == CLASSIFICATION_UNKNOWN) {
-                    audio_string_color = RED;
-                } else if (device_status.classification_audio.classification == CLASSIFICATION_LOW_CONFIDENCE) {
-                    audio_string_color = YELLOW;
-                } else if (device_status.classification_audio.classification == CLASSIFICATION_DETECTED) {
-                    audio_string_color = YELLOW;//GREEN;
-
-                    if (strncmp(device_status.classification_audio.result, "OFF", 3) == 0) {
-                    	PR_INFO("OFF");
-                        //  device_settings.enable_lcd = 0;
-                        //  lcd_backlight(0, 0);
-                        //  qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CMD);
-                    } else if(strncmp(device_status.classification_audio.result, "ON", 2) == 0) {
-                    	PR_INFO("ON");
-                        device_settings.enable_lcd = 1;
-                        if (device_settings.enable_max78000_video) {
-                            qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
-                        }
-                        lcd_backlight(1, MAX32666_LCD_BACKLIGHT_HIGH);
-
-                        // also enable cnn
-                        device_settings.enable_max78000_video_cnn = 1;
-                        //  qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD);
-
-                    } else if (strncmp(device_status.classification_audio.result, "GO", 2) == 0) {
-                    	PR_INFO("GO");
-                    	device_settings.enable_max78000_video_cnn = 1;
-                        //  qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD);
-                    } else if(strncmp(device_status.classification_audio.result, "STOP", 4) == 0) {
-                    	PR_INFO("STOP");
-                        //  device_settings.enable_max78000_video_cnn = 0;
-                        //  qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CNN_CMD);
+    // Handle Audio QSPI RX
+    if (qspi_master_audio_rx_worker(&qspi_packet_type_rx) == E_NO_ERROR) {
+        switch(qspi_packet_type_rx) {
+        case QSPI_PACKET_TYPE_AUDIO_CLASSIFICATION_RES:
+            timestamps.audio_result_received = timer_ms_tick;
+            timestamps.activity_detected = timer_ms_tick;
 
+            if (device_status.classification_audio.classification == CLASSIFICATION_UNKNOWN) {
+                audio_string_color = RED;
+            } else if (device_status.classification_audio.classification == CLASSIFICATION_LOW_CONFIDENCE) {
+                audio_string_color = YELLOW;
+            } else if (device_status.classification_audio.classification == CLASSIFICATION_DETECTED) {
+                audio_string_color = YELLOW;//GREEN;
+
+                if (strncmp(device_status.classification_audio.result, "OFF", 3) == 0) {
+                	PR_INFO("OFF");
+                    //  device_settings.enable_lcd = 0;
+                    //  lcd_backlight(0, 0);
+                    //  qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CMD);
+                } else if(strncmp(device_status.classification_audio.result, "ON", 2) == 0) {
+                	PR_INFO("ON");
+                    device_settings.enable_lcd = 1;
+                    if (device_settings.enable_max78000_video) {
+                        qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
                     }
-                }
+                    lcd_backlight(1, MAX32666_LCD_BACKLIGHT_HIGH);
+
+                    // also enable cnn
+                    device_settings.enable_max78000_video_cnn = 1;
+                    //  qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD);
+
+                } else if (strncmp(device_status.classification_audio.result, "GO", 2) == 0) {
+                	PR_INFO("GO");
+                	device_settings.enable_max78000_video_cnn = 1;
+                    //  qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD);
+                } else if(strncmp(device_status.classification_audio.result, "STOP", 4) == 0) {
+                	PR_INFO("STOP");
+                    //  device_settings.enable_max78000_video_cnn = 0;
+                    //  qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CNN_CMD);
 
-//                if (device_settings.enable_ble_send_classification && device_status.ble_connected) {
-//                    ble_command_send_single_packet(BLE_COMMAND_GET_MAX78000_AUDIO_CLASSIFICATION_RES,
-//                        sizeof(device_status.classification_audio), (uint8_t *) &device_status.classification_audio);
-//                }
-                if (!device_settings.enable_max78000_video) {
-                    lcd_data.refresh_screen = 1;
                 }
-                break;
-            default:
-                break;
             }
-        }
-
-        // Handle QSPI TX
-        qspi_master_video_tx_worker();
-        qspi_master_audio_tx_worker();
 
-        // Send BLE periodic statistics
-//        if (device_settings.enable_ble_send_statistics && device_status.ble_connected) {
-//            if ((timer_ms_tick - timestamps.statistics_sent) > BLE_STATISTICS_INTERVAL) {
-//                timestamps.statistics_sent = timer_ms_tick;
-//                ble_command_send_single_packet(BLE_COMMAND_GET_STATISTICS_RES,
-//                    sizeof(device_status.statistics), (uint8_t *) &device_status.statistics);
+//            if (device_settings.enable_ble_send_classification && device_status.ble_connected) {
+//                ble_command_send_single_packet(BLE_COMMAND_GET_MAX78000_AUDIO_CLASSIFICATION_RES,
+//                    sizeof(device_status.classification_audio), (uint8_t *) &device_status.classification_audio);
 //            }
-//        }
-
-        if (device_settings.enable_max78000_video) {
-            // If video is not available for a long time, draw logo and refresh periodically
-            if ((timer_ms_tick - timestamps.video_data_received) > LCD_NO_VIDEO_REFRESH_DURATION) {
-                timestamps.video_data_received = timer_ms_tick;
-                memcpy(lcd_data.buffer, adi_logo, sizeof(lcd_data.buffer));
-                snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1, "No video!");
-                fonts_putStringCentered(16, lcd_string_buff, &Font_11x18, RED, lcd_data.buffer);
+            if (!device_settings.enable_max78000_video) {
                 lcd_data.refresh_screen = 1;
             }
-        } else {
-            // If video is disabled, draw logo and refresh periodically
-            if ((timer_ms_tick - timestamps.screen_drew) > LCD_VIDEO_DISABLE_REFRESH_DURATION) {
-                memcpy(lcd_data.buffer, adi_logo, sizeof(lcd_data.buffer));
-                snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1, "Video disabled");
-                fonts_putStringCentered(15, lcd_string_buff, &Font_11x18, RED, lcd_data.buffer);
-                lcd_data.refresh_screen = 1;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Handle QSPI TX
+    qspi_master_video_ack_worker();
+    qspi_master_video_tx_worker();
+    qspi_master_audio_tx_worker();
+}
+
+// Frame swap and screen refresh, on received frames and LCD DMA completion
+static void display_task(void)
+{
+    // Show the latest video frame once the LCD and QSPI are done with the buffers,
+    // not faster than the governor operating point allows
+    if (lcd_data.frame_pending && device_settings.enable_max78000_video &&
+        qspi_master_video_rx_idle() && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL) &&
+        ((timer_ms_tick - timestamps.screen_drew) >= governor_get_point(device_status.governor.level)->lcd_interval)) {
+        lcd_swap_buffers();
+        draw_mask();
+        qspi_master_video_ack(QSPI_PACKET_TYPE_VIDEO_DATA_RES);
+    }
+
+#if MAX32666_LCD_DOUBLE_BUFFER
+    // The next frame is received into the back buffer while this one goes to the LCD
+    qspi_master_video_ack_worker();
+#endif
+
+    // Refresh LCD
+    if (lcd_data.refresh_screen && device_settings.enable_lcd && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
+        refresh_screen();
+    }
+
+#if !MAX32666_LCD_DOUBLE_BUFFER
+    // The next frame would be received into the buffer being sent to the LCD, the worker holds
+    // the acknowledge until the LCD DMA is done
+    qspi_master_video_ack_worker();
+#endif
+}
+
+// Latest UNet mask on the new frame, the next one is requested once it was shown
+static void draw_mask(void)
+{
+    if (!lcd_data.mask_valid) {
+        return;
+    }
+
+    if ((timer_ms_tick - timestamps.mask_received) > UNET_MASK_TIMEOUT) {
+        lcd_data.mask_valid = 0;
+        lcd_data.mask_pending = 0;
+        return;
+    }
+
+    unet_mask_render(lcd_data.buffer, lcd_data.mask.class_map, mask_palette, MASK_ALPHA);
+
+    if (lcd_data.mask_pending) {
+        qspi_master_video_ack(QSPI_PACKET_TYPE_VIDEO_UNET_MASK_RES);
+        lcd_data.mask_pending = 0;
+    }
+}
+
+// Touch, buttons and IO expander inputs, on their interrupts
+static void input_task(void)
+{
+    uint16_t touch_x1, touch_y1;
+
+    // IO expander worker
+    expander_worker();
+
+    // Touch screen worker
+    if (touch_worker(&touch_x1, &touch_y1) == E_NO_ERROR) {
+
+        // Check if init page start button is clicked
+        if (device_settings.enable_max78000_video == 0) {
+            if ((LCD_START_BUTTON_X1 <= touch_x1) && (touch_x1 <= LCD_START_BUTTON_X2) &&
+                (LCD_START_BUTTON_Y1 <= touch_y1) && (touch_y1 <= LCD_START_BUTTON_Y2)) {
+                device_settings.enable_max78000_video = 1;
+                qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
+                PR_INFO("start button clicked");
+
+                // Start video
+                MXC_Delay(MXC_DELAY_MSEC(1000));
+                device_settings.enable_max78000_video_cnn = 1;
+               // qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD);
             }
         }
 
-//        // Handle BLE communication
-//        if (device_settings.enable_ble && device_status.ble_connected) {
-//            ble_command_worker();
+        PR_INFO("touch %d %d", touch_x1, touch_y1);
+        timestamps.activity_detected = timer_ms_tick;
+        timestamps.scene_activity = timer_ms_tick;
+    }
+
+    // Button worker
+    button_worker();
+
+    // USB worker
+//    usb_worker();
+}
+
+// Statistics, trace dumps, no video screen and inactivity
+static void status_task(void)
+{
+    // Send BLE periodic statistics
+//    if (device_settings.enable_ble_send_statistics && device_status.ble_connected) {
+//        if ((timer_ms_tick - timestamps.statistics_sent) > BLE_STATISTICS_INTERVAL) {
+//            timestamps.statistics_sent = timer_ms_tick;
+//            ble_command_send_single_packet(BLE_COMMAND_GET_STATISTICS_RES,
+//                sizeof(device_status.statistics), (uint8_t *) &device_status.statistics);
 //        }
+//    }
+
+#ifdef ENABLE_TRACE
+    // Print trace dumps
+    if ((timer_ms_tick - timestamps.trace_sent) > BLE_STATISTICS_INTERVAL) {
+        timestamps.trace_sent = timer_ms_tick;
+        send_trace_dump();
+    }
+#endif
+
+    if (device_settings.enable_max78000_video) {
+        // If video is not available for a long time, draw logo and refresh periodically
+        if ((timer_ms_tick - timestamps.video_data_received) > LCD_NO_VIDEO_REFRESH_DURATION) {
+            timestamps.video_data_received = timer_ms_tick;
+            memcpy(lcd_data.buffer, adi_logo, LCD_DATA_SIZE);
+            lcd_mark_dirty_all();
+            snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1, "No video!");
+            fonts_putStringCentered(16, lcd_string_buff, &Font_11x18, RED, lcd_data.buffer);
+            lcd_data.refresh_screen = 1;
+        }
+    } else {
+        // If video is disabled, draw logo and refresh periodically
+        if ((timer_ms_tick - timestamps.screen_drew) > LCD_VIDEO_DISABLE_REFRESH_DURATION) {
+            memcpy(lcd_data.buffer, adi_logo, LCD_DATA_SIZE);
+            lcd_mark_dirty_all();
+            snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1, "Video disabled");
+            fonts_putStringCentered(15, lcd_string_buff, &Font_11x18, RED, lcd_data.buffer);
+            lcd_data.refresh_screen = 1;
+        }
+    }
+
+//    // Handle BLE communication
+//    if (device_settings.enable_ble && device_status.ble_connected) {
+//        ble_command_worker();
+//    }
 //
-//        // Check if BLE status changed
-//        if (device_status.ble_connected_status_changed) {
-//            device_status.ble_connected_status_changed = 0;
+//    // Check if BLE status changed
+//    if (device_status.ble_connected_status_changed) {
+//        device_status.ble_connected_status_changed = 0;
 //
-//            ble_queue_flush();
-//            ble_command_reset();
-//            device_settings.enable_ble_send_classification = 0;
-//            device_settings.enable_ble_send_statistics = 0;
+//        ble_queue_flush();
+//        ble_command_reset();
+//        device_settings.enable_ble_send_classification = 0;
+//        device_settings.enable_ble_send_statistics = 0;
 //
-//            if (device_status.ble_connected) {
-//                snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1,
-//                        "BLE %02X:%02X:%02X:%02X:%02X:%02X connected!",
-//                        device_status.ble_connected_peer_mac[5], device_status.ble_connected_peer_mac[4],
-//                        device_status.ble_connected_peer_mac[3], device_status.ble_connected_peer_mac[2],
-//                        device_status.ble_connected_peer_mac[1], device_status.ble_connected_peer_mac[0]);
-//                lcd_notification(BLUE, lcd_string_buff);
-//            } else {
-//                lcd_notification(BLUE, "BLE disconnected!");
-//            }
+//        if (device_status.ble_connected) {
+//            snprintf(lcd_string_buff, sizeof(lcd_string_buff) - 1,
+//                    "BLE %02X:%02X:%02X:%02X:%02X:%02X connected!",
+//                    device_status.ble_connected_peer_mac[5], device_status.ble_connected_peer_mac[4],
+//                    device_status.ble_connected_peer_mac[3], device_status.ble_connected_peer_mac[2],
+//                    device_status.ble_connected_peer_mac[1], device_status.ble_connected_peer_mac[0]);
+//            lcd_notification(BLUE, lcd_string_buff);
+//        } else {
+//            lcd_notification(BLUE, "BLE disconnected!");
 //        }
+//    }
 //
-//        if (device_status.ble_running_status_changed) {
-//            if (device_settings.enable_ble) {
-//                PR_INFO("Enable Core1");
-//                Core1_Start();
-//            } else {
-//                PR_INFO("Disable Core1");
-//                Core1_Stop();
-//            }
-//            device_status.ble_running_status_changed = 0;
+//    if (device_status.ble_running_status_changed) {
+//        if (device_settings.enable_ble) {
+//            PR_INFO("Enable Core1");
+//            Core1_Start();
+//        } else {
+//            PR_INFO("Disable Core1");
+//            Core1_Stop();
 //        }
+//        device_status.ble_running_status_changed = 0;
+//    }
 
-        // Check inactivity
-        if (device_settings.enable_inactivity) {
-            if ((timer_ms_tick - timestamps.activity_detected) > INACTIVITY_LONG_DURATION) {
-                if (device_status.inactivity_state != INACTIVITY_STATE_INACTIVE_LONG) {
-                    device_status.inactivity_state = INACTIVITY_STATE_INACTIVE_LONG;
-                    // Switch to inactive long state
-                    lcd_backlight(0, 0);
-                    qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CMD);
-                    PR_INFO("Inactive long");
+    // Check inactivity
+    if (device_settings.enable_inactivity) {
+        if ((timer_ms_tick - timestamps.activity_detected) > INACTIVITY_LONG_DURATION) {
+            if (device_status.inactivity_state != INACTIVITY_STATE_INACTIVE_LONG) {
+                device_status.inactivity_state = INACTIVITY_STATE_INACTIVE_LONG;
+                // Switch to inactive long state
+                lcd_backlight(0, 0);
+                qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_DISABLE_CMD);
+                PR_INFO("Inactive long");
+            }
+        } else if ((timer_ms_tick - timestamps.activity_detected) > INACTIVITY_SHORT_DURATION) {
+            if (device_status.inactivity_state != INACTIVITY_STATE_INACTIVE_SHORT) {
+                device_status.inactivity_state = INACTIVITY_STATE_INACTIVE_SHORT;
+                // Switch to inactive short state
+                if (device_settings.enable_lcd) {
+                    lcd_backlight(1, MAX32666_LCD_BACKLIGHT_LOW);
                 }
-            } else if ((timer_ms_tick - timestamps.activity_detected) > INACTIVITY_SHORT_DURATION) {
-                if (device_status.inactivity_state != INACTIVITY_STATE_INACTIVE_SHORT) {
-                    device_status.inactivity_state = INACTIVITY_STATE_INACTIVE_SHORT;
-                    // Switch to inactive short state
-                    if (device_settings.enable_lcd) {
-                        lcd_backlight(1, MAX32666_LCD_BACKLIGHT_LOW);
-                    }
-                    PR_INFO("Inactive short");
+                PR_INFO("Inactive short");
+            }
+        } else {
+            if (device_status.inactivity_state != INACTIVITY_STATE_ACTIVE) {
+                device_status.inactivity_state = INACTIVITY_STATE_ACTIVE;
+                // Switch to active state
+                if (device_settings.enable_lcd) {
+                    lcd_backlight(1, MAX32666_LCD_BACKLIGHT_HIGH);
                 }
-            } else {
-                if (device_status.inactivity_state != INACTIVITY_STATE_ACTIVE) {
-                    device_status.inactivity_state = INACTIVITY_STATE_ACTIVE;
-                    // Switch to active state
-                    if (device_settings.enable_lcd) {
-                        lcd_backlight(1, MAX32666_LCD_BACKLIGHT_HIGH);
-                    }
-                    if (device_settings.enable_max78000_video && device_settings.enable_lcd) {
-                        MXC_Delay(MXC_DELAY_MSEC(600));
-                        qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
-                    }
-                    PR_INFO("Active");
+                if (device_settings.enable_max78000_video && device_settings.enable_lcd) {
+                    MXC_Delay(MXC_DELAY_MSEC(600));
+                    qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
                 }
+                PR_INFO("Active");
             }
         }
+    }
+}
 
-        // Check PMIC and Fuel Gauge
-        if ((timer_ms_tick - timestamps.pmic_check) > MAX32666_PMIC_INTERVAL) {
-            timestamps.pmic_check = timer_ms_tick;
-            pmic_worker();
-            if (device_status.fuel_gauge_working) {
-                fuel_gauge_worker();
-            }
-        }
-
-        // Power accumulator worker
-//        if ((timer_ms_tick - timestamps.powmon) > MAX32666_POWMON_INTERVAL) {
-//            timestamps.powmon = timer_ms_tick;
-//            powmon_worker();
-//        }
-
-        // LED worker
-        if ((timer_ms_tick - timestamps.led) > MAX32666_LED_INTERVAL) {
-            timestamps.led = timer_ms_tick;
-            led_worker();
-        }
+// LED worker
+static void led_task(void)
+{
+    led_worker();
+}
 
-        // IO expander worker
-        expander_worker();
+// PMIC and Fuel Gauge
+static void pmic_task(void)
+{
+    pmic_worker();
+    if (device_status.fuel_gauge_working) {
+        fuel_gauge_worker();
+    }
+}
 
-        // Touch screen worker
-        if (touch_worker(&touch_x1, &touch_y1) == E_NO_ERROR) {
+#ifdef ENABLE_TRACE
+static void send_trace_dump(void)
+{
+    static int next_source = 0;
+    trace_dump_t *dump;
 
-            // Check if init page start button is clicked
-            if (device_settings.enable_max78000_video == 0) {
-                if ((LCD_START_BUTTON_X1 <= touch_x1) && (touch_x1 <= LCD_START_BUTTON_X2) &&
-                    (LCD_START_BUTTON_Y1 <= touch_y1) && (touch_y1 <= LCD_START_BUTTON_Y2)) {
-                    device_settings.enable_max78000_video = 1;
-                    qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CMD);
-                    PR_INFO("start button clicked");
+    // Local events are drained once the previous dump is out
+    if (!(device_status.trace_pending & (1 << TRACE_SOURCE_MAX32666))) {
+        trace_drain(&device_status.trace[TRACE_SOURCE_MAX32666]);
+        device_status.trace_pending |= (1 << TRACE_SOURCE_MAX32666);
+    }
 
-                    // Start video
-                    MXC_Delay(MXC_DELAY_MSEC(1000));
-                    device_settings.enable_max78000_video_cnn = 1;
-                   // qspi_master_send_video(NULL, 0, QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD);
-                }
+    // One dump per call, round robin over the sources
+    for (int i = 0; i < TRACE_SOURCE_LAST; i++) {
+        next_source = (next_source + 1) % TRACE_SOURCE_LAST;
+        if (device_status.trace_pending & (1 << next_source)) {
+            dump = &device_status.trace[next_source];
+            // BLE is not enabled in this demo, hex dump to the debug UART
+            printf("TRACE ");
+            for (int j = 0; j < TRACE_DUMP_SIZE(dump->count); j++) {
+                printf("%02hhX", ((uint8_t *) dump)[j]);
             }
-
-            PR_INFO("touch %d %d", touch_x1, touch_y1);
-            timestamps.activity_detected = timer_ms_tick;
+            printf("\r\n");
+            device_status.trace_pending &= ~(1 << next_source);
+            return;
         }
-
-        // Button worker
-        button_worker();
-
-        // USB worker
-//        usb_worker();
-
-        // Refresh LCD
-        if (lcd_data.refresh_screen && device_settings.enable_lcd && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
-            refresh_screen();
-        }
-
-        // Sleep until an interrupt
-        __WFI();
     }
 }
+#endif
 
 static int refresh_screen(void)
 {
@@ -916,6 +1052,7 @@ static void core1_irq_init(void)
     NVIC_DisableIRQ(GPIO1_IRQn);
 
     NVIC_DisableIRQ(MXC_TMR_GET_IRQ(MXC_TMR_GET_IDX(MAX32666_TIMER_MS)));
+    NVIC_DisableIRQ(MXC_TMR_GET_IRQ(MXC_TMR_GET_IDX(MAX32666_TIMER_QSPI_CS)));
 }
 
 static void core0_icc(int enable)
@@ -942,115 +1079,3 @@ static void core1_icc(int enable)
     while (!(MXC_ICC1->cache_ctrl & MXC_F_ICC_CACHE_CTRL_RDY));
 }
 
-
-void update_mask(uint32_t mask)
-{
-	
-  int r;
-  int g;
-  int b;
-  int i;
-  int8_t rr, gg, bb, uu;
-  uint32_t x, y;
-  uint32_t color;
-  int32_t max = 0;
-  uint32_t max_index = 0;
- 
-  uint32_t cnt=0;
-  
-  int8_t *ml_data8 = lcd_data.ml_data8;
-
-  x = 0;
-  y = 0;
-
-  for (i = 0; i < UNET_IMAGE_SIZE_X*UNET_IMAGE_SIZE_Y; i++)
-  {
-		max = -256; // smaller than -128
-		max_index = 0;
-
-		rr = ml_data8[i];
-		bb = ml_data8[i + UNET_IMAGE_SIZE_X * UNET_IMAGE_SIZE_Y];  //swapped b&g
-		gg = ml_data8[i + 2 * UNET_IMAGE_SIZE_X * UNET_IMAGE_SIZE_Y];
-		uu = ml_data8[i + 3 * UNET_IMAGE_SIZE_X * UNET_IMAGE_SIZE_Y];
-		//printf("[%d] %d  %d  %d  %d \n",i,rr, bb, gg, uu);
-
-		if (rr > max)
-		{
-		  max = rr;
-		  max_index = 0;
-		}
-		if (gg > max)
-		{
-		  max = gg;
-		  max_index = 1;
-		}
-		if (bb > max)
-		{
-		  max = bb;
-		  max_index = 2;
-		}
-		if (uu > max)
-		{
-		  max = uu;
-		  max_index = 3;
-		}
-
-		//printf("[%d] %d  %d  \n",i,max,max_index);
-
-		// set mask color
-		switch(max_index)
-		{
-		   case 0:
-			   r = mask;
-			   g = 0;
-			   b = 0;
-			   break;
-		   case 1:
-			   r = 0;
-			   g = mask;
-			   b = 0;
-			  break;
-		   case 2:
-			   r = 0;
-			   g = 0;
-			   b = mask;
-			   break;
-		   case 3:
-			   r = 0;
-			   g = 0;
-			   b = 0;
-			   break;
-
-		   default:
-			  printf("ERROR");
-			  while(1);
-		}
-
-		color = BRG(b, r, g); // convert to RGB565 as needed by TFT
-
-		// repeat samples to convert 80x80 to 240x240
-		mask_data[3*x + 3*y*LCD_WIDTH] = color;
-		mask_data[3*x + (3*y+1)*LCD_WIDTH] = color;
-		mask_data[3*x + (3*y+2)*LCD_WIDTH] = color;
-
-		mask_data[3*x + 1 + 3*y*LCD_WIDTH] = color;
-		mask_data[3*x + 1 + (3*y+1)*LCD_WIDTH] = color;
-		mask_data[3*x + 1 + (3*y+2)*LCD_WIDTH] = color;
-
-		mask_data[3*x + 2 + 3*y*LCD_WIDTH] = color;
-		mask_data[3*x + 2 + (3*y+1)*LCD_WIDTH] = color;
-		mask_data[3*x + 2 + (3*y+2)*LCD_WIDTH] = color;
-
-		cnt+=9;
-
-		x += 1;
-		if (x >= (UNET_IMAGE_SIZE_X)) {
-		  x = 0;
-		  y += 1;
-	}
-	
- }	    
-	  
- memcpy(lcd_data.buffer, mask_data, LCD_DATA_SIZE);
- // printf("Total count: %d\r\n", cnt);	
-}
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAX78000_AUDIO_TRANSPOSE_H_
+#define _MAX78000_AUDIO_TRANSPOSE_H_
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+//#define ENABLE_CONTINUOUS_KWS            // runs CNN every KWS_HOP_CHUNKS on a sliding window instead of waiting for THRESHOLD_HIGH
+#ifndef ENABLE_CONTINUOUS_KWS
+/* CNN overwrites its input while running, sliding window has to be kept in the transpose buffer */
+#define ENABLE_CNN_DIRECT_TRANSPOSE      // transposes samples straight into CNN data memory, otherwise into a 16KB buffer first
+#endif
+
+#define TRANSPOSE_WIDTH       128     // width of 2d data model to be used for transpose
+#define TRANSPOSE_SIZE        (TRANSPOSE_WIDTH * TRANSPOSE_WIDTH)  // number of samples in the CNN input
+#define TRANSPOSE_GROUPS      16      // number of CNN data memory groups holding the input, TRANSPOSE_WIDTH / 8
+#define TRANSPOSE_GROUP_SIZE  (TRANSPOSE_SIZE / TRANSPOSE_GROUPS)  // bytes per CNN data memory group
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Append inSize samples to the CNN input row by row, returns 1 once outSize samples are added
+uint8_t transpose_add(const uint8_t *pIn, uint16_t inSize, uint16_t outSize);
+
+// Write TRANSPOSE_WIDTH samples as row 'row' of the CNN input
+void transpose_row(const uint8_t *pIn, uint16_t row);
+
+// Copy the buffer into CNN data memory, rows are a ring starting at startRow.
+// Nothing to do with ENABLE_CNN_DIRECT_TRANSPOSE
+void transpose_load(uint16_t startRow);
+
+#endif /* _MAX78000_AUDIO_TRANSPOSE_H_ */
@@ -54,9 +54,12 @@
 #include <tmr.h>
 
 #include "max78000_audio_cnn.h"
+#include "max78000_audio_kws.h"
+#include "max78000_audio_transpose.h"
 #include "max78000_debug.h"
 #include "max78000_qspi_slave.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_trace.h"
 #include "maxrefdes178_utility.h"
 #include "maxrefdes178_version.h"
 
@@ -76,20 +79,26 @@
 /* keep following unchanged */
 #define SAMPLE_SIZE         16384   // size of input vector for CNN, keep it multiple of 128
 #define CHUNK               128     // number of data points to read at a time and average for threshold, keep multiple of 128
-#define TRANSPOSE_WIDTH     128     // width of 2d data model to be used for transpose
 #define NUM_OUTPUTS         CNN_NUM_OUTPUTS      // number of classes
 #define I2S_RX_BUFFER_SIZE  64      // I2S buffer size
 #define TFT_BUFF_SIZE       50      // TFT buffer size
 /*-----------------------------*/
 
 /* Adjustables */
-#define SAMPLE_SCALE_FACTOR         5//4//3       // multiplies 16-bit samples by this scale factor before converting to 8-bit
 #define THRESHOLD_HIGH              350     // voice detection threshold to find beginning of a keyword
 #define THRESHOLD_LOW               100     // voice detection threshold to find end of a keyword
 #define SILENCE_COUNTER_THRESHOLD   20      // [>20] number of back to back CHUNK periods with avg < THRESHOLD_LOW to declare the end of a word
 #define PREAMBLE_SIZE               30*CHUNK// how many samples before beginning of a keyword to include
 #define INFERENCE_THRESHOLD         75      // min probability (0-100) to accept an inference
 
+#if SAMPLE_SIZE != TRANSPOSE_SIZE
+#error "SAMPLE_SIZE must match the transposed CNN input"
+#endif
+
+#if defined(ENABLE_CONTINUOUS_KWS) && (CHUNK != TRANSPOSE_WIDTH)
+#error "ENABLE_CONTINUOUS_KWS needs one CHUNK per transposed row"
+#endif
+
 /* MAX9867 Audio Codec */
 #define MAX9867_I2C        MXC_I2C1
 #define MAX9867_I2C_FREQ   400000
@@ -125,13 +134,14 @@ static const mxc_gpio_cfg_t gpio_blue      = MAX78000_AUDIO_LED_BLUE_PIN;
 
 static int32_t ml_data[NUM_OUTPUTS];
 static q15_t ml_softmax[NUM_OUTPUTS];
-static uint8_t pAI85Buffer[SAMPLE_SIZE];
 static uint8_t pPreambleCircBuffer[PREAMBLE_SIZE];
+#ifdef ENABLE_CONTINUOUS_KWS
+static q15_t kwsSmoothSoft[NUM_OUTPUTS];
+static int32_t kwsSmoothData[NUM_OUTPUTS];
+#endif
 static int16_t Max, Min;
 static uint16_t thresholdHigh = THRESHOLD_HIGH;
 static uint16_t thresholdLow = THRESHOLD_LOW;
-static int16_t  x0, x1, Coeff;
-static int32_t  y0, y1;
 static int8_t enable_audio = 1;
 static int8_t enable_sleep = 0;
 static volatile int8_t button_pressed = 0;
@@ -141,6 +151,9 @@ static int32_t i2s_rx_buffer[I2S_RX_BUFFER_SIZE];
 static max78000_statistics_t max78000_statistics = {0};
 static version_t version = {S_VERSION_MAJOR, S_VERSION_MINOR, S_VERSION_BUILD};
 static char demo_name[] = UNET_DEMO_NAME;
+#ifdef ENABLE_TRACE
+static trace_dump_t trace_dump;
+#endif
 static uint8_t qspi_rx_buffer[100];
 
 /* **** Constants **** */
@@ -161,15 +174,14 @@ static const char keywords[NUM_OUTPUTS][10] = { "UP", "DOWN", "LEFT", "RIGHT", "
 // Local function declarations
 //-----------------------------------------------------------------------------
 static void fail(void);
-static uint8_t cnn_load_data(uint8_t* pIn);
+static uint8_t cnn_load_data(uint16_t startRow);
+static void cnn_inference(uint16_t startRow);
+static uint8_t report_inference(classification_result_t *classification_result, q15_t *ml_soft,
+                        int32_t *ml_data, uint8_t detected_only);
 static uint8_t MicReadChunk(uint8_t* pBuff, uint16_t* avg);
-static uint8_t AddTranspose(uint8_t* pIn, uint8_t* pOut, uint16_t inSize,
-                     uint16_t outSize, uint16_t width);
 static uint8_t check_inference(q15_t* ml_soft, int32_t* ml_data,
                         int16_t* out_class, double* out_prob);
 static void I2SInit();
-static void HPF_init(void);
-static int16_t HPF(int16_t input);
 static int max9867_init(void);
 
 
@@ -201,7 +213,6 @@ int main(void)
     MXC_Delay(MXC_DELAY_MSEC(500)); // Wait supply to be ready
 
     uint32_t sampleCounter = 0;
-    mxc_tmr_unit_t units;
 
     uint8_t pChunkBuff[CHUNK];
 
@@ -266,12 +277,10 @@ int main(void)
     PR_INFO("maxrefdes178_max78000_audio %s v%d.%d.%d [%s]",
             demo_name, version.major, version.minor, version.build, S_BUILD_TIMESTAMP);
 
-    memset(pAI85Buffer, 0x0, sizeof(pAI85Buffer));
     memset(pPreambleCircBuffer, 0x0, sizeof(pPreambleCircBuffer));
 
     PR_DEBUG("pChunkBuff: %d", sizeof(pChunkBuff));
     PR_DEBUG("pPreambleCircBuffer: %d", sizeof(pPreambleCircBuffer));
-    PR_DEBUG("pAI85Buffer: %d", sizeof(pAI85Buffer));
 
     if (MXC_DMA_Init() != E_NO_ERROR) {
         PR_ERROR("DMA INIT ERROR");
@@ -317,6 +326,8 @@ int main(void)
     MXC_TMR_EnableInt(MAX78000_AUDIO_SLEEP_DEFER_TMR);
     MXC_TMR_Start(MAX78000_AUDIO_SLEEP_DEFER_TMR);
 
+    TRACE_INIT(TRACE_SOURCE_MAX78000_AUDIO);
+
     PR_INFO("** READY ***");
 
     /* Read samples */
@@ -426,6 +437,9 @@ int main(void)
         }
 
         if (!enable_audio) {
+#ifdef ENABLE_CONTINUOUS_KWS
+            kws_reset();
+#endif
             if (enable_sleep) {
 //                MXC_LP_EnterSleepMode();
                 __WFI();
@@ -440,6 +454,33 @@ int main(void)
 
         sampleCounter += CHUNK;
 
+#ifdef ENABLE_CONTINUOUS_KWS
+        /* new chunk replaces the oldest row, rest of the window is already transposed */
+        if (!kws_window_add(pChunkBuff, max78000_statistics.cnn_duration_us)) {
+            continue;
+        }
+
+        GPIO_SET(gpio_green);
+
+        PR_DEBUG("%.6d: Starts CNN", sampleCounter);
+        cnn_inference(kws_window_start());
+        PR_DEBUG("%.6d: Completes CNN", sampleCounter);
+
+        /* report detections only, from posteriors averaged over the last windows */
+        if (kws_smooth(ml_softmax, kwsSmoothSoft, kwsSmoothData) &&
+            report_inference(&classification_result, kwsSmoothSoft, kwsSmoothData, 1)) {
+            if (classification_result.classification == CLASSIFICATION_UNKNOWN) {
+                kws_smooth_clear();
+            } else {
+                /* keyword stays in the window for several hops, next report only from later audio */
+                kws_reset();
+            }
+        }
+
+        GPIO_CLR(gpio_green);
+        continue;
+#endif
+
 #ifdef ENABLE_SILENCE_DETECTION       // disable to start collecting data immediately.
 
         /* copy the preamble data*/
@@ -473,24 +514,21 @@ int main(void)
                         sampleCounter, sampleCounter - PREAMBLE_SIZE - CHUNK,
                         avg, thresholdHigh);
 
-                /* reorder circular buffer according to time at the beginning of pAI85Buffer */
+                /* reorder circular buffer according to time at the beginning of CNN input */
                 if (preambleCounter == 0) {
                     /* copy latest samples afterwards */
-                    if (AddTranspose(&pPreambleCircBuffer[0], pAI85Buffer,
-                            PREAMBLE_SIZE, SAMPLE_SIZE, TRANSPOSE_WIDTH)) {
+                    if (transpose_add(&pPreambleCircBuffer[0], PREAMBLE_SIZE, SAMPLE_SIZE)) {
                         PR_ERROR("ERROR: Transpose ended early");
                     }
                 } else {
                     /* copy oldest samples to the beginning*/
-                    if (AddTranspose(&pPreambleCircBuffer[preambleCounter],
-                            pAI85Buffer, PREAMBLE_SIZE - preambleCounter,
-                            SAMPLE_SIZE, TRANSPOSE_WIDTH)) {
+                    if (transpose_add(&pPreambleCircBuffer[preambleCounter],
+                            PREAMBLE_SIZE - preambleCounter, SAMPLE_SIZE)) {
                         PR_ERROR("ERROR: Transpose ended early");
                     }
 
                     /* copy latest samples afterwards */
-                    if (AddTranspose(&pPreambleCircBuffer[0], pAI85Buffer,
-                            preambleCounter, SAMPLE_SIZE, TRANSPOSE_WIDTH)) {
+                    if (transpose_add(&pPreambleCircBuffer[0], preambleCounter, SAMPLE_SIZE)) {
                         PR_ERROR("ERROR: Transpose ended early");
                     }
 
@@ -510,8 +548,7 @@ int main(void)
             uint8_t ret=0;
 
             /* add sample, rearrange buffer */
-            ret = AddTranspose(pChunkBuff, pAI85Buffer, CHUNK, SAMPLE_SIZE,
-                    TRANSPOSE_WIDTH);
+            ret = transpose_add(pChunkBuff, CHUNK, SAMPLE_SIZE);
 
             /* increment number of stored samples */
             ai85Counter += CHUNK;
@@ -534,17 +571,13 @@ int main(void)
                         SAMPLE_SIZE - ai85Counter);
                 ret = 0;
                 while (!ret) {
-                    ret = AddTranspose(pChunkBuff, pAI85Buffer, CHUNK,
-                            SAMPLE_SIZE, TRANSPOSE_WIDTH);
+                    ret = transpose_add(pChunkBuff, CHUNK, SAMPLE_SIZE);
                     ai85Counter += CHUNK;
                 }
             }
 
             /* if enough samples are collected, start CNN */
             if (ai85Counter >= SAMPLE_SIZE) {
-                int16_t out_class = -1;
-                double probability = 0;
-
                 GPIO_SET(gpio_green);
 
                 /* reset counters */
@@ -565,92 +598,10 @@ int main(void)
 
                 //----------------------------------  : invoke AI85 CNN
                 PR_DEBUG("%.6d: Starts CNN: %d", sampleCounter, wordCounter);
-
-                /* load to CNN */
-                if (!cnn_load_data(pAI85Buffer)) {
-                    PR_ERROR("ERROR: Loading data to CNN!");
-                    fail();
-                }
-
-                /* Start CNN */
-                if (!cnn_start()) {
-                    PR_ERROR("ERROR: Starting CNN!");
-                    fail();
-                }
-
-                /* Wait for CNN  to complete */
-                while (cnn_time == 0) {
-                    __WFI();
-                }
-
-                /* read data */
-                cnn_unload((uint32_t *)ml_data);
-
-                /* Get time */
-                MXC_TMR_GetTime(MXC_TMR0, cnn_time, (uint32_t*) &cnn_time, &units);
+                cnn_inference(0);
                 PR_DEBUG("%.6d: Completes CNN: %d", sampleCounter, wordCounter);
 
-                switch (units) {
-                case TMR_UNIT_NANOSEC:
-                    cnn_time /= 1000;
-                    break;
-                case TMR_UNIT_MILLISEC:
-                    cnn_time *= 1000;
-                    break;
-                case TMR_UNIT_SEC:
-                    cnn_time *= 1000000;
-                    break;
-                default:
-                    break;
-                }
-                PR_DEBUG("CNN Time: %d us", cnn_time);
-
-                /* run softmax */
-                softmax_q17p14_q15((const q31_t*) ml_data, NUM_OUTPUTS,
-                        ml_softmax);
-
-#ifdef ENABLE_CLASSIFICATION_DISPLAY
-                PR_INFO("Classification results:");
-                for (int i = 0; i < NUM_OUTPUTS; i++) {
-                    int digs = (1000 * ml_softmax[i] + 0x4000) >> 15;
-                    int tens = digs % 10;
-                    digs = digs/10;
-
-                    printf("[%+.7d] -> Class %.2d %8s: %d.%d%%\n", ml_data[i],
-                            i, keywords[i], digs, tens);
-                }
-#endif
-                /* find detected class with max probability */
-                ret = check_inference(ml_softmax, ml_data, &out_class, &probability);
-
-                if (!ret) {
-                    classification_result.classification = CLASSIFICATION_LOW_CONFIDENCE;
-                    PR_INFO("Low confidence: %s (%0.1f%%)", keywords[out_class], probability);
-                } else {
-                    classification_result.classification = CLASSIFICATION_DETECTED;
-                    PR_INFO("Detected: %s (%0.1f%%)", keywords[out_class], probability);
-                }
-
-                if (strcmp(keywords[out_class], "Unknown") == 0) {
-                    classification_result.classification = CLASSIFICATION_UNKNOWN;
-                }
-
-                memcpy(classification_result.result, keywords[out_class], sizeof(classification_result.result));
-                classification_result.probabily = probability;
-
-                qspi_slave_send_packet((uint8_t *) &classification_result, sizeof(classification_result),
-                        QSPI_PACKET_TYPE_AUDIO_CLASSIFICATION_RES);
-
-                max78000_statistics.cnn_duration_us = cnn_time;
-                qspi_slave_send_packet((uint8_t *) &max78000_statistics, sizeof(max78000_statistics),
-                        QSPI_PACKET_TYPE_AUDIO_STATISTICS_RES);
-
-#ifdef ENABLE_CLASSIFICATION_DISPLAY
-                printf("\n----------------------------------------- \n");
-#endif
-                PR_INFO("Min: %d Max:%d", Min, Max);
-                Max = 0;
-                Min = 0;
+                report_inference(&classification_result, ml_softmax, ml_data, 0);
 
                 GPIO_CLR(gpio_green);
             }
@@ -665,7 +616,7 @@ static void I2SInit()
 
     PR_INFO("*** I2S & Mic Init ***");
     /* Initialize High Pass Filter */
-    HPF_init();
+    kws_mic_init();
     /* Initialize I2S RX buffer */
     memset(i2s_rx_buffer, 0, sizeof(i2s_rx_buffer));
     /* Configure I2S interface parameters */
@@ -701,6 +652,122 @@ static void I2SInit()
     __enable_irq();
 }
 
+static void cnn_inference(uint16_t startRow)
+{
+    mxc_tmr_unit_t units;
+
+    TRACE_NEXT_FRAME();
+    TRACE_EVENT(TRACE_EVENT_CNN_LOAD, 0);
+
+    /* load to CNN */
+    if (!cnn_load_data(startRow)) {
+        PR_ERROR("ERROR: Loading data to CNN!");
+        fail();
+    }
+
+    /* Start CNN */
+    if (!cnn_start()) {
+        PR_ERROR("ERROR: Starting CNN!");
+        fail();
+    }
+    TRACE_EVENT(TRACE_EVENT_CNN_START, 0);
+
+    /* Wait for CNN  to complete */
+    while (cnn_time == 0) {
+        __WFI();
+    }
+    TRACE_EVENT(TRACE_EVENT_CNN_DONE, 0);
+
+    /* read data */
+    cnn_unload((uint32_t *)ml_data);
+    TRACE_EVENT(TRACE_EVENT_CNN_UNLOAD, 0);
+
+    /* Get time */
+    MXC_TMR_GetTime(MXC_TMR0, cnn_time, (uint32_t*) &cnn_time, &units);
+
+    switch (units) {
+    case TMR_UNIT_NANOSEC:
+        cnn_time /= 1000;
+        break;
+    case TMR_UNIT_MILLISEC:
+        cnn_time *= 1000;
+        break;
+    case TMR_UNIT_SEC:
+        cnn_time *= 1000000;
+        break;
+    default:
+        break;
+    }
+    PR_DEBUG("CNN Time: %d us", cnn_time);
+    max78000_statistics.cnn_duration_us = cnn_time;
+
+    /* run softmax */
+    softmax_q17p14_q15((const q31_t*) ml_data, NUM_OUTPUTS,
+            ml_softmax);
+}
+
+static uint8_t report_inference(classification_result_t *classification_result, q15_t *ml_soft,
+        int32_t *ml_data, uint8_t detected_only)
+{
+    int16_t out_class = -1;
+    double probability = 0;
+    uint8_t ret;
+
+#ifdef ENABLE_CLASSIFICATION_DISPLAY
+    PR_INFO("Classification results:");
+    for (int i = 0; i < NUM_OUTPUTS; i++) {
+        int digs = (1000 * ml_soft[i] + 0x4000) >> 15;
+        int tens = digs % 10;
+        digs = digs/10;
+
+        printf("[%+.7d] -> Class %.2d %8s: %d.%d%%\n", ml_data[i],
+                i, keywords[i], digs, tens);
+    }
+#endif
+    /* find detected class with max probability */
+    ret = check_inference(ml_soft, ml_data, &out_class, &probability);
+
+    if (!ret && detected_only) {
+        return 0;
+    }
+
+    if (!ret) {
+        classification_result->classification = CLASSIFICATION_LOW_CONFIDENCE;
+        PR_INFO("Low confidence: %s (%0.1f%%)", keywords[out_class], probability);
+    } else {
+        classification_result->classification = CLASSIFICATION_DETECTED;
+        PR_INFO("Detected: %s (%0.1f%%)", keywords[out_class], probability);
+    }
+
+    if (strcmp(keywords[out_class], "Unknown") == 0) {
+        classification_result->classification = CLASSIFICATION_UNKNOWN;
+    }
+
+    memcpy(classification_result->result, keywords[out_class], sizeof(classification_result->result));
+    classification_result->probabily = probability;
+
+    qspi_slave_send_packet((uint8_t *) classification_result, sizeof(*classification_result),
+            QSPI_PACKET_TYPE_AUDIO_CLASSIFICATION_RES);
+
+    qspi_slave_send_packet((uint8_t *) &max78000_statistics, sizeof(max78000_statistics),
+            QSPI_PACKET_TYPE_AUDIO_STATISTICS_RES);
+
+#ifdef ENABLE_TRACE
+    trace_drain(&trace_dump);
+    qspi_slave_send_packet((uint8_t *) &trace_dump, TRACE_DUMP_SIZE(trace_dump.count),
+            QSPI_PACKET_TYPE_AUDIO_TRACE_RES);
+#endif
+
+#ifdef ENABLE_CLASSIFICATION_DISPLAY
+    printf("\n----------------------------------------- \n");
+#endif
+    PR_INFO("Min: %d Max:%d", Min, Max);
+    Max = 0;
+    Min = 0;
+
+    return ret;
+}
+
 static uint8_t check_inference(q15_t *ml_soft, int32_t *ml_data,
         int16_t *out_class, double *out_prob) {
     int32_t temp[NUM_OUTPUTS];
@@ -742,122 +809,19 @@ static uint8_t check_inference(q15_t *ml_soft, int32_t *ml_data,
     }
 }
 
-static uint8_t cnn_load_data(uint8_t* pIn)
+static uint8_t cnn_load_data(uint16_t startRow)
 {
-    uint32_t mem;
-    uint16_t index = 0;
-
     /* data should already be formated correctly */
-    /* pIn is 16KB, each 1KB belongs to a memory group */
-    for (mem = 0x50400000; mem <= 0x50418000; mem += 0x8000) {
-        memcpy((uint8_t*)mem, &pIn[index], 1024);
-        //printf("%.10X \n",(uint8_t *)mem);
-        index += 1024;
-    }
-
-    for (mem = 0x50800000; mem <= 0x50818000; mem += 0x8000) {
-        memcpy((uint8_t*)mem, &pIn[index], 1024);
-        index += 1024;
-    }
-
-    for (mem = 0x50C00000; mem <= 0x50C18000; mem += 0x8000) {
-        memcpy((uint8_t*)mem, &pIn[index], 1024);
-        index += 1024;
-    }
-
-    for (mem = 0x51000000; mem <= 0x51018000; mem += 0x8000) {
-        memcpy((uint8_t*)mem, &pIn[index], 1024);
-        index += 1024;
-    }
+    transpose_load(startRow);
 
     return CNN_OK;
 }
 
-static uint8_t AddTranspose(uint8_t *pIn, uint8_t *pOut, uint16_t inSize,
-        uint16_t outSize, uint16_t width) {
-    /* Data order in Ai85 memory (transpose is included):
-	input(series of 8 bit samples): (0,0) ...  (0,127)  (1,0) ... (1,127) ...... (127,0)...(127,127)    16384 samples
-	output (32bit word): 16K samples in a buffer. Later, each 1K goes to a seperate CNN memory group
-	0x0000:
-		(0,3)(0,2)(0,1)(0,0)
-		(0,67)(0,66)(0,65)(0,64)
-		(1,3)(1,2)(1,1)(1,0)
-		(1,67)(1,66)(1,65)(1,64)
-		....
-		(127,67)(127,66)(127,65)(127,64)
-	0x0400:
-		(0,7)(0,6)(0,5)(0,4)
-		(0,71)(0,70)(0,69)(0,68)
-		....
-		(127,71)(127,70)(127,69)(127,68)
-	...
-	0x3C00:
-		(0,63)(0,62)(0,61)(0,60)
-		(0,127)(0,126)(0,125)(0,124)
-		....
-		(127,127)(127,126)(127,125)(127,124)
-     */
-
-    static uint16_t row = 0, col = 0, total = 0;
-    uint16_t  secondHalf = 0, wordRow = 0, byteInWord = 0, group = 0, index = 0;
-    for (int i = 0; i < inSize; i++) {
-        /* is it above 63? */
-        if (col >= (width >> 1)) {
-            secondHalf = 1; // odd word rows
-        } else {
-            secondHalf = 0; // even word rows
-        }
-
-        /* which group (0-15) it should be */
-        group = (col % (width >> 1)) / 4;
-
-        /* which word row (0-255) within the group */
-        wordRow = secondHalf + (row << 1);
-
-        /* which byte (0-3) in the word */
-        byteInWord = col % 4;
-
-        /* find output index */
-        index = 1024 * group + 4 * wordRow + byteInWord;
-
-        /* place sample in correct output location */
-        pOut[index] = pIn[i];
-
-        total++;
-
-        /* increment row and col index */
-        col++;
-        if (col >= width) {
-            col = 0;
-            row++;
-        }
-    }
-
-    if (total >= outSize) {
-        /* sanity check */
-        if (row != width) {
-            PR_ERROR("ERROR: Rearranging!");
-        }
-
-        total = 0;
-        row = 0;
-        col = 0;
-        return 1;
-    } else {
-        return 0;
-    }
-}
-
 static uint8_t MicReadChunk(uint8_t *pBuff, uint16_t * avg)
 {
-    static uint16_t chunkCount = 0;
-    static uint16_t sum = 0;
-
-    static uint32_t index = 0;
-
-    int32_t sample = 0;
-    int16_t temp = 0;
     uint32_t rx_size = 0;
+    uint8_t ready = 0;
+    int8_t temp;
 
     /* sample not ready */
     if (!i2s_flag) {
@@ -872,33 +836,21 @@ static uint8_t MicReadChunk(uint8_t *pBuff, uint16_t * avg)
     //	printf("%d ", rx_size);
 
     /* read until fifo is empty or enough samples are collected */
-    while ((rx_size--) && (chunkCount < CHUNK)) {
-        /* Read microphone sample from I2S FIFO */
-        sample = (int32_t)MXC_I2S->fifoch0;
-        /* The actual value is 18 MSB of 32-bit word */
-        temp = sample >> 14;
-
-        /* Remove DC from microphone signal */
-        sample = HPF((int16_t)temp); // filter needs about 1K sample to converge
-
-        /* Discard first 10k samples due to microphone charging cap effect */
-        if (index++ < 10000)
-            continue;
-
-        /* absolute for averaging */
-        if (sample >= 0)
-            sum += sample;
-        else
-            sum -= sample;
-
-        /* Convert to 8 bit unsigned */
-        pBuff[chunkCount] = (uint8_t)((sample)*SAMPLE_SCALE_FACTOR/256);
+    while ((rx_size--) && !ready) {
+        /* Read microphone sample from I2S FIFO, filter and convert to 8 bit */
+        ready = kws_mic_sample((int32_t)MXC_I2S->fifoch0, pBuff, CHUNK, avg);
+    }
 
-        temp=(int8_t)pBuff[chunkCount];
+    /* if not enough samples, return 0 */
+    if (!ready) {
+        *avg = 0;
+        return 0;
+    }
 
-        chunkCount++;
+    /* record max and min */
+    for (int i = 0; i < CHUNK; i++) {
+        temp = (int8_t)pBuff[i];
 
-        /* record max and min */
         if (temp > Max) {
             Max = temp;
         }
@@ -906,62 +858,11 @@ static uint8_t MicReadChunk(uint8_t *pBuff, uint16_t * avg)
         if (temp < Min) {
             Min = temp;
         }
-
-    }
-
-    /* if not enough samples, return 0 */
-    if (chunkCount < CHUNK) {
-        *avg = 0;
-        return 0;
     }
 
-    /* enough samples are collected, calculate average and return 1 */
-    *avg = ((uint16_t)(sum / CHUNK));
-
-    chunkCount = 0;
-    sum = 0;
     return 1;
 }
 
-static void HPF_init(void) {
-    Coeff = 32604; //0.995
-    x0 = 0;
-    y0 = 0;
-    y1 = y0;
-    x1 = x0;
-}
-
-static int16_t HPF(int16_t input) {
-    int16_t Acc, output;
-    int32_t tmp;
-
-    /* a 1st order IIR high pass filter (100 Hz cutoff frequency)  */
-    /* y(n)=x(n)-x(n-1)+A*y(n-1) and A =.995*2^15 */
-
-    x0 = input;
-
-    tmp = (Coeff * y1);
-    Acc = (int16_t)((tmp + (1 << 14)) >> 15);
-    y0 = x0 - x1 + Acc;
-
-    /* Clipping */
-    if (y0 > 32767) {
-        y0 = 32767;
-    }
-
-    if (y0 < -32768) {
-        y0 = -32768;
-    }
-
-    /* Update filter state */
-    y1 = y0;
-    x1 = x0;
-
-    output = (int16_t)y0;
-
-    return (output);
-}
-
 static void fail(void)
 {
     PR_ERROR("fail");
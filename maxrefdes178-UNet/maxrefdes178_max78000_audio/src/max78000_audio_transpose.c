@@ -0,0 +1,199 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+#include <string.h>
+
+#include "max78000_audio_transpose.h"
+#include "max78000_debug.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define S_MODULE_NAME   "transpose"
+
+#if TRANSPOSE_WIDTH != (TRANSPOSE_GROUPS * 8)
+#error "TRANSPOSE_GROUPS must be TRANSPOSE_WIDTH / 8"
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+/* CNN data memory of each group, 4 groups per quadrant */
+static volatile uint32_t * const pCnnDataMem[TRANSPOSE_GROUPS] = {
+    (volatile uint32_t *) 0x50400000, (volatile uint32_t *) 0x50408000,
+    (volatile uint32_t *) 0x50410000, (volatile uint32_t *) 0x50418000,
+    (volatile uint32_t *) 0x50800000, (volatile uint32_t *) 0x50808000,
+    (volatile uint32_t *) 0x50810000, (volatile uint32_t *) 0x50818000,
+    (volatile uint32_t *) 0x50C00000, (volatile uint32_t *) 0x50C08000,
+    (volatile uint32_t *) 0x50C10000, (volatile uint32_t *) 0x50C18000,
+    (volatile uint32_t *) 0x51000000, (volatile uint32_t *) 0x51008000,
+    (volatile uint32_t *) 0x51010000, (volatile uint32_t *) 0x51018000,
+};
+#ifdef ENABLE_CNN_DIRECT_TRANSPOSE
+static volatile uint32_t * const * const pTransposeOut = pCnnDataMem;
+#else
+static uint8_t pAI85Buffer[TRANSPOSE_SIZE] __attribute__((aligned(4)));
+/* each 1KB of pAI85Buffer belongs to a memory group */
+static volatile uint32_t * const pTransposeOut[TRANSPOSE_GROUPS] = {
+    (volatile uint32_t *) &pAI85Buffer[0 * TRANSPOSE_GROUP_SIZE], (volatile uint32_t *) &pAI85Buffer[1 * TRANSPOSE_GROUP_SIZE],
+    (volatile uint32_t *) &pAI85Buffer[2 * TRANSPOSE_GROUP_SIZE], (volatile uint32_t *) &pAI85Buffer[3 * TRANSPOSE_GROUP_SIZE],
+    (volatile uint32_t *) &pAI85Buffer[4 * TRANSPOSE_GROUP_SIZE], (volatile uint32_t *) &pAI85Buffer[5 * TRANSPOSE_GROUP_SIZE],
+    (volatile uint32_t *) &pAI85Buffer[6 * TRANSPOSE_GROUP_SIZE], (volatile uint32_t *) &pAI85Buffer[7 * TRANSPOSE_GROUP_SIZE],
+    (volatile uint32_t *) &pAI85Buffer[8 * TRANSPOSE_GROUP_SIZE], (volatile uint32_t *) &pAI85Buffer[9 * TRANSPOSE_GROUP_SIZE],
+    (volatile uint32_t *) &pAI85Buffer[10 * TRANSPOSE_GROUP_SIZE], (volatile uint32_t *) &pAI85Buffer[11 * TRANSPOSE_GROUP_SIZE],
+    (volatile uint32_t *) &pAI85Buffer[12 * TRANSPOSE_GROUP_SIZE], (volatile uint32_t *) &pAI85Buffer[13 * TRANSPOSE_GROUP_SIZE],
+    (volatile uint32_t *) &pAI85Buffer[14 * TRANSPOSE_GROUP_SIZE], (volatile uint32_t *) &pAI85Buffer[15 * TRANSPOSE_GROUP_SIZE],
+};
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+uint8_t transpose_add(const uint8_t *pIn, uint16_t inSize, uint16_t outSize)
+{
+    /* Data order in Ai85 memory (transpose is included):
+	input(series of 8 bit samples): (0,0) ...  (0,127)  (1,0) ... (1,127) ...... (127,0)...(127,127)    16384 samples
+	output (32bit word): 16K samples, each 1K goes to a seperate CNN memory group (pTransposeOut)
+	0x0000:
+		(0,3)(0,2)(0,1)(0,0)
+		(0,67)(0,66)(0,65)(0,64)
+		(1,3)(1,2)(1,1)(1,0)
+		(1,67)(1,66)(1,65)(1,64)
+		....
+		(127,67)(127,66)(127,65)(127,64)
+	0x0400:
+		(0,7)(0,6)(0,5)(0,4)
+		(0,71)(0,70)(0,69)(0,68)
+		....
+		(127,71)(127,70)(127,69)(127,68)
+	...
+	0x3C00:
+		(0,63)(0,62)(0,61)(0,60)
+		(0,127)(0,126)(0,125)(0,124)
+		....
+		(127,127)(127,126)(127,125)(127,124)
+
+	A complete row fills word rows 2*row and 2*row+1 of every group, so whole rows
+	are assembled into 32-bit words, partial rows fall back to one sample at a time.
+     */
+
+    static uint16_t row = 0, col = 0, total = 0;
+    const uint16_t half = TRANSPOSE_WIDTH >> 1;
+    volatile uint32_t *pWord;
+    uint16_t shift;
+    int i = 0;
+
+    while (i < inSize) {
+        if ((col == 0) && ((inSize - i) >= TRANSPOSE_WIDTH) && (row < TRANSPOSE_WIDTH)) {
+            transpose_row(&pIn[i], row);
+            i += TRANSPOSE_WIDTH;
+
+            total += TRANSPOSE_WIDTH;
+            row++;
+            continue;
+        }
+
+        /* partial row, read-modify-write the byte in its word */
+        pWord = &pTransposeOut[(col % half) >> 2][(row << 1) + (col >= half)];
+        shift = (col & 3) << 3;
+        *pWord = (*pWord & ~(0xFFUL << shift)) | ((uint32_t) pIn[i] << shift);
+        i++;
+
+        total++;
+
+        /* increment row and col index */
+        col++;
+        if (col >= TRANSPOSE_WIDTH) {
+            col = 0;
+            row++;
+        }
+    }
+
+    if (total >= outSize) {
+        /* sanity check */
+        if (row != TRANSPOSE_WIDTH) {
+            PR_ERROR("ERROR: Rearranging!");
+        }
+
+        total = 0;
+        row = 0;
+        col = 0;
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+void transpose_row(const uint8_t *pIn, uint16_t row)
+{
+    /* whole row, two words per group, see transpose_add */
+    const uint16_t half = TRANSPOSE_WIDTH >> 1;
+    volatile uint32_t *pWord;
+
+    for (uint16_t group = 0; group < TRANSPOSE_GROUPS; group++) {
+        pWord = &pTransposeOut[group][row << 1];
+        pWord[0] = ((uint32_t) pIn[0]) | ((uint32_t) pIn[1] << 8) |
+                ((uint32_t) pIn[2] << 16) | ((uint32_t) pIn[3] << 24);
+        pWord[1] = ((uint32_t) pIn[half + 0]) | ((uint32_t) pIn[half + 1] << 8) |
+                ((uint32_t) pIn[half + 2] << 16) | ((uint32_t) pIn[half + 3] << 24);
+        pIn += 4;
+    }
+}
+
+void transpose_load(uint16_t startRow)
+{
+#ifdef ENABLE_CNN_DIRECT_TRANSPOSE
+    /* transpose_add already placed the samples in CNN data memory */
+    (void) startRow;
+#else
+    /* pAI85Buffer is 16KB, each 1KB belongs to a memory group, a row takes 8 bytes in each group */
+    /* rows are a ring starting at startRow, the oldest row goes first */
+    uint16_t head = 8 * startRow;
+
+    for (int group = 0; group < TRANSPOSE_GROUPS; group++) {
+        memcpy((uint8_t *) pCnnDataMem[group], &pAI85Buffer[group * TRANSPOSE_GROUP_SIZE + head],
+                TRANSPOSE_GROUP_SIZE - head);
+        memcpy((uint8_t *) pCnnDataMem[group] + TRANSPOSE_GROUP_SIZE - head,
+                &pAI85Buffer[group * TRANSPOSE_GROUP_SIZE], head);
+    }
+#endif
+}
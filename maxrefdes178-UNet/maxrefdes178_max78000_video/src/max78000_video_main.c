@@ -52,6 +52,9 @@
 #include "max78000_video_cnn.h"
 #include "max78000_video_weights.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+#include "maxrefdes178_trace.h"
+#include "maxrefdes178_unet_mask.h"
 #include "maxrefdes178_utility.h"
 #include "maxrefdes178_version.h"
 
@@ -223,6 +226,7 @@ static volatile int8_t button_pressed = 0;
 
 static uint32_t time_counter = 0;
 static int8_t enable_cnn = 0;
+static uint8_t cnn_interval = 1;  // CNN runs on every Nth frame
 
 static int8_t flash_led = 0;
 static int8_t camera_vflip = 1;
@@ -230,8 +234,14 @@ static int8_t enable_video = 0;
 
 static int8_t enable_sleep = 0;
 static uint8_t *qspi_payload_buffer = NULL;
+static uint8_t qspi_command_buffer[16];  // Small payloads, received without stopping the camera
+static qspi_credit_t qspi_credit;
+static unet_mask_result_t unet_mask;
 static version_t version = {S_VERSION_MAJOR, S_VERSION_MINOR, S_VERSION_BUILD};
 static char demo_name[] = UNET_DEMO_NAME;
+#ifdef ENABLE_TRACE
+static trace_dump_t trace_dump;
+#endif
 static uint32_t camera_clock = 15 * 1000 * 1000;
 
 #ifdef PRINT_TIME_CNN
@@ -247,6 +257,7 @@ static void fail(void);
 static void send_img(void);
 static void run_cnn(int x_offset, int y_offset);
 static void run_demo(void);
+static int send_credited(uint8_t *data, uint32_t data_size, uint8_t packet_type);
 
 
 //-----------------------------------------------------------------------------
@@ -423,6 +434,8 @@ int main(void)
     // Successfully initialize the program
     PR_INFO("Initialization complete");
 
+    TRACE_INIT(TRACE_SOURCE_MAX78000_VIDEO);
+
     run_demo();
 
     return 0;
@@ -449,9 +462,14 @@ static void run_demo(void)
     max78000_statistics_t max78000_statistics = {0};
     qspi_packet_header_t qspi_rx_header;
     qspi_state_e qspi_rx_state;
+    uint8_t *qspi_rx_buffer;
+    int8_t run_cnn_frame;
 
 
+    qspi_credit_init(&qspi_credit);
+
     camera_start_capture_image();
+    TRACE_EVENT(TRACE_EVENT_CAPTURE_START, 0);
 
     while (1) { //Capture image and run CNN
 
@@ -460,18 +478,25 @@ static void run_demo(void)
         if (qspi_rx_state == QSPI_STATE_CS_DEASSERTED_HEADER) {
             qspi_rx_header = qspi_slave_get_rx_header();
 
-            // Use camera interface buffer for QSPI payload
-            MXC_PCIF_Stop();
+            // Use camera interface buffer for large QSPI payloads
+            if (qspi_rx_header.info.packet_size <= sizeof(qspi_command_buffer)) {
+                qspi_rx_buffer = qspi_command_buffer;
+            } else {
+                qspi_rx_buffer = qspi_payload_buffer;
+                MXC_PCIF_Stop();
+            }
 
-            qspi_slave_set_rx_data(qspi_payload_buffer, qspi_rx_header.info.packet_size);
+            qspi_slave_set_rx_data(qspi_rx_buffer, qspi_rx_header.info.packet_size);
             qspi_slave_trigger();
             qspi_slave_wait_rx();
 
             // Check payload crc again
-            if (qspi_rx_header.payload_crc16 != crc16_sw(qspi_payload_buffer, qspi_rx_header.info.packet_size)) {
+            if (qspi_rx_header.payload_crc16 != crc16_sw(qspi_rx_buffer, qspi_rx_header.info.packet_size)) {
                 PR_ERROR("Invalid payload crc %x", qspi_rx_header.payload_crc16);
                 qspi_slave_set_rx_state(QSPI_STATE_IDLE);
-                camera_start_capture_image();
+                if (qspi_rx_buffer == qspi_payload_buffer) {
+                    camera_start_capture_image();
+                }
                 continue;
             }
 
@@ -480,10 +505,21 @@ static void run_demo(void)
                 case QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_CMD:
                     PR_INFO("Command not supported");
                     break;
+                case QSPI_PACKET_TYPE_VIDEO_CNN_INTERVAL_CMD:
+                    if (qspi_rx_header.info.packet_size != sizeof(cnn_interval)) {
+                        PR_ERROR("Invalid cnn interval size %u", qspi_rx_header.info.packet_size);
+                        break;
+                    }
+                    cnn_interval = MIN(MAX(qspi_rx_buffer[0], 1), GOVERNOR_CNN_INTERVAL_MAX);
+                    PR_INFO("cnn interval %d", cnn_interval);
+                    break;
+                case QSPI_PACKET_TYPE_ACKNOWLEDGE:
+                    qspi_credit_grant(&qspi_credit, qspi_rx_buffer, qspi_rx_header.info.packet_size);
+                    break;
                 case QSPI_PACKET_TYPE_TEST:
                     PR_INFO("test data received %d", qspi_rx_header.info.packet_size);
                     for (int i = 0; i < qspi_rx_header.info.packet_size; i++) {
-                        printf("%02hhX ", qspi_payload_buffer[i]);
+                        printf("%02hhX ", qspi_rx_buffer[i]);
                     }
                     printf("\n");
                     break;
@@ -493,7 +529,9 @@ static void run_demo(void)
             }
 
             qspi_slave_set_rx_state(QSPI_STATE_IDLE);
-            camera_start_capture_image();
+            if (qspi_rx_buffer == qspi_payload_buffer) {
+                camera_start_capture_image();
+            }
 
         } else if (qspi_rx_state == QSPI_STATE_COMPLETED) {
             qspi_rx_header = qspi_slave_get_rx_header();
@@ -534,6 +572,7 @@ static void run_demo(void)
                 // Also CNN
                 PR_INFO("disable cnn");
                 enable_cnn = 0;
+                cnn_release();
                 break;
             case QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD:
                 PR_INFO("enable cnn");
@@ -544,6 +583,7 @@ static void run_demo(void)
                 enable_cnn = 0;
                 GPIO_CLR(gpio_red);
                 GPIO_CLR(gpio_green);
+                cnn_release();
                 break;
             case QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD:
             	PR_INFO("command not supported!");
@@ -627,12 +667,21 @@ static void run_demo(void)
 
         if (camera_is_image_rcv()) { // Check whether image is ready
             capture_completed_time = GET_RTC_MS();
+            TRACE_NEXT_FRAME();
+            TRACE_EVENT(TRACE_EVENT_CAPTURE_END, 0);
+
+            // Governor may run the CNN on every Nth frame only, and the MAX32666 must have shown the
+            // previous mask
+            run_cnn_frame = enable_cnn && ((time_counter % cnn_interval) == 0) &&
+                    qspi_credit_available(&qspi_credit, QSPI_PACKET_TYPE_VIDEO_UNET_MASK_RES, GET_RTC_MS());
 
             send_img();
 
             qspi_completed_time = GET_RTC_MS();
 
-            if (enable_cnn) {
+            // Serial, unlike the other demos: the CNN output is unloaded into the camera buffer, a
+            // separate 25600 byte buffer next to the 115200 byte frame does not fit in SRAM
+            if (run_cnn_frame) {
 
 
             	PR_INFO("CNN_EN");
@@ -656,14 +705,20 @@ static void run_demo(void)
                 PR_DEBUG("Total   : %lu\n\n", max78000_statistics.total_duration_us);
 
 				PR_INFO("Send Stat");
-                qspi_slave_send_packet((uint8_t *) &max78000_statistics, sizeof(max78000_statistics),
+                send_credited((uint8_t *) &max78000_statistics, sizeof(max78000_statistics),
                         QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES);
+#ifdef ENABLE_TRACE
+                trace_drain(&trace_dump);
+                qspi_slave_send_packet((uint8_t *) &trace_dump, TRACE_DUMP_SIZE(trace_dump.count),
+                        QSPI_PACKET_TYPE_VIDEO_TRACE_RES);
+#endif
             }
 
             time_counter++;
 
             camera_start_capture_image();
             capture_started_time = GET_RTC_MS();
+            TRACE_EVENT(TRACE_EVENT_CAPTURE_START, 0);
 
         }
     }
@@ -678,8 +733,8 @@ static void send_img(void)
     // Get the details of the image from the camera driver.
     camera_get_image(&raw, &imgLen, &w, &h);
 
-    qspi_slave_send_packet(raw, imgLen, QSPI_PACKET_TYPE_VIDEO_DATA_RES);
- 
+    // Skipped if the MAX32666 has not shown the previous frame yet
+    send_credited(raw, imgLen, QSPI_PACKET_TYPE_VIDEO_DATA_RES);
 }
 
 static void run_cnn(int x_offset, int y_offset)
@@ -690,6 +745,7 @@ static void run_cnn(int x_offset, int y_offset)
     int8_t r, g, b;
     uint32_t number;
     uint32_t w, h;
+    uint32_t size;
 
     // Get the details of the image from the camera driver.
     camera_get_image(&raw, &number, &w, &h);
@@ -698,13 +754,9 @@ static void run_cnn(int x_offset, int y_offset)
     uint32_t pass_time = GET_RTC_MS();
 #endif
 
-    // Enable CNN clock
-    MXC_SYS_ClockEnable(MXC_SYS_PERIPH_CLOCK_CNN);
-
-    cnn_init(); // Bring state machine into consistent state
-   // cnn_load_weights(); // No need to reload kernels
-    cnn_load_bias(); //load bias
-    cnn_configure(); // Configure state machine
+    // Enable clock and configure CNN, done only once while the CNN stays enabled
+    cnn_prepare();
+    TRACE_EVENT(TRACE_EVENT_CNN_LOAD, 0);
 
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN init : %d", GET_RTC_MS() - pass_time);
@@ -742,6 +794,7 @@ static void run_cnn(int x_offset, int y_offset)
 	printf("Total samples loaded: %d \r\n", cnt);
 
 	cnn_start();
+    TRACE_EVENT(TRACE_EVENT_CNN_START, 0);
 
 
 #ifdef PRINT_TIME_CNN
@@ -752,6 +805,8 @@ static void run_cnn(int x_offset, int y_offset)
     while (cnn_time == 0)
         __WFI(); // Wait for CNN done
 
+    TRACE_EVENT(TRACE_EVENT_CNN_DONE, 0);
+
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN wait : %d", GET_RTC_MS() - pass_time);
     pass_time = GET_RTC_MS();
@@ -775,10 +830,9 @@ static void run_cnn(int x_offset, int y_offset)
 	PR_INFO("load_inference_time: %d us", cnn_time);
 	
     cnn_unload((uint32_t*) raw);
+    TRACE_EVENT(TRACE_EVENT_CNN_UNLOAD, 0);
 
-    cnn_stop();
-    // Disable CNN clock to save power
-    MXC_SYS_ClockDisable(MXC_SYS_PERIPH_CLOCK_CNN);
+    cnn_stop(); // Keep clock and configuration for the next frame
 
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN unload : %d", GET_RTC_MS() - pass_time);
@@ -786,8 +840,24 @@ static void run_cnn(int x_offset, int y_offset)
 #endif
 
 
-    MXC_Delay(MXC_DELAY_MSEC(500));
-    qspi_slave_send_packet(raw, UNET_IMAGE_SIZE_X*UNET_IMAGE_SIZE_Y*4, QSPI_PACKET_TYPE_VIDEO_ML_RES); // r,g,b,unknown per pixel
-	//qspi_slave_send_packet(raw, 115200/4, QSPI_PACKET_TYPE_VIDEO_ML_RES);
-    MXC_Delay(MXC_DELAY_MSEC(500));
+    // r,g,b,unknown planes reduced to the class map
+    size = unet_mask_encode(&unet_mask, (int8_t *) raw, 1);
+    send_credited((uint8_t *) &unet_mask, size, QSPI_PACKET_TYPE_VIDEO_UNET_MASK_RES);
+}
+
+// Sends the packet if the MAX32666 has room for its class, returns E_BUSY otherwise
+static int send_credited(uint8_t *data, uint32_t data_size, uint8_t packet_type)
+{
+    int ret;
+
+    if (!qspi_credit_available(&qspi_credit, packet_type, GET_RTC_MS())) {
+        return E_BUSY;
+    }
+
+    ret = qspi_slave_send_packet(data, data_size, packet_type);
+    if (ret == E_NO_ERROR) {
+        qspi_credit_use(&qspi_credit, packet_type, GET_RTC_MS());
+    }
+
+    return ret;
 }
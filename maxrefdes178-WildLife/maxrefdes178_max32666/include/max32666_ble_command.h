@@ -58,6 +58,9 @@
 //-----------------------------------------------------------------------------
 int ble_command_send_single_packet(ble_command_e ble_command, uint32_t payload_size, uint8_t *payload);
 
+// Payload is copied, the packets are queued by ble_command_worker as core1 sends them
+int ble_command_send_multi_packet(ble_command_e ble_command, uint32_t payload_size, uint8_t *payload);
+
 int ble_command_reset(void);
 
 int ble_command_init(void);
@@ -50,6 +50,7 @@
 #include "max32666_qspi_master.h"
 #include "max32666_timer_led_button.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_scheduler.h"
 
 
 //-----------------------------------------------------------------------------
@@ -86,6 +87,7 @@ void power_off_timer(void);
 void button_x_int_handler(void *cbdata)
 {
     button_x_int = 1;
+    scheduler_post(MAX32666_EVENT_INPUT);
 }
 
 void button_power_int_handler(void *cbdata)
@@ -99,6 +101,7 @@ void button_power_int_handler(void *cbdata)
         MXC_TMR_Start(MAX32666_TIMER_BUTTON_POWER);
 
         button_power_int = 1;
+        scheduler_post(MAX32666_EVENT_INPUT);
     }
 }
 
@@ -0,0 +1,80 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAX78000_AUDIO_KWS_H_
+#define _MAX78000_AUDIO_KWS_H_
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+
+#include "max78000_tornadocnn.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define SAMPLE_SCALE_FACTOR         5//4//3       // multiplies 16-bit samples by this scale factor before converting to 8-bit
+#define KWS_HOP_CHUNKS              16      // [ENABLE_CONTINUOUS_KWS] number of CHUNKs between inferences, window overlaps by the rest
+#define KWS_MAX_DUTY_CYCLE          50      // [ENABLE_CONTINUOUS_KWS] max percentage of audio time spent in CNN, delays hops if exceeded
+#define KWS_SMOOTHING_WINDOW        3       // [ENABLE_CONTINUOUS_KWS] number of inferences averaged before check_inference decides
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Reset the high pass filter and the chunk in progress, first samples are discarded again
+void kws_mic_init(void);
+
+// Filter and scale one I2S word into pBuff, returns 1 with the average level once size samples are collected
+uint8_t kws_mic_sample(int32_t word, uint8_t *pBuff, uint16_t size, uint16_t *avg);
+
+// Transpose a CHUNK into the oldest row of the sliding window, returns 1 when the window is due for CNN
+uint8_t kws_window_add(const uint8_t *pIn, uint32_t cnn_duration_us);
+
+// Oldest row of the sliding window, the window starts there for transpose_load
+uint16_t kws_window_start(void);
+
+// Add posteriors to the history, returns 1 with their average once KWS_SMOOTHING_WINDOW are collected
+uint8_t kws_smooth(const q15_t *ml_soft, q15_t *smooth_soft, int32_t *smooth_data);
+
+// Forget the posteriors, overlapping windows would detect the same keyword again
+void kws_smooth_clear(void);
+
+// Restart the sliding window and the posterior history
+void kws_reset(void);
+
+#endif /* _MAX78000_AUDIO_KWS_H_ */
@@ -123,6 +123,12 @@ int cnn_load_bias(void);
 /* Start accelerator processing */
 int cnn_start(void);
 
+/* Enable clock and configure accelerator, skipped if still configured from the previous frame */
+int cnn_prepare(void);
+
+/* Stop accelerator and disable its clock, next cnn_prepare() does full configuration */
+int cnn_release(void);
+
 /* Force stop accelerator */
 int cnn_stop(void);
 
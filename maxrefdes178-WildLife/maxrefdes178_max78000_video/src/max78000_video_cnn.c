@@ -71,6 +71,7 @@
 // Global variables
 //-----------------------------------------------------------------------------
 volatile uint32_t cnn_time; // Stopwatch
+static int cnn_warm = 0; // Configuration is in place, only re-arm between frames
 
 
 //-----------------------------------------------------------------------------
@@ -761,6 +762,30 @@ int cnn_start(void)
   return CNN_OK;
 }
 
+int cnn_prepare(void)
+{
+  if (cnn_warm) {
+    return CNN_OK; // Weights, bias and layer configuration are retained, cnn_start() re-arms
+  }
+
+  MXC_SYS_ClockEnable(MXC_SYS_PERIPH_CLOCK_CNN); // Enable CNN clock
+  cnn_init(); // Bring state machine into consistent state
+  cnn_load_bias();
+  cnn_configure(); // Configure state machine
+  cnn_warm = 1;
+
+  return CNN_OK;
+}
+
+int cnn_release(void)
+{
+  cnn_stop();
+  MXC_SYS_ClockDisable(MXC_SYS_PERIPH_CLOCK_CNN); // Disable CNN clock to save power
+  cnn_warm = 0;
+
+  return CNN_OK;
+}
+
 // Custom unload for this network: 32-bit data, shape: [5, 1, 1]
 int cnn_unload(uint32_t *out_buf)
 {
@@ -791,6 +816,8 @@ int cnn_enable(uint32_t clock_source, uint32_t clock_divider)
 
   NVIC_SetVector(CNN_IRQn, CNN_ISR); // Set CNN complete vector
 
+  cnn_warm = 0;
+
   return CNN_OK;
 }
 
@@ -832,6 +859,8 @@ int cnn_disable(void)
   MXC_GCFR->reg1 = 0x0; // Mask memory
   MXC_GCFR->reg3 = 0x0; // Reset
 
+  cnn_warm = 0;
+
   return CNN_OK;
 }
 
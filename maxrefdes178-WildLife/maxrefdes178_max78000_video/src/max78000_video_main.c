@@ -50,10 +50,14 @@
 #include "max78000_debug.h"
 #include "max78000_qspi_slave.h"
 #include "max78000_video_cnn.h"
+#include "max78000_video_cnn_input.h"
 #include "max78000_video_weights.h"
 #include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+#include "maxrefdes178_trace.h"
 #include "maxrefdes178_utility.h"
 #include "maxrefdes178_version.h"
+#include "maxrefdes178_video_codec.h"
 
 
 //-----------------------------------------------------------------------------
@@ -61,6 +65,12 @@
 //-----------------------------------------------------------------------------
 #define S_MODULE_NAME          "main"
 
+// Frames estimated to compress to more than this are sent raw
+#define VIDEO_COMPRESSION_MAX_SIZE  (LCD_DATA_SIZE / 2)
+
+// Camera frame period, a frame every 40 ms at the 15 MHz camera clock
+#define CAMERA_FRAME_PERIOD_MS(clock)  ((40UL * 15 * 1000 * 1000) / (clock))
+
 //#define PRINT_TIME_CNN
 
 #define PIC_HEIGHT 192
@@ -223,19 +233,28 @@ static volatile int8_t button_pressed = 0;
 
 static uint32_t time_counter = 0;
 static int8_t enable_cnn = 0;
+static uint8_t cnn_interval = 1;  // CNN runs on every Nth frame
 
 static int8_t flash_led = 0;
 static int8_t camera_vflip = 1;
 static int8_t enable_video = 0;
+static int8_t overlap_capture = 1;
 
 static int8_t enable_sleep = 0;
+static int8_t enable_compression = 0;
 static uint8_t *qspi_payload_buffer = NULL;
+static uint8_t qspi_command_buffer[16];  // Small payloads, received without stopping the camera
+static qspi_credit_t qspi_credit;
 static version_t version = {S_VERSION_MAJOR, S_VERSION_MINOR, S_VERSION_BUILD};
 static char demo_name[] = WILDLIFE_DEMO_NAME;
+#ifdef ENABLE_TRACE
+static trace_dump_t trace_dump;
+#endif
 static uint32_t camera_clock = 15 * 1000 * 1000;
 
 #ifdef PRINT_TIME_CNN
 #define PR_TIMER(fmt, args...) if((time_counter % 10) == 0) printf("T[%-5s:%4d] " fmt "\r\n", S_MODULE_NAME, __LINE__, ##args )
+static uint32_t pass_time = 0;
 #endif
 
 
@@ -245,8 +264,10 @@ static uint32_t camera_clock = 15 * 1000 * 1000;
 
 static void fail(void);
 static void send_img(void);
-static void run_cnn(int x_offset, int y_offset);
+static void run_cnn_load(int x_offset, int y_offset);
+static void run_cnn_result(void);
 static void run_demo(void);
+static int send_credited(uint8_t *data, uint32_t data_size, uint8_t packet_type);
 
 
 //-----------------------------------------------------------------------------
@@ -423,6 +444,8 @@ int main(void)
     // Successfully initialize the program
     PR_INFO("Initialization complete");
 
+    TRACE_INIT(TRACE_SOURCE_MAX78000_VIDEO);
+
     run_demo();
 
     return 0;
@@ -444,14 +467,24 @@ static void run_demo(void)
 {
     uint32_t capture_started_time = GET_RTC_MS();
     uint32_t cnn_completed_time = 0;
+    uint32_t qspi_started_time = 0;
     uint32_t qspi_completed_time = 0;
     uint32_t capture_completed_time = 0;
+    uint32_t next_capture_started_time = 0;
+    uint32_t cnn_result_started_time;
+    uint32_t cnn_result_duration = 0;  // Of the last frame the CNN ran on
     max78000_statistics_t max78000_statistics = {0};
     qspi_packet_header_t qspi_rx_header;
     qspi_state_e qspi_rx_state;
+    uint8_t *qspi_rx_buffer;
+    int8_t run_cnn_frame;
+    int8_t capture_overlapped;
 
 
+    qspi_credit_init(&qspi_credit);
+
     camera_start_capture_image();
+    TRACE_EVENT(TRACE_EVENT_CAPTURE_START, 0);
 
     while (1) { //Capture image and run CNN
 
@@ -460,18 +493,25 @@ static void run_demo(void)
         if (qspi_rx_state == QSPI_STATE_CS_DEASSERTED_HEADER) {
             qspi_rx_header = qspi_slave_get_rx_header();
 
-            // Use camera interface buffer for QSPI payload
-            MXC_PCIF_Stop();
+            // Use camera interface buffer for large QSPI payloads
+            if (qspi_rx_header.info.packet_size <= sizeof(qspi_command_buffer)) {
+                qspi_rx_buffer = qspi_command_buffer;
+            } else {
+                qspi_rx_buffer = qspi_payload_buffer;
+                MXC_PCIF_Stop();
+            }
 
-            qspi_slave_set_rx_data(qspi_payload_buffer, qspi_rx_header.info.packet_size);
+            qspi_slave_set_rx_data(qspi_rx_buffer, qspi_rx_header.info.packet_size);
             qspi_slave_trigger();
             qspi_slave_wait_rx();
 
             // Check payload crc again
-            if (qspi_rx_header.payload_crc16 != crc16_sw(qspi_payload_buffer, qspi_rx_header.info.packet_size)) {
+            if (qspi_rx_header.payload_crc16 != crc16_sw(qspi_rx_buffer, qspi_rx_header.info.packet_size)) {
                 PR_ERROR("Invalid payload crc %x", qspi_rx_header.payload_crc16);
                 qspi_slave_set_rx_state(QSPI_STATE_IDLE);
-                camera_start_capture_image();
+                if (qspi_rx_buffer == qspi_payload_buffer) {
+                    camera_start_capture_image();
+                }
                 continue;
             }
 
@@ -480,10 +520,21 @@ static void run_demo(void)
                 case QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_CMD:
                     PR_INFO("Command not supported");
                     break;
+                case QSPI_PACKET_TYPE_VIDEO_CNN_INTERVAL_CMD:
+                    if (qspi_rx_header.info.packet_size != sizeof(cnn_interval)) {
+                        PR_ERROR("Invalid cnn interval size %u", qspi_rx_header.info.packet_size);
+                        break;
+                    }
+                    cnn_interval = MIN(MAX(qspi_rx_buffer[0], 1), GOVERNOR_CNN_INTERVAL_MAX);
+                    PR_INFO("cnn interval %d", cnn_interval);
+                    break;
+                case QSPI_PACKET_TYPE_ACKNOWLEDGE:
+                    qspi_credit_grant(&qspi_credit, qspi_rx_buffer, qspi_rx_header.info.packet_size);
+                    break;
                 case QSPI_PACKET_TYPE_TEST:
                     PR_INFO("test data received %d", qspi_rx_header.info.packet_size);
                     for (int i = 0; i < qspi_rx_header.info.packet_size; i++) {
-                        printf("%02hhX ", qspi_payload_buffer[i]);
+                        printf("%02hhX ", qspi_rx_buffer[i]);
                     }
                     printf("\n");
                     break;
@@ -493,7 +544,9 @@ static void run_demo(void)
             }
 
             qspi_slave_set_rx_state(QSPI_STATE_IDLE);
-            camera_start_capture_image();
+            if (qspi_rx_buffer == qspi_payload_buffer) {
+                camera_start_capture_image();
+            }
 
         } else if (qspi_rx_state == QSPI_STATE_COMPLETED) {
             qspi_rx_header = qspi_slave_get_rx_header();
@@ -534,6 +587,7 @@ static void run_demo(void)
                 // Also CNN
                 PR_INFO("disable cnn");
                 enable_cnn = 0;
+                cnn_release();
                 break;
             case QSPI_PACKET_TYPE_VIDEO_ENABLE_CNN_CMD:
                 PR_INFO("enable cnn");
@@ -544,6 +598,7 @@ static void run_demo(void)
                 enable_cnn = 0;
                 GPIO_CLR(gpio_red);
                 GPIO_CLR(gpio_green);
+                cnn_release();
                 break;
             case QSPI_PACKET_TYPE_VIDEO_FACEID_SUBJECTS_CMD:
             	PR_INFO("command not supported!");
@@ -590,6 +645,14 @@ static void run_demo(void)
                 camera_vflip = 0;
                 camera_set_vflip(camera_vflip);
                 break;
+            case QSPI_PACKET_TYPE_VIDEO_ENABLE_COMPRESSION_CMD:
+                PR_INFO("enable compression");
+                enable_compression = 1;
+                break;
+            case QSPI_PACKET_TYPE_VIDEO_DISABLE_COMPRESSION_CMD:
+                PR_INFO("disable compression");
+                enable_compression = 0;
+                break;
             case QSPI_PACKET_TYPE_VIDEO_DEBUG_CMD:
                 PR_INFO("dont sleep for %ds to let debugger connection", MAX78000_SLEEP_DEFER_DURATION);
                 enable_sleep = 0;
@@ -627,26 +690,55 @@ static void run_demo(void)
 
         if (camera_is_image_rcv()) { // Check whether image is ready
             capture_completed_time = GET_RTC_MS();
+            TRACE_NEXT_FRAME();
+            TRACE_EVENT(TRACE_EVENT_CAPTURE_END, 0);
+
+            // Governor may run the CNN on every Nth frame only
+            run_cnn_frame = enable_cnn && ((time_counter % cnn_interval) == 0);
+
+            // Compression overwrites the camera buffer, CNN input is loaded before
+            if (run_cnn_frame && enable_compression) {
+                run_cnn_load(0, 0);
+            }
+
+            qspi_started_time = GET_RTC_MS();
 
             send_img();
 
             qspi_completed_time = GET_RTC_MS();
 
-            if (enable_cnn) {
+            if (run_cnn_frame && !enable_compression) {
+                run_cnn_load(0, 0);
+            }
 
+            // Frame is sent and streamed into CNN data memory, camera buffer is free. Capture the
+            // next frame while the CNN result is processed only if the result would run past the
+            // next camera frame start. Otherwise the serial loop catches that frame too and an
+            // earlier capture start only waits longer for it.
+            cnn_result_started_time = GET_RTC_MS();
+            capture_overlapped = overlap_capture && run_cnn_frame &&
+                    (((cnn_result_started_time - capture_completed_time) + cnn_result_duration) >
+                    CAMERA_FRAME_PERIOD_MS(camera_clock));
+            if (capture_overlapped) {
+                camera_start_capture_image();
+                next_capture_started_time = GET_RTC_MS();
+                TRACE_EVENT(TRACE_EVENT_CAPTURE_START, 0);
+            }
 
-            	PR_INFO("CNN_EN");
-                run_cnn(0, 0);
+            if (run_cnn_frame) {
+                run_cnn_result();
             }
-            else
-            	PR_INFO("CNN_DIS");
 
             cnn_completed_time = GET_RTC_MS();
+            if (run_cnn_frame) {
+                cnn_result_duration = cnn_completed_time - cnn_result_started_time;
+            }
 
             if (time_counter % 10 == 0) {
                 max78000_statistics.capture_duration_us = (capture_completed_time - capture_started_time) * 1000;
-                max78000_statistics.communication_duration_us = (qspi_completed_time - capture_completed_time) * 1000;
+                max78000_statistics.communication_duration_us = (qspi_completed_time - qspi_started_time) * 1000;
                 max78000_statistics.cnn_duration_us = cnn_time; //(cnn_completed_time - qspi_completed_time) * 1000;
+                // Capture start to result of this frame, the capture overlapped the previous CNN run
                 max78000_statistics.total_duration_us = (cnn_completed_time - capture_started_time) * 1000;
 
                 PR_DEBUG("Capture : %lu", max78000_statistics.capture_duration_us);
@@ -654,15 +746,24 @@ static void run_demo(void)
                 PR_DEBUG("QSPI    : %lu", max78000_statistics.communication_duration_us);
                 PR_DEBUG("Total   : %lu\n\n", max78000_statistics.total_duration_us);
 
-                qspi_slave_send_packet((uint8_t *) &max78000_statistics, sizeof(max78000_statistics),
+                send_credited((uint8_t *) &max78000_statistics, sizeof(max78000_statistics),
                         QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES);
+#ifdef ENABLE_TRACE
+                trace_drain(&trace_dump);
+                qspi_slave_send_packet((uint8_t *) &trace_dump, TRACE_DUMP_SIZE(trace_dump.count),
+                        QSPI_PACKET_TYPE_VIDEO_TRACE_RES);
+#endif
             }
 
             time_counter++;
 
-            camera_start_capture_image();
-            capture_started_time = GET_RTC_MS();
-
+            if (capture_overlapped) {
+                capture_started_time = next_capture_started_time;
+            } else {
+                camera_start_capture_image();
+                capture_started_time = GET_RTC_MS();
+                TRACE_EVENT(TRACE_EVENT_CAPTURE_START, 0);
+            }
         }
     }
 }
@@ -672,37 +773,66 @@ static void send_img(void)
     uint8_t   *raw;
     uint32_t  imgLen;
     uint32_t  w, h;
+    uint32_t  compressed_size = 0;
+
+    // MAX32666 has not shown the previous frame yet, skip this one
+    if (!qspi_credit_available(&qspi_credit, QSPI_PACKET_TYPE_VIDEO_DATA_RES, GET_RTC_MS())) {
+        return;
+    }
 
     // Get the details of the image from the camera driver.
     camera_get_image(&raw, &imgLen, &w, &h);
 
-    qspi_slave_send_packet(raw, imgLen, QSPI_PACKET_TYPE_VIDEO_DATA_RES);
-//    MXC_Delay(MXC_DELAY_MSEC(3)); // Yield SPI DMA RAM read
+    // Compressed in place, frames that would not get small enough are sent raw
+    if (enable_compression && (imgLen == LCD_DATA_SIZE) &&
+        (video_codec_estimate(raw) <= VIDEO_COMPRESSION_MAX_SIZE)) {
+        compressed_size = video_codec_encode(raw);
+    }
+
+    if (compressed_size) {
+        send_credited(raw, compressed_size, QSPI_PACKET_TYPE_VIDEO_COMPRESSED_DATA_RES);
+    } else {
+        send_credited(raw, imgLen, QSPI_PACKET_TYPE_VIDEO_DATA_RES);
+    }
+}
+
+// Sends the packet if the MAX32666 has room for its class, returns E_BUSY otherwise
+static int send_credited(uint8_t *data, uint32_t data_size, uint8_t packet_type)
+{
+    int ret;
+
+    if (!qspi_credit_available(&qspi_credit, packet_type, GET_RTC_MS())) {
+        return E_BUSY;
+    }
+
+    ret = qspi_slave_send_packet(data, data_size, packet_type);
+    if (ret == E_NO_ERROR) {
+        qspi_credit_use(&qspi_credit, packet_type, GET_RTC_MS());
+    }
+
+    return ret;
 }
 
-static void run_cnn(int x_offset, int y_offset)
+static void run_cnn_load(int x_offset, int y_offset)
 {
     uint8_t *data;
     uint8_t *raw;
-    uint8_t ur, ug, ub;
-    int8_t r, g, b;
     uint32_t number;
+    static uint32_t line_r[PIC_WIDTH / 3 / 4];
+    static uint32_t line_g[PIC_WIDTH / 3 / 4];
+    static uint32_t line_b[PIC_WIDTH / 3 / 4];
     uint32_t w, h;
 
     // Get the details of the image from the camera driver.
     camera_get_image(&raw, &number, &w, &h);
 
 #ifdef PRINT_TIME_CNN
-    uint32_t pass_time = GET_RTC_MS();
+    pass_time = GET_RTC_MS();
 #endif
 
-    // Enable CNN clock
-    MXC_SYS_ClockEnable(MXC_SYS_PERIPH_CLOCK_CNN);
-
-    cnn_init(); // Bring state machine into consistent state
-   // cnn_load_weights(); // No need to reload kernels
-    cnn_load_bias(); //load bias
-    cnn_configure(); // Configure state machine
+    // Enable clock and configure CNN, done only once while the CNN stays enabled
+    cnn_prepare();
+    TRACE_EVENT(TRACE_EVENT_CNN_LOAD, 0);
 
     cnn_start();
 
@@ -711,68 +841,33 @@ static void run_cnn(int x_offset, int y_offset)
     pass_time = GET_RTC_MS();
 #endif
 
-    uint32_t r32=0, g32=0, b32=0;
-    int cnt = 3;
-
-    r32 = 0;
-	g32 = 0;
-	b32 = 0;
-	cnt = 3;
-
 	// Read 192x192, pick one out of 3 pixels to make it 64x64
 	// CNN needs RGB888, pack for bytes into 1 int for each color
     for (int i = y_offset; i < PIC_HEIGHT + y_offset; i+=3) {
         data = raw + (((LCD_HEIGHT - PIC_HEIGHT) / 2) + i) * LCD_WIDTH * LCD_BYTE_PER_PIXEL;  // down
         data += ((LCD_WIDTH - PIC_WIDTH) / 2) * LCD_BYTE_PER_PIXEL;  // right
 
-        for(int j = x_offset; j < PIC_WIDTH + x_offset; j+=3) {
-
-        	// RGB565, |RRRRRGGG|GGGBBBBB|
-            ub = (data[j * LCD_BYTE_PER_PIXEL + 1] << 3);
-            ug = ((data[j * LCD_BYTE_PER_PIXEL] << 5) | ((data[j * LCD_BYTE_PER_PIXEL + 1] & 0xE0) >> 3));
-            ur = (data[j * LCD_BYTE_PER_PIXEL] & 0xF8);
-
-            b = ub - 128;
-            g = ug - 128;
-            r = ur - 128;
-
-            r32 = r32 | ((uint8_t)r << ((cnt)*8));
-            g32 = g32 | ((uint8_t)g << ((cnt)*8));
-            b32 = b32 | ((uint8_t)b << ((cnt)*8));
-
-            // when 4 bytes are packed, write to FIFOs
-            if (cnt == 0)
-			{
-			   while (((*((volatile uint32_t *) 0x50000004) & 1)) != 0); // Wait for FIFO 0
-			   *((volatile uint32_t *) 0x50000008) = r32; // Write FIFO 0
-
-			   while (((*((volatile uint32_t *) 0x50000004) & 2)) != 0); // Wait for FIFO 1
-			   *((volatile uint32_t *) 0x5000000c) = g32; // Write FIFO 1
-
-			   while (((*((volatile uint32_t *) 0x50000004) & 4)) != 0); // Wait for FIFO 2
-			   *((volatile uint32_t *) 0x50000010) = b32; // Write FIFO 2
-
-			   r32 = 0;
-			   g32 = 0;
-			   b32 = 0;
-			   cnt = 3;
-            }
-            else
-            {
-            	cnt--;
-            }
-        }
+        // Convert the whole row, then stream it into the CNN FIFOs
+        cnn_input_rgb565_to_chw(data + x_offset * LCD_BYTE_PER_PIXEL, 3, line_r, line_g, line_b, PIC_WIDTH / 3);
+        cnn_input_fifo_write_chw(line_r, line_g, line_b, PIC_WIDTH / 3 / 4);
     }
 
 
+    TRACE_EVENT(TRACE_EVENT_CNN_START, 0);
+
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN load : %d", GET_RTC_MS() - pass_time);
     pass_time = GET_RTC_MS();
 #endif
+}
 
+static void run_cnn_result(void)
+{
     while (cnn_time == 0)
         __WFI(); // Wait for CNN done
 
+    TRACE_EVENT(TRACE_EVENT_CNN_DONE, 0);
+
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN wait : %d", GET_RTC_MS() - pass_time);
     pass_time = GET_RTC_MS();
@@ -796,10 +891,9 @@ static void run_cnn(int x_offset, int y_offset)
 	PR_INFO("load_inference_time: %d us", cnn_time);
 	
     cnn_unload((uint32_t*) ml_data);
+    TRACE_EVENT(TRACE_EVENT_CNN_UNLOAD, 0);
 
-    cnn_stop();
-    // Disable CNN clock to save power
-    MXC_SYS_ClockDisable(MXC_SYS_PERIPH_CLOCK_CNN);
+    cnn_stop(); // Keep clock and configuration for the next frame
 
 #ifdef PRINT_TIME_CNN
     PR_TIMER("CNN unload : %d", GET_RTC_MS() - pass_time);
@@ -839,11 +933,10 @@ static void run_cnn(int x_offset, int y_offset)
 		sprintf(msg,"%s (%d%%)",classes[max_index], max_result);
 	}
 	strncpy(classification_result.result, msg, sizeof(classification_result.result) - 1);
-    
-	qspi_slave_send_packet((uint8_t *) &classification_result, sizeof(classification_result),
-            QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES);
 
-    MXC_Delay(MXC_DELAY_MSEC(250));
+    // Dropped if the MAX32666 has not taken the previous one, a new result follows with the next frame
+    send_credited((uint8_t *) &classification_result, sizeof(classification_result),
+            QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES);
 
 
 #ifdef PRINT_TIME_CNN
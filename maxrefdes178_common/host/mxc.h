@@ -0,0 +1,372 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host stand-in for the MAX78000 SDK header, declares the parts of the SDK the video CNN drivers,
+ * the audio keyword spotting input, the FaceID embedding database, the QSPI master and slave, the
+ * MAX32666 LCD driver, BLE queue and command handling and the AppSwitcher MAX78000 loader use.
+ * Only for the host simulations, see maxrefdes178_cnn_sim.c, maxrefdes178_kws_sim.c,
+ * maxrefdes178_embedding_sim.c, maxrefdes178_qspi_link_sim.c, maxrefdes178_lcd_sim.c,
+ * maxrefdes178_ble_queue_sim.c, maxrefdes178_ble_loopback_sim.c and max32666_loader_sim.c. The
+ * other SDK headers of these sources include this one, MAX32665 SDK headers too.
+ */
+
+#ifndef _MAXREFDES178_HOST_MXC_H_
+#define _MAXREFDES178_HOST_MXC_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define MXC_GCFR                        (&host_gcfr)
+#define MXC_GCR                         (&host_gcr)
+#define MXC_TMR0                        (&host_tmr0)
+#define MXC_TMR4                        (&host_tmr4)
+#define MXC_FLC0                        (&host_flc0)
+#define MXC_ICC0                        (&host_icc0)
+#define MXC_GPIO0                       (&host_gpio0)
+#define MXC_GPIO1                       (&host_gpio1)
+#define MXC_SPI0                        (&host_spi0)
+#define MXC_SPI1                        (&host_spi1)
+#define MXC_DMA                         (&host_dma)
+#define SCB                             (&host_scb)
+
+#define MXC_FLASH_PAGE_SIZE             0x2000
+
+#define MXC_F_FLC_INTR_DONE             (0x1UL << 0)
+#define MXC_F_FLC_INTR_AF               (0x1UL << 1)
+#define MXC_F_FLC_INTR_DONEIE           (0x1UL << 8)
+#define MXC_F_FLC_INTR_AFIE             (0x1UL << 9)
+
+#define MXC_F_GCR_PCLKDIV_CNNCLKDIV     (0x7UL << 14)
+#define MXC_F_GCR_PCLKDIV_CNNCLKSEL     (0x1UL << 17)
+
+#define MXC_GPIO_PIN_4                  (0x1UL << 4)
+#define MXC_GPIO_PIN_6                  (0x1UL << 6)
+#define MXC_GPIO_PIN_8                  (0x1UL << 8)
+#define MXC_GPIO_PIN_12                 (0x1UL << 12)
+#define MXC_GPIO_PIN_14                 (0x1UL << 14)
+#define MXC_GPIO_PIN_20                 (0x1UL << 20)
+#define MXC_GPIO_PIN_21                 (0x1UL << 21)
+#define MXC_GPIO_PIN_22                 (0x1UL << 22)
+#define MXC_GPIO_PIN_23                 (0x1UL << 23)
+#define MXC_GPIO_PIN_30                 (0x1UL << 30)
+#define MXC_GPIO_PIN_31                 (0x1UL << 31)
+#define MXC_GPIO_PAD_NONE               0
+#define MXC_GPIO_PAD_PULL_UP            1
+#define MXC_GPIO_FUNC_IN                0
+#define MXC_GPIO_FUNC_OUT               1
+#define MXC_GPIO_VSSEL_VDDIO            0
+#define MXC_GPIO_GET_IDX(port)          (((port) == MXC_GPIO0) ? 0 : 1)
+#define MXC_GPIO_GET_IRQ(idx)           ((IRQn_Type) (GPIO0_IRQn + (idx)))
+
+// Only TMR0 and TMR4 are modelled
+#define MXC_TMR_GET_IDX(tmr)            (((tmr) == MXC_TMR4) ? 4 : 0)
+#define MXC_TMR_GET_IRQ(idx)            ((IRQn_Type) (TMR0_IRQn + (idx)))
+
+// MAX32666 peripheral clock at the 96 MHz system clock
+#define PeripheralClock                 48000000UL
+
+#define MXC_F_SPI_CTRL0_EN              (0x1UL << 0)
+#define MXC_F_SPI_CTRL1_TX_NUM_CHAR_POS 0
+#define MXC_F_SPI_CTRL1_TX_NUM_CHAR     (0xFFFFUL << MXC_F_SPI_CTRL1_TX_NUM_CHAR_POS)
+#define MXC_F_SPI_CTRL1_RX_NUM_CHAR_POS 16
+#define MXC_F_SPI_CTRL1_RX_NUM_CHAR     (0xFFFFUL << MXC_F_SPI_CTRL1_RX_NUM_CHAR_POS)
+#define MXC_F_SPI_CTRL2_NUMBITS_POS     8
+#define MXC_F_SPI_CTRL2_NUMBITS         (0xFUL << MXC_F_SPI_CTRL2_NUMBITS_POS)
+#define MXC_F_SPI_DMA_TX_THD_VAL_POS    0
+#define MXC_F_SPI_DMA_TX_THD_VAL        (0x1FUL << MXC_F_SPI_DMA_TX_THD_VAL_POS)
+#define MXC_F_SPI_DMA_TX_FIFO_EN        (0x1UL << 6)
+#define MXC_F_SPI_DMA_TX_FLUSH          (0x1UL << 7)
+#define MXC_F_SPI_DMA_DMA_TX_EN         (0x1UL << 15)
+#define MXC_F_SPI_DMA_RX_THD_VAL_POS    16
+#define MXC_F_SPI_DMA_RX_THD_VAL        (0x1FUL << MXC_F_SPI_DMA_RX_THD_VAL_POS)
+#define MXC_F_SPI_DMA_RX_FIFO_EN        (0x1UL << 22)
+#define MXC_F_SPI_DMA_RX_FLUSH          (0x1UL << 23)
+#define MXC_F_SPI_DMA_DMA_RX_EN         (0x1UL << 31)
+
+#define MXC_DMA_CHANNELS                4
+#define MXC_F_DMA_CTRL_EN               (0x1UL << 0)
+#define MXC_F_DMA_CTRL_RLDEN            (0x1UL << 1)
+#define MXC_F_DMA_CTRL_REQUEST          (0x3FUL << 4)
+#define MXC_S_DMA_CTRL_REQUEST_SPI0RX   (0x01UL << 4)
+#define MXC_S_DMA_CTRL_REQUEST_SPI0TX   (0x21UL << 4)
+#define MXC_S_DMA_CTRL_SRCWD_WORD       (0x2UL << 16)
+#define MXC_F_DMA_CTRL_SRCINC           (0x1UL << 22)
+#define MXC_F_DMA_CTRL_DSTINC           (0x1UL << 27)
+#define MXC_F_DMA_CTRL_CTZ_IE           (0x1UL << 31)
+#define MXC_F_DMA_STATUS_CTZ_IF         (0x1UL << 2)
+#define MXC_F_DMA_STATUS_RLD_IF         (0x1UL << 3)
+#define MXC_F_DMA_STATUS_BUS_ERR        (0x1UL << 4)
+#define MXC_F_DMA_STATUS_TO_IF          (0x1UL << 6)
+
+#define MXC_SETFIELD(reg, mask, value)  ((reg) = ((reg) & ~(mask)) | ((value) & (mask)))
+
+#define TRUE                            1
+#define FALSE                           0
+
+// Cortex-M data memory barrier, the queues only rely on its acquire/release ordering
+#define __DMB()                         __atomic_thread_fence(__ATOMIC_ACQ_REL)
+
+#define MXC_DELAY_MSEC(ms)              ((ms) * 1000UL)
+#define MXC_DELAY_USEC(us)              (us)
+
+#define E_NO_ERROR                      0
+#define E_SUCCESS                       0
+#define E_NULL_PTR                      -1
+#define E_NO_DEVICE                     -2
+#define E_BAD_PARAM                     -3
+#define E_INVALID                       -4
+#define E_UNINITIALIZED                 -5
+#define E_BUSY                          -6
+#define E_BAD_STATE                     -7
+#define E_UNKNOWN                       -8
+#define E_COMM_ERR                      -9
+#define E_TIME_OUT                      -10
+#define E_NO_RESPONSE                   -11
+#define E_OVERFLOW                      -12
+#define E_UNDERFLOW                     -13
+#define E_NONE_AVAIL                    -14
+#define E_SHUTDOWN                      -15
+#define E_ABORT                         -16
+#define E_NOT_SUPPORTED                 -17
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    volatile uint32_t reg0;
+    volatile uint32_t reg1;
+    volatile uint32_t reg2;
+    volatile uint32_t reg3;
+} mxc_gcfr_regs_t;
+
+typedef struct {
+    volatile uint32_t pclkdiv;
+} mxc_gcr_regs_t;
+
+typedef struct {
+    volatile uint32_t cnt;
+} mxc_tmr_regs_t;
+
+typedef struct {
+    volatile uint32_t out;
+    volatile uint32_t in;
+} mxc_gpio_regs_t;
+
+typedef struct {
+    volatile uint32_t clkdiv;
+    volatile uint32_t intr;
+} mxc_flc_regs_t;
+
+typedef struct {
+    volatile uint32_t ctrl;
+} mxc_icc_regs_t;
+
+typedef struct {
+    volatile uint32_t ctrl0;
+    volatile uint32_t ctrl1;
+    volatile uint32_t ctrl2;
+    volatile uint32_t dma;
+} mxc_spi_regs_t;
+
+typedef struct {
+    volatile uint32_t ctrl;
+    volatile uint32_t status;
+    volatile uint32_t src;
+    volatile uint32_t dst;
+    volatile uint32_t cnt;
+    volatile uint32_t srcrld;
+    volatile uint32_t dstrld;
+    volatile uint32_t cntrld;
+} mxc_dma_ch_regs_t;
+
+typedef struct {
+    volatile uint32_t inten;
+    volatile uint32_t intfl;
+    mxc_dma_ch_regs_t ch[MXC_DMA_CHANNELS];
+} mxc_dma_regs_t;
+
+typedef struct {
+    volatile uint32_t VTOR;
+} SCB_Type;
+
+typedef struct {
+    mxc_gpio_regs_t *port;
+    uint32_t mask;
+    int func;
+    int pad;
+    int vssel;
+} mxc_gpio_cfg_t;
+
+typedef struct {
+    int clock;
+    int ss0;
+    int ss1;
+    int ss2;
+    int miso;
+    int mosi;
+    int sdio2;
+    int sdio3;
+    int vddioh;
+} mxc_spi_pins_t;
+
+typedef enum {
+    SPI_WIDTH_3WIRE,
+    SPI_WIDTH_STANDARD,
+    SPI_WIDTH_DUAL,
+    SPI_WIDTH_QUAD,
+} mxc_spi_width_t;
+
+typedef void (*mxc_gpio_callback_fn)(void *cbdata);
+
+typedef enum {
+    MXC_GPIO_INT_FALLING,
+    MXC_GPIO_INT_RISING,
+    MXC_GPIO_INT_BOTH,
+} mxc_gpio_int_pol_t;
+
+typedef enum {
+    TMR_PRES_1,
+} mxc_tmr_pres_t;
+
+typedef enum {
+    TMR_MODE_ONESHOT,
+} mxc_tmr_mode_t;
+
+typedef struct {
+    mxc_tmr_pres_t pres;
+    mxc_tmr_mode_t mode;
+    uint32_t cmp_cnt;
+    unsigned pol;
+} mxc_tmr_cfg_t;
+
+typedef enum {
+    MAP_A,
+    MAP_B,
+} sys_map_t;
+
+typedef enum {
+    MXC_DMA_REQUEST_SPI0RX = 0x01,
+    MXC_DMA_REQUEST_SPI1TX = 0x0F,
+    MXC_DMA_REQUEST_SPI0TX = 0x21,
+} mxc_dma_reqsel_t;
+
+typedef enum {
+    MXC_SYS_PERIPH_CLOCK_CNN = 25,
+} mxc_sys_periph_clock_t;
+
+typedef enum {
+    TMR0_IRQn = 5,
+    FLC0_IRQn = 23,
+    GPIO0_IRQn = 24,
+    GPIO1_IRQn = 25,
+    DMA0_IRQn = 28,
+    DMA1_IRQn = 29,
+    CNN_IRQn = 50,
+} IRQn_Type;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+extern mxc_gcfr_regs_t host_gcfr;
+extern mxc_gcr_regs_t host_gcr;
+extern mxc_tmr_regs_t host_tmr0;
+extern mxc_tmr_regs_t host_tmr4;
+extern mxc_flc_regs_t host_flc0;
+extern mxc_icc_regs_t host_icc0;
+extern mxc_gpio_regs_t host_gpio0;
+extern mxc_gpio_regs_t host_gpio1;
+extern mxc_spi_regs_t host_spi0;
+extern mxc_spi_regs_t host_spi1;
+extern mxc_dma_regs_t host_dma;
+extern SCB_Type host_scb;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Provided by the simulation
+void MXC_SYS_ClockEnable(mxc_sys_periph_clock_t clock);
+void MXC_SYS_ClockDisable(mxc_sys_periph_clock_t clock);
+void MXC_TMR_SW_Start(mxc_tmr_regs_t *tmr);
+unsigned int MXC_TMR_SW_Stop(mxc_tmr_regs_t *tmr);
+void NVIC_SetVector(IRQn_Type irqn, void (*irq_callback)(void));
+int MXC_GPIO_Config(const mxc_gpio_cfg_t *cfg);
+void MXC_GPIO_OutSet(mxc_gpio_regs_t *port, uint32_t mask);
+void MXC_GPIO_OutClr(mxc_gpio_regs_t *port, uint32_t mask);
+uint32_t MXC_GPIO_InGet(mxc_gpio_regs_t *port, uint32_t mask);
+void MXC_GPIO_RegisterCallback(const mxc_gpio_cfg_t *cfg, mxc_gpio_callback_fn callback, void *cbdata);
+int MXC_GPIO_IntConfig(const mxc_gpio_cfg_t *cfg, mxc_gpio_int_pol_t pol);
+void MXC_GPIO_EnableInt(mxc_gpio_regs_t *port, uint32_t mask);
+int MXC_SPI_Init(mxc_spi_regs_t *spi, int masterMode, int quadModeUsed, int numSlaves, unsigned ssPolarity,
+        unsigned int hz, mxc_spi_pins_t pins);
+int MXC_SPI_SetWidth(mxc_spi_regs_t *spi, mxc_spi_width_t spiWidth);
+int MXC_TMR_Init(mxc_tmr_regs_t *tmr, mxc_tmr_cfg_t *cfg);
+void MXC_TMR_Shutdown(mxc_tmr_regs_t *tmr);
+void MXC_TMR_Start(mxc_tmr_regs_t *tmr);
+void MXC_TMR_Stop(mxc_tmr_regs_t *tmr);
+void MXC_TMR_SetCount(mxc_tmr_regs_t *tmr, uint32_t cnt);
+void MXC_TMR_ClearFlags(mxc_tmr_regs_t *tmr);
+int MXC_SEMA_GetSema(unsigned sema);
+void MXC_SEMA_FreeSema(unsigned sema);
+void MXC_Delay(uint32_t us);
+void Core1_Stop(void);
+void NVIC_EnableIRQ(IRQn_Type irqn);
+void __enable_irq(void);
+int MXC_FLC_PageErase(uint32_t address);
+int MXC_FLC_Write(uint32_t address, uint32_t length, uint32_t *buffer);
+int MXC_FLC_EnableInt(uint32_t flags);
+void MXC_ICC_Enable(mxc_icc_regs_t *icc);
+void MXC_ICC_Disable(mxc_icc_regs_t *icc);
+// maxrefdes178_qspi_link_sim.c builds the QSPI drivers with SPI_TIMEOUT_CNT defined as this, their
+// spin loops wait on the emulated link
+uint32_t host_spin_wait(void);
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+// Cortex-M4 DSP intrinsic, build with -D__ARM_FEATURE_DSP=1 to use the firmware's DSP path
+uint32_t __USADA8(uint32_t x, uint32_t y, uint32_t acc);
+#endif
+
+
+#endif /* _MAXREFDES178_HOST_MXC_H_ */
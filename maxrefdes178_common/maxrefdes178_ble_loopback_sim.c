@@ -0,0 +1,562 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host loopback test and benchmark of the MAX32666 BLE response streaming (max32666_ble_command.c,
+ * max32666_ble_tx.c, max32666_ble_queue.c):
+ *
+ *   gcc -O2 -I. -Ihost -I../maxrefdes178-FaceId/maxrefdes178_max32666/include \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max32666/src/max32666_ble_command.c \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max32666/src/max32666_ble_queue.c \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max32666/src/max32666_ble_tx.c \
+ *       maxrefdes178_ble_loopback_sim.c -o ble_loopback_sim
+ *   ./ble_loopback_sim [firmware log]
+ *
+ * Core0 (ble_command_worker) and core1 (ble_tx_worker) run in turns. ble_send_indication is the
+ * air: it checks the packet size against the MTU and the 7-bit seq, and records the packet. Each
+ * stream is a FaceID embeddings update sent with ble_command_send_single_packet, which falls back
+ * to streaming. After the stream the recorded packets are fed into the rx queue,
+ * ble_command_handle_rx reassembles them and the qspi_master_send_video stand-in compares the
+ * result with what was sent. The transmit window must hold after every core0 pass.
+ *
+ * Scenarios: several MTUs, an MTU shrink while full size packets are queued, an MTU growth, and
+ * indications that fail fewer than MAX32666_BLE_TX_RETRY times, which must still deliver the
+ * stream intact. Retries used up, a split packet failing after part of it was sent, and a
+ * disconnect must abort the stream: nothing more of it goes on the air, the tx queue ends empty
+ * and the next stream goes through.
+ *
+ * While a stream runs, statistics responses are sent with ble_command_send_single_packet and a
+ * GET_VERSION command arrives on rx. Both must be accepted: the responses are held behind the
+ * stream, none of them lands between its packets, and the last statistics value reaches the air.
+ *
+ * An indication waits for the confirmation of the previous one, so at most one is sent per
+ * connection interval. The benchmark reports the payload bytes per connection interval of an
+ * embeddings update at several MTUs. Firmware log output goes to the given file, /dev/null by
+ * default.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <mxc_errors.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "max32666_ble.h"
+#include "max32666_ble_command.h"
+#include "max32666_ble_queue.h"
+#include "max32666_ble_tx.h"
+#include "max32666_data.h"
+#include "max32666_expander.h"
+#include "max32666_lcd.h"
+#include "max32666_pmic.h"
+#include "max32666_qspi_master.h"
+#include "max32666_timer_led_button.h"
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define AIR_PACKETS_MAX     4096
+#define STREAM_PASSES_MAX   100000   // core0/core1 turns before a stream counts as stalled
+#define NO_EVENT            -1
+#define INTERLEAVE_SENDS    20       // statistics responses sent while a stream runs
+#define INTERLEAVE_RX_PASS  5        // core0 pass a command arrives on rx while the stream runs
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    const char *name;
+    uint32_t size;
+    uint16_t packet_size;       // ble_max_packet_size at the start, ATT MTU - 3
+    int mtu_at;                 // air packets sent before the MTU changes
+    uint16_t mtu_packet_size;
+    int fail_at;                // air packets sent before indications start to fail
+    int fail_count;
+    int fail_error;
+    int abort;                  // stream must be aborted
+    int failures;               // failed indications expected
+} scenario_t;
+
+// Peer side of the link, filled by ble_send_indication
+typedef struct {
+    ble_packet_container_t packets[AIR_PACKETS_MAX];
+    int count;
+    uint32_t bytes;
+    uint8_t expected_seq;
+    int mtu_at;
+    uint16_t mtu_packet_size;
+    int fail_at;
+    int fail_count;
+    int fail_error;
+    int failures;
+    int errors;
+} air_t;
+
+// Last qspi_master_send_video call, the reassembled command
+typedef struct {
+    uint8_t data[MAX32666_BLE_COMMAND_BUFFER_SIZE];
+    uint32_t size;
+    uint8_t type;
+    int count;
+} video_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+device_status_t device_status;
+volatile device_settings_t device_settings;
+device_info_t device_info;
+timestamps_t timestamps;
+volatile uint32_t timer_ms_tick;
+SCB_Type host_scb;
+uint32_t __isr_vector_core1;
+
+static FILE *report;
+static air_t air;
+static video_t video;
+static uint8_t payload[MAX32666_BLE_COMMAND_BUFFER_SIZE];
+
+static const scenario_t scenarios[] = {
+    {"mtu 23",            FACEID_MAX_EMBEDDINGS_SIZE, 20,  NO_EVENT, 0,   NO_EVENT, 0, 0, 0, 0},
+    {"mtu 247",           FACEID_MAX_EMBEDDINGS_SIZE, 244, NO_EVENT, 0,   NO_EVENT, 0, 0, 0, 0},
+    {"mtu 252",           FACEID_MAX_EMBEDDINGS_SIZE, BLE_MAX_PACKET_SIZE, NO_EVENT, 0, NO_EVENT, 0, 0, 0, 0},
+    {"one embedding",     FACEID_EMBEDDING_SIZE,      244, NO_EVENT, 0,   NO_EVENT, 0, 0, 0, 0},
+    {"mtu shrink",        FACEID_MAX_EMBEDDINGS_SIZE, 244, 3,        20,  NO_EVENT, 0, 0, 0, 0},
+    {"mtu grow",          FACEID_MAX_EMBEDDINGS_SIZE, 20,  10,       244, NO_EVENT, 0, 0, 0, 0},
+    {"retry",             FACEID_MAX_EMBEDDINGS_SIZE, 244, NO_EVENT, 0,   5, MAX32666_BLE_TX_RETRY - 1,
+            E_COMM_ERR, 0, MAX32666_BLE_TX_RETRY - 1},
+    {"retry split",       FACEID_MAX_EMBEDDINGS_SIZE, 244, 3,        20,  3, 1, E_COMM_ERR, 0, 1},
+    {"retries used up",   FACEID_MAX_EMBEDDINGS_SIZE, 244, NO_EVENT, 0,   5, MAX32666_BLE_TX_RETRY,
+            E_COMM_ERR, 1, MAX32666_BLE_TX_RETRY},
+    {"after abort",       FACEID_MAX_EMBEDDINGS_SIZE, 244, NO_EVENT, 0,   NO_EVENT, 0, 0, 0, 0},
+    {"split fails",       FACEID_MAX_EMBEDDINGS_SIZE, 244, 3,        20,  4, 1, E_COMM_ERR, 1, 1},
+    {"after split abort", FACEID_MAX_EMBEDDINGS_SIZE, 20,  NO_EVENT, 0,   NO_EVENT, 0, 0, 0, 0},
+    {"disconnect",        FACEID_MAX_EMBEDDINGS_SIZE, 244, NO_EVENT, 0,   5, 1, E_NO_DEVICE, 1, 1},
+    {"reconnect",         FACEID_MAX_EMBEDDINGS_SIZE, 244, NO_EVENT, 0,   NO_EVENT, 0, 0, 0, 0},
+};
+
+static const uint16_t bench_packet_sizes[] = {20, 64, 128, 182, 244, BLE_MAX_PACKET_SIZE};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static int stream_run(const scenario_t *scenario, int seed);
+static int stream_check(const scenario_t *scenario);
+static int interleave_run(void);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    scenario_t bench = {"bench", FACEID_MAX_EMBEDDINGS_SIZE, 0, NO_EVENT, 0, NO_EVENT, 0, 0, 0, 0};
+    int errors = 0;
+    int i;
+
+    // Keep the report on stdout, the firmware PR_* output goes to the log
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen((argc > 1) ? argv[1] : "/dev/null", "w", stdout)) {
+        fprintf(stderr, "cannot open firmware log\n");
+        return 1;
+    }
+    setvbuf(report, NULL, _IOLBF, 0);
+
+    device_status.ble_connected = 1;
+    ble_queue_init();
+    ble_command_init();
+
+    for (i = 0; i < (int) (sizeof(scenarios) / sizeof(scenarios[0])); i++) {
+        errors += stream_run(&scenarios[i], i);
+    }
+    errors += interleave_run();
+    fprintf(report, "ble loopback check: %s\n", errors ? "FAILED" : "passed");
+
+    fprintf(report, "embeddings update %d bytes, at most one indication per connection interval\n",
+            FACEID_MAX_EMBEDDINGS_SIZE);
+    fprintf(report, "ATT MTU  packets  bytes/interval  header overhead\n");
+    for (i = 0; i < (int) (sizeof(bench_packet_sizes) / sizeof(bench_packet_sizes[0])); i++) {
+        bench.packet_size = bench_packet_sizes[i];
+        errors += stream_run(&bench, i);
+        fprintf(report, "%7d  %7d  %14.1f  %14.1f%%\n", bench.packet_size + 3, air.count,
+                (double) bench.size / air.count, 100.0 * (air.bytes - bench.size) / air.bytes);
+    }
+
+    return errors ? 1 : 0;
+}
+
+// Sends one stream through core0 and core1, then feeds what went on the air into rx
+static int stream_run(const scenario_t *scenario, int seed)
+{
+    int aborted_count = NO_EVENT;
+    int errors = 0;
+    int pass;
+    int ret;
+
+    memset(&air, 0, sizeof(air));
+    air.expected_seq = device_status.ble_next_tx_seq;
+    air.mtu_at = scenario->mtu_at;
+    air.mtu_packet_size = scenario->mtu_packet_size;
+    air.fail_at = scenario->fail_at;
+    air.fail_count = scenario->fail_count;
+    air.fail_error = scenario->fail_error;
+    device_status.ble_max_packet_size = scenario->packet_size;
+
+    for (uint32_t i = 0; i < scenario->size; i++) {
+        payload[i] = (uint8_t) ((i * 31 + seed) ^ (i >> 8));
+    }
+
+    ret = ble_command_send_single_packet(BLE_COMMAND_FACEID_EMBED_UPDATE_CMD, scenario->size, payload);
+    if (ret != E_SUCCESS) {
+        fprintf(report, "FAIL: %s send returned %d\n", scenario->name, ret);
+        return 1;
+    }
+
+    for (pass = 0; pass < STREAM_PASSES_MAX; pass++) {
+        ble_command_worker();
+        if (ble_queue_count_tx() > MAX32666_BLE_TX_WINDOW) {
+            fprintf(report, "FAIL: %s %d packets queued, window is %d\n", scenario->name,
+                    ble_queue_count_tx(), MAX32666_BLE_TX_WINDOW);
+            errors++;
+        }
+        if (!ble_queue_count_tx() && !device_status.ble_tx_aborted) {
+            break;
+        }
+
+        ble_tx_worker();
+        if (device_status.ble_tx_aborted && (aborted_count == NO_EVENT)) {
+            aborted_count = air.count;
+        }
+    }
+    if (pass == STREAM_PASSES_MAX) {
+        fprintf(report, "FAIL: %s stalled after %d packets\n", scenario->name, air.count);
+        return errors + 1;
+    }
+
+    errors += air.errors;
+    if (air.failures != scenario->failures) {
+        fprintf(report, "FAIL: %s %d failed indications, expected %d\n", scenario->name, air.failures,
+                scenario->failures);
+        errors++;
+    }
+
+    if (scenario->abort) {
+        if (aborted_count == NO_EVENT) {
+            fprintf(report, "FAIL: %s was not aborted\n", scenario->name);
+            errors++;
+        } else if (air.count != aborted_count) {
+            fprintf(report, "FAIL: %s %d packets sent after the abort\n", scenario->name, air.count - aborted_count);
+            errors++;
+        }
+        return errors;
+    }
+
+    if (aborted_count != NO_EVENT) {
+        fprintf(report, "FAIL: %s aborted after %d packets\n", scenario->name, aborted_count);
+        return errors + 1;
+    }
+
+    return errors + stream_check(scenario);
+}
+
+// Reassembles the recorded packets with ble_command_handle_rx
+static int stream_check(const scenario_t *scenario)
+{
+    memset(&video, 0, sizeof(video));
+
+    for (int i = 0; i < air.count; i++) {
+        if (ble_queue_enq_rx(&air.packets[i]) != E_SUCCESS) {
+            fprintf(report, "FAIL: %s rx queue full\n", scenario->name);
+            return 1;
+        }
+        ble_command_worker();
+    }
+
+    if (video.count != 1) {
+        fprintf(report, "FAIL: %s reassembled %d commands from %d packets\n", scenario->name, video.count,
+                air.count);
+        return 1;
+    }
+    if ((video.type != QSPI_PACKET_TYPE_VIDEO_FACEID_EMBED_UPDATE_CMD) || (video.size != scenario->size) ||
+        memcmp(video.data, payload, scenario->size)) {
+        fprintf(report, "FAIL: %s reassembled type %d size %u does not match %u\n", scenario->name, video.type,
+                video.size, scenario->size);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Single packet responses and an rx command while a stream is being queued
+static int interleave_run(void)
+{
+    scenario_t scenario = {"interleave", FACEID_MAX_EMBEDDINGS_SIZE, 244, NO_EVENT, 0, NO_EVENT, 0, 0, 0, 0};
+    ble_packet_container_t command = {0};
+    uint32_t statistics = 0;
+    uint32_t last_statistics = 0;
+    int last_payload = NO_EVENT;
+    int statistics_count = 0;
+    int version_count = 0;
+    int errors = 0;
+    int pass;
+    int ret;
+
+    memset(&air, 0, sizeof(air));
+    air.expected_seq = device_status.ble_next_tx_seq;
+    air.mtu_at = NO_EVENT;
+    air.fail_at = NO_EVENT;
+    device_status.ble_max_packet_size = scenario.packet_size;
+
+    for (uint32_t i = 0; i < scenario.size; i++) {
+        payload[i] = (uint8_t) (i * 7 + (i >> 5));
+    }
+
+    ret = ble_command_send_single_packet(BLE_COMMAND_FACEID_EMBED_UPDATE_CMD, scenario.size, payload);
+    if (ret != E_SUCCESS) {
+        fprintf(report, "FAIL: %s send returned %d\n", scenario.name, ret);
+        return 1;
+    }
+
+    for (pass = 0; pass < STREAM_PASSES_MAX; pass++) {
+        if (pass == INTERLEAVE_RX_PASS) {
+            command.packet.command_packet.header.packet_info.type = BLE_PACKET_TYPE_COMMAND;
+            command.packet.command_packet.header.packet_info.seq = device_status.ble_expected_rx_seq;
+            command.packet.command_packet.header.command = BLE_COMMAND_GET_VERSION_CMD;
+            command.size = sizeof(ble_command_packet_header_t);
+            ble_queue_enq_rx(&command);
+        }
+        if ((pass % 2 == 0) && (statistics < INTERLEAVE_SENDS)) {
+            statistics++;
+            ret = ble_command_send_single_packet(BLE_COMMAND_GET_STATISTICS_RES, sizeof(statistics),
+                    (uint8_t *) &statistics);
+            if (ret != E_SUCCESS) {
+                fprintf(report, "FAIL: %s statistics send %u returned %d\n", scenario.name, statistics, ret);
+                errors++;
+            }
+        }
+
+        ble_command_worker();
+        if (ble_queue_count_tx() > MAX32666_BLE_TX_WINDOW + MAX32666_BLE_COMMAND_PENDING) {
+            fprintf(report, "FAIL: %s %d packets queued\n", scenario.name, ble_queue_count_tx());
+            errors++;
+        }
+        if (!ble_queue_count_tx() && (statistics == INTERLEAVE_SENDS)) {
+            break;
+        }
+
+        ble_tx_worker();
+    }
+    if (pass == STREAM_PASSES_MAX) {
+        fprintf(report, "FAIL: %s stalled after %d packets\n", scenario.name, air.count);
+        return errors + 1;
+    }
+    errors += air.errors;
+
+    for (int i = 0; i < air.count; i++) {
+        if (air.packets[i].packet.packet_info.type == BLE_PACKET_TYPE_PAYLOAD) {
+            last_payload = i;
+        }
+    }
+
+    // Everything but the stream command packet must follow the last payload packet of the stream
+    for (int i = 1; i < air.count; i++) {
+        ble_command_packet_t *packet = &air.packets[i].packet.command_packet;
+
+        if (packet->header.packet_info.type != BLE_PACKET_TYPE_COMMAND) {
+            continue;
+        }
+        if (i < last_payload) {
+            fprintf(report, "FAIL: %s command %d at packet %d inside the stream\n", scenario.name,
+                    packet->header.command, i);
+            errors++;
+        }
+        if (packet->header.command == BLE_COMMAND_GET_STATISTICS_RES) {
+            memcpy(&last_statistics, packet->payload, sizeof(last_statistics));
+            statistics_count++;
+        } else if (packet->header.command == BLE_COMMAND_GET_VERSION_RES) {
+            version_count++;
+        }
+    }
+
+    if (!statistics_count || (last_statistics != statistics)) {
+        fprintf(report, "FAIL: %s %d statistics responses, last %u, expected %u\n", scenario.name,
+                statistics_count, last_statistics, statistics);
+        errors++;
+    }
+    if (version_count != 1) {
+        fprintf(report, "FAIL: %s %d version responses to the command received while streaming\n",
+                scenario.name, version_count);
+        errors++;
+    }
+
+    return errors + stream_check(&scenario);
+}
+
+int ble_send_indication(uint16_t dataLen, uint8_t *data)
+{
+    ble_packet_container_t *ble_packet_container;
+    ble_packet_info_t *packet_info = (ble_packet_info_t *) data;
+
+    if ((air.count == air.fail_at) && (air.fail_count > 0)) {
+        air.fail_count--;
+        air.failures++;
+        return air.fail_error;
+    }
+
+    if ((dataLen > device_status.ble_max_packet_size) || (dataLen < sizeof(ble_payload_packet_header_t))) {
+        fprintf(report, "FAIL: air packet %d size %d, max %d\n", air.count, dataLen,
+                device_status.ble_max_packet_size);
+        air.errors++;
+        return E_BAD_STATE;
+    }
+    if (packet_info->seq != air.expected_seq) {
+        fprintf(report, "FAIL: air packet %d seq %d, expected %d\n", air.count, packet_info->seq,
+                air.expected_seq);
+        air.errors++;
+    }
+    if (air.count == AIR_PACKETS_MAX) {
+        fprintf(report, "FAIL: more than %d air packets\n", AIR_PACKETS_MAX);
+        air.errors++;
+        return E_OVERFLOW;
+    }
+
+    ble_packet_container = &air.packets[air.count++];
+    ble_packet_container->size = dataLen;
+    memcpy(&ble_packet_container->packet, data, dataLen);
+    air.bytes += dataLen;
+
+    air.expected_seq = (air.expected_seq + 1) % BLE_PACKET_SEQ_MASK;
+    device_status.ble_next_tx_seq += 1;
+    device_status.ble_next_tx_seq %= BLE_PACKET_SEQ_MASK;
+
+    // MTU exchange completes between two indications
+    if (air.count == air.mtu_at) {
+        device_status.ble_max_packet_size = air.mtu_packet_size;
+    }
+
+    return E_SUCCESS;
+}
+
+int qspi_master_send_video(uint8_t *data, uint32_t data_size, uint8_t data_type)
+{
+    if (data_size <= sizeof(video.data)) {
+        memcpy(video.data, data, data_size);
+    }
+    video.size = data_size;
+    video.type = data_type;
+    video.count++;
+
+    return E_NO_ERROR;
+}
+
+int qspi_master_send_audio(uint8_t *data, uint32_t data_size, uint8_t data_type)
+{
+    (void) data;
+    (void) data_size;
+    (void) data_type;
+
+    return E_NO_ERROR;
+}
+
+int lcd_notification(uint16_t color, const char *notification)
+{
+    (void) color;
+    (void) notification;
+
+    return E_NO_ERROR;
+}
+
+int lcd_backlight(int on, uint8_t level)
+{
+    (void) on;
+    (void) level;
+
+    return E_NO_ERROR;
+}
+
+int expander_select_debugger(debugger_select_e debugger_select)
+{
+    (void) debugger_select;
+
+    return E_NO_ERROR;
+}
+
+int pmic_ldo1(int on)
+{
+    (void) on;
+
+    return E_NO_ERROR;
+}
+
+int pmic_buck2(int on)
+{
+    (void) on;
+
+    return E_NO_ERROR;
+}
+
+int pmic_power_off(void)
+{
+    return E_NO_ERROR;
+}
+
+int pmic_hard_reset(void)
+{
+    return E_NO_ERROR;
+}
+
+void Core1_Stop(void)
+{
+}
+
+int MXC_SEMA_GetSema(unsigned sema)
+{
+    (void) sema;
+
+    return E_NO_ERROR;
+}
+
+void MXC_SEMA_FreeSema(unsigned sema)
+{
+    (void) sema;
+}
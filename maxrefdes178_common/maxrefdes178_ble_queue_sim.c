@@ -0,0 +1,565 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host stress test and benchmark of the MAX32666 core0/core1 BLE queues (max32666_ble_queue.c):
+ *
+ *   gcc -O2 -pthread -I. -Ihost -I../maxrefdes178-FaceId/maxrefdes178_max32666/include \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max32666/src/max32666_ble_queue.c \
+ *       maxrefdes178_ble_queue_sim.c -o ble_queue_sim
+ *   ./ble_queue_sim [packets]
+ *
+ * A pthread plays core1: it produces rx with enq and reserve/commit and consumes tx with deq and
+ * peek/release. The main thread plays core0 on the other ends. Every packet carries its sequence
+ * number, a size from 4 to BLE_MAX_PACKET_SIZE and a payload derived from both, all checked on
+ * the other side. The first pass must deliver everything in order. The second pass adds
+ * ble_queue_flush from core0. Rx may only skip packets across a flush. A tx gap must end exactly at
+ * the head recorded for a flush. Threads yield when a queue is full or empty, so the test also
+ * interleaves on a single CPU.
+ *
+ * __DMB() is an acquire/release fence on the host, only a compiler barrier on x86. x86 does not
+ * reorder the way the Cortex-M4 bus may, so the ordering itself is only checked as far as the
+ * compiler is concerned. Index handling, wrap and flush are checked fully.
+ *
+ * The benchmark moves tx packets from core0 to core1: the former locked queue with a whole
+ * container copy, enq/deq of the used size and zero-copy reserve/commit and peek/release. With two
+ * threads the hand over between them is included, a burst fills and drains the queue in one thread.
+ * Host numbers: a fixed size copy is cheap on x86, the used size copy is what saves on the MAX32666.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <mxc_errors.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "max32666_ble_queue.h"
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define DEFAULT_PACKETS     300000
+#define FLUSH_INTERVAL      997      // tx packets between flushes in the second pass
+#define FLUSH_POINTS_MAX    (DEFAULT_PACKETS * 16 / FLUSH_INTERVAL)
+#define GAPS_MAX            FLUSH_POINTS_MAX
+#define STALL_TIMEOUT_S     5        // neither side moved a packet
+#define BENCH_SMALL_SIZE    20
+#define FORMER_QUEUE_SIZE   10
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    int packets;
+    int flush;
+    volatile int core1_done;
+    volatile int core0_done;
+    volatile uint32_t core1_progress;
+    // Written by core0, read after the join
+    uint32_t flush_points[FLUSH_POINTS_MAX];
+    int flush_count;
+    // Written by core1, read after the join
+    uint32_t tx_gaps[GAPS_MAX];
+    int tx_gap_count;
+    volatile int core1_errors;
+} stress_t;
+
+// The queue before the lock-free ring, MAX32666_SEMAPHORE_BLE_QUEUE is a spin lock here
+typedef struct {
+    ble_packet_container_t container_array[FORMER_QUEUE_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    int lock;
+} former_queue_t;
+
+typedef enum {
+    BENCH_FORMER = 0,
+    BENCH_COPY,
+    BENCH_ZERO_COPY,
+} bench_mode_e;
+
+typedef struct {
+    bench_mode_e mode;
+    int packets;
+    uint8_t size;
+    volatile uint32_t checksum;
+} bench_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static stress_t stress;
+static former_queue_t former_queue;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint8_t packet_size(uint32_t seq);
+static void packet_fill(ble_packet_container_t *container, uint32_t seq);
+static int packet_check(const char *name, const ble_packet_container_t *container, uint32_t *seq);
+static void *stress_core1(void *arg);
+static int stress_run(int packets, int flush);
+static int former_enq(former_queue_t *queue, ble_packet_container_t *container);
+static int former_deq(former_queue_t *queue, ble_packet_container_t *container);
+static void *bench_consumer(void *arg);
+static double bench_run(bench_mode_e mode, int packets, uint8_t size);
+static double bench_burst(bench_mode_e mode, int packets, uint8_t size);
+static double elapsed_ns(struct timespec *start, int iterations);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static const char *mode_names[] = {"former locked copy", "enq/deq", "reserve/peek"};
+    int packets = DEFAULT_PACKETS;
+    int errors = 0;
+    int mode;
+
+    if (argc > 1) {
+        packets = atoi(argv[1]);
+    }
+    if ((packets <= 0) || (packets > DEFAULT_PACKETS * 16)) {
+        packets = DEFAULT_PACKETS;
+    }
+
+    errors += stress_run(packets, 0);
+    errors += stress_run(packets, 1);
+    printf("ble queue check: %s\n", errors ? "FAILED" : "passed");
+
+    printf("ns/packet            %3d bytes: threads   burst, %3d bytes: threads   burst\n",
+           BENCH_SMALL_SIZE, BLE_MAX_PACKET_SIZE);
+    for (mode = BENCH_FORMER; mode <= BENCH_ZERO_COPY; mode++) {
+        printf("%-20s %17.1f %7.1f %24.1f %7.1f\n", mode_names[mode],
+               bench_run(mode, packets, BENCH_SMALL_SIZE), bench_burst(mode, packets, BENCH_SMALL_SIZE),
+               bench_run(mode, packets, BLE_MAX_PACKET_SIZE), bench_burst(mode, packets, BLE_MAX_PACKET_SIZE));
+    }
+
+    return errors ? 1 : 0;
+}
+
+static uint8_t packet_size(uint32_t seq)
+{
+    return 4 + ((seq * 2654435761u) >> 16) % (BLE_MAX_PACKET_SIZE - 3);
+}
+
+static void packet_fill(ble_packet_container_t *container, uint32_t seq)
+{
+    uint8_t *data = (uint8_t *) &container->packet;
+    uint8_t size = packet_size(seq);
+
+    container->size = size;
+    memcpy(data, &seq, sizeof(seq));
+    for (int i = sizeof(seq); i < size; i++) {
+        data[i] = (uint8_t) (seq * 7 + i);
+    }
+}
+
+// Checks size and payload, returns the sequence number of the packet
+static int packet_check(const char *name, const ble_packet_container_t *container, uint32_t *seq)
+{
+    const uint8_t *data = (const uint8_t *) &container->packet;
+
+    memcpy(seq, data, sizeof(*seq));
+    if (container->size != packet_size(*seq)) {
+        printf("FAIL: %s packet %u size %u\n", name, *seq, container->size);
+        return 1;
+    }
+    for (int i = sizeof(*seq); i < container->size; i++) {
+        if (data[i] != (uint8_t) (*seq * 7 + i)) {
+            printf("FAIL: %s packet %u byte %d corrupted\n", name, *seq, i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Core1: produces rx, consumes tx
+static void *stress_core1(void *arg)
+{
+    ble_packet_container_t container;
+    ble_packet_container_t *slot;
+    uint32_t rx_seq = 0;
+    uint32_t tx_expected = 0;
+    uint32_t seq;
+    int tx_last = 0;
+
+    while (!stress.core1_errors && !stress.core0_done && ((rx_seq < (uint32_t) stress.packets) || !tx_last)) {
+        int progress = 0;
+
+        if (rx_seq < (uint32_t) stress.packets) {
+            if (rx_seq & 1) {
+                packet_fill(&container, rx_seq);
+                if (ble_queue_enq_rx(&container) == E_SUCCESS) {
+                    rx_seq++;
+                    progress = 1;
+                }
+            } else if ((slot = ble_queue_reserve_rx())) {
+                packet_fill(slot, rx_seq);
+                ble_queue_commit_rx();
+                rx_seq++;
+                progress = 1;
+            }
+        }
+
+        slot = NULL;
+        if (tx_expected & 1) {
+            if (ble_queue_deq_tx(&container) == E_SUCCESS) {
+                slot = &container;
+            }
+        } else {
+            slot = ble_queue_peek_tx();
+        }
+        if (slot) {
+            if (packet_check("tx", slot, &seq)) {
+                stress.core1_errors++;
+            } else if (seq != tx_expected) {
+                if (!stress.flush || (seq < tx_expected)) {
+                    printf("FAIL: tx packet %u, expected %u\n", seq, tx_expected);
+                    stress.core1_errors++;
+                } else if (stress.tx_gap_count < GAPS_MAX) {
+                    stress.tx_gaps[stress.tx_gap_count++] = seq;
+                }
+            }
+            if (slot != &container) {
+                ble_queue_release_tx();
+            }
+            tx_expected = seq + 1;
+            tx_last = (seq == (uint32_t) (stress.packets - 1));
+            progress = 1;
+        }
+
+        if (progress) {
+            stress.core1_progress++;
+        } else {
+            sched_yield();
+        }
+    }
+
+    stress.core1_done = 1;
+
+    return arg;
+}
+
+/* Core0 in the main thread: produces tx, consumes rx and with flush calls ble_queue_flush every
+ * FLUSH_INTERVAL tx packets until the last one.
+ */
+static int stress_run(int packets, int flush)
+{
+    ble_packet_container_t container;
+    ble_packet_container_t *slot;
+    pthread_t core1;
+    time_t stall_start = 0;
+    uint32_t core1_progress = 0;
+    uint32_t tx_seq = 0;
+    uint32_t rx_expected = 0;
+    uint32_t rx_last = UINT32_MAX;
+    uint32_t seq;
+    int rx_flushed = 0;
+    int errors = 0;
+    int i, j;
+
+    memset(&stress, 0, sizeof(stress));
+    stress.packets = packets;
+    stress.flush = flush;
+    ble_queue_init();
+
+    if (pthread_create(&core1, NULL, stress_core1, NULL)) {
+        printf("FAIL: pthread_create\n");
+        return 1;
+    }
+
+    while (!errors && !stress.core1_errors) {
+        int progress = 0;
+
+        if (tx_seq < (uint32_t) packets) {
+            if (flush && tx_seq && !(tx_seq % FLUSH_INTERVAL) && (tx_seq < (uint32_t) (packets - 1)) &&
+                (!stress.flush_count || (stress.flush_points[stress.flush_count - 1] != tx_seq))) {
+                stress.flush_points[stress.flush_count++] = tx_seq;
+                ble_queue_flush();
+                rx_flushed = 1;
+            }
+
+            if (tx_seq & 1) {
+                packet_fill(&container, tx_seq);
+                if (ble_queue_enq_tx(&container) == E_SUCCESS) {
+                    tx_seq++;
+                    progress = 1;
+                }
+            } else if ((slot = ble_queue_reserve_tx())) {
+                packet_fill(slot, tx_seq);
+                ble_queue_commit_tx();
+                tx_seq++;
+                progress = 1;
+            }
+        }
+
+        if (ble_queue_deq_rx(&container) == E_SUCCESS) {
+            if (packet_check("rx", &container, &seq)) {
+                errors++;
+            } else if ((seq < rx_expected) || ((seq != rx_expected) && !rx_flushed)) {
+                printf("FAIL: rx packet %u, expected %u\n", seq, rx_expected);
+                errors++;
+            }
+            rx_expected = seq + 1;
+            rx_last = seq;
+            rx_flushed = 0;
+            progress = 1;
+        } else if (stress.core1_done) {
+            break;
+        }
+
+        if (progress || (core1_progress != stress.core1_progress)) {
+            core1_progress = stress.core1_progress;
+            stall_start = 0;
+        } else if (!stall_start) {
+            stall_start = time(NULL);
+        } else if ((time(NULL) - stall_start) > STALL_TIMEOUT_S) {
+            printf("FAIL: stalled at tx %u rx %u\n", tx_seq, rx_expected);
+            errors++;
+        }
+
+        if (!progress) {
+            sched_yield();
+        }
+    }
+
+    stress.core0_done = 1;
+    pthread_join(core1, NULL);
+    errors += stress.core1_errors;
+
+    if (!errors && (rx_last != (uint32_t) (packets - 1)) && !rx_flushed) {
+        printf("FAIL: last rx packet %u of %d\n", rx_last, packets);
+        errors++;
+    }
+
+    // Tx may only resume at the head recorded by a flush
+    for (i = 0; i < stress.tx_gap_count; i++) {
+        for (j = 0; (j < stress.flush_count) && (stress.flush_points[j] != stress.tx_gaps[i]); j++);
+        if (j == stress.flush_count) {
+            printf("FAIL: tx resumed at %u, not at a flush\n", stress.tx_gaps[i]);
+            errors++;
+        }
+    }
+
+    printf("%s: %d packets each way, %d flushes, %d tx gaps\n", flush ? "flush" : "order",
+           packets, stress.flush_count, stress.tx_gap_count);
+
+    return errors;
+}
+
+static int former_enq(former_queue_t *queue, ble_packet_container_t *container)
+{
+    uint32_t next;
+
+    while (__atomic_exchange_n(&queue->lock, 1, __ATOMIC_ACQUIRE)) {};
+
+    next = (queue->head + 1) % FORMER_QUEUE_SIZE;
+    if (next == queue->tail) {
+        __atomic_store_n(&queue->lock, 0, __ATOMIC_RELEASE);
+        return E_OVERFLOW;
+    }
+
+    memcpy(&queue->container_array[queue->head], container, sizeof(ble_packet_container_t));
+    queue->head = next;
+
+    __atomic_store_n(&queue->lock, 0, __ATOMIC_RELEASE);
+
+    return E_SUCCESS;
+}
+
+static int former_deq(former_queue_t *queue, ble_packet_container_t *container)
+{
+    while (__atomic_exchange_n(&queue->lock, 1, __ATOMIC_ACQUIRE)) {};
+
+    if (queue->head == queue->tail) {
+        __atomic_store_n(&queue->lock, 0, __ATOMIC_RELEASE);
+        return E_UNDERFLOW;
+    }
+
+    memcpy(container, &queue->container_array[queue->tail], sizeof(ble_packet_container_t));
+    queue->tail = (queue->tail + 1) % FORMER_QUEUE_SIZE;
+
+    __atomic_store_n(&queue->lock, 0, __ATOMIC_RELEASE);
+
+    return E_SUCCESS;
+}
+
+// Core1 sending to BLE, reads size and the last payload byte
+static void *bench_consumer(void *arg)
+{
+    bench_t *bench = arg;
+    ble_packet_container_t container;
+    ble_packet_container_t *slot;
+    uint32_t checksum = 0;
+
+    for (int i = 0; i < bench->packets;) {
+        if (bench->mode == BENCH_ZERO_COPY) {
+            if ((slot = ble_queue_peek_tx())) {
+                checksum += slot->size + ((uint8_t *) &slot->packet)[slot->size - 1];
+                ble_queue_release_tx();
+                i++;
+                continue;
+            }
+        } else if (((bench->mode == BENCH_FORMER) ? former_deq(&former_queue, &container) :
+                     ble_queue_deq_tx(&container)) == E_SUCCESS) {
+            checksum += container.size + ((uint8_t *) &container.packet)[container.size - 1];
+            i++;
+            continue;
+        }
+        sched_yield();
+    }
+    bench->checksum = checksum;
+
+    return NULL;
+}
+
+// Core0 sending responses, the packet is written once either into a local container or the slot
+static double bench_run(bench_mode_e mode, int packets, uint8_t size)
+{
+    bench_t bench = {mode, packets, size, 0};
+    ble_packet_container_t container;
+    ble_packet_container_t *slot;
+    struct timespec start;
+    pthread_t consumer;
+
+    ble_queue_init();
+    memset(&former_queue, 0, sizeof(former_queue));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (pthread_create(&consumer, NULL, bench_consumer, &bench)) {
+        return 0;
+    }
+
+    for (int i = 0; i < packets;) {
+        if (mode == BENCH_ZERO_COPY) {
+            if ((slot = ble_queue_reserve_tx())) {
+                slot->size = size;
+                memset(&slot->packet, (uint8_t) i, size);
+                ble_queue_commit_tx();
+                i++;
+                continue;
+            }
+        } else {
+            container.size = size;
+            memset(&container.packet, (uint8_t) i, size);
+            if (((mode == BENCH_FORMER) ? former_enq(&former_queue, &container) :
+                  ble_queue_enq_tx(&container)) == E_SUCCESS) {
+                i++;
+                continue;
+            }
+        }
+        sched_yield();
+    }
+
+    pthread_join(consumer, NULL);
+
+    return elapsed_ns(&start, packets);
+}
+
+// Core0 queues until the queue is full then core1 empties it, both in this thread
+static double bench_burst(bench_mode_e mode, int packets, uint8_t size)
+{
+    ble_packet_container_t container;
+    ble_packet_container_t *slot;
+    struct timespec start;
+    uint32_t checksum = 0;
+    int queued = 0;
+    int i = 0;
+
+    ble_queue_init();
+    ble_queue_peek_tx();
+    memset(&former_queue, 0, sizeof(former_queue));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (i < packets) {
+        for (;;) {
+            if (mode == BENCH_ZERO_COPY) {
+                if (!(slot = ble_queue_reserve_tx())) {
+                    break;
+                }
+                slot->size = size;
+                memset(&slot->packet, (uint8_t) queued, size);
+                ble_queue_commit_tx();
+            } else {
+                container.size = size;
+                memset(&container.packet, (uint8_t) queued, size);
+                if (((mode == BENCH_FORMER) ? former_enq(&former_queue, &container) :
+                      ble_queue_enq_tx(&container)) != E_SUCCESS) {
+                    break;
+                }
+            }
+            queued++;
+        }
+
+        for (; i < queued; i++) {
+            if (mode == BENCH_ZERO_COPY) {
+                slot = ble_queue_peek_tx();
+                checksum += slot->size + ((uint8_t *) &slot->packet)[slot->size - 1];
+                ble_queue_release_tx();
+            } else {
+                if ((mode == BENCH_FORMER) ? former_deq(&former_queue, &container) :
+                    ble_queue_deq_tx(&container)) {
+                    break;
+                }
+                checksum += container.size + ((uint8_t *) &container.packet)[container.size - 1];
+            }
+        }
+    }
+    __asm__ volatile("" : : "r" (checksum));
+
+    return elapsed_ns(&start, i);
+}
+
+static double elapsed_ns(struct timespec *start, int iterations)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return ((now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec)) / iterations;
+}
@@ -0,0 +1,296 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host simulation of the MAX78000 video run_demo loop with stubbed camera, QSPI and CNN timing,
+ * compares the serial loop, the capture always overlapped with the CNN run and the gated overlap
+ * of run_demo:
+ *
+ *   gcc -O2 -I. maxrefdes178_capture_sim.c -o capture_sim
+ *   ./capture_sim [seconds] [frame_period_us]
+ *
+ * The camera delivers the first full frame that starts after camera_start_capture_image, so
+ * the overlap only gains when the serial loop misses a frame it would catch otherwise. With
+ * overlap the next capture is started once the frame is sent and streamed into CNN data memory,
+ * otherwise after the result. The gated loop overlaps only when the frame work so far and the
+ * last result time run past the camera frame period, it must be as fast as the better of the two
+ * and must not wait longer for captures than the overlap. Statistics are computed as run_demo does. A VIDEO_DISABLE_CMD and
+ * VIDEO_ENABLE_CMD pair arrives every few seconds, commands are handled at the top of the loop,
+ * no frame may be sent while video is disabled.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// us, rates of maxrefdes178_scheduler_sim.c
+#define SIM_FRAME_PERIOD      40000   // Camera frame at 15 MHz camera clock, default
+#define SIM_FRAME_TRANSFER    7700    // 240x240 RGB565 over QSPI
+#define SIM_STATISTICS        100     // Statistics packet
+#define SIM_TOGGLE_PERIOD     3000000 // VIDEO_DISABLE_CMD, VIDEO_ENABLE_CMD 500 ms later
+#define SIM_DISABLED          500000
+
+#define DEFAULT_SECONDS       60
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    SIM_SERIAL = 0,
+    SIM_OVERLAP,
+    SIM_GATED,
+
+    SIM_LAST
+} sim_mode_e;
+
+typedef struct {
+    const char *name;
+    uint32_t cnn_load;      // Frame into the CNN FIFOs, camera buffer needed
+    uint32_t cnn_result;    // Inference, unload and post processing
+} sim_demo_t;
+
+typedef struct {
+    uint32_t frames;
+    uint64_t enabled;         // Time with video enabled
+    uint64_t latency;         // Sum of total_duration
+    uint64_t capture;         // Sum of capture_duration
+    uint64_t command_latency; // Sum over commands
+    uint32_t commands;
+    uint32_t command_latency_max;
+    uint32_t sent_disabled;
+} sim_stats_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static uint64_t frame_period = SIM_FRAME_PERIOD;
+static const char *mode_names[SIM_LAST] = {"serial", "overlap", "gated"};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint64_t capture_done(uint64_t start);
+static void simulate(const sim_demo_t *demo, sim_mode_e mode, uint64_t duration, sim_stats_t *stats);
+static double fps(const sim_stats_t *stats);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static const sim_demo_t demos[] = {
+        {"FaceID",   9000, 25000},  // 160x120 load, embedding and distance
+        {"CatsDogs", 6000, 15000},  // 64x64
+        {"WildLife", 6000, 15000},
+    };
+    uint64_t duration = DEFAULT_SECONDS * 1000000ULL;
+    sim_stats_t stats[SIM_LAST];
+    size_t d;
+    int errors = 0;
+    int mode;
+
+    if (argc > 1) {
+        duration = strtoull(argv[1], NULL, 0) * 1000000ULL;
+    }
+    if (duration == 0) {
+        duration = DEFAULT_SECONDS * 1000000ULL;
+    }
+    if (argc > 2) {
+        frame_period = strtoull(argv[2], NULL, 0);
+    }
+    if (frame_period == 0) {
+        frame_period = SIM_FRAME_PERIOD;
+    }
+
+    printf("%-9s %-8s %7s %12s %12s %12s\n", "demo", "mode", "fps", "capture ms", "total ms",
+            "command ms");
+    for (d = 0; d < sizeof(demos) / sizeof(demos[0]); d++) {
+        for (mode = 0; mode < SIM_LAST; mode++) {
+            simulate(&demos[d], mode, duration, &stats[mode]);
+            printf("%-9s %-8s %7.2f %12.1f %12.1f %7.1f/%4.1f\n", demos[d].name, mode_names[mode],
+                    fps(&stats[mode]),
+                    stats[mode].capture / 1000.0 / stats[mode].frames,
+                    stats[mode].latency / 1000.0 / stats[mode].frames,
+                    stats[mode].command_latency / 1000.0 / stats[mode].commands,
+                    stats[mode].command_latency_max / 1000.0);
+            if (stats[mode].sent_disabled) {
+                printf("FAIL: %u frames sent while video was disabled\n", stats[mode].sent_disabled);
+                errors++;
+            }
+        }
+        if (fps(&stats[SIM_OVERLAP]) < fps(&stats[SIM_SERIAL])) {
+            printf("FAIL: overlap is slower\n");
+            errors++;
+        }
+        // Frames cut short by the video toggles differ a little between the modes
+        if ((fps(&stats[SIM_GATED]) < 0.99 * fps(&stats[SIM_SERIAL])) ||
+                (fps(&stats[SIM_GATED]) < 0.99 * fps(&stats[SIM_OVERLAP]))) {
+            printf("FAIL: gated overlap is slower\n");
+            errors++;
+        }
+        if (((double) stats[SIM_GATED].capture / stats[SIM_GATED].frames) >
+                (1.01 * stats[SIM_OVERLAP].capture / stats[SIM_OVERLAP].frames)) {
+            printf("FAIL: gated overlap waits longer for captures\n");
+            errors++;
+        }
+    }
+
+    return errors ? 1 : 0;
+}
+
+// The camera takes the first frame that starts after the capture was started
+static uint64_t capture_done(uint64_t start)
+{
+    return ((start + frame_period - 1) / frame_period + 1) * frame_period;
+}
+
+static double fps(const sim_stats_t *stats)
+{
+    return stats->frames * 1000000.0 / stats->enabled;
+}
+
+static void simulate(const sim_demo_t *demo, sim_mode_e mode, uint64_t duration, sim_stats_t *stats)
+{
+    uint64_t now = 0;
+    uint64_t capture_started_time = 0;
+    uint64_t capture_completed_time;
+    uint64_t capture_ready = capture_done(0);
+    uint64_t cnn_completed_time;
+    uint64_t cnn_result_duration = 0;
+    uint64_t next_capture_started_time = 0;
+    uint64_t next_toggle = SIM_TOGGLE_PERIOD;
+    uint64_t command_time = 0;
+    uint64_t enabled_time = 0;
+    int enable_video = 1;
+    int command = 0;    // Pending command, 1 disable, 2 enable
+    uint32_t time_counter = 0;
+    int overlap = 0;
+
+    memset(stats, 0, sizeof(sim_stats_t));
+
+    while (now < duration) {
+        // Commands arrive during the frame work and wait for the top of the loop
+        if (!command && (now >= next_toggle)) {
+            command = enable_video ? 1 : 2;
+            command_time = next_toggle;
+            next_toggle += enable_video ? SIM_DISABLED : (SIM_TOGGLE_PERIOD - SIM_DISABLED);
+        }
+        if (command) {
+            uint32_t latency = (uint32_t) (now - command_time);
+
+            stats->command_latency += latency;
+            stats->commands++;
+            stats->command_latency_max = (latency > stats->command_latency_max) ? latency : stats->command_latency_max;
+
+            if (command == 1) {
+                // MXC_PCIF_Stop
+                enable_video = 0;
+                stats->enabled += now - enabled_time;
+            } else {
+                enable_video = 1;
+                enabled_time = now;
+                capture_started_time = now;
+                capture_ready = capture_done(now);
+            }
+            command = 0;
+        }
+
+        if (!enable_video) {
+            now = next_toggle;
+            continue;
+        }
+
+        if (now < capture_ready) {
+            now = (capture_ready < next_toggle) ? capture_ready : next_toggle;
+            continue;
+        }
+
+        // camera_is_image_rcv
+        capture_completed_time = now;
+
+        // send_img
+        if (!enable_video) {
+            stats->sent_disabled++;
+        }
+        now += SIM_FRAME_TRANSFER;
+
+        // run_cnn_load
+        now += demo->cnn_load;
+
+        overlap = (mode == SIM_OVERLAP) || ((mode == SIM_GATED) &&
+                (((now - capture_completed_time) + cnn_result_duration) > frame_period));
+        if (overlap) {
+            next_capture_started_time = now;
+            capture_ready = capture_done(now);
+        }
+
+        // run_cnn_result
+        now += demo->cnn_result;
+        cnn_result_duration = demo->cnn_result;
+        cnn_completed_time = now;
+
+        if ((time_counter % 10) == 0) {
+            now += SIM_STATISTICS;
+        }
+        stats->capture += capture_completed_time - capture_started_time;
+        stats->latency += cnn_completed_time - capture_started_time;
+        stats->frames++;
+        time_counter++;
+
+        if (overlap) {
+            capture_started_time = next_capture_started_time;
+        } else {
+            capture_started_time = now;
+            capture_ready = capture_done(now);
+        }
+    }
+
+    if (enable_video) {
+        stats->enabled += now - enabled_time;
+    }
+}
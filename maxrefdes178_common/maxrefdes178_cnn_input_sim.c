@@ -0,0 +1,464 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check and benchmark of the CNN input conversion of the video firmware
+ * (max78000_video_cnn_input.c, the same in FaceId, CatsDogs and WildLife), Linux x86-64 only:
+ *
+ *   gcc -O2 -I. -I../maxrefdes178-FaceId/maxrefdes178_max78000_video/include \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max78000_video/src/max78000_video_cnn_input.c \
+ *       maxrefdes178_cnn_input_sim.c -o cnn_input_sim
+ *   ./cnn_input_sim [iterations]
+ *
+ * The CNN FIFO page is mapped without access, every status read and FIFO write faults and is
+ * single stepped against a FIFO model that drains one word per FIFO every drain period accesses.
+ * The former per pixel run_cnn_load loops (FaceID HWC 120x160, CatsDogs/WildLife CHW 192x192
+ * with 3:1 decimation) and the current ones, FaceID converting straight into the FIFO and CHW
+ * converting a row into a line buffer before the drain, are run for a set of x_offset/y_offset
+ * values covering every source alignment. The words written into each FIFO must be the same bit
+ * for bit, no word may be written into a full FIFO and the number of status reads per frame is
+ * reported. The benchmark then maps the page read write, the FIFOs never fill,
+ * and reports the time per frame of both paths. Host times only compare the two paths, the status
+ * reads are what costs wait states on the MAX78000.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "max78000_video_cnn_input.h"
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define CNN_FIFO_PAGE       0x50000000UL
+#define CNN_FIFO_STATUS     0x50000004UL
+#define CNN_FIFO_0          0x50000008UL
+#define CNN_FIFO_COUNT      3
+#define PAGE_SIZE           4096UL
+
+#define FIFO_DEPTH          8       // Model depth
+#define STREAM_SIZE         (FACEID_WIDTH * FACEID_HEIGHT)
+
+#define CHW_WIDTH           192
+#define CHW_HEIGHT          192
+
+#define TRAP_FLAG           0x100
+#define PF_WRITE            0x2
+
+#define DEFAULT_ITERATIONS  200
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    uint32_t words[CNN_FIFO_COUNT][STREAM_SIZE];
+    uint32_t count[CNN_FIFO_COUNT];
+    uint32_t status_reads;
+    uint32_t overflows;
+} fifo_stream_t;
+
+typedef struct {
+    int x;
+    int y;
+} offset_t;
+
+typedef void (*load_func_t)(uint8_t *raw, int x_offset, int y_offset);
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static uint8_t raw_frame[LCD_DATA_SIZE] __attribute__ ((aligned (4)));
+static fifo_stream_t stream_old;
+static fifo_stream_t stream_new;
+static fifo_stream_t *stream;
+static uint32_t fifo_level[CNN_FIFO_COUNT];
+static uint32_t drain_period;
+static uint32_t access_count;
+static volatile uintptr_t fault_address;
+static volatile int fault_write;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void segv_handler(int sig, siginfo_t *info, void *context);
+static void trap_handler(int sig, siginfo_t *info, void *context);
+static void old_load_faceid(uint8_t *raw, int x_offset, int y_offset);
+static void new_load_faceid(uint8_t *raw, int x_offset, int y_offset);
+static void old_load_chw(uint8_t *raw, int x_offset, int y_offset);
+static void new_load_chw(uint8_t *raw, int x_offset, int y_offset);
+static void run(load_func_t load, fifo_stream_t *dst, offset_t offset, uint32_t period);
+static int compare(const char *name, offset_t offset, uint32_t period);
+static void fill_frame(int pattern);
+static double elapsed_us(clock_t start, int iterations);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    // Offsets keep the crop inside the 240x240 frame, odd and even for both source alignments
+    static const offset_t faceid_offsets[] = {{0, 0}, {1, 0}, {-1, 1}, {-60, -40}, {60, 40}, {59, -40}};
+    static const offset_t chw_offsets[] = {{0, 0}, {1, 0}, {2, 1}, {-1, 2}, {-24, -24}, {24, 24}, {23, -24}};
+    static const uint32_t periods[] = {1, 3};
+    struct sigaction sa;
+    int iterations = DEFAULT_ITERATIONS;
+    int errors = 0;
+    clock_t start;
+    size_t o, p;
+    int pattern;
+    int i;
+
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+    }
+    if (iterations <= 0) {
+        iterations = DEFAULT_ITERATIONS;
+    }
+
+    if (mmap((void *) CNN_FIFO_PAGE, PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+            -1, 0) != (void *) CNN_FIFO_PAGE) {
+        perror("mmap CNN FIFO page");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_SIGINFO;
+    sa.sa_sigaction = segv_handler;
+    sigaction(SIGSEGV, &sa, NULL);
+    sa.sa_sigaction = trap_handler;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    srand(178);
+
+    // Random pixels, then a ramp through the RGB565 values. The slow drain makes the writers wait
+    for (pattern = 0; pattern < 2; pattern++) {
+        fill_frame(pattern);
+
+        for (p = 0; p < sizeof(periods) / sizeof(periods[0]); p++) {
+            for (o = 0; o < sizeof(faceid_offsets) / sizeof(faceid_offsets[0]); o++) {
+                if ((p > 0) && (o > 1)) {
+                    break;
+                }
+                run(old_load_faceid, &stream_old, faceid_offsets[o], periods[p]);
+                run(new_load_faceid, &stream_new, faceid_offsets[o], periods[p]);
+                errors += compare("hwc", faceid_offsets[o], periods[p]);
+                if ((pattern == 0) && (o == 0)) {
+                    printf("FaceID HWC    drain period %u, %5u words, status reads per pixel %5u, direct      %5u\n",
+                            periods[p], stream_new.count[0], stream_old.status_reads, stream_new.status_reads);
+                }
+            }
+
+            for (o = 0; o < sizeof(chw_offsets) / sizeof(chw_offsets[0]); o++) {
+                run(old_load_chw, &stream_old, chw_offsets[o], periods[p]);
+                run(new_load_chw, &stream_new, chw_offsets[o], periods[p]);
+                errors += compare("chw", chw_offsets[o], periods[p]);
+                if ((pattern == 0) && (o == 0)) {
+                    printf("CHW 3:1       drain period %u, %5u words, status reads per pixel %5u, line buffer %5u\n",
+                            periods[p], CNN_FIFO_COUNT * stream_new.count[0], stream_old.status_reads,
+                            stream_new.status_reads);
+                }
+            }
+        }
+    }
+
+    // FIFOs never full, the page is plain memory
+    mprotect((void *) CNN_FIFO_PAGE, PAGE_SIZE, PROT_READ | PROT_WRITE);
+    memset((void *) CNN_FIFO_PAGE, 0, PAGE_SIZE);
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        old_load_faceid(raw_frame, 0, 0);
+    }
+    printf("FaceID HWC per pixel:   %8.1f us/frame\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        new_load_faceid(raw_frame, 0, 0);
+    }
+    printf("FaceID HWC direct:      %8.1f us/frame\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        old_load_chw(raw_frame, 0, 0);
+    }
+    printf("CHW 3:1 per pixel:      %8.1f us/frame\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        new_load_chw(raw_frame, 0, 0);
+    }
+    printf("CHW 3:1 line buffer:    %8.1f us/frame\n", elapsed_us(start, iterations));
+
+    printf("cnn input check: %s\n", errors ? "FAILED" : "passed");
+
+    return errors ? 1 : 0;
+}
+
+// Access to the FIFO page, drain the model and allow the access for one instruction
+static void segv_handler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *) context;
+    uintptr_t address = (uintptr_t) info->si_addr;
+    uint32_t status = 0;
+    int i;
+
+    (void) sig;
+    if ((address < CNN_FIFO_PAGE) || (address >= (CNN_FIFO_PAGE + PAGE_SIZE))) {
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    fault_address = address;
+    fault_write = (uc->uc_mcontext.gregs[REG_ERR] & PF_WRITE) != 0;
+
+    access_count++;
+    for (i = 0; i < CNN_FIFO_COUNT; i++) {
+        if (((access_count % drain_period) == 0) && fifo_level[i]) {
+            fifo_level[i]--;
+        }
+        if (fifo_level[i] >= FIFO_DEPTH) {
+            status |= 1 << i;
+        }
+    }
+
+    mprotect((void *) CNN_FIFO_PAGE, PAGE_SIZE, PROT_READ | PROT_WRITE);
+    if (!fault_write && (address == CNN_FIFO_STATUS)) {
+        *(volatile uint32_t *) CNN_FIFO_STATUS = status;
+        stream->status_reads++;
+    }
+    uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+}
+
+// Access done, push a written word and protect the page again
+static void trap_handler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *) context;
+    uintptr_t address = fault_address;
+    uint32_t fifo;
+
+    (void) sig;
+    (void) info;
+    if (fault_write && (address >= CNN_FIFO_0) && (address < (CNN_FIFO_0 + CNN_FIFO_COUNT * 4))) {
+        fifo = (address - CNN_FIFO_0) / 4;
+        if (fifo_level[fifo] >= FIFO_DEPTH) {
+            stream->overflows++;
+        } else {
+            fifo_level[fifo]++;
+        }
+        if (stream->count[fifo] < STREAM_SIZE) {
+            stream->words[fifo][stream->count[fifo]++] = *(volatile uint32_t *) address;
+        }
+    }
+
+    mprotect((void *) CNN_FIFO_PAGE, PAGE_SIZE, PROT_NONE);
+    uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+}
+
+// FaceID run_cnn_load before the word-wide conversion
+static void old_load_faceid(uint8_t *raw, int x_offset, int y_offset)
+{
+    uint8_t *data;
+    uint8_t ur, ug, ub;
+    int8_t r, g, b;
+    uint32_t number;
+
+    for (int i = y_offset; i < FACEID_HEIGHT + y_offset; i++) {
+        data = raw + (((LCD_HEIGHT - FACEID_HEIGHT) / 2) + i) * LCD_WIDTH * LCD_BYTE_PER_PIXEL;  // down
+        data += ((LCD_WIDTH - FACEID_WIDTH) / 2) * LCD_BYTE_PER_PIXEL;  // right
+
+        for(int j = x_offset; j < FACEID_WIDTH + x_offset; j++) {
+            // RGB565, |RRRRRGGG|GGGBBBBB|
+            ub = (data[j * LCD_BYTE_PER_PIXEL + 1] << 3);
+            ug = ((data[j * LCD_BYTE_PER_PIXEL] << 5) | ((data[j * LCD_BYTE_PER_PIXEL + 1] & 0xE0) >> 3));
+            ur = (data[j * LCD_BYTE_PER_PIXEL] & 0xF8);
+
+            b = ub - 128;
+            g = ug - 128;
+            r = ur - 128;
+
+            // Loading data into the CNN fifo
+            while (((*((volatile uint32_t *) 0x50000004) & 1)) != 0); // Wait for FIFO 0
+
+            number = 0x00FFFFFF & ((((uint8_t)b) << 16) | (((uint8_t)g) << 8) | ((uint8_t) r));
+
+            *((volatile uint32_t *) 0x50000008) = number; // Write FIFO 0
+        }
+    }
+}
+
+// FaceID run_cnn_load now
+static void new_load_faceid(uint8_t *raw, int x_offset, int y_offset)
+{
+    uint8_t *data;
+
+    for (int i = y_offset; i < FACEID_HEIGHT + y_offset; i++) {
+        data = raw + (((LCD_HEIGHT - FACEID_HEIGHT) / 2) + i) * LCD_WIDTH * LCD_BYTE_PER_PIXEL;  // down
+        data += ((LCD_WIDTH - FACEID_WIDTH) / 2) * LCD_BYTE_PER_PIXEL;  // right
+
+        cnn_input_fifo_write_rgb565_hwc(data + x_offset * LCD_BYTE_PER_PIXEL, FACEID_WIDTH);
+    }
+}
+
+// CatsDogs and WildLife run_cnn_load before the line buffer
+static void old_load_chw(uint8_t *raw, int x_offset, int y_offset)
+{
+    uint8_t *data;
+    uint8_t ur, ug, ub;
+    int8_t r, g, b;
+    uint32_t r32 = 0, g32 = 0, b32 = 0;
+    int cnt = 3;
+
+    for (int i = y_offset; i < CHW_HEIGHT + y_offset; i+=3) {
+        data = raw + (((LCD_HEIGHT - CHW_HEIGHT) / 2) + i) * LCD_WIDTH * LCD_BYTE_PER_PIXEL;  // down
+        data += ((LCD_WIDTH - CHW_WIDTH) / 2) * LCD_BYTE_PER_PIXEL;  // right
+
+        for(int j = x_offset; j < CHW_WIDTH + x_offset; j+=3) {
+
+            // RGB565, |RRRRRGGG|GGGBBBBB|
+            ub = (data[j * LCD_BYTE_PER_PIXEL + 1] << 3);
+            ug = ((data[j * LCD_BYTE_PER_PIXEL] << 5) | ((data[j * LCD_BYTE_PER_PIXEL + 1] & 0xE0) >> 3));
+            ur = (data[j * LCD_BYTE_PER_PIXEL] & 0xF8);
+
+            b = ub - 128;
+            g = ug - 128;
+            r = ur - 128;
+
+            r32 = r32 | ((uint32_t)(uint8_t)r << ((cnt)*8));
+            g32 = g32 | ((uint32_t)(uint8_t)g << ((cnt)*8));
+            b32 = b32 | ((uint32_t)(uint8_t)b << ((cnt)*8));
+
+            // when 4 bytes are packed, write to FIFOs
+            if (cnt == 0) {
+                while (((*((volatile uint32_t *) 0x50000004) & 1)) != 0); // Wait for FIFO 0
+                *((volatile uint32_t *) 0x50000008) = r32; // Write FIFO 0
+
+                while (((*((volatile uint32_t *) 0x50000004) & 2)) != 0); // Wait for FIFO 1
+                *((volatile uint32_t *) 0x5000000c) = g32; // Write FIFO 1
+
+                while (((*((volatile uint32_t *) 0x50000004) & 4)) != 0); // Wait for FIFO 2
+                *((volatile uint32_t *) 0x50000010) = b32; // Write FIFO 2
+
+                r32 = 0;
+                g32 = 0;
+                b32 = 0;
+                cnt = 3;
+            } else {
+                cnt--;
+            }
+        }
+    }
+}
+
+// CatsDogs and WildLife run_cnn_load now
+static void new_load_chw(uint8_t *raw, int x_offset, int y_offset)
+{
+    static uint32_t line_r[CHW_WIDTH / 3 / 4];
+    static uint32_t line_g[CHW_WIDTH / 3 / 4];
+    static uint32_t line_b[CHW_WIDTH / 3 / 4];
+    uint8_t *data;
+
+    for (int i = y_offset; i < CHW_HEIGHT + y_offset; i+=3) {
+        data = raw + (((LCD_HEIGHT - CHW_HEIGHT) / 2) + i) * LCD_WIDTH * LCD_BYTE_PER_PIXEL;  // down
+        data += ((LCD_WIDTH - CHW_WIDTH) / 2) * LCD_BYTE_PER_PIXEL;  // right
+
+        cnn_input_rgb565_to_chw(data + x_offset * LCD_BYTE_PER_PIXEL, 3, line_r, line_g, line_b, CHW_WIDTH / 3);
+        cnn_input_fifo_write_chw(line_r, line_g, line_b, CHW_WIDTH / 3 / 4);
+    }
+}
+
+static void run(load_func_t load, fifo_stream_t *dst, offset_t offset, uint32_t period)
+{
+    memset(dst, 0, sizeof(fifo_stream_t));
+    memset(fifo_level, 0, sizeof(fifo_level));
+    stream = dst;
+    drain_period = period;
+    access_count = 0;
+
+    // The handlers use the model, volatile FIFO accesses alone do not order these stores
+    __asm__ volatile ("" ::: "memory");
+    load(raw_frame, offset.x, offset.y);
+    __asm__ volatile ("" ::: "memory");
+}
+
+static int compare(const char *name, offset_t offset, uint32_t period)
+{
+    int i;
+
+    if (stream_old.overflows || stream_new.overflows) {
+        printf("FAIL: %s offset %d,%d period %u, FIFO overflow %u/%u\n", name, offset.x, offset.y, period,
+                stream_old.overflows, stream_new.overflows);
+        return 1;
+    }
+
+    for (i = 0; i < CNN_FIFO_COUNT; i++) {
+        if ((stream_old.count[i] != stream_new.count[i]) ||
+                memcmp(stream_old.words[i], stream_new.words[i], stream_old.count[i] * sizeof(uint32_t))) {
+            printf("FAIL: %s offset %d,%d period %u, FIFO %d differs\n", name, offset.x, offset.y, period, i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void fill_frame(int pattern)
+{
+    uint16_t *pixel = (uint16_t *) raw_frame;
+    int i;
+
+    for (i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+        pixel[i] = pattern ? (uint16_t) (i * 7) : (uint16_t) rand();
+    }
+}
+
+static double elapsed_us(clock_t start, int iterations)
+{
+    return (double) (clock() - start) * 1000000.0 / CLOCKS_PER_SEC / iterations;
+}
@@ -0,0 +1,462 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check of the warm CNN path of the video firmware (cnn_prepare/cnn_release in
+ * max78000_video_cnn.c) with a register writes recording stand-in for the CNN block, Linux
+ * x86-64 only:
+ *
+ *   gcc -O2 -I. -Ihost -I../maxrefdes178-FaceId/maxrefdes178_max78000_video/include \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max78000_video/src/max78000_video_cnn.c \
+ *       maxrefdes178_cnn_sim.c -o cnn_sim
+ *   ./cnn_sim
+ *
+ * Any demo builds the same way with its own include and source paths. The CNN address range is
+ * mapped without access, every access faults, is single stepped and the written words are logged
+ * in order together with the CNN clock calls. The former per frame sequence (clock enable,
+ * cnn_init, cnn_load_bias, cnn_configure ... cnn_stop, clock disable) is recorded first, then
+ * frames as run_cnn does them now. A cold frame must write what the former sequence wrote, a warm
+ * frame only the re-arm part of it and leave the registers as a cold frame does, cnn_release,
+ * cnn_disable and cnn_enable must force the next frame to be cold.
+ *
+ * The bias memory is written through plain pointers, at -O2 the compiler may move those stores
+ * across the volatile register writes once cnn_load_bias is inlined into cnn_prepare. Cold frames
+ * are therefore compared per address, in order of writes to each address.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+#include "mxc.h"
+#include "max78000_video_cnn.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define CNN_BASE            0x50000000UL
+#define CNN_SIZE            0x01100000UL    // Registers, weight, bias and data memory
+#define PAGE_SIZE           4096UL
+#define LOG_SIZE            (1 << 20)
+#define UNLOAD_SIZE         (256 * 1024)
+
+#define TRAP_FLAG           0x100
+#define PF_WRITE            0x2
+
+// Log entries for calls outside the CNN block, address 0
+#define EVENT_CLOCK_ENABLE  1
+#define EVENT_CLOCK_DISABLE 2
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    uint32_t address;
+    uint32_t value;
+} reg_write_t;
+
+typedef struct {
+    reg_write_t write;
+    uint32_t index;
+} reg_write_order_t;
+
+typedef struct {
+    uint32_t start;
+    uint32_t count;
+} log_span_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+mxc_gcfr_regs_t host_gcfr;
+mxc_gcr_regs_t host_gcr;
+mxc_tmr_regs_t host_tmr0;
+
+static reg_write_t reg_log[LOG_SIZE];
+static uint32_t reg_log_count;
+static uint32_t reg_log_lost;
+static volatile uintptr_t fault_address;
+static volatile int fault_write;
+static uint32_t unload_buffer[UNLOAD_SIZE / sizeof(uint32_t)];
+
+extern void CNN_ISR(void);
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void segv_handler(int sig, siginfo_t *info, void *context);
+static void trap_handler(int sig, siginfo_t *info, void *context);
+static void log_event(uint32_t event);
+static log_span_t log_begin(void);
+static void log_end(log_span_t *span);
+static int log_equal(log_span_t a, log_span_t b);
+static int log_equal_per_address(log_span_t a, log_span_t b);
+static int write_order_compare(const void *a, const void *b);
+static reg_write_order_t *log_sort(log_span_t span);
+static void snapshot(uint8_t *dst);
+static void frame_former(void);
+static void frame(void);
+static int check(int ok, const char *what);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(void)
+{
+    struct sigaction sa;
+    log_span_t former, former_setup, cold, warm, warm_prepare, warm2, release, after, span;
+    uint8_t *regs_cold;
+    uint8_t *regs_warm;
+    int errors = 0;
+    uint32_t i;
+
+    if (mmap((void *) CNN_BASE, CNN_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+            -1, 0) != (void *) CNN_BASE) {
+        perror("mmap CNN block");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_SIGINFO;
+    sa.sa_sigaction = segv_handler;
+    sigaction(SIGSEGV, &sa, NULL);
+    sa.sa_sigaction = trap_handler;
+    sigaction(SIGTRAP, &sa, NULL);
+
+    regs_cold = malloc(CNN_SIZE);
+    regs_warm = malloc(CNN_SIZE);
+
+    // main
+    cnn_enable(0, 0);
+    cnn_init();
+    cnn_load_weights();
+    cnn_load_bias();
+    cnn_configure();
+    printf("startup:        %7u writes\n", reg_log_count);
+
+    // Former run_cnn
+    former = log_begin();
+    frame_former();
+    log_end(&former);
+
+    former_setup = log_begin();
+    MXC_SYS_ClockEnable(MXC_SYS_PERIPH_CLOCK_CNN);
+    cnn_init();
+    cnn_load_bias();
+    cnn_configure();
+    log_end(&former_setup);
+    MXC_SYS_ClockDisable(MXC_SYS_PERIPH_CLOCK_CNN);
+
+    // First frame after startup is cold, the clock was gated by the former sequence
+    cnn_release();
+    cold = log_begin();
+    frame();
+    log_end(&cold);
+    snapshot(regs_cold);
+
+    warm_prepare = log_begin();
+    cnn_prepare();
+    log_end(&warm_prepare);
+
+    warm = log_begin();
+    cnn_start();
+    CNN_ISR();
+    cnn_unload(unload_buffer);
+    cnn_stop();
+    log_end(&warm);
+    snapshot(regs_warm);
+
+    warm2 = log_begin();
+    frame();
+    log_end(&warm2);
+
+    // Former frame without the final clock disable, split into setup and re-arm
+    span.start = former.start;
+    span.count = former.count - 1;
+    errors += check(log_equal_per_address(span, cold), "cold frame writes the former sequence");
+    errors += check(reg_log[former.start + former.count - 1].address == 0 &&
+            reg_log[former.start + former.count - 1].value == EVENT_CLOCK_DISABLE,
+            "former frame gates the clock");
+    errors += check(warm_prepare.count == 0, "warm cnn_prepare writes nothing");
+    span.start = former.start + former_setup.count;
+    span.count = former.count - former_setup.count - 1;
+    errors += check(log_equal(span, warm), "warm frame writes only the re-arm part");
+    errors += check(log_equal(warm, warm2), "every warm frame writes the same");
+    errors += check(!memcmp(regs_cold, regs_warm, CNN_SIZE), "registers after a warm frame match a cold frame");
+
+    // Disable CNN command
+    release = log_begin();
+    cnn_release();
+    log_end(&release);
+    errors += check(release.count >= 1 && reg_log[release.start + release.count - 1].address == 0 &&
+            reg_log[release.start + release.count - 1].value == EVENT_CLOCK_DISABLE,
+            "cnn_release gates the clock");
+    after = log_begin();
+    frame();
+    log_end(&after);
+    errors += check(log_equal(after, cold), "frame after cnn_release is cold");
+
+    // Power domain reset
+    cnn_disable();
+    cnn_enable(0, 0);
+    after = log_begin();
+    frame();
+    log_end(&after);
+    errors += check(log_equal(after, cold), "frame after cnn_disable/cnn_enable is cold");
+
+    printf("former frame:   %7u writes\n", former.count);
+    printf("cold frame:     %7u writes\n", cold.count);
+    printf("warm frame:     %7u writes\n", warm2.count);
+    for (i = warm2.start; i < warm2.start + warm2.count; i++) {
+        printf("  0x%08x = 0x%08x\n", reg_log[i].address, reg_log[i].value);
+    }
+    if (reg_log_lost) {
+        printf("log overflow, %u writes lost\n", reg_log_lost);
+        errors++;
+    }
+
+    printf("cnn check: %s\n", errors ? "FAILED" : "passed");
+
+    return errors ? 1 : 0;
+}
+
+// Access to the CNN block, allow it for one instruction
+static void segv_handler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *) context;
+    uintptr_t address = (uintptr_t) info->si_addr;
+
+    (void) sig;
+    if ((address < CNN_BASE) || (address >= (CNN_BASE + CNN_SIZE))) {
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+
+    fault_address = address;
+    fault_write = (uc->uc_mcontext.gregs[REG_ERR] & PF_WRITE) != 0;
+    mprotect((void *) (address & ~(PAGE_SIZE - 1)), PAGE_SIZE, PROT_READ | PROT_WRITE);
+    uc->uc_mcontext.gregs[REG_EFL] |= TRAP_FLAG;
+}
+
+// Access done, log a write and protect the page again
+static void trap_handler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *) context;
+    uintptr_t address = fault_address & ~3UL;
+
+    (void) sig;
+    (void) info;
+    if (fault_write) {
+        if (reg_log_count < LOG_SIZE) {
+            reg_log[reg_log_count].address = (uint32_t) address;
+            reg_log[reg_log_count].value = *(volatile uint32_t *) address;
+            reg_log_count++;
+        } else {
+            reg_log_lost++;
+        }
+    }
+
+    mprotect((void *) (address & ~(PAGE_SIZE - 1)), PAGE_SIZE, PROT_NONE);
+    uc->uc_mcontext.gregs[REG_EFL] &= ~TRAP_FLAG;
+}
+
+static void log_event(uint32_t event)
+{
+    if (reg_log_count < LOG_SIZE) {
+        reg_log[reg_log_count].address = 0;
+        reg_log[reg_log_count].value = event;
+        reg_log_count++;
+    }
+}
+
+static log_span_t log_begin(void)
+{
+    log_span_t span = {reg_log_count, 0};
+
+    return span;
+}
+
+static void log_end(log_span_t *span)
+{
+    span->count = reg_log_count - span->start;
+}
+
+static int log_equal(log_span_t a, log_span_t b)
+{
+    return (a.count == b.count) &&
+            !memcmp(&reg_log[a.start], &reg_log[b.start], a.count * sizeof(reg_write_t));
+}
+
+static int write_order_compare(const void *a, const void *b)
+{
+    const reg_write_order_t *wa = (const reg_write_order_t *) a;
+    const reg_write_order_t *wb = (const reg_write_order_t *) b;
+
+    if (wa->write.address != wb->write.address) {
+        return (wa->write.address < wb->write.address) ? -1 : 1;
+    }
+
+    return (wa->index < wb->index) ? -1 : (wa->index > wb->index);
+}
+
+static reg_write_order_t *log_sort(log_span_t span)
+{
+    reg_write_order_t *sorted = malloc((span.count + 1) * sizeof(reg_write_order_t));
+    uint32_t i;
+
+    for (i = 0; i < span.count; i++) {
+        sorted[i].write = reg_log[span.start + i];
+        sorted[i].index = i;
+    }
+    qsort(sorted, span.count, sizeof(reg_write_order_t), write_order_compare);
+
+    return sorted;
+}
+
+static int log_equal_per_address(log_span_t a, log_span_t b)
+{
+    reg_write_order_t *sorted_a;
+    reg_write_order_t *sorted_b;
+    uint32_t i;
+    int equal = (a.count == b.count);
+
+    if (!equal) {
+        return 0;
+    }
+
+    sorted_a = log_sort(a);
+    sorted_b = log_sort(b);
+    for (i = 0; equal && (i < a.count); i++) {
+        equal = (sorted_a[i].write.address == sorted_b[i].write.address) &&
+                (sorted_a[i].write.value == sorted_b[i].write.value);
+    }
+    free(sorted_a);
+    free(sorted_b);
+
+    return equal;
+}
+
+static void snapshot(uint8_t *dst)
+{
+    mprotect((void *) CNN_BASE, CNN_SIZE, PROT_READ);
+    memcpy(dst, (void *) CNN_BASE, CNN_SIZE);
+    mprotect((void *) CNN_BASE, CNN_SIZE, PROT_NONE);
+}
+
+// run_cnn before the warm path, CNN input loading left out
+static void frame_former(void)
+{
+    MXC_SYS_ClockEnable(MXC_SYS_PERIPH_CLOCK_CNN);
+    cnn_init();
+    cnn_load_bias();
+    cnn_configure();
+    cnn_start();
+    CNN_ISR();
+    cnn_unload(unload_buffer);
+    cnn_stop();
+    MXC_SYS_ClockDisable(MXC_SYS_PERIPH_CLOCK_CNN);
+}
+
+// run_cnn now, CNN input loading left out
+static void frame(void)
+{
+    cnn_prepare();
+    cnn_start();
+    CNN_ISR();
+    cnn_unload(unload_buffer);
+    cnn_stop();
+}
+
+static int check(int ok, const char *what)
+{
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+    }
+
+    return ok ? 0 : 1;
+}
+
+// SDK stand-ins
+void MXC_SYS_ClockEnable(mxc_sys_periph_clock_t clock)
+{
+    (void) clock;
+    log_event(EVENT_CLOCK_ENABLE);
+}
+
+void MXC_SYS_ClockDisable(mxc_sys_periph_clock_t clock)
+{
+    (void) clock;
+    log_event(EVENT_CLOCK_DISABLE);
+}
+
+void MXC_TMR_SW_Start(mxc_tmr_regs_t *tmr)
+{
+    (void) tmr;
+}
+
+unsigned int MXC_TMR_SW_Stop(mxc_tmr_regs_t *tmr)
+{
+    (void) tmr;
+    return 1;
+}
+
+void NVIC_SetVector(IRQn_Type irqn, void (*irq_callback)(void))
+{
+    (void) irqn;
+    (void) irq_callback;
+}
+
+int MXC_GPIO_Config(const mxc_gpio_cfg_t *cfg)
+{
+    (void) cfg;
+    return E_NO_ERROR;
+}
+
+void MXC_GPIO_OutSet(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    port->out |= mask;
+}
@@ -0,0 +1,243 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check and benchmark of the CRC-16 engine (maxrefdes178_utility.c):
+ *
+ *   gcc -O2 -I. maxrefdes178_utility.c maxrefdes178_crc16_sim.c -o crc16_sim
+ *   ./crc16_sim [iterations]
+ *
+ * The slice-by-4 crc16_sw is compared with crc16_bitwise for every length up to CHECK_LEN at
+ * every start alignment, on the check string and across the former 255 byte length limit, and
+ * the incremental init/update/final API for every split of a buffer and for DMA sized chunks of
+ * a video frame. Time per 240x240 RGB565 frame is reported for both routines.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_utility.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define CHECK_LEN           1100
+#define SPLIT_LEN           300
+#define DMA_CHUNK           0xFFFF  // Largest MAX78000 QSPI slave DMA transfer
+#define DEFAULT_ITERATIONS  200
+#define CRC16_ARC_CHECK     0xBB3D  // CRC-16/ARC of "123456789"
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static uint8_t buffer[LCD_DATA_SIZE + 4] __attribute__ ((aligned (4)));
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint16_t reference(const uint8_t *data, uint32_t len);
+static int check_lengths(void);
+static int check_splits(void);
+static int check_frame(void);
+static double elapsed_us(clock_t start, int iterations);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    volatile uint16_t sink = 0;
+    int iterations = DEFAULT_ITERATIONS;
+    int errors = 0;
+    clock_t start;
+    uint32_t i;
+    int n;
+
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+    }
+    if (iterations <= 0) {
+        iterations = DEFAULT_ITERATIONS;
+    }
+
+    srand(178);
+    for (i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = (uint8_t) rand();
+    }
+
+    if (crc16_sw((uint8_t *) "123456789", 9) != CRC16_ARC_CHECK) {
+        printf("check string: got 0x%04x, expected 0x%04x\n", crc16_sw((uint8_t *) "123456789", 9),
+                CRC16_ARC_CHECK);
+        errors++;
+    }
+    errors += check_lengths();
+    errors += check_splits();
+    errors += check_frame();
+
+    printf("crc check: %s\n", errors ? "FAILED" : "passed");
+
+    start = clock();
+    for (n = 0; n < iterations; n++) {
+        sink ^= reference(buffer, LCD_DATA_SIZE);
+    }
+    printf("bitwise:     %10.1f us/frame\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (n = 0; n < iterations; n++) {
+        sink ^= crc16_sw(buffer, LCD_DATA_SIZE);
+    }
+    printf("slice-by-4:  %10.1f us/frame\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (n = 0; n < iterations; n++) {
+        sink ^= crc16_sw(&buffer[1], LCD_DATA_SIZE);
+    }
+    printf("unaligned:   %10.1f us/frame\n", elapsed_us(start, iterations));
+
+    return errors ? 1 : 0;
+}
+
+static uint16_t reference(const uint8_t *data, uint32_t len)
+{
+    return crc16_bitwise(CRC16_INIT, data, len, CRC16_POLY);
+}
+
+// Every length, every start alignment
+static int check_lengths(void)
+{
+    uint32_t offset;
+    uint32_t len;
+    uint16_t crc;
+    int errors = 0;
+
+    for (offset = 0; offset < 4; offset++) {
+        for (len = 0; len <= CHECK_LEN; len++) {
+            crc = crc16_sw(&buffer[offset], len);
+            if (crc != reference(&buffer[offset], len)) {
+                if (errors++ < 10) {
+                    printf("offset %u len %u: got 0x%04x, expected 0x%04x\n", offset, len, crc,
+                            reference(&buffer[offset], len));
+                }
+            }
+        }
+    }
+
+    return errors;
+}
+
+// Incremental API, every split point and a three way split
+static int check_splits(void)
+{
+    uint32_t offset;
+    uint32_t a;
+    uint32_t b;
+    uint16_t crc;
+    uint16_t expected;
+    int errors = 0;
+
+    for (offset = 0; offset < 4; offset++) {
+        expected = reference(&buffer[offset], SPLIT_LEN);
+
+        for (a = 0; a <= SPLIT_LEN; a++) {
+            crc = crc16_init();
+            crc = crc16_update(crc, &buffer[offset], a);
+            crc = crc16_update(crc, &buffer[offset + a], SPLIT_LEN - a);
+            if (crc16_final(crc) != expected) {
+                if (errors++ < 10) {
+                    printf("offset %u split %u: got 0x%04x, expected 0x%04x\n", offset, a,
+                            crc16_final(crc), expected);
+                }
+            }
+
+            b = (a + 7) % (SPLIT_LEN + 1);
+            b = (b < a) ? a : b;
+            crc = crc16_init();
+            crc = crc16_update(crc, &buffer[offset], a);
+            crc = crc16_update(crc, &buffer[offset + a], b - a);
+            crc = crc16_update(crc, &buffer[offset + b], SPLIT_LEN - b);
+            if (crc16_final(crc) != expected) {
+                if (errors++ < 10) {
+                    printf("offset %u split %u/%u: got 0x%04x, expected 0x%04x\n", offset, a, b,
+                            crc16_final(crc), expected);
+                }
+            }
+        }
+    }
+
+    return errors;
+}
+
+// Whole frame at once and in DMA sized chunks
+static int check_frame(void)
+{
+    uint16_t expected = reference(buffer, LCD_DATA_SIZE);
+    uint16_t crc;
+    uint32_t done;
+    uint32_t len;
+    int errors = 0;
+
+    crc = crc16_sw(buffer, LCD_DATA_SIZE);
+    if (crc != expected) {
+        printf("frame: got 0x%04x, expected 0x%04x\n", crc, expected);
+        errors++;
+    }
+
+    crc = crc16_init();
+    for (done = 0; done < LCD_DATA_SIZE; done += len) {
+        len = MIN(DMA_CHUNK, LCD_DATA_SIZE - done);
+        crc = crc16_update(crc, &buffer[done], len);
+    }
+    if (crc16_final(crc) != expected) {
+        printf("frame chunks: got 0x%04x, expected 0x%04x\n", crc16_final(crc), expected);
+        errors++;
+    }
+
+    return errors;
+}
+
+static double elapsed_us(clock_t start, int iterations)
+{
+    return (double) (clock() - start) * 1000000.0 / CLOCKS_PER_SEC / iterations;
+}
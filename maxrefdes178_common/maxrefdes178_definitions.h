@@ -51,7 +51,9 @@
 #define QSPI_START_SYMBOL                  0xAABBCCDD
 #define QSPI_CS_ASSERT_WAIT                10         // us
 
+#ifndef SPI_TIMEOUT_CNT
 #define SPI_TIMEOUT_CNT                    1000000  // loop counter
+#endif
 
 // Common I2C
 #define I2C_SPEED                          100000  // hz
@@ -146,6 +148,7 @@
 
 #define UNET_IMAGE_SIZE_X                  80
 #define UNET_IMAGE_SIZE_Y                  80
+#define UNET_MASK_TIMEOUT                  1000  // ms, mask is dropped from the display after
 
 // Common WILDLIFE
 #define WILDLIFE_WIDTH                     192
@@ -163,10 +166,17 @@
 
 #define BLE_STATISTICS_INTERVAL            UINT32_C(1000)  // ms
 
+// Common Trace
+#define TRACE_BUFFER_SIZE                  256  // events, power of two
+#define TRACE_DUMP_EVENT_COUNT             128  // events per dump
+
 // Inactivity
 #define INACTIVITY_SHORT_DURATION          UINT32_C(60 * 1000)  // ms
 #define INACTIVITY_LONG_DURATION           UINT32_C(2 * 60 * 1000)  // ms
 
+// Frame rate governor
+#define GOVERNOR_CNN_INTERVAL_MAX          16  // frames
+
 // Common MAX78000s
 #define MAX78000_SLEEP_DEFER_DURATION      30  // s
 
@@ -253,10 +263,14 @@
 #define MAX32666_TIMER_BLE_SLEEP           MXC_TMR1  // TODO remove
 #define MAX32666_TIMER_MS                  MXC_TMR2
 #define MAX32666_TIMER_BUTTON_POWER        MXC_TMR3
+#define MAX32666_TIMER_QSPI_CS             MXC_TMR4
 
 // MAX32666 BLE Communication buffer
-#define MAX32666_BLE_QUEUE_SIZE            10
+#define MAX32666_BLE_QUEUE_SIZE            16  // Must be a power of two
+#define MAX32666_BLE_TX_WINDOW             4   // Response packets queued to core1 ahead of the indication in flight
+#define MAX32666_BLE_TX_RETRY              3   // Worker passes an unsent packet is retried before the stream is aborted
 #define MAX32666_BLE_COMMAND_BUFFER_SIZE   FACEID_MAX_EMBEDDINGS_SIZE
+#define MAX32666_BLE_COMMAND_PENDING       4   // Single packet responses held while a multi packet response is queued
 
 // MAX32666 PMIC and Fuel Gauge
 #define MAX32666_PMIC_INTERVAL             UINT32_C(10 * 1000)  // ms
@@ -269,6 +283,17 @@
 // MAX32666 LED
 #define MAX32666_LED_INTERVAL              UINT32_C(1000)  // ms
 
+// MAX32666 Scheduler, polling periods back up the interrupt events
+#define MAX32666_QSPI_POLL_INTERVAL        UINT32_C(10)  // ms, QSPI RX timeout and deferred TX
+#define MAX32666_LCD_POLL_INTERVAL         UINT32_C(5)   // ms, screen refresh requests and frame rate limit
+#define MAX32666_BLE_INTERVAL              UINT32_C(2)   // ms, core1 does not post events
+#define MAX32666_STATUS_INTERVAL           UINT32_C(50)  // ms, statistics, no video screen and inactivity
+
+// MAX32666 Scheduler events
+#define MAX32666_EVENT_QSPI                (1UL << 0)  // Slave interrupt or QSPI DMA done
+#define MAX32666_EVENT_LCD                 (1UL << 1)  // LCD or QSPI DMA done, video frame received
+#define MAX32666_EVENT_INPUT               (1UL << 2)  // Touch, button or IO expander interrupt
+
 /*** MAX78000 AUDIO ***/
 // MAX78000 AUDIO PINS
 #define MAX78000_AUDIO_HOST_CS_PIN         {MXC_GPIO0, MXC_GPIO_PIN_4, MXC_GPIO_FUNC_IN, MXC_GPIO_PAD_NONE, MXC_GPIO_VSSEL_VDDIO}
@@ -450,6 +475,17 @@ typedef enum {
     QSPI_PACKET_TYPE_AUDIO_DEMO_NAME_CMD,      // None
     QSPI_PACKET_TYPE_AUDIO_DEMO_NAME_RES,      // Demo string
 
+    QSPI_PACKET_TYPE_VIDEO_TRACE_RES,          // trace_dump_t
+    QSPI_PACKET_TYPE_AUDIO_TRACE_RES,          // trace_dump_t
+
+    QSPI_PACKET_TYPE_VIDEO_ENABLE_COMPRESSION_CMD,  // None
+    QSPI_PACKET_TYPE_VIDEO_DISABLE_COMPRESSION_CMD, // None
+    QSPI_PACKET_TYPE_VIDEO_COMPRESSED_DATA_RES,     // 240x240 RGB565 Image, maxrefdes178_video_codec.h
+
+    QSPI_PACKET_TYPE_VIDEO_CNN_INTERVAL_CMD,        // uint8_t, CNN runs on every Nth frame
+
+    QSPI_PACKET_TYPE_VIDEO_UNET_MASK_RES,           // unet_mask_result_t, maxrefdes178_unet_mask.h
+
     QSPI_PACKET_TYPE_LAST
 } qspi_packet_type_e;
 
@@ -599,6 +635,10 @@ typedef enum {
     BLE_COMMAND_GET_DEMO_NAME_CMD,         // None
     BLE_COMMAND_GET_DEMO_NAME_RES,         // Demo string
 
+    //// v1.4 commands
+    BLE_COMMAND_GET_TRACE_RES,             // trace_dump_t
+    BLE_COMMAND_SET_GOVERNOR_POLICY_CMD,   // governor_policy_t
+
     BLE_COMMAND_LAST
 } ble_command_e;
 
@@ -673,6 +713,15 @@ typedef enum {
     CAMERA_CLOCK_LAST
 } camera_clock_e;
 
+// Frame rate governor policies
+typedef enum {
+    GOVERNOR_POLICY_OFF = 0,        // Operating point is not changed
+    GOVERNOR_POLICY_MAX_FPS,        // Full rate, backs off only when idle, hot or battery is low
+    GOVERNOR_POLICY_BATTERY_HOURS,  // Highest rate that lasts target_minutes on battery
+
+    GOVERNOR_POLICY_LAST
+} governor_policy_e;
+
 // Classification command response classification codes
 typedef enum {
     CLASSIFICATION_NOTHING = 0,
@@ -693,6 +742,32 @@ typedef enum {
     LCD_ROTATION_LAST
 } lcd_rotation_e;
 
+// Trace sources
+typedef enum {
+    TRACE_SOURCE_MAX32666 = 0,
+    TRACE_SOURCE_MAX78000_VIDEO,
+    TRACE_SOURCE_MAX78000_AUDIO,
+
+    TRACE_SOURCE_LAST
+} trace_source_e;
+
+// Trace events, arg is the packet type for QSPI and the packet size for BLE
+typedef enum {
+    TRACE_EVENT_CAPTURE_START = 0,
+    TRACE_EVENT_CAPTURE_END,
+    TRACE_EVENT_QSPI_HEADER,     // Header transferred
+    TRACE_EVENT_QSPI_PAYLOAD,    // Payload transferred
+    TRACE_EVENT_CNN_LOAD,        // Input load started
+    TRACE_EVENT_CNN_START,       // Input loaded, inference running
+    TRACE_EVENT_CNN_DONE,
+    TRACE_EVENT_CNN_UNLOAD,      // Output read
+    TRACE_EVENT_LCD_DMA_START,
+    TRACE_EVENT_LCD_DMA_END,
+    TRACE_EVENT_BLE_ENQUEUE,
+
+    TRACE_EVENT_LAST
+} trace_event_e;
+
 // Typedef Structs
 // QSPI packet info
 typedef struct __attribute__((packed)) {
@@ -776,13 +851,36 @@ typedef struct __attribute__((packed)) {
 } device_serial_num_t;
 
 // MAX78000 statistics field
+// The FaceID, CatsDogs and WildLife video firmware start the next capture while the CNN runs when
+// the frame would otherwise miss the next camera frame, then capture overlaps cnn and the frame
+// period can be shorter than total. UNet runs serially.
 typedef struct __attribute__((packed)) {
     uint32_t cnn_duration_us;
-    uint32_t capture_duration_us;
+    uint32_t capture_duration_us;        // Capture start until the frame is taken
     uint32_t communication_duration_us;
-    uint32_t total_duration_us;
+    uint32_t total_duration_us;          // Capture start until the result of the same frame
 } max78000_statistics_t;
 
+// Trace event record
+typedef struct __attribute__((packed)) {
+    uint32_t cycles;    // Core cycle counter
+    uint16_t frame;
+    uint8_t event;      // trace_event_e
+    uint8_t arg;
+} trace_event_t;
+
+// Trace dump, only count events are sent
+typedef struct __attribute__((packed)) {
+    uint8_t source;     // trace_source_e
+    uint8_t count;
+    uint16_t dropped;   // Events overwritten since the previous dump
+    uint32_t core_clock;  // Hz
+    trace_event_t events[TRACE_DUMP_EVENT_COUNT];
+} trace_dump_t;
+
+#define TRACE_DUMP_HEADER_SIZE             (sizeof(trace_dump_t) - sizeof(((trace_dump_t *) 0)->events))
+#define TRACE_DUMP_SIZE(count)             (TRACE_DUMP_HEADER_SIZE + ((count) * sizeof(trace_event_t)))
+
 // Statistics command response
 typedef struct __attribute__((packed)) {
     max78000_statistics_t max78000_video;
@@ -793,6 +891,12 @@ typedef struct __attribute__((packed)) {
     uint32_t max78000_audio_power_mw;
 } device_statistics_t;
 
+// Governor policy command
+typedef struct __attribute__((packed)) {
+    uint8_t policy;           // governor_policy_e
+    uint16_t target_minutes;  // GOVERNOR_POLICY_BATTERY_HOURS only
+} governor_policy_t;
+
 // Classification command response
 typedef struct __attribute__((packed)) {
     float probabily;
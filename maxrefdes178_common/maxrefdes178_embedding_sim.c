@@ -0,0 +1,539 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check and benchmark of the FaceID embedding search of the video firmware
+ * (calculate_minDistance in max78000_video_embedding_process.c), Linux x86-64 only:
+ *
+ *   gcc -O2 -no-pie -Wno-pointer-to-int-cast -Wno-int-to-pointer-cast -D__ARM_FEATURE_DSP=1 -I. -Ihost \
+ *       -I../maxrefdes178-FaceId/maxrefdes178_max78000_common \
+ *       -I../maxrefdes178-FaceId/maxrefdes178_max78000_video/include \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max78000_video/src/max78000_video_embedding_process.c \
+ *       maxrefdes178_faceid_db.c maxrefdes178_utility.c maxrefdes178_embedding_sim.c -o embedding_sim
+ *   ./embedding_sim ../maxrefdes178-FaceId/maxrefdes178_max78000_video/embeddings.bin [queries]
+ *
+ * The firmware keeps 32-bit addresses of the database, hence the position dependent build. The
+ * database is placed where the linker script puts embeddings.bin, in slot A. __USADA8 is emulated and counted,
+ * without -D__ARM_FEATURE_DSP=1 the portable SAD8 is checked instead.
+ *
+ * The search is compared with the former calculate_minDistance (full distance of every stored
+ * embedding, mean per subject, hand rolled top 3) on the database file and on databases grown to
+ * more embeddings per subject from it, with random, near match and stored embeddings as queries.
+ * The result list, the return value and the per subject counters must be the same after every
+ * query. Then the steps per query, bytes for the former loop and __USADA8 words with the early
+ * exit now, and host queries per second of both versions are reported per database size. Host rates compare the emulated
+ * __USADA8 with compiler vectorized bytes, they are not MAX78000 rates.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mxc.h"
+#include "max78000_video_embedding_process.h"
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define DB_REGION_SIZE      0x200000
+#define DB_SLOT_SIZE        (DB_REGION_SIZE / 2)
+#define DB_HEADER_SIZE      11
+#define MAX_PER_SUBJECT     255     // tsMeanDistance.number is 8-bit
+#define MAX_EMBEDDINGS      (FACEID_MAX_SUBJECT * MAX_PER_SUBJECT)
+#define MAX_DISTANCE        1000000
+#define NEAR_NOISE          12
+#define DEFAULT_QUERIES     3000
+#define COMMIT_MAGIC        0x43424446  // Same as the linker script
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct  __attribute__((packed)) {
+    uint8_t numberOfSubjects;
+    uint16_t lengthOfEmbeddings;
+    uint16_t numberOfEmbeddings;
+    uint16_t imageWidth;
+    uint16_t imageHeight;
+    uint16_t lengthOfSubjectNames;
+} db_header_t;
+
+typedef struct {
+    uint8_t subID;
+    int32_t distance;
+} ref_distance_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t size;
+    uint32_t check;
+} db_commit_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+// Flash region of the linker script, _embeddings_start_ to _embeddings_end_
+__asm__ (
+    "    .pushsection .data\n"
+    "    .balign 0x2000\n"
+    "    .globl _embeddings_start_\n"
+    "_embeddings_start_:\n"
+    "    .fill 0x200000, 1, 0xff\n"
+    "    .globl _embeddings_end_\n"
+    "_embeddings_end_:\n"
+    "    .popsection\n"
+);
+extern uint8_t _embeddings_start_[];
+
+mxc_flc_regs_t host_flc0;
+mxc_icc_regs_t host_icc0;
+
+static uint64_t usada8_count;
+
+static uint8_t db_file[DB_REGION_SIZE];
+static uint32_t db_file_size;
+static int8_t queries[DEFAULT_QUERIES * 10][FACEID_EMBEDDING_SIZE];
+
+// Former calculate_minDistance state
+static ref_distance_t ref_distance[MAX_EMBEDDINGS];
+static tsMeanDistance ref_mean_distance[FACEID_MAX_SUBJECT];
+static tsMinDistance ref_min_distance[3];
+static int8_t ref_closest_sub_id[closest_sub_buffer_size];
+static uint8_t ref_min_distance_counter[FACEID_MAX_SUBJECT];
+static uint32_t ref_closest_sub_id_buf_idx;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint32_t build_db(uint32_t per_subject);
+static void commit_db(uint32_t size);
+static void ref_init(void);
+static int ref_calculate_minDistance(const uint8_t *embedding);
+static void make_queries(int count);
+static int check(uint32_t per_subject, int count);
+static double elapsed_us(clock_t start, int iterations);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static const uint32_t sizes[] = {0, 16, 32, 64, 128, 255};
+    const db_header_t *header = (const db_header_t *) db_file;
+    int count = DEFAULT_QUERIES;
+    int errors = 0;
+    uint32_t embeddings;
+    double old_us, new_us;
+    uint64_t steps;
+    clock_t start;
+    size_t s;
+    FILE *f;
+    int i;
+
+    if (argc < 2) {
+        printf("usage: %s embeddings.bin [queries]\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        count = atoi(argv[2]);
+    }
+    if ((count <= 0) || (count > DEFAULT_QUERIES * 10)) {
+        count = DEFAULT_QUERIES;
+    }
+
+    f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    db_file_size = fread(db_file, 1, sizeof(db_file), f);
+    fclose(f);
+
+    if ((db_file_size < DB_HEADER_SIZE) || (header->lengthOfEmbeddings != FACEID_EMBEDDING_SIZE) ||
+            (header->numberOfSubjects == 0) || (header->numberOfSubjects > FACEID_MAX_SUBJECT) ||
+            (db_file_size < (uint32_t) (DB_HEADER_SIZE + header->lengthOfSubjectNames +
+                    header->numberOfEmbeddings * (FACEID_EMBEDDING_SIZE + 1)))) {
+        printf("%s: not an embeddings database\n", argv[1]);
+        return 1;
+    }
+    printf("%s: %u subjects, %u embeddings\n", argv[1], header->numberOfSubjects, header->numberOfEmbeddings);
+
+    srand(178);
+
+    // 0 is the database as read
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        embeddings = build_db(sizes[s]);
+        make_queries(count);
+
+        errors += check(sizes[s], count);
+
+        ref_init();
+        start = clock();
+        for (i = 0; i < count; i++) {
+            ref_calculate_minDistance((uint8_t *) queries[i]);
+        }
+        old_us = elapsed_us(start, count);
+
+        init_database();
+        usada8_count = 0;
+        start = clock();
+        for (i = 0; i < count; i++) {
+            calculate_minDistance((uint8_t *) queries[i]);
+        }
+        new_us = elapsed_us(start, count);
+        steps = usada8_count / count;
+        uninit_database();
+
+        printf("%5u embeddings: steps per query former %6u bytes, now %6lu __USADA8, "
+                "host former %6.0f queries/s, now %6.0f queries/s\n", embeddings, embeddings * FACEID_EMBEDDING_SIZE,
+                (unsigned long) steps, 1000000.0 / old_us, 1000000.0 / new_us);
+    }
+
+    printf("embedding check: %s\n", errors ? "FAILED" : "passed");
+
+    return errors ? 1 : 0;
+}
+
+// Database file in the flash region, or grown to per_subject embeddings of each subject with
+// stored embeddings plus noise
+static uint32_t build_db(uint32_t per_subject)
+{
+    const db_header_t *file_header = (const db_header_t *) db_file;
+    db_header_t *header = (db_header_t *) _embeddings_start_;
+    uint32_t data_offset = DB_HEADER_SIZE + file_header->lengthOfSubjectNames;
+    uint32_t stride = FACEID_EMBEDDING_SIZE + 1;
+    uint8_t *dst = _embeddings_start_ + data_offset;
+    const uint8_t *src;
+    uint32_t subject, n, j;
+    int value;
+
+    memset(_embeddings_start_, 0xff, DB_REGION_SIZE);
+
+    if (per_subject == 0) {
+        memcpy(_embeddings_start_, db_file, db_file_size);
+        commit_db(db_file_size);
+        return header->numberOfEmbeddings;
+    }
+
+    memcpy(_embeddings_start_, db_file, data_offset);
+    header->numberOfEmbeddings = 0;
+
+    for (n = 0; n < per_subject; n++) {
+        for (subject = 0; subject < file_header->numberOfSubjects; subject++) {
+            // A stored embedding of this subject, fall back to any for subjects without one
+            src = NULL;
+            for (j = rand() % file_header->numberOfEmbeddings; !src && (j < 2u * file_header->numberOfEmbeddings); j++) {
+                const uint8_t *e = db_file + data_offset + (j % file_header->numberOfEmbeddings) * stride;
+                if (e[0] == subject) {
+                    src = e;
+                }
+            }
+            if (!src) {
+                src = db_file + data_offset;
+            }
+
+            dst[0] = subject;
+            for (j = 1; j < stride; j++) {
+                value = (int8_t) src[j] + (rand() % (2 * NEAR_NOISE + 1)) - NEAR_NOISE;
+                dst[j] = (uint8_t) (int8_t) (value > 127 ? 127 : (value < -128 ? -128 : value));
+            }
+            dst += stride;
+            header->numberOfEmbeddings++;
+        }
+    }
+    commit_db(dst - _embeddings_start_);
+
+    return header->numberOfEmbeddings;
+}
+
+// Commit record at the end of slot A, as the linker script emits it
+static void commit_db(uint32_t size)
+{
+    db_commit_t *commit = (db_commit_t *) (_embeddings_start_ + DB_SLOT_SIZE - sizeof(db_commit_t));
+
+    commit->magic = COMMIT_MAGIC;
+    commit->generation = 0;
+    commit->size = size;
+    commit->check = ~(commit->magic + commit->generation + commit->size);
+}
+
+// Random, near match and exactly stored embeddings
+static void make_queries(int count)
+{
+    const db_header_t *header = (const db_header_t *) _embeddings_start_;
+    const int8_t *stored;
+    int value;
+    int i, j;
+
+    for (i = 0; i < count; i++) {
+        stored = (const int8_t *) _embeddings_start_ + DB_HEADER_SIZE + header->lengthOfSubjectNames +
+                (rand() % header->numberOfEmbeddings) * (FACEID_EMBEDDING_SIZE + 1) + 1;
+
+        for (j = 0; j < FACEID_EMBEDDING_SIZE; j++) {
+            switch (i % 3) {
+            case 0:
+                value = (rand() % 256) - 128;
+                break;
+            case 1:
+                value = stored[j] + (rand() % (2 * NEAR_NOISE + 1)) - NEAR_NOISE;
+                break;
+            default:
+                value = stored[j];
+                break;
+            }
+            queries[i][j] = (int8_t) (value > 127 ? 127 : (value < -128 ? -128 : value));
+        }
+    }
+}
+
+static int check(uint32_t per_subject, int count)
+{
+    const db_header_t *header = (const db_header_t *) _embeddings_start_;
+    tsMinDistance *min_distance;
+    uint8_t *counter;
+    uint8_t counter_len;
+    int ret, ref_ret;
+    int i, k;
+
+    ref_init();
+    init_database();
+
+    for (i = 0; i < count; i++) {
+        ref_ret = ref_calculate_minDistance((uint8_t *) queries[i]);
+        ret = calculate_minDistance((uint8_t *) queries[i]);
+        min_distance = get_min_distance();
+        get_min_dist_counter(&counter, &counter_len);
+
+        for (k = 0; k < 3; k++) {
+            if ((min_distance[k].subID != ref_min_distance[k].subID) ||
+                    (min_distance[k].distance != ref_min_distance[k].distance)) {
+                break;
+            }
+        }
+
+        if ((k < 3) || (ret != ref_ret) || (counter_len != header->numberOfSubjects) ||
+                memcmp(counter, ref_min_distance_counter, counter_len)) {
+            printf("FAIL: %u per subject, query %d, %d. %u/%d, expected %u/%d\n", per_subject, i, k + 1,
+                    min_distance[k % 3].subID, min_distance[k % 3].distance, ref_min_distance[k % 3].subID,
+                    ref_min_distance[k % 3].distance);
+            uninit_database();
+            return 1;
+        }
+    }
+
+    uninit_database();
+
+    return 0;
+}
+
+static void ref_init(void)
+{
+    const db_header_t *header = (const db_header_t *) _embeddings_start_;
+
+    for (int i = 0; i < closest_sub_buffer_size; ++i) {
+        ref_closest_sub_id[i] = -1;
+    }
+
+    for (int i = 0; i < header->numberOfSubjects; ++i) {
+        ref_min_distance_counter[i] = 0;
+    }
+
+    ref_closest_sub_id_buf_idx = 0;
+}
+
+// calculate_minDistance before the word parallel search
+static int ref_calculate_minDistance(const uint8_t *embedding)
+{
+    const db_header_t *pDatabaseInfo = (const db_header_t *) _embeddings_start_;
+    int8_t *theEmbedding = (int8_t *)embedding;
+    int8_t *theEmbeddingOrigin = theEmbedding;
+
+    ref_distance_t *dist = ref_distance;
+    tsMeanDistance *meanDist = ref_mean_distance;
+
+    int8_t *pData =  (int8_t *)(pDatabaseInfo+1) + pDatabaseInfo->lengthOfSubjectNames;
+
+    // Calculate min distance for each embedding
+    for (int i = 0; i < pDatabaseInfo->numberOfEmbeddings; i++) {
+        int total = 0;
+        dist->subID = (uint8_t)(*(pData++));
+        theEmbedding = theEmbeddingOrigin;
+        for (int j = 0; j < pDatabaseInfo->lengthOfEmbeddings;j++) {
+            total += abs((*(theEmbedding++))-(*(pData++)));
+        }
+
+        dist->distance = total;
+        dist++;
+    }
+
+    dist = ref_distance;
+
+    for (int i = 0; i < pDatabaseInfo->numberOfSubjects; i++) {
+        meanDist[i].subID = i;
+        meanDist[i].number = 0;
+        meanDist[i].distance = 0;
+    }
+
+    for (int i = 0; i < pDatabaseInfo->numberOfEmbeddings; i++) {
+        meanDist = ref_mean_distance + dist->subID;
+        meanDist->distance += dist->distance;
+        meanDist->number++;
+        dist++;
+    }
+
+    meanDist = ref_mean_distance;
+
+    for (int i = 0; i < pDatabaseInfo->numberOfSubjects; i++) {
+        meanDist->distance = meanDist->distance / meanDist->number;
+        meanDist++;
+    }
+
+    meanDist = ref_mean_distance;
+
+    for (int i = 0; i < 3; i++) {
+        ref_min_distance[i].subID = 0xFF;
+        ref_min_distance[i].distance = MAX_DISTANCE;
+    }
+
+    for (int i = 0; i < pDatabaseInfo->numberOfSubjects; i++)
+    {
+        if (meanDist[i].distance < ref_min_distance[0].distance) {
+            ref_min_distance[2].distance = ref_min_distance[1].distance;
+            ref_min_distance[2].subID = ref_min_distance[1].subID;
+            ref_min_distance[1].distance = ref_min_distance[0].distance;
+            ref_min_distance[1].subID = ref_min_distance[0].subID;
+            ref_min_distance[0].distance = meanDist[i].distance;
+            ref_min_distance[0].subID  = meanDist[i].subID;
+        } else if (meanDist[i].distance < ref_min_distance[1].distance) {
+            ref_min_distance[2].distance = ref_min_distance[1].distance;
+            ref_min_distance[2].subID = ref_min_distance[1].subID;
+            ref_min_distance[1].distance = meanDist[i].distance;
+            ref_min_distance[1].subID  = meanDist[i].subID;
+        } else if (meanDist[i].distance < ref_min_distance[2].distance) {
+            ref_min_distance[2].distance = meanDist[i].distance;
+            ref_min_distance[2].subID  = meanDist[i].subID;
+        }
+    }
+
+    uint32_t bufferIdx = ref_closest_sub_id_buf_idx % (closest_sub_buffer_size);
+    if (ref_closest_sub_id[bufferIdx] >= 0){
+        --ref_min_distance_counter[ref_closest_sub_id[bufferIdx]];
+    }
+
+    if (ref_min_distance[0].distance < thresh_for_unknown_subject){
+        ref_closest_sub_id[bufferIdx] = ref_min_distance[0].subID;
+        ++ref_min_distance_counter[ref_closest_sub_id[bufferIdx]];
+    } else {
+        ref_closest_sub_id[bufferIdx] = -1;
+    }
+    ++ref_closest_sub_id_buf_idx;
+
+    return (ref_closest_sub_id_buf_idx % 3);
+}
+
+static double elapsed_us(clock_t start, int iterations)
+{
+    return (double) (clock() - start) * 1000000.0 / CLOCKS_PER_SEC / iterations;
+}
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+uint32_t __USADA8(uint32_t x, uint32_t y, uint32_t acc)
+{
+    usada8_count++;
+    for (int i = 0; i < 4; i++) {
+        acc += abs((int) (x & 0xFF) - (int) (y & 0xFF));
+        x >>= 8;
+        y >>= 8;
+    }
+
+    return acc;
+}
+#endif
+
+// SDK stand-ins, the database is not written here
+void NVIC_SetVector(IRQn_Type irqn, void (*irq_callback)(void))
+{
+    (void) irqn;
+    (void) irq_callback;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irqn)
+{
+    (void) irqn;
+}
+
+void __enable_irq(void)
+{
+}
+
+int MXC_FLC_PageErase(uint32_t address)
+{
+    (void) address;
+    return E_BAD_STATE;
+}
+
+int MXC_FLC_Write(uint32_t address, uint32_t length, uint32_t *buffer)
+{
+    (void) address;
+    (void) length;
+    (void) buffer;
+    return E_BAD_STATE;
+}
+
+int MXC_FLC_EnableInt(uint32_t flags)
+{
+    (void) flags;
+    return E_NO_ERROR;
+}
+
+void MXC_ICC_Enable(mxc_icc_regs_t *icc)
+{
+    (void) icc;
+}
+
+void MXC_ICC_Disable(mxc_icc_regs_t *icc)
+{
+    (void) icc;
+}
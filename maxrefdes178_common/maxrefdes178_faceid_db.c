@@ -0,0 +1,176 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stddef.h>
+
+#include "maxrefdes178_faceid_db.h"
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static const char *faceid_db_status_strings[FACEID_DB_LAST] = {
+    [FACEID_DB_OK]                   = "OK",
+    [FACEID_DB_TRUNCATED]            = "truncated",
+    [FACEID_DB_BAD_SIZE]             = "size does not match the header",
+    [FACEID_DB_BAD_EMBEDDING_LENGTH] = "unsupported embedding length",
+    [FACEID_DB_TOO_MANY_SUBJECTS]    = "too many subjects",
+    [FACEID_DB_BAD_NAMES]            = "subject names do not match the subject count",
+    [FACEID_DB_BAD_SUBJECT_ID]       = "embedding of an unknown subject",
+    [FACEID_DB_EMPTY_SUBJECT]        = "subject without embeddings",
+    [FACEID_DB_TOO_MANY_EMBEDDINGS]  = "too many embeddings of a subject",
+};
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+faceid_db_status_e faceid_db_check(const uint8_t *db, uint32_t size)
+{
+    const tsFaceIDFile *info = (const tsFaceIDFile *) db;
+    uint16_t counts[FACEID_MAX_SUBJECT] = {0};
+    const char *names;
+    const int8_t *record;
+    uint32_t name_len = 0;
+    int subjects = 0;
+
+    if (size < sizeof(tsFaceIDFile)) {
+        return FACEID_DB_TRUNCATED;
+    }
+
+    if (info->lengthOfEmbeddings != FACEID_EMBEDDING_SIZE) {
+        return FACEID_DB_BAD_EMBEDDING_LENGTH;
+    }
+
+    if (info->numberOfSubjects > FACEID_MAX_SUBJECT) {
+        return FACEID_DB_TOO_MANY_SUBJECTS;
+    }
+
+    if (size < faceid_db_size(info, 0)) {
+        return FACEID_DB_TRUNCATED;
+    }
+
+    if ((size != faceid_db_size(info, 0)) && (size != faceid_db_size(info, 1))) {
+        return FACEID_DB_BAD_SIZE;
+    }
+
+    // Every name is terminated, none is empty and nothing follows the last one
+    names = (const char *) (info + 1);
+    for (uint32_t i = 0; i < info->lengthOfSubjectNames; i++) {
+        if (names[i] != '\0') {
+            name_len++;
+            continue;
+        }
+
+        if (name_len == 0) {
+            return FACEID_DB_BAD_NAMES;
+        }
+
+        name_len = 0;
+        subjects++;
+    }
+
+    if ((name_len != 0) || (subjects != info->numberOfSubjects)) {
+        return FACEID_DB_BAD_NAMES;
+    }
+
+    record = faceid_db_embeddings(info);
+    for (int i = 0; i < info->numberOfEmbeddings; i++, record += info->lengthOfEmbeddings + 1) {
+        uint8_t id = (uint8_t) record[0];
+
+        if (id >= info->numberOfSubjects) {
+            return FACEID_DB_BAD_SUBJECT_ID;
+        }
+
+        if (++counts[id] > FACEID_DB_MAX_PER_SUBJECT) {
+            return FACEID_DB_TOO_MANY_EMBEDDINGS;
+        }
+    }
+
+    for (int i = 0; i < info->numberOfSubjects; i++) {
+        if (counts[i] == 0) {
+            return FACEID_DB_EMPTY_SUBJECT;
+        }
+    }
+
+    return FACEID_DB_OK;
+}
+
+const char *faceid_db_status_string(faceid_db_status_e status)
+{
+    if ((unsigned) status >= FACEID_DB_LAST) {
+        return "unknown";
+    }
+
+    return faceid_db_status_strings[status];
+}
+
+const char *faceid_db_subject_name(const tsFaceIDFile *db, int id)
+{
+    const char *name = (const char *) (db + 1);
+    const char *end = name + db->lengthOfSubjectNames;
+
+    if ((id < 0) || (id >= db->numberOfSubjects)) {
+        return NULL;
+    }
+
+    for (; (id > 0) && (name < end); name++) {
+        if (*name == '\0') {
+            id--;
+        }
+    }
+
+    return (name < end) ? name : NULL;
+}
+
+const int8_t *faceid_db_embeddings(const tsFaceIDFile *db)
+{
+    return (const int8_t *) (db + 1) + db->lengthOfSubjectNames;
+}
+
+uint32_t faceid_db_size(const tsFaceIDFile *db, int with_images)
+{
+    uint32_t size = sizeof(tsFaceIDFile) + db->lengthOfSubjectNames +
+            (uint32_t) (db->lengthOfEmbeddings + 1) * db->numberOfEmbeddings;
+
+    if (with_images) {
+        size += (uint32_t) db->imageWidth * db->imageHeight * FACEID_DB_IMAGE_SIZE * db->numberOfEmbeddings;
+    }
+
+    return size;
+}
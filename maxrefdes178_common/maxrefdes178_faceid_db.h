@@ -0,0 +1,118 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_FACEID_DB_H_
+#define _MAXREFDES178_FACEID_DB_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define FACEID_DB_IMAGE_SIZE        3   // Bytes per preview image pixel
+#define FACEID_DB_MAX_PER_SUBJECT   255 // Embeddings per subject are counted in 8 bits
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+/*  FaceID embeddings database layout:
+ *  1 byte : number of subjects (S)
+ *  2 bytes: length of embeddings (L)
+ *  2 bytes: number of embeddings (N)
+ *  2 bytes: length of image width (W)
+ *  2 bytes: length of image height (H)
+ *  2 bytes: length of subject names (K)
+ *  K bytes: subject names, each NULL terminated
+ *  (L+1)*N bytes: embeddings
+ *     1 byte : subject id
+ *     L bytes: embedding, int8
+ *  (W*H*3)*N bytes: preview images, optional
+ */
+typedef struct  __attribute__((packed)) {
+    uint8_t numberOfSubjects;
+    uint16_t lengthOfEmbeddings;
+    uint16_t numberOfEmbeddings;
+    uint16_t imageWidth;
+    uint16_t imageHeight;
+    uint16_t lengthOfSubjectNames;
+} tsFaceIDFile;
+
+typedef enum {
+    FACEID_DB_OK = 0,
+    FACEID_DB_TRUNCATED,            // Shorter than the header, the names or the embeddings
+    FACEID_DB_BAD_SIZE,             // Size matches neither with nor without preview images
+    FACEID_DB_BAD_EMBEDDING_LENGTH, // L is not FACEID_EMBEDDING_SIZE
+    FACEID_DB_TOO_MANY_SUBJECTS,    // S is above FACEID_MAX_SUBJECT
+    FACEID_DB_BAD_NAMES,            // Names are not S non-empty NULL terminated strings
+    FACEID_DB_BAD_SUBJECT_ID,       // Embedding of a subject id not below S
+    FACEID_DB_EMPTY_SUBJECT,        // Subject without embeddings, would match at distance 0
+    FACEID_DB_TOO_MANY_EMBEDDINGS,  // Subject with more than FACEID_DB_MAX_PER_SUBJECT embeddings
+
+    FACEID_DB_LAST
+} faceid_db_status_e;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// FaceID embeddings database parser, hardware independent, no allocation. Shared by the video
+// firmware and the host database tool, so a file the tool accepts is one the firmware can search.
+
+// Checks the layout of size bytes of database, the firmware limits on the number of embeddings
+// and the name length are left to the caller
+faceid_db_status_e faceid_db_check(const uint8_t *db, uint32_t size);
+
+// Short description of a check result
+const char *faceid_db_status_string(faceid_db_status_e status);
+
+// Name of subject id, NULL if out of range. Database must be checked.
+const char *faceid_db_subject_name(const tsFaceIDFile *db, int id);
+
+// First embedding record, subject id byte followed by L embedding bytes, records are L+1 apart
+const int8_t *faceid_db_embeddings(const tsFaceIDFile *db);
+
+// Database size in bytes, with or without the preview images
+uint32_t faceid_db_size(const tsFaceIDFile *db, int with_images);
+
+
+#endif /* _MAXREFDES178_FACEID_DB_H_ */
@@ -0,0 +1,523 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host round trip check of the FaceID embeddings database tool (maxrefdes178_faceid_db_tool.c)
+ * and of the parser it shares with the video firmware (maxrefdes178_faceid_db.c):
+ *
+ *   gcc -O2 -I. -I../maxrefdes178-FaceId/maxrefdes178_max78000_video/include \
+ *       maxrefdes178_faceid_db.c maxrefdes178_faceid_db_sim.c -o faceid_db_sim
+ *   ./faceid_db_sim ../maxrefdes178-FaceId/maxrefdes178_max78000_video/embeddings.bin \
+ *       ../maxrefdes178-FaceId/maxrefdes178_android/app/src/main/assets/embeddings_default.bin
+ *
+ * The tool is built in with its main renamed and run on temporary files, its output is discarded.
+ * For each database: it validates, merging it alone and building it from its dump give the same
+ * bytes, merging it with itself doubles every subject and --dedup 1 undoes that, --dedup beyond
+ * every distance keeps one embedding of each subject, --max-photos keeps that many embeddings of
+ * each subject in their order, subject names are the same as a plain walk of the name list, stats
+ * runs. The same database with preview images makes the same round trips. Corrupted copies (truncated, padded, other embedding length, too many subjects,
+ * unterminated or missing names, unknown subject id, subject without embeddings) must get the
+ * expected faceid_db_check result and fail validation, and broken text must fail to build.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define main faceid_db_tool_main
+#include "maxrefdes178_faceid_db_tool.c"
+#undef main
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define SIM_MAX_ARGS        8
+#define SIM_MAX_PHOTOS      3
+#define SIM_IMAGE_WIDTH     4
+#define SIM_IMAGE_HEIGHT    3
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    CORRUPT_TRUNCATED,
+    CORRUPT_PADDED,
+    CORRUPT_LENGTH,
+    CORRUPT_SUBJECTS,
+    CORRUPT_UNTERMINATED,   // Last name split in two, the second part without terminator
+    CORRUPT_EMPTY_NAME,     // First name empty, its terminator moved to the end of the next one
+    CORRUPT_SUBJECT_ID,
+    CORRUPT_EMPTY_SUBJECT,  // Embeddings of the last subject moved to the first
+} corrupt_e;
+
+typedef struct {
+    const char *name;
+    corrupt_e corrupt;
+    faceid_db_status_e expected;
+} corrupt_case_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static FILE *report;
+static char tmp_dir[] = "/tmp/faceid_db_sim.XXXXXX";
+static char path_db[64], path_out[64], path_out2[64], path_text[64];
+
+static const corrupt_case_t corrupt_cases[] = {
+    {"truncated",     CORRUPT_TRUNCATED,     FACEID_DB_TRUNCATED},
+    {"padded",        CORRUPT_PADDED,        FACEID_DB_BAD_SIZE},
+    {"length",        CORRUPT_LENGTH,        FACEID_DB_BAD_EMBEDDING_LENGTH},
+    {"subjects",      CORRUPT_SUBJECTS,      FACEID_DB_TOO_MANY_SUBJECTS},
+    {"unterminated",  CORRUPT_UNTERMINATED,  FACEID_DB_BAD_NAMES},
+    {"empty name",    CORRUPT_EMPTY_NAME,    FACEID_DB_BAD_NAMES},
+    {"subject id",    CORRUPT_SUBJECT_ID,    FACEID_DB_BAD_SUBJECT_ID},
+    {"empty subject", CORRUPT_EMPTY_SUBJECT, FACEID_DB_EMPTY_SUBJECT},
+};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static int tool(const char *command, ...);
+static int write_file(const char *path, const uint8_t *data, uint32_t size);
+static int same_file(const char *path, const uint8_t *data, uint32_t size);
+static int check_db(const char *name, const uint8_t *db, uint32_t size);
+static int check_names(const char *name, const uint8_t *db);
+static int check_cap(const char *name, const uint8_t *db, uint32_t size);
+static int check_corrupt(const char *name, const uint8_t *db, uint32_t size);
+static int check_text(const char *name);
+static uint32_t add_images(uint8_t *dst, const uint8_t *db, uint32_t size);
+static uint32_t corrupt_db(uint8_t *db, uint32_t size, corrupt_e corrupt);
+
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+
+    if (argc < 2) {
+        printf("usage: %s embeddings.bin...\n", argv[0]);
+        return 1;
+    }
+
+    // Keep the report on stdout, the tool output is not checked
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen("/dev/null", "w", stdout) || !mkdtemp(tmp_dir)) {
+        fprintf(stderr, "cannot set up\n");
+        return 1;
+    }
+    setvbuf(report, NULL, _IOLBF, 0);
+
+    snprintf(path_db, sizeof(path_db), "%s/in.bin", tmp_dir);
+    snprintf(path_out, sizeof(path_out), "%s/out.bin", tmp_dir);
+    snprintf(path_out2, sizeof(path_out2), "%s/out2.bin", tmp_dir);
+    snprintf(path_text, sizeof(path_text), "%s/db.txt", tmp_dir);
+
+    for (int i = 1; i < argc; i++) {
+        uint32_t size;
+        uint32_t images_size;
+        uint8_t *db = read_file(argv[i], &size);
+        uint8_t *images;
+
+        if (!db) {
+            errors++;
+            continue;
+        }
+
+        errors += check_db(argv[i], db, size);
+        errors += check_names(argv[i], db);
+        errors += check_cap(argv[i], db, size);
+        errors += check_corrupt(argv[i], db, size);
+
+        images = malloc(size * 2);
+        images_size = add_images(images, db, size);
+        errors += check_db("with images", images, images_size);
+
+        free(images);
+        free(db);
+    }
+
+    errors += check_text(argv[1]);
+
+    remove(path_db);
+    remove(path_out);
+    remove(path_out2);
+    remove(path_text);
+    rmdir(tmp_dir);
+
+    fprintf(report, "faceid db check: %s\n", errors ? "FAILED" : "passed");
+
+    return errors ? 1 : 0;
+}
+
+// Runs the tool with the given arguments, NULL terminated
+static int tool(const char *command, ...)
+{
+    char *args[SIM_MAX_ARGS + 2] = {"faceid_db_tool", (char *) command};
+    int argc = 2;
+    va_list ap;
+
+    va_start(ap, command);
+    while ((argc < SIM_MAX_ARGS + 1) && (args[argc] = va_arg(ap, char *))) {
+        argc++;
+    }
+    va_end(ap);
+
+    fflush(stdout);
+
+    return faceid_db_tool_main(argc, args);
+}
+
+static int write_file(const char *path, const uint8_t *data, uint32_t size)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (!f || (fwrite(data, 1, size, f) != size) || fclose(f)) {
+        fprintf(report, "FAIL: cannot write %s\n", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int same_file(const char *path, const uint8_t *data, uint32_t size)
+{
+    uint32_t file_size;
+    uint8_t *file = read_file(path, &file_size);
+    int same = file && (file_size == size) && !memcmp(file, data, size);
+
+    free(file);
+
+    return same;
+}
+
+// Validation and the byte exact round trips
+static int check_db(const char *name, const uint8_t *db, uint32_t size)
+{
+    const tsFaceIDFile *info = (const tsFaceIDFile *) db;
+    faceid_db_status_e status = faceid_db_check(db, size);
+    uint32_t out_size;
+    uint8_t *out;
+    int errors = 0;
+
+    if (status != FACEID_DB_OK) {
+        fprintf(report, "FAIL: %s: %s\n", name, faceid_db_status_string(status));
+        return 1;
+    }
+
+    if (write_file(path_db, db, size)) {
+        return 1;
+    }
+
+    if (tool("validate", path_db, NULL) != 0) {
+        fprintf(report, "FAIL: %s: validate\n", name);
+        errors++;
+    }
+
+    if ((tool("merge", path_db, "-o", path_out, NULL) != 0) || !same_file(path_out, db, size)) {
+        fprintf(report, "FAIL: %s: merge alone changes the database\n", name);
+        errors++;
+    }
+
+    if ((tool("dump", path_db, path_text, NULL) != 0) ||
+        (tool("build", path_text, "-o", path_out, NULL) != 0) || !same_file(path_out, db, size)) {
+        fprintf(report, "FAIL: %s: build of the dump changes the database\n", name);
+        errors++;
+    }
+
+    // Twice the embeddings is above the firmware limit, validation fails but the file is written
+    tool("merge", path_db, path_db, "-o", path_out, NULL);
+    out = read_file(path_out, &out_size);
+    if (!out || (faceid_db_check(out, out_size) != FACEID_DB_OK) ||
+        (((tsFaceIDFile *) out)->numberOfSubjects != info->numberOfSubjects) ||
+        (((tsFaceIDFile *) out)->numberOfEmbeddings != 2 * info->numberOfEmbeddings)) {
+        fprintf(report, "FAIL: %s: merge with itself\n", name);
+        errors++;
+    }
+    free(out);
+
+    if ((tool("merge", path_out, "--dedup", "1", "-o", path_out2, NULL) != 0) ||
+        !same_file(path_out2, db, size)) {
+        fprintf(report, "FAIL: %s: --dedup 1 of the merge with itself\n", name);
+        errors++;
+    }
+
+    // Beyond every distance only the first embedding of each subject is kept
+    tool("merge", path_db, "--dedup", "1000000", "-o", path_out, NULL);
+    out = read_file(path_out, &out_size);
+    if (!out || (faceid_db_check(out, out_size) != FACEID_DB_OK) ||
+        (((tsFaceIDFile *) out)->numberOfSubjects != info->numberOfSubjects) ||
+        (((tsFaceIDFile *) out)->numberOfEmbeddings != info->numberOfSubjects)) {
+        fprintf(report, "FAIL: %s: --dedup beyond every distance\n", name);
+        errors++;
+    }
+    free(out);
+
+    if (tool("stats", path_db, NULL) != 0) {
+        fprintf(report, "FAIL: %s: stats\n", name);
+        errors++;
+    }
+
+    return errors;
+}
+
+static int check_names(const char *name, const uint8_t *db)
+{
+    const tsFaceIDFile *info = (const tsFaceIDFile *) db;
+    const char *walk = (const char *) (info + 1);
+    int errors = 0;
+
+    for (int i = 0; i < info->numberOfSubjects; i++, walk += strlen(walk) + 1) {
+        if (faceid_db_subject_name(info, i) != walk) {
+            fprintf(report, "FAIL: %s: name of subject %d\n", name, i);
+            errors++;
+        }
+    }
+
+    if (faceid_db_subject_name(info, -1) || faceid_db_subject_name(info, info->numberOfSubjects)) {
+        fprintf(report, "FAIL: %s: name of a subject out of range\n", name);
+        errors++;
+    }
+
+    return errors;
+}
+
+// --max-photos keeps the first SIM_MAX_PHOTOS records of each subject that are in the input
+static int check_cap(const char *name, const uint8_t *db, uint32_t size)
+{
+    const tsFaceIDFile *info = (const tsFaceIDFile *) db;
+    const tsFaceIDFile *out_info;
+    int counts[FACEID_MAX_SUBJECT] = {0};
+    const int8_t *record, *in_record;
+    uint32_t out_size;
+    uint8_t *out;
+    int errors = 0;
+    int i, j;
+
+    if (write_file(path_db, db, size) ||
+        (tool("merge", path_db, "--max-photos", "3", "-o", path_out, NULL) != 0)) {
+        fprintf(report, "FAIL: %s: --max-photos %d\n", name, SIM_MAX_PHOTOS);
+        return 1;
+    }
+
+    out = read_file(path_out, &out_size);
+    out_info = (const tsFaceIDFile *) out;
+    if (!out || (faceid_db_check(out, out_size) != FACEID_DB_OK)) {
+        fprintf(report, "FAIL: %s: --max-photos %d output\n", name, SIM_MAX_PHOTOS);
+        free(out);
+        return 1;
+    }
+
+    // Records must come in input order, skipping the ones dropped
+    record = faceid_db_embeddings(out_info);
+    in_record = faceid_db_embeddings(info);
+    for (i = 0, j = 0; i < out_info->numberOfEmbeddings; i++, record += FACEID_EMBEDDING_SIZE + 1) {
+        counts[(uint8_t) record[0]]++;
+
+        for (; j < info->numberOfEmbeddings; j++, in_record += FACEID_EMBEDDING_SIZE + 1) {
+            if (!memcmp(record, in_record, FACEID_EMBEDDING_SIZE + 1)) {
+                break;
+            }
+        }
+        if (j == info->numberOfEmbeddings) {
+            fprintf(report, "FAIL: %s: --max-photos record %d not in input order\n", name, i);
+            errors++;
+            break;
+        }
+    }
+
+    for (i = 0; i < out_info->numberOfSubjects; i++) {
+        if (counts[i] != SIM_MAX_PHOTOS) {
+            fprintf(report, "FAIL: %s: --max-photos kept %d of subject %d\n", name, counts[i], i);
+            errors++;
+        }
+    }
+
+    free(out);
+
+    return errors;
+}
+
+static int check_corrupt(const char *name, const uint8_t *db, uint32_t size)
+{
+    uint8_t *bad = malloc(size + 1);
+    int errors = 0;
+
+    for (size_t c = 0; c < sizeof(corrupt_cases) / sizeof(corrupt_cases[0]); c++) {
+        const corrupt_case_t *corrupt = &corrupt_cases[c];
+        uint32_t bad_size;
+        faceid_db_status_e status;
+
+        memcpy(bad, db, size);
+        bad_size = corrupt_db(bad, size, corrupt->corrupt);
+        status = faceid_db_check(bad, bad_size);
+
+        if (status != corrupt->expected) {
+            fprintf(report, "FAIL: %s: %s: %s, expected %s\n", name, corrupt->name,
+                    faceid_db_status_string(status), faceid_db_status_string(corrupt->expected));
+            errors++;
+        }
+
+        if (write_file(path_db, bad, bad_size) || (tool("validate", path_db, NULL) == 0) ||
+            (tool("merge", path_db, "-o", path_out, NULL) == 0)) {
+            fprintf(report, "FAIL: %s: %s: accepted by the tool\n", name, corrupt->name);
+            errors++;
+        }
+    }
+
+    free(bad);
+
+    return errors;
+}
+
+// Text the build has to reject
+static int check_text(const char *name)
+{
+    static const char *edits[][2] = {
+        {"embedding 0 ", "embedding 9 "},   // Unknown subject
+        {" -11 ", " -129 "},                // Out of int8 range
+        {"subject 1 ", "subject 2 "},       // Out of order
+        {"image 120 160", "image 120"},     // Missing height
+    };
+    uint32_t size;
+    char *text;
+    int errors = 0;
+
+    if (tool("dump", name, path_text, NULL) != 0) {
+        fprintf(report, "FAIL: %s: dump\n", name);
+        return 1;
+    }
+    text = (char *) read_file(path_text, &size);
+
+    for (size_t e = 0; e < sizeof(edits) / sizeof(edits[0]); e++) {
+        char *at = memmem(text, size, edits[e][0], strlen(edits[e][0]));
+        FILE *f = fopen(path_text, "wb");
+
+        if (!at || !f) {
+            fprintf(report, "FAIL: %s: text edit %zu not applied\n", name, e);
+            errors++;
+            if (f) {
+                fclose(f);
+            }
+            continue;
+        }
+
+        fwrite(text, 1, at - text, f);
+        fputs(edits[e][1], f);
+        fwrite(at + strlen(edits[e][0]), 1, size - (at - text) - strlen(edits[e][0]), f);
+        fclose(f);
+
+        if (tool("build", path_text, "-o", path_out, NULL) == 0) {
+            fprintf(report, "FAIL: %s: text edit %zu built\n", name, e);
+            errors++;
+        }
+    }
+
+    free(text);
+
+    return errors;
+}
+
+// Same database with a small preview image after every embedding
+static uint32_t add_images(uint8_t *dst, const uint8_t *db, uint32_t size)
+{
+    tsFaceIDFile *info = (tsFaceIDFile *) dst;
+    uint32_t image_bytes;
+
+    memcpy(dst, db, size);
+    info->imageWidth = SIM_IMAGE_WIDTH;
+    info->imageHeight = SIM_IMAGE_HEIGHT;
+    image_bytes = faceid_db_size(info, 1) - size;
+
+    for (uint32_t i = 0; i < image_bytes; i++) {
+        dst[size + i] = i * 7;
+    }
+
+    return size + image_bytes;
+}
+
+// Corrupts a copy of the database, db has room for one more byte. Returns the new size.
+static uint32_t corrupt_db(uint8_t *db, uint32_t size, corrupt_e corrupt)
+{
+    tsFaceIDFile *info = (tsFaceIDFile *) db;
+    char *names = (char *) (info + 1);
+    int8_t *record = (int8_t *) faceid_db_embeddings(info);
+
+    switch (corrupt) {
+    case CORRUPT_TRUNCATED:
+        return size - 1;
+    case CORRUPT_PADDED:
+        db[size] = 0xFF;
+        return size + 1;
+    case CORRUPT_LENGTH:
+        info->lengthOfEmbeddings = FACEID_EMBEDDING_SIZE / 2;
+        break;
+    case CORRUPT_SUBJECTS:
+        info->numberOfSubjects = FACEID_MAX_SUBJECT + 1;
+        break;
+    case CORRUPT_UNTERMINATED:
+        names[info->lengthOfSubjectNames - 3] = '\0';
+        names[info->lengthOfSubjectNames - 1] = 'x';
+        break;
+    case CORRUPT_EMPTY_NAME:
+        names[strlen(names)] = 'x';
+        names[0] = '\0';
+        break;
+    case CORRUPT_SUBJECT_ID:
+        record[(info->numberOfEmbeddings - 1) * (FACEID_EMBEDDING_SIZE + 1)] = info->numberOfSubjects;
+        break;
+    case CORRUPT_EMPTY_SUBJECT:
+        for (int i = 0; i < info->numberOfEmbeddings; i++, record += FACEID_EMBEDDING_SIZE + 1) {
+            if (record[0] == info->numberOfSubjects - 1) {
+                record[0] = 0;
+            }
+        }
+        break;
+    }
+
+    return size;
+}
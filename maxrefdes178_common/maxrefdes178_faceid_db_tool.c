@@ -0,0 +1,1053 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * FaceID embeddings database tool, validates, dumps, rebuilds, merges and inspects the database
+ * files the video firmware searches (embeddings.bin, embeddings_default.bin of the Android app):
+ *
+ *   gcc -O2 -I. -I../maxrefdes178-FaceId/maxrefdes178_max78000_video/include \
+ *       maxrefdes178_faceid_db.c maxrefdes178_faceid_db_tool.c -o faceid_db_tool
+ *
+ *   ./faceid_db_tool validate DB...
+ *   ./faceid_db_tool dump DB [TEXT]
+ *   ./faceid_db_tool build TEXT -o DB [--dedup DISTANCE] [--max-photos COUNT]
+ *   ./faceid_db_tool merge DB... -o DB [--dedup DISTANCE] [--max-photos COUNT]
+ *   ./faceid_db_tool stats DB
+ *
+ * Files are parsed with maxrefdes178_faceid_db.c, same as init_database and update_database, so a
+ * file that validates here is one the firmware accepts. validate also reports the limits of the
+ * BLE and QSPI transfer (FACEID_MAX_SUBJECT * FACEID_MAX_PHOTO_PER_SUBJECT embeddings) and of the
+ * display (FACEID_MAX_SUBJECT_NAME_SIZE).
+ *
+ * dump writes a text form that build turns back into the same bytes: "image W H", one
+ * "subject ID NAME" line per subject, one "embedding ID VALUE..." line per embedding and an
+ * optional "preview HEX" line after it, lines starting with # are comments. Embeddings of photos
+ * are still computed by the db_gen Python scripts of the Android app, which run the model.
+ *
+ * merge appends the embeddings of subjects with the same name. --dedup drops embeddings closer
+ * than DISTANCE (L1) to a kept one of the same subject, --max-photos keeps the COUNT embeddings
+ * closest to the subject centroid. Output files are written grouped by subject, preview images
+ * are kept only if every embedding has one.
+ *
+ * stats matches every embedding against the database without itself, as calculate_minDistance
+ * would a new photo of the same person: spread of the subject, margin to the closest other
+ * subject mean and the share of matches below thresh_for_unknown_subject, an estimate of the
+ * votes the subject gets in the closest subject buffer.
+ *
+ * The header is read and written as tsFaceIDFile, the host must be little endian like the MCUs.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "max78000_video_embedding_process.h"
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_faceid_db.h"
+#include "maxrefdes178_utility.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define DB_TOOL_MAX_SUBJECTS    UINT8_MAX
+#define DB_TOOL_MAX_EMBEDDINGS  UINT16_MAX
+#define DB_TOOL_MAX_NAMES_SIZE  UINT16_MAX
+#define DB_TOOL_MAX_EMBEDDINGS_FW   (FACEID_MAX_SUBJECT * FACEID_MAX_PHOTO_PER_SUBJECT)
+#define DB_TOOL_OPTION_OFF      -1
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    int subject;
+    int8_t value[FACEID_EMBEDDING_SIZE];
+    uint8_t *image;                 // width * height * FACEID_DB_IMAGE_SIZE bytes or NULL
+} db_embedding_t;
+
+typedef struct {
+    int subject_count;
+    char *names[DB_TOOL_MAX_SUBJECTS + 1];
+    int embedding_count;
+    int embedding_size;
+    db_embedding_t *embeddings;
+    uint16_t width;
+    uint16_t height;
+} db_t;
+
+typedef struct {
+    const char *output;
+    long dedup;
+    long max_photos;
+} db_options_t;
+
+typedef struct {
+    int percent;
+    const char *decision;
+} db_vote_threshold_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+// Vote shares max78000_video_main.c decides on, in closest_sub_buffer_size votes
+static const db_vote_threshold_t vote_thresholds[] = {
+    {80, "detected"},
+    {40, "adjust face"},
+    {20, "unknown"},
+    {10, "no face"},
+};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void usage(const char *name);
+static int parse_options(int argc, char *argv[], int first, db_options_t *options);
+static void db_init(db_t *db);
+static void db_free(db_t *db);
+static int db_find_subject(const db_t *db, const char *name);
+static int db_add_subject(db_t *db, const char *name);
+static db_embedding_t *db_add_embedding(db_t *db, int subject);
+static uint8_t *read_file(const char *path, uint32_t *size);
+static int db_load(db_t *db, const char *path);
+static int db_save(db_t *db, const char *path);
+static int db_parse(db_t *db, const char *path);
+static void db_dump(const db_t *db, FILE *f);
+static int db_validate(const char *path);
+static void db_remove(db_t *db, const char *keep);
+static void db_dedup(db_t *db, long min_distance);
+static void db_cap(db_t *db, long max_photos);
+static int32_t l1_distance(const int8_t *a, const int8_t *b);
+static int32_t mean_distance(const db_t *db, const int8_t *query, int subject, int exclude);
+static void db_stats(const db_t *db);
+static int finish(db_t *db, const db_options_t *options);
+static int cmd_validate(int argc, char *argv[]);
+static int cmd_dump(int argc, char *argv[]);
+static int cmd_build(int argc, char *argv[]);
+static int cmd_merge(int argc, char *argv[]);
+static int cmd_stats(int argc, char *argv[]);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!strcmp(argv[1], "validate")) {
+        return cmd_validate(argc, argv);
+    } else if (!strcmp(argv[1], "dump")) {
+        return cmd_dump(argc, argv);
+    } else if (!strcmp(argv[1], "build")) {
+        return cmd_build(argc, argv);
+    } else if (!strcmp(argv[1], "merge")) {
+        return cmd_merge(argc, argv);
+    } else if (!strcmp(argv[1], "stats")) {
+        return cmd_stats(argc, argv);
+    }
+
+    usage(argv[0]);
+
+    return 1;
+}
+
+static void usage(const char *name)
+{
+    printf("usage: %s validate DB...\n", name);
+    printf("       %s dump DB [TEXT]\n", name);
+    printf("       %s build TEXT -o DB [--dedup DISTANCE] [--max-photos COUNT]\n", name);
+    printf("       %s merge DB... -o DB [--dedup DISTANCE] [--max-photos COUNT]\n", name);
+    printf("       %s stats DB\n", name);
+}
+
+/*  Collects -o, --dedup and --max-photos from argv[first..] and moves the remaining arguments to
+ *  the front. Returns the number of remaining arguments, -1 on error.
+ */
+static int parse_options(int argc, char *argv[], int first, db_options_t *options)
+{
+    int inputs = 0;
+
+    options->output = NULL;
+    options->dedup = DB_TOOL_OPTION_OFF;
+    options->max_photos = DB_TOOL_OPTION_OFF;
+
+    for (int i = first; i < argc; i++) {
+        long *value = NULL;
+        char *end;
+
+        if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+            if (++i == argc) {
+                return -1;
+            }
+            options->output = argv[i];
+            continue;
+        } else if (!strcmp(argv[i], "--dedup")) {
+            value = &options->dedup;
+        } else if (!strcmp(argv[i], "--max-photos")) {
+            value = &options->max_photos;
+        } else {
+            argv[first + inputs++] = argv[i];
+            continue;
+        }
+
+        if (++i == argc) {
+            return -1;
+        }
+        *value = strtol(argv[i], &end, 10);
+        if ((*end != '\0') || (*value < 0)) {
+            printf("%s: not a count\n", argv[i]);
+            return -1;
+        }
+    }
+
+    return options->output ? inputs : -1;
+}
+
+static void db_init(db_t *db)
+{
+    memset(db, 0, sizeof(*db));
+    db->width = FACEID_WIDTH;
+    db->height = FACEID_HEIGHT;
+}
+
+static void db_free(db_t *db)
+{
+    for (int i = 0; i < db->subject_count; i++) {
+        free(db->names[i]);
+    }
+
+    for (int i = 0; i < db->embedding_count; i++) {
+        free(db->embeddings[i].image);
+    }
+
+    free(db->embeddings);
+    db_init(db);
+}
+
+static int db_find_subject(const db_t *db, const char *name)
+{
+    for (int i = 0; i < db->subject_count; i++) {
+        if (!strcmp(db->names[i], name)) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Returns the id of the new subject, -1 if there are too many
+static int db_add_subject(db_t *db, const char *name)
+{
+    if (db->subject_count == DB_TOOL_MAX_SUBJECTS) {
+        printf("error: more than %d subjects\n", DB_TOOL_MAX_SUBJECTS);
+        return -1;
+    }
+
+    db->names[db->subject_count] = strdup(name);
+
+    return db->subject_count++;
+}
+
+// Returns the new embedding, zeroed, NULL if there are too many
+static db_embedding_t *db_add_embedding(db_t *db, int subject)
+{
+    db_embedding_t *embedding;
+
+    if (db->embedding_count == DB_TOOL_MAX_EMBEDDINGS) {
+        printf("error: more than %d embeddings\n", DB_TOOL_MAX_EMBEDDINGS);
+        return NULL;
+    }
+
+    if (db->embedding_count == db->embedding_size) {
+        db->embedding_size = db->embedding_size ? (db->embedding_size * 2) : 64;
+        db->embeddings = realloc(db->embeddings, db->embedding_size * sizeof(db_embedding_t));
+    }
+
+    embedding = &db->embeddings[db->embedding_count++];
+    memset(embedding, 0, sizeof(*embedding));
+    embedding->subject = subject;
+
+    return embedding;
+}
+
+static uint8_t *read_file(const char *path, uint32_t *size)
+{
+    uint8_t *data = NULL;
+    size_t len = 0;
+    size_t n;
+    FILE *f;
+
+    f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return NULL;
+    }
+
+    do {
+        data = realloc(data, len + 65536);
+        n = fread(data + len, 1, 65536, f);
+        len += n;
+    } while (n == 65536);
+
+    fclose(f);
+    *size = len;
+
+    return data;
+}
+
+// Loads a database file the firmware would accept
+static int db_load(db_t *db, const char *path)
+{
+    const tsFaceIDFile *info;
+    const int8_t *record;
+    faceid_db_status_e status;
+    uint32_t image_size;
+    uint32_t size;
+    uint8_t *data;
+    int with_images;
+
+    data = read_file(path, &size);
+    if (!data) {
+        return -1;
+    }
+
+    status = faceid_db_check(data, size);
+    if (status != FACEID_DB_OK) {
+        printf("%s: error: %s\n", path, faceid_db_status_string(status));
+        free(data);
+        return -1;
+    }
+
+    info = (const tsFaceIDFile *) data;
+    db->width = info->imageWidth;
+    db->height = info->imageHeight;
+    image_size = (uint32_t) info->imageWidth * info->imageHeight * FACEID_DB_IMAGE_SIZE;
+    with_images = info->numberOfEmbeddings && (size == faceid_db_size(info, 1)) && image_size;
+
+    for (int i = 0; i < info->numberOfSubjects; i++) {
+        db_add_subject(db, faceid_db_subject_name(info, i));
+    }
+
+    record = faceid_db_embeddings(info);
+    for (int i = 0; i < info->numberOfEmbeddings; i++, record += info->lengthOfEmbeddings + 1) {
+        db_embedding_t *embedding = db_add_embedding(db, (uint8_t) record[0]);
+
+        memcpy(embedding->value, record + 1, FACEID_EMBEDDING_SIZE);
+        if (with_images) {
+            embedding->image = malloc(image_size);
+            memcpy(embedding->image, data + faceid_db_size(info, 0) + i * image_size, image_size);
+        }
+    }
+
+    free(data);
+
+    return 0;
+}
+
+/*  Writes the database grouped by subject, subjects without embeddings are left out. Preview
+ *  images are written if every embedding has one.
+ */
+static int db_save(db_t *db, const char *path)
+{
+    tsFaceIDFile info = {0};
+    uint32_t image_size = (uint32_t) db->width * db->height * FACEID_DB_IMAGE_SIZE;
+    uint32_t names_size = 0;
+    int with_images = (db->embedding_count > 0);
+    int ret = 0;
+    FILE *f;
+
+    int *counts = calloc(db->subject_count + 1, sizeof(int));
+    for (int i = 0; i < db->embedding_count; i++) {
+        counts[db->embeddings[i].subject]++;
+        with_images &= (db->embeddings[i].image != NULL);
+    }
+
+    for (int i = 0; i < db->subject_count; i++) {
+        if (counts[i]) {
+            info.numberOfSubjects++;
+            names_size += strlen(db->names[i]) + 1;
+        }
+    }
+
+    if (names_size > DB_TOOL_MAX_NAMES_SIZE) {
+        printf("%s: error: subject names are %u bytes\n", path, names_size);
+        free(counts);
+        return -1;
+    }
+
+    info.lengthOfEmbeddings = FACEID_EMBEDDING_SIZE;
+    info.numberOfEmbeddings = db->embedding_count;
+    info.imageWidth = db->width;
+    info.imageHeight = db->height;
+    info.lengthOfSubjectNames = names_size;
+
+    f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        free(counts);
+        return -1;
+    }
+
+    fwrite(&info, sizeof(info), 1, f);
+    for (int i = 0; i < db->subject_count; i++) {
+        if (counts[i]) {
+            fwrite(db->names[i], strlen(db->names[i]) + 1, 1, f);
+        }
+    }
+
+    for (int pass = 0; pass < 2; pass++) {
+        uint8_t id = 0;
+
+        if ((pass == 1) && !with_images) {
+            break;
+        }
+
+        for (int s = 0; s < db->subject_count; s++) {
+            if (!counts[s]) {
+                continue;
+            }
+
+            for (int i = 0; i < db->embedding_count; i++) {
+                const db_embedding_t *embedding = &db->embeddings[i];
+
+                if (embedding->subject != s) {
+                    continue;
+                }
+
+                if (pass == 0) {
+                    fwrite(&id, 1, 1, f);
+                    fwrite(embedding->value, FACEID_EMBEDDING_SIZE, 1, f);
+                } else {
+                    fwrite(embedding->image, image_size, 1, f);
+                }
+            }
+            id++;
+        }
+    }
+
+    if (ferror(f)) {
+        printf("%s: error: write failed\n", path);
+        ret = -1;
+    }
+    if (fclose(f)) {
+        perror(path);
+        ret = -1;
+    }
+
+    free(counts);
+
+    return ret;
+}
+
+// Reads the text form written by db_dump
+static int db_parse(db_t *db, const char *path)
+{
+    db_embedding_t *last = NULL;
+    size_t line_size = 0;
+    char *line = NULL;
+    int line_no = 0;
+    int ret = 0;
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    while ((ret == 0) && (getline(&line, &line_size, f) >= 0)) {
+        char *p = line;
+        char *end;
+        long id;
+
+        line_no++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if ((line[0] == '\0') || (line[0] == '#')) {
+            continue;
+        }
+
+        if (!strncmp(p, "image ", 6)) {
+            long width = strtol(p + 6, &end, 10);
+            long height = strtol(p = end, &end, 10);
+
+            if ((end == p) || (*end != '\0') || (width < 0) || (width > UINT16_MAX) || (height < 0) ||
+                (height > UINT16_MAX) || db->embedding_count) {
+                printf("%s:%d: error: bad image size\n", path, line_no);
+                ret = -1;
+            }
+            db->width = width;
+            db->height = height;
+        } else if (!strncmp(p, "subject ", 8)) {
+            id = strtol(p + 8, &end, 10);
+            if ((id != db->subject_count) || (*end != ' ') || (end[1] == '\0') ||
+                (strlen(end + 1) > DB_TOOL_MAX_NAMES_SIZE)) {
+                printf("%s:%d: error: expected subject %d NAME\n", path, line_no, db->subject_count);
+                ret = -1;
+            } else if (db_add_subject(db, end + 1) < 0) {
+                ret = -1;
+            }
+        } else if (!strncmp(p, "embedding ", 10)) {
+            id = strtol(p + 10, &end, 10);
+            if ((id < 0) || (id >= db->subject_count) || !(last = db_add_embedding(db, id))) {
+                printf("%s:%d: error: embedding of unknown subject\n", path, line_no);
+                ret = -1;
+                break;
+            }
+
+            for (int i = 0; i < FACEID_EMBEDDING_SIZE; i++) {
+                long value = strtol(end, &p, 10);
+
+                if ((p == end) || (value < INT8_MIN) || (value > INT8_MAX)) {
+                    printf("%s:%d: error: expected %d values from -128 to 127\n", path, line_no,
+                           FACEID_EMBEDDING_SIZE);
+                    ret = -1;
+                    break;
+                }
+                last->value[i] = value;
+                end = p;
+            }
+
+            if ((ret == 0) && (*end != '\0')) {
+                printf("%s:%d: error: more than %d values\n", path, line_no, FACEID_EMBEDDING_SIZE);
+                ret = -1;
+            }
+        } else if (!strncmp(p, "preview ", 8)) {
+            uint32_t image_size = (uint32_t) db->width * db->height * FACEID_DB_IMAGE_SIZE;
+
+            p += 8;
+            if (!last || last->image || (strlen(p) != image_size * 2)) {
+                printf("%s:%d: error: expected %u hex bytes after an embedding\n", path, line_no,
+                       image_size);
+                ret = -1;
+                break;
+            }
+
+            last->image = malloc(image_size);
+            for (uint32_t i = 0; i < image_size; i++, p += 2) {
+                char hex[3] = {p[0], p[1], '\0'};
+
+                last->image[i] = strtoul(hex, &end, 16);
+                if (*end != '\0') {
+                    printf("%s:%d: error: bad hex byte %s\n", path, line_no, hex);
+                    ret = -1;
+                    break;
+                }
+            }
+        } else {
+            printf("%s:%d: error: unknown line\n", path, line_no);
+            ret = -1;
+        }
+    }
+
+    free(line);
+    fclose(f);
+
+    return ret;
+}
+
+static void db_dump(const db_t *db, FILE *f)
+{
+    uint32_t image_size = (uint32_t) db->width * db->height * FACEID_DB_IMAGE_SIZE;
+
+    fprintf(f, "# FaceID embeddings database, %d subjects, %d embeddings\n", db->subject_count,
+            db->embedding_count);
+    fprintf(f, "image %u %u\n", db->width, db->height);
+
+    for (int s = 0; s < db->subject_count; s++) {
+        int count = 0;
+
+        for (int i = 0; i < db->embedding_count; i++) {
+            count += (db->embeddings[i].subject == s);
+        }
+
+        fprintf(f, "# %d embeddings\n", count);
+        fprintf(f, "subject %d %s\n", s, db->names[s]);
+    }
+
+    for (int i = 0; i < db->embedding_count; i++) {
+        const db_embedding_t *embedding = &db->embeddings[i];
+
+        fprintf(f, "embedding %d", embedding->subject);
+        for (int j = 0; j < FACEID_EMBEDDING_SIZE; j++) {
+            fprintf(f, " %d", embedding->value[j]);
+        }
+        fprintf(f, "\n");
+
+        if (embedding->image) {
+            fprintf(f, "preview ");
+            for (uint32_t j = 0; j < image_size; j++) {
+                fprintf(f, "%02x", embedding->image[j]);
+            }
+            fprintf(f, "\n");
+        }
+    }
+}
+
+// Prints warnings and errors of a database file, returns the number of errors
+static int db_validate(const char *path)
+{
+    const tsFaceIDFile *info;
+    faceid_db_status_e status;
+    const int8_t *record;
+    int counts[FACEID_MAX_SUBJECT] = {0};
+    uint32_t size;
+    uint8_t *data;
+    int errors = 0;
+
+    data = read_file(path, &size);
+    if (!data) {
+        return 1;
+    }
+
+    status = faceid_db_check(data, size);
+    if (status != FACEID_DB_OK) {
+        printf("%s: error: %s\n", path, faceid_db_status_string(status));
+        free(data);
+        return 1;
+    }
+
+    info = (const tsFaceIDFile *) data;
+    if (info->numberOfEmbeddings > DB_TOOL_MAX_EMBEDDINGS_FW) {
+        printf("%s: error: %d embeddings, firmware supports %d\n", path, info->numberOfEmbeddings,
+               DB_TOOL_MAX_EMBEDDINGS_FW);
+        errors++;
+    }
+
+    record = faceid_db_embeddings(info);
+    for (int i = 0; i < info->numberOfEmbeddings; i++, record += info->lengthOfEmbeddings + 1) {
+        counts[(uint8_t) record[0]]++;
+    }
+
+    for (int i = 0; i < info->numberOfSubjects; i++) {
+        const char *name = faceid_db_subject_name(info, i);
+
+        if (strlen(name) > FACEID_MAX_SUBJECT_NAME_SIZE - 1) {
+            printf("%s: warning: %s: name is truncated to %d characters on the display\n", path,
+                   name, FACEID_MAX_SUBJECT_NAME_SIZE - 1);
+        }
+        if (counts[i] > FACEID_MAX_PHOTO_PER_SUBJECT) {
+            printf("%s: warning: %s: %d embeddings, more than %d photos per subject\n", path,
+                   name, counts[i], FACEID_MAX_PHOTO_PER_SUBJECT);
+        }
+    }
+
+    if (!errors) {
+        printf("%s: OK\n", path);
+    }
+
+    free(data);
+
+    return errors;
+}
+
+// Drops the embeddings without keep flag, order of the others is kept
+static void db_remove(db_t *db, const char *keep)
+{
+    int count = 0;
+
+    for (int i = 0; i < db->embedding_count; i++) {
+        if (keep[i]) {
+            db->embeddings[count++] = db->embeddings[i];
+        } else {
+            free(db->embeddings[i].image);
+        }
+    }
+
+    db->embedding_count = count;
+}
+
+static void db_dedup(db_t *db, long min_distance)
+{
+    char *keep = calloc(db->embedding_count + 1, 1);
+
+    for (int i = 0; i < db->embedding_count; i++) {
+        const db_embedding_t *embedding = &db->embeddings[i];
+
+        keep[i] = 1;
+        for (int j = 0; j < i; j++) {
+            if (keep[j] && (db->embeddings[j].subject == embedding->subject) &&
+                (l1_distance(db->embeddings[j].value, embedding->value) < min_distance)) {
+                printf("%s: embedding %d is a near duplicate, removed\n",
+                       db->names[embedding->subject], i);
+                keep[i] = 0;
+                break;
+            }
+        }
+    }
+
+    db_remove(db, keep);
+    free(keep);
+}
+
+static void db_cap(db_t *db, long max_photos)
+{
+    char *keep = calloc(db->embedding_count + 1, 1);
+    float *distance = calloc(db->embedding_count + 1, sizeof(float));
+
+    for (int s = 0; s < db->subject_count; s++) {
+        float centroid[FACEID_EMBEDDING_SIZE] = {0};
+        int count = 0;
+
+        for (int i = 0; i < db->embedding_count; i++) {
+            if (db->embeddings[i].subject == s) {
+                for (int j = 0; j < FACEID_EMBEDDING_SIZE; j++) {
+                    centroid[j] += db->embeddings[i].value[j];
+                }
+                count++;
+            }
+        }
+
+        for (int i = 0; i < db->embedding_count; i++) {
+            if (db->embeddings[i].subject == s) {
+                distance[i] = 0;
+                for (int j = 0; j < FACEID_EMBEDDING_SIZE; j++) {
+                    float d = db->embeddings[i].value[j] - centroid[j] / count;
+                    distance[i] += (d < 0) ? -d : d;
+                }
+            }
+        }
+
+        // Keep the max_photos closest, earlier ones first on equal distance
+        for (int i = 0; i < db->embedding_count; i++) {
+            int closer = 0;
+
+            if (db->embeddings[i].subject != s) {
+                continue;
+            }
+            for (int j = 0; j < db->embedding_count; j++) {
+                if ((db->embeddings[j].subject == s) &&
+                    ((distance[j] < distance[i]) || ((distance[j] == distance[i]) && (j < i)))) {
+                    closer++;
+                }
+            }
+            keep[i] = (closer < max_photos);
+        }
+
+        if (count > max_photos) {
+            printf("%s: %d embeddings capped to %ld\n", db->names[s], count, max_photos);
+        }
+    }
+
+    db_remove(db, keep);
+    free(distance);
+    free(keep);
+}
+
+// Same distance as embedding_distance in the firmware
+static int32_t l1_distance(const int8_t *a, const int8_t *b)
+{
+    int32_t distance = 0;
+
+    for (int i = 0; i < FACEID_EMBEDDING_SIZE; i++) {
+        distance += abs(a[i] - b[i]);
+    }
+
+    return distance;
+}
+
+// Mean distance to the embeddings of a subject, integer division as calculate_minDistance
+static int32_t mean_distance(const db_t *db, const int8_t *query, int subject, int exclude)
+{
+    int32_t total = 0;
+    int count = 0;
+
+    for (int i = 0; i < db->embedding_count; i++) {
+        if ((i != exclude) && (db->embeddings[i].subject == subject)) {
+            total += l1_distance(query, db->embeddings[i].value);
+            count++;
+        }
+    }
+
+    return count ? (total / count) : 0;
+}
+
+static void db_stats(const db_t *db)
+{
+    printf("Unknown subject threshold: %d\n", thresh_for_unknown_subject);
+    printf("Vote thresholds:");
+    for (size_t t = 0; t < sizeof(vote_thresholds) / sizeof(vote_thresholds[0]); t++) {
+        printf("%s %d%% %s (%d votes)", t ? "," : "", vote_thresholds[t].percent,
+               vote_thresholds[t].decision, (closest_sub_buffer_size) * vote_thresholds[t].percent / 100);
+    }
+    printf("\n");
+
+    for (int s = 0; s < db->subject_count; s++) {
+        int32_t pair_min = INT32_MAX, pair_max = 0, margin_min = INT32_MAX;
+        int64_t pair_total = 0, margin_total = 0;
+        int pairs = 0, margins = 0, votes = 0, count = 0;
+
+        for (int i = 0; i < db->embedding_count; i++) {
+            const int8_t *query = db->embeddings[i].value;
+            int32_t own, closest = INT32_MAX;
+
+            if (db->embeddings[i].subject != s) {
+                continue;
+            }
+            count++;
+
+            for (int j = i + 1; j < db->embedding_count; j++) {
+                if (db->embeddings[j].subject == s) {
+                    int32_t distance = l1_distance(query, db->embeddings[j].value);
+
+                    pair_min = MIN(pair_min, distance);
+                    pair_max = MAX(pair_max, distance);
+                    pair_total += distance;
+                    pairs++;
+                }
+            }
+
+            own = mean_distance(db, query, s, i);
+            for (int o = 0; o < db->subject_count; o++) {
+                if (o != s) {
+                    closest = MIN(closest, mean_distance(db, query, o, -1));
+                }
+            }
+
+            if (db->subject_count > 1) {
+                margin_min = MIN(margin_min, closest - own);
+                margin_total += closest - own;
+                margins++;
+            }
+            if ((own < thresh_for_unknown_subject) && (own < closest)) {
+                votes++;
+            }
+        }
+
+        printf("%s: %d embeddings\n", db->names[s], count);
+        if (count < 2) {
+            printf("    spread   single embedding, no leave one out statistics\n");
+            continue;
+        }
+
+        printf("    spread   min %d, mean %d, max %d\n", pair_min, (int) (pair_total / pairs), pair_max);
+        if (margins) {
+            printf("    margin   min %d, mean %d\n", margin_min, (int) (margin_total / margins));
+        }
+
+        const char *decision = "no face";
+        for (size_t t = 0; t < sizeof(vote_thresholds) / sizeof(vote_thresholds[0]); t++) {
+            if (votes * 100 >= vote_thresholds[t].percent * count) {
+                decision = vote_thresholds[t].decision;
+                break;
+            }
+        }
+        printf("    matched  %d/%d (%d%%), %s\n", votes, count, votes * 100 / count, decision);
+    }
+}
+
+// Applies --dedup and --max-photos, saves and validates the result
+static int finish(db_t *db, const db_options_t *options)
+{
+    int ret;
+
+    if (options->dedup != DB_TOOL_OPTION_OFF) {
+        db_dedup(db, options->dedup);
+    }
+    if (options->max_photos != DB_TOOL_OPTION_OFF) {
+        db_cap(db, options->max_photos);
+    }
+
+    ret = db_save(db, options->output);
+    db_free(db);
+    if (ret) {
+        return 1;
+    }
+
+    return db_validate(options->output) ? 1 : 0;
+}
+
+static int cmd_validate(int argc, char *argv[])
+{
+    int ret = 0;
+
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (db_validate(argv[i])) {
+            ret = 1;
+        }
+    }
+
+    return ret;
+}
+
+static int cmd_dump(int argc, char *argv[])
+{
+    FILE *f = stdout;
+    db_t db;
+
+    if ((argc < 3) || (argc > 4)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    db_init(&db);
+    if (db_load(&db, argv[2])) {
+        return 1;
+    }
+
+    if ((argc == 4) && !(f = fopen(argv[3], "w"))) {
+        perror(argv[3]);
+        db_free(&db);
+        return 1;
+    }
+
+    db_dump(&db, f);
+    db_free(&db);
+
+    if ((f != stdout) && fclose(f)) {
+        perror(argv[3]);
+        return 1;
+    }
+
+    return 0;
+}
+
+static int cmd_build(int argc, char *argv[])
+{
+    db_options_t options;
+    db_t db;
+
+    if (parse_options(argc, argv, 2, &options) != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    db_init(&db);
+    if (db_parse(&db, argv[2])) {
+        db_free(&db);
+        return 1;
+    }
+
+    return finish(&db, &options);
+}
+
+static int cmd_merge(int argc, char *argv[])
+{
+    db_options_t options;
+    int inputs;
+    db_t db;
+
+    inputs = parse_options(argc, argv, 2, &options);
+    if (inputs < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    db_init(&db);
+    for (int i = 0; i < inputs; i++) {
+        const char *path = argv[2 + i];
+        int map[DB_TOOL_MAX_SUBJECTS];
+        db_t in;
+
+        db_init(&in);
+        if (db_load(&in, path)) {
+            db_free(&db);
+            return 1;
+        }
+
+        if (i == 0) {
+            db.width = in.width;
+            db.height = in.height;
+        } else if ((in.width != db.width) || (in.height != db.height)) {
+            printf("%s: preview images are %ux%u, dropped\n", path, in.width, in.height);
+            for (int j = 0; j < in.embedding_count; j++) {
+                free(in.embeddings[j].image);
+                in.embeddings[j].image = NULL;
+            }
+        }
+
+        for (int s = 0; s < in.subject_count; s++) {
+            map[s] = db_find_subject(&db, in.names[s]);
+            if (map[s] >= 0) {
+                printf("%s: merging embeddings from %s\n", in.names[s], path);
+            } else if ((map[s] = db_add_subject(&db, in.names[s])) < 0) {
+                db_free(&in);
+                db_free(&db);
+                return 1;
+            }
+        }
+
+        for (int j = 0; j < in.embedding_count; j++) {
+            db_embedding_t *embedding = db_add_embedding(&db, map[in.embeddings[j].subject]);
+
+            if (!embedding) {
+                db_free(&in);
+                db_free(&db);
+                return 1;
+            }
+            memcpy(embedding->value, in.embeddings[j].value, FACEID_EMBEDDING_SIZE);
+            embedding->image = in.embeddings[j].image;
+            in.embeddings[j].image = NULL;
+        }
+
+        db_free(&in);
+    }
+
+    return finish(&db, &options);
+}
+
+static int cmd_stats(int argc, char *argv[])
+{
+    db_t db;
+
+    if (argc != 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    db_init(&db);
+    if (db_load(&db, argv[2])) {
+        return 1;
+    }
+
+    db_stats(&db);
+    db_free(&db);
+
+    return 0;
+}
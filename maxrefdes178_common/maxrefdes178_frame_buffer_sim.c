@@ -0,0 +1,442 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host timing model of the MAX32666 video frame double buffering (max32666_lcd.c,
+ * maxrefdes178_qspi_credit.c):
+ *
+ *   gcc -O2 -I. -Ihost -I../maxrefdes178-CatsDogs/maxrefdes178_max32666/include \
+ *       ../maxrefdes178-CatsDogs/maxrefdes178_max32666/src/max32666_lcd.c \
+ *       ../maxrefdes178-CatsDogs/maxrefdes178_max32666/src/max32666_fonts.c \
+ *       maxrefdes178_glyph_cache.c maxrefdes178_qspi_credit.c maxrefdes178_frame_buffer_sim.c -o frame_buffer_sim
+ *   ./frame_buffer_sim [seconds]
+ *
+ * Time advances in SIM_STEP_US steps. The MAX78000 has a camera frame every camera period and
+ * sends it raw when it holds the frame credit, otherwise the frame is skipped. The transfer takes
+ * LCD_DATA_SIZE bytes at QSPI_SPEED over four lines. The MAX32666 receives it into
+ * lcd_get_back_buffer(), picked when the header arrives, and marks it pending when it is done.
+ * The display_task of max32666_main.c runs every step. Once a frame is pending and both the QSPI
+ * receive and the LCD DMA are idle, it swaps with lcd_swap_buffers() and acknowledges the frame.
+ * refresh_screen is reduced to lcd_drawImage(), and the LCD DMA takes the frame at
+ * MAX32666_LCD_SPI_SPEED. As in qspi_master_video_ack_worker, the acknowledge returns the credit
+ * only when neither the receive nor the LCD DMA is running. With double buffering the worker runs
+ * before the refresh, with a single buffer after it.
+ *
+ * Double buffering uses the two lcd_data frame buffers. Single buffering
+ * (MAX32666_LCD_DOUBLE_BUFFER 0) points both buffers at the first one. The frame number goes into
+ * the frame when its receive completes. Every frame sent to the LCD must be newer than the one
+ * before, and no frame may be received into the buffer the LCD DMA reads.
+ * For several camera periods the shown frames per second, the frames skipped by the MAX78000,
+ * the pending frames dropped for a newer one and the frames torn by a receive during the LCD DMA
+ * are reported for both.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "max32666_data.h"
+#include "max32666_lcd.h"
+#include "max32666_spi_dma.h"
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+#include "maxrefdes178_scheduler.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define DEFAULT_SECONDS     20
+#define SIM_STEP_US         50
+
+#define QSPI_FRAME_US       ((uint32_t) ((uint64_t) LCD_DATA_SIZE * 2 * 1000000 / QSPI_SPEED))  // 4 lines
+#define LCD_BYTE_US(n)      ((uint32_t) ((uint64_t) (n) * 8 * 1000000 / MAX32666_LCD_SPI_SPEED))
+
+// Frame number is kept in the middle of the frame, away from the overlays
+#define FRAME_ID_OFFSET     (LCD_DATA_SIZE / 2)
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    uint32_t captured;      // Camera frames
+    uint32_t skipped;       // Not sent, MAX78000 had no frame credit
+    uint32_t dropped;       // Received but replaced by a newer one before the swap
+    uint32_t shown;         // Sent to the LCD
+    uint32_t torn;          // Received into the buffer while the LCD DMA read it
+    uint32_t errors;
+} counters_t;
+
+// Video QSPI receive on the MAX32666
+typedef struct {
+    int busy;
+    uint64_t end_us;
+    uint8_t *buffer;
+    uint32_t frame;
+} rx_t;
+
+// LCD SPI DMA
+typedef struct {
+    int busy;
+    uint64_t end_us;
+    const uint8_t *data;
+    uint32_t len;
+    int torn;
+    void (*callback)(void);
+} lcd_dma_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+lcd_data_t lcd_data;
+volatile device_settings_t device_settings;
+timestamps_t timestamps;
+volatile uint32_t timer_ms_tick;
+
+mxc_gpio_regs_t host_gpio0;
+mxc_spi_regs_t host_spi1;
+SCB_Type host_scb;
+uint32_t __isr_vector_core1;
+
+static uint64_t now_us;
+static rx_t rx;
+static lcd_dma_t lcd_dma;
+static qspi_credit_t credit;
+static int ack_pending;
+static counters_t counters;
+static int double_buffer;
+
+static const uint32_t camera_periods_ms[] = {20, 40, 66, 100};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static int run(uint32_t camera_period_ms, uint32_t seconds);
+static void max78000_camera_frame(uint32_t frame);
+static void display_task(uint32_t *last_shown);
+static void ack_worker(void);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    counters_t single;
+    uint32_t seconds = DEFAULT_SECONDS;
+    int errors = 0;
+    size_t i;
+
+    if (argc > 1) {
+        seconds = atoi(argv[1]);
+    }
+    if (!seconds) {
+        seconds = DEFAULT_SECONDS;
+    }
+
+    printf("QSPI frame %u us, LCD frame %u us, %u s per run\n", QSPI_FRAME_US, LCD_BYTE_US(LCD_DATA_SIZE),
+            seconds);
+    printf("camera      buffers  shown fps  skipped  dropped  torn\n");
+
+    for (i = 0; i < sizeof(camera_periods_ms) / sizeof(camera_periods_ms[0]); i++) {
+        double_buffer = 0;
+        errors += run(camera_periods_ms[i], seconds);
+        single = counters;
+        double_buffer = 1;
+        errors += run(camera_periods_ms[i], seconds);
+
+        if (counters.shown < single.shown) {
+            printf("FAIL: camera %u ms, double buffering shows %u frames, single %u\n", camera_periods_ms[i],
+                    counters.shown, single.shown);
+            errors++;
+        }
+    }
+
+    printf("frame buffer check: %s\n", errors ? "FAILED" : "passed");
+
+    return errors ? 1 : 0;
+}
+
+static int run(uint32_t camera_period_ms, uint32_t seconds)
+{
+    uint64_t next_frame_us = 0;
+    uint32_t last_shown = 0;
+    uint32_t frame = 0;
+
+    memset(&counters, 0, sizeof(counters));
+    memset(&rx, 0, sizeof(rx));
+    memset(&lcd_dma, 0, sizeof(lcd_dma));
+    memset(&timestamps, 0, sizeof(timestamps));
+    memset(lcd_data.frame_buffer, 0, sizeof(lcd_data.frame_buffer));
+    now_us = 0;
+    timer_ms_tick = 0;
+    ack_pending = 0;
+    device_settings.enable_lcd = 1;
+    device_settings.enable_max78000_video = 1;
+
+    if (lcd_init() != E_NO_ERROR) {
+        printf("FAIL: lcd_init\n");
+        return 1;
+    }
+    if (!double_buffer) {
+        lcd_data.back_buffer = lcd_data.buffer;
+    }
+    lcd_data.refresh_screen = 0;
+    qspi_credit_init(&credit);
+
+    for (now_us = 0; now_us < (uint64_t) seconds * 1000000; now_us += SIM_STEP_US) {
+        timer_ms_tick = now_us / 1000;
+
+        // Interrupts first: QSPI payload and LCD DMA completion
+        if (rx.busy && (now_us >= rx.end_us)) {
+            memcpy(&rx.buffer[FRAME_ID_OFFSET], &rx.frame, sizeof(rx.frame));
+            rx.busy = 0;
+            // qspi_video_data_rx
+            lcd_data.frame_pending = 1;
+        }
+        if (lcd_dma.busy && (now_us >= lcd_dma.end_us)) {
+            lcd_dma.busy = 0;
+            if (lcd_dma.callback) {
+                lcd_dma.callback();
+            }
+        }
+
+        if (now_us >= next_frame_us) {
+            max78000_camera_frame(++frame);
+            next_frame_us += camera_period_ms * 1000;
+        }
+
+        if (rx.busy && lcd_dma.busy && (rx.buffer == lcd_dma.data) && !lcd_dma.torn) {
+            lcd_dma.torn = 1;
+            counters.torn++;
+        }
+
+        display_task(&last_shown);
+        ack_worker();
+    }
+
+    printf("%4u ms  %9s  %9.2f  %7u  %7u  %4u\n", camera_period_ms, double_buffer ? "double" : "single",
+            (double) counters.shown / seconds, counters.skipped, counters.dropped, counters.torn);
+    if (counters.torn) {
+        printf("FAIL: camera %u ms, %u frames received into the buffer on its way to the LCD\n",
+                camera_period_ms, counters.torn);
+        counters.errors++;
+    }
+
+    return counters.errors;
+}
+
+// send_img of the MAX78000 video firmware and the header interrupt of the MAX32666
+static void max78000_camera_frame(uint32_t frame)
+{
+    counters.captured++;
+
+    if (!qspi_credit_available(&credit, QSPI_PACKET_TYPE_VIDEO_DATA_RES, timer_ms_tick) || rx.busy) {
+        counters.skipped++;
+        return;
+    }
+    qspi_credit_use(&credit, QSPI_PACKET_TYPE_VIDEO_DATA_RES, timer_ms_tick);
+
+    if (lcd_data.frame_pending) {
+        counters.dropped++;
+    }
+    rx.buffer = lcd_get_back_buffer();
+    rx.frame = frame;
+    rx.end_us = now_us + QSPI_FRAME_US;
+    rx.busy = 1;
+}
+
+// display_task and refresh_screen of max32666_main.c, overlays left out
+static void display_task(uint32_t *last_shown)
+{
+    uint32_t shown;
+
+    if (lcd_data.frame_pending && device_settings.enable_max78000_video && !rx.busy &&
+        !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
+        lcd_swap_buffers();
+        ack_pending = 1;
+    }
+
+    if (double_buffer) {
+        ack_worker();
+    }
+
+    if (lcd_data.refresh_screen && device_settings.enable_lcd && !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
+        memcpy(&shown, &lcd_data.buffer[FRAME_ID_OFFSET], sizeof(shown));
+        if (shown <= *last_shown) {
+            printf("FAIL: frame %u sent to the LCD after frame %u\n", shown, *last_shown);
+            counters.errors++;
+        }
+        *last_shown = shown;
+        counters.shown++;
+
+        lcd_drawImage(lcd_data.buffer);
+        timestamps.screen_drew = timer_ms_tick;
+    }
+
+    if (!double_buffer) {
+        ack_worker();
+    }
+}
+
+// qspi_master_video_ack_worker, the credit is back on the MAX78000 once the acknowledge is sent
+static void ack_worker(void)
+{
+    static const uint8_t ack = QSPI_PACKET_TYPE_VIDEO_DATA_RES;
+
+    if (!ack_pending || rx.busy || spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
+        return;
+    }
+
+    qspi_credit_grant(&credit, &ack, 1);
+    ack_pending = 0;
+}
+
+int spi_dma_master_init(mxc_spi_regs_t *spi, sys_map_t map, uint32_t speed, uint8_t quad)
+{
+    (void) spi;
+    (void) map;
+    (void) speed;
+    (void) quad;
+    return E_NO_ERROR;
+}
+
+// Commands and parameters complete at once, frames take their time on the SPI
+int spi_dma(uint8_t ch, mxc_spi_regs_t *spi, uint8_t *data_out, uint8_t *data_in, uint32_t len, mxc_dma_reqsel_t reqsel, void (*callback)(void))
+{
+    (void) ch;
+    (void) spi;
+    (void) data_in;
+    (void) reqsel;
+
+    if (!callback) {
+        return E_NO_ERROR;
+    }
+
+    lcd_dma.busy = 1;
+    lcd_dma.end_us = now_us + LCD_BYTE_US(len);
+    lcd_dma.data = data_out;
+    lcd_dma.len = len;
+    lcd_dma.torn = 0;
+    lcd_dma.callback = callback;
+
+    return E_NO_ERROR;
+}
+
+void spi_dma_int_handler(uint8_t ch, mxc_spi_regs_t *spi)
+{
+    (void) ch;
+    (void) spi;
+}
+
+int spi_dma_wait(uint8_t ch, mxc_spi_regs_t *spi)
+{
+    (void) ch;
+    (void) spi;
+    return E_NO_ERROR;
+}
+
+uint8_t spi_dma_busy_flag(uint8_t ch)
+{
+    (void) ch;
+    return lcd_dma.busy;
+}
+
+void MXC_GPIO_OutSet(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    port->out |= mask;
+}
+
+void MXC_GPIO_OutClr(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    port->out &= ~mask;
+}
+
+int MXC_GPIO_Config(const mxc_gpio_cfg_t *cfg)
+{
+    (void) cfg;
+    return E_NO_ERROR;
+}
+
+int MXC_SEMA_GetSema(unsigned sema)
+{
+    (void) sema;
+    return E_NO_ERROR;
+}
+
+void MXC_SEMA_FreeSema(unsigned sema)
+{
+    (void) sema;
+}
+
+void MXC_Delay(uint32_t us)
+{
+    (void) us;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irqn)
+{
+    (void) irqn;
+}
+
+int expander_set_output(uint8_t mask)
+{
+    (void) mask;
+    return E_NO_ERROR;
+}
+
+int expander_clear_output(uint8_t mask)
+{
+    (void) mask;
+    return E_NO_ERROR;
+}
+
+int pmic_boost(int on, uint8_t boost_output_level)
+{
+    (void) on;
+    (void) boost_output_level;
+    return E_NO_ERROR;
+}
+
+void scheduler_post(uint32_t events)
+{
+    (void) events;
+}
@@ -0,0 +1,257 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <string.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_glyph_cache.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define GLYPH_CACHE_RUN_START(r)   ((r) >> 4)
+#define GLYPH_CACHE_RUN_LENGTH(r)  (((r) & 0xF) + 1)
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    const uint8_t *buff;  // NULL if the entry is free
+    const glyph_font_t *font;
+    uint16_t x1;
+    uint16_t y1;
+    uint16_t x2;
+    uint16_t y2;
+    uint16_t color;
+    uint16_t bgcolor;
+    uint8_t bg;
+    uint32_t generation;
+    char text[GLYPH_CACHE_TEXT_SIZE];
+} glyph_text_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static glyph_font_t glyph_fonts[GLYPH_CACHE_FONT_MAX];
+static uint32_t glyph_font_count = 0;
+static uint8_t glyph_run_pool[GLYPH_CACHE_RUN_POOL_SIZE];
+static uint32_t glyph_run_used = 0;
+
+static glyph_text_t glyph_texts[GLYPH_CACHE_TEXT_MAX];
+static uint32_t glyph_text_next = 0;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint32_t glyph_cache_row_runs(uint16_t bits, uint8_t width, uint8_t *runs);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+// Returns the number of runs in a bitmap row, stores them if runs is not NULL
+static uint32_t glyph_cache_row_runs(uint16_t bits, uint8_t width, uint8_t *runs)
+{
+    uint32_t count = 0;
+    uint32_t start = 0;
+    uint32_t j;
+    int in_run = 0;
+
+    for (j = 0; j <= width; j++) {
+        if ((j < width) && ((bits << j) & 0x8000)) {
+            if (!in_run) {
+                start = j;
+                in_run = 1;
+            }
+        } else if (in_run) {
+            if (runs) {
+                runs[count] = (start << 4) | (j - start - 1);
+            }
+            count++;
+            in_run = 0;
+        }
+    }
+
+    return count;
+}
+
+const glyph_font_t *glyph_cache_font(const uint16_t *data, uint8_t width, uint8_t height)
+{
+    glyph_font_t *font;
+    uint32_t size = 0;
+    uint32_t rows = GLYPH_CACHE_CHAR_COUNT * height;
+    uint32_t i;
+    uint8_t *runs;
+
+    for (i = 0; i < glyph_font_count; i++) {
+        if (glyph_fonts[i].data == data) {
+            return &glyph_fonts[i];
+        }
+    }
+
+    if ((glyph_font_count == GLYPH_CACHE_FONT_MAX) || !width || (width > 16)) {
+        return NULL;
+    }
+
+    for (i = 0; i < rows; i++) {
+        size += 1 + glyph_cache_row_runs(data[i], width, NULL);
+    }
+
+    if (size > (GLYPH_CACHE_RUN_POOL_SIZE - glyph_run_used)) {
+        return NULL;
+    }
+
+    font = &glyph_fonts[glyph_font_count];
+    font->data = data;
+    font->width = width;
+    font->height = height;
+    font->runs = &glyph_run_pool[glyph_run_used];
+
+    runs = &glyph_run_pool[glyph_run_used];
+    for (i = 0; i < rows; i++) {
+        if ((i % height) == 0) {
+            font->offset[i / height] = runs - font->runs;
+        }
+        *runs = glyph_cache_row_runs(data[i], width, runs + 1);
+        runs += 1 + *runs;
+    }
+
+    glyph_run_used += size;
+    glyph_font_count++;
+
+    return font;
+}
+
+void glyph_cache_put_char(uint16_t *buff, uint16_t x, uint16_t y, const glyph_font_t *font, char ch,
+                          uint16_t color, uint8_t bg, uint16_t bgcolor)
+{
+    const uint8_t *run;
+    uint16_t *row = &buff[(y * LCD_WIDTH) + x];
+    uint32_t i, j, count, end;
+
+    if ((ch < GLYPH_CACHE_FIRST_CHAR) || (ch >= (GLYPH_CACHE_FIRST_CHAR + GLYPH_CACHE_CHAR_COUNT))) {
+        return;
+    }
+
+    run = &font->runs[font->offset[ch - GLYPH_CACHE_FIRST_CHAR]];
+    for (i = 0; i < font->height; i++, row += LCD_WIDTH) {
+        if (bg) {
+            for (j = 0; j < font->width; j++) {
+                row[j] = bgcolor;
+            }
+        }
+
+        for (count = *run++; count; count--, run++) {
+            end = GLYPH_CACHE_RUN_START(*run) + GLYPH_CACHE_RUN_LENGTH(*run);
+            for (j = GLYPH_CACHE_RUN_START(*run); j < end; j++) {
+                row[j] = color;
+            }
+        }
+    }
+}
+
+int glyph_cache_text_check(const uint8_t *buff, uint16_t x, uint16_t y, const glyph_font_t *font,
+                           uint16_t color, uint8_t bg, uint16_t bgcolor, const char *str, uint32_t generation)
+{
+    glyph_text_t *text;
+    uint32_t len = strlen(str);
+    uint32_t i;
+
+    // Wrapped text may cover anything below
+    if ((len >= GLYPH_CACHE_TEXT_SIZE) || ((x + (len * font->width)) >= LCD_WIDTH)) {
+        glyph_cache_text_invalidate(buff, 0, y, LCD_WIDTH - 1, LCD_HEIGHT - 1);
+        return 0;
+    }
+
+    if (!len) {
+        return 0;
+    }
+
+    for (i = 0; i < GLYPH_CACHE_TEXT_MAX; i++) {
+        text = &glyph_texts[i];
+        if ((text->buff == buff) && (text->x1 == x) && (text->y1 == y) && (text->font == font) &&
+            (text->color == color) && (text->bg == bg) && (!bg || (text->bgcolor == bgcolor)) &&
+            (text->generation == generation) && !strcmp(text->text, str)) {
+            return 1;
+        }
+    }
+
+    glyph_cache_text_invalidate(buff, x, y, x + (len * font->width) - 1, y + font->height - 1);
+
+    // Free entry or the oldest one
+    for (i = 0; i < GLYPH_CACHE_TEXT_MAX; i++) {
+        if (!glyph_texts[i].buff) {
+            glyph_text_next = i;
+            break;
+        }
+    }
+
+    text = &glyph_texts[glyph_text_next];
+    glyph_text_next = (glyph_text_next + 1) % GLYPH_CACHE_TEXT_MAX;
+
+    text->buff = buff;
+    text->font = font;
+    text->x1 = x;
+    text->y1 = y;
+    text->x2 = x + (len * font->width) - 1;
+    text->y2 = y + font->height - 1;
+    text->color = color;
+    text->bgcolor = bgcolor;
+    text->bg = bg;
+    text->generation = generation;
+    memcpy(text->text, str, len + 1);
+
+    return 0;
+}
+
+void glyph_cache_text_invalidate(const uint8_t *buff, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+    glyph_text_t *text;
+    uint32_t i;
+
+    for (i = 0; i < GLYPH_CACHE_TEXT_MAX; i++) {
+        text = &glyph_texts[i];
+        if ((text->buff == buff) && (text->x1 <= x2) && (x1 <= text->x2) && (text->y1 <= y2) && (y1 <= text->y2)) {
+            text->buff = NULL;
+        }
+    }
+}
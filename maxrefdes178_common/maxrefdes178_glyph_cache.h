@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_GLYPH_CACHE_H_
+#define _MAXREFDES178_GLYPH_CACHE_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define GLYPH_CACHE_FIRST_CHAR     ' '
+#define GLYPH_CACHE_CHAR_COUNT     95    // ' ' to '~'
+#define GLYPH_CACHE_FONT_MAX       3
+#define GLYPH_CACHE_RUN_POOL_SIZE  12288 // Font_7x10, Font_11x18 and Font_16x26 take 10 KB
+
+// Strings remembered for the unchanged text check, longer ones are always drawn
+#define GLYPH_CACHE_TEXT_MAX       16
+#define GLYPH_CACHE_TEXT_SIZE      LCD_NOTIFICATION_MAX_SIZE
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+// Set pixel runs of every glyph row: a run count byte followed by one byte per run,
+// start column in the high and length - 1 in the low nibble
+typedef struct {
+    const uint16_t *data;  // Font bitmap the runs were built from, one uint16_t per row
+    uint8_t width;
+    uint8_t height;
+    uint16_t offset[GLYPH_CACHE_CHAR_COUNT];  // Runs of the first row of each glyph
+    const uint8_t *runs;
+} glyph_font_t;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Span based text drawing and unchanged text detection, hardware independent, also builds on a
+// host. Glyph bitmaps are expanded once into runs of set pixels. Runs do not depend on the
+// colours, so a single atlas per font serves every colour. Transparent glyphs write only
+// their runs. Opaque glyphs fill the cell with the background first. Colours are the 16 bit
+// words stored in the LCD_WIDTH wide frame buffer, byte swapped RGB565.
+
+// Returns the atlas of a font, built on the first call. Returns NULL if it does not fit.
+const glyph_font_t *glyph_cache_font(const uint16_t *data, uint8_t width, uint8_t height);
+
+// Draws a character with its top left corner at x, y. Characters outside the font are skipped.
+void glyph_cache_put_char(uint16_t *buff, uint16_t x, uint16_t y, const glyph_font_t *font, char ch,
+                          uint16_t color, uint8_t bg, uint16_t bgcolor);
+
+// Returns 1 if the same single line text was drawn at x, y in the buffer since the generation
+// started and nothing was drawn over it since. Otherwise records it as drawn and returns 0.
+int glyph_cache_text_check(const uint8_t *buff, uint16_t x, uint16_t y, const glyph_font_t *font,
+                           uint16_t color, uint8_t bg, uint16_t bgcolor, const char *str, uint32_t generation);
+
+// Forgets the texts of the buffer overlapping the area, corners inclusive
+void glyph_cache_text_invalidate(const uint8_t *buff, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+
+
+#endif /* _MAXREFDES178_GLYPH_CACHE_H_ */
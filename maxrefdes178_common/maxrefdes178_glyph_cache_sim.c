@@ -0,0 +1,489 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check and benchmark of the glyph cache (maxrefdes178_glyph_cache.c):
+ *
+ *   gcc -O2 -I. maxrefdes178_glyph_cache.c maxrefdes178_glyph_cache_sim.c -o glyph_cache_sim
+ *   ./glyph_cache_sim [iterations]
+ *
+ * Fonts are random bitmaps of the Font_7x10, Font_11x18 and Font_16x26 sizes with up to three
+ * runs per row, bits beyond the width set and a few alternating rows. Characters and wrapped
+ * strings are compared byte for byte with the original fonts_putChar and fonts_putString,
+ * transparent and opaque. A sequence of max32666_main refresh_screen overlays with changing
+ * values, new frames and refreshes without a new frame is drawn with and without the unchanged
+ * text check and compared after every refresh. Overlay time per refresh is reported for the
+ * original drawing, the span atlas on a new frame and the atlas on a refresh without one.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_glyph_cache.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define DEFAULT_ITERATIONS  2000
+#define REFRESH_STEPS       5000
+#define FRAME_PIXELS        (LCD_WIDTH * (LCD_HEIGHT + 32))  // Text near the bottom runs over
+
+#define MAGENTA             0xF81F
+#define GREEN               0x07E0
+#define CYAN                0x7FFF
+#define RED                 0xF800
+#define BLACK               0x0000
+#define GRED                0xFFE0
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    const uint8_t width;
+    const uint8_t height;
+    const uint16_t *data;
+} FontDef;
+
+typedef struct {
+    int use_glyphs;
+    int use_text_check;
+    uint16_t *front;       // Cached texts are valid for this buffer only
+    uint32_t generation;
+} draw_t;
+
+typedef struct {
+    int battery;
+    float fps;
+    int cnn_us;
+    int kws_us;
+    int capture_ms;
+    int comm_ms;
+    const char *result;
+    uint16_t frame_color;
+} overlay_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static uint16_t font_data[3][GLYPH_CACHE_CHAR_COUNT * 26];
+static const FontDef fonts[3] = {
+    {7, 10, font_data[0]},
+    {11, 18, font_data[1]},
+    {16, 26, font_data[2]},
+};
+
+static uint16_t frame_reference[FRAME_PIXELS];
+static uint16_t frame_cached[FRAME_PIXELS];
+static uint16_t frame_source[FRAME_PIXELS];
+static draw_t draw;
+
+static const char *results[] = {"Cat", "Dog", "Unknown", "Cat 97%", "Dog 63%"};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void fill_font(uint16_t *data, uint8_t height);
+static void fill_frame(uint16_t *frame);
+static void legacy_putChar(uint16_t x, uint16_t y, char ch, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff);
+static void legacy_putString(uint16_t x, uint16_t y, const char *str, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff);
+static void putString(uint16_t x, uint16_t y, const char *str, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff);
+static void putStringCentered(uint16_t y, const char *str, const FontDef *font, uint16_t color, uint8_t *buff);
+static void drawRectangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color, uint8_t *buff);
+static void overlay(const overlay_t *state, uint8_t *buff);
+static void random_overlay(overlay_t *state);
+static int compare(const char *name, const uint16_t *frame, const uint16_t *expected);
+static double elapsed_us(clock_t start, uint32_t iterations);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static const char *strings[] = {
+        "FPS:14.93", "Cats&Dogs:18342 us", " ~{|}`_^]\\[@?>=<;", "Audio disabled",
+        "A long string that wraps to the next line and further", "x",
+    };
+    overlay_t state;
+    uint32_t iterations = DEFAULT_ITERATIONS;
+    int errors = 0;
+    clock_t start;
+    uint32_t f, c, s, i;
+    uint16_t x, y;
+
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 0);
+    }
+    if (!iterations) {
+        iterations = DEFAULT_ITERATIONS;
+    }
+
+    srand(178);
+    for (f = 0; f < 3; f++) {
+        fill_font(font_data[f], fonts[f].height);
+        if (!glyph_cache_font(fonts[f].data, fonts[f].width, fonts[f].height) ||
+            (glyph_cache_font(fonts[f].data, fonts[f].width, fonts[f].height) !=
+             glyph_cache_font(fonts[f].data, fonts[f].width, fonts[f].height))) {
+            printf("font %u: atlas not built\n", f);
+            errors++;
+        }
+    }
+    if (glyph_cache_font(frame_source, 8, 8)) {
+        printf("atlas built beyond GLYPH_CACHE_FONT_MAX\n");
+        errors++;
+    }
+
+    // Every character of every font, transparent and opaque
+    draw.use_glyphs = 1;
+    for (f = 0; f < 3; f++) {
+        for (c = GLYPH_CACHE_FIRST_CHAR; c < GLYPH_CACHE_FIRST_CHAR + GLYPH_CACHE_CHAR_COUNT; c++) {
+            x = rand() % (LCD_WIDTH - fonts[f].width);
+            y = rand() % (LCD_HEIGHT - fonts[f].height);
+
+            fill_frame(frame_reference);
+            memcpy(frame_cached, frame_reference, sizeof(frame_cached));
+            legacy_putChar(x, y, c, &fonts[f], MAGENTA, 0, 0, (uint8_t *) frame_reference);
+            putString(x, y, (char[]) {c, 0}, &fonts[f], MAGENTA, 0, 0, (uint8_t *) frame_cached);
+            errors += compare("transparent char", frame_cached, frame_reference);
+
+            legacy_putChar(x, y, c, &fonts[f], GREEN, 1, RED, (uint8_t *) frame_reference);
+            putString(x, y, (char[]) {c, 0}, &fonts[f], GREEN, 1, RED, (uint8_t *) frame_cached);
+            errors += compare("opaque char", frame_cached, frame_reference);
+        }
+    }
+
+    // Strings, some of them wrapped
+    for (f = 0; f < 3; f++) {
+        for (s = 0; s < sizeof(strings) / sizeof(strings[0]); s++) {
+            x = rand() % (LCD_WIDTH / 2);
+            y = rand() % (LCD_HEIGHT / 2);
+
+            fill_frame(frame_reference);
+            memcpy(frame_cached, frame_reference, sizeof(frame_cached));
+            legacy_putString(x, y, strings[s], &fonts[f], CYAN, s & 1, BLACK, (uint8_t *) frame_reference);
+            putString(x, y, strings[s], &fonts[f], CYAN, s & 1, BLACK, (uint8_t *) frame_cached);
+            errors += compare("string", frame_cached, frame_reference);
+        }
+    }
+
+    // Refreshes with and without a new frame, the original draws everything every time
+    draw.use_text_check = 1;
+    draw.front = frame_cached;
+    memset(&state, 0, sizeof(state));
+    random_overlay(&state);
+    for (i = 0; i < REFRESH_STEPS; i++) {
+        if (!i || !(rand() % 3)) {
+            fill_frame(frame_reference);
+            memcpy(frame_cached, frame_reference, sizeof(frame_cached));
+            draw.generation++;
+        }
+        if (!(rand() % 4)) {
+            random_overlay(&state);
+        } else {
+            state.fps = (rand() % 2) ? state.fps : (float) (rand() % 3000) / 100;
+        }
+
+        draw.use_glyphs = 0;
+        overlay(&state, (uint8_t *) frame_reference);
+        draw.use_glyphs = 1;
+        overlay(&state, (uint8_t *) frame_cached);
+        if (compare("refresh", frame_cached, frame_reference)) {
+            printf("  at refresh %u\n", i);
+            errors++;
+            break;
+        }
+    }
+
+    printf("pixel check: %s\n", errors ? "FAILED" : "passed");
+
+    // Overlay cost per refresh
+    fill_frame(frame_source);
+    random_overlay(&state);
+    state.fps = 14.93;
+
+    draw.use_glyphs = 0;
+    draw.use_text_check = 0;
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        overlay(&state, (uint8_t *) frame_cached);
+    }
+    printf("original:         %8.2f us/refresh\n", elapsed_us(start, iterations));
+
+    draw.use_glyphs = 1;
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        overlay(&state, (uint8_t *) frame_cached);
+    }
+    printf("atlas:            %8.2f us/refresh\n", elapsed_us(start, iterations));
+
+    draw.use_text_check = 1;
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        draw.generation++;
+        overlay(&state, (uint8_t *) frame_cached);
+    }
+    printf("atlas new frame:  %8.2f us/refresh\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        overlay(&state, (uint8_t *) frame_cached);
+    }
+    printf("atlas same frame: %8.2f us/refresh\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        state.fps = (float) (i % 3000) / 100;
+        overlay(&state, (uint8_t *) frame_cached);
+    }
+    printf("atlas FPS change: %8.2f us/refresh\n", elapsed_us(start, iterations));
+
+    return errors ? 1 : 0;
+}
+
+// Up to three runs per row, anywhere in the 16 bits, also past the font width
+static void fill_font(uint16_t *data, uint8_t height)
+{
+    uint32_t i, r, start, len;
+
+    for (i = 0; i < GLYPH_CACHE_CHAR_COUNT * height; i++) {
+        data[i] = 0;
+        for (r = rand() % 4; r; r--) {
+            start = rand() % 16;
+            len = 1 + rand() % (16 - start);
+            data[i] |= (uint16_t) (((1UL << len) - 1) << (16 - start - len));
+        }
+    }
+
+    // '!' alternates, worst case runs
+    for (i = 0; i < height; i++) {
+        data[height + i] = (i & 1) ? 0x5555 : 0xAAAA;
+    }
+}
+
+static void fill_frame(uint16_t *frame)
+{
+    uint32_t i;
+
+    for (i = 0; i < FRAME_PIXELS; i++) {
+        frame[i] = (uint16_t) rand();
+    }
+}
+
+// max32666_fonts.c fonts_putChar, without the LCD dirty region
+static void legacy_putChar(uint16_t x, uint16_t y, char ch, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff)
+{
+    uint32_t i, b, j, pos;
+
+    uint16_t *p = (uint16_t *) buff;
+
+    for (i = 0; i < font->height; i++) {
+        b = font->data[(ch - 32) * font->height + i];
+        for (j = 0; j < font->width; j++) {
+            pos = (((i + y) * LCD_WIDTH) + (j + x));
+            if ((b << j) & 0x8000) {
+                p[pos] = __builtin_bswap16 (color);
+            } else if (bg) {
+                p[pos] = __builtin_bswap16 (bgcolor);
+            }
+        }
+    }
+}
+
+// max32666_fonts.c fonts_putString
+static void legacy_putString(uint16_t x, uint16_t y, const char *str, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff)
+{
+    while (*str) {
+        if (x + font->width >= LCD_WIDTH) {
+            x = 0;
+            y += font->height;
+            if (y + font->height >= LCD_HEIGHT) {
+                break;
+            }
+
+            if (*str == ' ') {
+                // skip spaces in the beginning of the new line
+                str++;
+                continue;
+            }
+        }
+        legacy_putChar(x, y, *str, font, color, bg, bgcolor, buff);
+        x += font->width;
+        str++;
+    }
+}
+
+// max32666_fonts.c fonts_putString with the glyph cache
+static void putString(uint16_t x, uint16_t y, const char *str, const FontDef *font, uint16_t color, uint8_t bg, uint16_t bgcolor, uint8_t *buff)
+{
+    const glyph_font_t *glyphs;
+
+    if (!draw.use_glyphs) {
+        legacy_putString(x, y, str, font, color, bg, bgcolor, buff);
+        return;
+    }
+
+    glyphs = glyph_cache_font(font->data, font->width, font->height);
+
+    if (draw.use_text_check && (buff == (uint8_t *) draw.front) &&
+        glyph_cache_text_check(buff, x, y, glyphs, color, bg, bgcolor, str, draw.generation)) {
+        return;
+    }
+
+    while (*str) {
+        if (x + font->width >= LCD_WIDTH) {
+            x = 0;
+            y += font->height;
+            if (y + font->height >= LCD_HEIGHT) {
+                break;
+            }
+
+            if (*str == ' ') {
+                str++;
+                continue;
+            }
+        }
+        glyph_cache_put_char((uint16_t *) buff, x, y, glyphs, *str, __builtin_bswap16(color), bg, __builtin_bswap16(bgcolor));
+        x += font->width;
+        str++;
+    }
+}
+
+static void putStringCentered(uint16_t y, const char *str, const FontDef *font, uint16_t color, uint8_t *buff)
+{
+    uint16_t x = (LCD_WIDTH - (font->width * strlen(str))) / 2;
+
+    putString(x, y, str, font, color, 0, 0, buff);
+}
+
+// fonts_drawRectangle, lines drop the texts they cross
+static void drawRectangle(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2, uint16_t color, uint8_t *buff)
+{
+    uint16_t *p = (uint16_t *) buff;
+    uint32_t i;
+
+    if (draw.use_glyphs) {
+        glyph_cache_text_invalidate(buff, x1, y1, x2, y1);
+        glyph_cache_text_invalidate(buff, x1, y1, x1, y2);
+        glyph_cache_text_invalidate(buff, x1, y2, x2, y2);
+        glyph_cache_text_invalidate(buff, x2, y1, x2, y2);
+    }
+
+    for (i = x1; i <= x2; i++) {
+        p[(y1 * LCD_WIDTH) + i] = __builtin_bswap16(color);
+        p[(y2 * LCD_WIDTH) + i] = __builtin_bswap16(color);
+    }
+    for (i = y1; i <= y2; i++) {
+        p[(i * LCD_WIDTH) + x1] = __builtin_bswap16(color);
+        p[(i * LCD_WIDTH) + x2] = __builtin_bswap16(color);
+    }
+}
+
+// CatsDogs refresh_screen with statistics, the audio line overlaps the battery and FPS
+static void overlay(const overlay_t *state, uint8_t *buff)
+{
+    char line[LCD_NOTIFICATION_MAX_SIZE];
+    int line_pos = 3;
+
+    snprintf(line, sizeof(line) - 1, "%3d%%", state->battery);
+    putString(LCD_WIDTH - 31, 3, line, &fonts[0], GREEN, 0, 0, buff);
+
+    putStringCentered(LCD_HEIGHT - 29, state->result, &fonts[2], state->frame_color, buff);
+    drawRectangle(CATSDOGS_RECTANGLE_X1 - 0, CATSDOGS_RECTANGLE_Y1 - 0, CATSDOGS_RECTANGLE_X2 + 0, CATSDOGS_RECTANGLE_Y2 + 0, state->frame_color, buff);
+    drawRectangle(CATSDOGS_RECTANGLE_X1 - 1, CATSDOGS_RECTANGLE_Y1 - 1, CATSDOGS_RECTANGLE_X2 + 1, CATSDOGS_RECTANGLE_Y2 + 1, state->frame_color, buff);
+    drawRectangle(CATSDOGS_RECTANGLE_X1 - 2, CATSDOGS_RECTANGLE_Y1 - 2, CATSDOGS_RECTANGLE_X2 + 2, CATSDOGS_RECTANGLE_Y2 + 2, BLACK, buff);
+    drawRectangle(CATSDOGS_RECTANGLE_X1 - 3, CATSDOGS_RECTANGLE_Y1 - 3, CATSDOGS_RECTANGLE_X2 + 3, CATSDOGS_RECTANGLE_Y2 + 3, BLACK, buff);
+
+    snprintf(line, sizeof(line) - 1, "FPS:%.2f", (double) state->fps);
+    putString(3, line_pos, line, &fonts[0], MAGENTA, 0, 0, buff);
+    line_pos += 12;
+
+    snprintf(line, sizeof(line) - 1, "Cats&Dogs:%d us", state->cnn_us);
+    putString(3, line_pos, line, &fonts[0], MAGENTA, 0, 0, buff);
+    line_pos += 12;
+
+    snprintf(line, sizeof(line) - 1, "KWS:%d us", state->kws_us);
+    putString(3, line_pos, line, &fonts[0], MAGENTA, 0, 0, buff);
+    line_pos += 12;
+
+    snprintf(line, sizeof(line) - 1, "VidCap:%d ms", state->capture_ms);
+    putString(3, line_pos, line, &fonts[0], MAGENTA, 0, 0, buff);
+    line_pos += 12;
+
+    snprintf(line, sizeof(line) - 1, "VidComm:%d ms", state->comm_ms);
+    putString(3, line_pos, line, &fonts[0], MAGENTA, 0, 0, buff);
+
+    putStringCentered(3, "Audio disabled", &fonts[1], RED, buff);
+}
+
+static void random_overlay(overlay_t *state)
+{
+    state->battery = rand() % 101;
+    state->fps = (float) (rand() % 3000) / 100;
+    state->cnn_us = 15000 + rand() % 5000;
+    state->kws_us = 10000 + rand() % 5000;
+    state->capture_ms = 30 + rand() % 20;
+    state->comm_ms = 5 + rand() % 10;
+    state->result = results[rand() % (sizeof(results) / sizeof(results[0]))];
+    state->frame_color = (rand() % 2) ? GRED : GREEN;
+}
+
+static int compare(const char *name, const uint16_t *frame, const uint16_t *expected)
+{
+    uint32_t i;
+
+    for (i = 0; i < FRAME_PIXELS; i++) {
+        if (frame[i] != expected[i]) {
+            printf("%s: pixel %u,%u differs\n", name, (unsigned) (i % LCD_WIDTH), (unsigned) (i / LCD_WIDTH));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static double elapsed_us(clock_t start, uint32_t iterations)
+{
+    return (double) (clock() - start) * 1000000.0 / CLOCKS_PER_SEC / iterations;
+}
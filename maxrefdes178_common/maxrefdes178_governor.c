@@ -0,0 +1,187 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_governor.h"
+#include "maxrefdes178_utility.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define GOVERNOR_LEVEL_COUNT    (sizeof(governor_points) / sizeof(governor_points[0]))
+#define GOVERNOR_LEVEL_LAST     (GOVERNOR_LEVEL_COUNT - 1)
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+// Ordered from full rate to lowest power. Relative power and frame rate are bench estimates, the
+// loop corrects for them with the measured power.
+static const governor_point_t governor_points[] = {
+    {CAMERA_CLOCK_15_MHZ, 1, 0,   1000, 1000},
+    {CAMERA_CLOCK_15_MHZ, 2, 0,   850,  1000},
+    {CAMERA_CLOCK_10_MHZ, 2, 66,  650,  700},
+    {CAMERA_CLOCK_10_MHZ, 4, 100, 500,  600},
+    {CAMERA_CLOCK_5_MHZ,  8, 200, 300,  350},
+};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint32_t video_power_budget(const governor_t *governor, const governor_input_t *input);
+static uint8_t fit_level(const governor_t *governor, uint32_t video_power_mw, uint32_t budget_mw);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+void governor_init(governor_t *governor, const governor_policy_t *policy, uint32_t time)
+{
+    governor->policy = *policy;
+    governor->start_time = time;
+    governor->level = 0;
+    governor->settle = 0;
+}
+
+int governor_update(governor_t *governor, const governor_input_t *input)
+{
+    uint8_t floor_level = 0;
+    uint8_t target_level;
+    uint8_t level = governor->level;
+
+    if (governor->policy.policy == GOVERNOR_POLICY_OFF) {
+        return 0;
+    }
+
+    if (governor->settle) {
+        governor->settle--;
+        return 0;
+    }
+
+    // Limits for all policies
+    if (input->idle_duration > GOVERNOR_IDLE_DURATION) {
+        floor_level = MAX(floor_level, GOVERNOR_IDLE_LEVEL);
+    }
+    if (input->thermal) {
+        floor_level = MAX(floor_level, GOVERNOR_THERMAL_LEVEL);
+    }
+    if (input->battery_valid && !input->usb_chgin && (input->battery_soc <= GOVERNOR_LOW_SOC)) {
+        floor_level = GOVERNOR_LEVEL_LAST;
+    }
+
+    target_level = floor_level;
+    if ((governor->policy.policy == GOVERNOR_POLICY_BATTERY_HOURS) && input->battery_valid && !input->usb_chgin) {
+        target_level = MAX(floor_level, fit_level(governor, input->video_power_mw, video_power_budget(governor, input)));
+    }
+
+    // Back off one point per update, recover at once
+    if (target_level > level) {
+        level++;
+    } else {
+        level = target_level;
+    }
+
+    if (level == governor->level) {
+        return 0;
+    }
+
+    governor->level = level;
+    governor->settle = GOVERNOR_SETTLE_UPDATES;
+
+    return 1;
+}
+
+const governor_point_t *governor_get_point(uint8_t level)
+{
+    return &governor_points[MIN(level, GOVERNOR_LEVEL_LAST)];
+}
+
+uint8_t governor_get_level_count(void)
+{
+    return GOVERNOR_LEVEL_COUNT;
+}
+
+static uint32_t video_power_budget(const governor_t *governor, const governor_input_t *input)
+{
+    uint32_t elapsed_minutes = (input->time - governor->start_time) / (60 * 1000);
+    uint32_t remaining_minutes;
+    uint32_t budget_mw;
+
+    // Target reached, nothing to save for
+    if (elapsed_minutes >= governor->policy.target_minutes) {
+        return UINT32_MAX;
+    }
+    remaining_minutes = governor->policy.target_minutes - elapsed_minutes;
+
+    // mWh left spread over the remaining time
+    budget_mw = (GOVERNOR_BATTERY_CAPACITY_MWH * input->battery_soc * 60) / (100 * remaining_minutes);
+
+    if (budget_mw <= (GOVERNOR_BASE_POWER_MW + input->audio_power_mw)) {
+        return 0;
+    }
+
+    return budget_mw - GOVERNOR_BASE_POWER_MW - input->audio_power_mw;
+}
+
+static uint8_t fit_level(const governor_t *governor, uint32_t video_power_mw, uint32_t budget_mw)
+{
+    uint32_t current_power = governor_points[governor->level].relative_power;
+    uint64_t predicted_mw;
+    uint64_t limit_mw;
+
+    // Highest rate point whose predicted power fits, raising the rate needs margin
+    for (uint8_t level = 0; level < GOVERNOR_LEVEL_LAST; level++) {
+        predicted_mw = ((uint64_t) video_power_mw * governor_points[level].relative_power) / current_power;
+        limit_mw = budget_mw;
+        if (level < governor->level) {
+            limit_mw = (limit_mw * (100 - GOVERNOR_HYSTERESIS_PERCENT)) / 100;
+        }
+        if (predicted_mw <= limit_mw) {
+            return level;
+        }
+    }
+
+    return GOVERNOR_LEVEL_LAST;
+}
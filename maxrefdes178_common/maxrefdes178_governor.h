@@ -0,0 +1,114 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_GOVERNOR_H_
+#define _MAXREFDES178_GOVERNOR_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Nominal cell, adjust for the fitted battery, and the part of the system the power
+// accumulator does not measure
+#define GOVERNOR_BATTERY_CAPACITY_MWH      UINT32_C(3700)  // mWh, 1000 mAh at 3.7 V
+#define GOVERNOR_BASE_POWER_MW             UINT32_C(120)   // mW, MAX32666, LCD and PMIC
+
+// Power must drop below budget by this margin before the rate is raised again
+#define GOVERNOR_HYSTERESIS_PERCENT        10
+
+// Updates skipped after a change, the accumulated power still includes the old point
+#define GOVERNOR_SETTLE_UPDATES            1
+
+#define GOVERNOR_IDLE_DURATION             UINT32_C(10 * 1000)  // ms without scene activity
+#define GOVERNOR_IDLE_LEVEL                3
+#define GOVERNOR_THERMAL_LEVEL             2
+#define GOVERNOR_LOW_SOC                   MAX32666_SOC_WARNING_LEVEL
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    camera_clock_e camera_clock;
+    uint8_t cnn_interval;     // CNN runs on every Nth frame
+    uint16_t lcd_interval;    // ms, minimum time between LCD frames
+    uint16_t relative_power;  // per mille of level 0 video power, estimate
+    uint16_t relative_fps;    // per mille of level 0 frame rate, estimate
+} governor_point_t;
+
+typedef struct {
+    uint32_t time;            // ms
+    uint32_t video_power_mw;
+    uint32_t audio_power_mw;
+    uint32_t idle_duration;   // ms since the last scene activity
+    uint8_t battery_soc;      // %
+    uint8_t battery_valid;    // Fuel gauge is working
+    uint8_t usb_chgin;
+    uint8_t thermal;          // PMIC thermal regulation or shutdown
+} governor_input_t;
+
+typedef struct {
+    governor_policy_t policy;
+    uint32_t start_time;      // ms, GOVERNOR_POLICY_BATTERY_HOURS is measured from here
+    uint8_t level;            // Index of the current operating point, 0 is full rate
+    uint8_t settle;
+} governor_t;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Closed loop frame rate governor, hardware independent, also builds on a host.
+// Operating points trade camera clock, CNN duty cycle and LCD refresh for power. The level is
+// stepped down one point per update while power is over budget and raised straight to the
+// highest point that fits the budget with margin.
+
+void governor_init(governor_t *governor, const governor_policy_t *policy, uint32_t time);
+
+// Returns 1 if the operating point changed
+int governor_update(governor_t *governor, const governor_input_t *input);
+
+const governor_point_t *governor_get_point(uint8_t level);
+
+uint8_t governor_get_level_count(void);
+
+
+#endif /* _MAXREFDES178_GOVERNOR_H_ */
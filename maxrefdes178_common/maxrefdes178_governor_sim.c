@@ -0,0 +1,263 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host simulation of the frame rate governor (maxrefdes178_governor.c) on recorded traces, to
+ * compare policies offline:
+ *
+ *   gcc -O2 -I. maxrefdes178_governor.c maxrefdes178_governor_sim.c -o governor_sim
+ *   ./governor_sim uart.log off max_fps hours:6 hours:10
+ *
+ * Input is a MAX32666 debug UART log, only the "governor,..." lines printed at every power
+ * accumulator read are used. Plain CSV lines with the same fields are accepted too:
+ *   time_ms,video_mw,audio_mw,soc,soc_valid,usb_chgin,thermal,idle_ms,level
+ * level is the operating point the power was measured at. Video power is rescaled to the
+ * simulated point with the relative power estimates, the energy difference is applied to the
+ * recorded state of charge.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_governor.h"
+#include "maxrefdes178_utility.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define TRACE_FIELD_COUNT   9
+#define MAX_POLICIES        8
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    uint32_t time;
+    uint32_t video_power_mw;
+    uint32_t audio_power_mw;
+    uint32_t soc;
+    uint32_t soc_valid;
+    uint32_t usb_chgin;
+    uint32_t thermal;
+    uint32_t idle_duration;
+    uint32_t level;
+} trace_record_t;
+
+typedef struct {
+    const char *name;
+    governor_t governor;
+    double energy_recorded_mwh;
+    double energy_mwh;
+    double video_energy_mwh;
+    double fps_sum;
+    double cnn_sum;
+    double duration_h;
+    double soc;
+    uint32_t changes;
+} simulation_t;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static int parse_record(const char *line, trace_record_t *record);
+static int parse_policy(const char *arg, governor_policy_t *policy);
+static void simulate(simulation_t *sim, const trace_record_t *prev, const trace_record_t *record);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    static const char *default_policies[] = {"off", "max_fps", "hours:8"};
+    const char **policy_args = default_policies;
+    int policy_count = sizeof(default_policies) / sizeof(default_policies[0]);
+    simulation_t sims[MAX_POLICIES];
+    governor_policy_t policy;
+    trace_record_t record;
+    trace_record_t prev;
+    char line[256];
+    int record_count = 0;
+    FILE *f;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s trace [off|max_fps|hours:H]...\n", argv[0]);
+        return 1;
+    }
+    if (argc > 2) {
+        policy_args = (const char **) &argv[2];
+        policy_count = MIN(argc - 2, MAX_POLICIES);
+    }
+
+    if ((f = fopen(argv[1], "r")) == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    memset(sims, 0, sizeof(sims));
+    for (int i = 0; i < policy_count; i++) {
+        if (parse_policy(policy_args[i], &policy)) {
+            fprintf(stderr, "invalid policy %s\n", policy_args[i]);
+            return 1;
+        }
+        sims[i].name = policy_args[i];
+        sims[i].governor.policy = policy;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        if (parse_record(line, &record)) {
+            continue;
+        }
+
+        for (int i = 0; i < policy_count; i++) {
+            if (record_count == 0) {
+                governor_init(&sims[i].governor, &sims[i].governor.policy, record.time);
+                sims[i].soc = record.soc;
+            } else {
+                simulate(&sims[i], &prev, &record);
+            }
+        }
+
+        prev = record;
+        record_count++;
+    }
+    fclose(f);
+
+    if (record_count < 2) {
+        fprintf(stderr, "not enough governor records\n");
+        return 1;
+    }
+
+    printf("%-12s %8s %10s %8s %8s %8s %8s %10s\n",
+            "policy", "hours", "video_mw", "fps_%", "cnn_%", "changes", "soc_%", "life_h");
+    for (int i = 0; i < policy_count; i++) {
+        simulation_t *sim = &sims[i];
+        double total_mw = sim->energy_mwh / sim->duration_h;
+
+        printf("%-12s %8.2f %10.1f %8.1f %8.1f %8u %8.1f %10.2f\n", sim->name, sim->duration_h,
+                sim->video_energy_mwh / sim->duration_h, 100.0 * sim->fps_sum / sim->duration_h,
+                100.0 * sim->cnn_sum / sim->duration_h, sim->changes, sim->soc,
+                GOVERNOR_BATTERY_CAPACITY_MWH / total_mw);
+    }
+
+    return 0;
+}
+
+static int parse_record(const char *line, trace_record_t *record)
+{
+    const char *p = strstr(line, "governor,");
+
+    if (p) {
+        p += strlen("governor,");
+    } else if ((line[0] >= '0') && (line[0] <= '9')) {
+        p = line;
+    } else {
+        return -1;
+    }
+
+    if (sscanf(p, "%u,%u,%u,%u,%u,%u,%u,%u,%u", &record->time, &record->video_power_mw,
+            &record->audio_power_mw, &record->soc, &record->soc_valid, &record->usb_chgin,
+            &record->thermal, &record->idle_duration, &record->level) != TRACE_FIELD_COUNT) {
+        return -1;
+    }
+
+    if (record->level >= governor_get_level_count()) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_policy(const char *arg, governor_policy_t *policy)
+{
+    double hours;
+
+    memset(policy, 0, sizeof(*policy));
+
+    if (strcmp(arg, "off") == 0) {
+        policy->policy = GOVERNOR_POLICY_OFF;
+    } else if (strcmp(arg, "max_fps") == 0) {
+        policy->policy = GOVERNOR_POLICY_MAX_FPS;
+    } else if ((sscanf(arg, "hours:%lf", &hours) == 1) && (hours > 0) && (hours * 60 <= UINT16_MAX)) {
+        policy->policy = GOVERNOR_POLICY_BATTERY_HOURS;
+        policy->target_minutes = hours * 60;
+    } else {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void simulate(simulation_t *sim, const trace_record_t *prev, const trace_record_t *record)
+{
+    const governor_point_t *point = governor_get_point(sim->governor.level);
+    const governor_point_t *recorded_point = governor_get_point(record->level);
+    double dt_h = (double)(record->time - prev->time) / (3600.0 * 1000.0);
+    uint32_t video_power_mw;
+    governor_input_t input;
+
+    // Power read at this record was accumulated at the level in effect since the previous one
+    video_power_mw = ((uint64_t) record->video_power_mw * point->relative_power) / recorded_point->relative_power;
+
+    sim->energy_recorded_mwh += (record->video_power_mw + record->audio_power_mw + GOVERNOR_BASE_POWER_MW) * dt_h;
+    sim->energy_mwh += (video_power_mw + record->audio_power_mw + GOVERNOR_BASE_POWER_MW) * dt_h;
+    sim->video_energy_mwh += video_power_mw * dt_h;
+    sim->fps_sum += (point->relative_fps / 1000.0) * dt_h;
+    sim->cnn_sum += (1.0 / point->cnn_interval) * dt_h;
+    sim->duration_h += dt_h;
+
+    // Energy saved or spent compared to the recording moves the state of charge
+    sim->soc = record->soc + ((sim->energy_recorded_mwh - sim->energy_mwh) * 100.0 / GOVERNOR_BATTERY_CAPACITY_MWH);
+    sim->soc = MAX(0.0, MIN(100.0, sim->soc));
+
+    input.time = record->time;
+    input.video_power_mw = video_power_mw;
+    input.audio_power_mw = record->audio_power_mw;
+    input.idle_duration = record->idle_duration;
+    input.battery_soc = (uint8_t) sim->soc;
+    input.battery_valid = record->soc_valid;
+    input.usb_chgin = record->usb_chgin;
+    input.thermal = record->thermal;
+
+    sim->changes += governor_update(&sim->governor, &input);
+}
@@ -0,0 +1,585 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host harness of the continuous keyword spotting mode of the audio firmware
+ * (max78000_audio_kws.c and max78000_audio_transpose.c, the same in every demo), Linux only:
+ *
+ *   gcc -O2 -DENABLE_CONTINUOUS_KWS -I. -Ihost -I../maxrefdes178-FaceId/maxrefdes178_max78000_common \
+ *       -I../maxrefdes178-FaceId/maxrefdes178_max78000_audio/include \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max78000_audio/src/max78000_audio_kws.c \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max78000_audio/src/max78000_audio_transpose.c \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max78000_common/max78000_softmax.c \
+ *       maxrefdes178_kws_sim.c -o kws_sim -lm
+ *   ./kws_sim [16kHz mono 16-bit PCM .wav ...]
+ *
+ * Without arguments a synthetic recording is written to a temporary WAV file and read back: six
+ * 0.5s tone bursts 2.5s apart over low noise, half of them too quiet to trip THRESHOLD_HIGH.
+ *
+ * Every WAV sample goes through kws_mic_sample as the 16-bit value MicReadChunk takes from an I2S
+ * word, so high pass filter, settling discard, 8-bit scaling and CHUNK framing are the firmware's.
+ * Each CHUNK goes to kws_window_add. When the window is due, transpose_load copies it into the CNN
+ * data memory, mapped read write at 0x50400000-0x51018000, and the stub CNN reads it back. The
+ * window must hold the last SAMPLE_SIZE samples in order. The stub scores the window from the
+ * level of each row: "GO" when a word lies completely inside, half way when a word touches an
+ * edge, "Unknown" otherwise. The scores go through softmax_q17p14_q15 and kws_smooth, and a
+ * smoothed class above INFERENCE_THRESHOLD is a report, like report_inference, followed by
+ * kws_reset for a keyword and kws_smooth_clear for "Unknown" as in max78000_audio_main.c.
+ *
+ * Words are found over the whole recording with the same row level rule. Detection latency runs
+ * from the end of the last CHUNK of a word to the end of the CNN run that reported it. Every
+ * input runs with a fast CNN and a slow one, the slow one is held back by KWS_MAX_DUTY_CYCLE.
+ * Audio arriving while the stub CNN runs is never dropped.
+ *
+ * Checks: the window content, the duty cycle bound, and on the synthetic recording with the fast
+ * CNN every word reported once with no false reports.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "mxc.h"
+#include "max78000_audio_cnn.h"
+#include "max78000_audio_kws.h"
+#include "max78000_audio_transpose.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define SAMPLE_RATE             16000
+#define CHUNK                   TRANSPOSE_WIDTH
+#define THRESHOLD_HIGH          350     // as in max78000_audio_main.c
+#define INFERENCE_THRESHOLD     75      // as in max78000_audio_main.c
+#define GROUP_PAGE              4096
+
+#define STUB_ACTIVE_SUM         (2 * CHUNK)  // sum of absolute 8-bit samples of a row holding a word
+#define STUB_GAP_ROWS           4       // quiet rows inside one word
+#define STUB_MIN_ROWS           4       // shorter bursts are clicks
+#define STUB_MARGIN_ROWS        4       // quiet rows needed after a word to call it complete
+#define STUB_CLASS_KEYWORD      5       // "GO"
+#define STUB_CLASS_UNKNOWN      (CNN_NUM_OUTPUTS - 1)
+#define STUB_SURE               (9 << 14)    // Q17.14 base 2, 512 : 21 against the rest
+#define STUB_HALF               (5 << 14)
+
+#define CNN_FAST_US             3000
+#define CNN_SLOW_US             150000
+
+#define SYNTH_LEAD_MS           1500
+#define SYNTH_WORD_MS           500
+#define SYNTH_SPACING_MS        2500
+#define SYNTH_TAIL_MS           2000
+#define SYNTH_NOISE             8
+
+#define MAX_WORDS               256
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    int first_row;
+    int last_row;
+    uint16_t peak_avg;
+    int reports;
+    double latency_ms;
+} word_t;
+
+typedef struct {
+    int words;
+    int detected;
+    int duplicates;
+    int false_reports;
+    int unknown_reports;
+    int quiet_words;
+    int inferences;
+    double audio_s;
+    double latency_sum_ms;
+    double latency_max_ms;
+} run_result_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static const uintptr_t group_addr[TRANSPOSE_GROUPS] = {
+    0x50400000, 0x50408000, 0x50410000, 0x50418000,
+    0x50800000, 0x50808000, 0x50810000, 0x50818000,
+    0x50C00000, 0x50C08000, 0x50C10000, 0x50C18000,
+    0x51000000, 0x51008000, 0x51010000, 0x51018000,
+};
+
+static const int synth_amplitude[] = {700, 250, 450, 250, 700, 300};
+
+static uint8_t *rows;           // every CHUNK of the recording as framed by kws_mic_sample
+static uint16_t *row_avg;
+static int row_count;
+static uint8_t window[TRANSPOSE_WIDTH][TRANSPOSE_WIDTH];
+static word_t words[MAX_WORDS];
+static int window_errors;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static int wav_write(FILE *f, const int16_t *samples, int count);
+static int16_t *wav_read(FILE *f, int *count);
+static int16_t *synth(int *count);
+static int row_active(const uint8_t *row);
+static int find_words(const uint8_t *first, int count, int stride, int *starts, int *ends, int max);
+static void stub_cnn(int newest_row, int32_t *ml_data);
+static int run(const int16_t *samples, int count, uint32_t cnn_us, run_result_t *result);
+static int report(const char *name, const int16_t *samples, int count, int synthetic);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    int errors = 0;
+    int16_t *samples;
+    int count;
+    FILE *f;
+
+    for (int i = 0; i < TRANSPOSE_GROUPS; i++) {
+        if (mmap((void *) group_addr[i], GROUP_PAGE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) != (void *) group_addr[i]) {
+            printf("FAIL: cannot map CNN data memory at 0x%08lx\n", (unsigned long) group_addr[i]);
+            return 1;
+        }
+    }
+
+    printf("%-24s %7s %5s %5s %5s %5s %5s %7s %6s %8s %8s %7s\n", "input", "cnn us", "words", "quiet",
+            "found", "dup", "false", "unknown", "inf/s", "duty %", "mean ms", "max ms");
+
+    if (argc < 2) {
+        samples = synth(&count);
+        f = tmpfile();
+        if (!f || wav_write(f, samples, count)) {
+            printf("FAIL: cannot write synthetic WAV\n");
+            return 1;
+        }
+        free(samples);
+        rewind(f);
+        samples = wav_read(f, &count);
+        fclose(f);
+        if (!samples) {
+            printf("FAIL: cannot read back synthetic WAV\n");
+            return 1;
+        }
+        errors += report("synthetic", samples, count, 1);
+        free(samples);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        f = fopen(argv[i], "rb");
+        samples = f ? wav_read(f, &count) : NULL;
+        if (f) {
+            fclose(f);
+        }
+        if (!samples) {
+            printf("FAIL: %s is not a 16kHz mono 16-bit PCM WAV file\n", argv[i]);
+            errors++;
+            continue;
+        }
+        errors += report(argv[i], samples, count, 0);
+        free(samples);
+    }
+
+    printf("kws check: %s\n", errors ? "FAILED" : "passed");
+
+    return errors ? 1 : 0;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static int wav_write(FILE *f, const int16_t *samples, int count)
+{
+    uint8_t header[44];
+
+    memcpy(&header[0], "RIFF", 4);
+    put_u32(&header[4], 36 + 2 * count);
+    memcpy(&header[8], "WAVEfmt ", 8);
+    put_u32(&header[16], 16);
+    put_u32(&header[20], 1 | (1 << 16));            // PCM, mono
+    put_u32(&header[24], SAMPLE_RATE);
+    put_u32(&header[28], 2 * SAMPLE_RATE);
+    put_u32(&header[32], 2 | (16 << 16));           // block align, bits
+    memcpy(&header[36], "data", 4);
+    put_u32(&header[40], 2 * count);
+
+    if (fwrite(header, sizeof(header), 1, f) != 1) {
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        uint8_t le[2] = {(uint8_t) samples[i], (uint8_t) (samples[i] >> 8)};
+
+        if (fwrite(le, sizeof(le), 1, f) != 1) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int16_t *wav_read(FILE *f, int *count)
+{
+    uint8_t chunk[8];
+    uint8_t fmt[16];
+    uint8_t riff[12];
+    uint32_t size;
+    int fmt_ok = 0;
+    int16_t *samples;
+
+    if ((fread(riff, sizeof(riff), 1, f) != 1) || memcmp(riff, "RIFF", 4) || memcmp(&riff[8], "WAVE", 4)) {
+        return NULL;
+    }
+
+    while (fread(chunk, sizeof(chunk), 1, f) == 1) {
+        size = get_u32(&chunk[4]);
+
+        if (!memcmp(chunk, "fmt ", 4) && (size >= sizeof(fmt))) {
+            if (fread(fmt, sizeof(fmt), 1, f) != 1) {
+                return NULL;
+            }
+            fmt_ok = ((fmt[0] | (fmt[1] << 8)) == 1) && ((fmt[2] | (fmt[3] << 8)) == 1) &&
+                    (get_u32(&fmt[4]) == SAMPLE_RATE) && ((fmt[14] | (fmt[15] << 8)) == 16);
+            size -= sizeof(fmt);
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!fmt_ok) {
+                return NULL;
+            }
+            *count = size / 2;
+            samples = malloc(size + 2);
+            if (!samples) {
+                return NULL;
+            }
+            for (int i = 0; i < *count; i++) {
+                uint8_t le[2];
+
+                if (fread(le, sizeof(le), 1, f) != 1) {
+                    *count = i;
+                    break;
+                }
+                samples[i] = (int16_t) (le[0] | (le[1] << 8));
+            }
+            return samples;
+        }
+
+        // chunks are padded to an even size
+        if (fseek(f, size + (size & 1), SEEK_CUR)) {
+            return NULL;
+        }
+    }
+
+    return NULL;
+}
+
+static int16_t *synth(int *count)
+{
+    int words_count = sizeof(synth_amplitude) / sizeof(synth_amplitude[0]);
+    int word_len = SYNTH_WORD_MS * SAMPLE_RATE / 1000;
+    int16_t *samples;
+
+    *count = (SYNTH_LEAD_MS + (words_count - 1) * SYNTH_SPACING_MS + SYNTH_WORD_MS + SYNTH_TAIL_MS) *
+            (SAMPLE_RATE / 1000);
+    samples = malloc(*count * sizeof(int16_t));
+    srand(178);
+
+    for (int i = 0; i < *count; i++) {
+        samples[i] = (rand() % (2 * SYNTH_NOISE + 1)) - SYNTH_NOISE;
+    }
+
+    for (int w = 0; w < words_count; w++) {
+        int start = (SYNTH_LEAD_MS + w * SYNTH_SPACING_MS) * (SAMPLE_RATE / 1000);
+
+        for (int i = 0; i < word_len; i++) {
+            double t = (double) i / SAMPLE_RATE;
+            double envelope = sin(M_PI * i / word_len);
+            double tone = 0.6 * sin(2 * M_PI * 500 * t) + 0.4 * sin(2 * M_PI * 1200 * t);
+
+            samples[start + i] += (int16_t) (synth_amplitude[w] * envelope * tone * 1.6);
+        }
+    }
+
+    return samples;
+}
+
+static int row_active(const uint8_t *row)
+{
+    int sum = 0;
+
+    for (int i = 0; i < CHUNK; i++) {
+        sum += abs((int8_t) row[i]);
+    }
+
+    return sum >= STUB_ACTIVE_SUM;
+}
+
+// Runs of active rows, quiet gaps up to STUB_GAP_ROWS joined, short runs dropped
+static int find_words(const uint8_t *first, int count, int stride, int *starts, int *ends, int max)
+{
+    int found = 0;
+    int start = -1;
+    int last = -1;
+
+    for (int r = 0; r <= count; r++) {
+        int active = (r < count) && row_active(first + r * stride);
+
+        if (active) {
+            if ((start >= 0) && (r - last > STUB_GAP_ROWS + 1)) {
+                if ((last - start + 1 >= STUB_MIN_ROWS) && (found < max)) {
+                    starts[found] = start;
+                    ends[found++] = last;
+                }
+                start = -1;
+            }
+            if (start < 0) {
+                start = r;
+            }
+            last = r;
+        }
+    }
+    if ((start >= 0) && (last - start + 1 >= STUB_MIN_ROWS) && (found < max)) {
+        starts[found] = start;
+        ends[found++] = last;
+    }
+
+    return found;
+}
+
+// Reads the window back from CNN data memory, newest_row is the recording row of its last row
+static void stub_cnn(int newest_row, int32_t *ml_data)
+{
+    int starts[TRANSPOSE_WIDTH];
+    int ends[TRANSPOSE_WIDTH];
+    int complete = 0;
+    int found;
+
+    for (int row = 0; row < TRANSPOSE_WIDTH; row++) {
+        for (int col = 0; col < TRANSPOSE_WIDTH; col++) {
+            const uint8_t *mem = (const uint8_t *) group_addr[(col % (TRANSPOSE_WIDTH / 2)) / 4];
+
+            window[row][col] = mem[4 * (2 * row + (col >= TRANSPOSE_WIDTH / 2)) + (col % 4)];
+        }
+    }
+
+    if (memcmp(window, &rows[(newest_row - TRANSPOSE_WIDTH + 1) * CHUNK], sizeof(window))) {
+        if (!window_errors++) {
+            printf("FAIL: window ending at row %d is not the last %d samples\n", newest_row, TRANSPOSE_SIZE);
+        }
+    }
+
+    found = find_words(&window[0][0], TRANSPOSE_WIDTH, CHUNK, starts, ends, TRANSPOSE_WIDTH);
+    for (int i = 0; i < found; i++) {
+        if ((starts[i] > 0) && (ends[i] < TRANSPOSE_WIDTH - 1 - STUB_MARGIN_ROWS)) {
+            complete = 1;
+        }
+    }
+
+    memset(ml_data, 0, CNN_NUM_OUTPUTS * sizeof(int32_t));
+    if (complete) {
+        ml_data[STUB_CLASS_KEYWORD] = STUB_SURE;
+    } else if (found) {
+        ml_data[STUB_CLASS_KEYWORD] = STUB_HALF;
+    } else {
+        ml_data[STUB_CLASS_UNKNOWN] = STUB_SURE;
+    }
+}
+
+static int run(const int16_t *samples, int count, uint32_t cnn_us, run_result_t *result)
+{
+    int starts[MAX_WORDS];
+    int ends[MAX_WORDS];
+    int32_t ml_data[CNN_NUM_OUTPUTS];
+    q15_t ml_softmax[CNN_NUM_OUTPUTS];
+    q15_t smooth_soft[CNN_NUM_OUTPUTS];
+    int32_t smooth_data[CNN_NUM_OUTPUTS];
+    uint16_t avg;
+    int errors = 0;
+
+    memset(result, 0, sizeof(*result));
+    rows = malloc((count / CHUNK + 1) * CHUNK);
+    row_avg = malloc((count / CHUNK + 1) * sizeof(uint16_t));
+    row_count = 0;
+    window_errors = 0;
+
+    // frame the whole recording first, words are needed to match reports as they come
+    kws_mic_init();
+    for (int i = 0; i < count; i++) {
+        if (kws_mic_sample(samples[i] * (1 << 14), &rows[row_count * CHUNK], CHUNK, &avg)) {
+            row_avg[row_count++] = avg;
+        }
+    }
+
+    result->words = find_words(rows, row_count, CHUNK, starts, ends, MAX_WORDS);
+    for (int w = 0; w < result->words; w++) {
+        words[w].first_row = starts[w];
+        words[w].last_row = ends[w];
+        words[w].peak_avg = 0;
+        words[w].reports = 0;
+        for (int r = starts[w]; r <= ends[w]; r++) {
+            if (row_avg[r] > words[w].peak_avg) {
+                words[w].peak_avg = row_avg[r];
+            }
+        }
+        if (words[w].peak_avg < THRESHOLD_HIGH) {
+            result->quiet_words++;
+        }
+    }
+
+    kws_reset();
+    for (int r = 0; r < row_count; r++) {
+        if (!kws_window_add(&rows[r * CHUNK], cnn_us)) {
+            continue;
+        }
+
+        transpose_load(kws_window_start());
+        stub_cnn(r, ml_data);
+        softmax_q17p14_q15(ml_data, CNN_NUM_OUTPUTS, ml_softmax);
+        result->inferences++;
+
+        if (!kws_smooth(ml_softmax, smooth_soft, smooth_data)) {
+            continue;
+        }
+
+        // check_inference
+        int32_t max_ml = 1 << 31;
+        int out_class = -1;
+        for (int i = 0; i < CNN_NUM_OUTPUTS; i++) {
+            if (smooth_data[i] > max_ml) {
+                max_ml = smooth_data[i];
+                out_class = i;
+            }
+        }
+        if (100.0 * smooth_soft[out_class] / 32768.0 <= INFERENCE_THRESHOLD) {
+            continue;
+        }
+        if (out_class != STUB_CLASS_KEYWORD) {
+            kws_smooth_clear();
+            result->unknown_reports++;
+            continue;
+        }
+        kws_reset();
+
+        // the latest word that started inside the window
+        int w;
+        for (w = result->words - 1; w >= 0; w--) {
+            if ((words[w].first_row <= r) && (words[w].first_row > r - TRANSPOSE_WIDTH)) {
+                break;
+            }
+        }
+        if (w < 0) {
+            result->false_reports++;
+            continue;
+        }
+        if (words[w].reports++) {
+            result->duplicates++;
+            continue;
+        }
+        words[w].latency_ms = (r - words[w].last_row) * CHUNK * 1000.0 / SAMPLE_RATE + cnn_us / 1000.0;
+        result->detected++;
+        result->latency_sum_ms += words[w].latency_ms;
+        if (words[w].latency_ms > result->latency_max_ms) {
+            result->latency_max_ms = words[w].latency_ms;
+        }
+    }
+
+    result->audio_s = (double) count / SAMPLE_RATE;
+    if (window_errors) {
+        printf("FAIL: %d windows differ from the recording\n", window_errors);
+        errors++;
+    }
+    // one inference may start just before the bound is reached
+    if ((double) (result->inferences - 1) * cnn_us / 1e6 > result->audio_s * KWS_MAX_DUTY_CYCLE / 100.0) {
+        printf("FAIL: %d inferences of %u us exceed %d%% of %.1f s\n", result->inferences, cnn_us,
+                KWS_MAX_DUTY_CYCLE, result->audio_s);
+        errors++;
+    }
+
+    free(rows);
+    free(row_avg);
+
+    return errors;
+}
+
+static int report(const char *name, const int16_t *samples, int count, int synthetic)
+{
+    static const uint32_t cnn_us[] = {CNN_FAST_US, CNN_SLOW_US};
+    run_result_t result;
+    int errors = 0;
+
+    for (unsigned int i = 0; i < sizeof(cnn_us) / sizeof(cnn_us[0]); i++) {
+        errors += run(samples, count, cnn_us[i], &result);
+
+        printf("%-24.24s %7u %5d %5d %5d %5d %5d %7d %6.2f %8.1f %8.1f %7.1f\n", name, cnn_us[i], result.words,
+                result.quiet_words, result.detected, result.duplicates, result.false_reports,
+                result.unknown_reports, result.inferences / result.audio_s,
+                100.0 * result.inferences * cnn_us[i] / 1e6 / result.audio_s,
+                result.detected ? result.latency_sum_ms / result.detected : 0.0, result.latency_max_ms);
+
+        if (synthetic && (i == 0)) {
+            int expected = sizeof(synth_amplitude) / sizeof(synth_amplitude[0]);
+
+            if ((result.words != expected) || (result.detected != expected) || result.duplicates ||
+                    result.false_reports) {
+                printf("FAIL: %d of %d words found, %d reported, %d twice, %d false\n", result.words,
+                        expected, result.detected, result.duplicates, result.false_reports);
+                errors++;
+            }
+        }
+    }
+
+    return errors;
+}
@@ -0,0 +1,589 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check and benchmark of the MAX32666 dirty region LCD refresh (max32666_lcd.c, max32666_fonts.c):
+ *
+ *   gcc -O2 -I. -Ihost -I../maxrefdes178-CatsDogs/maxrefdes178_max32666/include \
+ *       ../maxrefdes178-CatsDogs/maxrefdes178_max32666/src/max32666_lcd.c \
+ *       ../maxrefdes178-CatsDogs/maxrefdes178_max32666/src/max32666_fonts.c \
+ *       maxrefdes178_glyph_cache.c maxrefdes178_lcd_sim.c -o lcd_sim
+ *   ./lcd_sim [refreshes]
+ *
+ * The LCD SPI DMA is replaced by an ST7789 command stream decoder. The decoder follows CS, D/C,
+ * CASET, RASET and RAMWR and writes the pixels into a model of the panel memory. A sequence of
+ * refresh_screen style overlays is drawn by the firmware. It mixes new frames, refreshes without a
+ * new frame, changing statistics, battery and notification text, the start screen, other images and
+ * rotation changes. After every refresh the visible panel must match the image that was drawn.
+ * The panel memory must also match the same sequence sent as full frames, as the firmware did
+ * before the dirty regions. Bytes on the wire, DMA transfers and SPI time at MAX32666_LCD_SPI_SPEED
+ * are reported for both. Only LCD_ROTATION_UP is modelled, other MADCTL settings fail the check.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "max32666_data.h"
+#include "max32666_fonts.h"
+#include "max32666_lcd.h"
+#include "max32666_spi_dma.h"
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_scheduler.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define DEFAULT_REFRESHES   2000
+
+#define ST7789_GRAM_WIDTH   240
+#define ST7789_GRAM_HEIGHT  320
+
+#define ST7789_CASET        0x2A
+#define ST7789_RASET        0x2B
+#define ST7789_RAMWR        0x2C
+#define ST7789_MADCTL       0x36
+
+#define LCD_CS_MASK         MXC_GPIO_PIN_22
+#define LCD_DC_MASK         MXC_GPIO_PIN_31
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+// ST7789 serial interface and panel memory
+typedef struct {
+    uint8_t gram[ST7789_GRAM_HEIGHT][ST7789_GRAM_WIDTH * LCD_BYTE_PER_PIXEL];
+    uint8_t command;
+    uint8_t params[4];
+    int param_count;
+    uint8_t madctl;
+    uint16_t xs, xe, ys, ye;  // Address window
+    uint16_t x, y;            // Next pixel of RAMWR
+    int pixel_byte;           // Second byte of a pixel is next
+    uint32_t errors;
+} st7789_t;
+
+typedef struct {
+    uint32_t bytes;
+    uint32_t transfers;
+} wire_t;
+
+typedef struct {
+    int battery;
+    float fps;
+    int cnn_us;
+    int kws_us;
+    const char *audio_result;
+    int video_enabled;
+    int notification;
+} overlay_t;
+
+typedef struct {
+    wire_t frame;      // Refreshes with a new video frame
+    wire_t overlay;    // Refreshes without a new video frame
+    wire_t other;      // Other images, rotation
+    uint32_t frame_refreshes;
+    uint32_t overlay_refreshes;
+    uint32_t other_refreshes;
+} run_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+lcd_data_t lcd_data;
+volatile device_settings_t device_settings;
+timestamps_t timestamps;
+volatile uint32_t timer_ms_tick;
+
+mxc_gpio_regs_t host_gpio0;
+mxc_spi_regs_t host_spi1;
+SCB_Type host_scb;
+uint32_t __isr_vector_core1;
+
+static st7789_t panel;
+static wire_t wire;
+static uint8_t other_image[LCD_DATA_SIZE];
+static uint32_t *full_frame_checksums;
+
+static const char *audio_results[] = {"Go", "Stop", "Left", "Right", "Unknown"};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void st7789_byte(int dc, uint8_t data);
+static int panel_compare(const char *name, const uint8_t *image);
+static uint32_t panel_checksum(void);
+static void fill_frame(uint8_t *frame);
+static void overlay(const overlay_t *state);
+static void random_overlay(overlay_t *state, int all);
+static int run(int refreshes, int full_frames, run_t *stats);
+static void report(const char *name, const wire_t *wire, uint32_t refreshes);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    run_t full, dirty;
+    int refreshes = DEFAULT_REFRESHES;
+    int errors = 0;
+
+    if (argc > 1) {
+        refreshes = atoi(argv[1]);
+    }
+    if (refreshes <= 0) {
+        refreshes = DEFAULT_REFRESHES;
+    }
+
+    full_frame_checksums = calloc(refreshes, sizeof(uint32_t));
+    if (!full_frame_checksums) {
+        return 1;
+    }
+
+    if (lcd_init() != E_NO_ERROR) {
+        printf("FAIL: lcd_init\n");
+        return 1;
+    }
+    fill_frame(other_image);
+
+    // Reference, every refresh sends the whole frame
+    errors += run(refreshes, 1, &full);
+    // Same sequence with dirty regions, the panel must show the same image after every refresh
+    errors += run(refreshes, 0, &dirty);
+
+    printf("pixel check: %s\n", errors ? "FAILED" : "passed");
+
+    printf("%d refreshes, %u with new frame, %u without, %u other image or rotation, SPI %u MHz\n",
+           refreshes, dirty.frame_refreshes, dirty.overlay_refreshes, dirty.other_refreshes,
+           MAX32666_LCD_SPI_SPEED / 1000000);
+    report("full frame, new frame", &full.frame, full.frame_refreshes);
+    report("dirty,      new frame", &dirty.frame, dirty.frame_refreshes);
+    report("full frame, overlay only", &full.overlay, full.overlay_refreshes);
+    report("dirty,      overlay only", &dirty.overlay, dirty.overlay_refreshes);
+    report("full frame, other", &full.other, full.other_refreshes);
+    report("dirty,      other", &dirty.other, dirty.other_refreshes);
+
+    free(full_frame_checksums);
+
+    return errors ? 1 : 0;
+}
+
+// Panel side of a byte on the wire
+static void st7789_byte(int dc, uint8_t data)
+{
+    if (!dc) {
+        panel.command = data;
+        panel.param_count = 0;
+        if (data == ST7789_RAMWR) {
+            if (panel.madctl) {
+                printf("FAIL: RAMWR with MADCTL 0x%02x, not modelled\n", panel.madctl);
+                panel.errors++;
+            }
+            panel.x = panel.xs;
+            panel.y = panel.ys;
+            panel.pixel_byte = 0;
+        }
+        return;
+    }
+
+    switch (panel.command) {
+    case ST7789_CASET:
+    case ST7789_RASET:
+        if (panel.param_count < 4) {
+            panel.params[panel.param_count++] = data;
+        }
+        if (panel.param_count == 4) {
+            uint16_t start = (panel.params[0] << 8) | panel.params[1];
+            uint16_t end = (panel.params[2] << 8) | panel.params[3];
+
+            if (panel.command == ST7789_CASET) {
+                panel.xs = start;
+                panel.xe = end;
+            } else {
+                panel.ys = start;
+                panel.ye = end;
+            }
+            if ((start > end) || (end >= ((panel.command == ST7789_CASET) ? ST7789_GRAM_WIDTH : ST7789_GRAM_HEIGHT))) {
+                printf("FAIL: address window %u..%u\n", start, end);
+                panel.errors++;
+            }
+        }
+        break;
+    case ST7789_MADCTL:
+        panel.madctl = data;
+        break;
+    case ST7789_RAMWR:
+        if (panel.y > panel.ye) {
+            // The panel would wrap to the window start, the driver never sends more than the window
+            if (panel.y == (panel.ye + 1)) {
+                printf("FAIL: RAMWR beyond window %u,%u-%u,%u\n", panel.xs, panel.ys, panel.xe, panel.ye);
+                panel.errors++;
+                panel.y++;
+            }
+            break;
+        }
+        panel.gram[panel.y][panel.x * LCD_BYTE_PER_PIXEL + panel.pixel_byte] = data;
+        if (panel.pixel_byte) {
+            if (++panel.x > panel.xe) {
+                panel.x = panel.xs;
+                panel.y++;
+            }
+        }
+        panel.pixel_byte ^= 1;
+        break;
+    default:
+        // Configuration commands, parameters do not change the panel memory
+        break;
+    }
+}
+
+static int panel_compare(const char *name, const uint8_t *image)
+{
+    int x, y;
+
+    for (y = 0; y < LCD_HEIGHT; y++) {
+        if (memcmp(panel.gram[y], &image[y * LCD_WIDTH * LCD_BYTE_PER_PIXEL], LCD_WIDTH * LCD_BYTE_PER_PIXEL)) {
+            for (x = 0; x < LCD_WIDTH * LCD_BYTE_PER_PIXEL; x++) {
+                if (panel.gram[y][x] != image[y * LCD_WIDTH * LCD_BYTE_PER_PIXEL + x]) {
+                    break;
+                }
+            }
+            printf("FAIL: %s: panel pixel %d,%d differs\n", name, x / LCD_BYTE_PER_PIXEL, y);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static uint32_t panel_checksum(void)
+{
+    uint32_t sum = 0;
+    int x, y;
+
+    for (y = 0; y < LCD_HEIGHT; y++) {
+        for (x = 0; x < LCD_WIDTH * LCD_BYTE_PER_PIXEL; x++) {
+            sum = (sum * 31) + panel.gram[y][x];
+        }
+    }
+
+    return sum;
+}
+
+// Random blocks of color, like a camera frame it changes everywhere
+static void fill_frame(uint8_t *frame)
+{
+    uint16_t *p = (uint16_t *) frame;
+    uint16_t color = 0;
+    int i;
+
+    for (i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++) {
+        if (!(i % 8)) {
+            color = rand();
+        }
+        p[i] = color;
+    }
+}
+
+// Parts of the CatsDogs refresh_screen
+static void overlay(const overlay_t *state)
+{
+    char line[LCD_NOTIFICATION_MAX_SIZE];
+    int line_pos = 3;
+
+    snprintf(line, sizeof(line) - 1, "%3d%%", state->battery);
+    fonts_putString(LCD_WIDTH - 31, 3, line, &Font_7x10, GREEN, 0, 0, lcd_data.buffer);
+
+    if (state->video_enabled) {
+        fonts_drawRectangle(CATSDOGS_RECTANGLE_X1 - 0, CATSDOGS_RECTANGLE_Y1 - 0, CATSDOGS_RECTANGLE_X2 + 0, CATSDOGS_RECTANGLE_Y2 + 0, GREEN, lcd_data.buffer);
+        fonts_drawRectangle(CATSDOGS_RECTANGLE_X1 - 1, CATSDOGS_RECTANGLE_Y1 - 1, CATSDOGS_RECTANGLE_X2 + 1, CATSDOGS_RECTANGLE_Y2 + 1, GREEN, lcd_data.buffer);
+    }
+
+    snprintf(line, sizeof(line) - 1, "FPS:%.2f", (double) state->fps);
+    fonts_putString(3, line_pos, line, &Font_7x10, MAGENTA, 0, 0, lcd_data.buffer);
+    line_pos += 12;
+
+    snprintf(line, sizeof(line) - 1, "Cats&Dogs:%d us", state->cnn_us);
+    fonts_putString(3, line_pos, line, &Font_7x10, MAGENTA, 0, 0, lcd_data.buffer);
+    line_pos += 12;
+
+    snprintf(line, sizeof(line) - 1, "KWS:%d us", state->kws_us);
+    fonts_putString(3, line_pos, line, &Font_7x10, MAGENTA, 0, 0, lcd_data.buffer);
+
+    if (!state->video_enabled) {
+        fonts_drawFilledRectangle(LCD_START_BUTTON_X1, LCD_START_BUTTON_Y1, LCD_START_BUTTON_X2 - LCD_START_BUTTON_X1,
+                                  LCD_START_BUTTON_Y2 - LCD_START_BUTTON_Y1, LGRAY, lcd_data.buffer);
+        fonts_drawThickRectangle(LCD_START_BUTTON_X1, LCD_START_BUTTON_Y1, LCD_START_BUTTON_X2, LCD_START_BUTTON_Y2, LIGHTBLUE, 4, lcd_data.buffer);
+        fonts_putStringCentered(LCD_START_BUTTON_Y1 + 10, "Start Video", &Font_16x26, ADIBLUE, lcd_data.buffer);
+    }
+
+    if (state->audio_result) {
+        fonts_putStringCentered(3, state->audio_result, &Font_16x26, WHITE, lcd_data.buffer);
+    }
+
+    if (state->notification) {
+        fonts_putStringCentered(LCD_HEIGHT - Font_11x18.height - 3, "Button pressed", &Font_11x18, YELLOW, lcd_data.buffer);
+    }
+}
+
+static void random_overlay(overlay_t *state, int all)
+{
+    state->fps = (float) (rand() % 3000) / 100;
+    if (all || !(rand() % 20)) {
+        state->battery = rand() % 101;
+    }
+    if (all || !(rand() % 4)) {
+        state->cnn_us = 15000 + rand() % 5000;
+        state->kws_us = 10000 + rand() % 5000;
+    }
+    if (all || !(rand() % 8)) {
+        state->audio_result = (rand() % 2) ? audio_results[rand() % (sizeof(audio_results) / sizeof(audio_results[0]))] : NULL;
+    }
+    if (all || !(rand() % 10)) {
+        state->notification = !(rand() % 3);
+    }
+    if (all || !(rand() % 50)) {
+        state->video_enabled = rand() % 4;
+    }
+}
+
+/* One sequence of refreshes, with full_frames every refresh sends the whole frame. The decoded
+ * panel must show lcd_data.buffer or the other image after every refresh, the dirty run must also
+ * match the checksum of the full frame run.
+ */
+static int run(int refreshes, int full_frames, run_t *stats)
+{
+    overlay_t state;
+    wire_t *category;
+    wire_t start;
+    int i, r;
+
+    memset(stats, 0, sizeof(*stats));
+    srand(178);
+
+    fill_frame(lcd_data.back_buffer);
+    lcd_swap_buffers();
+    random_overlay(&state, 1);
+
+    for (i = 0; i < refreshes; i++) {
+        start = wire;
+        r = rand() % 100;
+
+        if (r < 2) {
+            // Logo or another screen replaces the frame buffer on the panel
+            lcd_drawImage(other_image);
+            category = &stats->other;
+            stats->other_refreshes++;
+        } else {
+            if (r < 3) {
+                lcd_set_rotation(LCD_ROTATION_UP);
+                category = &stats->other;
+                stats->other_refreshes++;
+            } else if (state.video_enabled && (r < 40)) {
+                fill_frame(lcd_data.back_buffer);
+                lcd_swap_buffers();
+                category = &stats->frame;
+                stats->frame_refreshes++;
+            } else {
+                category = &stats->overlay;
+                stats->overlay_refreshes++;
+            }
+
+            random_overlay(&state, 0);
+            overlay(&state);
+            if (full_frames) {
+                lcd_mark_dirty_all();
+            }
+            lcd_drawImage(lcd_data.buffer);
+        }
+
+        category->bytes += wire.bytes - start.bytes;
+        category->transfers += wire.transfers - start.transfers;
+
+        if (panel.errors) {
+            printf("  at refresh %d\n", i);
+            return 1;
+        }
+        if (panel_compare((r < 2) ? "other image" : "refresh", (r < 2) ? other_image : lcd_data.buffer)) {
+            printf("  at refresh %d%s\n", i, full_frames ? " of full frames" : "");
+            return 1;
+        }
+        if (full_frames) {
+            full_frame_checksums[i] = panel_checksum();
+        } else if (full_frame_checksums[i] != panel_checksum()) {
+            printf("FAIL: panel differs from full frame refresh at %d\n", i);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void report(const char *name, const wire_t *wire, uint32_t refreshes)
+{
+    if (!refreshes) {
+        return;
+    }
+
+    printf("%-25s %8u bytes/refresh %6.1f transfers/refresh %7.2f ms/refresh\n", name,
+           wire->bytes / refreshes, (double) wire->transfers / refreshes,
+           (double) wire->bytes * 8 * 1000 / MAX32666_LCD_SPI_SPEED / refreshes);
+}
+
+// Host stand-ins for the SDK and the other drivers the LCD driver uses
+int spi_dma_master_init(mxc_spi_regs_t *spi, sys_map_t map, uint32_t speed, uint8_t quad)
+{
+    (void) spi;
+    (void) map;
+    (void) speed;
+    (void) quad;
+    return E_NO_ERROR;
+}
+
+// Transfers complete at once, completion callback is called as from the DMA interrupt
+int spi_dma(uint8_t ch, mxc_spi_regs_t *spi, uint8_t *data_out, uint8_t *data_in, uint32_t len, mxc_dma_reqsel_t reqsel, void (*callback)(void))
+{
+    uint32_t i;
+
+    (void) ch;
+    (void) spi;
+    (void) data_in;
+    (void) reqsel;
+
+    if (host_gpio0.out & LCD_CS_MASK) {
+        printf("FAIL: %u bytes sent with CS deasserted\n", len);
+        panel.errors++;
+    }
+
+    for (i = 0; i < len; i++) {
+        st7789_byte(!!(host_gpio0.out & LCD_DC_MASK), data_out[i]);
+    }
+    wire.bytes += len;
+    wire.transfers++;
+
+    if (callback) {
+        callback();
+    }
+
+    return E_NO_ERROR;
+}
+
+void spi_dma_int_handler(uint8_t ch, mxc_spi_regs_t *spi)
+{
+    (void) ch;
+    (void) spi;
+}
+
+int spi_dma_wait(uint8_t ch, mxc_spi_regs_t *spi)
+{
+    (void) ch;
+    (void) spi;
+    return E_NO_ERROR;
+}
+
+uint8_t spi_dma_busy_flag(uint8_t ch)
+{
+    (void) ch;
+    return 0;
+}
+
+void MXC_GPIO_OutSet(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    port->out |= mask;
+}
+
+void MXC_GPIO_OutClr(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    port->out &= ~mask;
+}
+
+int MXC_GPIO_Config(const mxc_gpio_cfg_t *cfg)
+{
+    (void) cfg;
+    return E_NO_ERROR;
+}
+
+int MXC_SEMA_GetSema(unsigned sema)
+{
+    (void) sema;
+    return E_NO_ERROR;
+}
+
+void MXC_SEMA_FreeSema(unsigned sema)
+{
+    (void) sema;
+}
+
+void MXC_Delay(uint32_t us)
+{
+    (void) us;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irqn)
+{
+    (void) irqn;
+}
+
+int expander_set_output(uint8_t mask)
+{
+    (void) mask;
+    return E_NO_ERROR;
+}
+
+int expander_clear_output(uint8_t mask)
+{
+    (void) mask;
+    return E_NO_ERROR;
+}
+
+int pmic_boost(int on, uint8_t boost_output_level)
+{
+    (void) on;
+    (void) boost_output_level;
+    return E_NO_ERROR;
+}
+
+void scheduler_post(uint32_t events)
+{
+    (void) events;
+}
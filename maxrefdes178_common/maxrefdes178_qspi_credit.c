@@ -0,0 +1,121 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static const uint8_t qspi_credit_limit[QSPI_CREDIT_CLASS_LAST] = {
+    QSPI_CREDIT_FRAME,
+    QSPI_CREDIT_RESULT,
+    QSPI_CREDIT_STATISTICS,
+};
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+qspi_credit_class_e qspi_credit_class(uint8_t packet_type)
+{
+    switch (packet_type) {
+    case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
+    case QSPI_PACKET_TYPE_VIDEO_COMPRESSED_DATA_RES:
+        return QSPI_CREDIT_CLASS_FRAME;
+    case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
+    case QSPI_PACKET_TYPE_VIDEO_UNET_MASK_RES:
+        return QSPI_CREDIT_CLASS_RESULT;
+    case QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES:
+        return QSPI_CREDIT_CLASS_STATISTICS;
+    default:
+        return QSPI_CREDIT_CLASS_NONE;
+    }
+}
+
+void qspi_credit_init(qspi_credit_t *credit)
+{
+    int i;
+
+    for (i = 0; i < QSPI_CREDIT_CLASS_LAST; i++) {
+        credit->credits[i] = qspi_credit_limit[i];
+        credit->used_time[i] = 0;
+    }
+}
+
+int qspi_credit_available(qspi_credit_t *credit, uint8_t packet_type, uint32_t time)
+{
+    qspi_credit_class_e credit_class = qspi_credit_class(packet_type);
+
+    if (credit_class == QSPI_CREDIT_CLASS_NONE) {
+        return 1;
+    }
+
+    // Acknowledge lost or MAX32666 restarted
+    if (!credit->credits[credit_class] && ((time - credit->used_time[credit_class]) >= QSPI_CREDIT_TIMEOUT)) {
+        credit->credits[credit_class] = qspi_credit_limit[credit_class];
+    }
+
+    return credit->credits[credit_class] != 0;
+}
+
+void qspi_credit_use(qspi_credit_t *credit, uint8_t packet_type, uint32_t time)
+{
+    qspi_credit_class_e credit_class = qspi_credit_class(packet_type);
+
+    if ((credit_class == QSPI_CREDIT_CLASS_NONE) || !credit->credits[credit_class]) {
+        return;
+    }
+
+    credit->credits[credit_class]--;
+    credit->used_time[credit_class] = time;
+}
+
+void qspi_credit_grant(qspi_credit_t *credit, const uint8_t *packet_types, uint32_t count)
+{
+    qspi_credit_class_e credit_class;
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        credit_class = qspi_credit_class(packet_types[i]);
+        if ((credit_class != QSPI_CREDIT_CLASS_NONE) && (credit->credits[credit_class] < qspi_credit_limit[credit_class])) {
+            credit->credits[credit_class]++;
+        }
+    }
+}
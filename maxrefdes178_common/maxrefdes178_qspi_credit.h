@@ -0,0 +1,98 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_QSPI_CREDIT_H_
+#define _MAXREFDES178_QSPI_CREDIT_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Packets of a class the MAX32666 can hold before it acknowledges them
+#define QSPI_CREDIT_FRAME                  1  // Back buffer
+#define QSPI_CREDIT_RESULT                 1
+#define QSPI_CREDIT_STATISTICS             1
+
+// Credits of a class are restored if none came back for this long, ms
+#define QSPI_CREDIT_TIMEOUT                500
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    QSPI_CREDIT_CLASS_FRAME = 0,   // Raw and compressed video frames
+    QSPI_CREDIT_CLASS_RESULT,      // Classification results and UNet masks
+    QSPI_CREDIT_CLASS_STATISTICS,  // max78000_statistics_t
+
+    QSPI_CREDIT_CLASS_LAST,
+    QSPI_CREDIT_CLASS_NONE = QSPI_CREDIT_CLASS_LAST  // Not flow controlled
+} qspi_credit_class_e;
+
+typedef struct {
+    uint8_t credits[QSPI_CREDIT_CLASS_LAST];
+    uint32_t used_time[QSPI_CREDIT_CLASS_LAST];  // Last packet sent with the class out of credits
+} qspi_credit_t;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Per class credit flow control of the video QSPI link, hardware independent, also builds on a
+// host. The MAX78000 spends a credit for every packet it sends, the MAX32666 returns it with a
+// QSPI_PACKET_TYPE_ACKNOWLEDGE once the packet was consumed. The payload lists the packet types
+// consumed, one byte each. A class out of credits does not hold back the others.
+
+qspi_credit_class_e qspi_credit_class(uint8_t packet_type);
+
+void qspi_credit_init(qspi_credit_t *credit);
+
+// Returns 1 if a packet of the type can be sent now
+int qspi_credit_available(qspi_credit_t *credit, uint8_t packet_type, uint32_t time);
+
+// Spends a credit for a packet that was sent
+void qspi_credit_use(qspi_credit_t *credit, uint8_t packet_type, uint32_t time);
+
+// Returns the credits of an acknowledge payload
+void qspi_credit_grant(qspi_credit_t *credit, const uint8_t *packet_types, uint32_t count);
+
+
+#endif /* _MAXREFDES178_QSPI_CREDIT_H_ */
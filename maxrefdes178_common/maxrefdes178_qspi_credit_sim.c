@@ -0,0 +1,302 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host simulation of the video QSPI link with both endpoints, compares the former fixed delays
+ * of the MAX78000 video firmware with the credit flow control (maxrefdes178_qspi_credit.c):
+ *
+ *   gcc -O2 -I. maxrefdes178_qspi_credit.c maxrefdes178_qspi_credit_sim.c -o qspi_credit_sim
+ *   ./qspi_credit_sim [seconds] [ack_loss_%]
+ *
+ * The slave captures, sends the frame, runs the CNN and sends the result as the video firmware
+ * does, statistics once a second. The master reads every packet, swaps a received frame in once
+ * the LCD is free and the governor interval passed, acknowledges frames at the swap and results
+ * and statistics on reception. Each mode runs for the LCD intervals of the governor points.
+ * Frame latency is from the end of the capture to the swap, result latency to the reception.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// us, rates of maxrefdes178_scheduler_sim.c
+#define SIM_CAPTURE                40000
+#define SIM_CNN                    30000  // Load, inference and unload
+#define SIM_FRAME_TRANSFER         7700   // 240x240 RGB565 over QSPI
+#define SIM_RESULT_TRANSFER        100
+#define SIM_LCD_TRANSFER           12000
+#define SIM_ACK                    100    // Packet with payload to the slave
+#define SIM_FRAME_DELAY            3000   // Former delay after the frame
+#define SIM_RESULT_DELAY           250000 // Former delay after the result
+#define SIM_STATISTICS_PERIOD      1000000
+
+#define MS(t)                      ((uint32_t) ((t) / 1000))
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    SIM_MODE_DELAY = 0,  // Fixed delays, no acknowledge
+    SIM_MODE_FREE,       // Neither, for reference
+    SIM_MODE_CREDIT,
+} sim_mode_e;
+
+typedef struct {
+    sim_mode_e mode;
+    uint64_t lcd_interval;
+    uint32_t ack_loss;       // %
+
+    uint64_t now;            // Slave
+    qspi_credit_t credit;
+
+    // Master
+    int frame_pending;
+    uint64_t frame_capture;
+    uint64_t frame_rx;
+    uint64_t lcd_done;
+    uint64_t screen_drew;
+    uint64_t ack_time[QSPI_CREDIT_CLASS_LAST];  // Acknowledge on the way, 0 if none
+
+    // Statistics
+    uint32_t frames_sent;
+    uint32_t frames_skipped;  // Not sent, no credit
+    uint32_t frames_shown;
+    uint32_t frames_replaced; // Sent but overwritten before the swap
+    uint32_t results_sent;
+    uint32_t results_dropped;
+    uint32_t acks_lost;
+    uint64_t link_busy;
+    uint64_t frame_latency;
+    uint64_t result_latency;
+} sim_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static const char *mode_names[] = {"delay", "free", "credit"};
+static const uint64_t lcd_intervals[] = {0, 66000, 200000};
+static sim_t sim;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void master_ack(uint8_t packet_type, uint64_t time);
+static void master_advance(uint64_t time);
+static int slave_send(uint8_t packet_type, uint64_t transfer, uint64_t capture_end);
+static void run(sim_mode_e mode, uint64_t seconds, uint64_t lcd_interval, uint32_t ack_loss);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    uint64_t seconds = (argc > 1) ? strtoull(argv[1], NULL, 0) : 600;
+    uint32_t ack_loss = (argc > 2) ? strtoul(argv[2], NULL, 0) : 0;
+
+    if (!seconds || (ack_loss > 100)) {
+        printf("usage: %s [seconds] [ack_loss_%%]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+
+    printf("%-7s %6s %8s %8s %8s %8s %9s %9s %10s %7s\n", "mode", "lcd_ms", "frames/s", "shown/s",
+           "replaced", "skipped", "results/s", "frame_ms", "result_ms", "link_%");
+    for (size_t i = 0; i < sizeof(lcd_intervals) / sizeof(lcd_intervals[0]); i++) {
+        run(SIM_MODE_DELAY, seconds, lcd_intervals[i], 0);
+        run(SIM_MODE_FREE, seconds, lcd_intervals[i], 0);
+        run(SIM_MODE_CREDIT, seconds, lcd_intervals[i], ack_loss);
+    }
+
+    return 0;
+}
+
+// Acknowledge leaves once the LCD DMA is done, as qspi_master_video_ack_worker
+static void master_ack(uint8_t packet_type, uint64_t time)
+{
+    qspi_credit_class_e credit_class = qspi_credit_class(packet_type);
+
+    if ((sim.mode != SIM_MODE_CREDIT) || (credit_class == QSPI_CREDIT_CLASS_NONE)) {
+        return;
+    }
+
+    if (sim.ack_loss && ((uint32_t) (rand() % 100) < sim.ack_loss)) {
+        sim.acks_lost++;
+        return;
+    }
+
+    time = (time > sim.lcd_done) ? time : sim.lcd_done;
+    sim.ack_time[credit_class] = time + SIM_ACK;
+}
+
+// Master display and acknowledges up to the time
+static void master_advance(uint64_t time)
+{
+    uint64_t swap;
+    uint8_t packet_type;
+
+    if (sim.frame_pending) {
+        swap = (sim.lcd_done > sim.screen_drew + sim.lcd_interval) ? sim.lcd_done : (sim.screen_drew + sim.lcd_interval);
+        swap = (swap > sim.frame_rx) ? swap : sim.frame_rx;
+        if (swap <= time) {
+            sim.frame_pending = 0;
+            sim.screen_drew = swap;
+            sim.lcd_done = swap + SIM_LCD_TRANSFER;
+            sim.frames_shown++;
+            sim.frame_latency += swap - sim.frame_capture;
+            master_ack(QSPI_PACKET_TYPE_VIDEO_DATA_RES, swap);
+        }
+    }
+
+    for (int i = 0; i < QSPI_CREDIT_CLASS_LAST; i++) {
+        if (sim.ack_time[i] && (sim.ack_time[i] <= time)) {
+            packet_type = (i == QSPI_CREDIT_CLASS_FRAME) ? QSPI_PACKET_TYPE_VIDEO_DATA_RES :
+                          (i == QSPI_CREDIT_CLASS_RESULT) ? QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES :
+                          QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES;
+            qspi_credit_grant(&sim.credit, &packet_type, 1);
+            sim.link_busy += SIM_ACK;
+            sim.ack_time[i] = 0;
+        }
+    }
+}
+
+// Returns 1 if the packet was sent, the master reads it right away
+static int slave_send(uint8_t packet_type, uint64_t transfer, uint64_t capture_end)
+{
+    master_advance(sim.now);
+
+    if ((sim.mode == SIM_MODE_CREDIT) && !qspi_credit_available(&sim.credit, packet_type, MS(sim.now))) {
+        return 0;
+    }
+
+    sim.now += transfer;
+    sim.link_busy += transfer;
+    qspi_credit_use(&sim.credit, packet_type, MS(sim.now));
+
+    switch (packet_type) {
+    case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
+        // Received into the back buffer, a frame not swapped in yet is lost
+        if (sim.frame_pending) {
+            sim.frames_replaced++;
+        }
+        sim.frame_pending = 1;
+        sim.frame_capture = capture_end;
+        sim.frame_rx = sim.now;
+        sim.frames_sent++;
+        break;
+    case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
+        sim.results_sent++;
+        sim.result_latency += sim.now - capture_end;
+        master_ack(packet_type, sim.now);
+        break;
+    default:
+        master_ack(packet_type, sim.now);
+        break;
+    }
+
+    return 1;
+}
+
+static void run(sim_mode_e mode, uint64_t seconds, uint64_t lcd_interval, uint32_t ack_loss)
+{
+    uint64_t end = seconds * 1000000ULL;
+    uint64_t capture_start = 0;
+    uint64_t capture_end;
+    uint64_t frame_capture;
+    uint64_t next_statistics = SIM_STATISTICS_PERIOD;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.mode = mode;
+    sim.lcd_interval = lcd_interval;
+    sim.ack_loss = ack_loss;
+    qspi_credit_init(&sim.credit);
+
+    // Video firmware loop, the next capture runs during the CNN
+    while (sim.now < end) {
+        capture_end = capture_start + SIM_CAPTURE;
+        sim.now = (sim.now > capture_end) ? sim.now : capture_end;
+        frame_capture = capture_end;
+
+        if (slave_send(QSPI_PACKET_TYPE_VIDEO_DATA_RES, SIM_FRAME_TRANSFER, frame_capture)) {
+            if (mode == SIM_MODE_DELAY) {
+                sim.now += SIM_FRAME_DELAY;
+            }
+        } else {
+            sim.frames_skipped++;
+        }
+
+        capture_start = sim.now;
+        sim.now += SIM_CNN;
+
+        if (!slave_send(QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES, SIM_RESULT_TRANSFER, frame_capture)) {
+            sim.results_dropped++;
+        }
+        if (mode == SIM_MODE_DELAY) {
+            sim.now += SIM_RESULT_DELAY;
+        }
+
+        if (sim.now >= next_statistics) {
+            slave_send(QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES, SIM_RESULT_TRANSFER, frame_capture);
+            next_statistics += SIM_STATISTICS_PERIOD;
+        }
+    }
+
+    master_advance(UINT64_MAX);
+
+    printf("%-7s %6u %8.2f %8.2f %8u %8u %9.2f %9.1f %10.1f %7.1f\n", mode_names[mode], MS(lcd_interval),
+           (double) sim.frames_sent / seconds, (double) sim.frames_shown / seconds,
+           sim.frames_replaced, sim.frames_skipped,
+           (double) sim.results_sent / seconds,
+           sim.frames_shown ? (double) sim.frame_latency / sim.frames_shown / 1000 : 0.0,
+           sim.results_sent ? (double) sim.result_latency / sim.results_sent / 1000 : 0.0,
+           (double) sim.link_busy * 100 / sim.now);
+    if (ack_loss) {
+        printf("        %u acknowledges lost, %u results dropped\n", sim.acks_lost, sim.results_dropped);
+    }
+}
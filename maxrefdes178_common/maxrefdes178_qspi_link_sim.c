@@ -0,0 +1,1606 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host emulator of the video QSPI link, the MAX32666 master (max32666_qspi_master.c) and the
+ * MAX78000 video slave (max78000_qspi_slave.c) talk over an emulated wire:
+ *
+ *   gcc -O2 -no-pie -DSPI_TIMEOUT_CNT='host_spin_wait()' -I. -Ihost \
+ *       -I../maxrefdes178-FaceId/maxrefdes178_max32666/include \
+ *       -I../maxrefdes178-FaceId/maxrefdes178_max32666/src \
+ *       -I../maxrefdes178-FaceId/maxrefdes178_max78000_common \
+ *       maxrefdes178_qspi_packet.c maxrefdes178_qspi_credit.c maxrefdes178_video_codec.c \
+ *       maxrefdes178_utility.c maxrefdes178_qspi_link_sim.c -o qspi_link_sim
+ *   ./qspi_link_sim [firmware log]
+ *
+ * Both drivers are built into this file. Each chip runs a mirror of its main loop in a
+ * coroutine on virtual time: qspi_task and display_task of max32666_main.c on the master, the
+ * QSPI receive and send_img of max78000_video_main.c on the slave. A chip runs until it waits, in
+ * MXC_Delay, spi_dma_wait, a driver spin loop or idle until an interrupt. SPI_TIMEOUT_CNT is
+ * host_spin_wait() here, it returns once the loop condition holds or when the loop would have
+ * timed out. Interrupt handlers run as soon as the other chip or the wire drives their line, so
+ * they preempt a main loop only where it waits. -no-pie keeps the buffers below 4 GB, the slave
+ * writes their addresses to its 32-bit DMA registers.
+ *
+ * Wire: master CS, the direction line and the slave INT connect the GPIO stand-ins, the slave CS
+ * interrupt runs 1 us after the edge and reads the level then. The master SPI DMA clocks a byte
+ * every two QSPI clocks. A byte reaches the slave only while CS is low and the slave SPI and its
+ * DMA channel are enabled, the master reads 0xFF otherwise. The slave DMA channel is modelled from
+ * its registers with the count reload; a count above 0xFFFF is an error. The register stand-ins
+ * belong to the slave, the master SPI DMA is the spi_dma stand-in. The LCD refresh takes the LCD
+ * DMA channel for a full frame.
+ *
+ * Phases: clean, bit errors, truncated master transfers, slave CS interrupt 10 to 40 us late and
+ * lost INT edges, each fault phase is followed by a clean one. Every packet the master accepts
+ * must be one the slave sent, in order, and every TEST command the slave accepts one the master
+ * sent. Classification and statistics on the master must only change with an accepted packet. The
+ * clean phase must lose nothing with no error on either side. Faults must be detected
+ * and the link must carry frames without errors again within half of the next clean phase.
+ *
+ * Benchmark: frames per second and, per packet type, link time and header overhead at 7, 10 and
+ * 12 MHz QSPI clock with raw and compressed frames. Capture takes 1 ms and the CNN none, the link,
+ * the LCD and the credits bound the frame rate. Firmware log output goes to the given file,
+ * /dev/null by default.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <mxc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include "max32666_data.h"
+#include "max32666_lcd.h"
+#include "max32666_qspi_master.h"
+#include "max32666_spi_dma.h"
+#include "max32666_timer_led_button.h"
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+#include "maxrefdes178_qspi_packet.h"
+#include "maxrefdes178_utility.h"
+#include "maxrefdes178_video_codec.h"
+
+// Slave driver, its DMA handler is renamed, the master one keeps DMA1_IRQHandler
+#define MAXREFDES178_MAX78000_VIDEO
+#define DMA1_IRQHandler     slave_dma1_irq_handler
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#include "max78000_qspi_slave.c"
+#pragma GCC diagnostic pop
+#undef DMA1_IRQHandler
+#undef S_MODULE_NAME
+#undef PR_DEBUG
+#undef PR_INFO
+#undef PR_WARN
+#undef PR_ERROR
+
+// Master driver, uint32_t is unsigned long on the MAX32666 which its formats expect
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat"
+#pragma GCC diagnostic ignored "-Wsign-compare"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#include "max32666_qspi_master.c"
+#pragma GCC diagnostic pop
+#undef S_MODULE_NAME
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define MS(ms)                      ((uint64_t) (ms) * 1000000)
+#define US(us)                      ((uint64_t) (us) * 1000)
+#define NEVER                       UINT64_MAX
+
+#define SIM_STACK_SIZE              (256 * 1024)
+#define SIM_SPIN_LOOPS              1000000   // SPI_TIMEOUT_CNT of the firmware
+#define SIM_SPIN_NS                 40        // One spin loop iteration
+#define SIM_CS_LATENCY              US(1)     // CS edge to slave CS interrupt
+#define SIM_MASTER_CPU              US(5)     // Master code between two transfers of its main loop
+#define SIM_LATE_CS_MIN             US(10)
+#define SIM_LATE_CS_MAX             US(40)
+#define SIM_LCD_REFRESH             ((uint64_t) LCD_DATA_SIZE * 8 * 1000000000 / MAX32666_LCD_SPI_SPEED)
+#define SIM_CAPTURE                 MS(40)
+#define SIM_CNN                     MS(30)
+#define SIM_BENCH_CAPTURE           MS(1)
+#define SIM_BENCH_TIME              MS(3000)
+#define SIM_SETTLE_TIME             MS(1000)  // Link drains, credits come back
+#define SIM_TEST_INTERVAL           MS(50)    // Master TEST commands
+#define SIM_COMMAND_BUFFER_SIZE     16        // qspi_command_buffer of the video firmware
+#define SIM_COMPRESSION_MAX_SIZE    (LCD_DATA_SIZE / 2)  // VIDEO_COMPRESSION_MAX_SIZE
+#define SIM_NOISE_FRAME             4         // Every Nth frame does not compress
+#define SIM_PACKETS_MAX             65536
+#define SIM_DMA_COUNT_MAX           0xFFFF
+#define SIM_RECOVERY_FRAMES         5         // Frames in the error free half of a clean phase
+
+// Fault probabilities, parts per billion so bit errors fit
+#define PPB                         1000000000ULL
+#define PERCENT                     (PPB / 100)
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    CHIP_RUN = 0,
+    CHIP_SPIN,   // Driver spin loop, until ready() or the loop times out
+    CHIP_IDLE,   // Until an interrupt or the wake time
+    CHIP_BUSY,   // Until the time, interrupts still run
+} chip_state_e;
+
+typedef struct {
+    const char *name;
+    ucontext_t context;
+    chip_state_e state;
+    uint64_t until;
+    int (*ready)(void);
+    int irq;     // Interrupt ran since the chip went idle
+} chip_t;
+
+typedef enum {
+    EVENT_SLAVE_CS = 0,  // Slave CS interrupt
+    EVENT_CS_TIMER,      // Master payload CS settle timer
+    EVENT_QSPI_DMA,      // Master QSPI DMA done
+    EVENT_LCD_DMA,       // Master LCD DMA done
+    EVENT_LAST
+} event_e;
+
+typedef struct {
+    int active;
+    uint64_t start;
+    uint32_t size;
+    uint32_t len;        // Bytes clocked before the DMA completes, less than size if truncated
+    uint32_t pos;
+    uint8_t *out;
+    uint8_t *in;
+} transfer_t;
+
+typedef struct {
+    const char *name;
+    uint64_t duration;
+    uint64_t bit_error;  // ppb of the bits
+    uint64_t truncate;   // ppb of the master transfers
+    uint64_t late_cs;    // ppb of the CS edges
+    uint64_t lost_int;   // ppb of the INT edges
+} phase_t;
+
+typedef struct {
+    uint32_t frames;          // Frames the master accepted
+    uint32_t shown;
+    uint32_t commands;        // TEST commands the slave accepted
+    uint32_t master_errors;   // Receive errors on the master
+    uint32_t slave_errors;    // Failed sends and receives on the slave
+    uint32_t slave_busy;      // Sends refused while a receive was running
+    uint32_t lost;            // Sent without error but never accepted
+    uint32_t mismatched;      // Accepted but never sent or out of order
+    uint32_t faults;          // Faults injected
+    uint32_t chunk_errors;    // Slave DMA count above 0xFFFF
+    uint32_t overlaps;        // Master DMA started on a busy channel
+    uint32_t settled_frames;  // Frames in the second half of the phase
+    uint32_t torn;            // Results changed on the master without an accepted packet
+    uint64_t start;
+    uint64_t last_error;
+} counters_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t phase;
+    int ret;                  // 1 until the send returned
+    uint64_t hash;
+} packet_t;
+
+// Packets in the order they were sent, the receiver matches what it accepts
+typedef struct {
+    packet_t packets[SIM_PACKETS_MAX];
+    int count;
+    int matched;              // Next packet an accepted one may match
+} packet_log_t;
+
+typedef struct {
+    uint32_t packets;
+    uint64_t payload;
+    uint64_t time;            // First CS fall to last CS rise
+} link_stat_t;
+
+typedef struct {
+    uint64_t now;
+    uint64_t events[EVENT_LAST];
+    uint64_t byte_time;
+    uint32_t prng;
+
+    // Faults
+    const phase_t *phase;
+    int phase_index;
+
+    // Wire
+    transfer_t transfer;
+    uint8_t dma_busy[MXC_DMA_CHANNELS];
+    void (*dma_callback[MXC_DMA_CHANNELS])(void);
+    int wait_channel;
+    uint64_t cs_timer;
+    void (*cs_timer_vector)(void);
+    mxc_gpio_callback_fn slave_cs_callback;
+    mxc_gpio_callback_fn master_int_callback;
+    void *master_int_cbdata;
+    uint32_t master_ints;
+    uint32_t master_ints_seen;
+
+    // Slave
+    uint64_t camera_ready;
+    int camera_enabled;
+    uint64_t capture;
+    uint64_t cnn;
+    int noise_frames;
+    uint32_t images;          // Frames the camera handed to send_img
+    int compression;
+    int sending;
+    uint32_t send_size;
+    int send_triggers;
+
+    // Master
+    uint64_t test_time;
+    uint32_t test_seq;
+    int compression_request;
+    int compression_sent;
+    classification_result_t classification;  // Last accepted results
+    max78000_statistics_t statistics;
+
+    // Checks and benchmark
+    int link_stats;
+    packet_log_t to_master;
+    packet_log_t to_slave;
+    counters_t counters[16];
+    link_stat_t link[256];
+    int wire_type;
+    uint32_t wire_payload;    // Payload of the last header, next CS frame carries it
+    uint64_t packet_start;
+} sim_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+lcd_data_t lcd_data;
+device_status_t device_status;
+volatile device_settings_t device_settings;
+device_info_t device_info;
+timestamps_t timestamps;
+volatile uint32_t timer_ms_tick;
+
+mxc_gpio_regs_t host_gpio0;
+mxc_gpio_regs_t host_gpio1;
+mxc_spi_regs_t host_spi0;
+mxc_spi_regs_t host_spi1;
+mxc_dma_regs_t host_dma;
+mxc_tmr_regs_t host_tmr4;
+SCB_Type host_scb;
+uint32_t __isr_vector_core1;
+
+static const mxc_gpio_cfg_t master_cs_pin   = MAX32666_VIDEO_CS_PIN;
+static const mxc_gpio_cfg_t master_rw_pin   = MAX32666_VIDEO_IO_PIN;
+static const mxc_gpio_cfg_t master_int_pin  = MAX32666_VIDEO_INT_PIN;
+static const mxc_gpio_cfg_t slave_cs_pin    = MAX78000_VIDEO_HOST_CS_PIN;
+static const mxc_gpio_cfg_t slave_rw_pin    = MAX78000_VIDEO_HOST_IO_PIN;
+static const mxc_gpio_cfg_t slave_int_pin   = MAX78000_VIDEO_HOST_INT_PIN;
+
+static const phase_t phases[] = {
+    {"clean",         MS(3000), 0,   0,             0,              0},
+    {"bit errors",    MS(2000), 5000,0,             0,              0},
+    {"recovery",      MS(2000), 0,   0,             0,              0},
+    {"truncated",     MS(2000), 0,   5 * PERCENT,   0,              0},
+    {"recovery",      MS(2000), 0,   0,             0,              0},
+    {"late CS",       MS(2000), 0,   0,             20 * PERCENT,   0},
+    {"recovery",      MS(2000), 0,   0,             0,              0},
+    {"lost INT",      MS(2000), 0,   0,             0,              5 * PERCENT},
+    {"recovery",      MS(2000), 0,   0,             0,              0},
+};
+
+static const phase_t bench_phase = {"bench", SIM_BENCH_TIME, 0, 0, 0, 0};
+static const uint32_t bench_clocks[] = {7000000, 10000000, 12000000};
+
+static sim_t sim;
+static FILE *report;
+static chip_t master_chip = {.name = "master"};
+static chip_t slave_chip = {.name = "slave"};
+static chip_t *chip;  // Running chip, NULL in the scheduler
+static ucontext_t scheduler_context;
+static uint8_t master_stack[SIM_STACK_SIZE];
+static uint8_t slave_stack[SIM_STACK_SIZE];
+
+// Slave buffers, their addresses go to the DMA registers
+static uint8_t slave_frame[LCD_DATA_SIZE];  // Camera buffer, large QSPI payloads too
+static uint8_t slave_command_buffer[SIM_COMMAND_BUFFER_SIZE];
+static classification_result_t slave_classification;
+static max78000_statistics_t slave_statistics;
+static qspi_credit_t slave_credit;
+
+static uint8_t master_test[1024];
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void chip_init(chip_t *c, uint8_t *stack, void (*main_loop)(void));
+static void sim_run(uint64_t duration);
+static int chip_wait(chip_state_e state, uint64_t until, int (*ready)(void));
+static void wire_run(uint64_t time);
+static void transfer_done(void);
+static void master_main(void);
+static void slave_main(void);
+static const char *packet_name(int type);
+static int phase_check(int index);
+static int bench_run(uint32_t clock, int compression, int print);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    char clock[16];
+    int errors = 0;
+    int i;
+
+    // Keep the report on stdout, the firmware PR_* output goes to the log
+    report = fdopen(dup(STDOUT_FILENO), "w");
+    if (!report || !freopen((argc > 1) ? argv[1] : "/dev/null", "w", stdout)) {
+        fprintf(stderr, "cannot open firmware log\n");
+        return 1;
+    }
+    setvbuf(report, NULL, _IOLBF, 0);
+
+    if (((uintptr_t) slave_frame > UINT32_MAX) || ((uintptr_t) &g_qspi_packet_header_tx > UINT32_MAX)) {
+        fprintf(report, "FAIL: buffers above 4 GB, build with -no-pie\n");
+        return 1;
+    }
+
+    for (i = 0; i < EVENT_LAST; i++) {
+        sim.events[i] = NEVER;
+    }
+    sim.prng = 0x2545F491;
+    sim.byte_time = 2 * 1000000000ULL / QSPI_SPEED;
+    sim.capture = SIM_CAPTURE;
+    sim.cnn = SIM_CNN;
+    sim.noise_frames = 1;
+    sim.camera_enabled = 1;
+    sim.compression = 1;
+    sim.compression_request = 1;
+    sim.compression_sent = 1;
+    device_settings.enable_max78000_video = 1;
+
+    // Lines idle high
+    host_gpio0.out = master_cs_pin.mask | master_rw_pin.mask | slave_int_pin.mask;
+    host_gpio0.in = slave_cs_pin.mask | master_int_pin.mask;
+    host_gpio1.in = slave_rw_pin.mask;
+
+    chip_init(&master_chip, master_stack, master_main);
+    chip_init(&slave_chip, slave_stack, slave_main);
+
+    fprintf(report, "phase          frames  shown  commands  faults  master err  slave err  busy  lost\n");
+    for (i = 0; i < (int) (sizeof(phases) / sizeof(phases[0])); i++) {
+        sim.phase = &phases[i];
+        sim.phase_index = i;
+        sim.counters[i].start = sim.now;
+        sim_run(phases[i].duration);
+        errors += phase_check(i);
+    }
+    fprintf(report, "qspi link check: %s\n", errors ? "FAILED" : "passed");
+
+    fprintf(report, "\nQSPI link benchmark, capture %llu ms, no CNN, LCD refresh %.1f ms\n",
+            (unsigned long long) (SIM_BENCH_CAPTURE / MS(1)), (double) SIM_LCD_REFRESH / MS(1));
+    fprintf(report, "clock  %-10s %6s %9s %10s\n", "frames", "received", "fps rx", "fps shown");
+    sim.noise_frames = 0;
+    sim.capture = SIM_BENCH_CAPTURE;
+    sim.cnn = 0;
+    memset(sim.link, 0, sizeof(sim.link));
+    for (i = 0; i < (int) (sizeof(bench_clocks) / sizeof(bench_clocks[0])); i++) {
+        errors += bench_run(bench_clocks[i], 0, bench_clocks[i] == QSPI_SPEED);
+        errors += bench_run(bench_clocks[i], 1, bench_clocks[i] == QSPI_SPEED);
+    }
+
+    snprintf(clock, sizeof(clock), "at %lu MHz", QSPI_SPEED / 1000000);
+    fprintf(report, "\n%-19s %7s  %9s  %8s  %7s  %16s\n", clock, "packets", "payload B", "header B", "link us",
+            "header+handshake");
+    for (i = 0; i < 256; i++) {
+        link_stat_t *link = &sim.link[i];
+        double payload_time;
+
+        if (!link->packets) {
+            continue;
+        }
+        payload_time = (double) link->payload * 1000000000ULL / (QSPI_SPEED / 2);
+        fprintf(report, "%-19s %7u  %9.0f  %8d  %7.1f  %15.1f%%\n", packet_name(i), link->packets,
+                (double) link->payload / link->packets, (int) QSPI_PACKET_OVERHEAD_SIZE,
+                (double) link->time / link->packets / US(1), 100.0 * (1.0 - payload_time / link->time));
+    }
+
+    return errors ? 1 : 0;
+}
+
+static uint32_t prng_next(void)
+{
+    // xorshift32
+    sim.prng ^= sim.prng << 13;
+    sim.prng ^= sim.prng >> 17;
+    sim.prng ^= sim.prng << 5;
+
+    return sim.prng;
+}
+
+static int fault(uint64_t ppb)
+{
+    return ppb && ((prng_next() % PPB) < ppb);
+}
+
+static uint64_t hash64(const void *data, uint32_t size)
+{
+    const uint8_t *bytes = data;
+    uint64_t hash = 0xCBF29CE484222325ULL;  // FNV-1a
+
+    for (uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static counters_t *phase_counters(void)
+{
+    return &sim.counters[sim.phase_index];
+}
+
+static void master_error(void)
+{
+    phase_counters()->master_errors++;
+    phase_counters()->last_error = sim.now;
+}
+
+static void slave_error(void)
+{
+    phase_counters()->slave_errors++;
+    phase_counters()->last_error = sim.now;
+}
+
+static const char *packet_name(int type)
+{
+    static char name[16];
+
+    switch (type) {
+    case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
+        return "frame";
+    case QSPI_PACKET_TYPE_VIDEO_COMPRESSED_DATA_RES:
+        return "compressed frame";
+    case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
+        return "classification";
+    case QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES:
+        return "statistics";
+    case QSPI_PACKET_TYPE_ACKNOWLEDGE:
+        return "acknowledge";
+    case QSPI_PACKET_TYPE_TEST:
+        return "test";
+    case QSPI_PACKET_TYPE_VIDEO_ENABLE_COMPRESSION_CMD:
+        return "compression on";
+    case QSPI_PACKET_TYPE_VIDEO_DISABLE_COMPRESSION_CMD:
+        return "compression off";
+    default:
+        snprintf(name, sizeof(name), "type %d", type);
+        return name;
+    }
+}
+
+static packet_t *log_add(packet_log_t *log, uint8_t type, uint64_t hash)
+{
+    static packet_t overflow;
+    packet_t *packet = &overflow;
+
+    if (log->count < SIM_PACKETS_MAX) {
+        packet = &log->packets[log->count++];
+    } else {
+        phase_counters()->mismatched++;
+    }
+    packet->type = type;
+    packet->phase = sim.phase_index;
+    packet->ret = 1;
+    packet->hash = hash;
+
+    return packet;
+}
+
+// Accepted packet must be the next sent one, the packets it skips were lost
+static void log_match(packet_log_t *log, uint8_t type, uint64_t hash)
+{
+    int i;
+
+    for (i = log->matched; i < log->count; i++) {
+        if ((log->packets[i].type == type) && (log->packets[i].hash == hash)) {
+            break;
+        }
+    }
+    if (i == log->count) {
+        phase_counters()->mismatched++;
+        phase_counters()->last_error = sim.now;
+        return;
+    }
+
+    for (; log->matched < i; log->matched++) {
+        if (log->packets[log->matched].ret == E_NO_ERROR) {
+            sim.counters[log->packets[log->matched].phase].lost++;
+        }
+    }
+    log->matched = i + 1;
+}
+
+
+// Scheduler
+static void time_set(uint64_t time)
+{
+    sim.now = time;
+    timer_ms_tick = (uint32_t) (time / MS(1));
+}
+
+static void chip_init(chip_t *c, uint8_t *stack, void (*main_loop)(void))
+{
+    getcontext(&c->context);
+    c->context.uc_stack.ss_sp = stack;
+    c->context.uc_stack.ss_size = SIM_STACK_SIZE;
+    makecontext(&c->context, main_loop, 0);
+}
+
+static int chip_runnable(const chip_t *c)
+{
+    switch (c->state) {
+    case CHIP_SPIN:
+        return c->ready() || (sim.now >= c->until);
+    case CHIP_IDLE:
+        return c->irq || (sim.now >= c->until);
+    case CHIP_BUSY:
+        return sim.now >= c->until;
+    default:
+        return 1;
+    }
+}
+
+static void chip_resume(chip_t *c)
+{
+    chip = c;
+    c->state = CHIP_RUN;
+    swapcontext(&scheduler_context, &c->context);
+    chip = NULL;
+}
+
+// Returns 1 if ready() holds, 0 if the wait ran out or an interrupt ended the idle wait
+static int chip_wait(chip_state_e state, uint64_t until, int (*ready)(void))
+{
+    chip_t *c = chip;
+
+    if (!c) {
+        fprintf(report, "FAIL: wait outside of a chip\n");
+        exit(1);
+    }
+    if (ready && ready()) {
+        return 1;
+    }
+    if ((state == CHIP_IDLE) && c->irq) {
+        c->irq = 0;
+        return 0;
+    }
+
+    c->state = state;
+    c->until = until;
+    c->ready = ready;
+    swapcontext(&c->context, &scheduler_context);
+    if (state == CHIP_IDLE) {
+        c->irq = 0;
+    }
+
+    return ready ? ready() : 0;
+}
+
+static void event_fire(int event)
+{
+    sim.events[event] = NEVER;
+
+    switch (event) {
+    case EVENT_SLAVE_CS:
+        slave_chip.irq = 1;
+        if (sim.slave_cs_callback) {
+            sim.slave_cs_callback(NULL);
+        }
+        break;
+    case EVENT_CS_TIMER:
+        master_chip.irq = 1;
+        if (sim.cs_timer_vector) {
+            sim.cs_timer_vector();
+        }
+        break;
+    case EVENT_QSPI_DMA:
+        wire_run(sim.now);
+        transfer_done();
+        master_chip.irq = 1;
+        MAX32666_QSPI_DMA_IRQ_HAND();
+        break;
+    case EVENT_LCD_DMA:
+        master_chip.irq = 1;
+        spi_dma_int_handler(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI);
+        break;
+    default:
+        break;
+    }
+}
+
+static void sim_run(uint64_t duration)
+{
+    uint64_t end = sim.now + duration;
+
+    while (1) {
+        uint64_t next = end;
+        int event = EVENT_LAST;
+
+        // Master first, it runs the interrupts of both sides it starts
+        if (chip_runnable(&master_chip)) {
+            chip_resume(&master_chip);
+            continue;
+        }
+        if (chip_runnable(&slave_chip)) {
+            chip_resume(&slave_chip);
+            continue;
+        }
+
+        for (int i = 0; i < EVENT_LAST; i++) {
+            if (sim.events[i] < next) {
+                next = sim.events[i];
+                event = i;
+            }
+        }
+        if (master_chip.until < next) {
+            next = master_chip.until;
+            event = EVENT_LAST;
+        }
+        if (slave_chip.until < next) {
+            next = slave_chip.until;
+            event = EVENT_LAST;
+        }
+
+        time_set(next);
+        if (event != EVENT_LAST) {
+            event_fire(event);
+        } else if (next == end) {
+            return;
+        }
+    }
+}
+
+
+// Wire
+static uint8_t wire_bit_errors(uint8_t byte)
+{
+    if (fault(sim.phase->bit_error * 8)) {
+        byte ^= 1 << (prng_next() % 8);
+        phase_counters()->faults++;
+    }
+
+    return byte;
+}
+
+static mxc_dma_ch_regs_t *slave_dma_channel(uint32_t request, uint32_t spi_dma_enable)
+{
+    mxc_dma_ch_regs_t *ch = &MXC_DMA->ch[MAX78000_VIDEO_QSPI_DMA_CHANNEL];
+
+    if (!(MXC_SPI0->ctrl0 & MXC_F_SPI_CTRL0_EN) || !(MXC_SPI0->dma & spi_dma_enable) ||
+        !(ch->ctrl & MXC_F_DMA_CTRL_EN) || ((ch->ctrl & MXC_F_DMA_CTRL_REQUEST) != request)) {
+        return NULL;
+    }
+
+    if (ch->cnt > SIM_DMA_COUNT_MAX) {
+        phase_counters()->chunk_errors++;
+        ch->cnt = SIM_DMA_COUNT_MAX;
+    }
+
+    return ch;
+}
+
+static void slave_dma_count_to_zero(mxc_dma_ch_regs_t *ch)
+{
+    uint32_t channel = 1 << MAX78000_VIDEO_QSPI_DMA_CHANNEL;
+
+    if (ch->ctrl & MXC_F_DMA_CTRL_RLDEN) {
+        ch->cnt = ch->cntrld;
+        ch->src = ch->srcrld;
+        ch->dst = ch->dstrld;
+        ch->ctrl &= ~MXC_F_DMA_CTRL_RLDEN;
+        ch->status |= MXC_F_DMA_STATUS_RLD_IF;
+    } else {
+        ch->ctrl &= ~MXC_F_DMA_CTRL_EN;
+        ch->status |= MXC_F_DMA_STATUS_CTZ_IF;
+    }
+
+    if ((ch->ctrl & MXC_F_DMA_CTRL_CTZ_IE) && (MXC_DMA->inten & channel)) {
+        MXC_DMA->intfl |= channel;
+        slave_chip.irq = 1;
+        slave_dma1_irq_handler();
+        // Write one to clear on the chip
+        ch->status = 0;
+        MXC_DMA->intfl &= ~channel;
+    }
+}
+
+static void slave_spi_rx(uint8_t byte)
+{
+    mxc_dma_ch_regs_t *ch = slave_dma_channel(MXC_S_DMA_CTRL_REQUEST_SPI0RX, MXC_F_SPI_DMA_DMA_RX_EN);
+
+    if (!ch) {
+        return;
+    }
+
+    *(uint8_t *) (uintptr_t) ch->dst = byte;
+    ch->dst++;
+    if (--ch->cnt == 0) {
+        slave_dma_count_to_zero(ch);
+    }
+}
+
+static uint8_t slave_spi_tx(void)
+{
+    mxc_dma_ch_regs_t *ch = slave_dma_channel(MXC_S_DMA_CTRL_REQUEST_SPI0TX, MXC_F_SPI_DMA_DMA_TX_EN);
+    uint8_t byte;
+
+    if (!ch) {
+        return 0xFF;
+    }
+
+    byte = *(uint8_t *) (uintptr_t) ch->src;
+    ch->src++;
+    if (--ch->cnt == 0) {
+        slave_dma_count_to_zero(ch);
+    }
+
+    return byte;
+}
+
+// Clocks the master transfer up to the time, a byte reaches the slave only while CS is low
+static void wire_run(uint64_t time)
+{
+    transfer_t *t = &sim.transfer;
+    uint64_t count;
+
+    if (!t->active) {
+        return;
+    }
+
+    count = (time - t->start) / sim.byte_time;
+    if (count > t->len) {
+        count = t->len;
+    }
+
+    for (; t->pos < count; t->pos++) {
+        int selected = !(MXC_GPIO0->out & master_cs_pin.mask);
+
+        if (t->out) {
+            uint8_t byte = wire_bit_errors(t->out[t->pos]);
+
+            if (selected) {
+                slave_spi_rx(byte);
+            }
+        } else {
+            t->in[t->pos] = wire_bit_errors(selected ? slave_spi_tx() : 0xFF);
+        }
+    }
+}
+
+// Benchmark, a header CS frame names the packet, the next CS frame carries its payload
+static void transfer_done(void)
+{
+    transfer_t *t = &sim.transfer;
+    qspi_packet_header_t header;
+
+    t->active = 0;
+    if (!sim.link_stats) {
+        return;
+    }
+
+    if (sim.wire_payload && (t->size == sim.wire_payload)) {
+        sim.wire_payload = 0;
+    } else if (t->size == sizeof(header)) {
+        memcpy(&header, t->out ? t->out : t->in, sizeof(header));
+        if (qspi_packet_check_header(&header) == QSPI_PACKET_STATUS_OK) {
+            sim.wire_type = header.info.packet_type;
+            sim.wire_payload = header.info.packet_size;
+            sim.link[sim.wire_type].packets++;
+            sim.link[sim.wire_type].payload += header.info.packet_size;
+        }
+    }
+}
+
+static void slave_cs_edge(void)
+{
+    uint64_t latency = SIM_CS_LATENCY;
+
+    // A pending interrupt reads the level when it runs
+    if (sim.events[EVENT_SLAVE_CS] != NEVER) {
+        return;
+    }
+
+    if (fault(sim.phase->late_cs)) {
+        latency = SIM_LATE_CS_MIN + prng_next() % (SIM_LATE_CS_MAX - SIM_LATE_CS_MIN);
+        phase_counters()->faults++;
+    }
+    sim.events[EVENT_SLAVE_CS] = sim.now + latency;
+}
+
+static void gpio_write(mxc_gpio_regs_t *port, uint32_t mask, int level)
+{
+    uint32_t changed;
+
+    // Bytes clocked so far saw the old levels
+    wire_run(sim.now);
+
+    changed = (level ? ~port->out : port->out) & mask;
+    if (level) {
+        port->out |= mask;
+    } else {
+        port->out &= ~mask;
+    }
+    if (port != MXC_GPIO0) {
+        return;
+    }
+
+    if (changed & master_cs_pin.mask) {
+        if (level) {
+            MXC_GPIO0->in |= slave_cs_pin.mask;
+            if (sim.link_stats && !sim.wire_payload) {
+                sim.link[sim.wire_type].time += sim.now - sim.packet_start;
+            }
+        } else {
+            MXC_GPIO0->in &= ~slave_cs_pin.mask;
+            if (!sim.wire_payload) {
+                sim.packet_start = sim.now;
+            }
+        }
+        slave_cs_edge();
+    }
+
+    if (changed & master_rw_pin.mask) {
+        if (level) {
+            MXC_GPIO1->in |= slave_rw_pin.mask;
+        } else {
+            MXC_GPIO1->in &= ~slave_rw_pin.mask;
+        }
+    }
+
+    if (changed & slave_int_pin.mask) {
+        if (level) {
+            MXC_GPIO0->in |= master_int_pin.mask;
+        } else {
+            MXC_GPIO0->in &= ~master_int_pin.mask;
+            if (sim.sending) {
+                sim.send_triggers++;
+            }
+            if (fault(sim.phase->lost_int)) {
+                phase_counters()->faults++;
+            } else if (sim.master_int_callback) {
+                master_chip.irq = 1;
+                sim.master_ints++;
+                sim.master_int_callback(sim.master_int_cbdata);
+            }
+        }
+    }
+}
+
+
+// SDK and firmware stand-ins
+void MXC_Delay(uint32_t us)
+{
+    if (chip) {
+        chip_wait(CHIP_BUSY, sim.now + US(us), NULL);
+    }
+}
+
+int MXC_GPIO_Config(const mxc_gpio_cfg_t *cfg)
+{
+    (void) cfg;
+    return E_NO_ERROR;
+}
+
+void MXC_GPIO_OutSet(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    gpio_write(port, mask, 1);
+}
+
+void MXC_GPIO_OutClr(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    gpio_write(port, mask, 0);
+}
+
+uint32_t MXC_GPIO_InGet(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    return port->in & mask;
+}
+
+void MXC_GPIO_RegisterCallback(const mxc_gpio_cfg_t *cfg, mxc_gpio_callback_fn callback, void *cbdata)
+{
+    if ((cfg->port == slave_cs_pin.port) && (cfg->mask == slave_cs_pin.mask)) {
+        sim.slave_cs_callback = callback;
+    } else if ((cfg->port == master_int_pin.port) && (cfg->mask == master_int_pin.mask)) {
+        sim.master_int_callback = callback;
+        sim.master_int_cbdata = cbdata;
+    }
+}
+
+int MXC_GPIO_IntConfig(const mxc_gpio_cfg_t *cfg, mxc_gpio_int_pol_t pol)
+{
+    (void) cfg;
+    (void) pol;
+    return E_NO_ERROR;
+}
+
+void MXC_GPIO_EnableInt(mxc_gpio_regs_t *port, uint32_t mask)
+{
+    (void) port;
+    (void) mask;
+}
+
+void NVIC_EnableIRQ(IRQn_Type irqn)
+{
+    (void) irqn;
+}
+
+void NVIC_SetVector(IRQn_Type irqn, void (*irq_callback)(void))
+{
+    if (irqn == MXC_TMR_GET_IRQ(MXC_TMR_GET_IDX(MAX32666_TIMER_QSPI_CS))) {
+        sim.cs_timer_vector = irq_callback;
+    }
+}
+
+int MXC_SPI_Init(mxc_spi_regs_t *spi, int masterMode, int quadModeUsed, int numSlaves, unsigned ssPolarity,
+        unsigned int hz, mxc_spi_pins_t pins)
+{
+    (void) spi;
+    (void) masterMode;
+    (void) quadModeUsed;
+    (void) numSlaves;
+    (void) ssPolarity;
+    (void) hz;
+    (void) pins;
+    return E_NO_ERROR;
+}
+
+int MXC_SPI_SetWidth(mxc_spi_regs_t *spi, mxc_spi_width_t spiWidth)
+{
+    (void) spi;
+    (void) spiWidth;
+    return E_NO_ERROR;
+}
+
+int MXC_TMR_Init(mxc_tmr_regs_t *tmr, mxc_tmr_cfg_t *cfg)
+{
+    (void) tmr;
+    sim.cs_timer = (uint64_t) cfg->cmp_cnt * 1000000000ULL / PeripheralClock;
+    return E_NO_ERROR;
+}
+
+void MXC_TMR_Shutdown(mxc_tmr_regs_t *tmr)
+{
+    (void) tmr;
+    sim.events[EVENT_CS_TIMER] = NEVER;
+}
+
+void MXC_TMR_Start(mxc_tmr_regs_t *tmr)
+{
+    (void) tmr;
+    sim.events[EVENT_CS_TIMER] = sim.now + sim.cs_timer;
+}
+
+void MXC_TMR_Stop(mxc_tmr_regs_t *tmr)
+{
+    (void) tmr;
+    sim.events[EVENT_CS_TIMER] = NEVER;
+}
+
+void MXC_TMR_SetCount(mxc_tmr_regs_t *tmr, uint32_t cnt)
+{
+    (void) tmr;
+    (void) cnt;
+}
+
+void MXC_TMR_ClearFlags(mxc_tmr_regs_t *tmr)
+{
+    (void) tmr;
+}
+
+int MXC_SEMA_GetSema(unsigned sema)
+{
+    (void) sema;
+    return E_NO_ERROR;
+}
+
+void MXC_SEMA_FreeSema(unsigned sema)
+{
+    (void) sema;
+}
+
+void scheduler_post(uint32_t events)
+{
+    (void) events;
+    master_chip.irq = 1;
+}
+
+uint8_t *lcd_get_back_buffer(void)
+{
+    lcd_data.frame_pending = 0;
+    return lcd_data.back_buffer;
+}
+
+int lcd_notification(uint16_t color, const char *notification)
+{
+    (void) color;
+    (void) notification;
+    return E_NO_ERROR;
+}
+
+int spi_dma_master_init(mxc_spi_regs_t *spi, sys_map_t map, uint32_t speed, uint8_t quad)
+{
+    (void) spi;
+    (void) map;
+    (void) speed;
+    (void) quad;
+    return E_NO_ERROR;
+}
+
+int spi_dma(uint8_t ch, mxc_spi_regs_t *spi, uint8_t *data_out, uint8_t *data_in, uint32_t len,
+        mxc_dma_reqsel_t reqsel, void (*callback)(void))
+{
+    transfer_t *t = &sim.transfer;
+
+    (void) spi;
+    (void) reqsel;
+
+    if (sim.dma_busy[ch]) {
+        phase_counters()->overlaps++;
+    }
+    sim.dma_busy[ch] = 1;
+    sim.dma_callback[ch] = callback;
+
+    if (ch == MAX32666_LCD_DMA_CHANNEL) {
+        sim.events[EVENT_LCD_DMA] = sim.now + (uint64_t) len * SIM_LCD_REFRESH / LCD_DATA_SIZE;
+        return E_NO_ERROR;
+    }
+
+    wire_run(sim.now);
+    t->active = 1;
+    t->start = sim.now;
+    t->size = len;
+    t->len = len;
+    t->pos = 0;
+    t->out = data_out;
+    t->in = data_in;
+    if ((len > 1) && fault(sim.phase->truncate)) {
+        t->len = prng_next() % len;
+        phase_counters()->faults++;
+    }
+    sim.events[EVENT_QSPI_DMA] = sim.now + t->len * sim.byte_time;
+
+    return E_NO_ERROR;
+}
+
+void spi_dma_int_handler(uint8_t ch, mxc_spi_regs_t *spi)
+{
+    void (*callback)(void) = sim.dma_callback[ch];
+
+    (void) spi;
+    sim.dma_busy[ch] = 0;
+    sim.dma_callback[ch] = NULL;
+    if (callback) {
+        callback();
+    }
+}
+
+static int dma_idle(void)
+{
+    return !sim.dma_busy[sim.wait_channel];
+}
+
+int spi_dma_wait(uint8_t ch, mxc_spi_regs_t *spi)
+{
+    (void) spi;
+
+    sim.wait_channel = ch;
+    if (!chip_wait(CHIP_SPIN, sim.now + SIM_SPIN_LOOPS * SIM_SPIN_NS, dma_idle)) {
+        return E_TIME_OUT;
+    }
+
+    return E_NO_ERROR;
+}
+
+uint8_t spi_dma_busy_flag(uint8_t ch)
+{
+    return sim.dma_busy[ch];
+}
+
+void spi_dma_abort(uint8_t ch, mxc_spi_regs_t *spi)
+{
+    (void) spi;
+
+    if (ch == MAX32666_QSPI_DMA_CHANNEL) {
+        wire_run(sim.now);
+        sim.transfer.active = 0;
+        sim.events[EVENT_QSPI_DMA] = NEVER;
+    }
+    sim.dma_busy[ch] = 0;
+    sim.dma_callback[ch] = NULL;
+}
+
+static int master_int_ready(void)
+{
+    return sim.master_ints != sim.master_ints_seen;
+}
+
+static int slave_rx_ready(void)
+{
+    return (g_qspi_state_rx == QSPI_STATE_COMPLETED) || (g_qspi_state_rx == QSPI_STATE_IDLE);
+}
+
+// qspi_slave_send_packet waits for the deasserted header after the first trigger of a packet
+// with payload, for completion otherwise
+static int slave_tx_ready(void)
+{
+    if ((sim.send_triggers == 1) && sim.send_size) {
+        return g_qspi_state_tx == QSPI_STATE_CS_DEASSERTED_HEADER;
+    }
+
+    return g_qspi_state_tx == QSPI_STATE_COMPLETED;
+}
+
+// SPI_TIMEOUT_CNT of the drivers, waits for the condition of the spin loop it starts
+uint32_t host_spin_wait(void)
+{
+    uint64_t loops = SIM_SPIN_LOOPS;
+    int (*ready)(void) = slave_rx_ready;
+
+    if (chip == &master_chip) {
+        sim.master_ints_seen = sim.master_ints;
+        ready = master_int_ready;
+    } else if (sim.sending) {
+        loops *= 10;
+        ready = slave_tx_ready;
+    }
+
+    return chip_wait(CHIP_SPIN, sim.now + loops * SIM_SPIN_NS, ready) ? SIM_SPIN_LOOPS : 1;
+}
+
+
+// Slave, max78000_video_main.c
+static uint32_t slave_ms(void)
+{
+    return (uint32_t) (sim.now / MS(1));
+}
+
+static int slave_send(uint8_t *data, uint32_t size, uint8_t type, uint64_t hash)
+{
+    packet_t *packet;
+    int ret;
+
+    if (!qspi_credit_available(&slave_credit, type, slave_ms())) {
+        return E_BUSY;
+    }
+
+    packet = log_add(&sim.to_master, type, hash);
+    sim.sending = 1;
+    sim.send_size = size;
+    sim.send_triggers = 0;
+    ret = qspi_slave_send_packet(data, size, type);
+    sim.sending = 0;
+    packet->ret = ret;
+
+    if (ret == E_NO_ERROR) {
+        qspi_credit_use(&slave_credit, type, slave_ms());
+    } else if (ret == E_BUSY) {
+        phase_counters()->slave_busy++;
+    } else {
+        slave_error();
+    }
+
+    return ret;
+}
+
+// Flat frame with a moving band of detail, every SIM_NOISE_FRAME th frame is noise
+static void frame_generate(uint8_t *frame, uint32_t seq)
+{
+    uint32_t noise = (seq * 2654435761u) | 1;
+    int noisy = sim.noise_frames && ((++sim.images % SIM_NOISE_FRAME) == 0);
+
+    for (int row = 0; row < LCD_HEIGHT; row++) {
+        uint8_t *line = frame + row * LCD_WIDTH * LCD_BYTE_PER_PIXEL;
+        int band = ((row + seq * 7) % LCD_HEIGHT) < 24;
+
+        for (int i = 0; i < LCD_WIDTH * LCD_BYTE_PER_PIXEL; i++) {
+            if (noisy || band) {
+                noise ^= noise << 13;
+                noise ^= noise >> 17;
+                noise ^= noise << 5;
+                line[i] = (uint8_t) noise;
+            } else {
+                line[i] = (uint8_t) (seq + row / 16);
+            }
+        }
+    }
+}
+
+static void slave_send_image(uint32_t seq)
+{
+    uint32_t size = 0;
+    uint64_t hash;
+
+    if (!qspi_credit_available(&slave_credit, QSPI_PACKET_TYPE_VIDEO_DATA_RES, slave_ms())) {
+        return;
+    }
+
+    // Master compares the decoded frame
+    frame_generate(slave_frame, seq);
+    hash = hash64(slave_frame, LCD_DATA_SIZE);
+
+    if (sim.compression && (video_codec_estimate(slave_frame) <= SIM_COMPRESSION_MAX_SIZE)) {
+        size = video_codec_encode(slave_frame);
+    }
+    if (size) {
+        slave_send(slave_frame, size, QSPI_PACKET_TYPE_VIDEO_COMPRESSED_DATA_RES, hash);
+    } else {
+        slave_send(slave_frame, LCD_DATA_SIZE, QSPI_PACKET_TYPE_VIDEO_DATA_RES, hash);
+    }
+}
+
+static void slave_send_results(uint32_t seq)
+{
+    memset(&slave_classification, 0, sizeof(slave_classification));
+    slave_classification.probabily = (float) (seq % 100);
+    slave_classification.classification = (classification_e) (seq % CLASSIFICATION_LAST);
+    snprintf(slave_classification.result, sizeof(slave_classification.result), "frame %u", seq);
+    slave_send((uint8_t *) &slave_classification, sizeof(slave_classification),
+            QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES, hash64(&slave_classification, sizeof(slave_classification)));
+
+    if ((seq % 10) == 0) {
+        slave_statistics.cnn_duration_us = (uint32_t) (sim.cnn / US(1));
+        slave_statistics.capture_duration_us = (uint32_t) (sim.capture / US(1));
+        slave_statistics.communication_duration_us = seq;
+        slave_statistics.total_duration_us = slave_ms();
+        slave_send((uint8_t *) &slave_statistics, sizeof(slave_statistics),
+                QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES, hash64(&slave_statistics, sizeof(slave_statistics)));
+    }
+}
+
+static void slave_main(void)
+{
+    qspi_packet_header_t header;
+    uint8_t *buffer;
+    uint32_t seq = 0;
+
+    qspi_slave_init();
+    qspi_credit_init(&slave_credit);
+    sim.camera_ready = sim.now + sim.capture;
+
+    while (1) {
+        if (qspi_slave_get_rx_state() == QSPI_STATE_CS_DEASSERTED_HEADER) {
+            // Payload commands, large ones go to the camera buffer and stop the capture
+            header = qspi_slave_get_rx_header();
+            if (header.info.packet_size <= sizeof(slave_command_buffer)) {
+                buffer = slave_command_buffer;
+            } else {
+                buffer = slave_frame;
+                sim.camera_ready = NEVER;
+            }
+
+            qspi_slave_set_rx_data(buffer, header.info.packet_size);
+            qspi_slave_trigger();
+            qspi_slave_wait_rx();
+
+            if (header.payload_crc16 != crc16_sw(buffer, header.info.packet_size)) {
+                slave_error();
+            } else if (header.info.packet_type == QSPI_PACKET_TYPE_ACKNOWLEDGE) {
+                qspi_credit_grant(&slave_credit, buffer, header.info.packet_size);
+            } else if (header.info.packet_type == QSPI_PACKET_TYPE_TEST) {
+                log_match(&sim.to_slave, QSPI_PACKET_TYPE_TEST, hash64(buffer, header.info.packet_size));
+                phase_counters()->commands++;
+            } else {
+                slave_error();
+            }
+
+            qspi_slave_set_rx_state(QSPI_STATE_IDLE);
+            if (buffer == slave_frame) {
+                sim.camera_ready = sim.now + sim.capture;
+            }
+        } else if (qspi_slave_get_rx_state() == QSPI_STATE_COMPLETED) {
+            header = qspi_slave_get_rx_header();
+            if (header.info.packet_type == QSPI_PACKET_TYPE_VIDEO_ENABLE_COMPRESSION_CMD) {
+                sim.compression = 1;
+            } else if (header.info.packet_type == QSPI_PACKET_TYPE_VIDEO_DISABLE_COMPRESSION_CMD) {
+                sim.compression = 0;
+            } else {
+                slave_error();
+            }
+            qspi_slave_set_rx_state(QSPI_STATE_IDLE);
+        }
+
+        if (sim.now < sim.camera_ready) {
+            chip_wait(CHIP_IDLE, sim.camera_ready, NULL);
+            continue;
+        }
+
+        sim.camera_ready = sim.now + sim.capture;
+        if (!sim.camera_enabled) {
+            continue;
+        }
+
+        // Next capture runs during the CNN
+        slave_send_image(seq);
+        sim.camera_ready = sim.now + sim.capture;
+        if (sim.cnn) {
+            chip_wait(CHIP_BUSY, sim.now + sim.cnn, NULL);
+        }
+        slave_send_results(seq);
+        seq++;
+    }
+}
+
+
+// Master, qspi_task and display_task of max32666_main.c
+static void master_accept(qspi_packet_type_e type)
+{
+    uint64_t hash = 0;
+
+    switch (type) {
+    case QSPI_PACKET_TYPE_VIDEO_DATA_RES:
+    case QSPI_PACKET_TYPE_VIDEO_COMPRESSED_DATA_RES:
+        hash = hash64(lcd_data.back_buffer, LCD_DATA_SIZE);
+        phase_counters()->frames++;
+        if (sim.now >= phase_counters()->start + sim.phase->duration / 2) {
+            phase_counters()->settled_frames++;
+        }
+        break;
+    case QSPI_PACKET_TYPE_VIDEO_CLASSIFICATION_RES:
+        hash = hash64(&device_status.classification_video, sizeof(device_status.classification_video));
+        sim.classification = device_status.classification_video;
+        break;
+    case QSPI_PACKET_TYPE_VIDEO_STATISTICS_RES:
+        hash = hash64(&device_status.statistics.max78000_video, sizeof(device_status.statistics.max78000_video));
+        sim.statistics = device_status.statistics.max78000_video;
+        break;
+    default:
+        break;
+    }
+
+    log_match(&sim.to_master, type, hash);
+}
+
+// Results the main loop reads only change with an accepted packet, never with a failed receive
+static void master_results_check(void)
+{
+    if (memcmp(&sim.classification, &device_status.classification_video, sizeof(sim.classification)) ||
+        memcmp(&sim.statistics, &device_status.statistics.max78000_video, sizeof(sim.statistics))) {
+        phase_counters()->torn++;
+        sim.classification = device_status.classification_video;
+        sim.statistics = device_status.statistics.max78000_video;
+    }
+}
+
+// The slave CS interrupt sees a CS pulse shorter than its latency as one edge
+static void master_cpu(void)
+{
+    chip_wait(CHIP_BUSY, sim.now + SIM_MASTER_CPU, NULL);
+}
+
+static uint32_t test_generate(uint8_t *data, uint32_t seq)
+{
+    // Mostly command buffer sizes, every 8th goes to the camera buffer of the slave
+    uint32_t size = ((seq % 8) == 7) ? (200 + seq % 300) : (4 + seq % (SIM_COMMAND_BUFFER_SIZE - 3));
+
+    memcpy(data, &seq, sizeof(seq));
+    for (uint32_t i = sizeof(seq); i < size; i++) {
+        data[i] = (uint8_t) (seq * 31 + i);
+    }
+
+    return size;
+}
+
+static void master_commands(void)
+{
+    if (sim.compression_request != sim.compression_sent) {
+        if (qspi_master_send_video(NULL, 0, sim.compression_request ?
+                QSPI_PACKET_TYPE_VIDEO_ENABLE_COMPRESSION_CMD : QSPI_PACKET_TYPE_VIDEO_DISABLE_COMPRESSION_CMD) == E_NO_ERROR) {
+            sim.compression_sent = sim.compression_request;
+        }
+        master_cpu();
+    }
+
+    if (sim.now >= sim.test_time) {
+        uint32_t size = test_generate(master_test, sim.test_seq);
+
+        if (qspi_master_send_video(master_test, size, QSPI_PACKET_TYPE_TEST) == E_NO_ERROR) {
+            log_add(&sim.to_slave, QSPI_PACKET_TYPE_TEST, hash64(master_test, size))->ret = E_NO_ERROR;
+            sim.test_seq++;
+        }
+        sim.test_time = sim.now + SIM_TEST_INTERVAL;
+        master_cpu();
+    }
+}
+
+static void master_main(void)
+{
+    qspi_packet_type_e type;
+    uint64_t wake;
+    int ret;
+
+    lcd_data.buffer = lcd_data.frame_buffer[0];
+    lcd_data.back_buffer = lcd_data.frame_buffer[MAX32666_LCD_DOUBLE_BUFFER];
+    qspi_master_init();
+
+    while (1) {
+        ret = qspi_master_video_rx_worker(&type);
+        if (ret == E_NO_ERROR) {
+            master_accept(type);
+            master_cpu();
+        } else if ((ret != E_NONE_AVAIL) && (ret != E_BUSY)) {
+            master_error();
+            master_cpu();
+        }
+        master_results_check();
+
+        // Sends wait for the receive to go idle without a yield, only start them when it is
+        if (qspi_master_video_rx_idle()) {
+            qspi_master_video_tx_worker();
+            master_cpu();
+            master_commands();
+        }
+
+        if (lcd_data.frame_pending && qspi_master_video_rx_idle() &&
+            !spi_dma_busy_flag(MAX32666_LCD_DMA_CHANNEL)) {
+            uint8_t *front = lcd_data.buffer;
+
+            lcd_data.buffer = lcd_data.back_buffer;
+            lcd_data.back_buffer = front;
+            lcd_data.frame_pending = 0;
+            spi_dma(MAX32666_LCD_DMA_CHANNEL, MAX32666_LCD_SPI, lcd_data.buffer, NULL, LCD_DATA_SIZE,
+                    MAX32666_LCD_DMA_REQSEL_SPITX, NULL);
+            phase_counters()->shown++;
+            qspi_master_video_ack(QSPI_PACKET_TYPE_VIDEO_DATA_RES);
+        }
+        qspi_master_video_ack_worker();
+        master_cpu();
+
+        wake = sim.now + MS(MAX32666_QSPI_POLL_INTERVAL);
+        if ((sim.test_time > sim.now) && (sim.test_time < wake)) {
+            wake = sim.test_time;
+        }
+        chip_wait(CHIP_IDLE, wake, NULL);
+    }
+}
+
+
+// Checks and benchmark
+static int phase_check(int index)
+{
+    const phase_t *phase = &phases[index];
+    const counters_t *c = &sim.counters[index];
+    int fault_phase = phase->bit_error || phase->truncate || phase->late_cs || phase->lost_int;
+    int errors = 0;
+
+    fprintf(report, "%-12s %8u %6u %9u %7u %11u %10u %5u %5u\n", phase->name, c->frames, c->shown,
+            c->commands, c->faults, c->master_errors, c->slave_errors, c->slave_busy, c->lost);
+
+    if (c->mismatched) {
+        fprintf(report, "FAIL: %s: %u packets accepted that were not sent or out of order\n", phase->name,
+                c->mismatched);
+        errors++;
+    }
+    if (c->chunk_errors) {
+        fprintf(report, "FAIL: %s: slave DMA count above 0xFFFF %u times\n", phase->name, c->chunk_errors);
+        errors++;
+    }
+    if (c->overlaps) {
+        fprintf(report, "FAIL: %s: master DMA started while busy %u times\n", phase->name, c->overlaps);
+        errors++;
+    }
+    if (c->torn) {
+        fprintf(report, "FAIL: %s: results changed without an accepted packet %u times\n", phase->name, c->torn);
+        errors++;
+    }
+
+    if (index == 0) {
+        if (c->master_errors || c->slave_errors || c->lost) {
+            fprintf(report, "FAIL: %s: errors or lost packets on a clean link\n", phase->name);
+            errors++;
+        }
+        if (!c->frames || !c->shown || !c->commands) {
+            fprintf(report, "FAIL: %s: no frames or commands on the link\n", phase->name);
+            errors++;
+        }
+    } else if (fault_phase) {
+        if (!c->faults) {
+            fprintf(report, "FAIL: %s: no faults injected\n", phase->name);
+            errors++;
+        } else if (!c->master_errors && !c->slave_errors) {
+            fprintf(report, "FAIL: %s: faults not detected\n", phase->name);
+            errors++;
+        }
+    } else {
+        if (c->last_error > c->start + phase->duration / 2) {
+            fprintf(report, "FAIL: %s: errors %llu ms into the clean phase\n", phase->name,
+                    (unsigned long long) ((c->last_error - c->start) / MS(1)));
+            errors++;
+        }
+        if (c->settled_frames < SIM_RECOVERY_FRAMES) {
+            fprintf(report, "FAIL: %s: %u frames after the link settled\n", phase->name, c->settled_frames);
+            errors++;
+        }
+    }
+
+    return errors;
+}
+
+static int bench_run(uint32_t clock, int compression, int print)
+{
+    int index = sizeof(phases) / sizeof(phases[0]);
+    counters_t *c = &sim.counters[index];
+    int errors = 0;
+
+    // Link drains at the previous clock, the master switches compression
+    sim.phase = &bench_phase;
+    sim.phase_index = index;
+    sim.camera_enabled = 0;
+    sim.compression_request = compression;
+    sim_run(SIM_SETTLE_TIME);
+    sim.byte_time = 2 * 1000000000ULL / clock;
+
+    memset(c, 0, sizeof(*c));
+    c->start = sim.now;
+    sim.link_stats = print;
+    sim.wire_payload = 0;
+    sim.camera_enabled = 1;
+    sim_run(SIM_BENCH_TIME);
+    sim.link_stats = 0;
+
+    fprintf(report, "%2u MHz %-10s %6u %9.1f %10.1f\n", clock / 1000000, compression ? "compressed" : "raw",
+            c->frames, c->frames * 1000.0 / (SIM_BENCH_TIME / MS(1)), c->shown * 1000.0 / (SIM_BENCH_TIME / MS(1)));
+
+    if (c->master_errors || c->slave_errors || c->mismatched || c->chunk_errors || c->overlaps || !c->frames) {
+        fprintf(report, "FAIL: benchmark at %u MHz: %u master and %u slave errors, %u mismatched\n",
+                clock / 1000000, c->master_errors, c->slave_errors, c->mismatched);
+        errors++;
+    }
+
+    return errors;
+}
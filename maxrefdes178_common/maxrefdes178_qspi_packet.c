@@ -0,0 +1,103 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <string.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_packet.h"
+#include "maxrefdes178_utility.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+void qspi_packet_form_header(qspi_packet_header_t *header, const uint8_t packet_type,
+        const uint8_t *payload, const uint32_t payload_size)
+{
+    memset(header, 0, sizeof(qspi_packet_header_t));
+
+    header->start_symbol = QSPI_START_SYMBOL;
+    header->info.packet_size = payload_size;
+    header->info.packet_type = packet_type;
+    header->header_crc16 = crc16_sw((uint8_t *) &header->info, sizeof(header->info));
+    header->payload_crc16 = payload_size ? crc16_sw((uint8_t *) payload, payload_size) : 0;
+}
+
+qspi_packet_status_e qspi_packet_check_header(const qspi_packet_header_t *header)
+{
+    if (header->start_symbol != QSPI_START_SYMBOL) {
+        return QSPI_PACKET_STATUS_INVALID_START;
+    }
+
+    if (header->header_crc16 != crc16_sw((uint8_t *) &header->info, sizeof(header->info))) {
+        return QSPI_PACKET_STATUS_INVALID_HEADER_CRC;
+    }
+
+    return QSPI_PACKET_STATUS_OK;
+}
+
+qspi_packet_status_e qspi_packet_check_payload(const qspi_packet_header_t *header,
+        const uint8_t *payload, const uint32_t payload_size)
+{
+    if (payload_size &&
+        (header->payload_crc16 != crc16_sw((uint8_t *) payload, payload_size))) {
+        return QSPI_PACKET_STATUS_INVALID_PAYLOAD_CRC;
+    }
+
+    return QSPI_PACKET_STATUS_OK;
+}
@@ -0,0 +1,79 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_QSPI_PACKET_H_
+#define _MAXREFDES178_QSPI_PACKET_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Bytes clocked for a packet on top of its payload, header and payload are separate CS frames
+#define QSPI_PACKET_OVERHEAD_SIZE   sizeof(qspi_packet_header_t)
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    QSPI_PACKET_STATUS_OK = 0,
+    QSPI_PACKET_STATUS_INVALID_START,
+    QSPI_PACKET_STATUS_INVALID_HEADER_CRC,
+    QSPI_PACKET_STATUS_INVALID_PAYLOAD_CRC,
+
+    QSPI_PACKET_STATUS_LAST
+} qspi_packet_status_e;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Hardware independent framing shared by the QSPI master and slaves, also builds on a host
+void qspi_packet_form_header(qspi_packet_header_t *header, const uint8_t packet_type,
+        const uint8_t *payload, const uint32_t payload_size);
+
+qspi_packet_status_e qspi_packet_check_header(const qspi_packet_header_t *header);
+
+qspi_packet_status_e qspi_packet_check_payload(const qspi_packet_header_t *header,
+        const uint8_t *payload, const uint32_t payload_size);
+
+
+#endif /* _MAXREFDES178_QSPI_PACKET_H_ */
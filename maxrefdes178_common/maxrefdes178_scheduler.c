@@ -0,0 +1,202 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#ifndef SCHEDULER_HOST
+#include <mxc_device.h>
+#endif
+#include <stddef.h>
+
+#include "maxrefdes178_scheduler.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#if (SCHEDULER_WHEEL_SIZE & (SCHEDULER_WHEEL_SIZE - 1)) != 0
+#error "SCHEDULER_WHEEL_SIZE must be a power of two"
+#endif
+
+#define SCHEDULER_WHEEL_MASK  (SCHEDULER_WHEEL_SIZE - 1)
+
+#ifdef SCHEDULER_HOST
+// Host simulation posts between handlers, there is nothing to race with
+#define EXCLUSIVE_LOAD(addr)            (*(addr))
+#define EXCLUSIVE_STORE(value, addr)    ((*(addr) = (value)), 0)
+#else
+#define EXCLUSIVE_LOAD(addr)            __LDREXW(addr)
+#define EXCLUSIVE_STORE(value, addr)    __STREXW((value), (addr))
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static scheduler_task_t *scheduler_tasks = NULL;
+static int scheduler_task_count = 0;
+static volatile uint32_t scheduler_events = 0;  // Written by interrupts
+static uint32_t scheduler_expired = 0;          // Task bit set when its timer expires
+static scheduler_task_t *scheduler_wheel[SCHEDULER_WHEEL_SIZE];
+static uint32_t scheduler_wheel_time = 0;       // ms, the last slot walked
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void scheduler_timer_start(scheduler_task_t *task, uint32_t delay);
+static void scheduler_advance(uint32_t time);
+static uint32_t scheduler_take_events(uint32_t events);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int scheduler_init(scheduler_task_t *tasks, int task_count, uint32_t time)
+{
+    if ((task_count < 0) || (task_count > SCHEDULER_TASK_MAX)) {
+        return -1;
+    }
+
+    scheduler_tasks = tasks;
+    scheduler_task_count = task_count;
+    scheduler_expired = 0;
+    scheduler_wheel_time = time;
+    for (int i = 0; i < SCHEDULER_WHEEL_SIZE; i++) {
+        scheduler_wheel[i] = NULL;
+    }
+
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].period) {
+            scheduler_timer_start(&tasks[i], tasks[i].period);
+        }
+    }
+
+    return 0;
+}
+
+void scheduler_post(uint32_t events)
+{
+    uint32_t pending;
+
+    do {
+        pending = EXCLUSIVE_LOAD(&scheduler_events);
+    } while (EXCLUSIVE_STORE(pending | events, &scheduler_events));
+}
+
+int scheduler_dispatch(uint32_t time)
+{
+    uint32_t events;
+    scheduler_task_t *task;
+
+    scheduler_advance(time);
+
+    events = scheduler_events;
+    for (int i = 0; i < scheduler_task_count; i++) {
+        task = &scheduler_tasks[i];
+        if ((scheduler_expired & (1UL << i)) || (events & task->events)) {
+            // Cleared before the handler, events posted while it runs make it ready again
+            scheduler_expired &= ~(1UL << i);
+            scheduler_take_events(task->events);
+            task->handler();
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Timer expires when the slot delay ms ahead is walked for the rounds + 1 time
+static void scheduler_timer_start(scheduler_task_t *task, uint32_t delay)
+{
+    scheduler_task_t **slot = &scheduler_wheel[(scheduler_wheel_time + delay) & SCHEDULER_WHEEL_MASK];
+
+    task->rounds = (delay - 1) / SCHEDULER_WHEEL_SIZE;
+    task->next = *slot;
+    *slot = task;
+}
+
+// Walks every slot up to time, a late call catches up on all missed slots
+static void scheduler_advance(uint32_t time)
+{
+    scheduler_task_t **link;
+    scheduler_task_t *task;
+    scheduler_task_t *expired;
+
+    while ((int32_t) (time - scheduler_wheel_time) > 0) {
+        scheduler_wheel_time++;
+
+        expired = NULL;
+        link = &scheduler_wheel[scheduler_wheel_time & SCHEDULER_WHEEL_MASK];
+        while (*link) {
+            task = *link;
+            if (task->rounds) {
+                task->rounds--;
+                link = &task->next;
+                continue;
+            }
+
+            *link = task->next;
+            task->next = expired;
+            expired = task;
+        }
+
+        // Restarted after the walk, a period of a whole number of turns lands on this slot.
+        // Timers restart from the expiry so they do not drift.
+        while (expired) {
+            task = expired;
+            expired = task->next;
+            scheduler_expired |= 1UL << (task - scheduler_tasks);
+            scheduler_timer_start(task, task->period);
+        }
+    }
+}
+
+static uint32_t scheduler_take_events(uint32_t events)
+{
+    uint32_t pending;
+
+    do {
+        pending = EXCLUSIVE_LOAD(&scheduler_events);
+    } while (EXCLUSIVE_STORE(pending & ~events, &scheduler_events));
+
+    return pending & events;
+}
@@ -0,0 +1,91 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_SCHEDULER_H_
+#define _MAXREFDES178_SCHEDULER_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Task count is limited by the ready masks
+#define SCHEDULER_TASK_MAX                 32
+
+// 1 ms slots, longer periods take more turns of the wheel
+#define SCHEDULER_WHEEL_SIZE               32  // power of two
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef void (*scheduler_handler_t)(void);
+
+typedef struct scheduler_task_s {
+    scheduler_handler_t handler;
+    uint32_t events;                  // Event mask that makes the task ready
+    uint32_t period;                  // ms, 0 for event driven only
+
+    // Owned by the scheduler
+    struct scheduler_task_s *next;    // Timer wheel slot list
+    uint32_t rounds;                  // Wheel turns left before the timer expires
+} scheduler_task_t;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Event and timer driven run to completion scheduler, hardware independent, also builds on a
+// host with -DSCHEDULER_HOST. Tasks are given in priority order, the first is the highest.
+// After each handler the highest priority ready task is picked again, so a task waits for at
+// most one lower priority handler. An event wakes the first task waiting for it.
+
+// Events posted before init are kept. Returns -1 if there are too many tasks.
+int scheduler_init(scheduler_task_t *tasks, int task_count, uint32_t time);
+
+// Safe from interrupt and thread context of one core
+void scheduler_post(uint32_t events);
+
+// Advances the timer wheel to time and runs the highest priority ready task.
+// Returns 1 if a task ran, 0 if nothing is ready and the core can sleep.
+int scheduler_dispatch(uint32_t time);
+
+
+#endif /* _MAXREFDES178_SCHEDULER_H_ */
@@ -0,0 +1,473 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host simulation of the MAX32666 main loop with simulated interrupts and timers, compares the
+ * former polling superloop with the scheduler (maxrefdes178_scheduler.c):
+ *
+ *   gcc -O2 -DSCHEDULER_HOST -I. maxrefdes178_scheduler.c maxrefdes178_scheduler_sim.c -o scheduler_sim
+ *   ./scheduler_sim [seconds] [frame_ms]
+ *
+ * Workers only spend time, the costs below are rough MAX32666 figures. Interrupts are delivered
+ * when the simulated clock passes them, the latency is measured from the interrupt time.
+ * Frame to display latency is from the video slave interrupt to the start of the LCD DMA.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_scheduler.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Interrupt sources, us
+#define SIM_CLASSIFICATION_DELAY   25000  // Video CNN result after the frame
+#define SIM_AUDIO_PERIOD           1000000
+#define SIM_TOUCH_PERIOD           700000
+#define SIM_EXPANDER_PERIOD        3000000
+
+// Transfers, us
+#define SIM_FRAME_TRANSFER         7700   // 240x240 RGB565 over QSPI
+#define SIM_RESULT_TRANSFER        100
+#define SIM_LCD_TRANSFER           12000
+
+// Handler costs, us
+#define SIM_QSPI_START_COST        30
+#define SIM_FRAME_COMPLETE_COST    1500   // Payload CRC
+#define SIM_RESULT_COMPLETE_COST   50
+#define SIM_SWAP_COST              150
+#define SIM_TOUCH_COST             350    // I2C
+#define SIM_EXPANDER_COST          300    // I2C
+#define SIM_BLE_COST               40
+#define SIM_STATUS_COST            15
+#define SIM_LED_COST               30
+#define SIM_POWMON_COST            2500   // I2C
+#define SIM_PMIC_COST              4000   // I2C, PMIC and fuel gauge
+#define SIM_CHECK_COST             1      // Flag or timestamp check that finds nothing
+#define SIM_DISPATCH_COST          2
+
+#define SIM_QUEUE_SIZE             4
+
+#define MS(t)                      ((uint32_t) ((t) / 1000))
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    SIM_PACKET_FRAME = 0,
+    SIM_PACKET_RESULT,
+    SIM_PACKET_AUDIO,
+} sim_packet_e;
+
+typedef struct {
+    sim_packet_e type;
+    uint64_t time;            // Slave interrupt
+} sim_packet_t;
+
+typedef struct {
+    int use_scheduler;
+    uint64_t end;
+    uint64_t frame_period;
+
+    uint64_t now;
+    uint64_t idle;
+
+    // Interrupt sources
+    uint64_t next_frame;
+    uint64_t next_result;
+    uint64_t next_audio;
+    uint64_t next_touch;
+    uint64_t next_expander;
+    uint64_t next_tick;
+    uint64_t rx_done;         // 0 when no QSPI DMA runs
+    uint64_t lcd_done;        // 0 when no LCD DMA runs
+
+    // Slave queue, the interrupt is asserted while it is not empty
+    sim_packet_t video_queue[SIM_QUEUE_SIZE];
+    int video_count;
+    int audio_int;
+    int touch_int;
+    int expander_int;
+
+    // Master
+    enum { RX_IDLE, RX_BUSY, RX_COMPLETED } rx_state;
+    sim_packet_t rx_packet;
+    int frame_pending;
+    uint64_t frame_time;
+    uint64_t screen_drew;
+
+    // Statistics
+    uint32_t frames_sent;
+    uint32_t frames_shown;
+    uint32_t frames_dropped;
+    uint32_t *latency;
+} sim_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static sim_t sim;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void sim_post(uint32_t events);
+static void sim_deliver(void);
+static void sim_spend(uint64_t us);
+static void sim_wfi(void);
+static void qspi_task(void);
+static void display_task(void);
+static void input_task(void);
+static void ble_task(void);
+static void status_task(void);
+static void led_task(void);
+static void powmon_task(void);
+static void pmic_task(void);
+static void run(int use_scheduler, uint64_t seconds, uint64_t frame_ms);
+static int compare_u32(const void *a, const void *b);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+static void sim_post(uint32_t events)
+{
+    // The superloop polls the flags, interrupts only wake it
+    if (sim.use_scheduler) {
+        scheduler_post(events);
+    }
+}
+
+static void sim_video_packet(sim_packet_e type, uint64_t time)
+{
+    // A frame still queued is replaced, the camera does not wait
+    if (type == SIM_PACKET_FRAME) {
+        for (int i = 0; i < sim.video_count; i++) {
+            if (sim.video_queue[i].type == SIM_PACKET_FRAME) {
+                sim.video_queue[i].time = time;
+                sim.frames_dropped++;
+                return;
+            }
+        }
+    }
+    if (sim.video_count < SIM_QUEUE_SIZE) {
+        sim.video_queue[sim.video_count].type = type;
+        sim.video_queue[sim.video_count].time = time;
+        sim.video_count++;
+    }
+    sim_post(MAX32666_EVENT_QSPI);
+}
+
+// Runs the interrupts due by now in time order
+static void sim_deliver(void)
+{
+    uint64_t *sources[] = {&sim.next_frame, &sim.next_result, &sim.next_audio, &sim.next_touch,
+                           &sim.next_expander, &sim.next_tick, &sim.rx_done, &sim.lcd_done};
+    uint64_t **first;
+
+    while (1) {
+        first = NULL;
+        for (int i = 0; i < (int) (sizeof(sources) / sizeof(sources[0])); i++) {
+            if (*sources[i] && (*sources[i] <= sim.now) && (!first || (*sources[i] < **first))) {
+                first = &sources[i];
+            }
+        }
+        if (!first) {
+            return;
+        }
+
+        if (*first == &sim.next_frame) {
+            sim_video_packet(SIM_PACKET_FRAME, sim.next_frame);
+            sim.frames_sent++;
+            sim.next_result = sim.next_frame + SIM_CLASSIFICATION_DELAY;
+            sim.next_frame += sim.frame_period;
+        } else if (*first == &sim.next_result) {
+            sim_video_packet(SIM_PACKET_RESULT, sim.next_result);
+            sim.next_result = 0;
+        } else if (*first == &sim.next_audio) {
+            sim.audio_int = 1;
+            sim_post(MAX32666_EVENT_QSPI);
+            sim.next_audio += SIM_AUDIO_PERIOD;
+        } else if (*first == &sim.next_touch) {
+            sim.touch_int = 1;
+            sim_post(MAX32666_EVENT_INPUT);
+            sim.next_touch += SIM_TOUCH_PERIOD;
+        } else if (*first == &sim.next_expander) {
+            sim.expander_int = 1;
+            sim_post(MAX32666_EVENT_INPUT);
+            sim.next_expander += SIM_EXPANDER_PERIOD;
+        } else if (*first == &sim.next_tick) {
+            sim.next_tick += 1000;
+        } else if (*first == &sim.rx_done) {
+            sim.rx_done = 0;
+            sim.rx_state = RX_COMPLETED;
+            sim_post(MAX32666_EVENT_QSPI | MAX32666_EVENT_LCD);
+        } else if (*first == &sim.lcd_done) {
+            sim.lcd_done = 0;
+            sim_post(MAX32666_EVENT_LCD);
+        }
+    }
+}
+
+static void sim_spend(uint64_t us)
+{
+    sim.now += us;
+    sim_deliver();
+}
+
+// Sleeps until the next interrupt, the ms timer at the latest
+static void sim_wfi(void)
+{
+    uint64_t next = sim.next_tick;
+    uint64_t sources[] = {sim.next_frame, sim.next_result, sim.next_audio, sim.next_touch,
+                          sim.next_expander, sim.rx_done, sim.lcd_done};
+
+    for (int i = 0; i < (int) (sizeof(sources) / sizeof(sources[0])); i++) {
+        if (sources[i] && (sources[i] < next)) {
+            next = sources[i];
+        }
+    }
+
+    if (next > sim.now) {
+        sim.idle += next - sim.now;
+        sim.now = next;
+    }
+    sim_deliver();
+}
+
+static void qspi_task(void)
+{
+    if (sim.rx_state == RX_COMPLETED) {
+        if (sim.rx_packet.type == SIM_PACKET_FRAME) {
+            sim_spend(SIM_FRAME_COMPLETE_COST);
+            if (sim.frame_pending) {
+                sim.frames_dropped++;
+            }
+            sim.frame_pending = 1;
+            sim.frame_time = sim.rx_packet.time;
+            sim_post(MAX32666_EVENT_LCD);
+        } else {
+            sim_spend(SIM_RESULT_COMPLETE_COST);
+        }
+        sim.rx_state = RX_IDLE;
+    }
+
+    if ((sim.rx_state == RX_IDLE) && sim.video_count) {
+        sim.rx_packet = sim.video_queue[0];
+        memmove(&sim.video_queue[0], &sim.video_queue[1], (sim.video_count - 1) * sizeof(sim_packet_t));
+        sim.video_count--;
+        sim_spend(SIM_QSPI_START_COST);
+        sim.rx_state = RX_BUSY;
+        sim.rx_done = sim.now + ((sim.rx_packet.type == SIM_PACKET_FRAME) ? SIM_FRAME_TRANSFER : SIM_RESULT_TRANSFER);
+    } else if ((sim.rx_state == RX_IDLE) && sim.audio_int) {
+        sim.audio_int = 0;
+        sim.rx_packet.type = SIM_PACKET_AUDIO;
+        sim.rx_packet.time = sim.now;
+        sim_spend(SIM_QSPI_START_COST);
+        sim.rx_state = RX_BUSY;
+        sim.rx_done = sim.now + SIM_RESULT_TRANSFER;
+    }
+
+    sim_spend(2 * SIM_CHECK_COST);
+}
+
+static void display_task(void)
+{
+    if (sim.frame_pending && !((sim.rx_state == RX_BUSY) && (sim.rx_packet.type != SIM_PACKET_AUDIO)) && !sim.lcd_done) {
+        sim_spend(SIM_SWAP_COST);
+        sim.latency[sim.frames_shown++] = (uint32_t) (sim.now - sim.frame_time);
+        sim.frame_pending = 0;
+        sim.screen_drew = sim.now;
+        sim.lcd_done = sim.now + SIM_LCD_TRANSFER;
+    }
+
+    sim_spend(SIM_CHECK_COST);
+}
+
+static void input_task(void)
+{
+    if (sim.expander_int) {
+        sim.expander_int = 0;
+        sim_spend(SIM_EXPANDER_COST);
+    }
+    if (sim.touch_int) {
+        sim.touch_int = 0;
+        sim_spend(SIM_TOUCH_COST);
+    }
+
+    sim_spend(3 * SIM_CHECK_COST);
+}
+
+static void ble_task(void)
+{
+    sim_spend(SIM_BLE_COST);
+}
+
+static void status_task(void)
+{
+    sim_spend(SIM_STATUS_COST);
+}
+
+static void led_task(void)
+{
+    sim_spend(SIM_LED_COST);
+}
+
+static void powmon_task(void)
+{
+    sim_spend(SIM_POWMON_COST);
+}
+
+static void pmic_task(void)
+{
+    sim_spend(SIM_PMIC_COST);
+}
+
+static void run(int use_scheduler, uint64_t seconds, uint64_t frame_ms)
+{
+    static scheduler_task_t tasks[] = {
+        {.handler = qspi_task,    .events = MAX32666_EVENT_QSPI,  .period = MAX32666_QSPI_POLL_INTERVAL},
+        {.handler = display_task, .events = MAX32666_EVENT_LCD,   .period = MAX32666_LCD_POLL_INTERVAL},
+        {.handler = input_task,   .events = MAX32666_EVENT_INPUT, .period = 0},
+        {.handler = ble_task,     .events = 0,                    .period = MAX32666_BLE_INTERVAL},
+        {.handler = status_task,  .events = 0,                    .period = MAX32666_STATUS_INTERVAL},
+        {.handler = led_task,     .events = 0,                    .period = MAX32666_LED_INTERVAL},
+        {.handler = powmon_task,  .events = 0,                    .period = MAX32666_POWMON_INTERVAL},
+        {.handler = pmic_task,    .events = 0,                    .period = MAX32666_PMIC_INTERVAL},
+    };
+    uint32_t pmic_check = 0, powmon = 0, led = 0;
+    uint64_t latency_sum = 0;
+    uint32_t *latency = sim.latency;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.latency = latency;
+    sim.use_scheduler = use_scheduler;
+    sim.end = seconds * 1000000;
+    sim.frame_period = frame_ms * 1000;
+    sim.next_frame = sim.frame_period;
+    sim.next_audio = SIM_AUDIO_PERIOD / 2;
+    sim.next_touch = SIM_TOUCH_PERIOD;
+    sim.next_expander = SIM_EXPANDER_PERIOD;
+    sim.next_tick = 1000;
+
+    if (use_scheduler) {
+        scheduler_init(tasks, sizeof(tasks) / sizeof(tasks[0]), MS(sim.now));
+    }
+
+    while (sim.now < sim.end) {
+        if (use_scheduler) {
+            sim_spend(SIM_DISPATCH_COST);
+            if (!scheduler_dispatch(MS(sim.now))) {
+                sim_wfi();
+            }
+            continue;
+        }
+
+        // Former run_application pass, every worker is checked
+        qspi_task();
+        status_task();
+        ble_task();
+        if ((MS(sim.now) - pmic_check) > MAX32666_PMIC_INTERVAL) {
+            pmic_check = MS(sim.now);
+            pmic_task();
+        }
+        if ((MS(sim.now) - powmon) > MAX32666_POWMON_INTERVAL) {
+            powmon = MS(sim.now);
+            powmon_task();
+        }
+        if ((MS(sim.now) - led) > MAX32666_LED_INTERVAL) {
+            led = MS(sim.now);
+            led_task();
+        }
+        input_task();
+        display_task();
+        sim_wfi();
+    }
+
+    for (uint32_t i = 0; i < sim.frames_shown; i++) {
+        latency_sum += sim.latency[i];
+    }
+    qsort(sim.latency, sim.frames_shown, sizeof(uint32_t), compare_u32);
+
+    printf("%-10s %7u %7u %7u %9.2f %9.2f %9.2f %7.2f\n", use_scheduler ? "scheduler" : "superloop",
+           sim.frames_sent, sim.frames_shown, sim.frames_dropped,
+           sim.frames_shown ? (latency_sum / (double) sim.frames_shown) / 1000 : 0,
+           sim.frames_shown ? sim.latency[(sim.frames_shown * 99) / 100] / 1000.0 : 0,
+           sim.frames_shown ? sim.latency[sim.frames_shown - 1] / 1000.0 : 0,
+           (100.0 * sim.idle) / sim.now);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t seconds = (argc > 1) ? strtoull(argv[1], NULL, 0) : 600;
+    uint64_t frame_ms = (argc > 2) ? strtoull(argv[2], NULL, 0) : 50;
+
+    if (!seconds || !frame_ms) {
+        printf("usage: %s [seconds] [frame_ms]\n", argv[0]);
+        return 1;
+    }
+
+    sim.latency = malloc(((seconds * 1000) / frame_ms + 1) * sizeof(uint32_t));
+    if (!sim.latency) {
+        return 1;
+    }
+
+    printf("%-10s %7s %7s %7s %9s %9s %9s %7s\n", "mode", "frames", "shown", "dropped",
+           "avg_ms", "p99_ms", "max_ms", "idle_%");
+    run(0, seconds, frame_ms);
+    run(1, seconds, frame_ms);
+
+    free(sim.latency);
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <mxc_device.h>
+#include <string.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_trace.h"
+#include "maxrefdes178_utility.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#if (TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)) != 0
+#error "TRACE_BUFFER_SIZE must be a power of two"
+#endif
+
+#define TRACE_MASK  (TRACE_BUFFER_SIZE - 1)
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+// head and tail run freely and are masked on access. Producers claim slots by incrementing head
+// with exclusive access, so an interrupt recording in between makes the claim retry.
+static trace_event_t trace_buffer[TRACE_BUFFER_SIZE];
+static volatile uint32_t trace_head = 0;  // Written by producers
+static uint32_t trace_tail = 0;           // Written by trace_drain
+static volatile uint16_t trace_frame = 0;
+static trace_source_e trace_source = TRACE_SOURCE_MAX32666;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+void trace_init(trace_source_e source)
+{
+    trace_source = source;
+    trace_head = 0;
+    trace_tail = 0;
+    trace_frame = 0;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+void trace_record(trace_event_e event, uint8_t arg)
+{
+    uint32_t cycles = DWT->CYCCNT;
+    uint32_t index;
+    trace_event_t *slot;
+
+    do {
+        index = __LDREXW(&trace_head);
+    } while (__STREXW(index + 1, &trace_head));
+
+    slot = &trace_buffer[index & TRACE_MASK];
+    slot->cycles = cycles;
+    slot->frame = trace_frame;
+    slot->event = event;
+    slot->arg = arg;
+}
+
+void trace_next_frame(void)
+{
+    trace_frame++;
+}
+
+int trace_drain(trace_dump_t *dump)
+{
+    uint32_t head = trace_head;
+    uint32_t count = head - trace_tail;
+    uint32_t dropped = 0;
+    uint32_t index;
+
+    if (count > TRACE_DUMP_EVENT_COUNT) {
+        dropped = count - TRACE_DUMP_EVENT_COUNT;
+        count = TRACE_DUMP_EVENT_COUNT;
+    }
+
+    // Copy in up to two parts, the slots may wrap around the end of the buffer
+    index = (head - count) & TRACE_MASK;
+    if (index + count > TRACE_BUFFER_SIZE) {
+        uint32_t first = TRACE_BUFFER_SIZE - index;
+        memcpy(&dump->events[0], &trace_buffer[index], first * sizeof(trace_event_t));
+        memcpy(&dump->events[first], &trace_buffer[0], (count - first) * sizeof(trace_event_t));
+    } else {
+        memcpy(&dump->events[0], &trace_buffer[index], count * sizeof(trace_event_t));
+    }
+
+    trace_tail = head;
+
+    dump->source = trace_source;
+    dump->count = count;
+    dump->dropped = MIN(dropped, UINT16_MAX);
+    dump->core_clock = SystemCoreClock;
+
+    return count;
+}
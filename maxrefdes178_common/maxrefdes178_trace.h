@@ -0,0 +1,83 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_TRACE_H_
+#define _MAXREFDES178_TRACE_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Add -DENABLE_TRACE to PROJ_CFLAGS to record events, the calls compile out otherwise
+#ifdef ENABLE_TRACE
+#define TRACE_INIT(source)          trace_init(source)
+#define TRACE_EVENT(event, arg)     trace_record((event), (arg))
+#define TRACE_NEXT_FRAME()          trace_next_frame()
+#else
+#define TRACE_INIT(source)
+#define TRACE_EVENT(event, arg)
+#define TRACE_NEXT_FRAME()
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Starts the core cycle counter used for timestamps
+void trace_init(trace_source_e source);
+
+// Safe from thread and interrupt context of one core, the oldest events are overwritten when full
+void trace_record(trace_event_e event, uint8_t arg);
+
+// Events recorded after this carry the new frame number
+void trace_next_frame(void);
+
+// Copies the most recent events not drained yet, older ones are counted as dropped.
+// Call from thread context only. Returns the number of events in the dump.
+int trace_drain(trace_dump_t *dump);
+
+
+#endif /* _MAXREFDES178_TRACE_H_ */
@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+###################################################################################################
+# Copyright (C) Maxim Integrated Products, Inc., All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+# associated documentation files (the "Software"), to deal in the Software without restriction,
+# including without limitation the rights to use, copy, modify, merge, publish, distribute,
+# sublicense, and/or sell copies of the Software, and to permit persons to whom the
+# Software is furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all copies or
+# substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+# NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONIN-
+# FRINGEMENT.IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+# WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH
+# THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+#
+# Except as contained in this notice, the name of Maxim Integrated Products, Inc. shall not be used
+# except as stated in the Maxim Integrated Products, Inc. Branding Policy.
+#
+# The mere transfer of this software does not imply any licenses of trade secrets, proprietary
+# technology, copyrights, patents, trademarks, maskwork rights, or any other form of intellectual
+# property whatsoever. Maxim Integrated Products, Inc. retains all ownership rights.
+#
+###################################################################################################
+
+
+"""
+Decodes trace dumps (trace_dump_t in maxrefdes178_definitions.h) recorded with ENABLE_TRACE.
+
+Input is either a binary file of concatenated BLE_COMMAND_GET_TRACE_RES payloads or a debug UART
+log with "TRACE <hex>" lines. Prints per frame stage latencies for each chip and optionally writes
+a Chrome trace (chrome://tracing, Perfetto) JSON file. Each chip has its own cycle counter, so
+timestamps are only comparable within one source.
+"""
+import argparse
+import json
+import re
+import struct
+import sys
+from collections import defaultdict
+
+SOURCES = ['MAX32666', 'MAX78000_VIDEO', 'MAX78000_AUDIO']
+EVENTS = ['CAPTURE_START', 'CAPTURE_END', 'QSPI_HEADER', 'QSPI_PAYLOAD', 'CNN_LOAD', 'CNN_START',
+          'CNN_DONE', 'CNN_UNLOAD', 'LCD_DMA_START', 'LCD_DMA_END', 'BLE_ENQUEUE']
+
+# Stage name: (begin event, end event), matched to the latest begin before each end
+STAGES = {
+    'capture': ('CAPTURE_START', 'CAPTURE_END'),
+    'qspi': ('QSPI_HEADER', 'QSPI_PAYLOAD'),
+    'cnn_load': ('CNN_LOAD', 'CNN_START'),
+    'cnn': ('CNN_START', 'CNN_DONE'),
+    'cnn_unload': ('CNN_DONE', 'CNN_UNLOAD'),
+    'lcd': ('LCD_DMA_START', 'LCD_DMA_END'),
+}
+
+DUMP_HEADER = struct.Struct('<BBHI')
+EVENT = struct.Struct('<IHBB')
+
+
+def parse_dumps(data):
+    """
+    Splits concatenated trace dumps
+    """
+    dumps = []
+    offset = 0
+    while offset + DUMP_HEADER.size <= len(data):
+        source, count, dropped, core_clock = DUMP_HEADER.unpack_from(data, offset)
+        offset += DUMP_HEADER.size
+        if source >= len(SOURCES) or offset + count * EVENT.size > len(data):
+            raise ValueError(f'Corrupt trace dump at offset {offset - DUMP_HEADER.size}')
+        events = [EVENT.unpack_from(data, offset + i * EVENT.size) for i in range(count)]
+        offset += count * EVENT.size
+        dumps.append((source, dropped, core_clock, events))
+    return dumps
+
+
+def read_input(file_name):
+    """
+    Reads a binary dump file or the hex lines of a debug UART log
+    """
+    with open(file_name, 'rb') as f:
+        data = f.read()
+    lines = re.findall(rb'TRACE ([0-9A-Fa-f]+)', data)
+    if lines:
+        return b''.join(bytes.fromhex(line.decode()) for line in lines)
+    return data
+
+
+def unwrap(dumps):
+    """
+    Returns per source event lists with 64 bit cycle counts and the core clock
+    """
+    timelines = defaultdict(list)
+    clocks = {}
+    dropped = defaultdict(int)
+    last = {}
+    for source, lost, core_clock, events in dumps:
+        clocks[source] = core_clock
+        dropped[source] += lost
+        for cycles, frame, event, arg in events:
+            prev = last.get(source)
+            if prev is None:
+                total = cycles
+            else:
+                total = prev + ((cycles - prev) & 0xFFFFFFFF)
+            last[source] = total
+            name = EVENTS[event] if event < len(EVENTS) else f'EVENT_{event}'
+            timelines[source].append((total, frame, name, arg))
+    return timelines, clocks, dropped
+
+
+def pair_stages(timeline):
+    """
+    Returns (stage, frame, begin, end) intervals
+    """
+    intervals = []
+    begins = {}
+    for cycles, frame, name, arg in timeline:
+        for stage, (begin, end) in STAGES.items():
+            key = (stage, arg) if stage == 'qspi' else stage
+            if name == end and key in begins:
+                intervals.append((stage, frame, begins.pop(key), cycles))
+            if name == begin:
+                begins[key] = cycles
+    return intervals
+
+
+def print_report(timelines, clocks, dropped):
+    """
+    Prints per frame stage latencies in ms and their averages
+    """
+    for source in sorted(timelines):
+        us_per_cycle = 1e6 / clocks[source]
+        intervals = pair_stages(timelines[source])
+        stages = [s for s in STAGES if any(i[0] == s for i in intervals)]
+        print(f'{SOURCES[source]}: {len(timelines[source])} events, {dropped[source]} dropped, '
+              f'{clocks[source] / 1e6:.0f} MHz')
+        if not stages:
+            continue
+
+        frames = defaultdict(lambda: defaultdict(float))
+        for stage, frame, begin, end in intervals:
+            frames[frame][stage] += (end - begin) * us_per_cycle / 1000
+        print('  frame' + ''.join(f'{s:>12}' for s in stages))
+        for frame in sorted(frames):
+            print(f'  {frame:5}' + ''.join(f'{frames[frame][s]:12.3f}' if s in frames[frame]
+                                           else f'{"-":>12}' for s in stages))
+        print('  avg  ' + ''.join(
+            f'{sum(f[s] for f in frames.values() if s in f) / sum(s in f for f in frames.values()):12.3f}'
+            for s in stages))
+
+
+def write_chrome_trace(file_name, timelines, clocks):
+    """
+    Writes stages as complete events and everything else as instant events
+    """
+    trace = []
+    for source, timeline in timelines.items():
+        us_per_cycle = 1e6 / clocks[source]
+        for stage, frame, begin, end in pair_stages(timeline):
+            trace.append({'name': stage, 'ph': 'X', 'pid': SOURCES[source], 'tid': stage,
+                          'ts': begin * us_per_cycle, 'dur': (end - begin) * us_per_cycle,
+                          'args': {'frame': frame}})
+        for cycles, frame, name, arg in timeline:
+            if name == 'BLE_ENQUEUE':
+                trace.append({'name': name, 'ph': 'i', 's': 't', 'pid': SOURCES[source],
+                              'tid': 'ble', 'ts': cycles * us_per_cycle,
+                              'args': {'frame': frame, 'size': arg}})
+    with open(file_name, 'w') as f:
+        json.dump({'traceEvents': trace, 'displayTimeUnit': 'ms'}, f)
+
+
+def main():
+    """
+    Entry point
+    """
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input', help='binary trace dumps or debug UART log')
+    parser.add_argument('--chrome', metavar='JSON', help='write a Chrome trace file')
+    args = parser.parse_args()
+
+    try:
+        dumps = parse_dumps(read_input(args.input))
+    except (OSError, ValueError) as err:
+        print(err, file=sys.stderr)
+        return 1
+
+    timelines, clocks, dropped = unwrap(dumps)
+    print_report(timelines, clocks, dropped)
+    if args.chrome:
+        write_chrome_trace(args.chrome, timelines, clocks)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,374 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check and benchmark of the keyword spotting transpose of the audio firmware
+ * (max78000_audio_transpose.c, the same in every demo), Linux x86-64 only:
+ *
+ *   gcc -O2 -I. -I../maxrefdes178-FaceId/maxrefdes178_max78000_common \
+ *       -I../maxrefdes178-FaceId/maxrefdes178_max78000_audio/include \
+ *       ../maxrefdes178-FaceId/maxrefdes178_max78000_audio/src/max78000_audio_transpose.c \
+ *       maxrefdes178_transpose_sim.c -o transpose_sim
+ *   ./transpose_sim [words]
+ *
+ * The sixteen CNN data memory groups at 0x50400000-0x51018000 are mapped read write at their
+ * addresses and filled with garbage before every word. The former AddTranspose, one sample at a
+ * time with division and modulo into a 16KB buffer, and the former cnn_load_data copy of each 1KB
+ * slice are the reference. Every word is added the way the firmware does: the preamble circular
+ * buffer split at every CHUNK aligned offset followed by CHUNKs and zero padding, the split at
+ * unaligned offsets, and random chunk sizes, so partial rows are mixed with whole rows. Return
+ * values must match call by call and the CNN data memory must be byte identical to the reference
+ * layout.
+ *
+ * The benchmark reports TSC cycles per sample for a whole word in CHUNKs and for a preamble split
+ * at an unaligned offset, for the former transpose with its 16KB copy and for transpose_add
+ * writing straight into the CNN data memory. Host cycles only compare the two, the MAX78000 has
+ * no divider in the loop but pays for the byte stores and the copy the same way.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <x86intrin.h>
+
+#include "max78000_audio_transpose.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define SAMPLE_SIZE         TRANSPOSE_SIZE
+#define CHUNK               128
+#define PREAMBLE_SIZE       (30 * CHUNK)
+#define DEFAULT_WORDS       200
+#define BENCH_WORDS         2000
+#define BENCH_SPLIT         1000     // unaligned preamble split of the benchmark
+#define GROUP_PAGE          4096
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef uint8_t (*add_fn_t)(const uint8_t *pIn, uint16_t inSize);
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static const uintptr_t group_addr[TRANSPOSE_GROUPS] = {
+    0x50400000, 0x50408000, 0x50410000, 0x50418000,
+    0x50800000, 0x50808000, 0x50810000, 0x50818000,
+    0x50C00000, 0x50C08000, 0x50C10000, 0x50C18000,
+    0x51000000, 0x51008000, 0x51010000, 0x51018000,
+};
+
+static uint8_t ref_buffer[SAMPLE_SIZE];
+static uint8_t preamble[PREAMBLE_SIZE];
+static uint8_t chunk[SAMPLE_SIZE];
+static int calls;
+static int mismatches;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint8_t former_transpose(const uint8_t *pIn, uint8_t *pOut, uint16_t inSize, uint16_t outSize, uint16_t width);
+static void former_load(const uint8_t *pIn);
+static uint8_t add_both(const uint8_t *pIn, uint16_t inSize);
+static uint8_t add_former(const uint8_t *pIn, uint16_t inSize);
+static uint8_t add_direct(const uint8_t *pIn, uint16_t inSize);
+static void fill_random(uint8_t *buf, int size);
+static void word_garbage(void);
+static int word_check(const char *name, int word);
+static int word_preamble(add_fn_t add, int split, int zeros);
+static int word_random(add_fn_t add);
+static double bench(add_fn_t add, int split);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    int words = DEFAULT_WORDS;
+    int errors = 0;
+    int word = 0;
+    int split;
+    int i;
+
+    if (argc > 1) {
+        words = atoi(argv[1]);
+    }
+    if (words <= 0) {
+        words = DEFAULT_WORDS;
+    }
+
+    for (i = 0; i < TRANSPOSE_GROUPS; i++) {
+        if (mmap((void *) group_addr[i], GROUP_PAGE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) != (void *) group_addr[i]) {
+            printf("FAIL: cannot map CNN data memory at 0x%08lx\n", (unsigned long) group_addr[i]);
+            return 1;
+        }
+    }
+    srand(178);
+
+    // Firmware splits the preamble circular buffer at multiples of CHUNK
+    for (split = 0; split < PREAMBLE_SIZE; split += CHUNK) {
+        word_garbage();
+        errors += word_preamble(add_both, split, rand() % (SAMPLE_SIZE / 2 / CHUNK));
+        errors += word_check("aligned preamble split", word++);
+    }
+    for (split = 1; split < PREAMBLE_SIZE; split += 61) {
+        word_garbage();
+        errors += word_preamble(add_both, split, rand() % (SAMPLE_SIZE / 2 / CHUNK));
+        errors += word_check("unaligned preamble split", word++);
+    }
+    for (i = 0; i < words; i++) {
+        word_garbage();
+        errors += word_random(add_both);
+        errors += word_check("random chunks", word++);
+    }
+    if (mismatches) {
+        printf("FAIL: %d of %d calls returned differently\n", mismatches, calls);
+        errors++;
+    }
+    printf("%d words, %d transpose calls\n", word, calls);
+    printf("transpose check: %s\n", errors ? "FAILED" : "passed");
+
+    printf("cycles/sample                   whole CHUNKs  unaligned preamble split\n");
+    printf("former transpose + 16KB copy %15.2f %25.2f\n", bench(add_former, 0), bench(add_former, BENCH_SPLIT));
+    printf("transpose_add into CNN memory %14.2f %25.2f\n", bench(add_direct, 0), bench(add_direct, BENCH_SPLIT));
+
+    return errors ? 1 : 0;
+}
+
+// AddTranspose before the chunk oriented version, one sample at a time into the 16KB buffer
+__attribute__((noinline))
+static uint8_t former_transpose(const uint8_t *pIn, uint8_t *pOut, uint16_t inSize, uint16_t outSize, uint16_t width)
+{
+    static uint16_t row = 0, col = 0, total = 0;
+    uint16_t secondHalf = 0, wordRow = 0, byteInWord = 0, group = 0, index = 0;
+
+    for (int i = 0; i < inSize; i++) {
+        secondHalf = (col >= (width >> 1)) ? 1 : 0;
+        group = (col % (width >> 1)) / 4;
+        wordRow = secondHalf + (row << 1);
+        byteInWord = col % 4;
+        index = 1024 * group + 4 * wordRow + byteInWord;
+        pOut[index] = pIn[i];
+        total++;
+
+        col++;
+        if (col >= width) {
+            col = 0;
+            row++;
+        }
+    }
+
+    if (total >= outSize) {
+        if (row != width) {
+            printf("FAIL: former transpose rearranging\n");
+        }
+        total = 0;
+        row = 0;
+        col = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+// cnn_load_data before the direct transpose, each 1KB slice into its group
+__attribute__((noinline))
+static void former_load(const uint8_t *pIn)
+{
+    for (int group = 0; group < TRANSPOSE_GROUPS; group++) {
+        memcpy((uint8_t *) group_addr[group], &pIn[group * TRANSPOSE_GROUP_SIZE], TRANSPOSE_GROUP_SIZE);
+    }
+}
+
+static uint8_t add_both(const uint8_t *pIn, uint16_t inSize)
+{
+    uint8_t former = former_transpose(pIn, ref_buffer, inSize, SAMPLE_SIZE, TRANSPOSE_WIDTH);
+    uint8_t direct = transpose_add(pIn, inSize, SAMPLE_SIZE);
+
+    calls++;
+    if (former != direct) {
+        mismatches++;
+    }
+
+    return direct;
+}
+
+static uint8_t add_former(const uint8_t *pIn, uint16_t inSize)
+{
+    if (former_transpose(pIn, ref_buffer, inSize, SAMPLE_SIZE, TRANSPOSE_WIDTH)) {
+        former_load(ref_buffer);
+        return 1;
+    }
+
+    return 0;
+}
+
+static uint8_t add_direct(const uint8_t *pIn, uint16_t inSize)
+{
+    if (transpose_add(pIn, inSize, SAMPLE_SIZE)) {
+        transpose_load(0);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void fill_random(uint8_t *buf, int size)
+{
+    for (int i = 0; i < size; i++) {
+        buf[i] = (uint8_t) rand();
+    }
+}
+
+// Same garbage in the CNN data memory and the reference buffer, every byte must be overwritten
+static void word_garbage(void)
+{
+    for (int group = 0; group < TRANSPOSE_GROUPS; group++) {
+        fill_random(&ref_buffer[group * TRANSPOSE_GROUP_SIZE], TRANSPOSE_GROUP_SIZE);
+        memcpy((uint8_t *) group_addr[group], &ref_buffer[group * TRANSPOSE_GROUP_SIZE], TRANSPOSE_GROUP_SIZE);
+    }
+}
+
+static int word_check(const char *name, int word)
+{
+    for (int group = 0; group < TRANSPOSE_GROUPS; group++) {
+        const uint8_t *mem = (const uint8_t *) group_addr[group];
+        const uint8_t *ref = &ref_buffer[group * TRANSPOSE_GROUP_SIZE];
+
+        for (int i = 0; i < TRANSPOSE_GROUP_SIZE; i++) {
+            if (mem[i] != ref[i]) {
+                printf("FAIL: %s word %d group %d byte %d is 0x%02x, expected 0x%02x\n", name, word, group, i,
+                        mem[i], ref[i]);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Preamble reordered as the firmware does when a keyword starts, then CHUNKs ending in zeros
+static int word_preamble(add_fn_t add, int split, int zeros)
+{
+    int added = PREAMBLE_SIZE;
+    uint8_t done = 0;
+
+    fill_random(preamble, PREAMBLE_SIZE);
+    if (split == 0) {
+        done |= add(&preamble[0], PREAMBLE_SIZE);
+    } else {
+        done |= add(&preamble[split], PREAMBLE_SIZE - split);
+        done |= add(&preamble[0], split);
+    }
+
+    while (!done) {
+        if (added >= SAMPLE_SIZE - zeros * CHUNK) {
+            memset(chunk, 0, CHUNK);
+        } else {
+            fill_random(chunk, CHUNK);
+        }
+        done = add(chunk, CHUNK);
+        added += CHUNK;
+    }
+
+    if (added != SAMPLE_SIZE) {
+        printf("FAIL: word completed after %d samples\n", added);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Random sizes from 1 to 3 rows, the last one ends exactly at SAMPLE_SIZE
+static int word_random(add_fn_t add)
+{
+    int added = 0;
+    uint8_t done = 0;
+    int size;
+
+    while (!done) {
+        size = 1 + rand() % (3 * TRANSPOSE_WIDTH);
+        if (size > SAMPLE_SIZE - added) {
+            size = SAMPLE_SIZE - added;
+        }
+        fill_random(chunk, size);
+        done = add(chunk, size);
+        added += size;
+        if (!done && (added >= SAMPLE_SIZE)) {
+            printf("FAIL: word not completed after %d samples\n", added);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static double bench(add_fn_t add, int split)
+{
+    uint64_t start;
+    int word;
+
+    fill_random(preamble, PREAMBLE_SIZE);
+    fill_random(chunk, SAMPLE_SIZE);
+
+    start = __rdtsc();
+    for (word = 0; word < BENCH_WORDS; word++) {
+        if (split == 0) {
+            for (int i = 0; i < SAMPLE_SIZE; i += CHUNK) {
+                add(&chunk[i], CHUNK);
+            }
+        } else {
+            add(&preamble[split], PREAMBLE_SIZE - split);
+            add(&preamble[0], split);
+            for (int i = PREAMBLE_SIZE; i < SAMPLE_SIZE; i += CHUNK) {
+                add(&chunk[i], CHUNK);
+            }
+        }
+    }
+
+    return (double) (__rdtsc() - start) / ((double) BENCH_WORDS * SAMPLE_SIZE);
+}
@@ -0,0 +1,253 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_unet_mask.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define UNET_MASK_CLASS_MASK        ((1 << UNET_MASK_CLASS_BITS) - 1)
+#define UNET_MASK_ALPHA_SHIFT       5
+#define UNET_MASK_FRAME_ROW_WORDS   (LCD_WIDTH * LCD_BYTE_PER_PIXEL / sizeof(uint32_t))
+
+// RGB565 with green moved to the upper half word, leaves room for the blend products
+#define UNET_MASK_SPREAD_MASK       0x07E0F81FUL
+
+// Frame buffer pixels are byte swapped RGB565, swaps both pixels of a word
+#define UNET_MASK_SWAP16(w)         ((((w) & 0xFF00FF00UL) >> 8) | (((w) & 0x00FF00FFUL) << 8))
+
+#if ((1 << UNET_MASK_ALPHA_SHIFT) != UNET_MASK_ALPHA_OPAQUE)
+#error "Mask opacity must be a power of two"
+#endif
+
+#if (UNET_MASK_CLASS_COUNT > (1 << UNET_MASK_CLASS_BITS)) || (UNET_IMAGE_SIZE_X % UNET_MASK_CELLS_PER_BYTE)
+#error "Class map rows must be whole bytes"
+#endif
+
+#if (UNET_MASK_SCALE != 3) || ((UNET_IMAGE_SIZE_X * UNET_MASK_SCALE) != LCD_WIDTH) || \
+    ((UNET_IMAGE_SIZE_Y * UNET_MASK_SCALE) != LCD_HEIGHT)
+#error "Four cells are rendered as six words per frame row"
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+// Planes are stored red, blue, green, unknown, classes are red, green, blue, unknown
+static const uint8_t unet_mask_class_plane[UNET_MASK_CLASS_COUNT] = {0, 2, 1, 3};
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static inline uint32_t unet_mask_class(const int8_t *ml_data);
+static inline uint32_t unet_mask_margin(const int8_t *ml_data, uint32_t index);
+static inline uint32_t unet_mask_spread(uint32_t pixel);
+static inline uint32_t unet_mask_blend(uint32_t pixels, uint32_t mask_lo, uint32_t mask_hi,
+        uint32_t inv_alpha);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+uint32_t unet_mask_encode(unet_mask_result_t *result, const int8_t *ml_data, int with_confidence)
+{
+    uint32_t margin_sum[UNET_MASK_CLASS_COUNT] = {0};
+    uint32_t count[UNET_MASK_CLASS_COUNT] = {0};
+    uint32_t cells = 0;
+    uint32_t index;
+    uint32_t i;
+
+    for (i = 0; i < UNET_MASK_PLANE_SIZE; i++) {
+        index = unet_mask_class(&ml_data[i]);
+        cells |= index << ((i % UNET_MASK_CELLS_PER_BYTE) * UNET_MASK_CLASS_BITS);
+
+        if ((i % UNET_MASK_CELLS_PER_BYTE) == (UNET_MASK_CELLS_PER_BYTE - 1)) {
+            result->class_map[i / UNET_MASK_CELLS_PER_BYTE] = cells;
+            cells = 0;
+        }
+
+        if (with_confidence) {
+            margin_sum[index] += unet_mask_margin(&ml_data[i], index);
+            count[index]++;
+        }
+    }
+
+    if (!with_confidence) {
+        return UNET_MASK_CLASS_MAP_SIZE;
+    }
+
+    for (i = 0; i < UNET_MASK_CLASS_COUNT; i++) {
+        result->confidence[i] = count[i] ? (margin_sum[i] / count[i]) : 0;
+    }
+
+    return sizeof(unet_mask_result_t);
+}
+
+void unet_mask_palette(uint16_t *palette, uint8_t intensity)
+{
+    // Channel placement of the original mask drawing, colours on the LCD are unchanged
+    palette[0] = (intensity & 0xFC) << 3;
+    palette[1] = (intensity & 0xF8) >> 3;
+    palette[2] = (intensity & 0xF8) << 8;
+    palette[3] = 0;
+}
+
+void unet_mask_render(uint8_t *frame, const uint8_t *class_map, const uint16_t *palette, uint32_t alpha)
+{
+    uint32_t mask_scaled[UNET_MASK_CLASS_COUNT];
+    uint32_t inv_alpha;
+    uint32_t *row;
+    uint32_t c0, c1, c2, c3;
+    uint32_t w0, w1, w2, w3, w4, w5;
+    uint32_t x, y;
+    uint32_t i;
+
+    if (alpha >= UNET_MASK_ALPHA_OPAQUE) {
+        // A byte of the class map is six words, written to the three frame rows of its cells
+        for (y = 0; y < UNET_IMAGE_SIZE_Y; y++) {
+            row = (uint32_t *) frame + (y * UNET_MASK_SCALE * UNET_MASK_FRAME_ROW_WORDS);
+            for (x = 0; x < UNET_IMAGE_SIZE_X; x += UNET_MASK_CELLS_PER_BYTE, class_map++, row += 6) {
+                c0 = palette[*class_map & UNET_MASK_CLASS_MASK];
+                c1 = palette[(*class_map >> 2) & UNET_MASK_CLASS_MASK];
+                c2 = palette[(*class_map >> 4) & UNET_MASK_CLASS_MASK];
+                c3 = palette[(*class_map >> 6) & UNET_MASK_CLASS_MASK];
+
+                w0 = c0 | (c0 << 16);
+                w1 = c0 | (c1 << 16);
+                w2 = c1 | (c1 << 16);
+                w3 = c2 | (c2 << 16);
+                w4 = c2 | (c3 << 16);
+                w5 = c3 | (c3 << 16);
+
+                for (i = 0; i < (UNET_MASK_SCALE * UNET_MASK_FRAME_ROW_WORDS); i += UNET_MASK_FRAME_ROW_WORDS) {
+                    row[i + 0] = w0;
+                    row[i + 1] = w1;
+                    row[i + 2] = w2;
+                    row[i + 3] = w3;
+                    row[i + 4] = w4;
+                    row[i + 5] = w5;
+                }
+            }
+        }
+        return;
+    }
+
+    if (alpha == 0) {
+        return;
+    }
+
+    inv_alpha = UNET_MASK_ALPHA_OPAQUE - alpha;
+    for (i = 0; i < UNET_MASK_CLASS_COUNT; i++) {
+        mask_scaled[i] = unet_mask_spread(UNET_MASK_SWAP16((uint32_t) palette[i])) * alpha;
+    }
+
+    for (y = 0; y < UNET_IMAGE_SIZE_Y; y++) {
+        row = (uint32_t *) frame + (y * UNET_MASK_SCALE * UNET_MASK_FRAME_ROW_WORDS);
+        for (x = 0; x < UNET_IMAGE_SIZE_X; x += UNET_MASK_CELLS_PER_BYTE, class_map++, row += 6) {
+            c0 = mask_scaled[*class_map & UNET_MASK_CLASS_MASK];
+            c1 = mask_scaled[(*class_map >> 2) & UNET_MASK_CLASS_MASK];
+            c2 = mask_scaled[(*class_map >> 4) & UNET_MASK_CLASS_MASK];
+            c3 = mask_scaled[(*class_map >> 6) & UNET_MASK_CLASS_MASK];
+
+            for (i = 0; i < (UNET_MASK_SCALE * UNET_MASK_FRAME_ROW_WORDS); i += UNET_MASK_FRAME_ROW_WORDS) {
+                row[i + 0] = unet_mask_blend(row[i + 0], c0, c0, inv_alpha);
+                row[i + 1] = unet_mask_blend(row[i + 1], c0, c1, inv_alpha);
+                row[i + 2] = unet_mask_blend(row[i + 2], c1, c1, inv_alpha);
+                row[i + 3] = unet_mask_blend(row[i + 3], c2, c2, inv_alpha);
+                row[i + 4] = unet_mask_blend(row[i + 4], c2, c3, inv_alpha);
+                row[i + 5] = unet_mask_blend(row[i + 5], c3, c3, inv_alpha);
+            }
+        }
+    }
+}
+
+static inline uint32_t unet_mask_class(const int8_t *ml_data)
+{
+    int8_t max = ml_data[0];
+    uint32_t index = 0;
+    uint32_t i;
+
+    // Ties go to the first class
+    for (i = 1; i < UNET_MASK_CLASS_COUNT; i++) {
+        if (ml_data[unet_mask_class_plane[i] * UNET_MASK_PLANE_SIZE] > max) {
+            max = ml_data[unet_mask_class_plane[i] * UNET_MASK_PLANE_SIZE];
+            index = i;
+        }
+    }
+
+    return index;
+}
+
+static inline uint32_t unet_mask_margin(const int8_t *ml_data, uint32_t index)
+{
+    int32_t runner_up = -256;
+    uint32_t i;
+
+    for (i = 0; i < UNET_MASK_CLASS_COUNT; i++) {
+        if ((i != index) && (ml_data[unet_mask_class_plane[i] * UNET_MASK_PLANE_SIZE] > runner_up)) {
+            runner_up = ml_data[unet_mask_class_plane[i] * UNET_MASK_PLANE_SIZE];
+        }
+    }
+
+    return ml_data[unet_mask_class_plane[index] * UNET_MASK_PLANE_SIZE] - runner_up;
+}
+
+static inline uint32_t unet_mask_spread(uint32_t pixel)
+{
+    return (pixel | (pixel << 16)) & UNET_MASK_SPREAD_MASK;
+}
+
+static inline uint32_t unet_mask_blend(uint32_t pixels, uint32_t mask_lo, uint32_t mask_hi,
+        uint32_t inv_alpha)
+{
+    uint32_t lo, hi;
+
+    pixels = UNET_MASK_SWAP16(pixels);
+
+    lo = (((unet_mask_spread(pixels & 0xFFFF) * inv_alpha) + mask_lo) >> UNET_MASK_ALPHA_SHIFT) &
+            UNET_MASK_SPREAD_MASK;
+    hi = (((unet_mask_spread(pixels >> 16) * inv_alpha) + mask_hi) >> UNET_MASK_ALPHA_SHIFT) &
+            UNET_MASK_SPREAD_MASK;
+
+    pixels = ((lo | (lo >> 16)) & 0xFFFF) | ((hi | (hi >> 16)) << 16);
+
+    return UNET_MASK_SWAP16(pixels);
+}
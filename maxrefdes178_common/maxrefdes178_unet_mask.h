@@ -0,0 +1,93 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_UNET_MASK_H_
+#define _MAXREFDES178_UNET_MASK_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define UNET_MASK_CLASS_COUNT       4
+#define UNET_MASK_PLANE_SIZE        (UNET_IMAGE_SIZE_X * UNET_IMAGE_SIZE_Y)
+#define UNET_MASK_SCALE             (LCD_WIDTH / UNET_IMAGE_SIZE_X)
+
+// Class map packs the class index of four cells into a byte, first cell in the low bits
+#define UNET_MASK_CLASS_BITS        2
+#define UNET_MASK_CELLS_PER_BYTE    (8 / UNET_MASK_CLASS_BITS)
+#define UNET_MASK_CLASS_MAP_SIZE    (UNET_MASK_PLANE_SIZE / UNET_MASK_CELLS_PER_BYTE)
+
+// Mask opacity is in 1/UNET_MASK_ALPHA_OPAQUE steps, opaque replaces the frame
+#define UNET_MASK_ALPHA_OPAQUE      32
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+// QSPI_PACKET_TYPE_VIDEO_UNET_MASK_RES payload, confidence is optional
+typedef struct __attribute__((packed)) {
+    uint8_t class_map[UNET_MASK_CLASS_MAP_SIZE];
+    uint8_t confidence[UNET_MASK_CLASS_COUNT];  // Mean score margin over the runner-up of the class cells
+} unet_mask_result_t;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// UNet segmentation mask encoder and renderer, hardware independent, also builds on a host.
+// The CNN output is UNET_MASK_CLASS_COUNT int8 planes of UNET_IMAGE_SIZE_X x UNET_IMAGE_SIZE_Y
+// scores. The MAX78000 reduces it to a class map, the MAX32666 draws each cell as a
+// UNET_MASK_SCALE x UNET_MASK_SCALE block of its class colour.
+
+// Fills the result from the CNN output. Returns the payload size, confidence is only included
+// if requested.
+uint32_t unet_mask_encode(unet_mask_result_t *result, const int8_t *ml_data, int with_confidence);
+
+// Fills palette[UNET_MASK_CLASS_COUNT] with the class colours for the given channel intensity,
+// values are the 16 bit words stored in the frame buffer
+void unet_mask_palette(uint16_t *palette, uint8_t intensity);
+
+// Renders the mask straight into the LCD_WIDTH x LCD_HEIGHT frame, which must be 32-bit aligned.
+// With alpha below UNET_MASK_ALPHA_OPAQUE the mask is blended over the frame already there.
+void unet_mask_render(uint8_t *frame, const uint8_t *class_map, const uint16_t *palette, uint32_t alpha);
+
+
+#endif /* _MAXREFDES178_UNET_MASK_H_ */
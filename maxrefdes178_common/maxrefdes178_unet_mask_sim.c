@@ -0,0 +1,482 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check and benchmark of the UNet mask encoder and renderer (maxrefdes178_unet_mask.c):
+ *
+ *   gcc -O2 -I. maxrefdes178_unet_mask.c maxrefdes178_unet_mask_sim.c -o unet_mask_sim
+ *   ./unet_mask_sim [iterations]
+ *
+ * The packed class map is unpacked and compared with the four plane argmax of the original
+ * update_mask, the opaque render pixel by pixel with its drawing and the blended render with a
+ * per channel reference. Encode and render time per mask is reported, then segmentation results
+ * per second over a simulated link, with the original fixed delays and with the class map paced
+ * by the mask credit of maxrefdes178_qspi_credit.h.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_qspi_credit.h"
+#include "maxrefdes178_unet_mask.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define MASK_INTENSITY      0x7f
+#define DEFAULT_ITERATIONS  2000
+
+#define BRG(r,g,b)  (((r&0xF8)<<8)|((g&0xFC)<<3)|((b&0xF8)>>3)) //5 red | 6 green | 5 blue
+
+// Simulated link, us, QSPI rate of maxrefdes178_scheduler_sim.c
+#define SIM_DURATION        (60 * 1000000ULL)
+#define SIM_CAPTURE         40000
+#define SIM_CNN             30000   // Load, inference and unload
+#define SIM_ENCODE          2000
+#define SIM_RENDER          3000
+#define SIM_ACK             100     // Acknowledge packet returning the credit to the slave
+#define SIM_OLD_DELAY       500000
+#define SIM_TRANSFER(size)  ((uint64_t) (size) * 67 / 1000)
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef struct {
+    uint32_t results;
+    uint32_t frames;
+    uint64_t latency;
+} sim_link_stats_t;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static uint32_t frame_words[LCD_DATA_SIZE / sizeof(uint32_t)];
+static uint32_t expected_words[LCD_DATA_SIZE / sizeof(uint32_t)];
+static uint16_t mask_data[LCD_WIDTH * LCD_HEIGHT];
+static int8_t ml_data8[UNET_MASK_CLASS_COUNT * UNET_MASK_PLANE_SIZE];
+static unet_mask_result_t result;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static void update_mask(uint8_t *buffer, uint32_t mask);
+static uint32_t argmax(uint32_t cell, int32_t *margin);
+static int check_encode(void);
+static void blend_reference(uint8_t *frame, uint32_t alpha);
+static void fill_ml_data(int range);
+static void fill_frame(uint8_t *frame);
+static int compare(const char *name, const uint8_t *frame, const uint8_t *expected);
+static double elapsed_us(clock_t start, int iterations);
+static void simulate_link(int use_credit, sim_link_stats_t *stats);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    static const int ranges[] = {256, 3, 1};
+    static const uint32_t alphas[] = {1, 11, 16, 31};
+    uint8_t *frame = (uint8_t *) frame_words;
+    uint8_t *expected = (uint8_t *) expected_words;
+    uint16_t palette[UNET_MASK_CLASS_COUNT];
+    sim_link_stats_t stats;
+    int iterations = DEFAULT_ITERATIONS;
+    int errors = 0;
+    clock_t start;
+    size_t r, a;
+    int i;
+
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+    }
+    if (iterations <= 0) {
+        iterations = DEFAULT_ITERATIONS;
+    }
+
+    srand(178);
+    unet_mask_palette(palette, MASK_INTENSITY);
+
+    // Full range scores, and narrow ranges to exercise the argmax ties
+    for (r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+        fill_ml_data(ranges[r]);
+
+        errors += check_encode();
+
+        fill_frame(frame);
+        update_mask(expected, MASK_INTENSITY);
+        unet_mask_render(frame, result.class_map, palette, UNET_MASK_ALPHA_OPAQUE);
+        errors += compare("opaque", frame, expected);
+
+        for (a = 0; a < sizeof(alphas) / sizeof(alphas[0]); a++) {
+            fill_frame(frame);
+            memcpy(expected, frame, LCD_DATA_SIZE);
+            unet_mask_render(frame, result.class_map, palette, alphas[a]);
+            blend_reference(expected, alphas[a]);
+            errors += compare("blend", frame, expected);
+        }
+
+        fill_frame(frame);
+        memcpy(expected, frame, LCD_DATA_SIZE);
+        unet_mask_render(frame, result.class_map, palette, 0);
+        errors += compare("transparent", frame, expected);
+    }
+
+    printf("pixel check: %s\n", errors ? "FAILED" : "passed");
+
+    fill_ml_data(256);
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        update_mask(frame, MASK_INTENSITY);
+    }
+    printf("update_mask:   %8.1f us/mask\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        unet_mask_encode(&result, ml_data8, 0);
+    }
+    printf("encode:        %8.1f us/mask\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        unet_mask_encode(&result, ml_data8, 1);
+    }
+    printf("encode conf:   %8.1f us/mask\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        unet_mask_render(frame, result.class_map, palette, UNET_MASK_ALPHA_OPAQUE);
+    }
+    printf("render opaque: %8.1f us/mask\n", elapsed_us(start, iterations));
+
+    start = clock();
+    for (i = 0; i < iterations; i++) {
+        unet_mask_render(frame, result.class_map, palette, 11);
+    }
+    printf("render blend:  %8.1f us/mask\n", elapsed_us(start, iterations));
+
+    simulate_link(0, &stats);
+    printf("link delays:   %5.2f results/s %5.1f frames/s latency %6.1f ms\n",
+            stats.results * 1000000.0 / SIM_DURATION, stats.frames * 1000000.0 / SIM_DURATION,
+            stats.results ? stats.latency / 1000.0 / stats.results : 0);
+    simulate_link(1, &stats);
+    printf("link credit:   %5.2f results/s %5.1f frames/s latency %6.1f ms\n",
+            stats.results * 1000000.0 / SIM_DURATION, stats.frames * 1000000.0 / SIM_DURATION,
+            stats.results ? stats.latency / 1000.0 / stats.results : 0);
+
+    return errors ? 1 : 0;
+}
+
+// Original MAX32666 UNet update_mask, drawing into buffer instead of lcd_data.buffer
+static void update_mask(uint8_t *buffer, uint32_t mask)
+{
+    int r;
+    int g;
+    int b;
+    int i;
+    int8_t rr, gg, bb, uu;
+    uint32_t x, y;
+    uint32_t color;
+    int32_t max = 0;
+    uint32_t max_index = 0;
+
+    x = 0;
+    y = 0;
+
+    for (i = 0; i < UNET_IMAGE_SIZE_X*UNET_IMAGE_SIZE_Y; i++) {
+        max = -256; // smaller than -128
+        max_index = 0;
+
+        rr = ml_data8[i];
+        bb = ml_data8[i + UNET_IMAGE_SIZE_X * UNET_IMAGE_SIZE_Y];  //swapped b&g
+        gg = ml_data8[i + 2 * UNET_IMAGE_SIZE_X * UNET_IMAGE_SIZE_Y];
+        uu = ml_data8[i + 3 * UNET_IMAGE_SIZE_X * UNET_IMAGE_SIZE_Y];
+
+        if (rr > max) {
+            max = rr;
+            max_index = 0;
+        }
+        if (gg > max) {
+            max = gg;
+            max_index = 1;
+        }
+        if (bb > max) {
+            max = bb;
+            max_index = 2;
+        }
+        if (uu > max) {
+            max = uu;
+            max_index = 3;
+        }
+
+        switch (max_index) {
+        case 0:
+            r = mask;
+            g = 0;
+            b = 0;
+            break;
+        case 1:
+            r = 0;
+            g = mask;
+            b = 0;
+            break;
+        case 2:
+            r = 0;
+            g = 0;
+            b = mask;
+            break;
+        default:
+            r = 0;
+            g = 0;
+            b = 0;
+            break;
+        }
+
+        color = BRG(b, r, g); // convert to RGB565 as needed by TFT
+
+        // repeat samples to convert 80x80 to 240x240
+        mask_data[3*x + 3*y*LCD_WIDTH] = color;
+        mask_data[3*x + (3*y+1)*LCD_WIDTH] = color;
+        mask_data[3*x + (3*y+2)*LCD_WIDTH] = color;
+
+        mask_data[3*x + 1 + 3*y*LCD_WIDTH] = color;
+        mask_data[3*x + 1 + (3*y+1)*LCD_WIDTH] = color;
+        mask_data[3*x + 1 + (3*y+2)*LCD_WIDTH] = color;
+
+        mask_data[3*x + 2 + 3*y*LCD_WIDTH] = color;
+        mask_data[3*x + 2 + (3*y+1)*LCD_WIDTH] = color;
+        mask_data[3*x + 2 + (3*y+2)*LCD_WIDTH] = color;
+
+        x += 1;
+        if (x >= (UNET_IMAGE_SIZE_X)) {
+            x = 0;
+            y += 1;
+        }
+    }
+
+    memcpy(buffer, mask_data, LCD_DATA_SIZE);
+}
+
+// Four plane argmax of update_mask, margin to the runner-up
+static uint32_t argmax(uint32_t cell, int32_t *margin)
+{
+    int32_t scores[UNET_MASK_CLASS_COUNT];
+    int32_t max = -256;
+    int32_t second = -256;
+    uint32_t index = 0;
+    uint32_t i;
+
+    scores[0] = ml_data8[cell];
+    scores[1] = ml_data8[cell + 2 * UNET_MASK_PLANE_SIZE];
+    scores[2] = ml_data8[cell + UNET_MASK_PLANE_SIZE];
+    scores[3] = ml_data8[cell + 3 * UNET_MASK_PLANE_SIZE];
+
+    for (i = 0; i < UNET_MASK_CLASS_COUNT; i++) {
+        if (scores[i] > max) {
+            max = scores[i];
+            index = i;
+        }
+    }
+    for (i = 0; i < UNET_MASK_CLASS_COUNT; i++) {
+        if ((i != index) && (scores[i] > second)) {
+            second = scores[i];
+        }
+    }
+
+    *margin = max - second;
+    return index;
+}
+
+// Unpacks the class map and confidence and compares them with argmax
+static int check_encode(void)
+{
+    uint32_t margin_sum[UNET_MASK_CLASS_COUNT] = {0};
+    uint32_t count[UNET_MASK_CLASS_COUNT] = {0};
+    uint32_t index, unpacked;
+    int32_t margin;
+    uint32_t i;
+
+    if (unet_mask_encode(&result, ml_data8, 0) != UNET_MASK_CLASS_MAP_SIZE) {
+        printf("encode: invalid size\n");
+        return 1;
+    }
+    if (unet_mask_encode(&result, ml_data8, 1) != sizeof(unet_mask_result_t)) {
+        printf("encode: invalid size with confidence\n");
+        return 1;
+    }
+
+    for (i = 0; i < UNET_MASK_PLANE_SIZE; i++) {
+        index = argmax(i, &margin);
+        unpacked = (result.class_map[i / UNET_MASK_CELLS_PER_BYTE] >>
+                ((i % UNET_MASK_CELLS_PER_BYTE) * UNET_MASK_CLASS_BITS)) & ((1 << UNET_MASK_CLASS_BITS) - 1);
+        if (unpacked != index) {
+            printf("encode: cell %u class %u expected %u\n", (unsigned) i, (unsigned) unpacked, (unsigned) index);
+            return 1;
+        }
+        margin_sum[index] += margin;
+        count[index]++;
+    }
+
+    for (i = 0; i < UNET_MASK_CLASS_COUNT; i++) {
+        if (result.confidence[i] != (count[i] ? (margin_sum[i] / count[i]) : 0)) {
+            printf("encode: class %u confidence %u\n", (unsigned) i, result.confidence[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Per channel blend of the update_mask colours over the byte swapped RGB565 frame
+static void blend_reference(uint8_t *frame, uint32_t alpha)
+{
+    uint32_t inv_alpha = UNET_MASK_ALPHA_OPAQUE - alpha;
+    uint32_t x, y, f, m, out;
+    uint16_t mask;
+    uint8_t *p;
+
+    update_mask((uint8_t *) mask_data, MASK_INTENSITY);
+
+    for (y = 0; y < LCD_HEIGHT; y++) {
+        for (x = 0; x < LCD_WIDTH; x++) {
+            p = &frame[(y * LCD_WIDTH + x) * LCD_BYTE_PER_PIXEL];
+            f = (p[0] << 8) | p[1];
+            mask = mask_data[y * LCD_WIDTH + x];
+            m = ((mask & 0xFF) << 8) | (mask >> 8);
+
+            out  = ((((m >> 11) & 0x1F) * alpha + ((f >> 11) & 0x1F) * inv_alpha) >> 5) << 11;
+            out |= ((((m >> 5) & 0x3F) * alpha + ((f >> 5) & 0x3F) * inv_alpha) >> 5) << 5;
+            out |= (((m & 0x1F) * alpha + (f & 0x1F) * inv_alpha) >> 5);
+
+            p[0] = out >> 8;
+            p[1] = out & 0xFF;
+        }
+    }
+}
+
+static void fill_ml_data(int range)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(ml_data8); i++) {
+        ml_data8[i] = (int8_t) ((rand() % range) - (range / 2));
+    }
+}
+
+static void fill_frame(uint8_t *frame)
+{
+    uint32_t i;
+
+    for (i = 0; i < LCD_DATA_SIZE; i++) {
+        frame[i] = (uint8_t) rand();
+    }
+}
+
+static int compare(const char *name, const uint8_t *frame, const uint8_t *expected)
+{
+    uint32_t i;
+
+    for (i = 0; i < LCD_DATA_SIZE; i += LCD_BYTE_PER_PIXEL) {
+        if (memcmp(&frame[i], &expected[i], LCD_BYTE_PER_PIXEL)) {
+            printf("%s: pixel %u,%u differs\n", name,
+                    (unsigned) ((i / LCD_BYTE_PER_PIXEL) % LCD_WIDTH), (unsigned) ((i / LCD_BYTE_PER_PIXEL) / LCD_WIDTH));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static double elapsed_us(clock_t start, int iterations)
+{
+    return (double) (clock() - start) * 1000000.0 / CLOCKS_PER_SEC / iterations;
+}
+
+// Video firmware loop and MAX32666 mask path. Without credits the CNN runs on every frame and
+// the class map is bracketed by the original delays, the mask replaces the next frame. With them
+// the CNN runs once the MAX32666 has drawn the previous mask and returned its credit.
+static void simulate_link(int use_credit, sim_link_stats_t *stats)
+{
+    uint64_t now = 0;
+    uint64_t capture_start = 0;
+    uint64_t capture_end;
+    uint64_t credit_time = 0;
+    uint64_t result_rx = 0;
+    int result_pending = 0;
+
+    memset(stats, 0, sizeof(*stats));
+
+    while (now < SIM_DURATION) {
+        capture_end = capture_start + SIM_CAPTURE;
+        now = (now > capture_end) ? now : capture_end;
+
+        // Frame
+        now += SIM_TRANSFER(LCD_DATA_SIZE);
+        stats->frames++;
+
+        // Master draws the pending mask on the frame and returns the credit
+        if (use_credit && result_pending) {
+            stats->latency += now + SIM_RENDER - result_rx;
+            stats->results++;
+            result_pending = 0;
+            credit_time = now + SIM_RENDER + SIM_ACK;
+        }
+
+        if (!use_credit) {
+            now += SIM_CNN + SIM_OLD_DELAY + SIM_TRANSFER(UNET_MASK_CLASS_COUNT * UNET_MASK_PLANE_SIZE);
+            stats->latency += now + SIM_RENDER - capture_end;
+            stats->results++;
+            now += SIM_OLD_DELAY;
+        } else if ((credit_time <= now) || ((now - result_rx) >= QSPI_CREDIT_TIMEOUT * 1000ULL)) {
+            result_rx = capture_end;
+            now += SIM_CNN + SIM_ENCODE + SIM_TRANSFER(sizeof(unet_mask_result_t));
+            result_pending = 1;
+            credit_time = UINT64_MAX;
+        }
+
+        capture_start = now;
+    }
+}
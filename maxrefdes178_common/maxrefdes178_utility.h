@@ -52,6 +52,11 @@
 #define GET_RTC_MS()        ((MXC_RTC_GetSecond() * 1000) + (( MXC_RTC_GetSubSecond() / 4096.0)*1000))
 
 #define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+// CRC-16/ARC, reflected 0x8005 polynomial, used on the QSPI and BLE links
+#define CRC16_POLY          0xA001
+#define CRC16_INIT          0x0000
 
 
 //-----------------------------------------------------------------------------
@@ -62,7 +67,11 @@
 //-----------------------------------------------------------------------------
 // Function declarations
 //-----------------------------------------------------------------------------
-uint16_t crc16_sw(uint8_t *data, uint8_t len);
+uint16_t crc16_sw(uint8_t *data, uint32_t len);
+uint16_t crc16_init(void);
+uint16_t crc16_update(uint16_t crc, const uint8_t *data, uint32_t len);
+uint16_t crc16_final(uint16_t crc);
+uint16_t crc16_bitwise(uint16_t crc, const uint8_t *data, uint32_t len, uint16_t poly);
 
 
 #endif /* _MAXREFDES178_UTILITY_H_ */
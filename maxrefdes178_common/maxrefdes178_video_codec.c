@@ -0,0 +1,273 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <string.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_video_codec.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+/* Row stream tokens are 16 bit words:
+ *   0x8000 | count, value        count residuals equal to value
+ *   count, value[count]          count literal residuals
+ * A residual is the pixel XORed with the pixel above it, the first row uses zero.
+ */
+#define VIDEO_CODEC_RUN_FLAG        0x8000
+#define VIDEO_CODEC_COUNT_MASK      0x7FFF
+#define VIDEO_CODEC_MIN_RUN         3
+
+#define VIDEO_CODEC_HEADER_WORDS    (VIDEO_CODEC_HEADER_SIZE / sizeof(uint16_t))
+
+#if (LCD_HEIGHT % 16)
+#error "Raw row bitmap must be a whole number of words"
+#endif
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static const uint16_t zero_row[LCD_WIDTH] = {0};
+static uint16_t row_buffer[LCD_WIDTH];
+static uint16_t above_buffer[LCD_WIDTH];
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint32_t encode_row(const uint16_t *row, const uint16_t *above, uint16_t *out);
+static const uint16_t *decode_row(const uint16_t *in, const uint16_t *in_end, const uint16_t *above, uint16_t *row);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+// Returns the number of words in out, LCD_WIDTH if the row does not get smaller
+static uint32_t encode_row(const uint16_t *row, const uint16_t *above, uint16_t *out)
+{
+    uint32_t n = 0;
+    uint16_t *literal = NULL;
+    uint16_t residual;
+    int x = 0;
+    int run;
+
+    while (x < LCD_WIDTH) {
+        residual = row[x] ^ above[x];
+        for (run = 1; ((x + run) < LCD_WIDTH) && ((row[x + run] ^ above[x + run]) == residual); run++);
+
+        if (run >= VIDEO_CODEC_MIN_RUN) {
+            if ((n + 2) >= LCD_WIDTH) {
+                return LCD_WIDTH;
+            }
+            out[n++] = VIDEO_CODEC_RUN_FLAG | run;
+            out[n++] = residual;
+            literal = NULL;
+            x += run;
+            continue;
+        }
+
+        for (; run; run--, x++) {
+            if (!literal) {
+                if ((n + 1) >= LCD_WIDTH) {
+                    return LCD_WIDTH;
+                }
+                literal = &out[n++];
+                *literal = 0;
+            }
+            if (n >= (LCD_WIDTH - 1)) {
+                return LCD_WIDTH;
+            }
+            (*literal)++;
+            out[n++] = row[x] ^ above[x];
+        }
+    }
+
+    return n;
+}
+
+// Returns the next row in the stream, NULL if the row is invalid
+static const uint16_t *decode_row(const uint16_t *in, const uint16_t *in_end, const uint16_t *above, uint16_t *row)
+{
+    uint16_t token;
+    uint16_t value;
+    int count;
+    int x = 0;
+
+    while (x < LCD_WIDTH) {
+        if (in >= in_end) {
+            return NULL;
+        }
+        token = *in++;
+        count = token & VIDEO_CODEC_COUNT_MASK;
+        if (!count || ((x + count) > LCD_WIDTH)) {
+            return NULL;
+        }
+
+        if (token & VIDEO_CODEC_RUN_FLAG) {
+            if (in >= in_end) {
+                return NULL;
+            }
+            value = *in++;
+            for (; count; count--, x++) {
+                row[x] = value ^ above[x];
+            }
+        } else {
+            if ((in_end - in) < count) {
+                return NULL;
+            }
+            for (; count; count--, x++) {
+                row[x] = *in++ ^ above[x];
+            }
+        }
+    }
+
+    return in;
+}
+
+uint32_t video_codec_estimate(const uint8_t *frame)
+{
+    const uint16_t *pixels = (const uint16_t *) frame;
+    uint32_t words = 0;
+
+    for (int y = 0; y < LCD_HEIGHT; y += VIDEO_CODEC_ESTIMATE_STEP) {
+        words += encode_row(&pixels[y * LCD_WIDTH], y ? &pixels[(y - 1) * LCD_WIDTH] : zero_row, row_buffer);
+    }
+
+    return VIDEO_CODEC_HEADER_SIZE + (words * VIDEO_CODEC_ESTIMATE_STEP * sizeof(uint16_t));
+}
+
+/* Output never overtakes the input, a row is encoded before its words are overwritten and the row
+ * above is kept in above_buffer. The header is only made room for once a row saves enough for it,
+ * until then raw rows stay where they are.
+ */
+uint32_t video_codec_encode(uint8_t *frame)
+{
+    uint16_t *pixels = (uint16_t *) frame;
+    uint8_t raw_rows[VIDEO_CODEC_HEADER_SIZE] = {0};
+    uint32_t offset = 0;  // Header words once the header is made room for
+    uint32_t out = 0;     // Row stream words
+    uint32_t n;
+    uint16_t *row;
+
+    memcpy(above_buffer, zero_row, sizeof(above_buffer));
+
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+        row = &pixels[y * LCD_WIDTH];
+        n = encode_row(row, above_buffer, row_buffer);
+        memcpy(above_buffer, row, sizeof(above_buffer));
+
+        // Compressed rows must not leave less room than the header needs
+        if ((n < LCD_WIDTH) && !offset && (((y + 1) * LCD_WIDTH - (out + n)) < VIDEO_CODEC_HEADER_WORDS)) {
+            n = LCD_WIDTH;
+        }
+
+        if (n < LCD_WIDTH) {
+            if (!offset) {
+                memmove(&pixels[VIDEO_CODEC_HEADER_WORDS], pixels, out * sizeof(uint16_t));
+                offset = VIDEO_CODEC_HEADER_WORDS;
+            }
+            memcpy(&pixels[offset + out], row_buffer, n * sizeof(uint16_t));
+            out += n;
+        } else {
+            raw_rows[y / 8] |= 1 << (y % 8);
+            if (offset) {
+                memcpy(&pixels[offset + out], above_buffer, sizeof(above_buffer));
+            }
+            out += LCD_WIDTH;
+        }
+    }
+
+    if (!offset) {
+        return 0;
+    }
+
+    memcpy(pixels, raw_rows, sizeof(raw_rows));
+
+    return (offset + out) * sizeof(uint16_t);
+}
+
+/* Rows are written from the top while the stream is read from the end of the frame, a row never
+ * gets smaller when decoded so writes stay behind the unread part of the stream.
+ */
+video_codec_status_e video_codec_decode(uint8_t *frame, uint32_t size)
+{
+    uint16_t *pixels = (uint16_t *) frame;
+    const uint16_t *in_end = (const uint16_t *) (frame + LCD_DATA_SIZE);
+    const uint16_t *in;
+    uint8_t raw_rows[VIDEO_CODEC_HEADER_SIZE];
+    uint16_t *row;
+
+    if ((size < VIDEO_CODEC_HEADER_SIZE) || (size > LCD_DATA_SIZE) || (size % sizeof(uint16_t))) {
+        return VIDEO_CODEC_STATUS_INVALID_SIZE;
+    }
+
+    in = (const uint16_t *) (frame + LCD_DATA_SIZE - size);
+    memcpy(raw_rows, in, sizeof(raw_rows));
+    in += VIDEO_CODEC_HEADER_WORDS;
+
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+        row = &pixels[y * LCD_WIDTH];
+
+        if (raw_rows[y / 8] & (1 << (y % 8))) {
+            if ((in_end - in) < LCD_WIDTH) {
+                return VIDEO_CODEC_STATUS_INVALID_STREAM;
+            }
+            memmove(row, in, LCD_WIDTH * sizeof(uint16_t));
+            in += LCD_WIDTH;
+        } else {
+            in = decode_row(in, in_end, y ? (row - LCD_WIDTH) : zero_row, row_buffer);
+            if (!in) {
+                return VIDEO_CODEC_STATUS_INVALID_STREAM;
+            }
+            memcpy(row, row_buffer, sizeof(row_buffer));
+        }
+    }
+
+    if (in != in_end) {
+        return VIDEO_CODEC_STATUS_INVALID_STREAM;
+    }
+
+    return VIDEO_CODEC_STATUS_OK;
+}
@@ -0,0 +1,86 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+#ifndef _MAXREFDES178_VIDEO_CODEC_H_
+#define _MAXREFDES178_VIDEO_CODEC_H_
+
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include "maxrefdes178_definitions.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// Compressed frame starts with a bitmap of the rows stored raw, row stream follows
+#define VIDEO_CODEC_HEADER_SIZE     (LCD_HEIGHT / 8)
+
+// Every Nth row is encoded by video_codec_estimate
+#define VIDEO_CODEC_ESTIMATE_STEP   16
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    VIDEO_CODEC_STATUS_OK = 0,
+    VIDEO_CODEC_STATUS_INVALID_SIZE,
+    VIDEO_CODEC_STATUS_INVALID_STREAM,
+
+    VIDEO_CODEC_STATUS_LAST
+} video_codec_status_e;
+
+
+//-----------------------------------------------------------------------------
+// Function declarations
+//-----------------------------------------------------------------------------
+// Lossless LCD_WIDTH x LCD_HEIGHT RGB565 frame codec, hardware independent, also builds on a host.
+// Each row is XORed with the row above and run length encoded, rows that do not get smaller are
+// stored raw.
+
+// Returns the approximate compressed size in bytes, frame is not modified
+uint32_t video_codec_estimate(const uint8_t *frame);
+
+// Compresses the frame in place, no frame sized buffer is needed. Returns the compressed size in
+// bytes, or 0 if no row got smaller and the frame was left unchanged.
+uint32_t video_codec_encode(uint8_t *frame);
+
+// Decompresses in place, the compressed frame of size bytes must be at the end of the frame
+video_codec_status_e video_codec_decode(uint8_t *frame, uint32_t size);
+
+
+#endif /* _MAXREFDES178_VIDEO_CODEC_H_ */
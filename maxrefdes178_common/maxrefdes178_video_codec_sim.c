@@ -0,0 +1,435 @@
+/*******************************************************************************
+ * Copyright (C) 2020-2021 Maxim Integrated Products, Inc., All rights Reserved.
+ *
+ * This software is protected by copyright laws of the United States and
+ * of foreign countries. This material may also be protected by patent laws
+ * and technology transfer regulations of the United States and of foreign
+ * countries. This software is furnished under a license agreement and/or a
+ * nondisclosure agreement and may only be used or reproduced in accordance
+ * with the terms of those agreements. Dissemination of this information to
+ * any party or parties not specified in the license agreement and/or
+ * nondisclosure agreement is expressly prohibited.
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL MAXIM INTEGRATED BE LIABLE FOR ANY CLAIM, DAMAGES
+ * OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * Except as contained in this notice, the name of Maxim Integrated
+ * Products, Inc. shall not be used except as stated in the Maxim Integrated
+ * Products, Inc. Branding Policy.
+ *
+ * The mere transfer of this software does not imply any licenses
+ * of trade secrets, proprietary technology, copyrights, patents,
+ * trademarks, maskwork rights, or any other form of intellectual
+ * property whatsoever. Maxim Integrated Products, Inc. retains all
+ * ownership rights.
+ *******************************************************************************
+ */
+
+/*
+ * Host check and benchmark of the video frame codec (maxrefdes178_video_codec.c):
+ *
+ *   gcc -O2 -I. maxrefdes178_video_codec.c maxrefdes178_video_codec_sim.c -o video_codec_sim
+ *   ./video_codec_sim [iterations]
+ *
+ * Frames from flat to incompressible go through the path of the video firmware send_img and the
+ * MAX32666 qspi_video_compressed_data_rx: a frame is encoded in place when video_codec_estimate
+ * is within VIDEO_COMPRESSION_MAX_SIZE, and the compressed frame is decoded from the end of a
+ * buffer holding garbage. Decoded frames must match, frames left raw by the encoder must be
+ * unchanged and no compressed frame may be larger than LCD_DATA_SIZE.
+ *
+ * The worst cases are included: rows that save a single word, a frame that only saves the header
+ * size, and a frame whose sampled rows compress while the others do not, which the estimate lets
+ * through although it ends up above VIDEO_COMPRESSION_MAX_SIZE. Truncated streams must be refused
+ * and corrupted ones must not be decoded outside the frame.
+ *
+ * Bytes and host time per frame are reported for estimate, encode and decode, without the frame
+ * copies the benchmark needs.
+ */
+
+//-----------------------------------------------------------------------------
+// Includes
+//-----------------------------------------------------------------------------
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "maxrefdes178_definitions.h"
+#include "maxrefdes178_video_codec.h"
+
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+// max78000_video_main.c
+#define VIDEO_COMPRESSION_MAX_SIZE  (LCD_DATA_SIZE / 2)
+
+#define DEFAULT_ITERATIONS          200
+#define CORRUPTIONS                 2000
+#define GUARD_SIZE                  64
+#define STREAM_CUT_MAX              64      // Bytes lost or appended
+
+
+//-----------------------------------------------------------------------------
+// Typedefs
+//-----------------------------------------------------------------------------
+typedef enum {
+    FRAME_FLAT = 0,
+    FRAME_SCENE,
+    FRAME_TEXT,
+    FRAME_NOISE,
+    FRAME_ONE_WORD,
+    FRAME_RLE_WORST,
+    FRAME_HEADER_EDGE,
+    FRAME_ESTIMATE_MISS,
+
+    FRAME_LAST
+} frame_type_e;
+
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+static const char *frame_names[FRAME_LAST] = {
+    "flat", "scene", "text", "noise", "one word rows", "rle worst", "header edge", "estimate miss",
+};
+
+static uint16_t original[LCD_WIDTH * LCD_HEIGHT];
+static uint16_t camera[LCD_WIDTH * LCD_HEIGHT];
+// MAX32666 back buffer, guards around it catch a decoder writing outside the frame
+static uint8_t rx_buffer[GUARD_SIZE + LCD_DATA_SIZE + GUARD_SIZE];
+static uint8_t *const lcd = &rx_buffer[GUARD_SIZE];
+static uint32_t noise_state = 1;
+
+
+//-----------------------------------------------------------------------------
+// Local function declarations
+//-----------------------------------------------------------------------------
+static uint16_t noise(void);
+static void frame_generate(uint16_t *frame, frame_type_e type);
+static void receive(const uint8_t *data, uint32_t size);
+static int guards_intact(void);
+static int check_frame(frame_type_e type);
+static int check_stream_size(frame_type_e type);
+static void check_corrupted(frame_type_e type);
+static void benchmark(frame_type_e type, int iterations);
+static double elapsed_us(clock_t start, int iterations);
+
+
+//-----------------------------------------------------------------------------
+// Function definitions
+//-----------------------------------------------------------------------------
+int main(int argc, char *argv[])
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+    int errors = 0;
+
+    if (iterations <= 0) {
+        iterations = DEFAULT_ITERATIONS;
+    }
+
+    printf("%-14s %8s %9s %8s %6s\n", "frame", "estimate", "sent", "bytes", "ratio");
+    for (int type = 0; type < FRAME_LAST; type++) {
+        errors += check_frame(type);
+    }
+    errors += check_stream_size(FRAME_SCENE);
+    errors += check_stream_size(FRAME_RLE_WORST);
+    check_corrupted(FRAME_SCENE);
+    printf("codec check: %s\n", errors ? "FAILED" : "passed");
+
+    printf("\n%-14s %16s %16s %16s\n", "frame", "estimate", "encode", "decode");
+    for (int type = 0; type < FRAME_LAST; type++) {
+        benchmark(type, iterations);
+    }
+
+    return errors ? 1 : 0;
+}
+
+static uint16_t noise(void)
+{
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    return (uint16_t) noise_state;
+}
+
+static void frame_generate(uint16_t *frame, frame_type_e type)
+{
+    noise_state = 1 + type;
+
+    for (int y = 0; y < LCD_HEIGHT; y++) {
+        uint16_t *row = &frame[y * LCD_WIDTH];
+
+        for (int x = 0; x < LCD_WIDTH; x++) {
+            switch (type) {
+            case FRAME_FLAT:
+                row[x] = 0x1234;
+                break;
+            case FRAME_SCENE:
+                // Sky gradient, two objects and a band of sensor detail
+                row[x] = (uint16_t) (y / 8) << 11 | 0x001F;
+                if ((x >= 40) && (x < 120) && (y >= 100) && (y < 200)) {
+                    row[x] = 0x07E0;
+                }
+                if (((x - 170) * (x - 170) + (y - 60) * (y - 60)) < 900) {
+                    row[x] = 0xFFE0;
+                }
+                if ((y >= 150) && (y < 182)) {
+                    row[x] = noise();
+                }
+                break;
+            case FRAME_TEXT:
+                // Lines of glyph pixels over a flat background
+                row[x] = (((y % 24) < 10) && ((noise() % 4) == 0)) ? 0xFFFF : 0x0000;
+                break;
+            case FRAME_NOISE:
+                row[x] = noise();
+                break;
+            case FRAME_ONE_WORD:
+                // Every row saves a single word, one run then literals, never enough for the header
+                row[x] = (x < 4) ? 0 : noise();
+                break;
+            case FRAME_RLE_WORST:
+                // The first row saves the header, the others a single word, one run then literals
+                row[x] = (x < (y ? 4 : 18)) ? 0 : noise();
+                break;
+            case FRAME_HEADER_EDGE:
+                // The first row saves just the header, the others are stored raw
+                row[x] = ((y == 0) && (x < 18)) ? 0 : noise();
+                break;
+            case FRAME_ESTIMATE_MISS:
+                // Only the rows video_codec_estimate samples repeat the row above
+                row[x] = (y % VIDEO_CODEC_ESTIMATE_STEP) ? noise() : (y ? frame[(y - 1) * LCD_WIDTH + x] : 0);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+}
+
+// The compressed frame arrives at the end of a back buffer holding the previous frame
+static void receive(const uint8_t *data, uint32_t size)
+{
+    memset(rx_buffer, 0xA5, sizeof(rx_buffer));
+    memmove(&lcd[LCD_DATA_SIZE - size], data, size);
+}
+
+static int guards_intact(void)
+{
+    for (int i = 0; i < GUARD_SIZE; i++) {
+        if ((rx_buffer[i] != 0xA5) || (rx_buffer[GUARD_SIZE + LCD_DATA_SIZE + i] != 0xA5)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int check_frame(frame_type_e type)
+{
+    uint32_t estimate;
+    uint32_t size = 0;
+    video_codec_status_e status;
+    int errors = 0;
+
+    frame_generate(original, type);
+    memcpy(camera, original, LCD_DATA_SIZE);
+
+    // send_img
+    estimate = video_codec_estimate((uint8_t *) camera);
+    if (memcmp(camera, original, LCD_DATA_SIZE)) {
+        printf("FAIL: %s estimate modified the frame\n", frame_names[type]);
+        errors++;
+    }
+    size = video_codec_encode((uint8_t *) camera);
+
+    if (!size) {
+        if (memcmp(camera, original, LCD_DATA_SIZE)) {
+            printf("FAIL: %s frame left raw but modified\n", frame_names[type]);
+            errors++;
+        }
+    } else if ((size < VIDEO_CODEC_HEADER_SIZE) || (size > LCD_DATA_SIZE) || (size % sizeof(uint16_t))) {
+        printf("FAIL: %s compressed to %u bytes\n", frame_names[type], size);
+        errors++;
+    } else {
+        // qspi_video_compressed_data_rx
+        receive((uint8_t *) camera, size);
+        status = video_codec_decode(lcd, size);
+        if (status != VIDEO_CODEC_STATUS_OK) {
+            printf("FAIL: %s decode status %d\n", frame_names[type], status);
+            errors++;
+        } else if (memcmp(lcd, original, LCD_DATA_SIZE) || !guards_intact()) {
+            printf("FAIL: %s decoded frame differs\n", frame_names[type]);
+            errors++;
+        }
+    }
+
+    // Frames the firmware should and should not compress
+    if ((type == FRAME_FLAT) || (type == FRAME_SCENE) || (type == FRAME_TEXT)) {
+        if ((estimate > VIDEO_COMPRESSION_MAX_SIZE) || !size || (size > VIDEO_COMPRESSION_MAX_SIZE)) {
+            printf("FAIL: %s estimate %u, compressed %u bytes\n", frame_names[type], estimate, size);
+            errors++;
+        }
+    } else if ((type == FRAME_NOISE) && (size || (estimate <= VIDEO_COMPRESSION_MAX_SIZE))) {
+        printf("FAIL: noise estimate %u, compressed %u bytes\n", estimate, size);
+        errors++;
+    } else if ((type == FRAME_ONE_WORD) && size) {
+        printf("FAIL: %s compressed without room for the header\n", frame_names[type]);
+        errors++;
+    }
+
+    printf("%-14s %8u %9s %8u %5.1f%%%s\n", frame_names[type], estimate,
+            (estimate <= VIDEO_COMPRESSION_MAX_SIZE) ? "compressed" : "raw", size ? size : LCD_DATA_SIZE,
+            100.0 * (size ? size : LCD_DATA_SIZE) / LCD_DATA_SIZE,
+            (size > VIDEO_COMPRESSION_MAX_SIZE) ? ", above VIDEO_COMPRESSION_MAX_SIZE" : "");
+
+    return errors;
+}
+
+// Streams missing words at either end or followed by extra words, the decoder must refuse them
+static int check_stream_size(frame_type_e type)
+{
+    static uint8_t padded[LCD_DATA_SIZE];
+    uint32_t size;
+    video_codec_status_e status;
+    int errors = 0;
+
+    frame_generate(original, type);
+    memcpy(camera, original, LCD_DATA_SIZE);
+    size = video_codec_encode((uint8_t *) camera);
+    if (!size || ((size + STREAM_CUT_MAX) > LCD_DATA_SIZE)) {
+        printf("FAIL: %s compressed to %u bytes\n", frame_names[type], size);
+        return 1;
+    }
+
+    for (uint32_t cut = sizeof(uint16_t); cut <= STREAM_CUT_MAX; cut += sizeof(uint16_t)) {
+        // Tail lost
+        receive((uint8_t *) camera, size - cut);
+        status = video_codec_decode(lcd, size - cut);
+        if ((status == VIDEO_CODEC_STATUS_OK) || !guards_intact()) {
+            printf("FAIL: %s stream without its last %u bytes decoded\n", frame_names[type], cut);
+            errors++;
+        }
+
+        // Head lost
+        receive((uint8_t *) camera + cut, size - cut);
+        status = video_codec_decode(lcd, size - cut);
+        if ((status == VIDEO_CODEC_STATUS_OK) || !guards_intact()) {
+            printf("FAIL: %s stream without its first %u bytes decoded\n", frame_names[type], cut);
+            errors++;
+        }
+
+        // Extra words after the stream
+        memcpy(padded, camera, size);
+        memset(&padded[size], 0, cut);
+        receive(padded, size + cut);
+        status = video_codec_decode(lcd, size + cut);
+        if ((status == VIDEO_CODEC_STATUS_OK) || !guards_intact()) {
+            printf("FAIL: %s stream followed by %u bytes decoded\n", frame_names[type], cut);
+            errors++;
+        }
+    }
+
+    printf("truncated and padded %s streams: refused\n", frame_names[type]);
+    return errors;
+}
+
+// A corrupted word may still decode to a wrong frame, but never outside the back buffer
+static void check_corrupted(frame_type_e type)
+{
+    static uint16_t compressed[LCD_WIDTH * LCD_HEIGHT];
+    uint32_t size;
+    int refused = 0;
+    int decoded = 0;
+    int escaped = 0;
+
+    frame_generate(original, type);
+    memcpy(compressed, original, LCD_DATA_SIZE);
+    size = video_codec_encode((uint8_t *) compressed);
+    noise_state = 12345;
+
+    for (int i = 0; i < CORRUPTIONS; i++) {
+        receive((uint8_t *) compressed, size);
+        lcd[LCD_DATA_SIZE - size + (noise() % size)] ^= (uint8_t) (1 << (noise() % 8));
+        if (video_codec_decode(lcd, size) == VIDEO_CODEC_STATUS_OK) {
+            decoded++;
+        } else {
+            refused++;
+        }
+        escaped += !guards_intact();
+    }
+
+    printf("corrupted %s streams: %d refused, %d decoded, %d written outside the frame\n",
+            frame_names[type], refused, decoded, escaped);
+}
+
+static void benchmark(frame_type_e type, int iterations)
+{
+    static uint16_t compressed[LCD_WIDTH * LCD_HEIGHT];
+    volatile uint32_t sink = 0;
+    double copy_us, receive_us, estimate_us, encode_us, decode_us = 0;
+    uint32_t size;
+    clock_t start;
+
+    frame_generate(original, type);
+    memcpy(compressed, original, LCD_DATA_SIZE);
+    size = video_codec_encode((uint8_t *) compressed);
+
+    start = clock();
+    for (int i = 0; i < iterations; i++) {
+        sink += video_codec_estimate((uint8_t *) original);
+    }
+    estimate_us = elapsed_us(start, iterations);
+
+    // Encode and decode work in place, the frame copies are timed alone and taken off
+    start = clock();
+    for (int i = 0; i < iterations; i++) {
+        memcpy(camera, original, LCD_DATA_SIZE);
+        sink += camera[i % LCD_WIDTH];
+    }
+    copy_us = elapsed_us(start, iterations);
+
+    start = clock();
+    for (int i = 0; i < iterations; i++) {
+        memcpy(camera, original, LCD_DATA_SIZE);
+        sink += video_codec_encode((uint8_t *) camera);
+    }
+    encode_us = elapsed_us(start, iterations) - copy_us;
+
+    if (size) {
+        start = clock();
+        for (int i = 0; i < iterations; i++) {
+            receive((uint8_t *) compressed, size);
+            sink += lcd[i % LCD_DATA_SIZE];
+        }
+        receive_us = elapsed_us(start, iterations);
+
+        start = clock();
+        for (int i = 0; i < iterations; i++) {
+            receive((uint8_t *) compressed, size);
+            sink += video_codec_decode(lcd, size);
+        }
+        decode_us = elapsed_us(start, iterations) - receive_us;
+    }
+    (void) sink;
+
+    printf("%-14s %7.1f us/frame %7.1f us/frame", frame_names[type], estimate_us, encode_us);
+    if (size) {
+        printf(" %7.1f us/frame\n", decode_us);
+    } else {
+        printf("          raw\n");
+    }
+}
+
+static double elapsed_us(clock_t start, int iterations)
+{
+    return (double) (clock() - start) * 1000000.0 / CLOCKS_PER_SEC / iterations;
+}